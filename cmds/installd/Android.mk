@@ -1,6 +1,6 @@
 LOCAL_PATH := $(call my-dir)
 
-common_src_files := commands.cpp globals.cpp utils.cpp
+common_src_files := app_size.cpp commands.cpp globals.cpp scheduler.cpp utils.cpp
 common_cflags := -Wall -Werror
 
 #
@@ -0,0 +1,427 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "app_size.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+
+#include <android-base/logging.h>
+#include <diskusage/dirsize.h>
+
+namespace android {
+namespace installd {
+
+// Enough for most directories to be read with a single getdents64.
+static constexpr size_t kDirentBufferSize = 64 * 1024;
+
+static bool is_dot_or_dot_dot(const char* name) {
+    return name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0));
+}
+
+namespace {
+
+// Walks the trees with a few threads, each keeping the directories it finds in its own queue and
+// taking the oldest directory of another thread's queue when its own is empty. The oldest ones are
+// the closest to the roots, and so are likely to hold the most to share out.
+class TreeWalker {
+  public:
+    explicit TreeWalker(size_t num_threads);
+
+    void Run(const std::vector<std::string>& roots, std::vector<int64_t>* sizes);
+
+  private:
+    struct Directory {
+        std::string path;
+        size_t root;
+    };
+
+    struct Worker {
+        std::mutex lock;
+        std::deque<Directory> queue;
+        std::vector<int64_t> sizes;
+        std::unique_ptr<char[]> buffer;
+    };
+
+    void WorkerLoop(size_t self);
+    void Push(size_t self, Directory directory);
+    bool Pop(size_t self, Directory* directory);
+    void Walk(size_t self, const Directory& directory);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // Directories in the queues, and directories in the queues or being walked.
+    std::atomic<size_t> queued_;
+    std::atomic<size_t> unfinished_;
+    std::atomic<size_t> waiting_;
+    std::mutex idle_lock_;
+    std::condition_variable idle_;
+};
+
+TreeWalker::TreeWalker(size_t num_threads) : queued_(0), unfinished_(0), waiting_(0) {
+    for (size_t i = 0; i < std::max<size_t>(num_threads, 1); ++i) {
+        workers_.emplace_back(new Worker());
+    }
+}
+
+void TreeWalker::Run(const std::vector<std::string>& roots, std::vector<int64_t>* sizes) {
+    for (auto& worker : workers_) {
+        worker->sizes.assign(roots.size(), 0);
+        worker->buffer.reset(new char[kDirentBufferSize]);
+    }
+    for (size_t i = 0; i < roots.size(); ++i) {
+        Push(i % workers_.size(), Directory{roots[i], i});
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        threads.emplace_back(&TreeWalker::WorkerLoop, this, i);
+    }
+    WorkerLoop(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    sizes->resize(roots.size(), 0);
+    for (auto& worker : workers_) {
+        for (size_t i = 0; i < roots.size(); ++i) {
+            (*sizes)[i] += worker->sizes[i];
+        }
+    }
+}
+
+void TreeWalker::WorkerLoop(size_t self) {
+    for (;;) {
+        Directory directory;
+        if (Pop(self, &directory)) {
+            Walk(self, directory);
+            if (--unfinished_ == 0) {
+                std::lock_guard<std::mutex> lock(idle_lock_);
+                idle_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idle_lock_);
+        waiting_++;
+        idle_.wait(lock, [this]() { return unfinished_ == 0 || queued_ > 0; });
+        waiting_--;
+        if (unfinished_ == 0) {
+            return;
+        }
+    }
+}
+
+void TreeWalker::Push(size_t self, Directory directory) {
+    unfinished_++;
+    {
+        std::lock_guard<std::mutex> lock(workers_[self]->lock);
+        workers_[self]->queue.push_back(std::move(directory));
+    }
+    queued_++;
+    // A thread that starts waiting after this sees queued_, one waiting already needs waking.
+    if (waiting_ > 0) {
+        std::lock_guard<std::mutex> lock(idle_lock_);
+        idle_.notify_one();
+    }
+}
+
+bool TreeWalker::Pop(size_t self, Directory* directory) {
+    {
+        Worker& worker = *workers_[self];
+        std::lock_guard<std::mutex> lock(worker.lock);
+        if (!worker.queue.empty()) {
+            *directory = std::move(worker.queue.back());
+            worker.queue.pop_back();
+            queued_--;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        Worker& victim = *workers_[(self + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.lock);
+        if (!victim.queue.empty()) {
+            *directory = std::move(victim.queue.front());
+            victim.queue.pop_front();
+            queued_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TreeWalker::Walk(size_t self, const Directory& directory) {
+    Worker& worker = *workers_[self];
+    int fd = open(directory.path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    int64_t size = 0;
+    char* buffer = worker.buffer.get();
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, buffer, kDirentBufferSize);
+        if (n <= 0) {
+            break;
+        }
+        for (long pos = 0; pos < n;) {
+            const struct dirent64* de = reinterpret_cast<const struct dirent64*>(buffer + pos);
+            pos += de->d_reclen;
+            if (is_dot_or_dot_dot(de->d_name)) {
+                continue;
+            }
+            struct stat s;
+            if (fstatat(fd, de->d_name, &s, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            size += stat_size(&s);
+            if (S_ISDIR(s.st_mode)) {
+                Push(self, Directory{directory.path + "/" + de->d_name, directory.root});
+            }
+        }
+    }
+    close(fd);
+    worker.sizes[directory.root] += size;
+}
+
+}  // namespace
+
+void calculate_tree_sizes(const std::vector<std::string>& roots, size_t max_threads,
+                          std::vector<int64_t>* sizes) {
+    if (roots.empty()) {
+        return;
+    }
+    // More threads than cores only contend for them, the storage is kept busy either way.
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    TreeWalker walker(std::min(max_threads, static_cast<size_t>(std::max(cores, 1L))));
+    walker.Run(roots, sizes);
+}
+
+static DirStamp get_dir_stamp(int fd) {
+    DirStamp stamp = {};
+    struct stat s;
+    if (fstat(fd, &s) == 0) {
+        stamp.dev = s.st_dev;
+        stamp.ino = s.st_ino;
+        stamp.mtime_ns = s.st_mtim.tv_sec * 1000000000LL + s.st_mtim.tv_nsec;
+        stamp.ctime_ns = s.st_ctim.tv_sec * 1000000000LL + s.st_ctim.tv_nsec;
+    }
+    // Not every file system has generations, the other fields have to do there.
+    int generation = 0;
+    if (ioctl(fd, FS_IOC_GETVERSION, &generation) == 0) {
+        stamp.generation = generation;
+    }
+    return stamp;
+}
+
+void get_dir_stamps(const std::string& path, std::vector<DirStamp>* stamps) {
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        stamps->push_back(DirStamp{});
+        return;
+    }
+    stamps->push_back(get_dir_stamp(fd));
+
+    DIR* d = fdopendir(fd);
+    if (d == nullptr) {
+        close(fd);
+        return;
+    }
+    struct dirent* de;
+    while ((de = readdir(d))) {
+        if ((de->d_type != DT_DIR && de->d_type != DT_UNKNOWN) || is_dot_or_dot_dot(de->d_name)) {
+            continue;
+        }
+        int subfd = openat(fd, de->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (subfd >= 0) {
+            stamps->push_back(get_dir_stamp(subfd));
+            close(subfd);
+        }
+    }
+    closedir(d);
+}
+
+static int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+AppSizeCache::AppSizeCache(int64_t max_age_ms) : max_age_ms_(max_age_ms) {
+}
+
+bool AppSizeCache::Lookup(const std::string& key, const std::vector<DirStamp>& stamps,
+                          AppSize* size) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return false;
+    }
+    if (now_ms() - it->second.time_ms > max_age_ms_ || !(it->second.stamps == stamps)) {
+        entries_.erase(it);
+        return false;
+    }
+    *size = it->second.size;
+    return true;
+}
+
+void AppSizeCache::Store(const std::string& key, const std::string& package,
+                         const std::string& code_path, const std::vector<DirStamp>& stamps,
+                         const AppSize& size) {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->second.package == package && it->second.code_path != code_path) {
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    entries_[key] = Entry{package, code_path, stamps, size, now_ms()};
+}
+
+void AppSizeCache::Invalidate(const std::string& package) {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->second.package == package) {
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void AppSizeCache::InvalidateAll() {
+    std::lock_guard<std::mutex> lock(lock_);
+    entries_.clear();
+}
+
+void AppSizeCache::InvalidateCodePath(const std::string& path) {
+    std::lock_guard<std::mutex> lock(lock_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        const std::string& code_path = it->second.code_path;
+        if (path.compare(0, code_path.size(), code_path) == 0
+                && (path.size() == code_path.size() || path[code_path.size()] == '/')) {
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Adds the sizes of the entries of an app data directory, and its subdirectories to roots, along
+// with the total each of them counts towards.
+static void add_app_data_size(const std::string& path, int64_t *codesize, int64_t *datasize,
+        int64_t *cachesize, std::vector<std::string>* roots, std::vector<int64_t*>* totals) {
+    DIR *d;
+    int dfd;
+    struct dirent *de;
+    struct stat s;
+
+    d = opendir(path.c_str());
+    if (d == nullptr) {
+        PLOG(WARNING) << "Failed to open " << path;
+        return;
+    }
+    dfd = dirfd(d);
+    while ((de = readdir(d))) {
+        const char *name = de->d_name;
+
+        int64_t statsize = 0;
+        if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+            statsize = stat_size(&s);
+        }
+
+        if (de->d_type == DT_DIR) {
+            /* always skip "." and ".." */
+            if (is_dot_or_dot_dot(name)) {
+                continue;
+            }
+            roots->push_back(path + "/" + name);
+            *datasize += statsize;
+            // TODO: check xattrs!
+            if (!strcmp(name, "cache") || !strcmp(name, "code_cache")) {
+                totals->push_back(cachesize);
+            } else {
+                totals->push_back(datasize);
+            }
+        } else if (de->d_type == DT_LNK && !strcmp(name, "lib")) {
+            *codesize += statsize;
+        } else {
+            *datasize += statsize;
+        }
+    }
+    closedir(d);
+}
+
+void calculate_app_sizes(const std::vector<AppPaths>& apps, size_t max_threads,
+                         AppSizeCache* cache, std::vector<AppSize>* sizes) {
+    sizes->assign(apps.size(), AppSize{0, 0, 0});
+    std::vector<std::string> keys(apps.size());
+    std::vector<std::vector<DirStamp>> stamps(apps.size());
+    std::vector<bool> cached(apps.size(), false);
+    std::vector<std::string> roots;
+    std::vector<int64_t*> totals;
+
+    for (size_t i = 0; i < apps.size(); i++) {
+        const AppPaths& app = apps[i];
+        AppSize* size = &(*sizes)[i];
+
+        // The paths tell apart the users, volumes and storage of the package.
+        keys[i] = app.code_path;
+        get_dir_stamps(app.code_path, &stamps[i]);
+        for (const std::string& path : app.data_paths) {
+            keys[i] += "\n" + path;
+            get_dir_stamps(path, &stamps[i]);
+        }
+        if (cache->Lookup(keys[i], stamps[i], size)) {
+            cached[i] = true;
+            continue;
+        }
+
+        roots.push_back(app.code_path);
+        totals.push_back(&size->codesize);
+        for (const std::string& path : app.data_paths) {
+            add_app_data_size(path, &size->codesize, &size->datasize, &size->cachesize, &roots,
+                    &totals);
+        }
+    }
+
+    std::vector<int64_t> root_sizes;
+    calculate_tree_sizes(roots, max_threads, &root_sizes);
+    for (size_t i = 0; i < roots.size(); i++) {
+        *totals[i] += root_sizes[i];
+    }
+    for (size_t i = 0; i < apps.size(); i++) {
+        if (!cached[i]) {
+            cache->Store(keys[i], apps[i].package, apps[i].code_path, stamps[i], (*sizes)[i]);
+        }
+    }
+}
+
+}  // namespace installd
+}  // namespace android
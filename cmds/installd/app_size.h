@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APP_SIZE_H_
+#define APP_SIZE_H_
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace installd {
+
+// Adds the space used by the files and directories under each of roots, the roots themselves not
+// included, to the matching element of sizes. The subdirectories are shared out between up to
+// max_threads threads, and no more than the online cores, which take directories from each other
+// once they run out.
+void calculate_tree_sizes(const std::vector<std::string>& roots, size_t max_threads,
+                          std::vector<int64_t>* sizes);
+
+// What identifies the entries of a directory: they only change along with its mtime and ctime, and
+// the generation tells it from a later directory reusing the inode.
+struct DirStamp {
+    dev_t dev;
+    ino_t ino;
+    uint32_t generation;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+
+    bool operator==(const DirStamp& other) const {
+        return dev == other.dev && ino == other.ino && generation == other.generation
+                && mtime_ns == other.mtime_ns && ctime_ns == other.ctime_ns;
+    }
+};
+
+// Appends the stamps of path and of its subdirectories to stamps. A missing path gets an empty
+// stamp, so that creating it changes the result.
+void get_dir_stamps(const std::string& path, std::vector<DirStamp>* stamps);
+
+struct AppSize {
+    int64_t codesize;
+    int64_t datasize;
+    int64_t cachesize;
+};
+
+// Recent sizes of apps, each kept while the stamps of its directories stay the same and for at most
+// max_age_ms. The stamps notice files being added and removed near the top of the app directories,
+// but not a file growing in place or changes further down, hence the age limit; installd drops the
+// sizes of the apps its commands change.
+class AppSizeCache {
+  public:
+    explicit AppSizeCache(int64_t max_age_ms);
+
+    // Returns whether a size was stored for key with the same stamps, recently enough.
+    bool Lookup(const std::string& key, const std::vector<DirStamp>& stamps, AppSize* size);
+    // Also drops the sizes of package with its code at another path, from before an update.
+    void Store(const std::string& key, const std::string& package, const std::string& code_path,
+               const std::vector<DirStamp>& stamps, const AppSize& size);
+
+    // Drops the sizes of package, or of every app.
+    void Invalidate(const std::string& package);
+    void InvalidateAll();
+    // Drops the sizes of the apps whose code path is path or holds it, e.g. an oat directory.
+    void InvalidateCodePath(const std::string& path);
+
+  private:
+    struct Entry {
+        std::string package;
+        std::string code_path;
+        std::vector<DirStamp> stamps;
+        AppSize size;
+        int64_t time_ms;
+    };
+
+    std::mutex lock_;
+    std::map<std::string, Entry> entries_;
+    const int64_t max_age_ms_;
+};
+
+// Where the files of an app are: its code, and its data directories on the storage asked about.
+struct AppPaths {
+    std::string package;
+    std::string code_path;
+    std::vector<std::string> data_paths;
+};
+
+// Computes the sizes of apps, or takes them from cache. The trees of all the apps are walked at
+// once, so that the threads share out the apps as well as their directories. Everything under a
+// data directory counts as data, except for what is under cache and code_cache, which counts as
+// cache, and the lib link, which counts as code.
+void calculate_app_sizes(const std::vector<AppPaths>& apps, size_t max_threads,
+                         AppSizeCache* cache, std::vector<AppSize>* sizes);
+
+}  // namespace installd
+}  // namespace android
+
+#endif  // APP_SIZE_H_
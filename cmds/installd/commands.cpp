@@ -42,6 +42,7 @@
 #include <selinux/android.h>
 #include <system/thread_defs.h>
 
+#include <app_size.h>
 #include <globals.h>
 #include <installd_deps.h>
 #include <otapreopt_utils.h>
@@ -82,6 +83,14 @@ static constexpr int DEXOPT_SELF_PATCHOAT_NEEDED = 3;
 
 #define MIN_RESTRICTED_HOME_SDK_VERSION 24 // > M
 
+// Threads walking the app directories for get_app_size. The storage rather than the CPU is the
+// limit, and a few requests in flight are enough to keep it busy.
+static constexpr size_t kAppSizeThreads = 4;
+// How long get_app_size may answer with sizes it computed before, see AppSizeCache.
+static constexpr int64_t kAppSizeMaxAgeMs = 30 * 1000;
+
+static AppSizeCache app_size_cache(kAppSizeMaxAgeMs);
+
 typedef int fd_t;
 
 static bool property_get_bool(const char* property_name, bool default_value = false) {
@@ -166,6 +175,7 @@ static int prepare_app_dir(const std::string& parent, const char* name, mode_t t
 
 int create_app_data(const char *uuid, const char *pkgname, userid_t userid, int flags,
         appid_t appid, const char* seinfo, int target_sdk_version) {
+    app_size_cache.Invalidate(pkgname);
     uid_t uid = multiuser_get_uid(userid, appid);
     mode_t target_mode = target_sdk_version >= MIN_RESTRICTED_HOME_SDK_VERSION ? 0700 : 0751;
     if (flags & FLAG_STORAGE_CE) {
@@ -230,6 +240,7 @@ int create_app_data(const char *uuid, const char *pkgname, userid_t userid, int
 }
 
 int migrate_app_data(const char *uuid, const char *pkgname, userid_t userid, int flags) {
+    app_size_cache.Invalidate(pkgname);
     // This method only exists to upgrade system apps that have requested
     // forceDeviceEncrypted, so their default storage always lives in a
     // consistent location.  This only works on non-FBE devices, since we
@@ -345,6 +356,7 @@ int clear_app_profiles(const char* pkgname) {
 
 int clear_app_data(const char *uuid, const char *pkgname, userid_t userid, int flags,
         ino_t ce_data_inode) {
+    app_size_cache.Invalidate(pkgname);
     int res = 0;
     if (flags & FLAG_STORAGE_CE) {
         auto path = create_data_user_ce_package_path(uuid, userid, pkgname, ce_data_inode);
@@ -406,6 +418,7 @@ int destroy_app_profiles(const char *pkgname) {
 
 int destroy_app_data(const char *uuid, const char *pkgname, userid_t userid, int flags,
         ino_t ce_data_inode) {
+    app_size_cache.Invalidate(pkgname);
     int res = 0;
     if (flags & FLAG_STORAGE_CE) {
         res |= delete_dir_contents_and_dir(
@@ -425,6 +438,7 @@ int destroy_app_data(const char *uuid, const char *pkgname, userid_t userid, int
 
 int move_complete_app(const char *from_uuid, const char *to_uuid, const char *package_name,
         const char *data_app_name, appid_t appid, const char* seinfo, int target_sdk_version) {
+    app_size_cache.Invalidate(package_name);
     std::vector<userid_t> users = get_known_users(from_uuid);
 
     // Copy app
@@ -561,6 +575,7 @@ int create_user_data(const char *uuid, userid_t userid, int user_serial ATTRIBUT
 }
 
 int destroy_user_data(const char *uuid, userid_t userid, int flags) {
+    app_size_cache.InvalidateAll();
     int res = 0;
     if (flags & FLAG_STORAGE_DE) {
         res |= delete_dir_contents_and_dir(create_data_user_de_path(uuid, userid), true);
@@ -584,6 +599,7 @@ int destroy_user_data(const char *uuid, userid_t userid, int flags) {
  * when just reading from the cache, which is pretty awful.
  */
 int free_cache(const char *uuid, int64_t free_size) {
+    app_size_cache.InvalidateAll();
     cache_t* cache;
     int64_t avail;
 
@@ -613,6 +629,7 @@ int free_cache(const char *uuid, int64_t free_size) {
 
 int rm_dex(const char *path, const char *instruction_set)
 {
+    app_size_cache.InvalidateAll();
     char dex_path[PKG_PATH_MAX];
 
     if (validate_apk_path(path) && validate_system_app_path(path)) {
@@ -633,83 +650,53 @@ int rm_dex(const char *path, const char *instruction_set)
     }
 }
 
-static void add_app_data_size(std::string& path, int64_t *codesize, int64_t *datasize,
-        int64_t *cachesize) {
-    DIR *d;
-    int dfd;
-    struct dirent *de;
-    struct stat s;
-
-    d = opendir(path.c_str());
-    if (d == nullptr) {
-        PLOG(WARNING) << "Failed to open " << path;
-        return;
-    }
-    dfd = dirfd(d);
-    while ((de = readdir(d))) {
-        const char *name = de->d_name;
-
-        int64_t statsize = 0;
-        if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
-            statsize = stat_size(&s);
+// The paths get_app_size walks for each of pkgnames.
+static std::vector<AppPaths> get_app_paths(const char *uuid,
+        const std::vector<std::string>& pkgnames, int userid, int flags,
+        const std::vector<ino_t>& ce_data_inodes, const std::vector<std::string>& code_paths) {
+    std::vector<AppPaths> apps(pkgnames.size());
+    for (size_t i = 0; i < pkgnames.size(); i++) {
+        const char *pkgname = pkgnames[i].c_str();
+        apps[i].package = pkgnames[i];
+        apps[i].code_path = code_paths[i];
+        if (flags & FLAG_STORAGE_CE) {
+            apps[i].data_paths.push_back(
+                    create_data_user_ce_package_path(uuid, userid, pkgname, ce_data_inodes[i]));
         }
-
-        if (de->d_type == DT_DIR) {
-            int subfd;
-            int64_t dirsize = 0;
-            /* always skip "." and ".." */
-            if (name[0] == '.') {
-                if (name[1] == 0) continue;
-                if ((name[1] == '.') && (name[2] == 0)) continue;
-            }
-            subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY);
-            if (subfd >= 0) {
-                dirsize = calculate_dir_size(subfd);
-                close(subfd);
-            }
-            // TODO: check xattrs!
-            if (!strcmp(name, "cache") || !strcmp(name, "code_cache")) {
-                *datasize += statsize;
-                *cachesize += dirsize;
-            } else {
-                *datasize += dirsize + statsize;
-            }
-        } else if (de->d_type == DT_LNK && !strcmp(name, "lib")) {
-            *codesize += statsize;
-        } else {
-            *datasize += statsize;
+        if (flags & FLAG_STORAGE_DE) {
+            apps[i].data_paths.push_back(create_data_user_de_package_path(uuid, userid, pkgname));
         }
     }
-    closedir(d);
+    return apps;
 }
 
 int get_app_size(const char *uuid, const char *pkgname, int userid, int flags, ino_t ce_data_inode,
         const char *code_path, int64_t *codesize, int64_t *datasize, int64_t *cachesize,
         int64_t* asecsize) {
-    DIR *d;
-    int dfd;
-
-    d = opendir(code_path);
-    if (d != nullptr) {
-        dfd = dirfd(d);
-        *codesize += calculate_dir_size(dfd);
-        closedir(d);
-    }
-
-    if (flags & FLAG_STORAGE_CE) {
-        auto path = create_data_user_ce_package_path(uuid, userid, pkgname, ce_data_inode);
-        add_app_data_size(path, codesize, datasize, cachesize);
-    }
-    if (flags & FLAG_STORAGE_DE) {
-        auto path = create_data_user_de_package_path(uuid, userid, pkgname);
-        add_app_data_size(path, codesize, datasize, cachesize);
-    }
+    std::vector<AppSize> sizes;
+    calculate_app_sizes(get_app_paths(uuid, { pkgname }, userid, flags, { ce_data_inode },
+            { code_path }), kAppSizeThreads, &app_size_cache, &sizes);
+    *codesize += sizes[0].codesize;
+    *datasize += sizes[0].datasize;
+    *cachesize += sizes[0].cachesize;
 
     *asecsize = 0;
 
     return 0;
 }
 
+int get_app_sizes(const char *uuid, const std::vector<std::string>& pkgnames, int userid,
+        int flags, const std::vector<ino_t>& ce_data_inodes,
+        const std::vector<std::string>& code_paths, std::vector<AppSize>* sizes) {
+    if (ce_data_inodes.size() != pkgnames.size() || code_paths.size() != pkgnames.size()) {
+        LOG(ERROR) << "get_app_sizes needs an inode and a code path per package";
+        return -1;
+    }
+    calculate_app_sizes(get_app_paths(uuid, pkgnames, userid, flags, ce_data_inodes, code_paths),
+            kAppSizeThreads, &app_size_cache, sizes);
+    return 0;
+}
+
 int get_app_data_inode(const char *uuid, const char *pkgname, int userid, int flags, ino_t *inode) {
     if (flags & FLAG_STORAGE_CE) {
         auto path = create_data_user_ce_package_path(uuid, userid, pkgname);
@@ -758,9 +745,7 @@ static void run_patchoat(int input_fd, int oat_fd, const char* input_file_name,
 
     static const char* PATCHOAT_BIN = "/system/bin/patchoat";
     if (strlen(instruction_set) >= MAX_INSTRUCTION_SET_LEN) {
-        ALOGE("Instruction set %s longer than max length of %d",
-              instruction_set, MAX_INSTRUCTION_SET_LEN);
-        return;
+        _exit(69);
     }
 
     /* input_file_name/input_fd should be the .odex/.oat file that is precompiled. I think*/
@@ -787,7 +772,6 @@ static void run_patchoat(int input_fd, int oat_fd, const char* input_file_name,
     argv[6] = NULL;
 
     execv(PATCHOAT_BIN, (char* const *)argv);
-    ALOGE("execv(%s) failed: %s\n", PATCHOAT_BIN, strerror(errno));
 }
 
 static void run_dex2oat(int zip_fd, int oat_fd, int image_fd, const char* input_file_name,
@@ -797,9 +781,7 @@ static void run_dex2oat(int zip_fd, int oat_fd, int image_fd, const char* input_
     static const unsigned int MAX_INSTRUCTION_SET_LEN = 7;
 
     if (strlen(instruction_set) >= MAX_INSTRUCTION_SET_LEN) {
-        ALOGE("Instruction set %s longer than max length of %d",
-              instruction_set, MAX_INSTRUCTION_SET_LEN);
-        return;
+        _exit(69);
     }
 
     char dex2oat_Xms_flag[kPropertyValueMax];
@@ -1033,7 +1015,6 @@ static void run_dex2oat(int zip_fd, int oat_fd, int image_fd, const char* input_
     argv[i] = NULL;
 
     execv(DEX2OAT_BIN, (char * const *)argv);
-    ALOGE("execv(%s) failed: %s\n", DEX2OAT_BIN, strerror(errno));
 }
 
 /*
@@ -1085,12 +1066,10 @@ static bool ShouldUseSwapFileForDexopt() {
 static void SetDex2OatAndPatchOatScheduling(bool set_to_bg) {
     if (set_to_bg) {
         if (set_sched_policy(0, SP_BACKGROUND) < 0) {
-            ALOGE("set_sched_policy failed: %s\n", strerror(errno));
-            exit(70);
+            _exit(70);
         }
         if (setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_BACKGROUND) < 0) {
-            ALOGE("setpriority failed: %s\n", strerror(errno));
-            exit(71);
+            _exit(71);
         }
     }
 }
@@ -1126,7 +1105,8 @@ static fd_t open_primary_profile_file_from_dir(const std::string& profile_dir, m
     fd_t profile_fd = -1;
     std::string profile_file = create_primary_profile(profile_dir);
 
-    profile_fd = TEMP_FAILURE_RETRY(open(profile_file.c_str(), open_mode | O_NOFOLLOW));
+    profile_fd = TEMP_FAILURE_RETRY(open(profile_file.c_str(),
+            open_mode | O_NOFOLLOW | O_CLOEXEC));
     if (profile_fd == -1) {
         // It's not an error if the profile file does not exist.
         if (errno != ENOENT) {
@@ -1181,14 +1161,15 @@ static void open_profile_files(uid_t uid, const char* pkgname,
     }
 }
 
+// Like the other code run between fork and exec, reports failures through the exit status, which
+// the parent logs: with commands running on several threads, another thread may have held the lock
+// of the log or of stdio at the time of the fork.
 static void drop_capabilities(uid_t uid) {
     if (setgid(uid) != 0) {
-        ALOGE("setgid(%d) failed in installd during dexopt\n", uid);
-        exit(64);
+        _exit(64);
     }
     if (setuid(uid) != 0) {
-        ALOGE("setuid(%d) failed in installd during dexopt\n", uid);
-        exit(65);
+        _exit(65);
     }
     // drop capabilities
     struct __user_cap_header_struct capheader;
@@ -1197,8 +1178,19 @@ static void drop_capabilities(uid_t uid) {
     memset(&capdata, 0, sizeof(capdata));
     capheader.version = _LINUX_CAPABILITY_VERSION_3;
     if (capset(&capheader, &capdata[0]) < 0) {
-        ALOGE("capset failed: %s\n", strerror(errno));
-        exit(66);
+        _exit(66);
+    }
+}
+
+// installd opens the fds it hands to a child with O_CLOEXEC, so that the child of one command
+// doesn't inherit those of the commands running alongside it. The child lets its own fds through.
+static void keep_fd_on_exec(fd_t fd) {
+    if (fd < 0) {
+        return;
+    }
+    int flags = fcntl(fd, F_GETFD);
+    if (flags == -1 || fcntl(fd, F_SETFD, flags & ~FD_CLOEXEC) != 0) {
+        _exit(74);
     }
 }
 
@@ -1233,8 +1225,7 @@ static void run_profman_merge(const std::vector<fd_t>& profiles_fd, fd_t referen
     argv[i] = NULL;
 
     execv(PROFMAN_BIN, (char * const *)argv);
-    ALOGE("execv(%s) failed: %s\n", PROFMAN_BIN, strerror(errno));
-    exit(68);   /* only get here on exec failure */
+    _exit(68);   /* only get here on exec failure */
 }
 
 // Decides if profile guided compilation is needed or not based on existing profiles.
@@ -1262,8 +1253,12 @@ static bool analyse_profiles(uid_t uid, const char* pkgname) {
     if (pid == 0) {
         /* child -- drop privileges before continuing */
         drop_capabilities(uid);
+        for (fd_t fd : profiles_fd) {
+            keep_fd_on_exec(fd);
+        }
+        keep_fd_on_exec(reference_profile_fd);
         run_profman_merge(profiles_fd, reference_profile_fd);
-        exit(68);   /* only get here on exec failure */
+        _exit(68);   /* only get here on exec failure */
     }
     /* parent */
     int return_code = wait_child(pid);
@@ -1353,8 +1348,7 @@ static void run_profman_dump(const std::vector<fd_t>& profile_fds,
     argv[i] = NULL;
 
     execv(PROFMAN_BIN, (char * const *)argv);
-    ALOGE("execv(%s) failed: %s\n", PROFMAN_BIN, strerror(errno));
-    exit(68);   /* only get here on exec failure */
+    _exit(68);   /* only get here on exec failure */
 }
 
 static const char* get_location_from_path(const char* path) {
@@ -1387,7 +1381,8 @@ bool dump_profile(uid_t uid, const char* pkgname, const char* code_path_string)
         return false;
     }
 
-    fd_t output_fd = open(out_file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW);
+    fd_t output_fd = open(out_file_name.c_str(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC);
     if (fchmod(output_fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH) < 0) {
         ALOGE("installd cannot chmod '%s' dump_profile\n", out_file_name.c_str());
         return false;
@@ -1397,7 +1392,7 @@ bool dump_profile(uid_t uid, const char* pkgname, const char* code_path_string)
     std::vector<fd_t> apk_fds;
     for (const std::string& code_full_path : code_full_paths) {
         const char* full_path = code_full_path.c_str();
-        fd_t apk_fd = open(full_path, O_RDONLY | O_NOFOLLOW);
+        fd_t apk_fd = open(full_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
         if (apk_fd == -1) {
             ALOGE("installd cannot open '%s'\n", full_path);
             return false;
@@ -1410,9 +1405,17 @@ bool dump_profile(uid_t uid, const char* pkgname, const char* code_path_string)
     if (pid == 0) {
         /* child -- drop privileges before continuing */
         drop_capabilities(uid);
+        for (fd_t fd : profile_fds) {
+            keep_fd_on_exec(fd);
+        }
+        for (fd_t fd : apk_fds) {
+            keep_fd_on_exec(fd);
+        }
+        keep_fd_on_exec(reference_profile_fd);
+        keep_fd_on_exec(output_fd);
         run_profman_dump(profile_fds, reference_profile_fd, dex_locations,
                          apk_fds, output_fd);
-        exit(68);   /* only get here on exec failure */
+        _exit(68);   /* only get here on exec failure */
     }
     /* parent */
     close_all_fds(apk_fds, "apk_fds");
@@ -1463,7 +1466,7 @@ static bool add_extension_to_file_name(char* file_name, const char* extension) {
 }
 
 static int open_output_file(const char* file_name, bool recreate, int permissions) {
-    int flags = O_RDWR | O_CREAT;
+    int flags = O_RDWR | O_CREAT | O_CLOEXEC;
     if (recreate) {
         if (unlink(file_name) < 0) {
             if (errno != ENOENT) {
@@ -1624,6 +1627,9 @@ int dexopt(const char* apk_path, uid_t uid, const char* pkgname, const char* ins
            int dexopt_needed, const char* oat_dir, int dexopt_flags, const char* compiler_filter,
            const char* volume_uuid ATTRIBUTE_UNUSED, const char* shared_libraries)
 {
+    if (pkgname != nullptr) {
+        app_size_cache.Invalidate(pkgname);
+    }
     bool is_public = ((dexopt_flags & DEXOPT_PUBLIC) != 0);
     bool vm_safe_mode = (dexopt_flags & DEXOPT_SAFEMODE) != 0;
     bool debuggable = (dexopt_flags & DEXOPT_DEBUGGABLE) != 0;
@@ -1685,7 +1691,7 @@ int dexopt(const char* apk_path, uid_t uid, const char* pkgname, const char* ins
     memset(&input_stat, 0, sizeof(input_stat));
     stat(input_file, &input_stat);
 
-    base::unique_fd input_fd(open(input_file, O_RDONLY, 0));
+    base::unique_fd input_fd(open(input_file, O_RDONLY | O_CLOEXEC, 0));
     if (input_fd.get() < 0) {
         ALOGE("installd cannot open '%s' for input during dexopt\n", input_file);
         return -1;
@@ -1772,8 +1778,12 @@ int dexopt(const char* apk_path, uid_t uid, const char* pkgname, const char* ins
         drop_capabilities(uid);
 
         SetDex2OatAndPatchOatScheduling(boot_complete);
+        keep_fd_on_exec(input_fd.get());
+        keep_fd_on_exec(out_fd.get());
+        keep_fd_on_exec(image_fd.get());
+        keep_fd_on_exec(swap_fd.get());
+        keep_fd_on_exec(reference_profile_fd.get());
         if (flock(out_fd.get(), LOCK_EX | LOCK_NB) != 0) {
-            ALOGE("flock(%s) failed: %s\n", out_path, strerror(errno));
             _exit(67);
         }
 
@@ -1802,7 +1812,6 @@ int dexopt(const char* apk_path, uid_t uid, const char* pkgname, const char* ins
                         reference_profile_fd.get(),
                         shared_libraries);
         } else {
-            ALOGE("Invalid dexopt needed: %d\n", dexopt_needed);
             _exit(73);
         }
         _exit(68);   /* only get here on exec failure */
@@ -1871,6 +1880,7 @@ void mkinnerdirs(char* path, int basepos, mode_t mode, int uid, int gid,
 
 int linklib(const char* uuid, const char* pkgname, const char* asecLibDir, int userId)
 {
+    app_size_cache.Invalidate(pkgname);
     struct stat s, libStat;
     int rc = 0;
 
@@ -1944,7 +1954,6 @@ static void run_idmap(const char *target_apk, const char *overlay_apk, int idmap
     snprintf(idmap_str, sizeof(idmap_str), "%d", idmap_fd);
 
     execl(IDMAP_BIN, IDMAP_BIN, "--fd", target_apk, overlay_apk, idmap_str, (char*)NULL);
-    ALOGE("execl(%s) failed: %s\n", IDMAP_BIN, strerror(errno));
 }
 
 // Transform string /a/b/c.apk to (prefix)/a@b@c.apk@(suffix)
@@ -1996,7 +2005,7 @@ int idmap(const char *target_apk, const char *overlay_apk, uid_t uid)
     }
 
     unlink(idmap_path);
-    idmap_fd = open(idmap_path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    idmap_fd = open(idmap_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
     if (idmap_fd < 0) {
         ALOGE("idmap cannot open '%s' for output: %s\n", idmap_path, strerror(errno));
         goto fail;
@@ -2015,20 +2024,18 @@ int idmap(const char *target_apk, const char *overlay_apk, uid_t uid)
     if (pid == 0) {
         /* child -- drop privileges before continuing */
         if (setgid(uid) != 0) {
-            ALOGE("setgid(%d) failed during idmap\n", uid);
-            exit(1);
+            _exit(1);
         }
         if (setuid(uid) != 0) {
-            ALOGE("setuid(%d) failed during idmap\n", uid);
-            exit(1);
+            _exit(1);
         }
+        keep_fd_on_exec(idmap_fd);
         if (flock(idmap_fd, LOCK_EX | LOCK_NB) != 0) {
-            ALOGE("flock(%s) failed during idmap: %s\n", idmap_path, strerror(errno));
-            exit(1);
+            _exit(1);
         }
 
         run_idmap(target_apk, overlay_apk, idmap_fd);
-        exit(1); /* only if exec call to idmap failed */
+        _exit(1); /* only if exec call to idmap failed */
     } else {
         int status = wait_child(pid);
         if (status != 0) {
@@ -2082,6 +2089,7 @@ int create_oat_dir(const char* oat_dir, const char* instruction_set)
 {
     char oat_instr_dir[PKG_PATH_MAX];
 
+    app_size_cache.InvalidateCodePath(oat_dir);
     if (validate_apk_path(oat_dir)) {
         ALOGE("invalid apk path '%s' (bad prefix)\n", oat_dir);
         return -1;
@@ -2102,6 +2110,7 @@ int create_oat_dir(const char* oat_dir, const char* instruction_set)
 
 int rm_package_dir(const char* apk_path)
 {
+    app_size_cache.InvalidateAll();
     if (validate_apk_path(apk_path)) {
         ALOGE("invalid apk path '%s' (bad prefix)\n", apk_path);
         return -1;
@@ -2110,6 +2119,7 @@ int rm_package_dir(const char* apk_path)
 }
 
 int link_file(const char* relative_path, const char* from_base, const char* to_base) {
+    app_size_cache.InvalidateCodePath(to_base);
     char from_path[PKG_PATH_MAX];
     char to_path[PKG_PATH_MAX];
     snprintf(from_path, PKG_PATH_MAX, "%s/%s", from_base, relative_path);
@@ -2194,6 +2204,7 @@ static bool move_ab_path(const std::string& b_path, const std::string& a_path) {
 }
 
 int move_ab(const char* apk_path, const char* instruction_set, const char* oat_dir) {
+    app_size_cache.InvalidateAll();
     if (apk_path == nullptr || instruction_set == nullptr || oat_dir == nullptr) {
         LOG(ERROR) << "Cannot move_ab with null input";
         return -1;
@@ -2265,6 +2276,7 @@ int move_ab(const char* apk_path, const char* instruction_set, const char* oat_d
 }
 
 bool delete_odex(const char *apk_path, const char *instruction_set, const char *oat_dir) {
+    app_size_cache.InvalidateAll();
     // Delete the oat/odex file.
     char out_path[PKG_PATH_MAX];
     if (!create_oat_out_path(apk_path, instruction_set, oat_dir, out_path)) {
@@ -21,8 +21,12 @@
 #include <inttypes.h>
 #include <unistd.h>
 
+#include <string>
+#include <vector>
+
 #include <cutils/multiuser.h>
 
+#include <app_size.h>
 #include <installd_constants.h>
 
 namespace android {
@@ -46,6 +50,11 @@ int move_complete_app(const char* from_uuid, const char *to_uuid, const char *pa
 int get_app_size(const char *uuid, const char *pkgname, int userid, int flags, ino_t ce_data_inode,
         const char* code_path, int64_t *codesize, int64_t *datasize, int64_t *cachesize,
         int64_t *asecsize);
+// Computes the sizes of several apps, e.g. of the packages sharing a user id, in one pass. sizes
+// gets one element per package, in the order of pkgnames.
+int get_app_sizes(const char *uuid, const std::vector<std::string>& pkgnames, int userid,
+        int flags, const std::vector<ino_t>& ce_data_inodes,
+        const std::vector<std::string>& code_paths, std::vector<AppSize>* sizes);
 int get_app_data_inode(const char *uuid, const char *pkgname, int userid, int flags, ino_t *inode);
 
 int create_user_data(const char *uuid, userid_t userid, int user_serial, int flags);
@@ -22,8 +22,16 @@
 #include <sys/prctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include <android-base/logging.h>
+#include <android-base/strings.h>
 #include <cutils/fs.h>
 #include <cutils/log.h>               // TODO: Move everything to base::logging.
 #include <cutils/properties.h>
@@ -34,6 +42,7 @@
 #include <globals.h>
 #include <installd_constants.h>
 #include <installd_deps.h>  // Need to fill in requirements of commands.
+#include <scheduler.h>
 #include <utils.h>
 
 #ifndef LOG_TAG
@@ -43,11 +52,19 @@
 
 #define BUFFER_MAX    1024  /* input buffer for commands */
 #define TOKEN_MAX     16    /* max number of arguments in buffer */
+#define TAG_MAX       32    /* longest tag of a tagged command, with its '@' */
 #define REPLY_MAX     256   /* largest reply allowed */
 
+/* A get_app_sizes reply line: four sizes of up to 20 characters, spaces and a newline. */
+#define APP_SIZES_LINE_MAX  84
+#define APP_SIZES_MAX       (REPLY_MAX / APP_SIZES_LINE_MAX)  /* packages per get_app_sizes */
+
 namespace android {
 namespace installd {
 
+// "@tag ret reply" must fit the client's BUFFER_MAX read buffer.
+static_assert(TAG_MAX + 1 + 11 + 1 + REPLY_MAX <= BUFFER_MAX, "replies don't fit BUFFER_MAX");
+
 // Check that installd-deps sizes match cutils sizes.
 static_assert(kPropertyKeyMax == PROPERTY_KEY_MAX, "Size mismatch.");
 static_assert(kPropertyValueMax == PROPERTY_VALUE_MAX, "Size mismatch.");
@@ -342,6 +359,38 @@ static int do_get_app_size(char **arg, char reply[REPLY_MAX]) {
     return res;
 }
 
+static int do_get_app_sizes(char **arg, char reply[REPLY_MAX]) {
+    std::vector<AppSize> sizes;
+    int res = 0;
+
+    /* const char *uuid, const char *pkgnames, int userid, int flags,
+            const char *ce_data_inodes, const char *code_paths, the lists separated by commas */
+    std::vector<std::string> pkgnames = android::base::Split(arg[1], ",");
+    if (pkgnames.size() > APP_SIZES_MAX) {
+        ALOGE("get_app_sizes: %zu packages, at most %d fit a reply\n", pkgnames.size(),
+                APP_SIZES_MAX);
+        return -1;
+    }
+    std::vector<ino_t> ce_data_inodes;
+    for (const std::string& inode : android::base::Split(arg[4], ",")) {
+        ce_data_inodes.push_back(atol(inode.c_str()));
+    }
+    std::vector<std::string> code_paths = android::base::Split(arg[5], ",");
+    res = get_app_sizes(parse_null(arg[0]), pkgnames, atoi(arg[2]), atoi(arg[3]), ce_data_inodes,
+            code_paths, &sizes);
+    if (res != 0) {
+        return res;
+    }
+
+    /* One line per package, in the order of pkgnames, as get_app_size replies. */
+    size_t n = 0;
+    for (const AppSize& size : sizes) {
+        n += snprintf(reply + n, REPLY_MAX - n, "%s%" PRId64 " %" PRId64 " %" PRId64 " %" PRId64,
+                n > 0 ? "\n" : "", size.codesize, size.datasize, size.cachesize, (int64_t) 0);
+    }
+    return 0;
+}
+
 static int do_get_app_data_inode(char **arg, char reply[REPLY_MAX]) {
     ino_t inode = 0;
     int res = 0;
@@ -427,38 +476,49 @@ struct cmdinfo {
     const char *name;
     unsigned numargs;
     int (*func)(char **arg, char reply[REPLY_MAX]);
+    // How tagged requests for this command are scheduled, and for CommandScope::kPackage, which
+    // argument is the package name, or the package names separated by commas. Commands working on
+    // paths rather than packages are global.
+    CommandScope scope;
+    int package_arg;
+    bool dexopt;
 };
 
+static constexpr CommandScope kNone = CommandScope::kNone;
+static constexpr CommandScope kPackage = CommandScope::kPackage;
+static constexpr CommandScope kGlobal = CommandScope::kGlobal;
+
 struct cmdinfo cmds[] = {
-    { "ping",                 0, do_ping },
-
-    { "create_app_data",      7, do_create_app_data },
-    { "restorecon_app_data",  6, do_restorecon_app_data },
-    { "migrate_app_data",     4, do_migrate_app_data },
-    { "clear_app_data",       5, do_clear_app_data },
-    { "destroy_app_data",     5, do_destroy_app_data },
-    { "move_complete_app",    7, do_move_complete_app },
-    { "get_app_size",         6, do_get_app_size },
-    { "get_app_data_inode",   4, do_get_app_data_inode },
-
-    { "create_user_data",     4, do_create_user_data },
-    { "destroy_user_data",    3, do_destroy_user_data },
-
-    { "dexopt",              10, do_dexopt },
-    { "markbootcomplete",     1, do_mark_boot_complete },
-    { "rmdex",                2, do_rm_dex },
-    { "freecache",            2, do_free_cache },
-    { "linklib",              4, do_linklib },
-    { "idmap",                3, do_idmap },
-    { "createoatdir",         2, do_create_oat_dir },
-    { "rmpackagedir",         1, do_rm_package_dir },
-    { "clear_app_profiles",   1, do_clear_app_profiles },
-    { "destroy_app_profiles", 1, do_destroy_app_profiles },
-    { "linkfile",             3, do_link_file },
-    { "move_ab",              3, do_move_ab },
-    { "merge_profiles",       2, do_merge_profiles },
-    { "dump_profiles",        3, do_dump_profiles },
-    { "delete_odex",          3, do_delete_odex },
+    { "ping",                 0, do_ping,                 kNone,    -1, false },
+
+    { "create_app_data",      7, do_create_app_data,      kPackage,  1, false },
+    { "restorecon_app_data",  6, do_restorecon_app_data,  kPackage,  1, false },
+    { "migrate_app_data",     4, do_migrate_app_data,     kPackage,  1, false },
+    { "clear_app_data",       5, do_clear_app_data,       kPackage,  1, false },
+    { "destroy_app_data",     5, do_destroy_app_data,     kPackage,  1, false },
+    { "move_complete_app",    7, do_move_complete_app,    kPackage,  2, false },
+    { "get_app_size",         6, do_get_app_size,         kPackage,  1, false },
+    { "get_app_sizes",        6, do_get_app_sizes,        kPackage,  1, false },
+    { "get_app_data_inode",   4, do_get_app_data_inode,   kPackage,  1, false },
+
+    { "create_user_data",     4, do_create_user_data,     kGlobal,  -1, false },
+    { "destroy_user_data",    3, do_destroy_user_data,    kGlobal,  -1, false },
+
+    { "dexopt",              10, do_dexopt,               kPackage,  2, true },
+    { "markbootcomplete",     1, do_mark_boot_complete,   kGlobal,  -1, false },
+    { "rmdex",                2, do_rm_dex,               kGlobal,  -1, false },
+    { "freecache",            2, do_free_cache,           kGlobal,  -1, false },
+    { "linklib",              4, do_linklib,              kPackage,  1, false },
+    { "idmap",                3, do_idmap,                kGlobal,  -1, false },
+    { "createoatdir",         2, do_create_oat_dir,       kGlobal,  -1, false },
+    { "rmpackagedir",         1, do_rm_package_dir,       kGlobal,  -1, false },
+    { "clear_app_profiles",   1, do_clear_app_profiles,   kPackage,  0, false },
+    { "destroy_app_profiles", 1, do_destroy_app_profiles, kPackage,  0, false },
+    { "linkfile",             3, do_link_file,            kGlobal,  -1, false },
+    { "move_ab",              3, do_move_ab,              kGlobal,  -1, false },
+    { "merge_profiles",       2, do_merge_profiles,       kPackage,  1, false },
+    { "dump_profiles",        3, do_dump_profiles,        kPackage,  1, false },
+    { "delete_odex",          3, do_delete_odex,          kGlobal,  -1, false },
 };
 
 static int readx(int s, void *_buf, int count)
@@ -500,23 +560,14 @@ static int writex(int s, const void *_buf, int count)
 }
 
 
-/* Tokenize the command buffer, locate a matching command,
- * ensure that the required number of arguments are provided,
- * call the function(), return the result.
+/* Tokenize the command buffer and locate a matching command. Returns the
+ * command, with its arguments in arg, or NULL if it is unknown or doesn't
+ * have the required number of arguments.
  */
-static int execute(int s, char cmd[BUFFER_MAX])
+static const struct cmdinfo *parse(char cmd[BUFFER_MAX], char *arg[TOKEN_MAX+1])
 {
-    char reply[REPLY_MAX];
-    char *arg[TOKEN_MAX+1];
     unsigned i;
     unsigned n = 0;
-    unsigned short count;
-    int ret = -1;
-
-    // ALOGI("execute('%s')\n", cmd);
-
-        /* default reply is "" */
-    reply[0] = 0;
 
         /* n is number of args (not counting arg[0]) */
     arg[0] = cmd;
@@ -527,7 +578,7 @@ static int execute(int s, char cmd[BUFFER_MAX])
             arg[n] = cmd;
             if (n == TOKEN_MAX) {
                 ALOGE("too many arguments\n");
-                goto done;
+                return NULL;
             }
         }
         if (*cmd) {
@@ -540,29 +591,127 @@ static int execute(int s, char cmd[BUFFER_MAX])
             if (n != cmds[i].numargs) {
                 ALOGE("%s requires %d arguments (%d given)\n",
                      cmds[i].name, cmds[i].numargs, n);
-            } else {
-                ret = cmds[i].func(arg + 1, reply);
+                return NULL;
             }
-            goto done;
+            return &cmds[i];
         }
     }
     ALOGE("unsupported command '%s'\n", arg[0]);
+    return NULL;
+}
 
-done:
-    if (reply[0]) {
-        n = snprintf(cmd, BUFFER_MAX, "%d %s", ret, reply);
-    } else {
-        n = snprintf(cmd, BUFFER_MAX, "%d", ret);
-    }
-    if (n > BUFFER_MAX) n = BUFFER_MAX;
+/* Replies of tagged commands are written by the scheduler's workers, one
+ * reply at a time so that the size and the text of two replies don't mix.
+ */
+static std::mutex reply_lock;
+
+/* Write "[@tag ]ret[ reply]" back to the client. */
+static int write_reply(int s, const char *tag, int ret, const char *reply)
+{
+    char buf[BUFFER_MAX];
+    unsigned n;
+    unsigned short count;
+
+    n = snprintf(buf, sizeof(buf), "%s%s%d%s%s", tag, tag[0] ? " " : "", ret,
+                 reply[0] ? " " : "", reply);
+    if (n > sizeof(buf)) n = sizeof(buf);
     count = n;
 
-    // ALOGI("reply: '%s'\n", cmd);
+    // ALOGI("reply: '%s'\n", buf);
+    std::lock_guard<std::mutex> lock(reply_lock);
     if (writex(s, &count, sizeof(count))) return -1;
-    if (writex(s, cmd, count)) return -1;
+    if (writex(s, buf, count)) return -1;
     return 0;
 }
 
+/* Run a command and write its reply. */
+static int execute(int s, char cmd[BUFFER_MAX])
+{
+    char reply[REPLY_MAX];
+    char *arg[TOKEN_MAX+1];
+    int ret = -1;
+
+    // ALOGI("execute('%s')\n", cmd);
+
+        /* default reply is "" */
+    reply[0] = 0;
+
+    const struct cmdinfo *info = parse(cmd, arg);
+    if (info != NULL) {
+        ret = info->func(arg + 1, reply);
+    }
+    return write_reply(s, "", ret, reply);
+}
+
+/* A command tagged "@<id> <command> <args>", which the client doesn't wait for:
+ * it is queued on the scheduler and its reply, "@<id> <ret>[ <reply>]", may come
+ * after the replies of later commands.
+ */
+struct tagged_command {
+    char tag[TAG_MAX];
+    char cmd[BUFFER_MAX];
+    char *arg[TOKEN_MAX+1];
+    const struct cmdinfo *info;
+};
+
+static int submit(CommandScheduler& scheduler, int s, const char *buf)
+{
+    std::shared_ptr<tagged_command> command = std::make_shared<tagged_command>();
+    const char *space = strchr(buf, ' ');
+    size_t tag_len = space != NULL ? space - buf : strlen(buf);
+    if (tag_len >= TAG_MAX) {
+        // The reply couldn't name the command, so the client can't be answered.
+        ALOGE("tag longer than %d characters\n", TAG_MAX - 1);
+        return -1;
+    }
+    if (space == NULL) {
+        ALOGE("tagged command without a command\n");
+        return write_reply(s, buf, -1, "");
+    }
+    snprintf(command->tag, TAG_MAX, "%.*s", (int) tag_len, buf);
+    strlcpy(command->cmd, space + 1, BUFFER_MAX);
+    command->info = parse(command->cmd, command->arg);
+    if (command->info == NULL) {
+        return write_reply(s, command->tag, -1, "");
+    }
+
+    const struct cmdinfo *info = command->info;
+    auto run = [s, command]() {
+        char reply[REPLY_MAX];
+        reply[0] = 0;
+        int ret = command->info->func(command->arg + 1, reply);
+        // A failed write means the client is gone, which the connection loop notices.
+        write_reply(s, command->tag, ret, reply);
+    };
+    if (info->scope == CommandScope::kPackage) {
+        scheduler.Submit(android::base::Split(command->arg[1 + info->package_arg], ","),
+                         info->dexopt, run);
+    } else {
+        scheduler.Submit(info->scope, "", info->dexopt, run);
+    }
+    return 0;
+}
+
+/* Number of dexopt commands that may run at once: as many as there are online
+ * cores for the threads of a dex2oat. It is asked before each dexopt starts, and
+ * so follows the cores that thermal mitigation takes offline.
+ */
+static size_t get_dexopt_slots() {
+    char boot_completed[PROPERTY_VALUE_MAX];
+    char threads[PROPERTY_VALUE_MAX];
+    property_get("sys.boot_completed", boot_completed, "0");
+    property_get(strcmp(boot_completed, "1") == 0 ? "dalvik.vm.dex2oat-threads"
+                                                  : "dalvik.vm.boot-dex2oat-threads",
+                 threads, "0");
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    long threads_per_dexopt = atol(threads);
+    if (cores <= 0 || threads_per_dexopt <= 0) {
+        // Without a thread count, dex2oat uses all the cores.
+        return 1;
+    }
+    return std::max(1L, cores / threads_per_dexopt);
+}
+
 static bool initialize_globals() {
     const char* data_path = getenv("ANDROID_DATA");
     if (data_path == nullptr) {
@@ -743,6 +892,11 @@ static int installd_main(const int argc ATTRIBUTE_UNUSED, char *argv[]) {
     }
     fcntl(lsocket, F_SETFD, FD_CLOEXEC);
 
+    // Workers for the tagged commands. Most commands wait on storage rather than the CPU, so a
+    // couple more than the cores keeps both busy; dexopt is limited by get_dexopt_slots().
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    CommandScheduler scheduler(std::max(3L, cores + 2), get_dexopt_slots);
+
     for (;;) {
         alen = sizeof(addr);
         s = accept(lsocket, &addr, &alen);
@@ -769,10 +923,21 @@ static int installd_main(const int argc ATTRIBUTE_UNUSED, char *argv[]) {
             }
             buf[count] = 0;
             if (selinux_enabled && selinux_status_updated() > 0) {
+                // Don't change the contexts under the commands labelling files.
+                scheduler.WaitForIdle();
                 selinux_android_seapp_context_reload();
             }
+            if (buf[0] == '@') {
+                if (submit(scheduler, s, buf)) break;
+                continue;
+            }
+            // Untagged commands run alone and in order, as the client expects a reply to each
+            // before sending the next.
+            scheduler.WaitForIdle();
             if (execute(s, buf)) break;
         }
+        // The workers write to s until its commands finished.
+        scheduler.WaitForIdle();
         ALOGI("closing connection\n");
         close(s);
     }
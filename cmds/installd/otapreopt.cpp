@@ -619,8 +619,8 @@ private:
 
             execv(program, &args[0]);
 
-            PLOG(ERROR) << "Failed to execv(" << command_line << ")";
-            // _exit to avoid atexit handlers in child.
+            // No logging either, the parent reports the exit status. _exit to avoid atexit
+            // handlers in child.
             _exit(1);
         } else {
             if (pid == -1) {
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scheduler.h"
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+
+namespace android {
+namespace installd {
+
+CommandScheduler::CommandScheduler(size_t num_workers, std::function<size_t()> dexopt_slots)
+        : running_dexopt_(0),
+          max_running_(0),
+          max_running_dexopt_(0),
+          stopping_(false),
+          dexopt_slots_(dexopt_slots) {
+    for (size_t i = 0; i < num_workers; ++i) {
+        workers_.emplace_back(&CommandScheduler::WorkerLoop, this);
+    }
+}
+
+CommandScheduler::~CommandScheduler() {
+    {
+        std::unique_lock<std::mutex> lock(lock_);
+        idle_.wait(lock, [this]() { return pending_.empty() && running_.empty(); });
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void CommandScheduler::Submit(CommandScope scope, const std::string& package, bool dexopt,
+                              std::function<void()> run) {
+    std::vector<std::string> packages;
+    if (scope == CommandScope::kPackage) {
+        packages.push_back(package);
+    }
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        pending_.push_back(Command{scope, std::move(packages), dexopt, run});
+    }
+    work_available_.notify_one();
+}
+
+void CommandScheduler::Submit(const std::vector<std::string>& packages, bool dexopt,
+                              std::function<void()> run) {
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        pending_.push_back(Command{CommandScope::kPackage, packages, dexopt, run});
+    }
+    work_available_.notify_one();
+}
+
+void CommandScheduler::WaitForIdle() {
+    std::unique_lock<std::mutex> lock(lock_);
+    idle_.wait(lock, [this]() { return pending_.empty() && running_.empty(); });
+}
+
+size_t CommandScheduler::GetMaxRunning() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return max_running_;
+}
+
+size_t CommandScheduler::GetMaxRunningDexopt() const {
+    std::lock_guard<std::mutex> lock(lock_);
+    return max_running_dexopt_;
+}
+
+bool CommandScheduler::TakeRunnableLocked(std::list<Command>::iterator* command) {
+    if (pending_.empty()) {
+        return false;
+    }
+
+    // What the running commands and the pending ones skipped so far hold back.
+    bool global_ahead = false;
+    size_t others_ahead = 0;
+    std::set<std::string> packages_ahead;
+    for (const Command& running : running_) {
+        if (running.scope == CommandScope::kGlobal) {
+            global_ahead = true;
+        } else if (running.scope == CommandScope::kPackage) {
+            packages_ahead.insert(running.packages.begin(), running.packages.end());
+            others_ahead++;
+        }
+    }
+    size_t free_dexopt_slots = 0;
+    bool dexopt_slots_known = false;
+
+    for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+        bool runnable;
+        switch (it->scope) {
+            case CommandScope::kNone:
+                runnable = true;
+                break;
+            case CommandScope::kGlobal:
+                runnable = !global_ahead && others_ahead == 0;
+                break;
+            case CommandScope::kPackage:
+            default:
+                runnable = !global_ahead
+                        && std::none_of(it->packages.begin(), it->packages.end(),
+                                        [&packages_ahead](const std::string& package) {
+                                            return packages_ahead.count(package) != 0;
+                                        });
+                break;
+        }
+        if (runnable && it->dexopt) {
+            if (!dexopt_slots_known) {
+                const size_t slots = dexopt_slots_();
+                free_dexopt_slots = slots > running_dexopt_ ? slots - running_dexopt_ : 0;
+                dexopt_slots_known = true;
+            }
+            runnable = free_dexopt_slots > 0;
+        }
+        if (runnable) {
+            running_.push_back(std::move(*it));
+            pending_.erase(it);
+            *command = std::prev(running_.end());
+            if ((*command)->dexopt) {
+                running_dexopt_++;
+                max_running_dexopt_ = std::max(max_running_dexopt_, running_dexopt_);
+            }
+            max_running_ = std::max(max_running_, running_.size());
+            return true;
+        }
+
+        // Everything after this command that conflicts with it waits for it.
+        if (it->scope == CommandScope::kGlobal) {
+            global_ahead = true;
+        } else if (it->scope == CommandScope::kPackage) {
+            packages_ahead.insert(it->packages.begin(), it->packages.end());
+            others_ahead++;
+        }
+    }
+    return false;
+}
+
+void CommandScheduler::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(lock_);
+    for (;;) {
+        std::list<Command>::iterator command;
+        bool taken = false;
+        work_available_.wait(lock, [this, &command, &taken]() {
+            taken = TakeRunnableLocked(&command);
+            return taken || (stopping_ && pending_.empty());
+        });
+        if (!taken) {
+            return;
+        }
+        // More may be runnable, e.g. after a command of global scope started.
+        if (!pending_.empty()) {
+            work_available_.notify_one();
+        }
+
+        lock.unlock();
+        command->run();
+        lock.lock();
+
+        if (command->dexopt) {
+            running_dexopt_--;
+        }
+        running_.erase(command);
+        // The end of a command may unblock several others.
+        work_available_.notify_all();
+        if (pending_.empty() && running_.empty()) {
+            idle_.notify_all();
+        }
+    }
+}
+
+}  // namespace installd
+}  // namespace android
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace installd {
+
+// What a command shares with the other commands, which decides what it may run alongside.
+enum class CommandScope {
+    // Nothing, it can run at any time. E.g. ping.
+    kNone,
+    // The files of one package, or of a few. Runs after the earlier commands for the same packages
+    // finished.
+    kPackage,
+    // Files of several packages or users, or paths of unknown packages. Runs alone, after all the
+    // earlier commands finished.
+    kGlobal,
+};
+
+// Runs installd commands concurrently on a pool of worker threads.
+//
+// Commands start in the order they were submitted, except that a command may overtake earlier
+// ones it doesn't conflict with: commands for different packages run side by side, while a
+// command of global scope waits for everything submitted before it and holds back everything
+// submitted after it. Dexopt commands also take a slot of the dexopt pool, whose size is asked
+// from the given function each time one is about to start, so that it can follow the state of
+// the device.
+class CommandScheduler {
+  public:
+    CommandScheduler(size_t num_workers, std::function<size_t()> dexopt_slots);
+
+    // Waits for the submitted commands to finish.
+    ~CommandScheduler();
+
+    // Queues a command. package is only used for kPackage commands.
+    void Submit(CommandScope scope, const std::string& package, bool dexopt,
+                std::function<void()> run);
+    // Queues a kPackage command working on several packages, e.g. get_app_sizes.
+    void Submit(const std::vector<std::string>& packages, bool dexopt,
+                std::function<void()> run);
+
+    // Waits until all the submitted commands finished.
+    void WaitForIdle();
+
+    // Largest number of commands, and of dexopt commands, that ran at once.
+    size_t GetMaxRunning() const;
+    size_t GetMaxRunningDexopt() const;
+
+  private:
+    struct Command {
+        CommandScope scope;
+        std::vector<std::string> packages;
+        bool dexopt;
+        std::function<void()> run;
+    };
+
+    void WorkerLoop();
+    // Removes the first command which can start now from pending_ and adds it to running_.
+    bool TakeRunnableLocked(std::list<Command>::iterator* command);
+
+    mutable std::mutex lock_;
+    std::condition_variable work_available_;
+    std::condition_variable idle_;
+    std::deque<Command> pending_;
+    std::list<Command> running_;
+    size_t running_dexopt_;
+    size_t max_running_;
+    size_t max_running_dexopt_;
+    bool stopping_;
+    std::function<size_t()> dexopt_slots_;
+    std::vector<std::thread> workers_;
+};
+
+}  // namespace installd
+}  // namespace android
+
+#endif  // SCHEDULER_H_
@@ -5,6 +5,8 @@ LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
 
 # Build the unit tests.
 test_src_files := \
+    installd_app_size_test.cpp \
+    installd_scheduler_test.cpp \
     installd_utils_test.cpp
 
 shared_libraries := \
@@ -29,3 +31,21 @@ $(foreach file,$(test_src_files), \
     $(eval LOCAL_CLANG := true) \
     $(eval include $(BUILD_NATIVE_TEST)) \
 )
+
+# Build the benchmarks.
+benchmark_src_files := \
+    installd_app_size_benchmark.cpp \
+    installd_scheduler_benchmark.cpp
+
+$(foreach file,$(benchmark_src_files), \
+    $(eval include $(CLEAR_VARS)) \
+    $(eval LOCAL_MODULE_TAGS := tests) \
+    $(eval LOCAL_SHARED_LIBRARIES := $(shared_libraries)) \
+    $(eval LOCAL_STATIC_LIBRARIES := $(static_libraries)) \
+    $(eval LOCAL_SRC_FILES := $(file)) \
+    $(eval LOCAL_C_INCLUDES := $(c_includes)) \
+    $(eval LOCAL_CFLAGS := -Wall -Werror) \
+    $(eval LOCAL_MODULE := $(notdir $(file:%.cpp=%))) \
+    $(eval LOCAL_CLANG := true) \
+    $(eval include $(BUILD_EXECUTABLE)) \
+)
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times the ways get_app_size can add up a synthetic tree: calculate_dir_size as it used to, the
+// threaded walk of calculate_tree_sizes, and the stamps that a cached size is checked against.
+// The tree is made once, with 10 directories per level and 100 files of 100 bytes per leaf
+// directory. Run as root to start each walk with cold caches.
+//
+// Usage: installd_app_size_benchmark [directory] [files]
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <app_size.h>
+#include <diskusage/dirsize.h>
+
+using namespace android::installd;
+
+static constexpr int kFilesPerDir = 100;
+static constexpr int kDirsPerDir = 10;
+static constexpr int kRuns = 5;
+
+static bool MakeTree(const std::string& path, int files) {
+    if (mkdir(path.c_str(), 0700) != 0) {
+        return false;
+    }
+    if (files <= kFilesPerDir) {
+        char data[100] = {};
+        for (int i = 0; i < files; i++) {
+            std::string file = path + "/file" + std::to_string(i);
+            int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if (fd < 0 || write(fd, data, sizeof(data)) != sizeof(data)) {
+                return false;
+            }
+            close(fd);
+        }
+        return true;
+    }
+    for (int i = 0; i < kDirsPerDir; i++) {
+        int share = files / kDirsPerDir + (i < files % kDirsPerDir ? 1 : 0);
+        if (!MakeTree(path + "/dir" + std::to_string(i), share)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool DropCaches() {
+    sync();
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool dropped = write(fd, "3", 1) == 1;
+    close(fd);
+    return dropped;
+}
+
+// Runs measure kRuns times and prints the median time.
+static void Time(const char* name, bool cold, const std::function<int64_t()>& measure) {
+    std::vector<double> times;
+    int64_t size = 0;
+    for (int i = 0; i < kRuns; i++) {
+        if (cold) {
+            DropCaches();
+        }
+        auto start = std::chrono::steady_clock::now();
+        size = measure();
+        times.push_back(std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    printf("%-36s %9.2fms | size %lld\n", name, times[kRuns / 2], static_cast<long long>(size));
+}
+
+int main(int argc, char* argv[]) {
+    const std::string root = argc > 1 ? argv[1] : "/data/local/tmp/installd_app_size_benchmark";
+    const int files = argc > 2 ? atoi(argv[2]) : 100000;
+
+    struct stat s;
+    if (stat(root.c_str(), &s) != 0) {
+        printf("making %d files under %s\n", files, root.c_str());
+        if (!MakeTree(root, files)) {
+            printf("could not make the tree under %s\n", root.c_str());
+            return 1;
+        }
+    }
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    const bool cold = DropCaches();
+    printf("%s, %ld cores, %s caches, median of %d runs\n", root.c_str(), cores,
+           cold ? "cold" : "warm", kRuns);
+
+    for (bool drop : { cold, false }) {
+        if (drop != cold) {
+            printf("warm caches\n");
+        }
+        Time("calculate_dir_size", drop, [&root]() {
+            int fd = open(root.c_str(), O_RDONLY | O_DIRECTORY);
+            return fd < 0 ? 0 : calculate_dir_size(fd);
+        });
+        for (size_t threads : { 1, 2, 4, 8 }) {
+            std::string name = "calculate_tree_sizes, " + std::to_string(threads) + " threads";
+            Time(name.c_str(), drop, [&root, threads]() {
+                std::vector<int64_t> sizes;
+                calculate_tree_sizes({ root }, threads, &sizes);
+                return sizes[0];
+            });
+        }
+        if (!cold) {
+            break;
+        }
+    }
+
+    // What a get_app_size answered from the cache costs.
+    AppSizeCache cache(60 * 1000);
+    std::vector<DirStamp> stamps;
+    get_dir_stamps(root, &stamps);
+    std::vector<int64_t> sizes;
+    calculate_tree_sizes({ root }, 4, &sizes);
+    cache.Store("key", "com.example", root, stamps, AppSize{ 0, sizes[0], 0 });
+    Time("cached, checking the stamps", false, [&root, &cache]() {
+        std::vector<DirStamp> current;
+        get_dir_stamps(root, &current);
+        AppSize size;
+        return cache.Lookup("key", current, &size) ? size.datasize : -1;
+    });
+    return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <app_size.h>
+#include <diskusage/dirsize.h>
+
+namespace android {
+namespace installd {
+
+class AppSizeTest : public testing::Test {
+  protected:
+    virtual void SetUp() {
+        char directory[] = "/data/local/tmp/installd_app_size_test.XXXXXX";
+        ASSERT_TRUE(mkdtemp(directory) != nullptr);
+        root_ = directory;
+    }
+
+    virtual void TearDown() {
+        std::string command = "rm -rf " + root_;
+        system(command.c_str());
+    }
+
+    void MakeDir(const std::string& path) {
+        ASSERT_EQ(0, mkdir((root_ + "/" + path).c_str(), 0700));
+    }
+
+    void MakeFile(const std::string& path, size_t size) {
+        int fd = open((root_ + "/" + path).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        ASSERT_GE(fd, 0);
+        std::vector<char> data(size, 'x');
+        ASSERT_EQ(static_cast<ssize_t>(size), write(fd, data.data(), size));
+        close(fd);
+    }
+
+    // A tree wide and deep enough for the threads to take directories from each other.
+    void MakeTree(const std::string& path, int depth) {
+        MakeDir(path);
+        for (int i = 0; i < 5; i++) {
+            MakeFile(path + "/file" + std::to_string(i), 100 * i + 1);
+        }
+        if (depth > 0) {
+            for (int i = 0; i < 3; i++) {
+                MakeTree(path + "/dir" + std::to_string(i), depth - 1);
+            }
+        }
+    }
+
+    int64_t DirSize(const std::string& path) {
+        int fd = open((root_ + "/" + path).c_str(), O_RDONLY | O_DIRECTORY);
+        return fd < 0 ? -1 : calculate_dir_size(fd);
+    }
+
+    std::string root_;
+};
+
+TEST_F(AppSizeTest, TreeSizesMatchDirSize) {
+    MakeTree("a", 4);
+    MakeTree("b", 1);
+    MakeDir("empty");
+
+    for (size_t threads : { 1, 4 }) {
+        std::vector<int64_t> sizes;
+        calculate_tree_sizes({ root_ + "/a", root_ + "/b", root_ + "/empty", root_ + "/missing" },
+                             threads, &sizes);
+        ASSERT_EQ(4U, sizes.size());
+        EXPECT_EQ(DirSize("a"), sizes[0]) << threads << " threads";
+        EXPECT_EQ(DirSize("b"), sizes[1]) << threads << " threads";
+        EXPECT_EQ(0, sizes[2]);
+        EXPECT_EQ(0, sizes[3]);
+    }
+}
+
+TEST_F(AppSizeTest, TreeSizesOfNoRoots) {
+    std::vector<int64_t> sizes;
+    calculate_tree_sizes({}, 4, &sizes);
+    EXPECT_TRUE(sizes.empty());
+}
+
+TEST_F(AppSizeTest, StampsChangeWithTheEntries) {
+    MakeDir("app");
+    MakeDir("app/cache");
+    std::vector<DirStamp> before;
+    get_dir_stamps(root_ + "/app", &before);
+    EXPECT_EQ(2U, before.size());
+
+    std::vector<DirStamp> again;
+    get_dir_stamps(root_ + "/app", &again);
+    EXPECT_TRUE(before == again);
+
+    MakeFile("app/cache/file", 10);
+    std::vector<DirStamp> after;
+    get_dir_stamps(root_ + "/app", &after);
+    EXPECT_FALSE(before == after);
+
+    std::vector<DirStamp> missing;
+    get_dir_stamps(root_ + "/missing", &missing);
+    ASSERT_EQ(1U, missing.size());
+    EXPECT_EQ(0U, missing[0].ino);
+}
+
+TEST_F(AppSizeTest, CacheKeepsSizesWhileStampsMatch) {
+    MakeDir("app");
+    std::vector<DirStamp> stamps;
+    get_dir_stamps(root_ + "/app", &stamps);
+
+    AppSizeCache cache(60 * 1000);
+    AppSize size = { 1, 2, 3 };
+    cache.Store("key", "com.example", "/data/app/com.example-1", stamps, size);
+
+    AppSize cached = { 0, 0, 0 };
+    ASSERT_TRUE(cache.Lookup("key", stamps, &cached));
+    EXPECT_EQ(1, cached.codesize);
+    EXPECT_EQ(2, cached.datasize);
+    EXPECT_EQ(3, cached.cachesize);
+    EXPECT_FALSE(cache.Lookup("other key", stamps, &cached));
+
+    MakeFile("app/file", 10);
+    std::vector<DirStamp> changed;
+    get_dir_stamps(root_ + "/app", &changed);
+    EXPECT_FALSE(cache.Lookup("key", changed, &cached));
+}
+
+TEST_F(AppSizeTest, CacheInvalidation) {
+    std::vector<DirStamp> stamps;
+    AppSizeCache cache(60 * 1000);
+    AppSize size = { 1, 2, 3 };
+    cache.Store("a", "com.example.a", "/data/app/com.example.a-1", stamps, size);
+    cache.Store("b", "com.example.b", "/data/app/com.example.b-1", stamps, size);
+
+    cache.Invalidate("com.example.a");
+    EXPECT_FALSE(cache.Lookup("a", stamps, &size));
+    EXPECT_TRUE(cache.Lookup("b", stamps, &size));
+
+    cache.InvalidateAll();
+    EXPECT_FALSE(cache.Lookup("b", stamps, &size));
+
+    // Creating an oat directory or linking files into one changes the app it is in.
+    cache.Store("a", "com.example.a", "/data/app/com.example.a-1", stamps, size);
+    cache.Store("a1", "com.example.a1", "/data/app/com.example.a-10", stamps, size);
+    cache.InvalidateCodePath("/data/app/com.example.a-1/oat");
+    EXPECT_FALSE(cache.Lookup("a", stamps, &size));
+    EXPECT_TRUE(cache.Lookup("a1", stamps, &size));
+
+    // After an update, the sizes at the old code path won't be asked for again.
+    cache.Store("b user 0", "com.example.b", "/data/app/com.example.b-1", stamps, size);
+    cache.Store("b user 10", "com.example.b", "/data/app/com.example.b-1", stamps, size);
+    EXPECT_TRUE(cache.Lookup("b user 0", stamps, &size));
+    cache.Store("b user 0 updated", "com.example.b", "/data/app/com.example.b-2", stamps, size);
+    EXPECT_FALSE(cache.Lookup("b user 0", stamps, &size));
+    EXPECT_FALSE(cache.Lookup("b user 10", stamps, &size));
+    EXPECT_TRUE(cache.Lookup("b user 0 updated", stamps, &size));
+
+    AppSizeCache short_lived(1);
+    short_lived.Store("a", "com.example.a", "/data/app/com.example.a-1", stamps, size);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_FALSE(short_lived.Lookup("a", stamps, &size));
+}
+
+TEST_F(AppSizeTest, AppSizesSplitCodeDataAndCache) {
+    // An app's code, and its CE and DE data.
+    MakeTree("app", 1);
+    MakeDir("app/oat");
+    MakeFile("app/oat/base.odex", 5000);
+    MakeDir("ce");
+    MakeFile("ce/top", 300);
+    MakeTree("ce/files", 2);
+    MakeTree("ce/cache", 1);
+    MakeTree("ce/code_cache", 0);
+    ASSERT_EQ(0, symlink("/data/app/com.example-1/lib", (root_ + "/ce/lib").c_str()));
+    MakeDir("de");
+    MakeTree("de/cache", 0);
+    MakeFile("de/databases", 700);
+
+    struct stat lib;
+    ASSERT_EQ(0, lstat((root_ + "/ce/lib").c_str(), &lib));
+    const int64_t code = DirSize("app") + stat_size(&lib);
+    const int64_t cache = DirSize("ce/cache") + DirSize("ce/code_cache") + DirSize("de/cache");
+    const int64_t data = DirSize("ce") + DirSize("de") - cache - stat_size(&lib);
+
+    std::vector<AppPaths> apps = {
+        AppPaths{ "com.example", root_ + "/app", { root_ + "/ce", root_ + "/de" } },
+        AppPaths{ "com.example.missing", root_ + "/missing", { root_ + "/missing_data" } },
+    };
+    AppSizeCache size_cache(60 * 1000);
+    std::vector<AppSize> sizes;
+    calculate_app_sizes(apps, 4, &size_cache, &sizes);
+    ASSERT_EQ(2U, sizes.size());
+    EXPECT_EQ(code, sizes[0].codesize);
+    EXPECT_EQ(data, sizes[0].datasize);
+    EXPECT_EQ(cache, sizes[0].cachesize);
+    EXPECT_EQ(0, sizes[1].codesize + sizes[1].datasize + sizes[1].cachesize);
+
+    // A file growing in place deep down doesn't change the stamps, the size comes from the cache.
+    MakeFile("ce/files/dir0/file4", 100000);
+    calculate_app_sizes(apps, 4, &size_cache, &sizes);
+    EXPECT_EQ(data, sizes[0].datasize);
+
+    // A new file in a cache directory does.
+    MakeFile("ce/cache/new", 20000);
+    calculate_app_sizes(apps, 4, &size_cache, &sizes);
+    EXPECT_EQ(DirSize("ce/cache") + DirSize("ce/code_cache") + DirSize("de/cache"),
+              sizes[0].cachesize);
+    EXPECT_EQ(DirSize("ce") + DirSize("de") - sizes[0].cachesize - stat_size(&lib),
+              sizes[0].datasize);
+    EXPECT_GT(sizes[0].datasize, data);
+}
+
+}  // namespace installd
+}  // namespace android
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a first-boot command trace through CommandScheduler and reports the wall-clock time
+// against running the same commands one after the other, as installd did.
+//
+// A trace has one command per line, "<ms> <command> <package>", where ms is how long the command
+// took. Dexopt commands use that much CPU time, the others sleep, as they mostly wait on
+// storage. Without a trace, replays a synthetic first boot: a freecache, then create_app_data,
+// dexopt and get_app_size for each package.
+//
+// Usage: installd_scheduler_benchmark [trace|packages] [dexopt slots]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <scheduler.h>
+
+using namespace android::installd;
+
+struct TraceCommand {
+    int ms;
+    std::string name;
+    std::string package;
+};
+
+// The scheduling of the commands, as in the command table of installd.cpp.
+static CommandScope GetScope(const std::string& name) {
+    static const char* kGlobalCommands[] = {
+        "create_user_data", "destroy_user_data", "markbootcomplete", "rmdex", "freecache",
+        "idmap", "createoatdir", "rmpackagedir", "linkfile", "move_ab", "delete_odex",
+    };
+    if (name == "ping") {
+        return CommandScope::kNone;
+    }
+    for (const char* global : kGlobalCommands) {
+        if (name == global) {
+            return CommandScope::kGlobal;
+        }
+    }
+    return CommandScope::kPackage;
+}
+
+static double ThreadCpuMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void Run(const TraceCommand& command) {
+    if (command.name == "dexopt") {
+        // CPU time rather than wall-clock time, so that more dexopts than cores don't finish
+        // sooner than they would.
+        const double end = ThreadCpuMs() + command.ms;
+        volatile unsigned sink = 0;
+        while (ThreadCpuMs() < end) {
+            for (int i = 0; i < 1000; i++) {
+                sink = sink + i;
+            }
+        }
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(command.ms));
+    }
+}
+
+static bool ReadTrace(const char* path, std::vector<TraceCommand>* trace) {
+    FILE* f = fopen(path, "r");
+    if (f == nullptr) {
+        return false;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        int ms;
+        char name[256];
+        char package[256] = "";
+        if (sscanf(line, "%d %255s %255s", &ms, name, package) >= 2) {
+            trace->push_back(TraceCommand{ms, name, package});
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static void MakeFirstBoot(int packages, std::vector<TraceCommand>* trace) {
+    trace->push_back(TraceCommand{20, "freecache", ""});
+    for (int i = 0; i < packages; i++) {
+        std::string package = "com.example.app" + std::to_string(i);
+        trace->push_back(TraceCommand{3, "create_app_data", package});
+        // Every fourth app is large.
+        trace->push_back(TraceCommand{i % 4 == 0 ? 300 : 60, "dexopt", package});
+        trace->push_back(TraceCommand{8, "get_app_size", package});
+    }
+    trace->push_back(TraceCommand{5, "markbootcomplete", ""});
+}
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<TraceCommand> trace;
+    if (argc > 1 && atoi(argv[1]) == 0) {
+        if (!ReadTrace(argv[1], &trace)) {
+            printf("could not read %s\n", argv[1]);
+            return 1;
+        }
+    } else {
+        MakeFirstBoot(argc > 1 ? atoi(argv[1]) : 40, &trace);
+    }
+    const long cores = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    const size_t slots = argc > 2 ? atoi(argv[2]) : cores;
+    const size_t workers = std::max(3L, cores + 2);
+
+    auto start = std::chrono::steady_clock::now();
+    for (const TraceCommand& command : trace) {
+        Run(command);
+    }
+    const double serial_ms = ElapsedMs(start);
+
+    CommandScheduler scheduler(workers, [slots]() { return slots; });
+    start = std::chrono::steady_clock::now();
+    for (const TraceCommand& command : trace) {
+        scheduler.Submit(GetScope(command.name), command.package, command.name == "dexopt",
+                         [&command]() { Run(command); });
+    }
+    scheduler.WaitForIdle();
+    const double scheduled_ms = ElapsedMs(start);
+
+    printf("%zu commands, %ld cores, %zu workers, %zu dexopt slots\n", trace.size(), cores,
+           workers, slots);
+    printf("serial %.0fms | scheduled %.0fms | speedup %.2fx | max running %zu, dexopt %zu\n",
+           serial_ms, scheduled_ms, serial_ms / scheduled_ms, scheduler.GetMaxRunning(),
+           scheduler.GetMaxRunningDexopt());
+    return 0;
+}
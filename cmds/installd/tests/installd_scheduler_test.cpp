@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <scheduler.h>
+
+namespace android {
+namespace installd {
+
+static void Sleep(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+class SchedulerTest : public testing::Test {
+  protected:
+    // Records the commands as they start and end, "+name" and "-name".
+    void Record(const std::string& event) {
+        std::lock_guard<std::mutex> lock(lock_);
+        events_.push_back(event);
+    }
+
+    std::function<void()> Command(const std::string& name, int ms) {
+        return [this, name, ms]() {
+            Record("+" + name);
+            Sleep(ms);
+            Record("-" + name);
+        };
+    }
+
+    size_t IndexOf(const std::string& event) {
+        for (size_t i = 0; i < events_.size(); i++) {
+            if (events_[i] == event) {
+                return i;
+            }
+        }
+        ADD_FAILURE() << event << " didn't happen";
+        return events_.size();
+    }
+
+    std::mutex lock_;
+    std::vector<std::string> events_;
+};
+
+TEST_F(SchedulerTest, CommandsForOnePackageRunInOrder) {
+    CommandScheduler scheduler(4, []() { return 4; });
+    scheduler.Submit(CommandScope::kPackage, "com.example.a", false, Command("a1", 20));
+    scheduler.Submit(CommandScope::kPackage, "com.example.a", true, Command("a2", 5));
+    scheduler.Submit(CommandScope::kPackage, "com.example.a", false, Command("a3", 5));
+    scheduler.WaitForIdle();
+
+    EXPECT_LT(IndexOf("-a1"), IndexOf("+a2"));
+    EXPECT_LT(IndexOf("-a2"), IndexOf("+a3"));
+    EXPECT_EQ(1U, scheduler.GetMaxRunning());
+}
+
+TEST_F(SchedulerTest, CommandsForDifferentPackagesOverlap) {
+    CommandScheduler scheduler(4, []() { return 4; });
+    scheduler.Submit(CommandScope::kPackage, "com.example.a", false, Command("a", 50));
+    scheduler.Submit(CommandScope::kPackage, "com.example.b", false, Command("b", 50));
+    scheduler.Submit(CommandScope::kNone, "", false, Command("ping", 0));
+    scheduler.WaitForIdle();
+
+    EXPECT_LT(IndexOf("+b"), IndexOf("-a"));
+    EXPECT_LT(IndexOf("+ping"), IndexOf("-a"));
+    EXPECT_EQ(3U, scheduler.GetMaxRunning());
+}
+
+TEST_F(SchedulerTest, CommandsForSeveralPackagesWaitForEach) {
+    CommandScheduler scheduler(4, []() { return 4; });
+    scheduler.Submit(CommandScope::kPackage, "com.example.a", false, Command("a", 10));
+    scheduler.Submit(CommandScope::kPackage, "com.example.b", false, Command("b", 30));
+    scheduler.Submit({ "com.example.a", "com.example.b" }, false, Command("sizes", 10));
+    scheduler.Submit(CommandScope::kPackage, "com.example.b", false, Command("b2", 5));
+    scheduler.Submit(CommandScope::kPackage, "com.example.c", false, Command("c", 5));
+    scheduler.WaitForIdle();
+
+    EXPECT_LT(IndexOf("-a"), IndexOf("+sizes"));
+    EXPECT_LT(IndexOf("-b"), IndexOf("+sizes"));
+    EXPECT_LT(IndexOf("-sizes"), IndexOf("+b2"));
+    // Other packages don't wait for it.
+    EXPECT_LT(IndexOf("+c"), IndexOf("-b"));
+}
+
+TEST_F(SchedulerTest, GlobalCommandsRunAlone) {
+    CommandScheduler scheduler(4, []() { return 4; });
+    scheduler.Submit(CommandScope::kPackage, "com.example.a", false, Command("a", 30));
+    scheduler.Submit(CommandScope::kPackage, "com.example.b", false, Command("b", 10));
+    scheduler.Submit(CommandScope::kGlobal, "", false, Command("freecache", 20));
+    scheduler.Submit(CommandScope::kPackage, "com.example.c", false, Command("c", 5));
+    scheduler.WaitForIdle();
+
+    EXPECT_LT(IndexOf("-a"), IndexOf("+freecache"));
+    EXPECT_LT(IndexOf("-b"), IndexOf("+freecache"));
+    EXPECT_LT(IndexOf("-freecache"), IndexOf("+c"));
+}
+
+TEST_F(SchedulerTest, DexoptIsLimitedToItsSlots) {
+    std::atomic<size_t> slots(2);
+    CommandScheduler scheduler(8, [&slots]() { return slots.load(); });
+    for (int i = 0; i < 6; i++) {
+        scheduler.Submit(CommandScope::kPackage, "com.example." + std::to_string(i), true,
+                         Command("dexopt" + std::to_string(i), 10));
+    }
+    scheduler.Submit(CommandScope::kPackage, "com.example.other", false, Command("size", 5));
+    scheduler.WaitForIdle();
+
+    EXPECT_EQ(2U, scheduler.GetMaxRunningDexopt());
+    // Commands which aren't dexopt don't wait for a slot.
+    EXPECT_LT(IndexOf("+size"), IndexOf("-dexopt0"));
+
+    // Fewer slots, e.g. once cores are taken offline, hold back the next dexopts.
+    slots = 1;
+    CommandScheduler throttled(8, [&slots]() { return slots.load(); });
+    for (int i = 0; i < 4; i++) {
+        throttled.Submit(CommandScope::kPackage, "com.example." + std::to_string(i), true,
+                         Command("throttled" + std::to_string(i), 5));
+    }
+    throttled.WaitForIdle();
+    EXPECT_EQ(1U, throttled.GetMaxRunningDexopt());
+}
+
+TEST_F(SchedulerTest, DestructorWaitsForCommands) {
+    std::atomic<int> done(0);
+    {
+        CommandScheduler scheduler(2, []() { return 1; });
+        for (int i = 0; i < 10; i++) {
+            scheduler.Submit(CommandScope::kPackage, "com.example." + std::to_string(i % 3), false,
+                             [&done]() { Sleep(1); done++; });
+        }
+    }
+    EXPECT_EQ(10, done.load());
+}
+
+}  // namespace installd
+}  // namespace android
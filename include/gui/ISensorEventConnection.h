@@ -29,6 +29,7 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 class BitTube;
+class SensorDirectChannel;
 
 class ISensorEventConnection : public IInterface
 {
@@ -40,6 +41,12 @@ public:
                                    nsecs_t maxBatchReportLatencyNs, int reservedFlags) = 0;
     virtual status_t setEventRate(int handle, nsecs_t ns) = 0;
     virtual status_t flush() = 0;
+    // Delivers the events of this connection through the shared memory ring of the channel
+    // instead of the BitTube, and wakes up the reader on the BitTube no later than maxLatencyNs
+    // after an event was written. The events of wake-up sensors stay on the BitTube, as they
+    // must be acknowledged. A NULL channel goes back to the BitTube.
+    virtual status_t setDirectChannel(const sp<SensorDirectChannel>& channel,
+                                      nsecs_t maxLatencyNs) = 0;
 };
 
 // ----------------------------------------------------------------------------
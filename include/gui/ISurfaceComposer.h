@@ -31,6 +31,9 @@
 
 #include <gui/IGraphicBufferAlloc.h>
 #include <gui/ISurfaceComposerClient.h>
+#include <gui/LayerCompositionStats.h>
+
+#include <vector>
 
 namespace android {
 // ----------------------------------------------------------------------------
@@ -175,6 +178,14 @@ public:
      */
     virtual status_t getHdrCapabilities(const sp<IBinder>& display,
             HdrCapabilities* outCapabilities) const = 0;
+
+    /* Gets the GPU composition cost of every layer, aggregated over the
+     * most recent frames in which each layer was composed by SurfaceFlinger.
+     *
+     * Requires the ACCESS_SURFACE_FLINGER permission.
+     */
+    virtual status_t getLayerCompositionStats(
+            std::vector<LayerCompositionStats>* outStats) const = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -206,6 +217,7 @@ public:
         GET_DISPLAY_COLOR_MODES,
         GET_ACTIVE_COLOR_MODE,
         SET_ACTIVE_COLOR_MODE,
+        GET_LAYER_COMPOSITION_STATS,
     };
 
     virtual status_t onTransact(uint32_t code, const Parcel& data,
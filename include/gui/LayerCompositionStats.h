@@ -0,0 +1,74 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_LAYERCOMPOSITIONSTATS_H
+#define ANDROID_GUI_LAYERCOMPOSITIONSTATS_H
+
+#include <binder/Parcelable.h>
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+/*
+ * Cost of composing a single layer with the GPU, aggregated over the most
+ * recent frames in which SurfaceFlinger drew that layer itself (i.e. the
+ * layer was not handled by hardware composer overlays).
+ */
+struct LayerCompositionStats : public Parcelable {
+    LayerCompositionStats()
+      : name(),
+        numFrames(0),
+        totalCpuTime(0),
+        maxCpuTime(0),
+        numGpuSamples(0),
+        totalGpuTime(0),
+        maxGpuTime(0),
+        totalPixels(0),
+        numTextureUploads(0) {}
+
+    // Parcelable interface
+    virtual status_t writeToParcel(Parcel* parcel) const override;
+    virtual status_t readFromParcel(const Parcel* parcel) override;
+
+    String8 name;
+
+    // Number of GPU-composed frames covered by these stats
+    uint32_t numFrames;
+
+    // CPU time spent by SurfaceFlinger issuing the draw calls for the layer
+    nsecs_t totalCpuTime;
+    nsecs_t maxCpuTime;
+
+    // GPU time spent executing the draw calls for the layer. Not every frame
+    // necessarily has a GPU sample (timing may be disabled, or the result may
+    // have been lost to a disjoint event), so it carries its own count.
+    uint32_t numGpuSamples;
+    nsecs_t totalGpuTime;
+    nsecs_t maxGpuTime;
+
+    // Number of framebuffer pixels covered by the layer's geometry
+    uint64_t totalPixels;
+
+    // Number of frames for which a newly latched buffer had to be bound to the
+    // layer's texture before drawing
+    uint32_t numTextureUploads;
+};
+
+} // namespace android
+
+#endif
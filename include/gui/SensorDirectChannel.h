@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_SENSOR_DIRECT_CHANNEL_H
+#define ANDROID_GUI_SENSOR_DIRECT_CHANNEL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+
+struct ASensorEvent;
+
+namespace android {
+// ----------------------------------------------------------------------------
+class BitTube;
+class Parcel;
+
+/*
+ * A ring of sensor events in shared memory, written by the sensor service and read by an
+ * application.
+ *
+ * The service copies events to the ring without a syscall and decides when to wake up the
+ * application, so a high rate sensor can be delivered in batches at a bounded latency. Events
+ * that don't fit in the ring are dropped and counted.
+ *
+ * The wakeups go through the BitTube of the connection, as messages of WAKEUP_SIZE bytes
+ * among the events of the sensors that still use the socket. The application keeps waiting
+ * on the same fd whether the ring is in use or not.
+ */
+class SensorDirectChannel : public RefBase
+{
+public:
+    // size of a wakeup message, which no message of events has
+    enum { WAKEUP_SIZE = 1 };
+
+    // creates a channel with room for at least capacity events
+    explicit SensorDirectChannel(size_t capacity);
+
+    // maps the ring parceled by writeToParcel()
+    explicit SensorDirectChannel(const Parcel& data);
+    virtual ~SensorDirectChannel();
+
+    // check state after construction
+    status_t initCheck() const;
+
+    // number of events the ring can hold
+    size_t getCapacity() const;
+
+    // number of events currently in the ring
+    size_t getSize() const;
+
+    // number of events dropped because the ring was full
+    uint32_t getDroppedCount() const;
+
+    // copies as many events as fit to the ring and counts the others as dropped.
+    // returns the number of events written, or BAD_VALUE if the ring is corrupted.
+    ssize_t write(ASensorEvent const* events, size_t count);
+
+    // sends a wakeup message to the reader of tube, without blocking. A full socket already
+    // wakes the reader up, so the wakeup is then left out.
+    static status_t wake(const sp<BitTube>& tube);
+
+    // copies up to count events from the ring.
+    // returns the number of events read, -EAGAIN if there are none, or BAD_VALUE if the
+    // ring is corrupted.
+    ssize_t read(ASensorEvent* events, size_t count);
+
+    // parcels the ring of this channel
+    status_t writeToParcel(Parcel* data) const;
+
+private:
+    struct Ring;
+
+    status_t map();
+    ssize_t readRing(ASensorEvent* events, size_t count);
+
+    int mMemoryFd;
+    Ring* mRing;
+    size_t mMappedSize;
+    uint32_t mCapacity;
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_GUI_SENSOR_DIRECT_CHANNEL_H
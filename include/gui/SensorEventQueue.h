@@ -43,6 +43,7 @@ namespace android {
 
 class ISensorEventConnection;
 class Sensor;
+class SensorDirectChannel;
 class Looper;
 
 // ----------------------------------------------------------------------------
@@ -93,10 +94,19 @@ public:
     void sendAck(const ASensorEvent* events, int count);
 
     status_t injectSensorEvent(const ASensorEvent& event);
+
+    // Receive the events through a shared memory ring with room for at least capacity events
+    // instead of the socket. The service wakes up the reader through the socket at most
+    // maxLatencyNs after writing an event, 0 wakes it up on every write, so getFd() stays the
+    // same. Wake-up sensors keep using the socket, as their events must be acknowledged.
+    // Must be called from the thread that reads the events.
+    status_t enableDirectChannel(size_t capacity, nsecs_t maxLatencyNs);
+    status_t disableDirectChannel();
 private:
     sp<Looper> getLooper() const;
     sp<ISensorEventConnection> mSensorEventConnection;
     sp<BitTube> mSensorChannel;
+    sp<SensorDirectChannel> mDirectChannel;
     mutable Mutex mLock;
     mutable sp<Looper> mLooper;
     ASensorEvent* mRecBuffer;
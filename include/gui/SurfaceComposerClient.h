@@ -33,6 +33,7 @@
 
 #include <gui/CpuConsumer.h>
 #include <gui/SurfaceControl.h>
+#include <gui/LayerCompositionStats.h>
 
 namespace android {
 
@@ -167,6 +168,9 @@ public:
     static status_t getHdrCapabilities(const sp<IBinder>& display,
             HdrCapabilities* outCapabilities);
 
+    static status_t getLayerCompositionStats(
+            std::vector<LayerCompositionStats>* outStats);
+
     static status_t setDisplaySurface(const sp<IBinder>& token,
             sp<IGraphicBufferProducer> bufferProducer);
     static void setDisplayLayerStack(const sp<IBinder>& token,
@@ -21,6 +21,8 @@
  * Native input transport.
  *
  * The InputChannel provides a mechanism for exchanging InputMessage structures across processes.
+ * Messages go through a socket, or optionally through a pair of rings in shared memory, in
+ * which case the socket only carries wakeups.
  *
  * The InputPublisher and InputConsumer each handle one end-point of an input channel.
  * The InputPublisher is used by the input dispatcher to send events to the application.
@@ -28,6 +30,7 @@
  */
 
 #include <input/Input.h>
+#include <input/TouchResampling.h>
 #include <utils/Errors.h>
 #include <utils/Timers.h>
 #include <utils/RefBase.h>
@@ -37,6 +40,8 @@
 
 namespace android {
 
+class Parcel;
+
 /*
  * Intermediate representation used to send input events and related signals.
  *
@@ -48,8 +53,12 @@ struct InputMessage {
         TYPE_KEY = 1,
         TYPE_MOTION = 2,
         TYPE_FINISHED = 3,
+        TYPE_FINISHED_BATCH = 4,
     };
 
+    // Maximum number of finished signals in a TYPE_FINISHED_BATCH message.
+    enum { MAX_FINISHED_BATCH = 64 };
+
     struct Header {
         uint32_t type;
         // We don't need this field in order to align the body below but we
@@ -121,6 +130,21 @@ struct InputMessage {
                 return sizeof(Finished);
             }
         } finished;
+
+        // The finished signals of several messages at once, in the order the
+        // consumer finished them.
+        struct FinishedBatch {
+            uint32_t count;
+            uint32_t padding;
+            struct Entry {
+                uint32_t seq;
+                uint32_t handled;
+            } entries[MAX_FINISHED_BATCH];
+
+            inline size_t size() const {
+                return sizeof(FinishedBatch) - sizeof(Entry) * (MAX_FINISHED_BATCH - count);
+            }
+        } finishedBatch;
     } __attribute__((aligned(8))) body;
 
     bool isValid(size_t actualSize) const;
@@ -133,6 +157,14 @@ struct InputMessage {
  *
  * Each endpoint has its own InputChannel object that specifies its file descriptor.
  *
+ * A channel may also have a shared memory region holding one ring of messages per
+ * direction, if the pair was opened with one.  Messages are then copied to the ring
+ * instead of being sent one syscall at a time, and the socket is only written to when
+ * the reader has run out of messages and may be waiting for the socket to become
+ * readable.  Several messages written back to back cost at most one wakeup.  The socket
+ * still reports when the peer goes away.  The region travels along with the socket
+ * when the channel is written to a parcel.
+ *
  * The input channel is closed when all references to it are released.
  */
 class InputChannel : public RefBase {
@@ -142,16 +174,30 @@ protected:
 public:
     InputChannel(const String8& name, int fd);
 
+    /* Creates an input channel that exchanges messages through the shared memory region
+     * ringFd and only uses the socket fd for wakeups.  The channel takes ownership of both
+     * file descriptors.  isRingServer tells which end of the channel this is, and must be
+     * true for exactly one of the two ends.
+     */
+    InputChannel(const String8& name, int fd, int ringFd, bool isRingServer);
+
     /* Creates a pair of input channels.
+     * If useSharedRing is true, the channels exchange messages through shared memory
+     * and only use their socket for wakeups.
      *
      * Returns OK on success.
      */
     static status_t openInputChannelPair(const String8& name,
-            sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel);
+            sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel,
+            bool useSharedRing = false);
 
     inline String8 getName() const { return mName; }
     inline int getFd() const { return mFd; }
 
+    /* Returns the fd of the shared memory region, or -1 if messages go through the socket. */
+    inline int getRingFd() const { return mRingFd; }
+    inline bool isRingServer() const { return mRingServer; }
+
     /* Sends a message to the other endpoint.
      *
      * If the channel is full then the message is guaranteed not to have been sent at all.
@@ -177,12 +223,32 @@ public:
      */
     status_t receiveMessage(InputMessage* msg);
 
-    /* Returns a new object that has a duplicate of this channel's fd. */
+    /* Returns a new object that has a duplicate of this channel's fds. */
     sp<InputChannel> dup() const;
 
+    /* Writes the name and duplicates of the fds of the channel to a parcel. */
+    status_t writeToParcel(Parcel* parcel) const;
+
+    /* Reads a channel written by writeToParcel(), or returns NULL if the parcel
+     * does not hold a valid one. */
+    static sp<InputChannel> readFromParcel(const Parcel* parcel);
+
 private:
+    struct SharedRing;
+
+    static status_t openSocketPair(const String8& name, int sockets[2]);
+
+    status_t sendRingMessage(const InputMessage* msg);
+    status_t receiveRingMessage(InputMessage* msg);
+    status_t sendWakeup();
+    status_t drainWakeups();
+
     String8 mName;
     int mFd;
+
+    int mRingFd;
+    bool mRingServer;
+    SharedRing* mRing;
 };
 
 /*
@@ -263,6 +329,10 @@ public:
 
 private:
     sp<InputChannel> mChannel;
+
+    // The finished signals of the last batch received, and how many have been returned.
+    InputMessage mFinishedBatch;
+    uint32_t mFinishedBatchIndex;
 };
 
 /*
@@ -270,8 +340,11 @@ private:
  */
 class InputConsumer {
 public:
-    /* Creates a consumer associated with an input channel. */
-    explicit InputConsumer(const sp<InputChannel>& channel);
+    /* Creates a consumer associated with an input channel that resamples touches
+     * using the specified strategy.
+     * If the strategy is NULL, uses the default strategy for the platform. */
+    explicit InputConsumer(const sp<InputChannel>& channel,
+            const char* resamplingStrategy = NULL);
 
     /* Destroys the consumer and releases its input channel. */
     ~InputConsumer();
@@ -309,6 +382,8 @@ public:
      * with the specified sequence number has finished being process and whether
      * the message was handled by the consumer.
      *
+     * The signals of all the messages of a batch go in a single message.
+     *
      * Returns OK on success.
      * Returns BAD_VALUE if seq is 0.
      * Other errors probably indicate that the channel is broken.
@@ -344,6 +419,9 @@ private:
     // True if touch resampling is enabled.
     const bool mResampleTouch;
 
+    // The touch resampling strategy.
+    TouchResamplingStrategy* const mResamplingStrategy;
+
     // The input channel.
     sp<InputChannel> mChannel;
 
@@ -387,7 +465,7 @@ private:
         int32_t source;
         size_t historyCurrent;
         size_t historySize;
-        History history[2];
+        History history[TouchResamplingStrategy::HISTORY_SIZE];
         History lastResample;
 
         void initialize(int32_t deviceId, int32_t source) {
@@ -400,15 +478,23 @@ private:
         }
 
         void addHistory(const InputMessage* msg) {
-            historyCurrent ^= 1;
-            if (historySize < 2) {
+            historyCurrent = (historyCurrent + 1) % TouchResamplingStrategy::HISTORY_SIZE;
+            if (historySize < TouchResamplingStrategy::HISTORY_SIZE) {
                 historySize += 1;
             }
             history[historyCurrent].initializeFrom(msg);
         }
 
+        // Forgets the past samples of a pointer, such as when its id is reused.
+        void clearHistory(uint32_t id) {
+            for (size_t i = 0; i < historySize; i++) {
+                history[i].idBits.clearBit(id);
+            }
+        }
+
         const History* getHistory(size_t index) const {
-            return &history[(historyCurrent + index) & 1];
+            return &history[(historyCurrent + TouchResamplingStrategy::HISTORY_SIZE - index)
+                    % TouchResamplingStrategy::HISTORY_SIZE];
         }
     };
     Vector<TouchState> mTouchStates;
@@ -432,11 +518,14 @@ private:
     void rewriteMessage(const TouchState& state, InputMessage* msg);
     void resampleTouchState(nsecs_t frameTime, MotionEvent* event,
             const InputMessage *next);
+    bool predictPointer(const TouchState& touchState, uint32_t id, nsecs_t sampleTime,
+            float* outX, float* outY) const;
 
     ssize_t findBatch(int32_t deviceId, int32_t source) const;
     ssize_t findTouchState(int32_t deviceId, int32_t source) const;
 
     status_t sendUnchainedFinishedSignal(uint32_t seq, bool handled);
+    status_t sendFinishedSignalBatch(const uint32_t* seqs, size_t count, bool handled);
 
     static void initializeKeyEvent(KeyEvent* event, const InputMessage* msg);
     static void initializeMotionEvent(MotionEvent* event, const InputMessage* msg);
@@ -446,6 +535,10 @@ private:
     static bool shouldResampleTool(int32_t toolType);
 
     static bool isTouchResamplingEnabled();
+
+    static const char* DEFAULT_RESAMPLING_STRATEGY;
+
+    static TouchResamplingStrategy* createResamplingStrategy(const char* strategy);
 };
 
 } // namespace android
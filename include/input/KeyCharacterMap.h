@@ -24,6 +24,7 @@
 #endif
 
 #include <input/Input.h>
+#include <input/KeyMapCache.h>
 #include <utils/Errors.h>
 #include <utils/KeyedVector.h>
 #include <utils/Tokenizer.h>
@@ -145,29 +146,22 @@ protected:
 
 private:
     struct Behavior {
-        Behavior();
-        Behavior(const Behavior& other);
-
-        /* The next behavior in the list, or NULL if none. */
-        Behavior* next;
-
         /* The meta key modifiers for this behavior. */
         int32_t metaState;
 
-        /* The character to insert. */
-        char16_t character;
-
         /* The fallback keycode if the key is not handled. */
         int32_t fallbackKeyCode;
 
         /* The replacement keycode if the key has to be replaced outright. */
         int32_t replacementKeyCode;
+
+        /* The character to insert. */
+        char16_t character;
     };
 
     struct Key {
-        Key();
-        Key(const Key& other);
-        ~Key();
+        /* The Android key code. */
+        int32_t keyCode;
 
         /* The single character label printed on the key, or 0 if none. */
         char16_t label;
@@ -175,9 +169,20 @@ private:
         /* The number or symbol character generated by the key, or 0 if none. */
         char16_t number;
 
-        /* The list of key behaviors sorted from most specific to least specific
-         * meta key binding. */
-        Behavior* firstBehavior;
+        /* The range of the key behaviors in mBehaviors, sorted from most specific
+         * to least specific meta key binding. */
+        uint32_t firstBehavior;
+        uint32_t behaviorCount;
+    };
+
+    struct CharacterKey {
+        /* The character generated by the key. */
+        char16_t character;
+
+        /* The key and the meta state of its most general behavior that generate
+         * the character. */
+        int32_t keyCode;
+        int32_t metaState;
     };
 
     class Parser {
@@ -217,21 +222,29 @@ private:
         status_t parseMapKey();
         status_t parseKey();
         status_t parseKeyProperty();
-        status_t finishKey(Key* key);
+        status_t finishKey(Key& key);
         status_t parseModifier(const String8& token, int32_t* outMetaState);
         status_t parseCharacterLiteral(char16_t* outCharacter);
     };
 
     static sp<KeyCharacterMap> sEmpty;
 
-    KeyedVector<int32_t, Key*> mKeys;
+    /* The keys sorted by key code. */
+    Vector<Key> mKeys;
+    /* The behaviors of all keys, each key owns a contiguous range. */
+    Vector<Behavior> mBehaviors;
+    /* The keys that generate each character, sorted by character. */
+    Vector<CharacterKey> mKeysByCharacter;
     int mType;
 
     KeyedVector<int32_t, int32_t> mKeysByScanCode;
     KeyedVector<int32_t, int32_t> mKeysByUsageCode;
 
     KeyCharacterMap();
-    KeyCharacterMap(const KeyCharacterMap& other);
+
+    ssize_t indexOfKey(int32_t keyCode) const;
+    ssize_t insertKey(int32_t keyCode);
+    void buildCharacterIndex();
 
     bool getKey(int32_t keyCode, const Key** outKey) const;
     bool getKeyBehavior(int32_t keyCode, int32_t metaState,
@@ -241,6 +254,10 @@ private:
     bool findKey(char16_t ch, int32_t* outKeyCode, int32_t* outMetaState) const;
 
     static status_t load(Tokenizer* tokenizer, Format format, sp<KeyCharacterMap>* outMap);
+    static status_t loadCompiled(const String8& filename, Format format,
+            sp<KeyCharacterMap>* outMap);
+    void writeCompiled(const String8& filename, const KeyMapCache::Source& source) const;
+    static bool isTypeAllowed(int32_t type, Format format);
 
     static void addKey(Vector<KeyEvent>& outEvents,
             int32_t deviceId, int32_t keyCode, int32_t metaState, bool down, nsecs_t time);
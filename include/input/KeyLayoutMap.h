@@ -18,6 +18,7 @@
 #define _LIBINPUT_KEY_LAYOUT_MAP_H
 
 #include <stdint.h>
+#include <input/KeyMapCache.h>
 #include <utils/Errors.h>
 #include <utils/KeyedVector.h>
 #include <utils/Tokenizer.h>
@@ -96,6 +97,9 @@ private:
 
     const Key* getKey(int32_t scanCode, int32_t usageCode) const;
 
+    static status_t loadCompiled(const String8& filename, sp<KeyLayoutMap>* outMap);
+    void writeCompiled(const String8& filename, const KeyMapCache::Source& source) const;
+
     class Parser {
         KeyLayoutMap* mMap;
         Tokenizer* mTokenizer;
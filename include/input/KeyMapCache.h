@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBINPUT_KEY_MAP_CACHE_H
+#define _LIBINPUT_KEY_MAP_CACHE_H
+
+#include <stdint.h>
+#include <utils/Errors.h>
+#include <utils/String8.h>
+
+namespace android {
+
+class FileMap;
+
+/**
+ * Stores key layout and key character maps in a compiled binary form so that
+ * they can be loaded again without tokenizing and parsing their source files.
+ *
+ * A compiled file is a versioned header followed by sections, each of which is
+ * an array of fixed size records that the maps copy straight out of the mapping.
+ * The header records the path, size and modification time of the source file
+ * and the compiled file is ignored as soon as any of them differ.
+ *
+ * The cache is disabled until a directory has been set.
+ */
+class KeyMapCache {
+public:
+    enum {
+        VERSION = 1,
+    };
+
+    enum Type {
+        TYPE_KEY_LAYOUT = 1,
+        TYPE_KEY_CHARACTER_MAP = 2,
+    };
+
+    struct Section {
+        const void* data;
+        uint32_t recordSize;
+        uint32_t recordCount;
+    };
+
+    /* Identifies the version of a source file that a compiled file was made from. */
+    struct Source {
+        int64_t size;
+        int64_t modifiedTime;
+    };
+
+    /* Sets the directory of the compiled files, or an empty string to disable the cache. */
+    static void setDirectory(const String8& directory);
+
+    /* Gets the directory of the compiled files, empty if the cache is disabled. */
+    static String8 getDirectory();
+
+    /* Opens the compiled form of the source file.
+     * Returns NULL if the cache is disabled or there is no up to date compiled file. */
+    static KeyMapCache* open(const String8& sourcePath, Type type);
+
+    /* Reads the contents of a source file to parse.
+     * The source is taken from the same open file, so that it matches the contents. */
+    static status_t readSource(const String8& sourcePath, String8* outContents,
+            Source* outSource);
+
+    /* Writes the compiled form of the source file, replacing any previous one. */
+    static status_t write(const String8& sourcePath, const Source& source, Type type,
+            const Section* sections, uint32_t sectionCount);
+
+    ~KeyMapCache();
+
+    inline uint32_t getSectionCount() const { return mSectionCount; }
+
+    /* Gets the records of a section.
+     * Returns NULL if the section does not exist or its records are not of the given size. */
+    const void* getSection(uint32_t index, uint32_t recordSize, uint32_t* outRecordCount) const;
+
+private:
+    struct Header;
+    struct SectionHeader;
+
+    FileMap* mFileMap;
+    const uint8_t* mData;
+    const SectionHeader* mSections;
+    uint32_t mSectionCount;
+
+    KeyMapCache(FileMap* fileMap, const uint8_t* data,
+            const SectionHeader* sections, uint32_t sectionCount);
+
+    static String8 getCompiledPath(const String8& directory, const String8& sourcePath);
+};
+
+} // namespace android
+
+#endif // _LIBINPUT_KEY_MAP_CACHE_H
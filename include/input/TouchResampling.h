@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBINPUT_TOUCH_RESAMPLING_H
+#define _LIBINPUT_TOUCH_RESAMPLING_H
+
+#include <stddef.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+/*
+ * Implements a particular touch resampling algorithm.
+ *
+ * The input consumer resamples touches at the start of each frame minus the latency
+ * of the strategy.  When a later sample is already known it interpolates linearly,
+ * otherwise it asks the strategy to predict the position of each pointer from its
+ * most recent samples, no further than the maximum prediction past the last sample.
+ */
+class TouchResamplingStrategy {
+protected:
+    TouchResamplingStrategy() { }
+
+public:
+    struct Sample {
+        nsecs_t eventTime;
+        float x, y;
+    };
+
+    // Maximum number of past samples of a pointer that are kept for prediction.
+    static const size_t HISTORY_SIZE = 8;
+
+    virtual ~TouchResamplingStrategy() { }
+
+    // Gets the time subtracted from the frame time to obtain the time to resample at.
+    // A few milliseconds in the past make mispredictions less likely at the cost of lag.
+    virtual nsecs_t getLatency() const = 0;
+
+    // Gets the maximum time to predict past the most recent sample, given the time
+    // between the two most recent samples.
+    virtual nsecs_t getMaxPrediction(nsecs_t delta) const = 0;
+
+    // Predicts the position of a pointer at the sample time.
+    // The samples are ordered from the most recent one backwards, there are at least two
+    // of them and the sample time is no earlier than the most recent one.
+    // Returns false if the pointer should keep its most recent position.
+    virtual bool predict(const Sample* samples, size_t sampleCount, nsecs_t sampleTime,
+            float* outX, float* outY) const = 0;
+
+    // Creates the strategy with the specified name, or NULL if there is no such strategy.
+    static TouchResamplingStrategy* create(const char* name);
+};
+
+
+/*
+ * Extrapolates linearly from the two most recent samples, half a sample period at most.
+ */
+class LinearTouchResamplingStrategy : public TouchResamplingStrategy {
+public:
+    LinearTouchResamplingStrategy();
+    virtual ~LinearTouchResamplingStrategy();
+
+    virtual nsecs_t getLatency() const;
+    virtual nsecs_t getMaxPrediction(nsecs_t delta) const;
+    virtual bool predict(const Sample* samples, size_t sampleCount, nsecs_t sampleTime,
+            float* outX, float* outY) const;
+};
+
+
+/*
+ * Tracks position, velocity and acceleration of each axis with a Kalman filter over the
+ * recent samples and predicts the position at the frame time itself, so it adds no
+ * latency and may predict further ahead than the linear strategy.
+ */
+class KalmanTouchResamplingStrategy : public TouchResamplingStrategy {
+public:
+    KalmanTouchResamplingStrategy();
+    virtual ~KalmanTouchResamplingStrategy();
+
+    virtual nsecs_t getLatency() const;
+    virtual nsecs_t getMaxPrediction(nsecs_t delta) const;
+    virtual bool predict(const Sample* samples, size_t sampleCount, nsecs_t sampleTime,
+            float* outX, float* outY) const;
+
+private:
+    struct State {
+        // Position, velocity and acceleration, and their covariance.
+        double x[3];
+        double p[3][3];
+    };
+
+    static void initialize(State* state, double position);
+    static void advance(State* state, double dt);
+    static void update(State* state, double position);
+    static double predict(const State& state, double dt);
+};
+
+} // namespace android
+
+#endif // _LIBINPUT_TOUCH_RESAMPLING_H
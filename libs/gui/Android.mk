@@ -64,9 +64,11 @@ LOCAL_SRC_FILES := \
 	ISensorServer.cpp \
 	ISurfaceComposer.cpp \
 	ISurfaceComposerClient.cpp \
+	LayerCompositionStats.cpp \
 	LayerState.cpp \
 	OccupancyTracker.cpp \
 	Sensor.cpp \
+	SensorDirectChannel.cpp \
 	SensorEventQueue.cpp \
 	SensorManager.cpp \
 	StreamSplitter.cpp \
@@ -26,6 +26,7 @@
 
 #include <gui/ISensorEventConnection.h>
 #include <gui/BitTube.h>
+#include <gui/SensorDirectChannel.h>
 
 namespace android {
 // ----------------------------------------------------------------------------
@@ -34,7 +35,8 @@ enum {
     GET_SENSOR_CHANNEL = IBinder::FIRST_CALL_TRANSACTION,
     ENABLE_DISABLE,
     SET_EVENT_RATE,
-    FLUSH_SENSOR
+    FLUSH_SENSOR,
+    SET_DIRECT_CHANNEL
 };
 
 class BpSensorEventConnection : public BpInterface<ISensorEventConnection>
@@ -85,6 +87,23 @@ public:
         remote()->transact(FLUSH_SENSOR, data, &reply);
         return reply.readInt32();
     }
+
+    virtual status_t setDirectChannel(const sp<SensorDirectChannel>& channel,
+                                      nsecs_t maxLatencyNs)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISensorEventConnection::getInterfaceDescriptor());
+        data.writeInt32(channel != NULL);
+        if (channel != NULL) {
+            status_t err = channel->writeToParcel(&data);
+            if (err != NO_ERROR) {
+                return err;
+            }
+        }
+        data.writeInt64(maxLatencyNs);
+        remote()->transact(SET_DIRECT_CHANNEL, data, &reply);
+        return reply.readInt32();
+    }
 };
 
 // Out-of-line virtual method definition to trigger vtable emission in this
@@ -131,6 +150,17 @@ status_t BnSensorEventConnection::onTransact(
             reply->writeInt32(result);
             return NO_ERROR;
         }
+        case SET_DIRECT_CHANNEL: {
+            CHECK_INTERFACE(ISensorEventConnection, data, reply);
+            sp<SensorDirectChannel> channel;
+            if (data.readInt32()) {
+                channel = new SensorDirectChannel(data);
+            }
+            nsecs_t maxLatencyNs = data.readInt64();
+            status_t result = setDirectChannel(channel, maxLatencyNs);
+            reply->writeInt32(result);
+            return NO_ERROR;
+        }
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
@@ -385,6 +385,23 @@ public:
         }
         return result;
     }
+
+    virtual status_t getLayerCompositionStats(
+            std::vector<LayerCompositionStats>* outStats) const {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
+        status_t result = remote()->transact(
+                BnSurfaceComposer::GET_LAYER_COMPOSITION_STATS, data, &reply);
+        if (result != NO_ERROR) {
+            ALOGE("getLayerCompositionStats failed to transact: %d", result);
+            return result;
+        }
+        result = reply.readInt32();
+        if (result == NO_ERROR) {
+            result = reply.readParcelableVector(outStats);
+        }
+        return result;
+    }
 };
 
 // Out-of-line virtual method definition to trigger vtable emission in this
@@ -639,6 +656,16 @@ status_t BnSurfaceComposer::onTransact(
             }
             return NO_ERROR;
         }
+        case GET_LAYER_COMPOSITION_STATS: {
+            CHECK_INTERFACE(ISurfaceComposer, data, reply);
+            std::vector<LayerCompositionStats> stats;
+            status_t result = getLayerCompositionStats(&stats);
+            reply->writeInt32(result);
+            if (result == NO_ERROR) {
+                reply->writeParcelableVector(stats);
+            }
+            return NO_ERROR;
+        }
         default: {
             return BBinder::onTransact(code, data, reply, flags);
         }
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gui/LayerCompositionStats.h>
+#include <binder/Parcel.h>
+
+namespace android {
+
+status_t LayerCompositionStats::writeToParcel(Parcel* parcel) const {
+    status_t result = parcel->writeString8(name);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->writeUint32(numFrames);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->writeInt64(totalCpuTime);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->writeInt64(maxCpuTime);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->writeUint32(numGpuSamples);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->writeInt64(totalGpuTime);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->writeInt64(maxGpuTime);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->writeUint64(totalPixels);
+    if (result != OK) {
+        return result;
+    }
+    return parcel->writeUint32(numTextureUploads);
+}
+
+status_t LayerCompositionStats::readFromParcel(const Parcel* parcel) {
+    name = parcel->readString8();
+    status_t result = parcel->readUint32(&numFrames);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->readInt64(&totalCpuTime);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->readInt64(&maxCpuTime);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->readUint32(&numGpuSamples);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->readInt64(&totalGpuTime);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->readInt64(&maxGpuTime);
+    if (result != OK) {
+        return result;
+    }
+    result = parcel->readUint64(&totalPixels);
+    if (result != OK) {
+        return result;
+    }
+    return parcel->readUint32(&numTextureUploads);
+}
+
+} // namespace android
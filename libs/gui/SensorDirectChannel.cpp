@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Sensors"
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cutils/ashmem.h>
+#include <cutils/log.h>
+#include <utils/Errors.h>
+
+#include <binder/Parcel.h>
+
+#include <gui/BitTube.h>
+#include <gui/SensorDirectChannel.h>
+
+#include <android/sensor.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+// Bounds of the capacity of a ring, in events.
+static const size_t MIN_CAPACITY = 16;
+static const size_t MAX_CAPACITY = 64 * 1024;
+
+// Precedes the events in the shared memory region.
+//
+// head and tail count the events ever written and read, so they wrap around at 2^32 and
+// the ring is empty when they are equal. The application can write anything to the shared
+// memory, so the service checks what it reads from it before use.
+struct SensorDirectChannel::Ring {
+    // Written once by the application when it creates the ring.
+    uint32_t capacity;
+    uint8_t capacityPadding[64 - sizeof(uint32_t)];
+
+    // Only written by the service.
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> dropped;
+    uint8_t headPadding[64 - 2 * sizeof(std::atomic<uint32_t>)];
+
+    // Only written by the application.
+    std::atomic<uint32_t> tail;
+    uint8_t tailPadding[64 - sizeof(std::atomic<uint32_t>)];
+
+    inline ASensorEvent* events() {
+        return reinterpret_cast<ASensorEvent*>(this + 1);
+    }
+};
+
+// The region is shared between 32 and 64 bit processes.
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+        "std::atomic<uint32_t> must have the size of uint32_t");
+static_assert(sizeof(ASensorEvent) % 8 == 0,
+        "ASensorEvent must keep the events of the ring aligned");
+
+static size_t roundUpCapacity(size_t capacity) {
+    size_t result = MIN_CAPACITY;
+    while (result < capacity && result < MAX_CAPACITY) {
+        result <<= 1;
+    }
+    return result;
+}
+
+SensorDirectChannel::SensorDirectChannel(size_t capacity)
+    : mMemoryFd(-1), mRing(NULL), mMappedSize(0), mCapacity(0)
+{
+    capacity = roundUpCapacity(capacity);
+    size_t size = sizeof(Ring) + capacity * sizeof(ASensorEvent);
+    mMemoryFd = ashmem_create_region("SensorDirectChannel", size);
+    if (mMemoryFd < 0) {
+        ALOGE("SensorDirectChannel: can't create shared memory (%s)", strerror(errno));
+        return;
+    }
+    // ashmem regions are zero-filled, which makes an empty ring.
+    void* ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mMemoryFd, 0);
+    if (ring == MAP_FAILED) {
+        ALOGE("SensorDirectChannel: can't map shared memory (%s)", strerror(errno));
+        return;
+    }
+    mRing = static_cast<Ring*>(ring);
+    mMappedSize = size;
+    mCapacity = capacity;
+    mRing->capacity = capacity;
+}
+
+SensorDirectChannel::SensorDirectChannel(const Parcel& data)
+    : mMemoryFd(-1), mRing(NULL), mMappedSize(0), mCapacity(0)
+{
+    mMemoryFd = dup(data.readFileDescriptor());
+    if (mMemoryFd < 0) {
+        ALOGE("SensorDirectChannel(Parcel): can't dup filedescriptor (%s)", strerror(errno));
+        return;
+    }
+    map();
+}
+
+SensorDirectChannel::~SensorDirectChannel()
+{
+    if (mRing) {
+        munmap(mRing, mMappedSize);
+    }
+    if (mMemoryFd >= 0) {
+        close(mMemoryFd);
+    }
+}
+
+status_t SensorDirectChannel::map() {
+    int size = ashmem_get_size_region(mMemoryFd);
+    if (size < int(sizeof(Ring))) {
+        ALOGE("SensorDirectChannel: shared memory is too small (%d)", size);
+        return BAD_VALUE;
+    }
+    void* ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mMemoryFd, 0);
+    if (ring == MAP_FAILED) {
+        ALOGE("SensorDirectChannel: can't map shared memory (%s)", strerror(errno));
+        return -errno;
+    }
+    mRing = static_cast<Ring*>(ring);
+    mMappedSize = size;
+
+    // Read the capacity once, the other side may change it afterwards.
+    uint32_t capacity = mRing->capacity;
+    if (capacity < MIN_CAPACITY || capacity > MAX_CAPACITY || (capacity & (capacity - 1))
+            || sizeof(Ring) + capacity * sizeof(ASensorEvent) > size_t(size)) {
+        ALOGE("SensorDirectChannel: invalid capacity %u for %d bytes", capacity, size);
+        return BAD_VALUE;
+    }
+    mCapacity = capacity;
+    return NO_ERROR;
+}
+
+status_t SensorDirectChannel::initCheck() const
+{
+    return mCapacity ? status_t(NO_ERROR) : status_t(NO_INIT);
+}
+
+size_t SensorDirectChannel::getCapacity() const
+{
+    return mCapacity;
+}
+
+// The ring positions wrap around on purpose.
+__attribute__((no_sanitize("integer")))
+size_t SensorDirectChannel::getSize() const
+{
+    if (!mCapacity) {
+        return 0;
+    }
+    uint32_t used = mRing->head.load(std::memory_order_acquire)
+            - mRing->tail.load(std::memory_order_acquire);
+    return used > mCapacity ? mCapacity : used;
+}
+
+uint32_t SensorDirectChannel::getDroppedCount() const
+{
+    return mCapacity ? mRing->dropped.load(std::memory_order_relaxed) : 0;
+}
+
+__attribute__((no_sanitize("integer")))
+ssize_t SensorDirectChannel::write(ASensorEvent const* events, size_t count)
+{
+    if (!mCapacity) {
+        return NO_INIT;
+    }
+    uint32_t head = mRing->head.load(std::memory_order_relaxed);
+    uint32_t tail = mRing->tail.load(std::memory_order_acquire);
+    uint32_t used = head - tail;
+    if (used > mCapacity) {
+        return BAD_VALUE;
+    }
+
+    size_t written = mCapacity - used < count ? mCapacity - used : count;
+    uint32_t offset = head & (mCapacity - 1);
+    size_t first = mCapacity - offset < written ? mCapacity - offset : written;
+    memcpy(mRing->events() + offset, events, first * sizeof(ASensorEvent));
+    memcpy(mRing->events(), events + first, (written - first) * sizeof(ASensorEvent));
+    mRing->head.store(head + written, std::memory_order_release);
+
+    if (written < count) {
+        mRing->dropped.fetch_add(count - written, std::memory_order_relaxed);
+    }
+    return written;
+}
+
+status_t SensorDirectChannel::wake(const sp<BitTube>& tube)
+{
+    // The BitTube is non-blocking, as the service writes to it with its locks held.
+    const uint8_t wakeup[WAKEUP_SIZE] = { 0 };
+    ssize_t size = BitTube::sendObjects(tube, wakeup, WAKEUP_SIZE);
+    return size < 0 && size != -EAGAIN ? status_t(size) : status_t(NO_ERROR);
+}
+
+ssize_t SensorDirectChannel::read(ASensorEvent* events, size_t count)
+{
+    if (!mCapacity) {
+        return NO_INIT;
+    }
+    ssize_t result = readRing(events, count);
+    return result ? result : ssize_t(-EAGAIN);
+}
+
+__attribute__((no_sanitize("integer")))
+ssize_t SensorDirectChannel::readRing(ASensorEvent* events, size_t count)
+{
+    uint32_t head = mRing->head.load(std::memory_order_acquire);
+    uint32_t tail = mRing->tail.load(std::memory_order_relaxed);
+    uint32_t used = head - tail;
+    if (used > mCapacity) {
+        return BAD_VALUE;
+    }
+
+    size_t read = used < count ? used : count;
+    uint32_t offset = tail & (mCapacity - 1);
+    size_t first = mCapacity - offset < read ? mCapacity - offset : read;
+    memcpy(events, mRing->events() + offset, first * sizeof(ASensorEvent));
+    memcpy(events + first, mRing->events(), (read - first) * sizeof(ASensorEvent));
+    mRing->tail.store(tail + read, std::memory_order_release);
+    return read;
+}
+
+status_t SensorDirectChannel::writeToParcel(Parcel* data) const
+{
+    if (!mCapacity) {
+        return NO_INIT;
+    }
+    return data->writeDupFileDescriptor(mMemoryFd);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
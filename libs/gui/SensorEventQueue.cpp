@@ -28,6 +28,7 @@
 
 #include <gui/Sensor.h>
 #include <gui/BitTube.h>
+#include <gui/SensorDirectChannel.h>
 #include <gui/SensorEventQueue.h>
 #include <gui/ISensorEventConnection.h>
 
@@ -66,13 +67,38 @@ ssize_t SensorEventQueue::write(const sp<BitTube>& tube,
 }
 
 ssize_t SensorEventQueue::read(ASensorEvent* events, size_t numEvents) {
-    if (mAvailable == 0) {
-        ssize_t err = BitTube::recvObjects(mSensorChannel,
-                mRecBuffer, MAX_RECEIVE_BUFFER_EVENT_COUNT);
-        if (err < 0) {
-            return err;
+    while (mAvailable == 0) {
+        if (mDirectChannel != NULL) {
+            ssize_t err = mDirectChannel->read(events, numEvents);
+            if (err == BAD_VALUE) {
+                // The service gives up on a corrupted ring and sends the events to the socket.
+                ALOGE("SensorEventQueue: direct channel is corrupted, going back to the socket");
+                mDirectChannel.clear();
+            } else if (err != -EAGAIN) {
+                return err;
+            }
         }
-        mAvailable = static_cast<size_t>(err);
+        // The socket has the wakeups of the direct channel, the events of wake-up sensors and
+        // the events sent before the direct channel was enabled. A message is received as
+        // bytes, as it is either events or a wakeup.
+        ssize_t size = BitTube::recvObjects(mSensorChannel,
+                reinterpret_cast<uint8_t*>(mRecBuffer),
+                MAX_RECEIVE_BUFFER_EVENT_COUNT * sizeof(ASensorEvent));
+        if (size < 0) {
+            return size;
+        }
+        if (size == SensorDirectChannel::WAKEUP_SIZE) {
+            // Look at the ring again, the wakeup may be for events written after it was
+            // found empty.
+            continue;
+        }
+        // should never happen because of SOCK_SEQPACKET
+        LOG_ALWAYS_FATAL_IF(size % sizeof(ASensorEvent),
+                "SensorEventQueue::read, res=%zd (partial events were received!)", size);
+        if (size == 0) {
+            return 0;
+        }
+        mAvailable = size / sizeof(ASensorEvent);
         mConsumed = 0;
     }
     size_t count = min(numEvents, mAvailable);
@@ -172,6 +198,26 @@ status_t SensorEventQueue::injectSensorEvent(const ASensorEvent& event) {
     } while (true);
 }
 
+status_t SensorEventQueue::enableDirectChannel(size_t capacity, nsecs_t maxLatencyNs) {
+    sp<SensorDirectChannel> channel = new SensorDirectChannel(capacity);
+    status_t err = channel->initCheck();
+    if (err == NO_ERROR) {
+        err = mSensorEventConnection->setDirectChannel(channel, maxLatencyNs);
+    }
+    if (err == NO_ERROR) {
+        mDirectChannel = channel;
+    }
+    return err;
+}
+
+status_t SensorEventQueue::disableDirectChannel() {
+    status_t err = mSensorEventConnection->setDirectChannel(NULL, 0);
+    if (err == NO_ERROR) {
+        mDirectChannel.clear();
+    }
+    return err;
+}
+
 void SensorEventQueue::sendAck(const ASensorEvent* events, int count) {
     for (int i = 0; i < count; ++i) {
         if (events[i].flags & WAKE_UP_SENSOR_EVENT_NEEDS_ACK) {
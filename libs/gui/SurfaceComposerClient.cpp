@@ -907,6 +907,12 @@ status_t SurfaceComposerClient::getHdrCapabilities(const sp<IBinder>& display,
             outCapabilities);
 }
 
+status_t SurfaceComposerClient::getLayerCompositionStats(
+        std::vector<LayerCompositionStats>* outStats) {
+    return ComposerService::getComposerService()->getLayerCompositionStats(
+            outStats);
+}
+
 // ----------------------------------------------------------------------------
 
 #ifndef FORCE_SCREENSHOT_CPU_PATH
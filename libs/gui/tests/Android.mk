@@ -17,6 +17,7 @@ LOCAL_SRC_FILES := \
     IGraphicBufferProducer_test.cpp \
     MultiTextureConsumer_test.cpp \
     SRGB_test.cpp \
+    SensorDirectChannel_test.cpp \
     StreamSplitter_test.cpp \
     SurfaceTextureClient_test.cpp \
     SurfaceTextureFBO_test.cpp \
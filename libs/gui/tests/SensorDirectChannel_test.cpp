@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SensorDirectChannel_test"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <android/sensor.h>
+#include <binder/Parcel.h>
+#include <cutils/ashmem.h>
+#include <gui/BitTube.h>
+#include <gui/SensorDirectChannel.h>
+
+namespace android {
+
+class SensorDirectChannelTest : public ::testing::Test {
+protected:
+    sp<SensorDirectChannel> mWriter;
+    sp<SensorDirectChannel> mReader;
+
+    virtual void SetUp() {
+        mReader = new SensorDirectChannel(16);
+        ASSERT_EQ(NO_ERROR, mReader->initCheck());
+
+        // The service maps the ring the application sends it over binder.
+        Parcel parcel;
+        ASSERT_EQ(NO_ERROR, mReader->writeToParcel(&parcel));
+        parcel.setDataPosition(0);
+        mWriter = new SensorDirectChannel(parcel);
+        ASSERT_EQ(NO_ERROR, mWriter->initCheck());
+    }
+
+    static void makeEvents(ASensorEvent* events, size_t count, int64_t firstTimestamp) {
+        memset(events, 0, count * sizeof(ASensorEvent));
+        for (size_t i = 0; i < count; i++) {
+            events[i].version = sizeof(ASensorEvent);
+            events[i].sensor = 1;
+            events[i].type = ASENSOR_TYPE_ACCELEROMETER;
+            events[i].timestamp = firstTimestamp + i;
+        }
+    }
+
+    static bool isReadable(int fd) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        return poll(&pfd, 1, 0) == 1;
+    }
+};
+
+TEST_F(SensorDirectChannelTest, CapacityIsRoundedUpToAPowerOfTwo) {
+    sp<SensorDirectChannel> channel = new SensorDirectChannel(100);
+    ASSERT_EQ(NO_ERROR, channel->initCheck());
+    EXPECT_EQ(128U, channel->getCapacity());
+    EXPECT_EQ(16U, mWriter->getCapacity());
+}
+
+TEST_F(SensorDirectChannelTest, EventsWrittenByOneSideAreReadByTheOther) {
+    ASensorEvent events[10];
+    makeEvents(events, 10, 1000);
+    ASSERT_EQ(10, mWriter->write(events, 10));
+    EXPECT_EQ(10U, mReader->getSize());
+
+    ASensorEvent received[16];
+    ASSERT_EQ(4, mReader->read(received, 4));
+    ASSERT_EQ(6, mReader->read(received + 4, 16));
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(1000 + i, received[i].timestamp);
+    }
+    EXPECT_EQ(-EAGAIN, mReader->read(received, 16));
+}
+
+TEST_F(SensorDirectChannelTest, EventsWrapAroundTheEndOfTheRing) {
+    ASensorEvent events[12];
+    ASensorEvent received[12];
+    int64_t timestamp = 0;
+    for (int round = 0; round < 5; round++) {
+        makeEvents(events, 12, timestamp);
+        ASSERT_EQ(12, mWriter->write(events, 12));
+        ASSERT_EQ(12, mReader->read(received, 12));
+        for (int i = 0; i < 12; i++) {
+            ASSERT_EQ(timestamp + i, received[i].timestamp);
+        }
+        timestamp += 12;
+    }
+    EXPECT_EQ(0U, mReader->getDroppedCount());
+}
+
+TEST_F(SensorDirectChannelTest, EventsThatDontFitAreDropped) {
+    ASensorEvent events[20];
+    makeEvents(events, 20, 0);
+    ASSERT_EQ(16, mWriter->write(events, 20));
+    EXPECT_EQ(4U, mReader->getDroppedCount());
+    ASSERT_EQ(0, mWriter->write(events, 1));
+    EXPECT_EQ(5U, mReader->getDroppedCount());
+
+    // The oldest events are kept.
+    ASensorEvent received[20];
+    ASSERT_EQ(16, mReader->read(received, 20));
+    EXPECT_EQ(0, received[0].timestamp);
+    EXPECT_EQ(15, received[15].timestamp);
+}
+
+TEST_F(SensorDirectChannelTest, WakeupsGoThroughTheBitTube) {
+    sp<BitTube> tube = new BitTube();
+    ASSERT_EQ(NO_ERROR, tube->initCheck());
+    EXPECT_FALSE(isReadable(tube->getFd()));
+
+    ASensorEvent events[4];
+    makeEvents(events, 4, 0);
+    ASSERT_EQ(4, mWriter->write(events, 4));
+    // Writing alone doesn't wake up the reader, the writer decides when to.
+    EXPECT_FALSE(isReadable(tube->getFd()));
+    ASSERT_EQ(NO_ERROR, SensorDirectChannel::wake(tube));
+    EXPECT_TRUE(isReadable(tube->getFd()));
+
+    // A wakeup can't be mistaken for events.
+    ASensorEvent received[4];
+    EXPECT_EQ(ssize_t(SensorDirectChannel::WAKEUP_SIZE), BitTube::recvObjects(tube,
+            reinterpret_cast<uint8_t*>(received), sizeof(received)));
+    EXPECT_FALSE(isReadable(tube->getFd()));
+    ASSERT_EQ(4, mReader->read(received, 4));
+}
+
+TEST_F(SensorDirectChannelTest, WakeupsDontBlockOnAFullBitTube) {
+    sp<BitTube> tube = new BitTube(4096);
+    ASSERT_EQ(NO_ERROR, tube->initCheck());
+    ASensorEvent events[4];
+    makeEvents(events, 4, 0);
+    while (BitTube::sendObjects(tube, events, 4) > 0) {
+    }
+    EXPECT_EQ(NO_ERROR, SensorDirectChannel::wake(tube));
+}
+
+TEST_F(SensorDirectChannelTest, RejectsRingsWithAnInvalidCapacity) {
+    // The capacity doesn't match the size of the shared memory.
+    int memoryFd = ashmem_create_region("SensorDirectChannel_test", 4096);
+    ASSERT_GE(memoryFd, 0);
+    void* header = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0);
+    ASSERT_NE(MAP_FAILED, header);
+    *static_cast<uint32_t*>(header) = 1024;
+    munmap(header, 4096);
+
+    Parcel parcel;
+    parcel.writeDupFileDescriptor(memoryFd);
+    parcel.setDataPosition(0);
+    sp<SensorDirectChannel> channel = new SensorDirectChannel(parcel);
+    EXPECT_NE(NO_ERROR, channel->initCheck());
+
+    ASensorEvent events[1];
+    makeEvents(events, 1, 0);
+    EXPECT_EQ(NO_INIT, channel->write(events, 1));
+    close(memoryFd);
+}
+
+} // namespace android
@@ -23,12 +23,14 @@ commonSources := \
     Keyboard.cpp \
     KeyCharacterMap.cpp \
     KeyLayoutMap.cpp \
+    KeyMapCache.cpp \
     VirtualKeyMap.cpp
 
 deviceSources := \
     $(commonSources) \
     IInputFlinger.cpp \
     InputTransport.cpp \
+    TouchResampling.cpp \
     VelocityControl.cpp \
     VelocityTracker.cpp
 
@@ -24,12 +24,17 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <math.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <atomic>
+
+#include <cutils/ashmem.h>
 #include <cutils/log.h>
 #include <cutils/properties.h>
+#include <binder/Parcel.h>
 #include <input/InputTransport.h>
 
 
@@ -41,13 +46,17 @@ namespace android {
 // behind processing touches.
 static const size_t SOCKET_BUFFER_SIZE = 32 * 1024;
 
+// Size of each of the two message rings of a shared ring channel.  Matches the socket
+// buffer size so that both transports hold about as many pending events.
+// Must be a power of two.
+static const uint32_t SHARED_RING_SIZE = 32 * 1024;
+
+// Records in the shared rings are aligned on this many bytes, like InputMessage bodies.
+static const uint32_t SHARED_RING_ALIGNMENT = 8;
+
 // Nanoseconds per milliseconds.
 static const nsecs_t NANOS_PER_MS = 1000000;
 
-// Latency added during resampling.  A few milliseconds doesn't hurt much but
-// reduces the impact of mispredicted touch positions.
-static const nsecs_t RESAMPLE_LATENCY = 5 * NANOS_PER_MS;
-
 // Minimum time difference between consecutive samples before attempting to resample.
 static const nsecs_t RESAMPLE_MIN_DELTA = 2 * NANOS_PER_MS;
 
@@ -55,15 +64,6 @@ static const nsecs_t RESAMPLE_MIN_DELTA = 2 * NANOS_PER_MS;
 // by extrapolation.
 static const nsecs_t RESAMPLE_MAX_DELTA = 20 * NANOS_PER_MS;
 
-// Maximum time to predict forward from the last known state, to avoid predicting too
-// far into the future.  This time is further bounded by 50% of the last time delta.
-static const nsecs_t RESAMPLE_MAX_PREDICTION = 8 * NANOS_PER_MS;
-
-template<typename T>
-inline static T min(const T& a, const T& b) {
-    return a < b ? a : b;
-}
-
 inline static float lerp(float a, float b, float alpha) {
     return a + alpha * (b - a);
 }
@@ -80,6 +80,9 @@ bool InputMessage::isValid(size_t actualSize) const {
                     && body.motion.pointerCount <= MAX_POINTERS;
         case TYPE_FINISHED:
             return true;
+        case TYPE_FINISHED_BATCH:
+            return body.finishedBatch.count > 0
+                    && body.finishedBatch.count <= MAX_FINISHED_BATCH;
         }
     }
     return false;
@@ -93,15 +96,153 @@ size_t InputMessage::size() const {
         return sizeof(Header) + body.motion.size();
     case TYPE_FINISHED:
         return sizeof(Header) + body.finished.size();
+    case TYPE_FINISHED_BATCH:
+        return sizeof(Header) + body.finishedBatch.size();
     }
     return sizeof(Header);
 }
 
 
+// --- InputChannel::SharedRing ---
+
+// A single producer, single consumer ring of variable size records in shared memory.
+// head and tail count the bytes ever written and read, so they wrap around at 2^32
+// and the ring is empty when they are equal.
+//
+// The peer can write anything to the shared memory, so everything read from it is
+// checked before use and a corrupted ring is reported as a broken channel.
+struct MessageRing {
+    // Only written by the producer.
+    std::atomic<uint32_t> head;
+    uint8_t headPadding[64 - sizeof(std::atomic<uint32_t>)];
+
+    // Only written by the consumer.
+    std::atomic<uint32_t> tail;
+    // Set by the consumer when it found the ring empty and may wait for the socket to
+    // become readable, cleared by the producer when it sends the wakeup.
+    std::atomic<uint32_t> consumerIdle;
+    uint8_t tailPadding[64 - 2 * sizeof(std::atomic<uint32_t>)];
+
+    uint8_t data[SHARED_RING_SIZE];
+};
+
+// Precedes every record of a ring.
+struct MessageRingRecord {
+    enum {
+        // The rest of the ring up to its end is unused, the next record is at the start.
+        FLAG_WRAP = 1,
+    };
+
+    // Size of the record including this header, a multiple of SHARED_RING_ALIGNMENT.
+    uint32_t size;
+    uint32_t flags;
+};
+
+struct InputChannel::SharedRing {
+    // Messages from the server to the client.
+    MessageRing serverToClient;
+    // Messages from the client to the server.
+    MessageRing clientToServer;
+};
+
+// The region is shared between 32 and 64 bit processes.
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+        "std::atomic<uint32_t> must have the size of uint32_t");
+static_assert(sizeof(InputMessage) % SHARED_RING_ALIGNMENT == 0,
+        "InputMessage must be a multiple of the ring record alignment");
+
+static inline uint32_t ringRecordSize(size_t msgLength) {
+    return (sizeof(MessageRingRecord) + msgLength + SHARED_RING_ALIGNMENT - 1)
+            & ~(SHARED_RING_ALIGNMENT - 1);
+}
+
+// The ring positions wrap around on purpose.
+__attribute__((no_sanitize("integer")))
+static status_t writeRingMessage(MessageRing& ring, const InputMessage* msg) {
+    size_t msgLength = msg->size();
+    uint32_t recordSize = ringRecordSize(msgLength);
+    uint32_t head = ring.head.load(std::memory_order_relaxed);
+    uint32_t tail = ring.tail.load(std::memory_order_acquire);
+    uint32_t used = head - tail;
+    if (used > SHARED_RING_SIZE || head % SHARED_RING_ALIGNMENT) {
+        return BAD_VALUE;
+    }
+
+    // Records are never split, skip the end of the ring if the message doesn't fit there.
+    uint32_t offset = head & (SHARED_RING_SIZE - 1);
+    uint32_t wrapSize = SHARED_RING_SIZE - offset < recordSize ? SHARED_RING_SIZE - offset : 0;
+    if (SHARED_RING_SIZE - used < wrapSize + recordSize) {
+        return WOULD_BLOCK;
+    }
+
+    MessageRingRecord record;
+    if (wrapSize) {
+        record.size = wrapSize;
+        record.flags = MessageRingRecord::FLAG_WRAP;
+        memcpy(ring.data + offset, &record, sizeof(record));
+        offset = 0;
+    }
+    record.size = recordSize;
+    record.flags = 0;
+    memcpy(ring.data + offset, &record, sizeof(record));
+    memcpy(ring.data + offset + sizeof(record), msg, msgLength);
+    ring.head.store(head + wrapSize + recordSize, std::memory_order_seq_cst);
+    return OK;
+}
+
+__attribute__((no_sanitize("integer")))
+static status_t readRingMessage(MessageRing& ring, InputMessage* msg) {
+    for (;;) {
+        uint32_t tail = ring.tail.load(std::memory_order_relaxed);
+        uint32_t head = ring.head.load(std::memory_order_acquire);
+        if (head == tail) {
+            return WOULD_BLOCK;
+        }
+        uint32_t used = head - tail;
+        if (used > SHARED_RING_SIZE || tail % SHARED_RING_ALIGNMENT) {
+            return BAD_VALUE;
+        }
+
+        uint32_t offset = tail & (SHARED_RING_SIZE - 1);
+        MessageRingRecord record;
+        memcpy(&record, ring.data + offset, sizeof(record));
+        if (record.size < sizeof(record) || record.size > used
+                || record.size > SHARED_RING_SIZE - offset
+                || record.size % SHARED_RING_ALIGNMENT) {
+            return BAD_VALUE;
+        }
+        if (record.flags & MessageRingRecord::FLAG_WRAP) {
+            ring.tail.store(tail + record.size, std::memory_order_release);
+            continue;
+        }
+
+        // Copy the message out before looking at it, the producer can't be trusted
+        // to leave it alone.
+        size_t msgLength = record.size - sizeof(record);
+        if (msgLength < sizeof(InputMessage::Header) || msgLength > sizeof(InputMessage)) {
+            return BAD_VALUE;
+        }
+        memcpy(msg, ring.data + offset + sizeof(record), msgLength);
+        ring.tail.store(tail + record.size, std::memory_order_release);
+
+        if (msg->header.type == InputMessage::TYPE_MOTION
+                && (msg->body.motion.pointerCount < 1
+                        || msg->body.motion.pointerCount > MAX_POINTERS)) {
+            return BAD_VALUE;
+        }
+        size_t actualLength = msg->size();
+        if (ringRecordSize(actualLength) != record.size || !msg->isValid(actualLength)) {
+            return BAD_VALUE;
+        }
+        return OK;
+    }
+}
+
+
 // --- InputChannel ---
 
 InputChannel::InputChannel(const String8& name, int fd) :
-        mName(name), mFd(fd) {
+        mName(name), mFd(fd), mRingFd(-1), mRingServer(false), mRing(NULL) {
 #if DEBUG_CHANNEL_LIFECYCLE
     ALOGD("Input channel constructed: name='%s', fd=%d",
             mName.string(), fd);
@@ -112,24 +253,40 @@ InputChannel::InputChannel(const String8& name, int fd) :
             "non-blocking.  errno=%d", mName.string(), errno);
 }
 
+InputChannel::InputChannel(const String8& name, int fd, int ringFd, bool isRingServer) :
+        InputChannel(name, fd) {
+#if DEBUG_CHANNEL_LIFECYCLE
+    ALOGD("Input channel uses shared ring: name='%s', ringFd=%d, server=%d",
+            mName.string(), ringFd, isRingServer);
+#endif
+
+    mRingFd = ringFd;
+    mRingServer = isRingServer;
+    void* ring = mmap(NULL, sizeof(SharedRing), PROT_READ | PROT_WRITE, MAP_SHARED,
+            mRingFd, 0);
+    LOG_ALWAYS_FATAL_IF(ring == MAP_FAILED, "channel '%s' ~ Could not map shared ring.  "
+            "errno=%d", mName.string(), errno);
+    mRing = static_cast<SharedRing*>(ring);
+}
+
 InputChannel::~InputChannel() {
 #if DEBUG_CHANNEL_LIFECYCLE
     ALOGD("Input channel destroyed: name='%s', fd=%d",
             mName.string(), mFd);
 #endif
 
+    if (mRing) {
+        munmap(mRing, sizeof(SharedRing));
+        ::close(mRingFd);
+    }
     ::close(mFd);
 }
 
-status_t InputChannel::openInputChannelPair(const String8& name,
-        sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel) {
-    int sockets[2];
+status_t InputChannel::openSocketPair(const String8& name, int sockets[2]) {
     if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sockets)) {
         status_t result = -errno;
         ALOGE("channel '%s' ~ Could not create socket pair.  errno=%d",
                 name.string(), errno);
-        outServerChannel.clear();
-        outClientChannel.clear();
         return result;
     }
 
@@ -138,18 +295,61 @@ status_t InputChannel::openInputChannelPair(const String8& name,
     setsockopt(sockets[0], SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
     setsockopt(sockets[1], SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
     setsockopt(sockets[1], SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    return OK;
+}
+
+status_t InputChannel::openInputChannelPair(const String8& name,
+        sp<InputChannel>& outServerChannel, sp<InputChannel>& outClientChannel,
+        bool useSharedRing) {
+    int sockets[2];
+    status_t result = openSocketPair(name, sockets);
+    if (result) {
+        outServerChannel.clear();
+        outClientChannel.clear();
+        return result;
+    }
 
     String8 serverChannelName = name;
     serverChannelName.append(" (server)");
-    outServerChannel = new InputChannel(serverChannelName, sockets[0]);
-
     String8 clientChannelName = name;
     clientChannelName.append(" (client)");
-    outClientChannel = new InputChannel(clientChannelName, sockets[1]);
+
+    if (!useSharedRing) {
+        outServerChannel = new InputChannel(serverChannelName, sockets[0]);
+        outClientChannel = new InputChannel(clientChannelName, sockets[1]);
+        return OK;
+    }
+
+    // ashmem regions are zero-filled, which makes two empty rings.
+    int serverRingFd = ashmem_create_region(name.string(), sizeof(SharedRing));
+    int clientRingFd = serverRingFd >= 0 ? ::dup(serverRingFd) : -1;
+    if (clientRingFd < 0) {
+        result = -errno;
+        ALOGE("channel '%s' ~ Could not create shared ring.  errno=%d",
+                name.string(), errno);
+        if (serverRingFd >= 0) {
+            ::close(serverRingFd);
+        }
+        ::close(sockets[0]);
+        ::close(sockets[1]);
+        outServerChannel.clear();
+        outClientChannel.clear();
+        return result;
+    }
+
+    outServerChannel = new InputChannel(serverChannelName, sockets[0], serverRingFd, true);
+    // Neither side has looked at its ring yet, so both wait for the first wakeup.
+    outServerChannel->mRing->serverToClient.consumerIdle.store(1);
+    outServerChannel->mRing->clientToServer.consumerIdle.store(1);
+    outClientChannel = new InputChannel(clientChannelName, sockets[1], clientRingFd, false);
     return OK;
 }
 
 status_t InputChannel::sendMessage(const InputMessage* msg) {
+    if (mRing) {
+        return sendRingMessage(msg);
+    }
+
     size_t msgLength = msg->size();
     ssize_t nWrite;
     do {
@@ -186,6 +386,10 @@ status_t InputChannel::sendMessage(const InputMessage* msg) {
 }
 
 status_t InputChannel::receiveMessage(InputMessage* msg) {
+    if (mRing) {
+        return receiveRingMessage(msg);
+    }
+
     ssize_t nRead;
     do {
         nRead = ::recv(mFd, msg, sizeof(InputMessage), MSG_DONTWAIT);
@@ -227,14 +431,177 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
 
 sp<InputChannel> InputChannel::dup() const {
     int fd = ::dup(getFd());
-    return fd >= 0 ? new InputChannel(getName(), fd) : NULL;
+    if (fd < 0) {
+        return NULL;
+    }
+    if (!mRing) {
+        return new InputChannel(getName(), fd);
+    }
+    int ringFd = ::dup(mRingFd);
+    if (ringFd < 0) {
+        ::close(fd);
+        return NULL;
+    }
+    return new InputChannel(getName(), fd, ringFd, mRingServer);
+}
+
+status_t InputChannel::writeToParcel(Parcel* parcel) const {
+    status_t result = parcel->writeString8(mName);
+    if (!result) {
+        result = parcel->writeDupFileDescriptor(mFd);
+    }
+    if (!result) {
+        result = parcel->writeInt32(mRing ? 1 : 0);
+    }
+    if (!result && mRing) {
+        result = parcel->writeDupFileDescriptor(mRingFd);
+        if (!result) {
+            result = parcel->writeInt32(mRingServer ? 1 : 0);
+        }
+    }
+    return result;
+}
+
+sp<InputChannel> InputChannel::readFromParcel(const Parcel* parcel) {
+    String8 name = parcel->readString8();
+    int parcelFd = parcel->readFileDescriptor();
+    if (parcelFd < 0) {
+        ALOGE("Failed to read input channel '%s' from parcel: missing fd.", name.string());
+        return NULL;
+    }
+    int32_t hasRing = parcel->readInt32();
+    int parcelRingFd = -1;
+    int32_t ringServer = 0;
+    if (hasRing) {
+        parcelRingFd = parcel->readFileDescriptor();
+        ringServer = parcel->readInt32();
+        if (parcelRingFd < 0) {
+            ALOGE("Failed to read input channel '%s' from parcel: missing ring fd.",
+                    name.string());
+            return NULL;
+        }
+    }
+
+    // The parcel owns the fds it read, so the channel takes duplicates.
+    int fd = ::dup(parcelFd);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (!hasRing) {
+        return new InputChannel(name, fd);
+    }
+    int ringFd = ::dup(parcelRingFd);
+    if (ringFd < 0) {
+        ::close(fd);
+        return NULL;
+    }
+    return new InputChannel(name, fd, ringFd, ringServer != 0);
+}
+
+status_t InputChannel::sendRingMessage(const InputMessage* msg) {
+    MessageRing& ring = mRingServer ? mRing->serverToClient : mRing->clientToServer;
+    status_t result = writeRingMessage(ring, msg);
+    if (result) {
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ error writing message of type %d to ring, status=%d",
+                mName.string(), msg->header.type, result);
+#endif
+        return result;
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ wrote message of type %d to ring", mName.string(), msg->header.type);
+#endif
+
+    // Only wake the consumer up if it ran out of messages, it will read this one along
+    // with the others otherwise.
+    if (ring.consumerIdle.exchange(0, std::memory_order_seq_cst)) {
+        return sendWakeup();
+    }
+    return OK;
+}
+
+status_t InputChannel::receiveRingMessage(InputMessage* msg) {
+    MessageRing& ring = mRingServer ? mRing->clientToServer : mRing->serverToClient;
+    status_t result = readRingMessage(ring, msg);
+    if (result == WOULD_BLOCK) {
+        // Ask for a wakeup before consuming the pending ones, then look at the ring
+        // again in case a message was written before the producer saw the request.
+        ring.consumerIdle.store(1, std::memory_order_seq_cst);
+        result = drainWakeups();
+        if (result) {
+            return result;
+        }
+        result = readRingMessage(ring, msg);
+        if (result == OK) {
+            // More messages may follow, the caller will ask again when it runs out.
+            ring.consumerIdle.store(0, std::memory_order_relaxed);
+        }
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    if (result == OK) {
+        ALOGD("channel '%s' ~ read message of type %d from ring", mName.string(),
+                msg->header.type);
+    } else {
+        ALOGD("channel '%s' ~ read message from ring failed, status=%d", mName.string(),
+                result);
+    }
+#endif
+    return result;
+}
+
+status_t InputChannel::sendWakeup() {
+    static const uint8_t wakeup = 0;
+    ssize_t nWrite;
+    do {
+        nWrite = ::send(mFd, &wakeup, sizeof(wakeup), MSG_DONTWAIT | MSG_NOSIGNAL);
+    } while (nWrite == -1 && errno == EINTR);
+
+    if (nWrite < 0) {
+        int error = errno;
+        if (error == EAGAIN || error == EWOULDBLOCK) {
+            // Plenty of wakeups are already pending.
+            return OK;
+        }
+        if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED || error == ECONNRESET) {
+            return DEAD_OBJECT;
+        }
+        return -error;
+    }
+    return OK;
+}
+
+status_t InputChannel::drainWakeups() {
+    for (;;) {
+        uint8_t buffer[16];
+        ssize_t nRead;
+        do {
+            nRead = ::recv(mFd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        } while (nRead == -1 && errno == EINTR);
+
+        if (nRead < 0) {
+            int error = errno;
+            if (error == EAGAIN || error == EWOULDBLOCK) {
+                return OK;
+            }
+            if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED) {
+                return DEAD_OBJECT;
+            }
+            return -error;
+        }
+        if (nRead == 0) { // check for EOF
+            return DEAD_OBJECT;
+        }
+    }
 }
 
 
 // --- InputPublisher ---
 
 InputPublisher::InputPublisher(const sp<InputChannel>& channel) :
-        mChannel(channel) {
+        mChannel(channel), mFinishedBatchIndex(0) {
+    mFinishedBatch.body.finishedBatch.count = 0;
 }
 
 InputPublisher::~InputPublisher() {
@@ -354,6 +721,15 @@ status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandle
             mChannel->getName().string());
 #endif
 
+    // Return the rest of the last batch before reading the next message.
+    if (mFinishedBatchIndex < mFinishedBatch.body.finishedBatch.count) {
+        const InputMessage::Body::FinishedBatch::Entry& entry =
+                mFinishedBatch.body.finishedBatch.entries[mFinishedBatchIndex++];
+        *outSeq = entry.seq;
+        *outHandled = entry.handled != 0;
+        return OK;
+    }
+
     InputMessage msg;
     status_t result = mChannel->receiveMessage(&msg);
     if (result) {
@@ -361,24 +737,62 @@ status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandle
         *outHandled = false;
         return result;
     }
-    if (msg.header.type != InputMessage::TYPE_FINISHED) {
+    switch (msg.header.type) {
+    case InputMessage::TYPE_FINISHED:
+        *outSeq = msg.body.finished.seq;
+        *outHandled = msg.body.finished.handled;
+        return OK;
+
+    case InputMessage::TYPE_FINISHED_BATCH:
+        mFinishedBatch = msg;
+        mFinishedBatchIndex = 1;
+        *outSeq = msg.body.finishedBatch.entries[0].seq;
+        *outHandled = msg.body.finishedBatch.entries[0].handled != 0;
+        return OK;
+
+    default:
         ALOGE("channel '%s' publisher ~ Received unexpected message of type %d from consumer",
                 mChannel->getName().string(), msg.header.type);
         return UNKNOWN_ERROR;
     }
-    *outSeq = msg.body.finished.seq;
-    *outHandled = msg.body.finished.handled;
-    return OK;
 }
 
 // --- InputConsumer ---
 
-InputConsumer::InputConsumer(const sp<InputChannel>& channel) :
+const char* InputConsumer::DEFAULT_RESAMPLING_STRATEGY = "linear";
+
+InputConsumer::InputConsumer(const sp<InputChannel>& channel, const char* resamplingStrategy) :
         mResampleTouch(isTouchResamplingEnabled()),
+        mResamplingStrategy(createResamplingStrategy(resamplingStrategy)),
         mChannel(channel), mMsgDeferred(false) {
 }
 
 InputConsumer::~InputConsumer() {
+    delete mResamplingStrategy;
+}
+
+TouchResamplingStrategy* InputConsumer::createResamplingStrategy(const char* strategy) {
+    char value[PROPERTY_VALUE_MAX];
+
+    // Allow the default strategy to be overridden using a system property for debugging.
+    if (!strategy) {
+        int length = property_get("debug.input.resampling_strategy", value, NULL);
+        if (length > 0) {
+            strategy = value;
+        } else {
+            strategy = DEFAULT_RESAMPLING_STRATEGY;
+        }
+    }
+
+    TouchResamplingStrategy* resamplingStrategy = TouchResamplingStrategy::create(strategy);
+    if (!resamplingStrategy) {
+        ALOGD("Unrecognized touch resampling strategy name '%s'.", strategy);
+        resamplingStrategy = TouchResamplingStrategy::create(DEFAULT_RESAMPLING_STRATEGY);
+        LOG_ALWAYS_FATAL_IF(!resamplingStrategy,
+                "Could not create the default touch resampling strategy '%s'!",
+                DEFAULT_RESAMPLING_STRATEGY);
+    }
+    return resamplingStrategy;
 }
 
 bool InputConsumer::isTouchResamplingEnabled() {
@@ -528,7 +942,7 @@ status_t InputConsumer::consumeBatch(InputEventFactoryInterface* factory,
 
         nsecs_t sampleTime = frameTime;
         if (mResampleTouch) {
-            sampleTime -= RESAMPLE_LATENCY;
+            sampleTime -= mResamplingStrategy->getLatency();
         }
         ssize_t split = findSampleNoLaterThan(batch, sampleTime);
         if (split < 0) {
@@ -624,6 +1038,7 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         if (index >= 0) {
             TouchState& touchState = mTouchStates.editItemAt(index);
             touchState.lastResample.idBits.clearBit(msg->body.motion.getActionId());
+            touchState.clearHistory(msg->body.motion.getActionId());
             rewriteMessage(touchState, msg);
         }
         break;
@@ -718,9 +1133,9 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
     }
 
     // Find the data to use for resampling.
-    const History* other;
+    const History* other = NULL;
     History future;
-    float alpha;
+    float alpha = 0;
     if (next) {
         // Interpolate between current sample and future sample.
         // So current->eventTime <= sampleTime <= future.eventTime.
@@ -735,10 +1150,10 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
         }
         alpha = float(sampleTime - current->eventTime) / delta;
     } else if (touchState.historySize >= 2) {
-        // Extrapolate future sample using current sample and past sample.
-        // So other->eventTime <= current->eventTime <= sampleTime.
-        other = touchState.getHistory(1);
-        nsecs_t delta = current->eventTime - other->eventTime;
+        // Let the strategy predict the future sample from the current and past samples.
+        // So previous->eventTime <= current->eventTime <= sampleTime.
+        const History* previous = touchState.getHistory(1);
+        nsecs_t delta = current->eventTime - previous->eventTime;
         if (delta < RESAMPLE_MIN_DELTA) {
 #if DEBUG_RESAMPLING
             ALOGD("Not resampled, delta time is too small: %lld ns.", delta);
@@ -750,7 +1165,7 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
 #endif
             return;
         }
-        nsecs_t maxPredict = current->eventTime + min(delta / 2, RESAMPLE_MAX_PREDICTION);
+        nsecs_t maxPredict = current->eventTime + mResamplingStrategy->getMaxPrediction(delta);
         if (sampleTime > maxPredict) {
 #if DEBUG_RESAMPLING
             ALOGD("Sample time is too far in the future, adjusting prediction "
@@ -759,7 +1174,6 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
 #endif
             sampleTime = maxPredict;
         }
-        alpha = float(current->eventTime - sampleTime) / delta;
     } else {
 #if DEBUG_RESAMPLING
         ALOGD("Not resampled, insufficient data.");
@@ -776,7 +1190,19 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
         touchState.lastResample.idBits.markBit(id);
         PointerCoords& resampledCoords = touchState.lastResample.pointers[i];
         const PointerCoords& currentCoords = current->getPointerById(id);
-        if (other->idBits.hasBit(id)
+        if (!other && shouldResampleTool(event->getToolType(i))) {
+            resampledCoords.copyFrom(currentCoords);
+            float x, y;
+            if (predictPointer(touchState, id, sampleTime, &x, &y)) {
+                resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_X, x);
+                resampledCoords.setAxisValue(AMOTION_EVENT_AXIS_Y, y);
+            }
+#if DEBUG_RESAMPLING
+            ALOGD("[%d] - out (%0.3f, %0.3f), cur (%0.3f, %0.3f), predicted",
+                    id, resampledCoords.getX(), resampledCoords.getY(),
+                    currentCoords.getX(), currentCoords.getY());
+#endif
+        } else if (other && other->idBits.hasBit(id)
                 && shouldResampleTool(event->getToolType(i))) {
             const PointerCoords& otherCoords = other->getPointerById(id);
             resampledCoords.copyFrom(currentCoords);
@@ -805,6 +1231,27 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
     event->addSample(sampleTime, touchState.lastResample.pointers);
 }
 
+bool InputConsumer::predictPointer(const TouchState& touchState, uint32_t id,
+        nsecs_t sampleTime, float* outX, float* outY) const {
+    // Collect the consecutive past samples of the pointer, stopping at a gap.
+    TouchResamplingStrategy::Sample samples[TouchResamplingStrategy::HISTORY_SIZE];
+    size_t sampleCount = 0;
+    while (sampleCount < touchState.historySize) {
+        const History* history = touchState.getHistory(sampleCount);
+        if (!history->idBits.hasBit(id) || (sampleCount
+                && samples[sampleCount - 1].eventTime - history->eventTime > RESAMPLE_MAX_DELTA)) {
+            break;
+        }
+        const PointerCoords& coords = history->getPointerById(id);
+        samples[sampleCount].eventTime = history->eventTime;
+        samples[sampleCount].x = coords.getX();
+        samples[sampleCount].y = coords.getY();
+        sampleCount += 1;
+    }
+    return sampleCount >= 2
+            && mResamplingStrategy->predict(samples, sampleCount, sampleTime, outX, outY);
+}
+
 bool InputConsumer::shouldResampleTool(int32_t toolType) {
     return toolType == AMOTION_EVENT_TOOL_TYPE_FINGER
             || toolType == AMOTION_EVENT_TOOL_TYPE_UNKNOWN;
@@ -821,43 +1268,57 @@ status_t InputConsumer::sendFinishedSignal(uint32_t seq, bool handled) {
         return BAD_VALUE;
     }
 
-    // Send finished signals for the batch sequence chain first.
+    // Collect the batch sequence chain, whose signals are sent before the one of
+    // the last message in the batch.
     size_t seqChainCount = mSeqChains.size();
-    if (seqChainCount) {
-        uint32_t currentSeq = seq;
-        uint32_t chainSeqs[seqChainCount];
-        size_t chainIndex = 0;
-        for (size_t i = seqChainCount; i > 0; ) {
-             i--;
-             const SeqChain& seqChain = mSeqChains.itemAt(i);
-             if (seqChain.seq == currentSeq) {
-                 currentSeq = seqChain.chain;
-                 chainSeqs[chainIndex++] = currentSeq;
-                 mSeqChains.removeAt(i);
-             }
-        }
-        status_t status = OK;
-        while (!status && chainIndex > 0) {
-            chainIndex--;
-            status = sendUnchainedFinishedSignal(chainSeqs[chainIndex], handled);
+    uint32_t seqs[seqChainCount + 1];
+    size_t seqCount = 0;
+    uint32_t currentSeq = seq;
+    for (size_t i = seqChainCount; i > 0; ) {
+        i--;
+        const SeqChain& seqChain = mSeqChains.itemAt(i);
+        if (seqChain.seq == currentSeq) {
+            currentSeq = seqChain.chain;
+            seqs[seqCount++] = currentSeq;
+            mSeqChains.removeAt(i);
+        }
+    }
+    // seqs holds the chain newest first, send it oldest first and seq last.
+    for (size_t i = 0; i < seqCount / 2; i++) {
+        uint32_t tmp = seqs[i];
+        seqs[i] = seqs[seqCount - 1 - i];
+        seqs[seqCount - 1 - i] = tmp;
+    }
+    seqs[seqCount++] = seq;
+
+    if (seqCount == 1) {
+        return sendUnchainedFinishedSignal(seq, handled);
+    }
+
+    size_t sentCount = 0;
+    status_t status = OK;
+    while (sentCount < seqCount) {
+        size_t count = seqCount - sentCount;
+        if (count > InputMessage::MAX_FINISHED_BATCH) {
+            count = InputMessage::MAX_FINISHED_BATCH;
         }
+        status = sendFinishedSignalBatch(seqs + sentCount, count, handled);
         if (status) {
-            // An error occurred so at least one signal was not sent, reconstruct the chain.
-            do {
-                SeqChain seqChain;
-                seqChain.seq = chainIndex != 0 ? chainSeqs[chainIndex - 1] : seq;
-                seqChain.chain = chainSeqs[chainIndex];
-                mSeqChains.push(seqChain);
-                if (chainIndex != 0) {
-                    chainIndex--;
-                }
-            } while (chainIndex > 0);
-            return status;
+            break;
         }
+        sentCount += count;
     }
-
-    // Send finished signal for the last message in the batch.
-    return sendUnchainedFinishedSignal(seq, handled);
+    if (status) {
+        // An error occurred so at least one signal was not sent, reconstruct the chain.
+        // Each seq is chained to the one sent before it.
+        for (size_t i = sentCount; i + 1 < seqCount; i++) {
+            SeqChain seqChain;
+            seqChain.seq = seqs[i + 1];
+            seqChain.chain = seqs[i];
+            mSeqChains.push(seqChain);
+        }
+    }
+    return status;
 }
 
 status_t InputConsumer::sendUnchainedFinishedSignal(uint32_t seq, bool handled) {
@@ -868,6 +1329,23 @@ status_t InputConsumer::sendUnchainedFinishedSignal(uint32_t seq, bool handled)
     return mChannel->sendMessage(&msg);
 }
 
+status_t InputConsumer::sendFinishedSignalBatch(const uint32_t* seqs, size_t count,
+        bool handled) {
+    if (count == 1) {
+        return sendUnchainedFinishedSignal(seqs[0], handled);
+    }
+
+    InputMessage msg;
+    msg.header.type = InputMessage::TYPE_FINISHED_BATCH;
+    msg.body.finishedBatch.count = count;
+    msg.body.finishedBatch.padding = 0;
+    for (size_t i = 0; i < count; i++) {
+        msg.body.finishedBatch.entries[i].seq = seqs[i];
+        msg.body.finishedBatch.entries[i].handled = handled ? 1 : 0;
+    }
+    return mChannel->sendMessage(&msg);
+}
+
 bool InputConsumer::hasDeferredEvent() const {
     return mMsgDeferred;
 }
@@ -27,6 +27,7 @@
 #include <input/InputEventLabels.h>
 #include <input/Keyboard.h>
 #include <input/KeyCharacterMap.h>
+#include <input/KeyMapCache.h>
 
 #include <utils/Log.h>
 #include <utils/Errors.h>
@@ -72,6 +73,49 @@ static const Modifier modifiers[] = {
         { "scrolllock", AMETA_SCROLL_LOCK_ON },
 };
 
+// Sections of a compiled key character map.
+enum {
+    SECTION_TYPE = 0,
+    SECTION_KEYS = 1,
+    SECTION_BEHAVIORS = 2,
+    SECTION_KEYS_BY_SCAN_CODE = 3,
+    SECTION_KEYS_BY_USAGE_CODE = 4,
+
+    SECTION_COUNT
+};
+
+// A scan code or usage code mapping in a compiled key character map.
+struct CompiledKeyMapping {
+    int32_t code;
+    int32_t keyCode;
+};
+
+static void flattenKeyMappings(const KeyedVector<int32_t, int32_t>& map,
+        Vector<CompiledKeyMapping>& outMappings) {
+    outMappings.setCapacity(map.size());
+    for (size_t i = 0; i < map.size(); i++) {
+        CompiledKeyMapping mapping;
+        mapping.code = map.keyAt(i);
+        mapping.keyCode = map.valueAt(i);
+        outMappings.add(mapping);
+    }
+}
+
+static bool unflattenKeyMappings(const KeyMapCache* cache, uint32_t section,
+        KeyedVector<int32_t, int32_t>& outMap) {
+    uint32_t count;
+    const CompiledKeyMapping* mappings = static_cast<const CompiledKeyMapping*>(
+            cache->getSection(section, sizeof(CompiledKeyMapping), &count));
+    if (!mappings) {
+        return false;
+    }
+    outMap.setCapacity(count);
+    for (uint32_t i = 0; i < count; i++) {
+        outMap.add(mappings[i].code, mappings[i].keyCode);
+    }
+    return true;
+}
+
 #if DEBUG_MAPPING
 static String8 toString(const char16_t* chars, size_t numChars) {
     String8 result;
@@ -91,32 +135,32 @@ KeyCharacterMap::KeyCharacterMap() :
     mType(KEYBOARD_TYPE_UNKNOWN) {
 }
 
-KeyCharacterMap::KeyCharacterMap(const KeyCharacterMap& other) :
-    RefBase(), mType(other.mType), mKeysByScanCode(other.mKeysByScanCode),
-    mKeysByUsageCode(other.mKeysByUsageCode) {
-    for (size_t i = 0; i < other.mKeys.size(); i++) {
-        mKeys.add(other.mKeys.keyAt(i), new Key(*other.mKeys.valueAt(i)));
-    }
-}
-
 KeyCharacterMap::~KeyCharacterMap() {
-    for (size_t i = 0; i < mKeys.size(); i++) {
-        Key* key = mKeys.editValueAt(i);
-        delete key;
-    }
 }
 
 status_t KeyCharacterMap::load(const String8& filename,
         Format format, sp<KeyCharacterMap>* outMap) {
     outMap->clear();
 
+    if (!loadCompiled(filename, format, outMap)) {
+        return OK;
+    }
+
+    String8 contents;
+    KeyMapCache::Source source;
     Tokenizer* tokenizer;
-    status_t status = Tokenizer::open(filename, &tokenizer);
+    status_t status = KeyMapCache::readSource(filename, &contents, &source);
+    if (!status) {
+        status = Tokenizer::fromContents(filename, contents.string(), &tokenizer);
+    }
     if (status) {
         ALOGE("Error %d opening key character map file %s.", status, filename.string());
     } else {
         status = load(tokenizer, format, outMap);
         delete tokenizer;
+        if (!status) {
+            (*outMap)->writeCompiled(filename, source);
+        }
     }
     return status;
 }
@@ -156,12 +200,118 @@ status_t KeyCharacterMap::load(Tokenizer* tokenizer,
                 elapsedTime / 1000000.0);
 #endif
         if (!status) {
+            map->buildCharacterIndex();
             *outMap = map;
         }
     }
     return status;
 }
 
+status_t KeyCharacterMap::loadCompiled(const String8& filename, Format format,
+        sp<KeyCharacterMap>* outMap) {
+    KeyMapCache* cache = KeyMapCache::open(filename, KeyMapCache::TYPE_KEY_CHARACTER_MAP);
+    if (!cache) {
+        return NAME_NOT_FOUND;
+    }
+
+#if DEBUG_PARSER_PERFORMANCE
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+#endif
+    sp<KeyCharacterMap> map = new KeyCharacterMap();
+    uint32_t typeCount, keyCount, behaviorCount;
+    const int32_t* type = static_cast<const int32_t*>(
+            cache->getSection(SECTION_TYPE, sizeof(int32_t), &typeCount));
+    const Key* keys = static_cast<const Key*>(
+            cache->getSection(SECTION_KEYS, sizeof(Key), &keyCount));
+    const Behavior* behaviors = static_cast<const Behavior*>(
+            cache->getSection(SECTION_BEHAVIORS, sizeof(Behavior), &behaviorCount));
+    bool valid = cache->getSectionCount() == SECTION_COUNT
+            && type && typeCount == 1 && isTypeAllowed(*type, format)
+            && keys && keyCount <= MAX_KEYS && behaviors
+            && unflattenKeyMappings(cache, SECTION_KEYS_BY_SCAN_CODE, map->mKeysByScanCode)
+            && unflattenKeyMappings(cache, SECTION_KEYS_BY_USAGE_CODE, map->mKeysByUsageCode);
+    for (uint32_t i = 0; valid && i < keyCount; i++) {
+        // Lookups rely on the keys being sorted and the behaviors being in range.
+        valid = (i == 0 || keys[i - 1].keyCode < keys[i].keyCode)
+                && keys[i].firstBehavior <= behaviorCount
+                && keys[i].behaviorCount <= behaviorCount - keys[i].firstBehavior;
+    }
+    if (valid) {
+        map->mType = *type;
+        map->mKeys.appendArray(keys, keyCount);
+        map->mBehaviors.appendArray(behaviors, behaviorCount);
+        map->buildCharacterIndex();
+        *outMap = map;
+    } else {
+        ALOGW("Ignoring invalid compiled key character map for %s.", filename.string());
+    }
+    delete cache;
+#if DEBUG_PARSER_PERFORMANCE
+    nsecs_t elapsedTime = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+    ALOGD("Loaded compiled key character map '%s' in %0.3fms.",
+            filename.string(), elapsedTime / 1000000.0);
+#endif
+    return valid ? OK : BAD_VALUE;
+}
+
+void KeyCharacterMap::writeCompiled(const String8& filename,
+        const KeyMapCache::Source& source) const {
+    if (KeyMapCache::getDirectory().isEmpty()) {
+        return;
+    }
+
+    Vector<CompiledKeyMapping> keysByScanCode;
+    Vector<CompiledKeyMapping> keysByUsageCode;
+    flattenKeyMappings(mKeysByScanCode, keysByScanCode);
+    flattenKeyMappings(mKeysByUsageCode, keysByUsageCode);
+
+    // Behaviors end in padding, copy them into zeroed records so that no uninitialized memory
+    // goes into the file.
+    Behavior* behaviors = static_cast<Behavior*>(calloc(mBehaviors.size() + 1, sizeof(Behavior)));
+    if (!behaviors) {
+        return;
+    }
+    for (size_t i = 0; i < mBehaviors.size(); i++) {
+        const Behavior& behavior = mBehaviors[i];
+        behaviors[i].metaState = behavior.metaState;
+        behaviors[i].fallbackKeyCode = behavior.fallbackKeyCode;
+        behaviors[i].replacementKeyCode = behavior.replacementKeyCode;
+        behaviors[i].character = behavior.character;
+    }
+
+    int32_t type = mType;
+    KeyMapCache::Section sections[SECTION_COUNT];
+    sections[SECTION_TYPE].data = &type;
+    sections[SECTION_TYPE].recordSize = sizeof(int32_t);
+    sections[SECTION_TYPE].recordCount = 1;
+    sections[SECTION_KEYS].data = mKeys.array();
+    sections[SECTION_KEYS].recordSize = sizeof(Key);
+    sections[SECTION_KEYS].recordCount = mKeys.size();
+    sections[SECTION_BEHAVIORS].data = behaviors;
+    sections[SECTION_BEHAVIORS].recordSize = sizeof(Behavior);
+    sections[SECTION_BEHAVIORS].recordCount = mBehaviors.size();
+    sections[SECTION_KEYS_BY_SCAN_CODE].data = keysByScanCode.array();
+    sections[SECTION_KEYS_BY_SCAN_CODE].recordSize = sizeof(CompiledKeyMapping);
+    sections[SECTION_KEYS_BY_SCAN_CODE].recordCount = keysByScanCode.size();
+    sections[SECTION_KEYS_BY_USAGE_CODE].data = keysByUsageCode.array();
+    sections[SECTION_KEYS_BY_USAGE_CODE].recordSize = sizeof(CompiledKeyMapping);
+    sections[SECTION_KEYS_BY_USAGE_CODE].recordCount = keysByUsageCode.size();
+    KeyMapCache::write(filename, source, KeyMapCache::TYPE_KEY_CHARACTER_MAP,
+            sections, SECTION_COUNT);
+    free(behaviors);
+}
+
+bool KeyCharacterMap::isTypeAllowed(int32_t type, Format format) {
+    switch (format) {
+    case FORMAT_BASE:
+        return type != KEYBOARD_TYPE_UNKNOWN && type != KEYBOARD_TYPE_OVERLAY;
+    case FORMAT_OVERLAY:
+        return type == KEYBOARD_TYPE_OVERLAY;
+    default:
+        return type != KEYBOARD_TYPE_UNKNOWN;
+    }
+}
+
 sp<KeyCharacterMap> KeyCharacterMap::combine(const sp<KeyCharacterMap>& base,
         const sp<KeyCharacterMap>& overlay) {
     if (overlay == NULL) {
@@ -171,17 +321,38 @@ sp<KeyCharacterMap> KeyCharacterMap::combine(const sp<KeyCharacterMap>& base,
         return overlay;
     }
 
-    sp<KeyCharacterMap> map = new KeyCharacterMap(*base.get());
-    for (size_t i = 0; i < overlay->mKeys.size(); i++) {
-        int32_t keyCode = overlay->mKeys.keyAt(i);
-        Key* key = overlay->mKeys.valueAt(i);
-        ssize_t oldIndex = map->mKeys.indexOfKey(keyCode);
-        if (oldIndex >= 0) {
-            delete map->mKeys.valueAt(oldIndex);
-            map->mKeys.editValueAt(oldIndex) = new Key(*key);
+    // Merge the sorted keys, the overlay replaces the keys that both of them define.
+    sp<KeyCharacterMap> map = new KeyCharacterMap();
+    map->mType = base->mType;
+    map->mKeysByScanCode = base->mKeysByScanCode;
+    map->mKeysByUsageCode = base->mKeysByUsageCode;
+    map->mKeys.setCapacity(base->mKeys.size() + overlay->mKeys.size());
+    map->mBehaviors.setCapacity(base->mBehaviors.size() + overlay->mBehaviors.size());
+    size_t baseIndex = 0;
+    size_t overlayIndex = 0;
+    while (baseIndex < base->mKeys.size() || overlayIndex < overlay->mKeys.size()) {
+        const KeyCharacterMap* source;
+        const Key* key;
+        if (overlayIndex == overlay->mKeys.size()
+                || (baseIndex < base->mKeys.size()
+                        && base->mKeys[baseIndex].keyCode
+                                < overlay->mKeys[overlayIndex].keyCode)) {
+            source = base.get();
+            key = &base->mKeys[baseIndex++];
         } else {
-            map->mKeys.add(keyCode, new Key(*key));
+            if (baseIndex < base->mKeys.size()
+                    && base->mKeys[baseIndex].keyCode == overlay->mKeys[overlayIndex].keyCode) {
+                baseIndex += 1;
+            }
+            source = overlay.get();
+            key = &overlay->mKeys[overlayIndex++];
         }
+
+        Key newKey = *key;
+        newKey.firstBehavior = map->mBehaviors.size();
+        map->mBehaviors.appendArray(source->mBehaviors.array() + key->firstBehavior,
+                key->behaviorCount);
+        map->mKeys.add(newKey);
     }
 
     for (size_t i = 0; i < overlay->mKeysByScanCode.size(); i++) {
@@ -193,6 +364,7 @@ sp<KeyCharacterMap> KeyCharacterMap::combine(const sp<KeyCharacterMap>& base,
         map->mKeysByUsageCode.replaceValueFor(overlay->mKeysByUsageCode.keyAt(i),
                 overlay->mKeysByUsageCode.valueAt(i));
     }
+    map->buildCharacterIndex();
     return map;
 }
 
@@ -273,7 +445,9 @@ char16_t KeyCharacterMap::getMatch(int32_t keyCode, const char16_t* chars, size_
         // Try to find the most general behavior that maps to this character.
         // For example, the base key behavior will usually be last in the list.
         // However, if we find a perfect meta state match for one behavior then use that one.
-        for (const Behavior* behavior = key->firstBehavior; behavior; behavior = behavior->next) {
+        const Behavior* behaviors = mBehaviors.array() + key->firstBehavior;
+        for (size_t j = 0; j < key->behaviorCount; j++) {
+            const Behavior* behavior = &behaviors[j];
             if (behavior->character) {
                 for (size_t i = 0; i < numChars; i++) {
                     if (behavior->character == chars[i]) {
@@ -401,10 +575,86 @@ void KeyCharacterMap::tryRemapKey(int32_t keyCode, int32_t metaState,
 #endif
 }
 
+ssize_t KeyCharacterMap::indexOfKey(int32_t keyCode) const {
+    ssize_t low = 0;
+    ssize_t high = ssize_t(mKeys.size()) - 1;
+    while (low <= high) {
+        ssize_t mid = (low + high) / 2;
+        int32_t midKeyCode = mKeys[mid].keyCode;
+        if (midKeyCode < keyCode) {
+            low = mid + 1;
+        } else if (midKeyCode > keyCode) {
+            high = mid - 1;
+        } else {
+            return mid;
+        }
+    }
+    return NAME_NOT_FOUND;
+}
+
+ssize_t KeyCharacterMap::insertKey(int32_t keyCode) {
+    // Keys are mostly declared in key code order, so this usually appends.
+    size_t index = 0;
+    size_t high = mKeys.size();
+    while (index < high) {
+        size_t mid = (index + high) / 2;
+        if (mKeys[mid].keyCode < keyCode) {
+            index = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    Key key;
+    key.keyCode = keyCode;
+    key.label = 0;
+    key.number = 0;
+    key.firstBehavior = mBehaviors.size();
+    key.behaviorCount = 0;
+    return mKeys.insertAt(key, index);
+}
+
+void KeyCharacterMap::buildCharacterIndex() {
+    // A character is generated by the first key, in key code order, that has a behavior
+    // for it, using the meta state of its most general such behavior.
+    mKeysByCharacter.clear();
+    for (size_t i = 0; i < mKeys.size(); i++) {
+        const Key& key = mKeys[i];
+        for (uint32_t j = 0; j < key.behaviorCount; j++) {
+            const Behavior& behavior = mBehaviors[key.firstBehavior + j];
+            if (!behavior.character) {
+                continue;
+            }
+
+            size_t index = 0;
+            size_t high = mKeysByCharacter.size();
+            while (index < high) {
+                size_t mid = (index + high) / 2;
+                if (mKeysByCharacter[mid].character < behavior.character) {
+                    index = mid + 1;
+                } else {
+                    high = mid;
+                }
+            }
+            if (index < mKeysByCharacter.size()
+                    && mKeysByCharacter[index].character == behavior.character) {
+                if (mKeysByCharacter[index].keyCode == key.keyCode) {
+                    mKeysByCharacter.editItemAt(index).metaState = behavior.metaState;
+                }
+            } else {
+                CharacterKey characterKey;
+                characterKey.character = behavior.character;
+                characterKey.keyCode = key.keyCode;
+                characterKey.metaState = behavior.metaState;
+                mKeysByCharacter.insertAt(characterKey, index);
+            }
+        }
+    }
+}
+
 bool KeyCharacterMap::getKey(int32_t keyCode, const Key** outKey) const {
-    ssize_t index = mKeys.indexOfKey(keyCode);
+    ssize_t index = indexOfKey(keyCode);
     if (index >= 0) {
-        *outKey = mKeys.valueAt(index);
+        *outKey = &mKeys[index];
         return true;
     }
     return false;
@@ -414,14 +664,13 @@ bool KeyCharacterMap::getKeyBehavior(int32_t keyCode, int32_t metaState,
         const Key** outKey, const Behavior** outBehavior) const {
     const Key* key;
     if (getKey(keyCode, &key)) {
-        const Behavior* behavior = key->firstBehavior;
-        while (behavior) {
-            if (matchesMetaState(metaState, behavior->metaState)) {
+        const Behavior* behaviors = mBehaviors.array() + key->firstBehavior;
+        for (size_t i = 0; i < key->behaviorCount; i++) {
+            if (matchesMetaState(metaState, behaviors[i].metaState)) {
                 *outKey = key;
-                *outBehavior = behavior;
+                *outBehavior = &behaviors[i];
                 return true;
             }
-            behavior = behavior->next;
         }
     }
     return false;
@@ -463,20 +712,18 @@ bool KeyCharacterMap::findKey(char16_t ch, int32_t* outKeyCode, int32_t* outMeta
         return false;
     }
 
-    for (size_t i = 0; i < mKeys.size(); i++) {
-        const Key* key = mKeys.valueAt(i);
-
-        // Try to find the most general behavior that maps to this character.
-        // For example, the base key behavior will usually be last in the list.
-        const Behavior* found = NULL;
-        for (const Behavior* behavior = key->firstBehavior; behavior; behavior = behavior->next) {
-            if (behavior->character == ch) {
-                found = behavior;
-            }
-        }
-        if (found) {
-            *outKeyCode = mKeys.keyAt(i);
-            *outMetaState = found->metaState;
+    ssize_t low = 0;
+    ssize_t high = ssize_t(mKeysByCharacter.size()) - 1;
+    while (low <= high) {
+        ssize_t mid = (low + high) / 2;
+        const CharacterKey& characterKey = mKeysByCharacter[mid];
+        if (characterKey.character < ch) {
+            low = mid + 1;
+        } else if (characterKey.character > ch) {
+            high = mid - 1;
+        } else {
+            *outKeyCode = characterKey.keyCode;
+            *outMetaState = characterKey.metaState;
             return true;
         }
     }
@@ -620,38 +867,33 @@ sp<KeyCharacterMap> KeyCharacterMap::readFromParcel(Parcel* parcel) {
             return NULL;
         }
 
-        Key* key = new Key();
-        key->label = label;
-        key->number = number;
-        map->mKeys.add(keyCode, key);
+        if (map->indexOfKey(keyCode) >= 0) {
+            ALOGE("Duplicate key %d in KeyCharacterMap", keyCode);
+            return NULL;
+        }
+        Key& key = map->mKeys.editItemAt(map->insertKey(keyCode));
+        key.label = label;
+        key.number = number;
 
-        Behavior* lastBehavior = NULL;
         while (parcel->readInt32()) {
-            int32_t metaState = parcel->readInt32();
-            char16_t character = parcel->readInt32();
-            int32_t fallbackKeyCode = parcel->readInt32();
-            int32_t replacementKeyCode = parcel->readInt32();
+            Behavior behavior;
+            behavior.metaState = parcel->readInt32();
+            behavior.character = parcel->readInt32();
+            behavior.fallbackKeyCode = parcel->readInt32();
+            behavior.replacementKeyCode = parcel->readInt32();
             if (parcel->errorCheck()) {
                 return NULL;
             }
 
-            Behavior* behavior = new Behavior();
-            behavior->metaState = metaState;
-            behavior->character = character;
-            behavior->fallbackKeyCode = fallbackKeyCode;
-            behavior->replacementKeyCode = replacementKeyCode;
-            if (lastBehavior) {
-                lastBehavior->next = behavior;
-            } else {
-                key->firstBehavior = behavior;
-            }
-            lastBehavior = behavior;
+            map->mBehaviors.add(behavior);
+            key.behaviorCount += 1;
         }
 
         if (parcel->errorCheck()) {
             return NULL;
         }
     }
+    map->buildCharacterIndex();
     return map;
 }
 
@@ -661,18 +903,17 @@ void KeyCharacterMap::writeToParcel(Parcel* parcel) const {
     size_t numKeys = mKeys.size();
     parcel->writeInt32(numKeys);
     for (size_t i = 0; i < numKeys; i++) {
-        int32_t keyCode = mKeys.keyAt(i);
-        const Key* key = mKeys.valueAt(i);
-        parcel->writeInt32(keyCode);
-        parcel->writeInt32(key->label);
-        parcel->writeInt32(key->number);
-        for (const Behavior* behavior = key->firstBehavior; behavior != NULL;
-                behavior = behavior->next) {
+        const Key& key = mKeys[i];
+        parcel->writeInt32(key.keyCode);
+        parcel->writeInt32(key.label);
+        parcel->writeInt32(key.number);
+        for (uint32_t j = 0; j < key.behaviorCount; j++) {
+            const Behavior& behavior = mBehaviors[key.firstBehavior + j];
             parcel->writeInt32(1);
-            parcel->writeInt32(behavior->metaState);
-            parcel->writeInt32(behavior->character);
-            parcel->writeInt32(behavior->fallbackKeyCode);
-            parcel->writeInt32(behavior->replacementKeyCode);
+            parcel->writeInt32(behavior.metaState);
+            parcel->writeInt32(behavior.character);
+            parcel->writeInt32(behavior.fallbackKeyCode);
+            parcel->writeInt32(behavior.replacementKeyCode);
         }
         parcel->writeInt32(0);
     }
@@ -680,41 +921,6 @@ void KeyCharacterMap::writeToParcel(Parcel* parcel) const {
 #endif
 
 
-// --- KeyCharacterMap::Key ---
-
-KeyCharacterMap::Key::Key() :
-        label(0), number(0), firstBehavior(NULL) {
-}
-
-KeyCharacterMap::Key::Key(const Key& other) :
-        label(other.label), number(other.number),
-        firstBehavior(other.firstBehavior ? new Behavior(*other.firstBehavior) : NULL) {
-}
-
-KeyCharacterMap::Key::~Key() {
-    Behavior* behavior = firstBehavior;
-    while (behavior) {
-        Behavior* next = behavior->next;
-        delete behavior;
-        behavior = next;
-    }
-}
-
-
-// --- KeyCharacterMap::Behavior ---
-
-KeyCharacterMap::Behavior::Behavior() :
-        next(NULL), metaState(0), character(0), fallbackKeyCode(0), replacementKeyCode(0) {
-}
-
-KeyCharacterMap::Behavior::Behavior(const Behavior& other) :
-        next(other.next ? new Behavior(*other.next) : NULL),
-        metaState(other.metaState), character(other.character),
-        fallbackKeyCode(other.fallbackKeyCode),
-        replacementKeyCode(other.replacementKeyCode) {
-}
-
-
 // --- KeyCharacterMap::Parser ---
 
 KeyCharacterMap::Parser::Parser(KeyCharacterMap* map, Tokenizer* tokenizer, Format format) :
@@ -900,7 +1106,7 @@ status_t KeyCharacterMap::Parser::parseKey() {
                 keyCodeToken.string());
         return BAD_VALUE;
     }
-    if (mMap->mKeys.indexOfKey(keyCode) >= 0) {
+    if (mMap->indexOfKey(keyCode) >= 0) {
         ALOGE("%s: Duplicate entry for key code '%s'.", mTokenizer->getLocation().string(),
                 keyCodeToken.string());
         return BAD_VALUE;
@@ -918,13 +1124,13 @@ status_t KeyCharacterMap::Parser::parseKey() {
     ALOGD("Parsed beginning of key: keyCode=%d.", keyCode);
 #endif
     mKeyCode = keyCode;
-    mMap->mKeys.add(keyCode, new Key());
+    mMap->insertKey(keyCode);
     mState = STATE_KEY;
     return NO_ERROR;
 }
 
 status_t KeyCharacterMap::Parser::parseKeyProperty() {
-    Key* key = mMap->mKeys.valueFor(mKeyCode);
+    Key& key = mMap->mKeys.editItemAt(mMap->indexOfKey(mKeyCode));
     String8 token = mTokenizer->nextToken(WHITESPACE_OR_PROPERTY_DELIMITER);
     if (token == "}") {
         mState = STATE_TOP;
@@ -971,6 +1177,7 @@ status_t KeyCharacterMap::Parser::parseKeyProperty() {
     mTokenizer->skipDelimiters(WHITESPACE);
 
     Behavior behavior;
+    memset(&behavior, 0, sizeof(behavior));
     bool haveCharacter = false;
     bool haveFallback = false;
     bool haveReplacement = false;
@@ -1066,44 +1273,46 @@ status_t KeyCharacterMap::Parser::parseKeyProperty() {
         const Property& property = properties.itemAt(i);
         switch (property.property) {
         case PROPERTY_LABEL:
-            if (key->label) {
+            if (key.label) {
                 ALOGE("%s: Duplicate label for key.",
                         mTokenizer->getLocation().string());
                 return BAD_VALUE;
             }
-            key->label = behavior.character;
+            key.label = behavior.character;
 #if DEBUG_PARSER
-            ALOGD("Parsed key label: keyCode=%d, label=%d.", mKeyCode, key->label);
+            ALOGD("Parsed key label: keyCode=%d, label=%d.", mKeyCode, key.label);
 #endif
             break;
         case PROPERTY_NUMBER:
-            if (key->number) {
+            if (key.number) {
                 ALOGE("%s: Duplicate number for key.",
                         mTokenizer->getLocation().string());
                 return BAD_VALUE;
             }
-            key->number = behavior.character;
+            key.number = behavior.character;
 #if DEBUG_PARSER
-            ALOGD("Parsed key number: keyCode=%d, number=%d.", mKeyCode, key->number);
+            ALOGD("Parsed key number: keyCode=%d, number=%d.", mKeyCode, key.number);
 #endif
             break;
         case PROPERTY_META: {
-            for (Behavior* b = key->firstBehavior; b; b = b->next) {
-                if (b->metaState == property.metaState) {
+            for (uint32_t j = 0; j < key.behaviorCount; j++) {
+                if (mMap->mBehaviors[key.firstBehavior + j].metaState == property.metaState) {
                     ALOGE("%s: Duplicate key behavior for modifier.",
                             mTokenizer->getLocation().string());
                     return BAD_VALUE;
                 }
             }
-            Behavior* newBehavior = new Behavior(behavior);
-            newBehavior->metaState = property.metaState;
-            newBehavior->next = key->firstBehavior;
-            key->firstBehavior = newBehavior;
+            // The behaviors of the key being parsed are last in the list, later
+            // behaviors take precedence so insert them at the front.
+            Behavior newBehavior = behavior;
+            newBehavior.metaState = property.metaState;
+            mMap->mBehaviors.insertAt(newBehavior, key.firstBehavior);
+            key.behaviorCount += 1;
 #if DEBUG_PARSER
             ALOGD("Parsed key meta: keyCode=%d, meta=0x%x, char=%d, fallback=%d replace=%d.",
                     mKeyCode,
-                    newBehavior->metaState, newBehavior->character,
-                    newBehavior->fallbackKeyCode, newBehavior->replacementKeyCode);
+                    newBehavior.metaState, newBehavior.character,
+                    newBehavior.fallbackKeyCode, newBehavior.replacementKeyCode);
 #endif
             break;
         }
@@ -1112,13 +1321,13 @@ status_t KeyCharacterMap::Parser::parseKeyProperty() {
     return NO_ERROR;
 }
 
-status_t KeyCharacterMap::Parser::finishKey(Key* key) {
+status_t KeyCharacterMap::Parser::finishKey(Key& key) {
     // Fill in default number property.
-    if (!key->number) {
+    if (!key.number) {
         char16_t digit = 0;
         char16_t symbol = 0;
-        for (Behavior* b = key->firstBehavior; b; b = b->next) {
-            char16_t ch = b->character;
+        for (uint32_t i = 0; i < key.behaviorCount; i++) {
+            char16_t ch = mMap->mBehaviors[key.firstBehavior + i].character;
             if (ch) {
                 if (ch >= '0' && ch <= '9') {
                     digit = ch;
@@ -1129,7 +1338,7 @@ status_t KeyCharacterMap::Parser::finishKey(Key* key) {
                 }
             }
         }
-        key->number = digit ? digit : symbol;
+        key.number = digit ? digit : symbol;
     }
     return NO_ERROR;
 }
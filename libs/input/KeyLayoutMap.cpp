@@ -22,6 +22,7 @@
 #include <input/InputEventLabels.h>
 #include <input/Keyboard.h>
 #include <input/KeyLayoutMap.h>
+#include <input/KeyMapCache.h>
 #include <utils/Log.h>
 #include <utils/Errors.h>
 #include <utils/Tokenizer.h>
@@ -41,6 +42,37 @@ namespace android {
 
 static const char* WHITESPACE = " \t\r";
 
+// Sections of a compiled key layout map.
+enum {
+    SECTION_KEYS_BY_SCAN_CODE = 0,
+    SECTION_KEYS_BY_USAGE_CODE = 1,
+    SECTION_AXES = 2,
+    SECTION_LEDS_BY_SCAN_CODE = 3,
+    SECTION_LEDS_BY_USAGE_CODE = 4,
+
+    SECTION_COUNT
+};
+
+struct CompiledKey {
+    int32_t code;
+    int32_t keyCode;
+    uint32_t flags;
+};
+
+struct CompiledAxis {
+    int32_t scanCode;
+    int32_t mode;
+    int32_t axis;
+    int32_t highAxis;
+    int32_t splitValue;
+    int32_t flatOverride;
+};
+
+struct CompiledLed {
+    int32_t code;
+    int32_t ledCode;
+};
+
 // --- KeyLayoutMap ---
 
 KeyLayoutMap::KeyLayoutMap() {
@@ -52,8 +84,17 @@ KeyLayoutMap::~KeyLayoutMap() {
 status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
     outMap->clear();
 
+    if (!loadCompiled(filename, outMap)) {
+        return OK;
+    }
+
+    String8 contents;
+    KeyMapCache::Source source;
     Tokenizer* tokenizer;
-    status_t status = Tokenizer::open(filename, &tokenizer);
+    status_t status = KeyMapCache::readSource(filename, &contents, &source);
+    if (!status) {
+        status = Tokenizer::fromContents(filename, contents.string(), &tokenizer);
+    }
     if (status) {
         ALOGE("Error %d opening key layout map file %s.", status, filename.string());
     } else {
@@ -74,6 +115,7 @@ status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
                     elapsedTime / 1000000.0);
 #endif
             if (!status) {
+                map->writeCompiled(filename, source);
                 *outMap = map;
             }
         }
@@ -82,6 +124,128 @@ status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
     return status;
 }
 
+status_t KeyLayoutMap::loadCompiled(const String8& filename, sp<KeyLayoutMap>* outMap) {
+    KeyMapCache* cache = KeyMapCache::open(filename, KeyMapCache::TYPE_KEY_LAYOUT);
+    if (!cache) {
+        return NAME_NOT_FOUND;
+    }
+
+    uint32_t keyCounts[2], axisCount, ledCounts[2];
+    const CompiledKey* keys[2];
+    const CompiledLed* leds[2];
+    keys[0] = static_cast<const CompiledKey*>(cache->getSection(
+            SECTION_KEYS_BY_SCAN_CODE, sizeof(CompiledKey), &keyCounts[0]));
+    keys[1] = static_cast<const CompiledKey*>(cache->getSection(
+            SECTION_KEYS_BY_USAGE_CODE, sizeof(CompiledKey), &keyCounts[1]));
+    const CompiledAxis* axes = static_cast<const CompiledAxis*>(cache->getSection(
+            SECTION_AXES, sizeof(CompiledAxis), &axisCount));
+    leds[0] = static_cast<const CompiledLed*>(cache->getSection(
+            SECTION_LEDS_BY_SCAN_CODE, sizeof(CompiledLed), &ledCounts[0]));
+    leds[1] = static_cast<const CompiledLed*>(cache->getSection(
+            SECTION_LEDS_BY_USAGE_CODE, sizeof(CompiledLed), &ledCounts[1]));
+    if (cache->getSectionCount() != SECTION_COUNT
+            || !keys[0] || !keys[1] || !axes || !leds[0] || !leds[1]) {
+        ALOGW("Ignoring invalid compiled key layout map for %s.", filename.string());
+        delete cache;
+        return BAD_VALUE;
+    }
+
+    sp<KeyLayoutMap> map = new KeyLayoutMap();
+    for (int i = 0; i < 2; i++) {
+        KeyedVector<int32_t, Key>& keyMap = i ? map->mKeysByUsageCode : map->mKeysByScanCode;
+        keyMap.setCapacity(keyCounts[i]);
+        for (uint32_t j = 0; j < keyCounts[i]; j++) {
+            Key key;
+            key.keyCode = keys[i][j].keyCode;
+            key.flags = keys[i][j].flags;
+            keyMap.add(keys[i][j].code, key);
+        }
+
+        KeyedVector<int32_t, Led>& ledMap = i ? map->mLedsByUsageCode : map->mLedsByScanCode;
+        ledMap.setCapacity(ledCounts[i]);
+        for (uint32_t j = 0; j < ledCounts[i]; j++) {
+            Led led;
+            led.ledCode = leds[i][j].ledCode;
+            ledMap.add(leds[i][j].code, led);
+        }
+    }
+    map->mAxes.setCapacity(axisCount);
+    for (uint32_t i = 0; i < axisCount; i++) {
+        AxisInfo axisInfo;
+        axisInfo.mode = AxisInfo::Mode(axes[i].mode);
+        axisInfo.axis = axes[i].axis;
+        axisInfo.highAxis = axes[i].highAxis;
+        axisInfo.splitValue = axes[i].splitValue;
+        axisInfo.flatOverride = axes[i].flatOverride;
+        map->mAxes.add(axes[i].scanCode, axisInfo);
+    }
+    delete cache;
+
+    *outMap = map;
+    return OK;
+}
+
+void KeyLayoutMap::writeCompiled(const String8& filename,
+        const KeyMapCache::Source& source) const {
+    if (KeyMapCache::getDirectory().isEmpty()) {
+        return;
+    }
+
+    Vector<CompiledKey> keys[2];
+    Vector<CompiledLed> leds[2];
+    Vector<CompiledAxis> axes;
+    for (int i = 0; i < 2; i++) {
+        const KeyedVector<int32_t, Key>& keyMap = i ? mKeysByUsageCode : mKeysByScanCode;
+        keys[i].setCapacity(keyMap.size());
+        for (size_t j = 0; j < keyMap.size(); j++) {
+            CompiledKey key;
+            key.code = keyMap.keyAt(j);
+            key.keyCode = keyMap.valueAt(j).keyCode;
+            key.flags = keyMap.valueAt(j).flags;
+            keys[i].add(key);
+        }
+
+        const KeyedVector<int32_t, Led>& ledMap = i ? mLedsByUsageCode : mLedsByScanCode;
+        leds[i].setCapacity(ledMap.size());
+        for (size_t j = 0; j < ledMap.size(); j++) {
+            CompiledLed led;
+            led.code = ledMap.keyAt(j);
+            led.ledCode = ledMap.valueAt(j).ledCode;
+            leds[i].add(led);
+        }
+    }
+    axes.setCapacity(mAxes.size());
+    for (size_t i = 0; i < mAxes.size(); i++) {
+        const AxisInfo& axisInfo = mAxes.valueAt(i);
+        CompiledAxis axis;
+        axis.scanCode = mAxes.keyAt(i);
+        axis.mode = axisInfo.mode;
+        axis.axis = axisInfo.axis;
+        axis.highAxis = axisInfo.highAxis;
+        axis.splitValue = axisInfo.splitValue;
+        axis.flatOverride = axisInfo.flatOverride;
+        axes.add(axis);
+    }
+
+    KeyMapCache::Section sections[SECTION_COUNT];
+    sections[SECTION_KEYS_BY_SCAN_CODE].data = keys[0].array();
+    sections[SECTION_KEYS_BY_SCAN_CODE].recordSize = sizeof(CompiledKey);
+    sections[SECTION_KEYS_BY_SCAN_CODE].recordCount = keys[0].size();
+    sections[SECTION_KEYS_BY_USAGE_CODE].data = keys[1].array();
+    sections[SECTION_KEYS_BY_USAGE_CODE].recordSize = sizeof(CompiledKey);
+    sections[SECTION_KEYS_BY_USAGE_CODE].recordCount = keys[1].size();
+    sections[SECTION_AXES].data = axes.array();
+    sections[SECTION_AXES].recordSize = sizeof(CompiledAxis);
+    sections[SECTION_AXES].recordCount = axes.size();
+    sections[SECTION_LEDS_BY_SCAN_CODE].data = leds[0].array();
+    sections[SECTION_LEDS_BY_SCAN_CODE].recordSize = sizeof(CompiledLed);
+    sections[SECTION_LEDS_BY_SCAN_CODE].recordCount = leds[0].size();
+    sections[SECTION_LEDS_BY_USAGE_CODE].data = leds[1].array();
+    sections[SECTION_LEDS_BY_USAGE_CODE].recordSize = sizeof(CompiledLed);
+    sections[SECTION_LEDS_BY_USAGE_CODE].recordCount = leds[1].size();
+    KeyMapCache::write(filename, source, KeyMapCache::TYPE_KEY_LAYOUT, sections, SECTION_COUNT);
+}
+
 status_t KeyLayoutMap::mapKey(int32_t scanCode, int32_t usageCode,
         int32_t* outKeyCode, uint32_t* outFlags) const {
     const Key* key = getKey(scanCode, usageCode);
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "KeyMapCache"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <input/KeyMapCache.h>
+#include <utils/FileMap.h>
+#include <utils/Log.h>
+#include <utils/Mutex.h>
+
+// Enables debug output for the cache.
+#define DEBUG_CACHE 0
+
+
+namespace android {
+
+// 'KMAP' in little endian.
+static const uint32_t MAGIC = 0x50414d4b;
+
+// Sections and the source path start on this alignment.
+static const size_t ALIGNMENT = 8;
+
+static Mutex gDirectoryLock;
+static String8 gDirectory;
+
+static size_t align(size_t size) {
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+static int64_t getModifiedTime(const struct stat& st) {
+#ifdef __APPLE__
+    return st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+}
+
+static bool readFully(int fd, char* data, size_t length, size_t* outLength) {
+    size_t total = 0;
+    while (total < length) {
+        ssize_t nRead = ::read(fd, data + total, length - total);
+        if (nRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (nRead == 0) {
+            break;
+        }
+        total += nRead;
+    }
+    *outLength = total;
+    return true;
+}
+
+static bool writeFully(int fd, const uint8_t* data, size_t length) {
+    while (length) {
+        ssize_t nWrite = ::write(fd, data, length);
+        if (nWrite < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += nWrite;
+        length -= nWrite;
+    }
+    return true;
+}
+
+
+// --- KeyMapCache ---
+
+struct KeyMapCache::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t type;
+    uint32_t sectionCount;
+    int64_t sourceSize;
+    int64_t sourceModifiedTime;
+    // Length of the source path that follows the header, without a terminator.
+    uint32_t sourcePathLength;
+    uint32_t reserved;
+};
+
+struct KeyMapCache::SectionHeader {
+    // Offset of the records from the start of the file.
+    uint32_t offset;
+    uint32_t recordSize;
+    uint32_t recordCount;
+    uint32_t reserved;
+};
+
+KeyMapCache::KeyMapCache(FileMap* fileMap, const uint8_t* data,
+        const SectionHeader* sections, uint32_t sectionCount) :
+        mFileMap(fileMap), mData(data), mSections(sections), mSectionCount(sectionCount) {
+}
+
+KeyMapCache::~KeyMapCache() {
+    delete mFileMap;
+}
+
+void KeyMapCache::setDirectory(const String8& directory) {
+    AutoMutex _l(gDirectoryLock);
+    gDirectory = directory;
+}
+
+String8 KeyMapCache::getDirectory() {
+    AutoMutex _l(gDirectoryLock);
+    return gDirectory;
+}
+
+String8 KeyMapCache::getCompiledPath(const String8& directory, const String8& sourcePath) {
+    String8 path(directory);
+    path.append("/");
+    const char* source = sourcePath.string();
+    while (*source == '/') {
+        source++;
+    }
+    for (; *source; source++) {
+        char ch = *source == '/' ? '@' : *source;
+        path.append(&ch, 1);
+    }
+    path.append(".bin");
+    return path;
+}
+
+KeyMapCache* KeyMapCache::open(const String8& sourcePath, Type type) {
+    String8 directory = getDirectory();
+    if (directory.isEmpty()) {
+        return NULL;
+    }
+
+    struct stat sourceStat;
+    if (stat(sourcePath.string(), &sourceStat)) {
+        return NULL;
+    }
+
+    String8 path = getCompiledPath(directory, sourcePath);
+    int fd = ::open(path.string(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    KeyMapCache* cache = NULL;
+    struct stat compiledStat;
+    if (!fstat(fd, &compiledStat) && size_t(compiledStat.st_size) >= sizeof(Header)) {
+        size_t length = compiledStat.st_size;
+        FileMap* fileMap = new FileMap();
+        if (fileMap->create(NULL, fd, 0, length, true)) {
+            const uint8_t* data = static_cast<const uint8_t*>(fileMap->getDataPtr());
+            const Header* header = reinterpret_cast<const Header*>(data);
+            size_t pathOffset = sizeof(Header);
+            size_t sectionsOffset = align(pathOffset + header->sourcePathLength);
+            if (header->magic != MAGIC
+                    || header->version != VERSION
+                    || header->type != uint32_t(type)
+                    || header->sourceSize != int64_t(sourceStat.st_size)
+                    || header->sourceModifiedTime != getModifiedTime(sourceStat)
+                    || header->sourcePathLength != sourcePath.length()
+                    || sectionsOffset > length
+                    || header->sectionCount > (length - sectionsOffset) / sizeof(SectionHeader)
+                    || memcmp(data + pathOffset, sourcePath.string(), sourcePath.length())) {
+#if DEBUG_CACHE
+                ALOGD("Ignoring stale or invalid compiled file '%s'.", path.string());
+#endif
+                delete fileMap;
+            } else {
+                const SectionHeader* sections = reinterpret_cast<const SectionHeader*>(
+                        data + sectionsOffset);
+                bool valid = true;
+                for (uint32_t i = 0; i < header->sectionCount; i++) {
+                    const SectionHeader& section = sections[i];
+                    if (section.offset % ALIGNMENT || section.offset > length
+                            || (section.recordSize && section.recordCount
+                                    > (length - section.offset) / section.recordSize)) {
+                        valid = false;
+                        break;
+                    }
+                }
+                if (valid) {
+                    cache = new KeyMapCache(fileMap, data, sections, header->sectionCount);
+                } else {
+                    ALOGW("Ignoring corrupt compiled file '%s'.", path.string());
+                    delete fileMap;
+                }
+            }
+        } else {
+            delete fileMap;
+        }
+    }
+    close(fd);
+    return cache;
+}
+
+status_t KeyMapCache::readSource(const String8& sourcePath, String8* outContents,
+        Source* outSource) {
+    int fd = ::open(sourcePath.string(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    status_t status = OK;
+    struct stat sourceStat;
+    if (fstat(fd, &sourceStat)) {
+        status = -errno;
+    } else {
+        size_t length = sourceStat.st_size;
+        char* buffer = outContents->lockBuffer(length);
+        if (!buffer) {
+            status = NO_MEMORY;
+        } else {
+            if (!readFully(fd, buffer, length, &length)) {
+                status = -errno;
+                length = 0;
+            }
+            outContents->unlockBuffer(length);
+            outSource->size = sourceStat.st_size;
+            outSource->modifiedTime = getModifiedTime(sourceStat);
+        }
+    }
+    close(fd);
+    return status;
+}
+
+status_t KeyMapCache::write(const String8& sourcePath, const Source& source, Type type,
+        const Section* sections, uint32_t sectionCount) {
+    String8 directory = getDirectory();
+    if (directory.isEmpty()) {
+        return INVALID_OPERATION;
+    }
+
+    size_t sectionsOffset = align(sizeof(Header) + sourcePath.length());
+    size_t length = align(sectionsOffset + sectionCount * sizeof(SectionHeader));
+    for (uint32_t i = 0; i < sectionCount; i++) {
+        length += align(size_t(sections[i].recordSize) * sections[i].recordCount);
+    }
+    if (length > UINT32_MAX) {
+        return BAD_VALUE;
+    }
+
+    uint8_t* data = static_cast<uint8_t*>(calloc(1, length));
+    if (!data) {
+        return NO_MEMORY;
+    }
+
+    Header* header = reinterpret_cast<Header*>(data);
+    header->magic = MAGIC;
+    header->version = VERSION;
+    header->type = type;
+    header->sectionCount = sectionCount;
+    header->sourceSize = source.size;
+    header->sourceModifiedTime = source.modifiedTime;
+    header->sourcePathLength = sourcePath.length();
+    memcpy(data + sizeof(Header), sourcePath.string(), sourcePath.length());
+
+    SectionHeader* sectionHeaders = reinterpret_cast<SectionHeader*>(data + sectionsOffset);
+    size_t offset = align(sectionsOffset + sectionCount * sizeof(SectionHeader));
+    for (uint32_t i = 0; i < sectionCount; i++) {
+        size_t size = size_t(sections[i].recordSize) * sections[i].recordCount;
+        sectionHeaders[i].offset = offset;
+        sectionHeaders[i].recordSize = sections[i].recordSize;
+        sectionHeaders[i].recordCount = sections[i].recordCount;
+        if (size) {
+            memcpy(data + offset, sections[i].data, size);
+        }
+        offset += align(size);
+    }
+
+    // Write to a temporary file first so that readers never see a partial file.
+    if (mkdir(directory.string(), 0700) && errno != EEXIST) {
+        ALOGW("Could not create key map cache directory '%s', errno=%d.",
+                directory.string(), errno);
+    }
+    String8 path = getCompiledPath(directory, sourcePath);
+    String8 tempPath(path);
+    tempPath.appendFormat(".%d.tmp", getpid());
+
+    status_t status = OK;
+    int fd = ::open(tempPath.string(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        status = -errno;
+    } else {
+        if (!writeFully(fd, data, length)) {
+            status = -errno;
+        }
+        close(fd);
+        if (!status && rename(tempPath.string(), path.string())) {
+            status = -errno;
+        }
+        if (status) {
+            unlink(tempPath.string());
+        }
+    }
+    free(data);
+
+    if (status) {
+        ALOGW("Could not write compiled file '%s', status=%d.", path.string(), status);
+    }
+#if DEBUG_CACHE
+    else {
+        ALOGD("Wrote compiled file '%s' for '%s', %zu bytes.",
+                path.string(), sourcePath.string(), length);
+    }
+#endif
+    return status;
+}
+
+const void* KeyMapCache::getSection(uint32_t index, uint32_t recordSize,
+        uint32_t* outRecordCount) const {
+    if (index >= mSectionCount || mSections[index].recordSize != recordSize) {
+        return NULL;
+    }
+    *outRecordCount = mSections[index].recordCount;
+    return mData + mSections[index].offset;
+}
+
+} // namespace android
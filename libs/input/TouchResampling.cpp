@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TouchResampling"
+//#define LOG_NDEBUG 0
+
+#include <string.h>
+
+#include <input/TouchResampling.h>
+
+namespace android {
+
+// Nanoseconds per milliseconds.
+static const nsecs_t NANOS_PER_MS = 1000000;
+
+// Latency added during linear resampling.  A few milliseconds doesn't hurt much but
+// reduces the impact of mispredicted touch positions.
+static const nsecs_t LINEAR_LATENCY = 5 * NANOS_PER_MS;
+
+// Maximum time to predict forward from the last known state by linear extrapolation,
+// to avoid predicting too far into the future.  This time is further bounded by 50% of
+// the last time delta.
+static const nsecs_t LINEAR_MAX_PREDICTION = 8 * NANOS_PER_MS;
+
+// Maximum time the Kalman filter predicts forward from the last known state.  This time
+// is further bounded by twice the last time delta.
+static const nsecs_t KALMAN_MAX_PREDICTION = 16 * NANOS_PER_MS;
+
+// Variance of the touch position measurements, in square pixels.
+static const double KALMAN_MEASUREMENT_VARIANCE = 1.0;
+
+// Spectral density of the jerk that drives the motion model, in square pixels per s^5.
+// Higher values follow changes of direction faster but let more jitter through.
+static const double KALMAN_JERK_DENSITY = 1e9;
+
+// Initial variance of the velocity and acceleration of a new pointer.
+static const double KALMAN_INITIAL_VELOCITY_VARIANCE = 1e6;
+static const double KALMAN_INITIAL_ACCELERATION_VARIANCE = 1e8;
+
+template<typename T>
+inline static T min(const T& a, const T& b) {
+    return a < b ? a : b;
+}
+
+inline static float lerp(float a, float b, float alpha) {
+    return a + alpha * (b - a);
+}
+
+
+// --- TouchResamplingStrategy ---
+
+TouchResamplingStrategy* TouchResamplingStrategy::create(const char* name) {
+    if (!strcmp("linear", name)) {
+        // Linear extrapolation from the last two samples with 5ms of latency.
+        // Rarely overshoots, but always lags behind a moving finger.
+        return new LinearTouchResamplingStrategy();
+    }
+    if (!strcmp("kalman", name)) {
+        // Constant acceleration Kalman filter that predicts up to the frame time.
+        // Keeps up with the finger during smooth motion, but overshoots a little when
+        // it stops or turns.  Meant for low latency drawing.
+        return new KalmanTouchResamplingStrategy();
+    }
+    return NULL;
+}
+
+
+// --- LinearTouchResamplingStrategy ---
+
+LinearTouchResamplingStrategy::LinearTouchResamplingStrategy() {
+}
+
+LinearTouchResamplingStrategy::~LinearTouchResamplingStrategy() {
+}
+
+nsecs_t LinearTouchResamplingStrategy::getLatency() const {
+    return LINEAR_LATENCY;
+}
+
+nsecs_t LinearTouchResamplingStrategy::getMaxPrediction(nsecs_t delta) const {
+    return min(delta / 2, LINEAR_MAX_PREDICTION);
+}
+
+bool LinearTouchResamplingStrategy::predict(const Sample* samples, size_t sampleCount,
+        nsecs_t sampleTime, float* outX, float* outY) const {
+    const Sample& current = samples[0];
+    const Sample& other = samples[1];
+    nsecs_t delta = current.eventTime - other.eventTime;
+    if (delta <= 0) {
+        return false;
+    }
+    float alpha = float(current.eventTime - sampleTime) / delta;
+    *outX = lerp(current.x, other.x, alpha);
+    *outY = lerp(current.y, other.y, alpha);
+    return true;
+}
+
+
+// --- KalmanTouchResamplingStrategy ---
+
+KalmanTouchResamplingStrategy::KalmanTouchResamplingStrategy() {
+}
+
+KalmanTouchResamplingStrategy::~KalmanTouchResamplingStrategy() {
+}
+
+nsecs_t KalmanTouchResamplingStrategy::getLatency() const {
+    return 0;
+}
+
+nsecs_t KalmanTouchResamplingStrategy::getMaxPrediction(nsecs_t delta) const {
+    return min(delta * 2, KALMAN_MAX_PREDICTION);
+}
+
+bool KalmanTouchResamplingStrategy::predict(const Sample* samples, size_t sampleCount,
+        nsecs_t sampleTime, float* outX, float* outY) const {
+    // The filter is small enough to run again over the few samples we keep each frame,
+    // which spares the consumer from keeping filter state per pointer.
+    State x, y;
+    const Sample* sample = &samples[sampleCount - 1];
+    initialize(&x, sample->x);
+    initialize(&y, sample->y);
+    while (sample != samples) {
+        double dt = (sample[-1].eventTime - sample->eventTime) * 1e-9;
+        sample -= 1;
+        if (dt <= 0) {
+            return false;
+        }
+        advance(&x, dt);
+        advance(&y, dt);
+        update(&x, sample->x);
+        update(&y, sample->y);
+    }
+
+    double dt = (sampleTime - samples[0].eventTime) * 1e-9;
+    *outX = float(predict(x, dt));
+    *outY = float(predict(y, dt));
+    return true;
+}
+
+void KalmanTouchResamplingStrategy::initialize(State* state, double position) {
+    memset(state, 0, sizeof(*state));
+    state->x[0] = position;
+    state->p[0][0] = KALMAN_MEASUREMENT_VARIANCE;
+    state->p[1][1] = KALMAN_INITIAL_VELOCITY_VARIANCE;
+    state->p[2][2] = KALMAN_INITIAL_ACCELERATION_VARIANCE;
+}
+
+void KalmanTouchResamplingStrategy::advance(State* state, double dt) {
+    // x = F x, with F the constant acceleration transition over dt.
+    double dt2 = dt * dt / 2;
+    state->x[0] += state->x[1] * dt + state->x[2] * dt2;
+    state->x[1] += state->x[2] * dt;
+
+    // P = F P F' + Q.
+    double f[3][3] = { { 1, dt, dt2 }, { 0, 1, dt }, { 0, 0, 1 } };
+    double fp[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            fp[i][j] = f[i][0] * state->p[0][j] + f[i][1] * state->p[1][j]
+                    + f[i][2] * state->p[2][j];
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            state->p[i][j] = fp[i][0] * f[j][0] + fp[i][1] * f[j][1] + fp[i][2] * f[j][2];
+        }
+    }
+
+    // Process noise of white jerk integrated over dt.
+    double q = KALMAN_JERK_DENSITY;
+    double t2 = dt * dt, t3 = t2 * dt, t4 = t3 * dt, t5 = t4 * dt;
+    state->p[0][0] += q * t5 / 20;
+    state->p[0][1] += q * t4 / 8;
+    state->p[0][2] += q * t3 / 6;
+    state->p[1][0] += q * t4 / 8;
+    state->p[1][1] += q * t3 / 3;
+    state->p[1][2] += q * t2 / 2;
+    state->p[2][0] += q * t3 / 6;
+    state->p[2][1] += q * t2 / 2;
+    state->p[2][2] += q * dt;
+}
+
+void KalmanTouchResamplingStrategy::update(State* state, double position) {
+    // Only the position is measured, so the gain is the first column of P scaled by
+    // the innovation variance.
+    double s = state->p[0][0] + KALMAN_MEASUREMENT_VARIANCE;
+    double k[3] = { state->p[0][0] / s, state->p[1][0] / s, state->p[2][0] / s };
+    double innovation = position - state->x[0];
+    for (int i = 0; i < 3; i++) {
+        state->x[i] += k[i] * innovation;
+    }
+
+    // P = (I - K H) P.
+    double p0[3] = { state->p[0][0], state->p[0][1], state->p[0][2] };
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            state->p[i][j] -= k[i] * p0[j];
+        }
+    }
+}
+
+double KalmanTouchResamplingStrategy::predict(const State& state, double dt) {
+    return state.x[0] + state.x[1] * dt + state.x[2] * dt * dt / 2;
+}
+
+} // namespace android
@@ -43,24 +43,30 @@ static const nsecs_t NANOS_PER_MS = 1000000;
 // velocity after the pointer starts moving again.
 static const nsecs_t ASSUME_POINTER_STOPPED_TIME = 40 * NANOS_PER_MS;
 
+// Largest least squares problem solved by the least squares strategy.
+static const uint32_t MAX_LEAST_SQUARES_SAMPLES = 20;
+static const uint32_t MAX_LEAST_SQUARES_COEFFS = VelocityTracker::Estimator::MAX_DEGREE + 1;
 
+
+// Uses four independent partial sums so that the compiler can keep them in a
+// single SIMD register.
 static float vectorDot(const float* a, const float* b, uint32_t m) {
-    float r = 0;
-    while (m) {
-        m--;
-        r += *(a++) * *(b++);
+    float r0 = 0, r1 = 0, r2 = 0, r3 = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= m; i += 4) {
+        r0 += a[i] * b[i];
+        r1 += a[i + 1] * b[i + 1];
+        r2 += a[i + 2] * b[i + 2];
+        r3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < m; i++) {
+        r0 += a[i] * b[i];
     }
-    return r;
+    return (r0 + r1) + (r2 + r3);
 }
 
 static float vectorNorm(const float* a, uint32_t m) {
-    float r = 0;
-    while (m) {
-        m--;
-        float t = *(a++);
-        r += t * t;
-    }
-    return sqrtf(r);
+    return sqrtf(vectorDot(a, a, m));
 }
 
 #if DEBUG_STRATEGY || DEBUG_VELOCITY
@@ -441,6 +447,9 @@ void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet3
  */
 static bool solveLeastSquares(const float* x, const float* y,
         const float* w, uint32_t m, uint32_t n, float* outB, float* outDet) {
+    LOG_ALWAYS_FATAL_IF(m > MAX_LEAST_SQUARES_SAMPLES || n > MAX_LEAST_SQUARES_COEFFS,
+            "solveLeastSquares: too many samples or coefficients, m=%u, n=%u", m, n);
+
 #if DEBUG_STRATEGY
     ALOGD("solveLeastSquares: m=%d, n=%d, x=%s, y=%s, w=%s", int(m), int(n),
             vectorToString(x, m).string(), vectorToString(y, m).string(),
@@ -448,7 +457,7 @@ static bool solveLeastSquares(const float* x, const float* y,
 #endif
 
     // Expand the X vector to a matrix A, pre-multiplied by the weights.
-    float a[n][m]; // column-major order
+    float a[MAX_LEAST_SQUARES_COEFFS][MAX_LEAST_SQUARES_SAMPLES]; // column-major order
     for (uint32_t h = 0; h < m; h++) {
         a[0][h] = w[h];
         for (uint32_t i = 1; i < n; i++) {
@@ -456,12 +465,15 @@ static bool solveLeastSquares(const float* x, const float* y,
         }
     }
 #if DEBUG_STRATEGY
-    ALOGD("  - a=%s", matrixToString(&a[0][0], m, n, false /*rowMajor*/).string());
+    ALOGD("  - a=%s", matrixToString(&a[0][0], MAX_LEAST_SQUARES_SAMPLES, n,
+            false /*rowMajor*/).string());
 #endif
 
     // Apply the Gram-Schmidt process to A to obtain its QR decomposition.
-    float q[n][m]; // orthonormal basis, column-major order
-    float r[n][n]; // upper triangular matrix, row-major order
+    // orthonormal basis, column-major order
+    float q[MAX_LEAST_SQUARES_COEFFS][MAX_LEAST_SQUARES_SAMPLES];
+    // upper triangular matrix, row-major order
+    float r[MAX_LEAST_SQUARES_COEFFS][MAX_LEAST_SQUARES_COEFFS];
     for (uint32_t j = 0; j < n; j++) {
         for (uint32_t h = 0; h < m; h++) {
             q[j][h] = a[j][h];
@@ -491,11 +503,13 @@ static bool solveLeastSquares(const float* x, const float* y,
         }
     }
 #if DEBUG_STRATEGY
-    ALOGD("  - q=%s", matrixToString(&q[0][0], m, n, false /*rowMajor*/).string());
-    ALOGD("  - r=%s", matrixToString(&r[0][0], n, n, true /*rowMajor*/).string());
+    ALOGD("  - q=%s", matrixToString(&q[0][0], MAX_LEAST_SQUARES_SAMPLES, n,
+            false /*rowMajor*/).string());
+    ALOGD("  - r=%s", matrixToString(&r[0][0], n, MAX_LEAST_SQUARES_COEFFS,
+            true /*rowMajor*/).string());
 
     // calculate QR, if we factored A correctly then QR should equal A
-    float qr[n][m];
+    float qr[MAX_LEAST_SQUARES_COEFFS][MAX_LEAST_SQUARES_SAMPLES];
     for (uint32_t h = 0; h < m; h++) {
         for (uint32_t i = 0; i < n; i++) {
             qr[i][h] = 0;
@@ -504,12 +518,13 @@ static bool solveLeastSquares(const float* x, const float* y,
             }
         }
     }
-    ALOGD("  - qr=%s", matrixToString(&qr[0][0], m, n, false /*rowMajor*/).string());
+    ALOGD("  - qr=%s", matrixToString(&qr[0][0], MAX_LEAST_SQUARES_SAMPLES, n,
+            false /*rowMajor*/).string());
 #endif
 
     // Solve R B = Qt W Y to find B.  This is easy because R is upper triangular.
     // We just work from bottom-right to top-left calculating B's coefficients.
-    float wy[m];
+    float wy[MAX_LEAST_SQUARES_SAMPLES];
     for (uint32_t h = 0; h < m; h++) {
         wy[h] = y[h] * w[h];
     }
@@ -557,6 +572,163 @@ static bool solveLeastSquares(const float* x, const float* y,
     return true;
 }
 
+/**
+ * Solves the same problem as solveLeastSquares for both axes at once, using the normal
+ * equations instead of a QR decomposition.
+ *
+ * The samples only contribute to the weighted moments of the time and of the positions,
+ * which are accumulated in a single pass, so the cost is linear in the number of samples
+ * instead of quadratic in the degree.  The equations are solved in double precision with
+ * a Cholesky decomposition, the time being rescaled to [-1, 0] and the positions taken
+ * relative to the newest sample to keep them well conditioned.
+ *
+ * The diagonal of the Cholesky factor of A^T A is the diagonal of R in the QR
+ * decomposition of A, so the same test as solveLeastSquares tells whether there is a
+ * solution.  Returns -1 if there is none, 1 if it was solved, and 0 if the normal
+ * equations are too ill-conditioned to be trusted, in which case solveLeastSquares
+ * should be used instead.
+ */
+static int solveLeastSquaresByMoments(const float* t, const float* x, const float* y,
+        const float* w, uint32_t m, uint32_t n,
+        float* outXB, float* outYB, float* outXDet, float* outYDet) {
+    double scale = 0;
+    for (uint32_t h = 0; h < m; h++) {
+        if (-t[h] > scale) {
+            scale = -t[h];
+        }
+    }
+    if (scale == 0) {
+        return -1; // all the samples happened at the same time so no solution
+    }
+    double invScale = 1.0 / scale;
+
+    // Weighted moments: g[k] = sum(w^2 u^k), gx[k] = sum(w^2 u^k x), gy[k] = sum(w^2 u^k y)
+    // where u is the rescaled time and x, y are relative to the newest sample.
+    const uint32_t momentCount = 2 * n - 1;
+    double g[2 * MAX_LEAST_SQUARES_COEFFS - 1];
+    double gx[MAX_LEAST_SQUARES_COEFFS];
+    double gy[MAX_LEAST_SQUARES_COEFFS];
+    for (uint32_t k = 0; k < momentCount; k++) {
+        g[k] = 0;
+    }
+    for (uint32_t k = 0; k < n; k++) {
+        gx[k] = 0;
+        gy[k] = 0;
+    }
+    const double x0 = x[0];
+    const double y0 = y[0];
+    for (uint32_t h = 0; h < m; h++) {
+        double u = t[h] * invScale;
+        double term = double(w[h]) * w[h];
+        double dx = x[h] - x0;
+        double dy = y[h] - y0;
+        for (uint32_t k = 0; k < momentCount; k++) {
+            g[k] += term;
+            if (k < n) {
+                gx[k] += term * dx;
+                gy[k] += term * dy;
+            }
+            term *= u;
+        }
+    }
+
+    // Cholesky decomposition of the Gram matrix G[i][j] = g[i + j], G = L L^T.
+    double l[MAX_LEAST_SQUARES_COEFFS][MAX_LEAST_SQUARES_COEFFS];
+    double columnScale = 1; // scale^j, to compare the diagonal with the unscaled problem
+    for (uint32_t j = 0; j < n; j++) {
+        double d = g[2 * j];
+        for (uint32_t k = 0; k < j; k++) {
+            d -= l[j][k] * l[j][k];
+        }
+        double norm = d > 0 ? sqrt(d) * columnScale : 0;
+        if (norm < 0.000001) {
+            return -1; // vectors are linearly dependent or zero so no solution
+        }
+        if (d < g[2 * j] * 0.000001) {
+            // Nearly dependent columns, such as samples bunched up at both ends of the
+            // horizon.  Squaring the condition number would lose too many digits here.
+            return 0;
+        }
+        l[j][j] = sqrt(d);
+        for (uint32_t i = j + 1; i < n; i++) {
+            double v = g[i + j];
+            for (uint32_t k = 0; k < j; k++) {
+                v -= l[i][k] * l[j][k];
+            }
+            l[i][j] = v / l[j][j];
+        }
+        columnScale *= scale;
+    }
+
+    // Solve L L^T B = gx and L L^T B = gy, then undo the rescaling.
+    double bx[MAX_LEAST_SQUARES_COEFFS];
+    double by[MAX_LEAST_SQUARES_COEFFS];
+    for (uint32_t i = 0; i < n; i++) {
+        double vx = gx[i];
+        double vy = gy[i];
+        for (uint32_t k = 0; k < i; k++) {
+            vx -= l[i][k] * bx[k];
+            vy -= l[i][k] * by[k];
+        }
+        bx[i] = vx / l[i][i];
+        by[i] = vy / l[i][i];
+    }
+    for (uint32_t i = n; i != 0; ) {
+        i--;
+        double vx = bx[i];
+        double vy = by[i];
+        for (uint32_t k = i + 1; k < n; k++) {
+            vx -= l[k][i] * bx[k];
+            vy -= l[k][i] * by[k];
+        }
+        bx[i] = vx / l[i][i];
+        by[i] = vy / l[i][i];
+    }
+    double coeffScale = 1;
+    for (uint32_t i = 0; i < n; i++) {
+        outXB[i] = float(bx[i] * coeffScale);
+        outYB[i] = float(by[i] * coeffScale);
+        coeffScale *= invScale;
+    }
+    outXB[0] += x0;
+    outYB[0] += y0;
+
+    // Coefficient of determination, computed like solveLeastSquares does.
+    double xmean = 0;
+    double ymean = 0;
+    for (uint32_t h = 0; h < m; h++) {
+        xmean += x[h];
+        ymean += y[h];
+    }
+    xmean /= m;
+    ymean /= m;
+
+    double xsserr = 0, xsstot = 0;
+    double ysserr = 0, ysstot = 0;
+    for (uint32_t h = 0; h < m; h++) {
+        double u = t[h] * invScale;
+        double px = bx[n - 1];
+        double py = by[n - 1];
+        for (uint32_t i = n - 1; i != 0; ) {
+            i--;
+            px = px * u + bx[i];
+            py = py * u + by[i];
+        }
+        double xerr = x[h] - x0 - px;
+        double yerr = y[h] - y0 - py;
+        double ww = double(w[h]) * w[h];
+        double xvar = x[h] - xmean;
+        double yvar = y[h] - ymean;
+        xsserr += ww * xerr * xerr;
+        xsstot += ww * xvar * xvar;
+        ysserr += ww * yerr * yerr;
+        ysstot += ww * yvar * yvar;
+    }
+    *outXDet = xsstot > 0.000001 ? float(1.0 - xsserr / xsstot) : 1;
+    *outYDet = ysstot > 0.000001 ? float(1.0 - ysserr / ysstot) : 1;
+    return 1;
+}
+
 bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
         VelocityTracker::Estimator* outEstimator) const {
     outEstimator->clear();
@@ -600,8 +772,14 @@ bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
     if (degree >= 1) {
         float xdet, ydet;
         uint32_t n = degree + 1;
-        if (solveLeastSquares(time, x, w, m, n, outEstimator->xCoeff, &xdet)
-                && solveLeastSquares(time, y, w, m, n, outEstimator->yCoeff, &ydet)) {
+        int result = solveLeastSquaresByMoments(time, x, y, w, m, n,
+                outEstimator->xCoeff, outEstimator->yCoeff, &xdet, &ydet);
+        if (result == 0) {
+            result = solveLeastSquares(time, x, w, m, n, outEstimator->xCoeff, &xdet)
+                    && solveLeastSquares(time, y, w, m, n, outEstimator->yCoeff, &ydet)
+                    ? 1 : -1;
+        }
+        if (result > 0) {
             outEstimator->time = newestMovement.eventTime;
             outEstimator->degree = degree;
             outEstimator->confidence = xdet * ydet;
@@ -4,8 +4,13 @@ LOCAL_PATH:= $(call my-dir)
 # Build the unit tests.
 test_src_files := \
     InputChannel_test.cpp \
+    InputChannelSharedRing_test.cpp \
     InputEvent_test.cpp \
-    InputPublisherAndConsumer_test.cpp
+    InputPublisherAndConsumer_test.cpp \
+    KeyCharacterMap_test.cpp \
+    KeyMapCache_test.cpp \
+    TouchResampling_test.cpp \
+    VelocityTracker_test.cpp
 
 shared_libraries := \
     libinput \
@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include <binder/Parcel.h>
+#include <gtest/gtest.h>
+#include <input/InputTransport.h>
+#include <utils/StrongPointer.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class InputChannelSharedRingTest : public testing::Test {
+protected:
+    sp<InputChannel> serverChannel, clientChannel;
+
+    virtual void SetUp() {
+        ASSERT_EQ(OK, InputChannel::openInputChannelPair(String8("channel name"),
+                serverChannel, clientChannel, true /*useSharedRing*/));
+    }
+
+    virtual void TearDown() {
+        serverChannel.clear();
+        clientChannel.clear();
+    }
+
+    static void makeKeyMessage(InputMessage* msg, uint32_t seq) {
+        memset(msg, 0, sizeof(InputMessage));
+        msg->header.type = InputMessage::TYPE_KEY;
+        msg->body.key.seq = seq;
+        msg->body.key.action = AKEY_EVENT_ACTION_DOWN;
+    }
+
+    static void makeMotionMessage(InputMessage* msg, uint32_t seq, uint32_t pointerCount) {
+        memset(msg, 0, sizeof(InputMessage));
+        msg->header.type = InputMessage::TYPE_MOTION;
+        msg->body.motion.seq = seq;
+        msg->body.motion.action = AMOTION_EVENT_ACTION_MOVE;
+        msg->body.motion.pointerCount = pointerCount;
+        for (uint32_t i = 0; i < pointerCount; i++) {
+            msg->body.motion.pointers[i].properties.id = i;
+            msg->body.motion.pointers[i].coords.setAxisValue(AMOTION_EVENT_AXIS_X, seq + i);
+        }
+    }
+
+    static bool isReadable(const sp<InputChannel>& channel) {
+        struct pollfd pfd;
+        pfd.fd = channel->getFd();
+        pfd.events = POLLIN;
+        return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+    }
+
+    static void waitReadable(const sp<InputChannel>& channel) {
+        struct pollfd pfd;
+        pfd.fd = channel->getFd();
+        pfd.events = POLLIN;
+        poll(&pfd, 1, -1);
+    }
+
+    static status_t publishMove(InputPublisher* publisher, uint32_t seq, nsecs_t eventTime) {
+        PointerProperties pointerProperties;
+        pointerProperties.clear();
+        pointerProperties.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+        PointerCoords pointerCoords;
+        pointerCoords.clear();
+        pointerCoords.setAxisValue(AMOTION_EVENT_AXIS_X, seq);
+        return publisher->publishMotionEvent(seq, 1 /*deviceId*/, AINPUT_SOURCE_TOUCHSCREEN,
+                AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, eventTime,
+                1, &pointerProperties, &pointerCoords);
+    }
+};
+
+TEST_F(InputChannelSharedRingTest, OpenInputChannelPair_WithoutSharedRing_UsesTheSocket) {
+    sp<InputChannel> server, client;
+    ASSERT_EQ(OK, InputChannel::openInputChannelPair(String8("socket"), server, client));
+    EXPECT_EQ(-1, server->getRingFd());
+    EXPECT_EQ(-1, client->getRingFd());
+}
+
+TEST_F(InputChannelSharedRingTest, OpenInputChannelPair_ReturnsAPairOfConnectedChannels) {
+    EXPECT_STREQ("channel name (server)", serverChannel->getName().string());
+    EXPECT_STREQ("channel name (client)", clientChannel->getName().string());
+    EXPECT_TRUE(serverChannel->isRingServer());
+    EXPECT_FALSE(clientChannel->isRingServer());
+    EXPECT_GE(serverChannel->getRingFd(), 0);
+    EXPECT_GE(clientChannel->getRingFd(), 0);
+
+    // Server->Client communication
+    InputMessage serverMsg;
+    makeKeyMessage(&serverMsg, 7);
+    EXPECT_EQ(OK, serverChannel->sendMessage(&serverMsg));
+    EXPECT_TRUE(isReadable(clientChannel))
+            << "client channel should have been woken up";
+
+    InputMessage clientMsg;
+    EXPECT_EQ(OK, clientChannel->receiveMessage(&clientMsg));
+    EXPECT_EQ(serverMsg.header.type, clientMsg.header.type);
+    EXPECT_EQ(serverMsg.body.key.seq, clientMsg.body.key.seq);
+    EXPECT_EQ(serverMsg.body.key.action, clientMsg.body.key.action);
+
+    // Client->Server communication
+    InputMessage clientReply;
+    memset(&clientReply, 0, sizeof(InputMessage));
+    clientReply.header.type = InputMessage::TYPE_FINISHED;
+    clientReply.body.finished.seq = 0x11223344;
+    clientReply.body.finished.handled = true;
+    EXPECT_EQ(OK, clientChannel->sendMessage(&clientReply));
+
+    InputMessage serverReply;
+    EXPECT_EQ(OK, serverChannel->receiveMessage(&serverReply));
+    EXPECT_EQ(clientReply.header.type, serverReply.header.type);
+    EXPECT_EQ(clientReply.body.finished.seq, serverReply.body.finished.seq);
+    EXPECT_EQ(clientReply.body.finished.handled, serverReply.body.finished.handled);
+
+    InputMessage msg;
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&msg));
+    EXPECT_EQ(WOULD_BLOCK, serverChannel->receiveMessage(&msg));
+}
+
+TEST_F(InputChannelSharedRingTest, SendMessage_WakesUpIdleConsumerOnce) {
+    InputMessage msg;
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&msg));
+
+    for (uint32_t seq = 1; seq <= 10; seq++) {
+        makeKeyMessage(&msg, seq);
+        ASSERT_EQ(OK, serverChannel->sendMessage(&msg));
+    }
+
+    // The first message wakes the consumer up, the other ones are read along with it.
+    char buffer[16];
+    EXPECT_EQ(1, ::recv(clientChannel->getFd(), buffer, sizeof(buffer), MSG_DONTWAIT));
+    EXPECT_EQ(-1, ::recv(clientChannel->getFd(), buffer, sizeof(buffer), MSG_DONTWAIT));
+
+    for (uint32_t seq = 1; seq <= 10; seq++) {
+        ASSERT_EQ(OK, clientChannel->receiveMessage(&msg));
+        EXPECT_EQ(seq, msg.body.key.seq);
+    }
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&msg));
+}
+
+TEST_F(InputChannelSharedRingTest, SendMessage_WhenRingFull_ReturnsWouldBlock) {
+    InputMessage msg;
+    uint32_t sent = 0;
+    status_t status;
+    for (;;) {
+        makeMotionMessage(&msg, sent + 1, MAX_POINTERS);
+        status = serverChannel->sendMessage(&msg);
+        if (status != OK) {
+            break;
+        }
+        sent += 1;
+    }
+    EXPECT_EQ(WOULD_BLOCK, status);
+    EXPECT_GT(sent, 0U);
+
+    // Consuming one message makes room for another one.
+    ASSERT_EQ(OK, clientChannel->receiveMessage(&msg));
+    EXPECT_EQ(1U, msg.body.motion.seq);
+    makeMotionMessage(&msg, sent + 1, MAX_POINTERS);
+    EXPECT_EQ(OK, serverChannel->sendMessage(&msg));
+
+    for (uint32_t seq = 2; seq <= sent + 1; seq++) {
+        ASSERT_EQ(OK, clientChannel->receiveMessage(&msg));
+        EXPECT_EQ(seq, msg.body.motion.seq);
+    }
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&msg));
+}
+
+TEST_F(InputChannelSharedRingTest, SendMessage_WrapsAroundTheRing) {
+    // Messages of varying sizes so that records end up straddling the end of the ring.
+    InputMessage msg;
+    uint32_t nextSent = 1;
+    uint32_t nextReceived = 1;
+    for (int round = 0; round < 200; round++) {
+        for (int i = 0; i < 7; i++) {
+            makeMotionMessage(&msg, nextSent, 1 + nextSent % MAX_POINTERS);
+            ASSERT_EQ(OK, serverChannel->sendMessage(&msg));
+            nextSent += 1;
+        }
+        for (int i = 0; i < 7; i++) {
+            ASSERT_EQ(OK, clientChannel->receiveMessage(&msg));
+            ASSERT_EQ(nextReceived, msg.body.motion.seq);
+            ASSERT_EQ(1 + nextReceived % MAX_POINTERS, msg.body.motion.pointerCount);
+            ASSERT_EQ(float(nextReceived + msg.body.motion.pointerCount - 1),
+                    msg.body.motion.pointers[msg.body.motion.pointerCount - 1]
+                            .coords.getAxisValue(AMOTION_EVENT_AXIS_X));
+            nextReceived += 1;
+        }
+    }
+}
+
+TEST_F(InputChannelSharedRingTest, Dup_SharesTheRing) {
+    sp<InputChannel> dupChannel = clientChannel->dup();
+    ASSERT_TRUE(dupChannel != NULL);
+    EXPECT_FALSE(dupChannel->isRingServer());
+
+    InputMessage msg;
+    makeKeyMessage(&msg, 3);
+    ASSERT_EQ(OK, serverChannel->sendMessage(&msg));
+
+    clientChannel.clear();
+    ASSERT_EQ(OK, dupChannel->receiveMessage(&msg));
+    EXPECT_EQ(3U, msg.body.key.seq);
+}
+
+TEST_F(InputChannelSharedRingTest, ReadFromParcel_KeepsTheRing) {
+    Parcel parcel;
+    ASSERT_EQ(OK, clientChannel->writeToParcel(&parcel));
+    parcel.setDataPosition(0);
+    sp<InputChannel> parceledChannel = InputChannel::readFromParcel(&parcel);
+    ASSERT_TRUE(parceledChannel != NULL);
+    EXPECT_STREQ("channel name (client)", parceledChannel->getName().string());
+    EXPECT_GE(parceledChannel->getRingFd(), 0);
+    EXPECT_FALSE(parceledChannel->isRingServer());
+
+    clientChannel.clear();
+    InputMessage msg;
+    makeKeyMessage(&msg, 5);
+    ASSERT_EQ(OK, serverChannel->sendMessage(&msg));
+    ASSERT_EQ(OK, parceledChannel->receiveMessage(&msg));
+    EXPECT_EQ(5U, msg.body.key.seq);
+}
+
+TEST_F(InputChannelSharedRingTest, ReadFromParcel_WithoutSharedRing_UsesTheSocket) {
+    sp<InputChannel> server, client;
+    ASSERT_EQ(OK, InputChannel::openInputChannelPair(String8("socket"), server, client));
+
+    Parcel parcel;
+    ASSERT_EQ(OK, client->writeToParcel(&parcel));
+    parcel.setDataPosition(0);
+    sp<InputChannel> parceledChannel = InputChannel::readFromParcel(&parcel);
+    ASSERT_TRUE(parceledChannel != NULL);
+    EXPECT_EQ(-1, parceledChannel->getRingFd());
+
+    InputMessage msg;
+    makeKeyMessage(&msg, 6);
+    ASSERT_EQ(OK, server->sendMessage(&msg));
+    ASSERT_EQ(OK, parceledChannel->receiveMessage(&msg));
+    EXPECT_EQ(6U, msg.body.key.seq);
+}
+
+TEST_F(InputChannelSharedRingTest, SendFinishedSignal_AcknowledgesABatchInOneMessage) {
+    InputPublisher publisher(serverChannel);
+    InputConsumer consumer(clientChannel);
+    PreallocatedInputEventFactory eventFactory;
+
+    for (uint32_t seq = 1; seq <= 4; seq++) {
+        ASSERT_EQ(OK, publishMove(&publisher, seq, seq));
+    }
+
+    uint32_t consumeSeq;
+    InputEvent* event;
+    ASSERT_EQ(OK, consumer.consume(&eventFactory, true /*consumeBatches*/, -1,
+            &consumeSeq, &event));
+    EXPECT_EQ(4U, consumeSeq);
+    EXPECT_EQ(3U, static_cast<MotionEvent*>(event)->getHistorySize());
+    ASSERT_EQ(OK, consumer.sendFinishedSignal(consumeSeq, true));
+
+    InputMessage msg;
+    ASSERT_EQ(OK, serverChannel->receiveMessage(&msg));
+    EXPECT_EQ(InputMessage::TYPE_FINISHED_BATCH, msg.header.type);
+    ASSERT_EQ(4U, msg.body.finishedBatch.count);
+    for (uint32_t i = 0; i < 4; i++) {
+        EXPECT_EQ(i + 1, msg.body.finishedBatch.entries[i].seq);
+        EXPECT_EQ(1U, msg.body.finishedBatch.entries[i].handled);
+    }
+    EXPECT_EQ(WOULD_BLOCK, serverChannel->receiveMessage(&msg));
+}
+
+TEST_F(InputChannelSharedRingTest, ReceiveFinishedSignal_ReturnsEachSignalOfABatch) {
+    InputPublisher publisher(serverChannel);
+    InputConsumer consumer(clientChannel);
+    PreallocatedInputEventFactory eventFactory;
+
+    for (uint32_t seq = 1; seq <= 4; seq++) {
+        ASSERT_EQ(OK, publishMove(&publisher, seq, seq));
+    }
+    uint32_t consumeSeq;
+    InputEvent* event;
+    ASSERT_EQ(OK, consumer.consume(&eventFactory, true /*consumeBatches*/, -1,
+            &consumeSeq, &event));
+    ASSERT_EQ(OK, consumer.sendFinishedSignal(consumeSeq, true));
+
+    uint32_t finishedSeq;
+    bool handled;
+    for (uint32_t seq = 1; seq <= 4; seq++) {
+        ASSERT_EQ(OK, publisher.receiveFinishedSignal(&finishedSeq, &handled));
+        EXPECT_EQ(seq, finishedSeq);
+        EXPECT_TRUE(handled);
+    }
+    EXPECT_EQ(WOULD_BLOCK, publisher.receiveFinishedSignal(&finishedSeq, &handled));
+}
+
+TEST_F(InputChannelSharedRingTest, ReceiveMessage_WhenPeerClosed_ReturnsDeadObject) {
+    serverChannel.clear();
+
+    InputMessage msg;
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->receiveMessage(&msg));
+}
+
+TEST_F(InputChannelSharedRingTest, SendMessage_WhenPeerClosedAndIdle_ReturnsDeadObject) {
+    InputMessage msg;
+    EXPECT_EQ(WOULD_BLOCK, serverChannel->receiveMessage(&msg)); // server now waits for a wakeup
+    serverChannel.clear();
+
+    makeKeyMessage(&msg, 1);
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->sendMessage(&msg));
+}
+
+// Compares the two transports from InputPublisher to InputConsumer and back.  Not a
+// pass/fail test, the numbers are printed for comparison on the device.
+TEST_F(InputChannelSharedRingTest, Benchmark_PublishToConsume) {
+    const int kRoundTrips = 5000;
+    const int kBursts = 500;
+    const int kBurstSize = 16;
+
+    for (int useRing = 0; useRing < 2; useRing++) {
+        sp<InputChannel> server, client;
+        ASSERT_EQ(OK, InputChannel::openInputChannelPair(String8("bench"), server, client,
+                useRing != 0));
+
+        // The client behaves like an app: it waits for its fd, consumes what it can
+        // and finishes each event, which covers every batched sample.
+        nsecs_t totalLatency = 0;
+        int consumedEvents = 0;
+        std::thread clientThread([&]() {
+            InputConsumer consumer(client);
+            PreallocatedInputEventFactory eventFactory;
+            int remaining = kRoundTrips + kBursts * kBurstSize;
+            while (remaining > 0) {
+                uint32_t seq;
+                InputEvent* event;
+                status_t status = consumer.consume(&eventFactory, true /*consumeBatches*/, -1,
+                        &seq, &event);
+                if (status == WOULD_BLOCK) {
+                    waitReadable(client);
+                    continue;
+                }
+                if (status != OK) {
+                    return;
+                }
+                MotionEvent* motionEvent = static_cast<MotionEvent*>(event);
+                totalLatency += systemTime(SYSTEM_TIME_MONOTONIC)
+                        - motionEvent->getHistoricalEventTime(0);
+                consumedEvents += 1;
+                remaining -= motionEvent->getHistorySize() + 1;
+                while (consumer.sendFinishedSignal(seq, true) == WOULD_BLOCK) {
+                    usleep(10);
+                }
+            }
+        });
+
+        InputPublisher publisher(server);
+        uint32_t seq = 1;
+        uint32_t finishedSeq;
+        bool handled;
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < kRoundTrips; i++) {
+            ASSERT_EQ(OK, publishMove(&publisher, seq++, systemTime(SYSTEM_TIME_MONOTONIC)));
+            status_t status;
+            while ((status = publisher.receiveFinishedSignal(&finishedSeq, &handled))
+                    == WOULD_BLOCK) {
+                waitReadable(server);
+            }
+            ASSERT_EQ(OK, status);
+        }
+        nsecs_t roundTripTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < kBursts; i++) {
+            for (int j = 0; j < kBurstSize; j++) {
+                ASSERT_EQ(OK, publishMove(&publisher, seq++, systemTime(SYSTEM_TIME_MONOTONIC)));
+            }
+            for (int j = 0; j < kBurstSize; ) {
+                status_t status = publisher.receiveFinishedSignal(&finishedSeq, &handled);
+                if (status == WOULD_BLOCK) {
+                    waitReadable(server);
+                    continue;
+                }
+                ASSERT_EQ(OK, status);
+                j += 1;
+            }
+        }
+        nsecs_t burstTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        clientThread.join();
+        printf("%s: round trip %.2f us, burst of %d %.2f us/event, "
+                "publish to consume %.2f us over %d consumed events\n",
+                useRing ? "shared ring" : "socket",
+                roundTripTime / 1000.0 / kRoundTrips, kBurstSize,
+                burstTime / 1000.0 / (kBursts * kBurstSize),
+                consumedEvents ? totalLatency / 1000.0 / consumedEvents : 0.0,
+                consumedEvents);
+    }
+}
+
+} // namespace android
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <input/Input.h>
+#include <input/KeyCharacterMap.h>
+
+namespace android {
+
+static const char* BASE_CONTENTS =
+        "type FULL\n"
+        "\n"
+        "key A {\n"
+        "    label:                              'A'\n"
+        "    base:                               'a'\n"
+        "    shift, capslock:                    'A'\n"
+        "    ctrl, alt, meta:                    none\n"
+        "}\n"
+        "\n"
+        "key 1 {\n"
+        "    label:                              '1'\n"
+        "    base:                               '1'\n"
+        "    shift:                              '!'\n"
+        "}\n"
+        "\n"
+        "key NUMPAD_1 {\n"
+        "    label:                              '1'\n"
+        "    base:                               fallback MOVE_END\n"
+        "    numlock:                            '1'\n"
+        "}\n"
+        "\n"
+        "key SPACE {\n"
+        "    label:                              ' '\n"
+        "    base:                               ' '\n"
+        "    alt, meta:                          fallback SEARCH\n"
+        "    ctrl:                               fallback LANGUAGE_SWITCH\n"
+        "}\n"
+        "\n"
+        "key ESCAPE {\n"
+        "    base:                               none\n"
+        "    meta:                               replace HOME\n"
+        "}\n"
+        "\n"
+        "map key 30 A\n"
+        "map key usage 0x070004 A\n";
+
+static const char* OVERLAY_CONTENTS =
+        "type OVERLAY\n"
+        "\n"
+        "key A {\n"
+        "    label:                              'Q'\n"
+        "    base:                               'q'\n"
+        "}\n"
+        "\n"
+        "map key 30 B\n";
+
+
+// --- KeyCharacterMapTest ---
+
+class KeyCharacterMapTest : public testing::Test {
+protected:
+    sp<KeyCharacterMap> mMap;
+
+    virtual void SetUp() {
+        ASSERT_EQ(OK, KeyCharacterMap::loadContents(String8("base.kcm"), BASE_CONTENTS,
+                KeyCharacterMap::FORMAT_BASE, &mMap));
+    }
+
+    static void assertKeyEvent(const KeyEvent& event, int32_t action, int32_t keyCode,
+            int32_t metaState) {
+        EXPECT_EQ(action, event.getAction());
+        EXPECT_EQ(keyCode, event.getKeyCode());
+        EXPECT_EQ(metaState, event.getMetaState());
+    }
+};
+
+TEST_F(KeyCharacterMapTest, Load_ReadsKeysAndProperties) {
+    EXPECT_EQ(KeyCharacterMap::KEYBOARD_TYPE_FULL, mMap->getKeyboardType());
+
+    EXPECT_EQ(u'A', mMap->getDisplayLabel(AKEYCODE_A));
+    EXPECT_EQ(u' ', mMap->getDisplayLabel(AKEYCODE_SPACE));
+    EXPECT_EQ(0, mMap->getDisplayLabel(AKEYCODE_B));
+
+    // The number defaults to the digit generated by any behavior of the key.
+    EXPECT_EQ(u'1', mMap->getNumber(AKEYCODE_1));
+    EXPECT_EQ(u'1', mMap->getNumber(AKEYCODE_NUMPAD_1));
+    EXPECT_EQ(0, mMap->getNumber(AKEYCODE_A));
+}
+
+TEST_F(KeyCharacterMapTest, Load_SortsKeysDeclaredOutOfOrder) {
+    sp<KeyCharacterMap> map;
+    ASSERT_EQ(OK, KeyCharacterMap::loadContents(String8("unsorted.kcm"),
+            "type FULL\n"
+            "key SPACE {\n    base: ' '\n}\n"
+            "key B {\n    base: 'b'\n}\n"
+            "key A {\n    base: 'a'\n}\n"
+            "key C {\n    base: 'c'\n}\n",
+            KeyCharacterMap::FORMAT_BASE, &map));
+
+    EXPECT_EQ(u'a', map->getCharacter(AKEYCODE_A, 0));
+    EXPECT_EQ(u'b', map->getCharacter(AKEYCODE_B, 0));
+    EXPECT_EQ(u'c', map->getCharacter(AKEYCODE_C, 0));
+    EXPECT_EQ(u' ', map->getCharacter(AKEYCODE_SPACE, 0));
+    EXPECT_EQ(0, map->getCharacter(AKEYCODE_D, 0));
+}
+
+TEST_F(KeyCharacterMapTest, Load_RejectsWrongFormat) {
+    sp<KeyCharacterMap> map;
+    EXPECT_NE(OK, KeyCharacterMap::loadContents(String8("base.kcm"), BASE_CONTENTS,
+            KeyCharacterMap::FORMAT_OVERLAY, &map));
+    EXPECT_TRUE(map == NULL);
+    EXPECT_NE(OK, KeyCharacterMap::loadContents(String8("overlay.kcm"), OVERLAY_CONTENTS,
+            KeyCharacterMap::FORMAT_BASE, &map));
+    EXPECT_TRUE(map == NULL);
+}
+
+TEST_F(KeyCharacterMapTest, GetCharacter_PrefersTheMostSpecificBehavior) {
+    EXPECT_EQ(u'a', mMap->getCharacter(AKEYCODE_A, 0));
+    EXPECT_EQ(u'A', mMap->getCharacter(AKEYCODE_A, AMETA_SHIFT_ON | AMETA_SHIFT_LEFT_ON));
+    EXPECT_EQ(u'A', mMap->getCharacter(AKEYCODE_A, AMETA_CAPS_LOCK_ON));
+    EXPECT_EQ(0, mMap->getCharacter(AKEYCODE_A, AMETA_CTRL_ON));
+    EXPECT_EQ(u'!', mMap->getCharacter(AKEYCODE_1, AMETA_SHIFT_ON));
+    EXPECT_EQ(0, mMap->getCharacter(AKEYCODE_NUMPAD_1, 0));
+    EXPECT_EQ(u'1', mMap->getCharacter(AKEYCODE_NUMPAD_1, AMETA_NUM_LOCK_ON));
+    EXPECT_EQ(0, mMap->getCharacter(AKEYCODE_B, 0));
+}
+
+TEST_F(KeyCharacterMapTest, GetFallbackActionAndTryRemapKey) {
+    KeyCharacterMap::FallbackAction action;
+    ASSERT_TRUE(mMap->getFallbackAction(AKEYCODE_SPACE, AMETA_ALT_ON, &action));
+    EXPECT_EQ(AKEYCODE_SEARCH, action.keyCode);
+    EXPECT_EQ(0, action.metaState);
+    ASSERT_TRUE(mMap->getFallbackAction(AKEYCODE_SPACE, AMETA_CTRL_ON, &action));
+    EXPECT_EQ(AKEYCODE_LANGUAGE_SWITCH, action.keyCode);
+    EXPECT_FALSE(mMap->getFallbackAction(AKEYCODE_SPACE, 0, &action));
+    ASSERT_TRUE(mMap->getFallbackAction(AKEYCODE_NUMPAD_1, 0, &action));
+    EXPECT_EQ(AKEYCODE_MOVE_END, action.keyCode);
+
+    int32_t keyCode, metaState;
+    mMap->tryRemapKey(AKEYCODE_ESCAPE, AMETA_META_ON, &keyCode, &metaState);
+    EXPECT_EQ(AKEYCODE_HOME, keyCode);
+    EXPECT_EQ(0, metaState);
+    mMap->tryRemapKey(AKEYCODE_ESCAPE, 0, &keyCode, &metaState);
+    EXPECT_EQ(AKEYCODE_ESCAPE, keyCode);
+}
+
+TEST_F(KeyCharacterMapTest, GetMatch_PrefersTheExactMetaState) {
+    const char16_t chars[] = { u'a', u'A' };
+    EXPECT_EQ(u'A', mMap->getMatch(AKEYCODE_A, chars, 2, AMETA_SHIFT_ON));
+    EXPECT_EQ(u'a', mMap->getMatch(AKEYCODE_A, chars, 2, 0));
+    EXPECT_EQ(0, mMap->getMatch(AKEYCODE_1, chars, 2, 0));
+}
+
+TEST_F(KeyCharacterMapTest, GetEvents_UsesTheLowestKeyCodeAndItsMostGeneralBehavior) {
+    const char16_t chars[] = { u'A', u'1', u'!' };
+    Vector<KeyEvent> events;
+    ASSERT_TRUE(mMap->getEvents(1, chars, 3, events));
+    ASSERT_EQ(10U, events.size());
+
+    // 'A' is generated by both caps lock and shift, the one declared first is more general.
+    assertKeyEvent(events[0], AKEY_EVENT_ACTION_DOWN, AKEYCODE_SHIFT_LEFT,
+            AMETA_SHIFT_ON | AMETA_SHIFT_LEFT_ON);
+    assertKeyEvent(events[1], AKEY_EVENT_ACTION_DOWN, AKEYCODE_A,
+            AMETA_SHIFT_ON | AMETA_SHIFT_LEFT_ON);
+    assertKeyEvent(events[2], AKEY_EVENT_ACTION_UP, AKEYCODE_A,
+            AMETA_SHIFT_ON | AMETA_SHIFT_LEFT_ON);
+    assertKeyEvent(events[3], AKEY_EVENT_ACTION_UP, AKEYCODE_SHIFT_LEFT, 0);
+
+    // '1' is generated by KEYCODE_1 and KEYCODE_NUMPAD_1, the lower key code wins.
+    assertKeyEvent(events[4], AKEY_EVENT_ACTION_DOWN, AKEYCODE_1, 0);
+    assertKeyEvent(events[5], AKEY_EVENT_ACTION_UP, AKEYCODE_1, 0);
+
+    assertKeyEvent(events[6], AKEY_EVENT_ACTION_DOWN, AKEYCODE_SHIFT_LEFT,
+            AMETA_SHIFT_ON | AMETA_SHIFT_LEFT_ON);
+    assertKeyEvent(events[7], AKEY_EVENT_ACTION_DOWN, AKEYCODE_1,
+            AMETA_SHIFT_ON | AMETA_SHIFT_LEFT_ON);
+    assertKeyEvent(events[8], AKEY_EVENT_ACTION_UP, AKEYCODE_1,
+            AMETA_SHIFT_ON | AMETA_SHIFT_LEFT_ON);
+    assertKeyEvent(events[9], AKEY_EVENT_ACTION_UP, AKEYCODE_SHIFT_LEFT, 0);
+
+    const char16_t missing[] = { u'z' };
+    EXPECT_FALSE(mMap->getEvents(1, missing, 1, events));
+}
+
+TEST_F(KeyCharacterMapTest, MapKey) {
+    int32_t keyCode;
+    ASSERT_EQ(OK, mMap->mapKey(30, 0, &keyCode));
+    EXPECT_EQ(AKEYCODE_A, keyCode);
+    ASSERT_EQ(OK, mMap->mapKey(0, 0x070004, &keyCode));
+    EXPECT_EQ(AKEYCODE_A, keyCode);
+    EXPECT_EQ(NAME_NOT_FOUND, mMap->mapKey(31, 0, &keyCode));
+}
+
+TEST_F(KeyCharacterMapTest, Combine_OverlayReplacesWholeKeys) {
+    sp<KeyCharacterMap> overlay;
+    ASSERT_EQ(OK, KeyCharacterMap::loadContents(String8("overlay.kcm"), OVERLAY_CONTENTS,
+            KeyCharacterMap::FORMAT_OVERLAY, &overlay));
+    sp<KeyCharacterMap> map = KeyCharacterMap::combine(mMap, overlay);
+
+    EXPECT_EQ(KeyCharacterMap::KEYBOARD_TYPE_FULL, map->getKeyboardType());
+    EXPECT_EQ(u'Q', map->getDisplayLabel(AKEYCODE_A));
+    EXPECT_EQ(u'q', map->getCharacter(AKEYCODE_A, 0));
+    EXPECT_EQ(u'q', map->getCharacter(AKEYCODE_A, AMETA_SHIFT_ON));
+    EXPECT_EQ(u'!', map->getCharacter(AKEYCODE_1, AMETA_SHIFT_ON));
+
+    const char16_t chars[] = { u'q', u'a' };
+    Vector<KeyEvent> events;
+    ASSERT_TRUE(map->getEvents(1, chars, 1, events));
+    ASSERT_EQ(2U, events.size());
+    EXPECT_EQ(AKEYCODE_A, events[0].getKeyCode());
+    EXPECT_FALSE(map->getEvents(1, chars + 1, 1, events));
+
+    int32_t keyCode;
+    ASSERT_EQ(OK, map->mapKey(30, 0, &keyCode));
+    EXPECT_EQ(AKEYCODE_B, keyCode);
+
+    // The base map is left alone.
+    EXPECT_EQ(u'a', mMap->getCharacter(AKEYCODE_A, 0));
+}
+
+} // namespace android
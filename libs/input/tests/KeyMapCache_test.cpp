@@ -0,0 +1,376 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <input/Input.h>
+#include <input/KeyCharacterMap.h>
+#include <input/KeyLayoutMap.h>
+#include <input/KeyMapCache.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+static const char* KEY_CHARACTER_MAP_CONTENTS =
+        "type FULL\n"
+        "\n"
+        "key A {\n"
+        "    label:                              'A'\n"
+        "    base:                               'a'\n"
+        "    shift, capslock:                    'A'\n"
+        "    ctrl, alt, meta:                    none\n"
+        "}\n"
+        "\n"
+        "key 1 {\n"
+        "    label:                              '1'\n"
+        "    base:                               '1'\n"
+        "    shift:                              '!'\n"
+        "}\n"
+        "\n"
+        "key SPACE {\n"
+        "    label:                              ' '\n"
+        "    base:                               ' '\n"
+        "    alt, meta:                          fallback SEARCH\n"
+        "}\n"
+        "\n"
+        "map key 30 A\n"
+        "map key usage 0x070004 A\n";
+
+static const char* KEY_LAYOUT_CONTENTS =
+        "key 30 A\n"
+        "key 158 BACK VIRTUAL\n"
+        "key usage 0x070004 B\n"
+        "axis 0x00 X\n"
+        "axis 0x01 invert Y\n"
+        "axis 0x02 split 0x7f LTRIGGER RTRIGGER flat 16\n"
+        "led 0x00 NUM_LOCK\n"
+        "led usage 0x080001 CAPS_LOCK\n";
+
+
+// --- KeyMapCacheTest ---
+
+class KeyMapCacheTest : public testing::Test {
+protected:
+    String8 mDirectory;
+    String8 mCacheDirectory;
+
+    virtual void SetUp() {
+        char directory[] = "/data/local/tmp/KeyMapCache_test.XXXXXX";
+        ASSERT_TRUE(mkdtemp(directory) != NULL);
+        mDirectory.setTo(directory);
+        mCacheDirectory.setTo(directory);
+        mCacheDirectory.append("/cache");
+        KeyMapCache::setDirectory(mCacheDirectory);
+    }
+
+    virtual void TearDown() {
+        KeyMapCache::setDirectory(String8());
+        removeDirectory(mCacheDirectory);
+        removeDirectory(mDirectory);
+    }
+
+    static void removeDirectory(const String8& path) {
+        DIR* dir = opendir(path.string());
+        if (dir) {
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != NULL) {
+                if (entry->d_type == DT_REG) {
+                    String8 child(path);
+                    child.appendFormat("/%s", entry->d_name);
+                    unlink(child.string());
+                }
+            }
+            closedir(dir);
+        }
+        rmdir(path.string());
+    }
+
+    String8 writeSource(const char* name, const char* contents) {
+        String8 path(mDirectory);
+        path.appendFormat("/%s", name);
+        FILE* file = fopen(path.string(), "w");
+        EXPECT_TRUE(file != NULL);
+        if (file) {
+            fputs(contents, file);
+            fclose(file);
+        }
+        return path;
+    }
+
+    // Replaces the contents of the source file without changing its size or
+    // modification time, so that only the compiled file can supply the map.
+    void clobberSource(const String8& path) {
+        struct stat st;
+        ASSERT_EQ(0, stat(path.string(), &st));
+        String8 junk;
+        for (off_t i = 0; i < st.st_size; i++) {
+            junk.append("x");
+        }
+        writeSource(path.string() + mDirectory.length() + 1, junk.string());
+
+        struct timespec times[2];
+        times[0] = st.st_atim;
+        times[1] = st.st_mtim;
+        ASSERT_EQ(0, utimensat(AT_FDCWD, path.string(), times, 0));
+    }
+
+    // Moves the modification time of the source file forward.
+    void touchSource(const String8& path) {
+        struct stat st;
+        ASSERT_EQ(0, stat(path.string(), &st));
+        struct timespec times[2];
+        times[0] = st.st_atim;
+        times[1] = st.st_mtim;
+        times[1].tv_sec += 1;
+        ASSERT_EQ(0, utimensat(AT_FDCWD, path.string(), times, 0));
+    }
+
+    size_t countCompiledFiles() {
+        size_t count = 0;
+        DIR* dir = opendir(mCacheDirectory.string());
+        if (dir) {
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != NULL) {
+                if (entry->d_type == DT_REG) {
+                    count += 1;
+                }
+            }
+            closedir(dir);
+        }
+        return count;
+    }
+
+    String8 getCompiledFile() {
+        String8 path;
+        DIR* dir = opendir(mCacheDirectory.string());
+        if (dir) {
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != NULL) {
+                if (entry->d_type == DT_REG) {
+                    path.setTo(mCacheDirectory);
+                    path.appendFormat("/%s", entry->d_name);
+                }
+            }
+            closedir(dir);
+        }
+        return path;
+    }
+
+    static void assertKeyCharacterMap(const sp<KeyCharacterMap>& map) {
+        ASSERT_TRUE(map != NULL);
+        EXPECT_EQ(KeyCharacterMap::KEYBOARD_TYPE_FULL, map->getKeyboardType());
+        EXPECT_EQ(u'A', map->getDisplayLabel(AKEYCODE_A));
+        EXPECT_EQ(u'1', map->getNumber(AKEYCODE_1));
+        EXPECT_EQ(u'a', map->getCharacter(AKEYCODE_A, 0));
+        EXPECT_EQ(u'A', map->getCharacter(AKEYCODE_A, AMETA_CAPS_LOCK_ON));
+        EXPECT_EQ(0, map->getCharacter(AKEYCODE_A, AMETA_CTRL_ON));
+        EXPECT_EQ(u'!', map->getCharacter(AKEYCODE_1, AMETA_SHIFT_ON));
+
+        KeyCharacterMap::FallbackAction action;
+        ASSERT_TRUE(map->getFallbackAction(AKEYCODE_SPACE, AMETA_META_ON, &action));
+        EXPECT_EQ(AKEYCODE_SEARCH, action.keyCode);
+
+        const char16_t chars[] = { u'a', u'!' };
+        Vector<KeyEvent> events;
+        ASSERT_TRUE(map->getEvents(1, chars, 2, events));
+        ASSERT_EQ(6U, events.size());
+        EXPECT_EQ(AKEYCODE_A, events[0].getKeyCode());
+        EXPECT_EQ(AKEYCODE_SHIFT_LEFT, events[2].getKeyCode());
+        EXPECT_EQ(AKEYCODE_1, events[3].getKeyCode());
+
+        int32_t keyCode;
+        ASSERT_EQ(OK, map->mapKey(30, 0, &keyCode));
+        EXPECT_EQ(AKEYCODE_A, keyCode);
+        ASSERT_EQ(OK, map->mapKey(0, 0x070004, &keyCode));
+        EXPECT_EQ(AKEYCODE_A, keyCode);
+    }
+
+    static void assertKeyLayoutMap(const sp<KeyLayoutMap>& map) {
+        ASSERT_TRUE(map != NULL);
+        int32_t keyCode;
+        uint32_t flags;
+        ASSERT_EQ(OK, map->mapKey(30, 0, &keyCode, &flags));
+        EXPECT_EQ(AKEYCODE_A, keyCode);
+        EXPECT_EQ(0U, flags);
+        ASSERT_EQ(OK, map->mapKey(158, 0, &keyCode, &flags));
+        EXPECT_EQ(AKEYCODE_BACK, keyCode);
+        EXPECT_EQ(uint32_t(POLICY_FLAG_VIRTUAL), flags);
+        ASSERT_EQ(OK, map->mapKey(30, 0x070004, &keyCode, &flags));
+        EXPECT_EQ(AKEYCODE_B, keyCode);
+        EXPECT_EQ(NAME_NOT_FOUND, map->mapKey(31, 0, &keyCode, &flags));
+
+        Vector<int32_t> scanCodes;
+        map->findScanCodesForKey(AKEYCODE_BACK, &scanCodes);
+        ASSERT_EQ(1U, scanCodes.size());
+        EXPECT_EQ(158, scanCodes[0]);
+
+        AxisInfo axisInfo;
+        ASSERT_EQ(OK, map->mapAxis(0x01, &axisInfo));
+        EXPECT_EQ(AxisInfo::MODE_INVERT, axisInfo.mode);
+        EXPECT_EQ(AMOTION_EVENT_AXIS_Y, axisInfo.axis);
+        ASSERT_EQ(OK, map->mapAxis(0x02, &axisInfo));
+        EXPECT_EQ(AxisInfo::MODE_SPLIT, axisInfo.mode);
+        EXPECT_EQ(AMOTION_EVENT_AXIS_LTRIGGER, axisInfo.axis);
+        EXPECT_EQ(AMOTION_EVENT_AXIS_RTRIGGER, axisInfo.highAxis);
+        EXPECT_EQ(0x7f, axisInfo.splitValue);
+        EXPECT_EQ(16, axisInfo.flatOverride);
+        EXPECT_EQ(NAME_NOT_FOUND, map->mapAxis(0x03, &axisInfo));
+
+        int32_t code;
+        ASSERT_EQ(OK, map->findScanCodeForLed(ALED_NUM_LOCK, &code));
+        EXPECT_EQ(0x00, code);
+        ASSERT_EQ(OK, map->findUsageCodeForLed(ALED_CAPS_LOCK, &code));
+        EXPECT_EQ(0x080001, code);
+    }
+};
+
+TEST_F(KeyMapCacheTest, KeyCharacterMap_LoadsFromTheCompiledFile) {
+    String8 path = writeSource("Test.kcm", KEY_CHARACTER_MAP_CONTENTS);
+    sp<KeyCharacterMap> map;
+    ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+    assertKeyCharacterMap(map);
+    ASSERT_EQ(1U, countCompiledFiles());
+
+    clobberSource(path);
+    ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+    assertKeyCharacterMap(map);
+
+    // The compiled file is still checked against the requested format.
+    EXPECT_NE(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_OVERLAY, &map));
+}
+
+TEST_F(KeyMapCacheTest, KeyCharacterMap_ReparsesWhenTheSourceChanges) {
+    String8 path = writeSource("Test.kcm", KEY_CHARACTER_MAP_CONTENTS);
+    sp<KeyCharacterMap> map;
+    ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+
+    writeSource("Test.kcm",
+            "type FULL\n"
+            "key A {\n"
+            "    base: 'x'\n"
+            "}\n");
+    touchSource(path);
+    ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+    EXPECT_EQ(u'x', map->getCharacter(AKEYCODE_A, 0));
+    EXPECT_EQ(0, map->getCharacter(AKEYCODE_1, 0));
+
+    // The compiled file was replaced with the new contents.
+    clobberSource(path);
+    ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+    EXPECT_EQ(u'x', map->getCharacter(AKEYCODE_A, 0));
+    EXPECT_EQ(1U, countCompiledFiles());
+}
+
+TEST_F(KeyMapCacheTest, KeyCharacterMap_IgnoresCorruptCompiledFiles) {
+    String8 path = writeSource("Test.kcm", KEY_CHARACTER_MAP_CONTENTS);
+    sp<KeyCharacterMap> map;
+    ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+
+    String8 compiledPath = getCompiledFile();
+    ASSERT_FALSE(compiledPath.isEmpty());
+    struct stat st;
+    ASSERT_EQ(0, stat(compiledPath.string(), &st));
+    for (off_t length = 0; length < st.st_size; length += 12) {
+        ASSERT_EQ(0, truncate(compiledPath.string(), length));
+        ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+        assertKeyCharacterMap(map);
+    }
+}
+
+TEST_F(KeyMapCacheTest, KeyCharacterMap_WithoutDirectory_DoesNotCompile) {
+    KeyMapCache::setDirectory(String8());
+    String8 path = writeSource("Test.kcm", KEY_CHARACTER_MAP_CONTENTS);
+    sp<KeyCharacterMap> map;
+    ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+    assertKeyCharacterMap(map);
+    EXPECT_EQ(0U, countCompiledFiles());
+}
+
+TEST_F(KeyMapCacheTest, KeyLayoutMap_LoadsFromTheCompiledFile) {
+    String8 path = writeSource("Test.kl", KEY_LAYOUT_CONTENTS);
+    sp<KeyLayoutMap> map;
+    ASSERT_EQ(OK, KeyLayoutMap::load(path, &map));
+    assertKeyLayoutMap(map);
+    ASSERT_EQ(1U, countCompiledFiles());
+
+    clobberSource(path);
+    ASSERT_EQ(OK, KeyLayoutMap::load(path, &map));
+    assertKeyLayoutMap(map);
+
+    touchSource(path);
+    EXPECT_NE(OK, KeyLayoutMap::load(path, &map));
+}
+
+TEST_F(KeyMapCacheTest, Benchmark_Load) {
+    const int kIterations = 200;
+
+    // A full alphabetic layout, similar in size to Generic.kcm.
+    String8 contents("type FULL\n");
+    for (char letter = 'A'; letter <= 'Z'; letter++) {
+        contents.appendFormat(
+                "key %c {\n"
+                "    label:                              '%c'\n"
+                "    base:                               '%c'\n"
+                "    shift, capslock:                    '%c'\n"
+                "    ralt:                               '%c'\n"
+                "    ctrl, alt, meta:                    none\n"
+                "}\n\n",
+                letter, letter, letter - 'A' + 'a', letter, letter - 'A' + 'a');
+    }
+    for (int scanCode = 1; scanCode < 256; scanCode++) {
+        contents.appendFormat("map key %d %c\n", scanCode, 'A' + scanCode % 26);
+    }
+    String8 path = writeSource("Generic.kcm", contents.string());
+
+    sp<KeyCharacterMap> map;
+    KeyMapCache::setDirectory(String8());
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+    }
+    nsecs_t parseTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    KeyMapCache::setDirectory(mCacheDirectory);
+    ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        ASSERT_EQ(OK, KeyCharacterMap::load(path, KeyCharacterMap::FORMAT_BASE, &map));
+    }
+    nsecs_t compiledTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    EXPECT_EQ(u'q', map->getCharacter(AKEYCODE_Q, 0));
+
+    const char16_t chars[] = { u'h', u'e', u'l', u'l', u'o' };
+    Vector<KeyEvent> events;
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < kIterations; i++) {
+        events.clear();
+        ASSERT_TRUE(map->getEvents(1, chars, 5, events));
+    }
+    nsecs_t getEventsTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    printf("kcm load: parsed %.3f us, compiled %.3f us; getEvents %.3f us\n",
+            parseTime / 1000.0 / kIterations, compiledTime / 1000.0 / kIterations,
+            getEventsTime / 1000.0 / kIterations);
+}
+
+} // namespace android
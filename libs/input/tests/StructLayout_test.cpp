@@ -63,6 +63,15 @@ void TestInputMessageAlignment() {
   CHECK_OFFSET(InputMessage::Body::Motion, yPrecision, 68);
   CHECK_OFFSET(InputMessage::Body::Motion, pointerCount, 72);
   CHECK_OFFSET(InputMessage::Body::Motion, pointers, 80);
+
+  CHECK_OFFSET(InputMessage::Body::Finished, seq, 0);
+  CHECK_OFFSET(InputMessage::Body::Finished, handled, 4);
+
+  CHECK_OFFSET(InputMessage::Body::FinishedBatch, count, 0);
+  CHECK_OFFSET(InputMessage::Body::FinishedBatch, padding, 4);
+  CHECK_OFFSET(InputMessage::Body::FinishedBatch, entries, 8);
+  CHECK_OFFSET(InputMessage::Body::FinishedBatch::Entry, seq, 0);
+  CHECK_OFFSET(InputMessage::Body::FinishedBatch::Entry, handled, 4);
 }
 
 } // namespace android
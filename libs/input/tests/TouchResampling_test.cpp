@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+#include <input/InputTransport.h>
+#include <input/TouchResampling.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+typedef TouchResamplingStrategy::Sample Sample;
+
+static const nsecs_t FRAME_PERIOD = ms2ns(16) + us2ns(667);
+
+static Sample makeSample(nsecs_t eventTime, float x, float y) {
+    Sample sample;
+    sample.eventTime = eventTime;
+    sample.x = x;
+    sample.y = y;
+    return sample;
+}
+
+static void publishTouch(InputPublisher& publisher, uint32_t seq, int32_t action,
+        nsecs_t downTime, const Sample& sample) {
+    PointerProperties properties;
+    properties.clear();
+    properties.id = 0;
+    properties.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+    PointerCoords coords;
+    coords.clear();
+    coords.setAxisValue(AMOTION_EVENT_AXIS_X, sample.x);
+    coords.setAxisValue(AMOTION_EVENT_AXIS_Y, sample.y);
+    status_t status = publisher.publishMotionEvent(seq, 1, AINPUT_SOURCE_TOUCHSCREEN,
+            action, 0, 0, 0, 0, 0, 0, 0, 1, 1, downTime, sample.eventTime,
+            1, &properties, &coords);
+    EXPECT_EQ(OK, status) << "publisher publishMotionEvent should return OK";
+}
+
+// Samples are passed to the strategies from the most recent one backwards.
+static void reverse(Vector<Sample>& samples) {
+    for (size_t i = 0, j = samples.size(); i + 1 < j; i++) {
+        j--;
+        Sample sample = samples[i];
+        samples.editItemAt(i) = samples[j];
+        samples.editItemAt(j) = sample;
+    }
+}
+
+
+// --- TouchResamplingStrategyTest ---
+
+TEST(TouchResamplingStrategyTest, Create_KnowsTheStrategiesByName) {
+    TouchResamplingStrategy* strategy = TouchResamplingStrategy::create("linear");
+    ASSERT_TRUE(strategy != NULL);
+    EXPECT_EQ(ms2ns(5), strategy->getLatency());
+    delete strategy;
+
+    strategy = TouchResamplingStrategy::create("kalman");
+    ASSERT_TRUE(strategy != NULL);
+    EXPECT_EQ(0, strategy->getLatency());
+    delete strategy;
+
+    EXPECT_TRUE(TouchResamplingStrategy::create("cubic") == NULL);
+}
+
+TEST(TouchResamplingStrategyTest, Linear_ExtrapolatesFromTheLastTwoSamples) {
+    LinearTouchResamplingStrategy strategy;
+    Sample samples[] = {
+        makeSample(ms2ns(18), 30, 60),
+        makeSample(ms2ns(10), 10, 20),
+        makeSample(ms2ns(2), 0, 0),
+    };
+
+    float x, y;
+    ASSERT_TRUE(strategy.predict(samples, 3, ms2ns(22), &x, &y));
+    EXPECT_FLOAT_EQ(40, x);
+    EXPECT_FLOAT_EQ(80, y);
+
+    EXPECT_EQ(ms2ns(4), strategy.getMaxPrediction(ms2ns(8)));
+    EXPECT_EQ(ms2ns(8), strategy.getMaxPrediction(ms2ns(20)));
+}
+
+TEST(TouchResamplingStrategyTest, Kalman_FollowsUniformAndAcceleratedMotion) {
+    KalmanTouchResamplingStrategy strategy;
+    float x, y;
+
+    Vector<Sample> samples;
+    for (int i = 0; i < 8; i++) {
+        samples.push(makeSample(ms2ns(8) * i, 2.0f * i, 100 - 1.0f * i));
+    }
+    reverse(samples);
+    ASSERT_TRUE(strategy.predict(samples.array(), samples.size(), ms2ns(64), &x, &y));
+    EXPECT_NEAR(16, x, 0.5);
+    EXPECT_NEAR(92, y, 0.5);
+
+    // Accelerating at 10000 px/s^2.
+    samples.clear();
+    for (int i = 0; i < 8; i++) {
+        float t = i * 0.008f;
+        samples.push(makeSample(ms2ns(8) * i, 5000 * t * t, 0));
+    }
+    reverse(samples);
+    ASSERT_TRUE(strategy.predict(samples.array(), samples.size(), ms2ns(72), &x, &y));
+    EXPECT_NEAR(5000 * 0.072f * 0.072f, x, 2);
+
+    EXPECT_EQ(ms2ns(16), strategy.getMaxPrediction(ms2ns(8)));
+    EXPECT_EQ(ms2ns(16), strategy.getMaxPrediction(ms2ns(20)));
+}
+
+TEST(TouchResamplingStrategyTest, Kalman_RejectsSamplesOutOfOrder) {
+    KalmanTouchResamplingStrategy strategy;
+    Sample samples[] = {
+        makeSample(ms2ns(8), 10, 10),
+        makeSample(ms2ns(8), 0, 0),
+    };
+    float x, y;
+    EXPECT_FALSE(strategy.predict(samples, 2, ms2ns(10), &x, &y));
+}
+
+
+// --- TouchResamplingConsumerTest ---
+
+TEST(TouchResamplingConsumerTest, Consume_ResamplesWithTheStrategyOfTheChannel) {
+    static const char* const NAMES[] = { "linear", "kalman" };
+    // Linear resamples 5ms before the frame, at most 4ms past the last sample.
+    // Kalman resamples at the frame itself.
+    const nsecs_t expectedTimes[] = { ms2ns(28), ms2ns(34) };
+
+    for (size_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); i++) {
+        sp<InputChannel> serverChannel, clientChannel;
+        ASSERT_EQ(OK, InputChannel::openInputChannelPair(String8("channel name"),
+                serverChannel, clientChannel));
+        InputPublisher publisher(serverChannel);
+        InputConsumer consumer(clientChannel, NAMES[i]);
+        PreallocatedInputEventFactory eventFactory;
+
+        for (int j = 0; j < 4; j++) {
+            publishTouch(publisher, j + 1,
+                    j ? AMOTION_EVENT_ACTION_MOVE : AMOTION_EVENT_ACTION_DOWN,
+                    0, makeSample(ms2ns(8) * j, 10.0f * j, 0));
+        }
+
+        uint32_t seq;
+        InputEvent* event;
+        ASSERT_EQ(OK, consumer.consume(&eventFactory, true, ms2ns(34), &seq, &event));
+        ASSERT_EQ(AMOTION_EVENT_ACTION_DOWN, static_cast<MotionEvent*>(event)->getAction());
+        ASSERT_EQ(OK, consumer.consume(&eventFactory, true, ms2ns(34), &seq, &event));
+        MotionEvent* motionEvent = static_cast<MotionEvent*>(event);
+        EXPECT_EQ(expectedTimes[i], motionEvent->getEventTime()) << NAMES[i];
+        EXPECT_LT(30, motionEvent->getX(0)) << NAMES[i];
+    }
+}
+
+
+// --- TouchResamplingEvaluation ---
+
+/*
+ * Replays touch streams through an input channel to an InputConsumer that uses a given
+ * strategy, consumes a batch at each frame and measures how far the reported position is
+ * from the finger.
+ *
+ * A stream is a dense trace of the true finger position, of which every sample at the
+ * report period is delivered to the consumer.  Recorded streams can be replayed from the
+ * file named by the TOUCH_RESAMPLING_TRACE environment variable, with one
+ * "<time ns> <x> <y>" sample per line.  All of their samples are delivered and the truth
+ * between samples is interpolated.
+ */
+class TouchResamplingEvaluation : public testing::Test {
+protected:
+    struct Stream {
+        const char* name;
+        Vector<Sample> truth;
+        nsecs_t reportPeriod; // 0 to report every sample of the truth
+    };
+
+    struct Result {
+        // Time from the reported sample time to the frame time, in ms.
+        double lag;
+        // Distance between the reported position and the finger at the reported time.
+        double predictionError;
+        // Distance between the reported position and the finger at the frame time.
+        double frameError;
+        double frameErrorP95;
+        size_t frameCount;
+    };
+
+    // Time it takes a touch sample to get from the digitizer to the consumer.
+    static const nsecs_t DELIVERY_LATENCY = 4000000;
+
+    static Sample truthAt(const Stream& stream, nsecs_t time) {
+        const Vector<Sample>& truth = stream.truth;
+        size_t i = 1;
+        while (i < truth.size() - 1 && truth[i].eventTime < time) {
+            i++;
+        }
+        const Sample& a = truth[i - 1];
+        const Sample& b = truth[i];
+        float alpha = float(time - a.eventTime) / (b.eventTime - a.eventTime);
+        return makeSample(time, a.x + alpha * (b.x - a.x), a.y + alpha * (b.y - a.y));
+    }
+
+    static void getReports(const Stream& stream, Vector<Sample>& reports) {
+        for (size_t i = 0; i < stream.truth.size(); i++) {
+            const Sample& sample = stream.truth[i];
+            if (!stream.reportPeriod
+                    || (sample.eventTime - stream.truth[0].eventTime)
+                            % stream.reportPeriod == 0) {
+                // Digitizers report positions with a little jitter.
+                float jitter = (i * 7919 % 13) / 12.0f - 0.5f;
+                reports.push(makeSample(sample.eventTime,
+                        sample.x + (stream.reportPeriod ? jitter : 0),
+                        sample.y - (stream.reportPeriod ? jitter : 0)));
+            }
+        }
+    }
+
+    // Does not resample when strategy is NULL, the latest report is used instead.
+    static Result evaluate(const Stream& stream, const char* strategy) {
+        Vector<Sample> reports;
+        getReports(stream, reports);
+
+        sp<InputChannel> serverChannel, clientChannel;
+        status_t status = InputChannel::openInputChannelPair(String8("evaluation"),
+                serverChannel, clientChannel);
+        EXPECT_EQ(OK, status) << "openInputChannelPair should return OK";
+        InputPublisher publisher(serverChannel);
+        InputConsumer consumer(clientChannel, strategy ? strategy : "linear");
+        PreallocatedInputEventFactory eventFactory;
+
+        Vector<double> frameErrors;
+        double lag = 0, predictionError = 0;
+        nsecs_t start = stream.truth[0].eventTime + FRAME_PERIOD / 3;
+        nsecs_t end = stream.truth.top().eventTime;
+        size_t delivered = 0;
+        Sample reported = makeSample(0, 0, 0);
+        for (nsecs_t frameTime = start; frameTime <= end; frameTime += FRAME_PERIOD) {
+            while (delivered < reports.size()
+                    && reports[delivered].eventTime + DELIVERY_LATENCY <= frameTime) {
+                publishTouch(publisher, delivered + 1,
+                        delivered ? AMOTION_EVENT_ACTION_MOVE : AMOTION_EVENT_ACTION_DOWN,
+                        reports[0].eventTime, reports[delivered]);
+                delivered++;
+            }
+
+            // Like the choreographer, consume everything up to the frame. Samples after
+            // the resampling time are kept for the next frame.
+            for (;;) {
+                uint32_t seq;
+                InputEvent* event;
+                status = consumer.consume(&eventFactory, true, strategy ? frameTime : -1,
+                        &seq, &event);
+                if (status) {
+                    EXPECT_EQ(WOULD_BLOCK, status) << "consumer consume should return "
+                            "WOULD_BLOCK once the frame is consumed";
+                    break;
+                }
+                MotionEvent* motionEvent = static_cast<MotionEvent*>(event);
+                reported = makeSample(motionEvent->getEventTime(),
+                        motionEvent->getX(0), motionEvent->getY(0));
+                consumer.sendFinishedSignal(seq, true);
+            }
+            uint32_t finishedSeq;
+            bool handled;
+            while (!publisher.receiveFinishedSignal(&finishedSeq, &handled)) {
+            }
+            if (delivered < 2) {
+                continue;
+            }
+
+            Sample actual = truthAt(stream, reported.eventTime);
+            Sample finger = truthAt(stream, frameTime);
+            lag += ns2us(frameTime - reported.eventTime) / 1000.0;
+            predictionError += hypot(reported.x - actual.x, reported.y - actual.y);
+            frameErrors.push(hypot(reported.x - finger.x, reported.y - finger.y));
+        }
+
+        Result result;
+        result.frameCount = frameErrors.size();
+        result.lag = lag / result.frameCount;
+        result.predictionError = predictionError / result.frameCount;
+        double frameError = 0;
+        for (size_t i = 0; i < frameErrors.size(); i++) {
+            frameError += frameErrors[i];
+        }
+        result.frameError = frameError / result.frameCount;
+        frameErrors.sort(compareErrors);
+        result.frameErrorP95 = frameErrors[frameErrors.size() * 95 / 100];
+        return result;
+    }
+
+    static int compareErrors(const double* a, const double* b) {
+        return *a < *b ? -1 : *a > *b ? 1 : 0;
+    }
+
+    // Generates a stroke with a 1ms truth reported at 125Hz.
+    template<typename F>
+    static void makeStream(Stream* stream, const char* name, nsecs_t duration, F position) {
+        stream->name = name;
+        stream->reportPeriod = ms2ns(8);
+        for (nsecs_t t = 0; t <= duration; t += ms2ns(1)) {
+            float x, y;
+            position(t * 1e-9f, &x, &y);
+            stream->truth.push(makeSample(t, x, y));
+        }
+    }
+
+    static void makeStreams(Vector<Stream>& streams) {
+        streams.push();
+        makeStream(&streams.editTop(), "drag", ms2ns(600), [](float t, float* x, float* y) {
+            *x = 100 + 800 * t;
+            *y = 300 + 300 * t;
+        });
+        streams.push();
+        makeStream(&streams.editTop(), "fling", ms2ns(300), [](float t, float* x, float* y) {
+            // Accelerates to 4000 px/s then lifts off.
+            *x = 200 + 7000 * t * t;
+            *y = 1500 - 3000 * t * t;
+        });
+        streams.push();
+        makeStream(&streams.editTop(), "circle", ms2ns(1000), [](float t, float* x, float* y) {
+            *x = 500 + 200 * cosf(2 * M_PI * t);
+            *y = 800 + 200 * sinf(2 * M_PI * t);
+        });
+        streams.push();
+        makeStream(&streams.editTop(), "zigzag", ms2ns(1000), [](float t, float* x, float* y) {
+            // Reverses direction every 250ms, the worst case for prediction.
+            float phase = fmodf(t, 0.5f);
+            *x = 300 + 1200 * (phase < 0.25f ? phase : 0.5f - phase);
+            *y = 400 + 300 * t;
+        });
+
+        const char* path = getenv("TOUCH_RESAMPLING_TRACE");
+        if (path) {
+            FILE* file = fopen(path, "r");
+            ASSERT_TRUE(file != NULL) << "Could not open " << path;
+            streams.push();
+            Stream& stream = streams.editTop();
+            stream.name = "recorded";
+            stream.reportPeriod = 0;
+            long long time;
+            float x, y;
+            while (fscanf(file, "%lld %f %f", &time, &x, &y) == 3) {
+                stream.truth.push(makeSample(time, x, y));
+            }
+            fclose(file);
+            ASSERT_LE(2U, stream.truth.size()) << "Not enough samples in " << path;
+        }
+    }
+};
+
+TEST_F(TouchResamplingEvaluation, Evaluate_ReplayedStrokes) {
+    static const char* const NAMES[] = { NULL, "linear", "kalman" };
+    const size_t strategyCount = sizeof(NAMES) / sizeof(NAMES[0]);
+
+    Vector<Stream> streams;
+    makeStreams(streams);
+
+    printf("%-10s %-8s %8s %12s %12s %12s\n", "stream", "strategy",
+            "lag ms", "predict px", "frame px", "frame p95");
+    for (size_t i = 0; i < streams.size(); i++) {
+        Result results[strategyCount];
+        for (size_t j = 0; j < strategyCount; j++) {
+            results[j] = evaluate(streams[i], NAMES[j]);
+            printf("%-10s %-8s %8.2f %12.2f %12.2f %12.2f\n", streams[i].name,
+                    NAMES[j] ? NAMES[j] : "none", results[j].lag, results[j].predictionError,
+                    results[j].frameError, results[j].frameErrorP95);
+        }
+
+        // Resampling must reduce the lag behind the finger on the synthetic strokes.
+        if (streams[i].reportPeriod) {
+            EXPECT_LT(results[2].lag, results[1].lag) << streams[i].name;
+            EXPECT_LT(results[2].lag, results[0].lag) << streams[i].name;
+        }
+    }
+
+    // Predicting up to the frame time keeps much closer to a steadily moving finger.
+    EXPECT_LT(evaluate(streams[0], "kalman").frameError,
+            evaluate(streams[0], "linear").frameError / 2);
+}
+
+} // namespace android
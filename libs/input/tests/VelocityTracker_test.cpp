@@ -0,0 +1,452 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <gtest/gtest.h>
+#include <input/VelocityTracker.h>
+#include <utils/BitSet.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+typedef LeastSquaresVelocityTrackerStrategy::Weighting Weighting;
+
+static const nsecs_t HORIZON = ms2ns(100);
+static const uint32_t HISTORY_SIZE = 20;
+
+// Pointer id used by the tests.
+static const uint32_t POINTER_ID = 0;
+
+
+// --- ReferenceLeastSquares ---
+
+// The least squares strategy as it was before it solved the normal equations,
+// a Gram-Schmidt QR decomposition of the whole problem.  With T = float this is
+// exactly the previous implementation, with T = double it shows what the previous
+// implementation was approximating.
+template <typename T>
+class ReferenceLeastSquares {
+public:
+    ReferenceLeastSquares(uint32_t degree, Weighting weighting) :
+            mDegree(degree), mWeighting(weighting), mCount(0) {
+    }
+
+    void addMovement(nsecs_t eventTime, const VelocityTracker::Position& position) {
+        Movement& movement = mMovements[mCount++ % HISTORY_SIZE];
+        movement.eventTime = eventTime;
+        movement.position = position;
+    }
+
+    bool getEstimator(VelocityTracker::Estimator* outEstimator) const {
+        outEstimator->clear();
+        if (!mCount) {
+            return false;
+        }
+
+        float x[HISTORY_SIZE], y[HISTORY_SIZE], w[HISTORY_SIZE], time[HISTORY_SIZE];
+        uint32_t m = 0;
+        const Movement& newest = getMovement(0);
+        while (m < HISTORY_SIZE && m < mCount) {
+            const Movement& movement = getMovement(m);
+            nsecs_t age = newest.eventTime - movement.eventTime;
+            if (age > HORIZON) {
+                break;
+            }
+            x[m] = movement.position.x;
+            y[m] = movement.position.y;
+            w[m] = chooseWeight(m);
+            time[m] = -age * 0.000000001f;
+            m++;
+        }
+
+        uint32_t degree = mDegree;
+        if (degree > m - 1) {
+            degree = m - 1;
+        }
+        if (degree >= 1) {
+            float xdet, ydet;
+            uint32_t n = degree + 1;
+            if (solve(time, x, w, m, n, outEstimator->xCoeff, &xdet)
+                    && solve(time, y, w, m, n, outEstimator->yCoeff, &ydet)) {
+                outEstimator->time = newest.eventTime;
+                outEstimator->degree = degree;
+                outEstimator->confidence = xdet * ydet;
+                return true;
+            }
+        }
+        outEstimator->xCoeff[0] = x[0];
+        outEstimator->yCoeff[0] = y[0];
+        outEstimator->time = newest.eventTime;
+        outEstimator->degree = 0;
+        outEstimator->confidence = 1;
+        return true;
+    }
+
+private:
+    struct Movement {
+        nsecs_t eventTime;
+        VelocityTracker::Position position;
+    };
+
+    const uint32_t mDegree;
+    const Weighting mWeighting;
+    uint32_t mCount;
+    Movement mMovements[HISTORY_SIZE];
+
+    // Returns the movement that happened the given number of movements ago.
+    const Movement& getMovement(uint32_t age) const {
+        return mMovements[(mCount - 1 - age) % HISTORY_SIZE];
+    }
+
+    float chooseWeight(uint32_t age) const {
+        switch (mWeighting) {
+        case LeastSquaresVelocityTrackerStrategy::WEIGHTING_DELTA: {
+            if (age == 0) {
+                return 1.0f;
+            }
+            float deltaMillis = (getMovement(age - 1).eventTime - getMovement(age).eventTime)
+                    * 0.000001f;
+            if (deltaMillis < 0) {
+                return 0.5f;
+            }
+            if (deltaMillis < 10) {
+                return 0.5f + deltaMillis * 0.05;
+            }
+            return 1.0f;
+        }
+        case LeastSquaresVelocityTrackerStrategy::WEIGHTING_CENTRAL: {
+            float ageMillis = (getMovement(0).eventTime - getMovement(age).eventTime)
+                    * 0.000001f;
+            if (ageMillis < 0) {
+                return 0.5f;
+            }
+            if (ageMillis < 10) {
+                return 0.5f + ageMillis * 0.05;
+            }
+            if (ageMillis < 50) {
+                return 1.0f;
+            }
+            if (ageMillis < 60) {
+                return 0.5f + (60 - ageMillis) * 0.05;
+            }
+            return 0.5f;
+        }
+        case LeastSquaresVelocityTrackerStrategy::WEIGHTING_RECENT: {
+            float ageMillis = (getMovement(0).eventTime - getMovement(age).eventTime)
+                    * 0.000001f;
+            if (ageMillis < 50) {
+                return 1.0f;
+            }
+            if (ageMillis < 100) {
+                return 0.5f + (100 - ageMillis) * 0.01f;
+            }
+            return 0.5f;
+        }
+        default:
+            return 1.0f;
+        }
+    }
+
+    static T dot(const T* a, const T* b, uint32_t m) {
+        T r = 0;
+        for (uint32_t i = 0; i < m; i++) {
+            r += a[i] * b[i];
+        }
+        return r;
+    }
+
+    static bool solve(const float* x, const float* y, const float* w,
+            uint32_t m, uint32_t n, float* outB, float* outDet) {
+        T a[n][m];
+        for (uint32_t h = 0; h < m; h++) {
+            a[0][h] = w[h];
+            for (uint32_t i = 1; i < n; i++) {
+                a[i][h] = a[i - 1][h] * x[h];
+            }
+        }
+
+        T q[n][m];
+        T r[n][n];
+        for (uint32_t j = 0; j < n; j++) {
+            for (uint32_t h = 0; h < m; h++) {
+                q[j][h] = a[j][h];
+            }
+            for (uint32_t i = 0; i < j; i++) {
+                T d = dot(&q[j][0], &q[i][0], m);
+                for (uint32_t h = 0; h < m; h++) {
+                    q[j][h] -= d * q[i][h];
+                }
+            }
+            T norm = sqrt(dot(&q[j][0], &q[j][0], m));
+            if (norm < 0.000001f) {
+                return false;
+            }
+            T invNorm = T(1) / norm;
+            for (uint32_t h = 0; h < m; h++) {
+                q[j][h] *= invNorm;
+            }
+            for (uint32_t i = 0; i < n; i++) {
+                r[j][i] = i < j ? 0 : dot(&q[j][0], &a[i][0], m);
+            }
+        }
+
+        T wy[m];
+        T b[n];
+        for (uint32_t h = 0; h < m; h++) {
+            wy[h] = T(y[h]) * w[h];
+        }
+        for (uint32_t i = n; i != 0; ) {
+            i--;
+            b[i] = dot(&q[i][0], wy, m);
+            for (uint32_t j = n - 1; j > i; j--) {
+                b[i] -= r[i][j] * b[j];
+            }
+            b[i] /= r[i][i];
+            outB[i] = b[i];
+        }
+
+        T ymean = 0;
+        for (uint32_t h = 0; h < m; h++) {
+            ymean += y[h];
+        }
+        ymean /= m;
+        T sserr = 0;
+        T sstot = 0;
+        for (uint32_t h = 0; h < m; h++) {
+            T err = y[h] - b[0];
+            T term = 1;
+            for (uint32_t i = 1; i < n; i++) {
+                term *= x[h];
+                err -= term * b[i];
+            }
+            sserr += T(w[h]) * w[h] * err * err;
+            T var = y[h] - ymean;
+            sstot += T(w[h]) * w[h] * var * var;
+        }
+        *outDet = sstot > 0.000001f ? float(1 - (sserr / sstot)) : 1;
+        return true;
+    }
+};
+
+
+// --- Gesture ---
+
+// Generates the samples of a noisy fling: a pointer that accelerates, decelerates and
+// changes direction, sampled at an irregular rate with occasional duplicate
+// timestamps and pauses.
+class Gesture {
+public:
+    Gesture(unsigned int seed) : mSeed(seed), mTime(ms2ns(1000)), mX(300), mY(1200),
+            mVx(random(-2000, 2000)), mVy(random(-4000, 4000)) {
+    }
+
+    void next(nsecs_t* outTime, VelocityTracker::Position* outPosition) {
+        float r = random(0, 1);
+        nsecs_t delta;
+        if (r < 0.05f) {
+            delta = 0;
+        } else if (r < 0.08f) {
+            delta = ms2ns(random(40, 150));
+        } else {
+            delta = us2ns(random(4000, 17000));
+        }
+        mTime += delta;
+        float dt = delta * 0.000000001f;
+        mVx += random(-30000, 30000) * dt;
+        mVy += random(-30000, 30000) * dt;
+        mX += mVx * dt;
+        mY += mVy * dt;
+        *outTime = mTime;
+        outPosition->x = mX + random(-0.5f, 0.5f);
+        outPosition->y = mY + random(-0.5f, 0.5f);
+    }
+
+private:
+    unsigned int mSeed;
+    nsecs_t mTime;
+    float mX, mY;
+    float mVx, mVy;
+
+    float random(float min, float max) {
+        return min + (max - min) * (rand_r(&mSeed) / float(RAND_MAX));
+    }
+};
+
+
+// --- LeastSquaresVelocityTrackerStrategyTest ---
+
+static const Weighting WEIGHTINGS[] = {
+    LeastSquaresVelocityTrackerStrategy::WEIGHTING_NONE,
+    LeastSquaresVelocityTrackerStrategy::WEIGHTING_DELTA,
+    LeastSquaresVelocityTrackerStrategy::WEIGHTING_CENTRAL,
+    LeastSquaresVelocityTrackerStrategy::WEIGHTING_RECENT,
+};
+
+class LeastSquaresVelocityTrackerStrategyTest : public testing::Test {
+protected:
+    // Allows for rounding errors relative to the magnitude of the corresponding
+    // derivative of the motion.
+    static void assertEstimatorNear(const VelocityTracker::Estimator& expected,
+            const VelocityTracker::Estimator& actual, uint32_t maxCoeff, float tolerance) {
+        ASSERT_EQ(expected.time, actual.time);
+        ASSERT_EQ(expected.degree, actual.degree);
+        for (uint32_t k = 0; k <= actual.degree && k <= maxCoeff; k++) {
+            SCOPED_TRACE(k);
+            float magnitude = fmaxf(1.0f,
+                    fmaxf(fabsf(expected.xCoeff[k]), fabsf(expected.yCoeff[k])));
+            ASSERT_NEAR(expected.xCoeff[k], actual.xCoeff[k], tolerance * magnitude);
+            ASSERT_NEAR(expected.yCoeff[k], actual.yCoeff[k], tolerance * magnitude);
+        }
+        ASSERT_NEAR(expected.confidence, actual.confidence, tolerance);
+    }
+
+    // Compares the estimates of the strategy with the reference along random gestures,
+    // for all weightings and degrees up to maxDegree, up to the given coefficient.
+    template <typename T>
+    void testMatchesReference(uint32_t maxDegree, uint32_t maxCoeff, float tolerance);
+
+    static void addMovement(LeastSquaresVelocityTrackerStrategy& strategy,
+            nsecs_t eventTime, const VelocityTracker::Position& position) {
+        BitSet32 idBits;
+        idBits.markBit(POINTER_ID);
+        strategy.addMovement(eventTime, idBits, &position);
+    }
+};
+
+template <typename T>
+void LeastSquaresVelocityTrackerStrategyTest::testMatchesReference(uint32_t maxDegree,
+        uint32_t maxCoeff, float tolerance) {
+    for (uint32_t degree = 1; degree <= maxDegree; degree++) {
+        for (size_t i = 0; i < sizeof(WEIGHTINGS) / sizeof(WEIGHTINGS[0]); i++) {
+            for (unsigned int seed = 1; seed <= 20; seed++) {
+                SCOPED_TRACE(testing::Message() << "degree=" << degree
+                        << ", weighting=" << WEIGHTINGS[i] << ", seed=" << seed);
+                LeastSquaresVelocityTrackerStrategy strategy(degree, WEIGHTINGS[i]);
+                ReferenceLeastSquares<T> reference(degree, WEIGHTINGS[i]);
+                Gesture gesture(seed);
+
+                for (int sample = 0; sample < 60; sample++) {
+                    nsecs_t eventTime;
+                    VelocityTracker::Position position;
+                    gesture.next(&eventTime, &position);
+                    addMovement(strategy, eventTime, position);
+                    reference.addMovement(eventTime, position);
+
+                    VelocityTracker::Estimator expected, actual;
+                    ASSERT_TRUE(reference.getEstimator(&expected));
+                    ASSERT_TRUE(strategy.getEstimator(POINTER_ID, &actual));
+                    ASSERT_NO_FATAL_FAILURE(assertEstimatorNear(expected, actual,
+                            maxCoeff, tolerance));
+                }
+            }
+        }
+    }
+}
+
+TEST_F(LeastSquaresVelocityTrackerStrategyTest, GetEstimator_MatchesReferenceSolution) {
+    // Both solve the same problem, only the rounding errors differ.
+    testMatchesReference<double>(3, VelocityTracker::Estimator::MAX_DEGREE, 0.00001f);
+}
+
+TEST_F(LeastSquaresVelocityTrackerStrategyTest, GetEstimator_MatchesPreviousVelocities) {
+    // The higher order coefficients are poorly determined by a few milliseconds of
+    // samples, the previous implementation only got a couple of digits of them right,
+    // and none of them for the cubic fit.
+    testMatchesReference<float>(2, 1, 0.002f);
+}
+
+TEST_F(LeastSquaresVelocityTrackerStrategyTest, GetEstimator_FitsLinearMotionExactly) {
+    LeastSquaresVelocityTrackerStrategy strategy(2);
+    for (int i = 0; i < 10; i++) {
+        VelocityTracker::Position position;
+        position.x = 100 + 8 * i;
+        position.y = 500 - 20 * i;
+        addMovement(strategy, ms2ns(1000 + 8 * i), position);
+    }
+
+    VelocityTracker::Estimator estimator;
+    ASSERT_TRUE(strategy.getEstimator(POINTER_ID, &estimator));
+    ASSERT_EQ(2U, estimator.degree);
+    EXPECT_NEAR(172, estimator.xCoeff[0], 0.01f);
+    EXPECT_NEAR(1000, estimator.xCoeff[1], 0.1f);
+    EXPECT_NEAR(320, estimator.yCoeff[0], 0.01f);
+    EXPECT_NEAR(-2500, estimator.yCoeff[1], 0.1f);
+    EXPECT_NEAR(1, estimator.confidence, 0.0001f);
+}
+
+TEST_F(LeastSquaresVelocityTrackerStrategyTest, GetEstimator_WhenSamplesAtSameTime_ReturnsPosition) {
+    LeastSquaresVelocityTrackerStrategy strategy(2);
+    VelocityTracker::Position position;
+    position.x = 10;
+    position.y = 20;
+    addMovement(strategy, ms2ns(1000), position);
+    position.x = 15;
+    position.y = 25;
+    addMovement(strategy, ms2ns(1000), position);
+
+    VelocityTracker::Estimator estimator;
+    ASSERT_TRUE(strategy.getEstimator(POINTER_ID, &estimator));
+    EXPECT_EQ(0U, estimator.degree);
+    EXPECT_EQ(15, estimator.xCoeff[0]);
+    EXPECT_EQ(25, estimator.yCoeff[0]);
+}
+
+// Compares the cost of an estimate with the reference.  Not a pass/fail test,
+// the numbers are printed for comparison on the device.
+TEST_F(LeastSquaresVelocityTrackerStrategyTest, Benchmark_GetEstimator) {
+    const int kIterations = 20000;
+
+    for (uint32_t degree = 1; degree <= 3; degree++) {
+        LeastSquaresVelocityTrackerStrategy strategy(degree);
+        ReferenceLeastSquares<float> reference(degree,
+                LeastSquaresVelocityTrackerStrategy::WEIGHTING_NONE);
+        Gesture gesture(degree);
+        for (uint32_t i = 0; i < HISTORY_SIZE; i++) {
+            nsecs_t eventTime;
+            VelocityTracker::Position position;
+            gesture.next(&eventTime, &position);
+            // Evenly spaced so that the whole history is within the horizon.
+            eventTime = ms2ns(1000) + i * ms2ns(4);
+            addMovement(strategy, eventTime, position);
+            reference.addMovement(eventTime, position);
+        }
+
+        VelocityTracker::Estimator estimator;
+        float sink = 0;
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < kIterations; i++) {
+            reference.getEstimator(&estimator);
+            sink += estimator.xCoeff[1];
+        }
+        nsecs_t referenceTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < kIterations; i++) {
+            strategy.getEstimator(POINTER_ID, &estimator);
+            sink += estimator.xCoeff[1];
+        }
+        nsecs_t strategyTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        printf("lsq%u, %u samples: reference %.3f us, normal equations %.3f us (%f)\n",
+                degree, HISTORY_SIZE, referenceTime / 1000.0 / kIterations,
+                strategyTime / 1000.0 / kIterations, sink);
+    }
+}
+
+} // namespace android
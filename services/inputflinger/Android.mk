@@ -19,10 +19,12 @@ LOCAL_SRC_FILES:= \
     EventHub.cpp \
     InputApplication.cpp \
     InputDispatcher.cpp \
+    InputLatencyTracker.cpp \
     InputListener.cpp \
     InputManager.cpp \
     InputReader.cpp \
-    InputWindow.cpp
+    InputWindow.cpp \
+    InputWindowSpatialIndex.cpp
 
 LOCAL_SHARED_LIBRARIES := \
     libbinder \
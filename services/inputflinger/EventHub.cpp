@@ -48,6 +48,7 @@
 
 #include <input/KeyLayoutMap.h>
 #include <input/KeyCharacterMap.h>
+#include <input/KeyMapCache.h>
 #include <input/VirtualKeyMap.h>
 
 /* this macro is used to tell if "bit" is set in "array"
@@ -68,6 +69,10 @@ namespace android {
 
 static const char *WAKE_LOCK_ID = "KeyEvents";
 static const char *DEVICE_PATH = "/dev/input";
+// Directory of the compiled key layout and key character maps.
+static const char *KEY_MAP_CACHE_PATH = "/data/system/keymapcache";
+// Set to 1 to register input devices with epoll in edge triggered mode.
+static const char *EDGE_TRIGGERED_EPOLL_PROPERTY = "ro.input.edge_triggered_epoll";
 
 /* return the larger integer */
 static inline int max(int v1, int v2)
@@ -150,7 +155,9 @@ EventHub::Device::Device(int fd, int32_t id, const String8& path,
         fd(fd), id(id), path(path), identifier(identifier),
         classes(0), configuration(NULL), virtualKeyMap(NULL),
         ffEffectPlaying(false), ffEffectId(-1), controllerNumber(0),
-        timestampOverrideSec(0), timestampOverrideUsec(0) {
+        timestampOverrideSec(0), timestampOverrideUsec(0),
+        averageReadSize(0), readBudget(EventHub::MIN_READ_BUDGET),
+        readCount(0), readEventCount(0) {
     memset(keyBitmask, 0, sizeof(keyBitmask));
     memset(absBitmask, 0, sizeof(absBitmask));
     memset(relBitmask, 0, sizeof(relBitmask));
@@ -186,9 +193,12 @@ EventHub::EventHub(void) :
         mOpeningDevices(0), mClosingDevices(0),
         mNeedToSendFinishedDeviceScan(false),
         mNeedToReopenDevices(false), mNeedToScanDevices(true),
-        mPendingEventCount(0), mPendingEventIndex(0), mPendingINotify(false) {
+        mPendingEventCount(0), mPendingEventIndex(0), mPendingINotify(false),
+        mWakeupCount(0), mReadCount(0), mReadEventCount(0), mReadBudgetExceededCount(0) {
     acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_ID);
 
+    KeyMapCache::setDirectory(String8(KEY_MAP_CACHE_PATH));
+
     mEpollFd = epoll_create(EPOLL_SIZE_HINT);
     LOG_ALWAYS_FATAL_IF(mEpollFd < 0, "Could not create epoll instance.  errno=%d", errno);
 
@@ -228,6 +238,10 @@ EventHub::EventHub(void) :
     getLinuxRelease(&major, &minor);
     // EPOLLWAKEUP was introduced in kernel 3.5
     mUsingEpollWakeup = major > 3 || (major == 3 && minor >= 5);
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get(EDGE_TRIGGERED_EPOLL_PROPERTY, value, "0");
+    mUsingEdgeTriggeredEpoll = atoi(value) != 0;
 }
 
 EventHub::~EventHub(void) {
@@ -728,6 +742,7 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
     RawEvent* event = buffer;
     size_t capacity = bufferSize;
     bool awoken = false;
+    bool polledReadPendingDevices = false;
     for (;;) {
         nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
 
@@ -749,6 +764,7 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
                  device->id, device->path.string());
             mClosingDevices = device->next;
             event->when = now;
+            event->readTime = now;
             event->deviceId = device->id == mBuiltInKeyboardId ? BUILT_IN_KEYBOARD_ID : device->id;
             event->type = DEVICE_REMOVED;
             event += 1;
@@ -771,6 +787,7 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
                  device->id, device->path.string());
             mOpeningDevices = device->next;
             event->when = now;
+            event->readTime = now;
             event->deviceId = device->id == mBuiltInKeyboardId ? 0 : device->id;
             event->type = DEVICE_ADDED;
             event += 1;
@@ -783,6 +800,7 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
         if (mNeedToSendFinishedDeviceScan) {
             mNeedToSendFinishedDeviceScan = false;
             event->when = now;
+            event->readTime = now;
             event->type = FINISHED_DEVICE_SCAN;
             event += 1;
             if (--capacity == 0) {
@@ -790,6 +808,20 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
             }
         }
 
+        // Before reading devices that had more events than their read budget allowed
+        // again, check without blocking whether other devices have become ready meanwhile
+        // so that they are not starved by a device that keeps producing events.
+        if (mPendingEventIndex >= mPendingEventCount && !mReadPendingDeviceIds.isEmpty()
+                && !polledReadPendingDevices) {
+            polledReadPendingDevices = true;
+            int pollResult = epoll_wait(mEpollFd, mPendingEventItems, EPOLL_MAX_EVENTS, 0);
+            mPendingEventIndex = 0;
+            mPendingEventCount = pollResult > 0 ? size_t(pollResult) : 0;
+            if (pollResult > 0) {
+                mWakeupCount += 1;
+            }
+        }
+
         // Grab the next input event.
         bool deviceChanged = false;
         while (mPendingEventIndex < mPendingEventCount) {
@@ -828,120 +860,14 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
 
             Device* device = mDevices.valueAt(deviceIndex);
             if (eventItem.events & EPOLLIN) {
-                int32_t readSize = read(device->fd, readBuffer,
-                        sizeof(struct input_event) * capacity);
-                if (readSize == 0 || (readSize < 0 && errno == ENODEV)) {
-                    // Device was removed before INotify noticed.
-                    ALOGW("could not get event, removed? (fd: %d size: %" PRId32
-                            " bufferSize: %zu capacity: %zu errno: %d)\n",
-                            device->fd, readSize, bufferSize, capacity, errno);
-                    deviceChanged = true;
-                    closeDeviceLocked(device);
-                } else if (readSize < 0) {
-                    if (errno != EAGAIN && errno != EINTR) {
-                        ALOGW("could not get event (errno=%d)", errno);
-                    }
-                } else if ((readSize % sizeof(struct input_event)) != 0) {
-                    ALOGE("could not get event (wrong size: %d)", readSize);
-                } else {
-                    int32_t deviceId = device->id == mBuiltInKeyboardId ? 0 : device->id;
-
-                    size_t count = size_t(readSize) / sizeof(struct input_event);
-                    for (size_t i = 0; i < count; i++) {
-                        struct input_event& iev = readBuffer[i];
-                        ALOGV("%s got: time=%d.%06d, type=%d, code=%d, value=%d",
-                                device->path.string(),
-                                (int) iev.time.tv_sec, (int) iev.time.tv_usec,
-                                iev.type, iev.code, iev.value);
-
-                        // Some input devices may have a better concept of the time
-                        // when an input event was actually generated than the kernel
-                        // which simply timestamps all events on entry to evdev.
-                        // This is a custom Android extension of the input protocol
-                        // mainly intended for use with uinput based device drivers.
-                        if (iev.type == EV_MSC) {
-                            if (iev.code == MSC_ANDROID_TIME_SEC) {
-                                device->timestampOverrideSec = iev.value;
-                                continue;
-                            } else if (iev.code == MSC_ANDROID_TIME_USEC) {
-                                device->timestampOverrideUsec = iev.value;
-                                continue;
-                            }
-                        }
-                        if (device->timestampOverrideSec || device->timestampOverrideUsec) {
-                            iev.time.tv_sec = device->timestampOverrideSec;
-                            iev.time.tv_usec = device->timestampOverrideUsec;
-                            if (iev.type == EV_SYN && iev.code == SYN_REPORT) {
-                                device->timestampOverrideSec = 0;
-                                device->timestampOverrideUsec = 0;
-                            }
-                            ALOGV("applied override time %d.%06d",
-                                    int(iev.time.tv_sec), int(iev.time.tv_usec));
-                        }
-
-                        // Use the time specified in the event instead of the current time
-                        // so that downstream code can get more accurate estimates of
-                        // event dispatch latency from the time the event is enqueued onto
-                        // the evdev client buffer.
-                        //
-                        // The event's timestamp fortuitously uses the same monotonic clock
-                        // time base as the rest of Android.  The kernel event device driver
-                        // (drivers/input/evdev.c) obtains timestamps using ktime_get_ts().
-                        // The systemTime(SYSTEM_TIME_MONOTONIC) function we use everywhere
-                        // calls clock_gettime(CLOCK_MONOTONIC) which is implemented as a
-                        // system call that also queries ktime_get_ts().
-                        event->when = nsecs_t(iev.time.tv_sec) * 1000000000LL
-                                + nsecs_t(iev.time.tv_usec) * 1000LL;
-                        ALOGV("event time %" PRId64 ", now %" PRId64, event->when, now);
-
-                        // Bug 7291243: Add a guard in case the kernel generates timestamps
-                        // that appear to be far into the future because they were generated
-                        // using the wrong clock source.
-                        //
-                        // This can happen because when the input device is initially opened
-                        // it has a default clock source of CLOCK_REALTIME.  Any input events
-                        // enqueued right after the device is opened will have timestamps
-                        // generated using CLOCK_REALTIME.  We later set the clock source
-                        // to CLOCK_MONOTONIC but it is already too late.
-                        //
-                        // Invalid input event timestamps can result in ANRs, crashes and
-                        // and other issues that are hard to track down.  We must not let them
-                        // propagate through the system.
-                        //
-                        // Log a warning so that we notice the problem and recover gracefully.
-                        if (event->when >= now + 10 * 1000000000LL) {
-                            // Double-check.  Time may have moved on.
-                            nsecs_t time = systemTime(SYSTEM_TIME_MONOTONIC);
-                            if (event->when > time) {
-                                ALOGW("An input event from %s has a timestamp that appears to "
-                                        "have been generated using the wrong clock source "
-                                        "(expected CLOCK_MONOTONIC): "
-                                        "event time %" PRId64 ", current time %" PRId64
-                                        ", call time %" PRId64 ".  "
-                                        "Using current time instead.",
-                                        device->path.string(), event->when, time, now);
-                                event->when = time;
-                            } else {
-                                ALOGV("Event time is ok but failed the fast path and required "
-                                        "an extra call to systemTime: "
-                                        "event time %" PRId64 ", current time %" PRId64
-                                        ", call time %" PRId64 ".",
-                                        event->when, time, now);
-                            }
-                        }
-                        event->deviceId = deviceId;
-                        event->type = iev.type;
-                        event->code = iev.code;
-                        event->value = iev.value;
-                        event += 1;
-                        capacity -= 1;
-                    }
-                    if (capacity == 0) {
-                        // The result buffer is full.  Reset the pending event index
-                        // so we will try to read the device again on the next iteration.
-                        mPendingEventIndex -= 1;
-                        break;
-                    }
+                size_t count = readDeviceLocked(device, readBuffer,
+                        getReadBudgetLocked(device, capacity), event, now, &deviceChanged);
+                event += count;
+                capacity -= count;
+                if (capacity == 0) {
+                    // The result buffer is full.  Devices that still have events are
+                    // in the read pending list and will be read again on the next call.
+                    break;
                 }
             } else if (eventItem.events & EPOLLHUP) {
                 ALOGI("Removing device %s due to epoll hang-up event.",
@@ -954,6 +880,28 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
             }
         }
 
+        // Share what is left of the buffer among the devices that were not drained.
+        if (mPendingEventIndex >= mPendingEventCount && capacity
+                && !mReadPendingDeviceIds.isEmpty()) {
+            Vector<int32_t> deviceIds(mReadPendingDeviceIds);
+            mReadPendingDeviceIds.clear();
+            for (size_t i = 0; i < deviceIds.size(); i++) {
+                ssize_t deviceIndex = mDevices.indexOfKey(deviceIds[i]);
+                if (deviceIndex < 0) {
+                    continue;
+                }
+                if (capacity == 0) {
+                    mReadPendingDeviceIds.push(deviceIds[i]);
+                    continue;
+                }
+                size_t budget = capacity / (deviceIds.size() - i);
+                size_t count = readDeviceLocked(mDevices.valueAt(deviceIndex), readBuffer,
+                        budget ? budget : 1, event, now, &deviceChanged);
+                event += count;
+                capacity -= count;
+            }
+        }
+
         // readNotify() will modify the list of devices so this must be done after
         // processing all other events to ensure that we read all remaining events
         // before closing the devices.
@@ -1013,6 +961,7 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
         } else {
             // Some events occurred.
             mPendingEventCount = size_t(pollResult);
+            mWakeupCount += 1;
         }
     }
 
@@ -1020,6 +969,195 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
     return event - buffer;
 }
 
+size_t EventHub::getReadBudgetLocked(const Device* device, size_t capacity) const {
+    size_t otherDeviceCount = 0;
+    for (size_t i = mPendingEventIndex; i < mPendingEventCount; i++) {
+        uint32_t id = mPendingEventItems[i].data.u32;
+        if (id != EPOLL_ID_INOTIFY && id != EPOLL_ID_WAKE && int32_t(id) != device->id) {
+            otherDeviceCount += 1;
+        }
+    }
+    for (size_t i = 0; i < mReadPendingDeviceIds.size(); i++) {
+        if (mReadPendingDeviceIds[i] != device->id) {
+            otherDeviceCount += 1;
+        }
+    }
+
+    // A device that is the only one ready may fill the whole buffer.  Otherwise it gets
+    // its fair share, or more if it usually has more events pending than that.
+    if (otherDeviceCount == 0) {
+        return capacity;
+    }
+    size_t budget = capacity / (otherDeviceCount + 1);
+    if (budget < device->readBudget) {
+        budget = device->readBudget;
+    }
+    return budget < capacity ? budget : capacity;
+}
+
+size_t EventHub::readDeviceLocked(Device* device, struct input_event* readBuffer, size_t budget,
+        RawEvent* buffer, nsecs_t now, bool* outDeviceChanged) {
+    int32_t deviceId = device->id == mBuiltInKeyboardId ? 0 : device->id;
+    RawEvent* event = buffer;
+
+    // Keep reading until the device runs dry or the budget is used up, a read that
+    // returns fewer events than requested means there are no more events for now.
+    size_t readEventCount = 0;
+    bool drained = false;
+    while (readEventCount < budget) {
+        size_t requestedCount = budget - readEventCount;
+        ssize_t readSize = read(device->fd, readBuffer,
+                sizeof(struct input_event) * requestedCount);
+        mReadCount += 1;
+        device->readCount += 1;
+        if (readSize == 0 || (readSize < 0 && errno == ENODEV)) {
+            // Device was removed before INotify noticed.
+            ALOGW("could not get event, removed? (fd: %d size: %zd"
+                    " budget: %zu errno: %d)\n",
+                    device->fd, readSize, budget, errno);
+            *outDeviceChanged = true;
+            closeDeviceLocked(device);
+            return event - buffer;
+        }
+        if (readSize < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                ALOGW("could not get event (errno=%d)", errno);
+            }
+            drained = true;
+            break;
+        }
+        if ((readSize % sizeof(struct input_event)) != 0) {
+            ALOGE("could not get event (wrong size: %zd)", readSize);
+            drained = true;
+            break;
+        }
+
+        nsecs_t readTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        size_t count = size_t(readSize) / sizeof(struct input_event);
+        for (size_t i = 0; i < count; i++) {
+            struct input_event& iev = readBuffer[i];
+            ALOGV("%s got: time=%d.%06d, type=%d, code=%d, value=%d",
+                    device->path.string(),
+                    (int) iev.time.tv_sec, (int) iev.time.tv_usec,
+                    iev.type, iev.code, iev.value);
+
+            // Some input devices may have a better concept of the time
+            // when an input event was actually generated than the kernel
+            // which simply timestamps all events on entry to evdev.
+            // This is a custom Android extension of the input protocol
+            // mainly intended for use with uinput based device drivers.
+            if (iev.type == EV_MSC) {
+                if (iev.code == MSC_ANDROID_TIME_SEC) {
+                    device->timestampOverrideSec = iev.value;
+                    continue;
+                } else if (iev.code == MSC_ANDROID_TIME_USEC) {
+                    device->timestampOverrideUsec = iev.value;
+                    continue;
+                }
+            }
+            if (device->timestampOverrideSec || device->timestampOverrideUsec) {
+                iev.time.tv_sec = device->timestampOverrideSec;
+                iev.time.tv_usec = device->timestampOverrideUsec;
+                if (iev.type == EV_SYN && iev.code == SYN_REPORT) {
+                    device->timestampOverrideSec = 0;
+                    device->timestampOverrideUsec = 0;
+                }
+                ALOGV("applied override time %d.%06d",
+                        int(iev.time.tv_sec), int(iev.time.tv_usec));
+            }
+
+            // Use the time specified in the event instead of the current time
+            // so that downstream code can get more accurate estimates of
+            // event dispatch latency from the time the event is enqueued onto
+            // the evdev client buffer.
+            //
+            // The event's timestamp fortuitously uses the same monotonic clock
+            // time base as the rest of Android.  The kernel event device driver
+            // (drivers/input/evdev.c) obtains timestamps using ktime_get_ts().
+            // The systemTime(SYSTEM_TIME_MONOTONIC) function we use everywhere
+            // calls clock_gettime(CLOCK_MONOTONIC) which is implemented as a
+            // system call that also queries ktime_get_ts().
+            event->when = nsecs_t(iev.time.tv_sec) * 1000000000LL
+                    + nsecs_t(iev.time.tv_usec) * 1000LL;
+            ALOGV("event time %" PRId64 ", now %" PRId64, event->when, now);
+
+            // Bug 7291243: Add a guard in case the kernel generates timestamps
+            // that appear to be far into the future because they were generated
+            // using the wrong clock source.
+            //
+            // This can happen because when the input device is initially opened
+            // it has a default clock source of CLOCK_REALTIME.  Any input events
+            // enqueued right after the device is opened will have timestamps
+            // generated using CLOCK_REALTIME.  We later set the clock source
+            // to CLOCK_MONOTONIC but it is already too late.
+            //
+            // Invalid input event timestamps can result in ANRs, crashes and
+            // and other issues that are hard to track down.  We must not let them
+            // propagate through the system.
+            //
+            // Log a warning so that we notice the problem and recover gracefully.
+            if (event->when >= now + 10 * 1000000000LL) {
+                // Double-check.  Time may have moved on.
+                nsecs_t time = systemTime(SYSTEM_TIME_MONOTONIC);
+                if (event->when > time) {
+                    ALOGW("An input event from %s has a timestamp that appears to "
+                            "have been generated using the wrong clock source "
+                            "(expected CLOCK_MONOTONIC): "
+                            "event time %" PRId64 ", current time %" PRId64
+                            ", call time %" PRId64 ".  "
+                            "Using current time instead.",
+                            device->path.string(), event->when, time, now);
+                    event->when = time;
+                } else {
+                    ALOGV("Event time is ok but failed the fast path and required "
+                            "an extra call to systemTime: "
+                            "event time %" PRId64 ", current time %" PRId64
+                            ", call time %" PRId64 ".",
+                            event->when, time, now);
+                }
+            }
+            event->readTime = readTime;
+            event->deviceId = deviceId;
+            event->type = iev.type;
+            event->code = iev.code;
+            event->value = iev.value;
+            event += 1;
+        }
+        readEventCount += count;
+        if (count < requestedCount) {
+            drained = true;
+            break;
+        }
+    }
+    mReadEventCount += readEventCount;
+    device->readEventCount += readEventCount;
+
+    // Let the device read twice as many events as it usually has pending whenever it
+    // shares the buffer with other devices, so a typical burst is read in one go.
+    if (readEventCount) {
+        device->averageReadSize += (float(readEventCount) - device->averageReadSize) * 0.25f;
+        size_t readBudget = size_t(device->averageReadSize * 2);
+        device->readBudget = readBudget < MIN_READ_BUDGET ? MIN_READ_BUDGET
+                : readBudget > MAX_READ_BUDGET ? MAX_READ_BUDGET : readBudget;
+    }
+
+    ssize_t pendingIndex = mReadPendingDeviceIds.indexOf(device->id);
+    if (drained) {
+        if (pendingIndex >= 0) {
+            mReadPendingDeviceIds.removeAt(pendingIndex);
+        }
+    } else {
+        mReadBudgetExceededCount += 1;
+        if (pendingIndex < 0) {
+            mReadPendingDeviceIds.push(device->id);
+        }
+    }
+    return event - buffer;
+}
+
 void EventHub::wake() {
     ALOGV("wake() called");
 
@@ -1342,6 +1480,9 @@ status_t EventHub::openDeviceLocked(const char *devicePath) {
     if (mUsingEpollWakeup) {
         eventItem.events |= EPOLLWAKEUP;
     }
+    if (mUsingEdgeTriggeredEpoll) {
+        eventItem.events |= EPOLLET;
+    }
     eventItem.data.u32 = deviceId;
     if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &eventItem)) {
         ALOGE("Could not add device fd to epoll instance.  errno=%d", errno);
@@ -1564,6 +1705,11 @@ void EventHub::closeDeviceLocked(Device* device) {
 
     releaseControllerNumberLocked(device);
 
+    ssize_t pendingIndex = mReadPendingDeviceIds.indexOf(device->id);
+    if (pendingIndex >= 0) {
+        mReadPendingDeviceIds.removeAt(pendingIndex);
+    }
+
     mDevices.removeItem(device->id);
     device->close();
 
@@ -1677,6 +1823,15 @@ void EventHub::dump(String8& dump) {
         AutoMutex _l(mLock);
 
         dump.appendFormat(INDENT "BuiltInKeyboardId: %d\n", mBuiltInKeyboardId);
+        dump.appendFormat(INDENT "KeyMapCache: %s\n", KeyMapCache::getDirectory().string());
+        dump.appendFormat(INDENT "EdgeTriggeredEpoll: %s\n", toString(mUsingEdgeTriggeredEpoll));
+        dump.appendFormat(INDENT "Reads: wakeups=%" PRIu64 ", reads=%" PRIu64
+                " (%0.2f per wakeup), events=%" PRIu64 " (%0.2f per read), "
+                "budgetExceeded=%" PRIu64 "\n",
+                mWakeupCount, mReadCount,
+                mWakeupCount ? float(mReadCount) / mWakeupCount : 0.0f,
+                mReadEventCount, mReadCount ? float(mReadEventCount) / mReadCount : 0.0f,
+                mReadBudgetExceededCount);
 
         dump.append(INDENT "Devices:\n");
 
@@ -1707,6 +1862,10 @@ void EventHub::dump(String8& dump) {
                     device->configurationFile.string());
             dump.appendFormat(INDENT3 "HaveKeyboardLayoutOverlay: %s\n",
                     toString(device->overlayKeyMap != NULL));
+            dump.appendFormat(INDENT3 "Reads: %" PRIu64 ", Events: %" PRIu64
+                    ", AverageReadSize: %0.1f, ReadBudget: %zu\n",
+                    device->readCount, device->readEventCount,
+                    device->averageReadSize, device->readBudget);
         }
     } // release lock
 }
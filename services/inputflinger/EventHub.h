@@ -71,6 +71,7 @@ enum {
  */
 struct RawEvent {
     nsecs_t when;
+    nsecs_t readTime; // when the event was read from the device
     int32_t deviceId;
     int32_t type;
     int32_t code;
@@ -366,6 +367,15 @@ private:
         int32_t timestampOverrideSec;
         int32_t timestampOverrideUsec;
 
+        // Smoothed number of events read each time the device was ready, and the number
+        // of events it may read at once while other devices are waiting to be read.
+        float averageReadSize;
+        size_t readBudget;
+
+        // Read statistics.
+        uint64_t readCount;
+        uint64_t readEventCount;
+
         Device(int fd, int32_t id, const String8& path, const InputDeviceIdentifier& identifier);
         ~Device();
 
@@ -414,6 +424,10 @@ private:
     status_t mapLed(Device* device, int32_t led, int32_t* outScanCode) const;
     void setLedStateLocked(Device* device, int32_t led, bool on);
 
+    size_t getReadBudgetLocked(const Device* device, size_t capacity) const;
+    size_t readDeviceLocked(Device* device, struct input_event* readBuffer, size_t budget,
+            RawEvent* buffer, nsecs_t now, bool* outDeviceChanged);
+
     // Protect all internal state.
     mutable Mutex mLock;
 
@@ -461,7 +475,26 @@ private:
     size_t mPendingEventIndex;
     bool mPendingINotify;
 
+    // Bounds of the number of events a device may read at once while other devices
+    // are waiting to be read.
+    static const size_t MIN_READ_BUDGET = 16;
+    static const size_t MAX_READ_BUDGET = 256;
+
+    // Ids of the devices that had more events than their read budget allowed.  They are
+    // read again once all other ready devices have been read.
+    Vector<int32_t> mReadPendingDeviceIds;
+
     bool mUsingEpollWakeup;
+
+    // Devices are registered edge triggered so each wakeup reports only newly arrived
+    // events, the read pending list keeps track of devices that were not drained.
+    bool mUsingEdgeTriggeredEpoll;
+
+    // Read statistics.
+    uint64_t mWakeupCount;
+    uint64_t mReadCount;
+    uint64_t mReadEventCount;
+    uint64_t mReadBudgetExceededCount;
 };
 
 }; // namespace android
@@ -45,6 +45,7 @@
 
 #include "InputDispatcher.h"
 
+#include <utils/SortedVector.h>
 #include <utils/Trace.h>
 #include <cutils/log.h>
 #include <powermanager/PowerManager.h>
@@ -210,6 +211,10 @@ InputDispatcher::InputDispatcher(const sp<InputDispatcherPolicyInterface>& polic
     mAppSwitchSawKeyDown(false), mAppSwitchDueTime(LONG_LONG_MAX),
     mNextUnblockedEvent(NULL),
     mDispatchEnabled(false), mDispatchFrozen(false), mInputFilterEnabled(false),
+    mHavePendingWindowHandles(false),
+    mWindowUpdatesApplied(0), mWindowUpdatesSkipped(0),
+    mWindowUpdatesDeferred(0), mWindowUpdatesCoalesced(0),
+    mWindowUpdateLockTime(0), mWindowUpdateMaxLockTime(0),
     mInputTargetWaitCause(INPUT_TARGET_WAIT_CAUSE_NONE) {
     sp<IBinder> dtoken(SurfaceComposerClient::getBuiltInDisplay(ISurfaceComposer::eDisplayIdMain));
     status_t status = SurfaceComposerClient::getDisplayInfo(dtoken, &dinfo);
@@ -240,6 +245,9 @@ void InputDispatcher::dispatchOnce() {
         AutoMutex _l(mLock);
         mDispatcherIsAliveCondition.broadcast();
 
+        // Apply the window updates that were deferred while we were busy.
+        applyPendingWindowHandlesLocked();
+
         // Run a dispatch loop if there are no pending commands.
         // The dispatch loop might enqueue commands to run afterwards.
         if (!haveCommandsLocked()) {
@@ -315,6 +323,9 @@ void InputDispatcher::dispatchOnceInnerLocked(nsecs_t* nextWakeupTime) {
             // Inbound queue has at least one entry.
             mPendingEvent = mInboundQueue.dequeueAtHead();
             traceInboundQueueLengthLocked();
+            if (mPendingEvent->latencyTrace.isSampled()) {
+                mPendingEvent->latencyTrace.dispatchTime = currentTime;
+            }
         }
 
         // Poke user activity for this event.
@@ -483,9 +494,10 @@ void InputDispatcher::addRecentEventLocked(EventEntry* entry) {
 sp<InputWindowHandle> InputDispatcher::findTouchedWindowAtLocked(int32_t displayId,
         int32_t x, int32_t y) {
     // Traverse windows from front to back to find touched window.
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
+    Vector<size_t> candidates;
+    mWindowIndex.findCandidatesAt(displayId, x, y, candidates);
+    for (size_t i = 0; i < candidates.size(); i++) {
+        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(candidates.itemAt(i));
         const InputWindowInfo* windowInfo = windowHandle->getInfo();
         if (windowHandle->getName().find("SingleMode_windowbg") != -1) {
             bool leftSingleHandScreen = (windowHandle->getName().find("left") != -1);
@@ -1191,7 +1203,7 @@ int32_t InputDispatcher::findTouchedWindowTargetsLocked(nsecs_t currentTime,
             || maskedAction == AMOTION_EVENT_ACTION_SCROLL
             || isHoverAction);
     bool wrongDevice = false;
-    size_t numWindows = mWindowHandles.size();
+    size_t numSingleHandWindows = mSingleHandWindowIndices.size();
     bool hasVirtualDevice = false;
     bool isOriginCoordinate = true;
     int32_t pointerIndex = getMotionEventActionPointerIndex(action);
@@ -1219,20 +1231,18 @@ int32_t InputDispatcher::findTouchedWindowTargetsLocked(nsecs_t currentTime,
         isSplit = false;
     }
 
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
+    for (size_t i = 0; i < numSingleHandWindows; i++) {
+        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(mSingleHandWindowIndices[i]);
         const InputWindowInfo* windowInfo = windowHandle->getInfo();
-        int32_t flags = windowInfo->layoutParamsFlags;
         if (windowInfo->visible && windowHandle->getName().find("SingleMode_windowbg_hint") != -1) {
             hint = true;
             break;
         }
     }
-    for (size_t i = 0; (!hint && i < numWindows); i++) {
-        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
+    for (size_t i = 0; (!hint && i < numSingleHandWindows); i++) {
+        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(mSingleHandWindowIndices[i]);
         const InputWindowInfo* windowInfo = windowHandle->getInfo();
-        int32_t flags = windowInfo->layoutParamsFlags;
-        if (windowInfo->visible && windowHandle->getName().find("SingleMode_windowbg") != -1) {
+        if (windowInfo->visible) {
             hasVirtualDevice = true;
             bool leftSingleHandScreen = (windowHandle->getName().find("left") != -1);
             if (singlehandRegionContainsPointLocked(xx, yy, leftSingleHandScreen)) {
@@ -1264,9 +1274,12 @@ int32_t InputDispatcher::findTouchedWindowTargetsLocked(nsecs_t currentTime,
         bool isTouchModal = false;
 
         // Traverse windows from front to back to find touched window and outside targets.
-        //size_t numWindows = mWindowHandles.size();
-        for (size_t i = 0; i < numWindows; i++) {
-            sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
+        // The index only leaves out windows that can neither be touched at this point
+        // nor watch outside touches.
+        Vector<size_t> candidates;
+        mWindowIndex.findCandidatesAt(displayId, x, y, candidates);
+        for (size_t i = 0; i < candidates.size(); i++) {
+            sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(candidates.itemAt(i));
             const InputWindowInfo* windowInfo = windowHandle->getInfo();
             if (windowInfo->displayId != displayId) {
                 continue; // wrong display
@@ -1688,14 +1701,15 @@ bool InputDispatcher::checkInjectionPermission(const sp<InputWindowHandle>& wind
 bool InputDispatcher::isWindowObscuredAtPointLocked(
         const sp<InputWindowHandle>& windowHandle, int32_t x, int32_t y) const {
     int32_t displayId = windowHandle->getInfo()->displayId;
-    const InputWindowInfo* windowInfo = windowHandle->getInfo();
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(i);
-        if (otherHandle == windowHandle) {
+    ssize_t windowIndex = mWindowIndex.indexOf(windowHandle);
+    Vector<size_t> candidates;
+    mWindowIndex.findCandidatesAt(displayId, x, y, candidates);
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (windowIndex >= 0 && candidates.itemAt(i) >= size_t(windowIndex)) {
             break;
         }
 
+        sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(candidates.itemAt(i));
         const InputWindowInfo* otherInfo = otherHandle->getInfo();
         if (otherHandle->getName().find("SingleMode_windowbg") != -1) {
             bool leftSingleHandScreen = (otherHandle->getName().find("left") != -1);
@@ -1722,13 +1736,16 @@ bool InputDispatcher::isWindowObscuredAtPointLocked(
 bool InputDispatcher::isWindowObscuredLocked(const sp<InputWindowHandle>& windowHandle) const {
     int32_t displayId = windowHandle->getInfo()->displayId;
     const InputWindowInfo* windowInfo = windowHandle->getInfo();
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(i);
-        if (otherHandle == windowHandle) {
+    ssize_t windowIndex = mWindowIndex.indexOf(windowHandle);
+    Vector<size_t> candidates;
+    mWindowIndex.findCandidatesInRect(displayId, Rect(windowInfo->frameLeft, windowInfo->frameTop,
+            windowInfo->frameRight, windowInfo->frameBottom), candidates);
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (windowIndex >= 0 && candidates.itemAt(i) >= size_t(windowIndex)) {
             break;
         }
 
+        sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(candidates.itemAt(i));
         const InputWindowInfo* otherInfo = otherHandle->getInfo();
         if (otherInfo->displayId == displayId
                 && otherInfo->visible && !otherInfo->isTrustedOverlay()
@@ -2553,6 +2570,10 @@ void InputDispatcher::notifyKey(const NotifyKeyArgs* args) {
                 args->deviceId, args->source, policyFlags,
                 args->action, flags, keyCode, args->scanCode,
                 metaState, repeatCount, args->downTime);
+        if (args->latencyTrace.isSampled()) {
+            newEntry->latencyTrace = args->latencyTrace;
+            newEntry->latencyTrace.enqueueTime = now();
+        }
 
         needWake = enqueueInboundEventLocked(newEntry);
         mLock.unlock();
@@ -2632,6 +2653,10 @@ void InputDispatcher::notifyMotion(const NotifyMotionArgs* args) {
                 args->edgeFlags, args->xPrecision, args->yPrecision, args->downTime,
                 args->displayId,
                 args->pointerCount, args->pointerProperties, args->pointerCoords, 0, 0);
+        if (args->latencyTrace.isSampled()) {
+            newEntry->latencyTrace = args->latencyTrace;
+            newEntry->latencyTrace.enqueueTime = now();
+        }
 
         needWake = enqueueInboundEventLocked(newEntry);
         mLock.unlock();
@@ -2926,107 +2951,213 @@ sp<InputWindowHandle> InputDispatcher::getWindowHandleLocked(
 
 bool InputDispatcher::hasWindowHandleLocked(
         const sp<InputWindowHandle>& windowHandle) const {
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        if (mWindowHandles.itemAt(i) == windowHandle) {
-            return true;
-        }
-    }
-    return false;
+    // The window index knows the position of every window in mWindowHandles.
+    return mWindowIndex.indexOf(windowHandle) >= 0;
 }
 
 void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inputWindowHandles) {
 #if DEBUG_FOCUS
     ALOGD("setInputWindows");
 #endif
+    bool needWake;
     { // acquire lock
         AutoMutex _l(mLock);
+        nsecs_t startTime = now();
 
-        Vector<sp<InputWindowHandle> > oldWindowHandles = mWindowHandles;
-        mWindowHandles = inputWindowHandles;
-
-        sp<InputWindowHandle> newFocusedWindowHandle;
-        bool foundHoveredWindow = false;
-        for (size_t i = 0; i < mWindowHandles.size(); i++) {
-            const sp<InputWindowHandle>& windowHandle = mWindowHandles.itemAt(i);
-            if (!windowHandle->updateInfo() || windowHandle->getInputChannel() == NULL) {
-                mWindowHandles.removeAt(i--);
-                continue;
-            }
-            if (windowHandle->getInfo()->hasFocus) {
-                newFocusedWindowHandle = windowHandle;
+        if (isDispatchBusyLocked() && !removesWindowsLocked(inputWindowHandles)) {
+            // Let the dispatch thread apply the update once it is done with the current
+            // events, along with any later updates that arrive in the meantime.
+            if (mHavePendingWindowHandles) {
+                mWindowUpdatesCoalesced += 1;
             }
-            if (windowHandle == mLastHoverWindowHandle) {
-                foundHoveredWindow = true;
+            mPendingWindowHandles = inputWindowHandles;
+            mHavePendingWindowHandles = true;
+            mWindowUpdatesDeferred += 1;
+            needWake = true;
+        } else {
+            // Windows went away or we are idle, apply the update right now.
+            // It supersedes any deferred update.
+            if (mHavePendingWindowHandles) {
+                mPendingWindowHandles.clear();
+                mHavePendingWindowHandles = false;
+                mWindowUpdatesCoalesced += 1;
             }
+            needWake = setInputWindowsLocked(inputWindowHandles);
         }
 
-        if (!foundHoveredWindow) {
-            mLastHoverWindowHandle = NULL;
+        recordWindowUpdateLockTimeLocked(startTime);
+    } // release lock
+
+    // Wake up poll loop since it may need to make new input dispatching choices.
+    if (needWake) {
+        mLooper->wake();
+    }
+}
+
+bool InputDispatcher::isDispatchBusyLocked() const {
+    return mPendingEvent != NULL || !mInboundQueue.isEmpty();
+}
+
+bool InputDispatcher::removesWindowsLocked(
+        const Vector<sp<InputWindowHandle> >& inputWindowHandles) const {
+    SortedVector<const InputWindowHandle*> windowHandles;
+    for (size_t i = 0; i < inputWindowHandles.size(); i++) {
+        windowHandles.add(inputWindowHandles.itemAt(i).get());
+    }
+    for (size_t i = 0; i < mWindowHandles.size(); i++) {
+        if (windowHandles.indexOf(mWindowHandles.itemAt(i).get()) < 0) {
+            return true;
         }
+    }
+    return false;
+}
 
-        if (mFocusedWindowHandle != newFocusedWindowHandle) {
-            if (mFocusedWindowHandle != NULL) {
+void InputDispatcher::applyPendingWindowHandlesLocked() {
+    if (!mHavePendingWindowHandles) {
+        return;
+    }
+
+    nsecs_t startTime = now();
+    Vector<sp<InputWindowHandle> > windowHandles;
+    windowHandles.appendVector(mPendingWindowHandles);
+    mPendingWindowHandles.clear();
+    mHavePendingWindowHandles = false;
+    setInputWindowsLocked(windowHandles);
+    recordWindowUpdateLockTimeLocked(startTime);
+}
+
+void InputDispatcher::recordWindowUpdateLockTimeLocked(nsecs_t startTime) {
+    nsecs_t lockTime = now() - startTime;
+    mWindowUpdateLockTime += lockTime;
+    if (lockTime > mWindowUpdateMaxLockTime) {
+        mWindowUpdateMaxLockTime = lockTime;
+    }
+}
+
+bool InputDispatcher::setInputWindowsLocked(
+        const Vector<sp<InputWindowHandle> >& inputWindowHandles) {
+    // Refresh the info of the windows and find out whether anything changed since
+    // the last update.  Window manager sends the same windows again on most layouts.
+    Vector<sp<InputWindowHandle> > windowHandles(inputWindowHandles);
+    Vector<uint64_t> windowInfoHashes;
+    windowInfoHashes.setCapacity(windowHandles.size());
+    bool changed = false;
+    for (size_t i = 0; i < windowHandles.size(); i++) {
+        const sp<InputWindowHandle>& windowHandle = windowHandles.itemAt(i);
+        if (!windowHandle->updateInfo() || windowHandle->getInputChannel() == NULL) {
+            windowHandles.removeAt(i--);
+            continue;
+        }
+        uint64_t hash = windowHandle->getInfo()->getContentHash();
+        windowInfoHashes.push(hash);
+        if (!changed) {
+            changed = i >= mWindowHandles.size()
+                    || mWindowHandles.itemAt(i) != windowHandle
+                    || mWindowInfoHashes.itemAt(i) != hash;
+        }
+    }
+    if (!changed && windowHandles.size() == mWindowHandles.size()) {
+        mWindowUpdatesSkipped += 1;
+        return false;
+    }
+    mWindowUpdatesApplied += 1;
+
+    Vector<sp<InputWindowHandle> > oldWindowHandles = mWindowHandles;
+    mWindowHandles = windowHandles;
+    mWindowInfoHashes = windowInfoHashes;
+
+    sp<InputWindowHandle> newFocusedWindowHandle;
+    bool foundHoveredWindow = false;
+    for (size_t i = 0; i < mWindowHandles.size(); i++) {
+        const sp<InputWindowHandle>& windowHandle = mWindowHandles.itemAt(i);
+        if (windowHandle->getInfo()->hasFocus) {
+            newFocusedWindowHandle = windowHandle;
+        }
+        if (windowHandle == mLastHoverWindowHandle) {
+            foundHoveredWindow = true;
+        }
+    }
+
+    mWindowIndex.update(mWindowHandles);
+    mSingleHandWindowIndices.clear();
+    for (size_t i = 0; i < mWindowHandles.size(); i++) {
+        if (mWindowHandles.itemAt(i)->getName().find("SingleMode_windowbg") != -1) {
+            mSingleHandWindowIndices.push(i);
+        }
+    }
+
+    if (!foundHoveredWindow) {
+        mLastHoverWindowHandle = NULL;
+    }
+
+    if (mFocusedWindowHandle != newFocusedWindowHandle) {
+        if (mFocusedWindowHandle != NULL) {
 #if DEBUG_FOCUS
-                ALOGD("Focus left window: %s",
-                        mFocusedWindowHandle->getName().string());
+            ALOGD("Focus left window: %s",
+                    mFocusedWindowHandle->getName().string());
 #endif
-                sp<InputChannel> focusedInputChannel = mFocusedWindowHandle->getInputChannel();
-                if (focusedInputChannel != NULL) {
-                    CancelationOptions options(CancelationOptions::CANCEL_NON_POINTER_EVENTS,
-                            "focus left window");
-                    synthesizeCancelationEventsForInputChannelLocked(
-                            focusedInputChannel, options);
-                }
+            sp<InputChannel> focusedInputChannel = mFocusedWindowHandle->getInputChannel();
+            if (focusedInputChannel != NULL) {
+                CancelationOptions options(CancelationOptions::CANCEL_NON_POINTER_EVENTS,
+                        "focus left window");
+                synthesizeCancelationEventsForInputChannelLocked(
+                        focusedInputChannel, options);
             }
-            if (newFocusedWindowHandle != NULL) {
+        }
+        if (newFocusedWindowHandle != NULL) {
 #if DEBUG_FOCUS
-                ALOGD("Focus entered window: %s",
-                        newFocusedWindowHandle->getName().string());
+            ALOGD("Focus entered window: %s",
+                    newFocusedWindowHandle->getName().string());
 #endif
-            }
-            mFocusedWindowHandle = newFocusedWindowHandle;
         }
+        mFocusedWindowHandle = newFocusedWindowHandle;
+    }
 
-        for (size_t d = 0; d < mTouchStatesByDisplay.size(); d++) {
-            TouchState& state = mTouchStatesByDisplay.editValueAt(d);
-            for (size_t i = 0; i < state.windows.size(); i++) {
-                TouchedWindow& touchedWindow = state.windows.editItemAt(i);
-                if (!hasWindowHandleLocked(touchedWindow.windowHandle)) {
+    // Touched windows can only have gone away if the window list lost some windows.
+    bool removedWindows = false;
+    for (size_t i = 0; i < oldWindowHandles.size() && !removedWindows; i++) {
+        removedWindows = !hasWindowHandleLocked(oldWindowHandles.itemAt(i));
+    }
+    if (!removedWindows) {
+        return true;
+    }
+
+    for (size_t d = 0; d < mTouchStatesByDisplay.size(); d++) {
+        TouchState& state = mTouchStatesByDisplay.editValueAt(d);
+        for (size_t i = 0; i < state.windows.size(); i++) {
+            TouchedWindow& touchedWindow = state.windows.editItemAt(i);
+            if (!hasWindowHandleLocked(touchedWindow.windowHandle)) {
 #if DEBUG_FOCUS
-                    ALOGD("Touched window was removed: %s",
-                            touchedWindow.windowHandle->getName().string());
+                ALOGD("Touched window was removed: %s",
+                        touchedWindow.windowHandle->getName().string());
 #endif
-                    sp<InputChannel> touchedInputChannel =
-                            touchedWindow.windowHandle->getInputChannel();
-                    if (touchedInputChannel != NULL) {
-                        CancelationOptions options(CancelationOptions::CANCEL_POINTER_EVENTS,
-                                "touched window was removed");
-                        synthesizeCancelationEventsForInputChannelLocked(
-                                touchedInputChannel, options);
-                    }
-                    state.windows.removeAt(i--);
+                sp<InputChannel> touchedInputChannel =
+                        touchedWindow.windowHandle->getInputChannel();
+                if (touchedInputChannel != NULL) {
+                    CancelationOptions options(CancelationOptions::CANCEL_POINTER_EVENTS,
+                            "touched window was removed");
+                    synthesizeCancelationEventsForInputChannelLocked(
+                            touchedInputChannel, options);
                 }
+                state.windows.removeAt(i--);
             }
         }
+    }
 
-        // Release information for windows that are no longer present.
-        // This ensures that unused input channels are released promptly.
-        // Otherwise, they might stick around until the window handle is destroyed
-        // which might not happen until the next GC.
-        for (size_t i = 0; i < oldWindowHandles.size(); i++) {
-            const sp<InputWindowHandle>& oldWindowHandle = oldWindowHandles.itemAt(i);
-            if (!hasWindowHandleLocked(oldWindowHandle)) {
+    // Release information for windows that are no longer present.
+    // This ensures that unused input channels are released promptly.
+    // Otherwise, they might stick around until the window handle is destroyed
+    // which might not happen until the next GC.
+    for (size_t i = 0; i < oldWindowHandles.size(); i++) {
+        const sp<InputWindowHandle>& oldWindowHandle = oldWindowHandles.itemAt(i);
+        if (!hasWindowHandleLocked(oldWindowHandle)) {
 #if DEBUG_FOCUS
-                ALOGD("Window went away: %s", oldWindowHandle->getName().string());
+            ALOGD("Window went away: %s", oldWindowHandle->getName().string());
 #endif
-                oldWindowHandle->releaseInfo();
-            }
+            oldWindowHandle->releaseInfo();
         }
-    } // release lock
-
-    // Wake up poll loop since it may need to make new input dispatching choices.
-    mLooper->wake();
+    }
+    return true;
 }
 
 void InputDispatcher::setFocusedApplication(
@@ -3037,6 +3168,9 @@ void InputDispatcher::setFocusedApplication(
     { // acquire lock
         AutoMutex _l(mLock);
 
+        // The focused application goes along with the windows sent before it.
+        applyPendingWindowHandlesLocked();
+
         if (inputApplicationHandle != NULL && inputApplicationHandle->updateInfo()) {
             if (mFocusedApplicationHandle != inputApplicationHandle) {
                 if (mFocusedApplicationHandle != NULL) {
@@ -3069,6 +3203,9 @@ void InputDispatcher::setInputDispatchMode(bool enabled, bool frozen) {
     { // acquire lock
         AutoMutex _l(mLock);
 
+        // Unfreezing must dispatch to the windows sent before it.
+        applyPendingWindowHandlesLocked();
+
         if (mDispatchEnabled != enabled || mDispatchFrozen != frozen) {
             if (mDispatchFrozen && !frozen) {
                 resetANRTimeoutsLocked();
@@ -3125,6 +3262,8 @@ bool InputDispatcher::transferTouchFocus(const sp<InputChannel>& fromChannel,
     { // acquire lock
         AutoMutex _l(mLock);
 
+        applyPendingWindowHandlesLocked();
+
         sp<InputWindowHandle> fromWindowHandle = getWindowHandleLocked(fromChannel);
         sp<InputWindowHandle> toWindowHandle = getWindowHandleLocked(toChannel);
         if (fromWindowHandle == NULL || toWindowHandle == NULL) {
@@ -3302,6 +3441,17 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
     } else {
         dump.append(INDENT "Windows: <none>\n");
     }
+    dump.append(INDENT "WindowIndex: ");
+    mWindowIndex.dump(dump);
+    dump.appendFormat(INDENT "WindowUpdates: applied=%u, skipped=%u, deferred=%u, "
+            "coalesced=%u, lockHeldTime=%0.3fms (max %0.3fms)\n",
+            mWindowUpdatesApplied, mWindowUpdatesSkipped,
+            mWindowUpdatesDeferred, mWindowUpdatesCoalesced,
+            mWindowUpdateLockTime / 1000000.0, mWindowUpdateMaxLockTime / 1000000.0);
+    if (mHavePendingWindowHandles) {
+        dump.appendFormat(INDENT "PendingWindows: %zu, not applied yet\n",
+                mPendingWindowHandles.size());
+    }
 
     if (!mMonitoringChannels.isEmpty()) {
         dump.append(INDENT "MonitoringChannels:\n");
@@ -3417,6 +3567,16 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
         dump.append(INDENT "AppSwitch: not pending\n");
     }
 
+    dump.append(INDENT "EntryPools:\n");
+    dump.append(INDENT2);
+    KeyEntry::sPool.dump(dump, "KeyEntry");
+    dump.append(INDENT2);
+    MotionEntry::sPool.dump(dump, "MotionEntry");
+    dump.append(INDENT2);
+    DispatchEntry::sPool.dump(dump, "DispatchEntry");
+    dump.append(INDENT2);
+    CommandEntry::sPool.dump(dump, "CommandEntry");
+
     dump.append(INDENT "Configuration:\n");
     dump.appendFormat(INDENT2 "KeyRepeatDelay: %0.1fms\n",
             mConfig.keyRepeatDelay * 0.000001f);
@@ -3658,6 +3818,13 @@ void InputDispatcher::doDispatchCycleFinishedLockedInterruptible(
             ALOGI("%s", msg.string());
         }
 
+        const EventEntry* eventEntry = dispatchEntry->eventEntry;
+        if (eventEntry->latencyTrace.isSampled() && !connection->monitor) {
+            mLatencyTracker.addSample(String8(connection->getWindowName()),
+                    eventEntry->eventTime, eventEntry->latencyTrace,
+                    dispatchEntry->deliveryTime, finishTime);
+        }
+
         bool restartEvent;
         if (dispatchEntry->eventEntry->type == EventEntry::TYPE_KEY) {
             KeyEntry* keyEntry = static_cast<KeyEntry*>(dispatchEntry->eventEntry);
@@ -3923,14 +4090,25 @@ void InputDispatcher::traceWaitQueueLengthLocked(const sp<Connection>& connectio
 }
 
 void InputDispatcher::dump(String8& dump) {
-    AutoMutex _l(mLock);
+    // The latency histograms take a while to format, so only copy them with the lock held.
+    InputLatencyTracker latencyTracker;
+    String8 lastANRState;
+    { // acquire lock
+        AutoMutex _l(mLock);
 
-    dump.append("Input Dispatcher State:\n");
-    dumpDispatchStateLocked(dump);
+        dump.append("Input Dispatcher State:\n");
+        dumpDispatchStateLocked(dump);
+
+        latencyTracker = mLatencyTracker;
+        lastANRState = mLastANRState;
+    } // release lock
+
+    dump.append(INDENT "InputLatency: ");
+    latencyTracker.dump(dump);
 
-    if (!mLastANRState.isEmpty()) {
+    if (!lastANRState.isEmpty()) {
         dump.append("\nInput Dispatcher State at time of last ANR:\n");
-        dump.append(mLastANRState);
+        dump.append(lastANRState);
     }
 }
 
@@ -4026,6 +4204,8 @@ void InputDispatcher::DeviceResetEntry::appendDescription(String8& msg) const {
 
 // --- InputDispatcher::KeyEntry ---
 
+InputDispatcher::EntryPool<InputDispatcher::KeyEntry> InputDispatcher::KeyEntry::sPool;
+
 InputDispatcher::KeyEntry::KeyEntry(nsecs_t eventTime,
         int32_t deviceId, uint32_t source, uint32_t policyFlags, int32_t action,
         int32_t flags, int32_t keyCode, int32_t scanCode, int32_t metaState,
@@ -4061,6 +4241,8 @@ void InputDispatcher::KeyEntry::recycle() {
 
 // --- InputDispatcher::MotionEntry ---
 
+InputDispatcher::EntryPool<InputDispatcher::MotionEntry> InputDispatcher::MotionEntry::sPool;
+
 InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime, int32_t deviceId,
         uint32_t source, uint32_t policyFlags, int32_t action, int32_t actionButton,
         int32_t flags, int32_t metaState, int32_t buttonState, int32_t edgeFlags,
@@ -4107,6 +4289,8 @@ void InputDispatcher::MotionEntry::appendDescription(String8& msg) const {
 
 volatile int32_t InputDispatcher::DispatchEntry::sNextSeqAtomic;
 
+InputDispatcher::EntryPool<InputDispatcher::DispatchEntry> InputDispatcher::DispatchEntry::sPool;
+
 InputDispatcher::DispatchEntry::DispatchEntry(EventEntry* eventEntry,
         int32_t targetFlags, float xOffset, float yOffset, float scaleFactor) :
         seq(nextSeq()),
@@ -4534,6 +4718,8 @@ InputDispatcher::DispatchEntry* InputDispatcher::Connection::findWaitQueueEntry(
 
 // --- InputDispatcher::CommandEntry ---
 
+InputDispatcher::EntryPool<InputDispatcher::CommandEntry> InputDispatcher::CommandEntry::sPool;
+
 InputDispatcher::CommandEntry::CommandEntry(Command command) :
     command(command), eventTime(0), keyEntry(NULL), userActivityEventType(0),
     seq(0), handled(false) {
@@ -4681,13 +4867,12 @@ bool InputDispatcher::singlehandRegionContainsPointLocked(int32_t x, int32_t y,
 void InputDispatcher::singleHandModePreProcessLocked(MotionEntry* entry) {
     bool hasVirtualDevice = false;
     bool leftSingleHandScreen  = false;
-    size_t numWindows = mWindowHandles.size();
+    size_t numSingleHandWindows = mSingleHandWindowIndices.size();
 
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
+    for (size_t i = 0; i < numSingleHandWindows; i++) {
+        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(mSingleHandWindowIndices[i]);
         const InputWindowInfo* windowInfo = windowHandle->getInfo();
-        int32_t flags = windowInfo->layoutParamsFlags;
-        if (windowInfo->visible && windowHandle->getName().find("SingleMode_windowbg") != -1) {
+        if (windowInfo->visible) {
             hasVirtualDevice = true;
             leftSingleHandScreen = (windowHandle->getName().find("left") != -1);
             break;
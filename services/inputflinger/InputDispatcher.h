@@ -34,7 +34,9 @@
 #include <limits.h>
 
 #include "InputWindow.h"
+#include "InputWindowSpatialIndex.h"
 #include "InputApplication.h"
+#include "InputLatencyTracker.h"
 #include "InputListener.h"
 #include <ui/DisplayInfo.h>
 
@@ -411,6 +413,115 @@ private:
         inline Link() : next(NULL), prev(NULL) { }
     };
 
+    // Recycles the memory of the entries of type T, which are allocated and freed at
+    // the input rate.  Freed entries are kept on an intrusive free list, up to the peak
+    // number of entries that were alive at once since the previous trim, so that the
+    // pool grows with bursts of input and shrinks back once they are over.
+    //
+    // Entries are created outside of the dispatcher lock (injection, the reader thread)
+    // so the pool has a lock of its own.
+    template <typename T>
+    class EntryPool {
+    public:
+        inline EntryPool() : mFreeList(NULL), mFreeCount(0), mLiveCount(0),
+                mPeakLiveCount(0), mCapacity(MIN_CAPACITY), mFreesSinceTrim(0),
+                mAllocationCount(0), mReuseCount(0) {
+        }
+
+        void* allocate(size_t size) {
+            if (size != sizeof(T)) {
+                return ::operator new(size);
+            }
+
+            AutoMutex _l(mLock);
+            mAllocationCount += 1;
+            mLiveCount += 1;
+            if (mLiveCount > mPeakLiveCount) {
+                // Grow right away, shrink only when trimming.
+                mPeakLiveCount = mLiveCount;
+                if (mPeakLiveCount > mCapacity && mCapacity < MAX_CAPACITY) {
+                    mCapacity = mPeakLiveCount;
+                }
+            }
+            if (mFreeList) {
+                FreeBlock* block = mFreeList;
+                mFreeList = block->next;
+                mFreeCount -= 1;
+                mReuseCount += 1;
+                return block;
+            }
+            return ::operator new(sizeof(T));
+        }
+
+        void deallocate(void* ptr, size_t size) {
+            if (!ptr || size != sizeof(T)) {
+                ::operator delete(ptr);
+                return;
+            }
+
+            AutoMutex _l(mLock);
+            mLiveCount -= 1;
+            if (++mFreesSinceTrim >= TRIM_INTERVAL) {
+                trimLocked();
+            }
+            if (mFreeCount < mCapacity) {
+                FreeBlock* block = static_cast<FreeBlock*>(ptr);
+                block->next = mFreeList;
+                mFreeList = block;
+                mFreeCount += 1;
+            } else {
+                ::operator delete(ptr);
+            }
+        }
+
+        void dump(String8& dump, const char* name) const {
+            AutoMutex _l(mLock);
+            dump.appendFormat("%s: live=%zu, free=%zu, capacity=%zu, "
+                    "allocations=%llu, reused=%llu (%0.1f%%)\n",
+                    name, mLiveCount, mFreeCount, mCapacity,
+                    (unsigned long long)mAllocationCount, (unsigned long long)mReuseCount,
+                    mAllocationCount ? mReuseCount * 100.0 / mAllocationCount : 0.0);
+        }
+
+    private:
+        enum {
+            MIN_CAPACITY = 16,
+            MAX_CAPACITY = 1024,
+            // Number of frees after which the capacity is adjusted to the peak.
+            TRIM_INTERVAL = 4096,
+        };
+
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        void trimLocked() {
+            mCapacity = mPeakLiveCount < MIN_CAPACITY ? size_t(MIN_CAPACITY)
+                    : mPeakLiveCount > MAX_CAPACITY ? size_t(MAX_CAPACITY)
+                    : mPeakLiveCount;
+            mPeakLiveCount = mLiveCount;
+            mFreesSinceTrim = 0;
+            while (mFreeCount > mCapacity) {
+                FreeBlock* block = mFreeList;
+                mFreeList = block->next;
+                mFreeCount -= 1;
+                ::operator delete(block);
+            }
+        }
+
+        mutable Mutex mLock;
+        FreeBlock* mFreeList;
+        size_t mFreeCount;
+        size_t mLiveCount;
+        size_t mPeakLiveCount;
+        size_t mCapacity;
+        uint32_t mFreesSinceTrim;
+
+        // Statistics, for dumpsys.
+        uint64_t mAllocationCount;
+        uint64_t mReuseCount;
+    };
+
     struct InjectionState {
         mutable int32_t refCount;
 
@@ -440,6 +551,7 @@ private:
         nsecs_t eventTime;
         uint32_t policyFlags;
         InjectionState* injectionState;
+        InputLatencyTrace latencyTrace; // stage timestamps if the event is sampled
 
         bool dispatchInProgress; // initially false, set to true while dispatching
 
@@ -502,6 +614,10 @@ private:
         virtual void appendDescription(String8& msg) const;
         void recycle();
 
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* ptr, size_t size) { sPool.deallocate(ptr, size); }
+        static EntryPool<KeyEntry> sPool;
+
     protected:
         virtual ~KeyEntry();
     };
@@ -534,6 +650,10 @@ private:
                 float xOffset, float yOffset);
         virtual void appendDescription(String8& msg) const;
 
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* ptr, size_t size) { sPool.deallocate(ptr, size); }
+        static EntryPool<MotionEntry> sPool;
+
     protected:
         virtual ~MotionEntry();
     };
@@ -557,6 +677,10 @@ private:
                 int32_t targetFlags, float xOffset, float yOffset, float scaleFactor);
         ~DispatchEntry();
 
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* ptr, size_t size) { sPool.deallocate(ptr, size); }
+        static EntryPool<DispatchEntry> sPool;
+
         inline bool hasForegroundTarget() const {
             return targetFlags & InputTarget::FLAG_FOREGROUND;
         }
@@ -595,6 +719,10 @@ private:
         CommandEntry(Command command);
         ~CommandEntry();
 
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* ptr, size_t size) { sPool.deallocate(ptr, size); }
+        static EntryPool<CommandEntry> sPool;
+
         Command command;
 
         // parameters for the command (usage varies by command)
@@ -864,6 +992,9 @@ private:
     Queue<EventEntry> mRecentQueue;
     Queue<CommandEntry> mCommandQueue;
 
+    // Latency statistics of the sampled events, per window.
+    InputLatencyTracker mLatencyTracker;
+
     DropReason mLastDropReason;
 
     void dispatchOnceInnerLocked(nsecs_t* nextWakeupTime);
@@ -956,6 +1087,38 @@ private:
 
     Vector<sp<InputWindowHandle> > mWindowHandles;
 
+    // Content hash of the info of each window in mWindowHandles, as of the last
+    // update that was applied.
+    Vector<uint64_t> mWindowInfoHashes;
+
+    // Window list waiting to be applied by the dispatch thread.  Updates that do not
+    // remove any window are deferred here while events are being dispatched, a newer
+    // update replaces an older one that was not applied yet.
+    Vector<sp<InputWindowHandle> > mPendingWindowHandles;
+    bool mHavePendingWindowHandles;
+
+    // Window update statistics, for dumpsys.
+    uint32_t mWindowUpdatesApplied;
+    uint32_t mWindowUpdatesSkipped;
+    uint32_t mWindowUpdatesDeferred;
+    uint32_t mWindowUpdatesCoalesced;
+    // Time spent holding the lock to update windows.
+    nsecs_t mWindowUpdateLockTime;
+    nsecs_t mWindowUpdateMaxLockTime;
+
+    bool isDispatchBusyLocked() const;
+    bool removesWindowsLocked(const Vector<sp<InputWindowHandle> >& inputWindowHandles) const;
+    bool setInputWindowsLocked(const Vector<sp<InputWindowHandle> >& inputWindowHandles);
+    void applyPendingWindowHandlesLocked();
+    void recordWindowUpdateLockTimeLocked(nsecs_t startTime);
+
+    // Per display index of mWindowHandles for hit-testing touches, updated along
+    // with mWindowHandles.
+    InputWindowSpatialIndex mWindowIndex;
+
+    // Positions in mWindowHandles of the single hand mode background windows.
+    Vector<size_t> mSingleHandWindowIndices;
+
     sp<InputWindowHandle> getWindowHandleLocked(const sp<InputChannel>& inputChannel) const;
     bool hasWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) const;
 
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputLatencyTracker"
+
+#include "InputLatencyTracker.h"
+
+#include <string.h>
+
+namespace android {
+
+// Upper bound of the first histogram bucket.
+static const nsecs_t FIRST_BUCKET_BOUND = 125 * 1000LL;
+
+static const uint32_t PERCENTILES[] = { 50, 90, 99 };
+
+static void appendDuration(String8& dump, nsecs_t duration) {
+    dump.appendFormat("%0.2fms", duration * 0.000001f);
+}
+
+
+// --- InputLatencyTracker::Histogram ---
+
+InputLatencyTracker::Histogram::Histogram() :
+        count(0), sum(0), max(0) {
+    memset(buckets, 0, sizeof(buckets));
+}
+
+void InputLatencyTracker::Histogram::add(nsecs_t duration) {
+    buckets[getBucket(duration)] += 1;
+    count += 1;
+    sum += duration;
+    if (duration > max) {
+        max = duration;
+    }
+}
+
+nsecs_t InputLatencyTracker::Histogram::getPercentileBound(uint32_t percentile) const {
+    uint64_t threshold = (uint64_t(count) * percentile + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT - 1; i++) {
+        seen += buckets[i];
+        if (seen >= threshold) {
+            return getBucketBound(i);
+        }
+    }
+    return -1;
+}
+
+size_t InputLatencyTracker::Histogram::getBucket(nsecs_t duration) {
+    size_t bucket = 0;
+    nsecs_t bound = FIRST_BUCKET_BOUND;
+    while (bucket < BUCKET_COUNT - 1 && duration >= bound) {
+        bucket += 1;
+        bound *= 2;
+    }
+    return bucket;
+}
+
+nsecs_t InputLatencyTracker::Histogram::getBucketBound(size_t bucket) {
+    return FIRST_BUCKET_BOUND << bucket;
+}
+
+
+// --- InputLatencyTracker ---
+
+InputLatencyTracker::InputLatencyTracker() :
+        mSampleCount(0) {
+}
+
+void InputLatencyTracker::addSample(const String8& windowName, nsecs_t eventTime,
+        const InputLatencyTrace& trace, nsecs_t deliveryTime, nsecs_t finishTime) {
+    nsecs_t durations[STAGE_COUNT];
+    durations[STAGE_READ] = trace.readTime - eventTime;
+    durations[STAGE_COOK] = trace.cookTime - trace.readTime;
+    durations[STAGE_ENQUEUE] = trace.enqueueTime - trace.cookTime;
+    durations[STAGE_QUEUE] = trace.dispatchTime - trace.enqueueTime;
+    durations[STAGE_DELIVER] = deliveryTime - trace.dispatchTime;
+    durations[STAGE_FINISH] = finishTime - deliveryTime;
+    durations[STAGE_TOTAL] = finishTime - eventTime;
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        // Kernel timestamps of some devices can be slightly in the future.
+        if (durations[i] < 0) {
+            durations[i] = 0;
+        }
+    }
+
+    ssize_t index = mWindows.indexOfKey(windowName);
+    if (index < 0) {
+        if (mWindows.size() >= MAX_WINDOWS) {
+            size_t oldest = 0;
+            for (size_t i = 1; i < mWindows.size(); i++) {
+                if (mSampleCount - mWindows.valueAt(i).lastUpdate
+                        > mSampleCount - mWindows.valueAt(oldest).lastUpdate) {
+                    oldest = i;
+                }
+            }
+            mWindows.removeItemsAt(oldest);
+        }
+        index = mWindows.add(windowName, WindowStats());
+    }
+
+    WindowStats& stats = mWindows.editValueAt(index);
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        stats.stages[i].add(durations[i]);
+    }
+    stats.lastUpdate = mSampleCount;
+
+    Sample& sample = mRecentSamples[mSampleCount % MAX_RECENT_SAMPLES];
+    sample.windowName = windowName;
+    sample.eventTime = eventTime;
+    memcpy(sample.durations, durations, sizeof(durations));
+    mSampleCount += 1;
+}
+
+void InputLatencyTracker::clear() {
+    mWindows.clear();
+    for (size_t i = 0; i < MAX_RECENT_SAMPLES; i++) {
+        mRecentSamples[i] = Sample();
+    }
+    mSampleCount = 0;
+}
+
+const InputLatencyTracker::Histogram* InputLatencyTracker::getHistogram(
+        const String8& windowName, Stage stage) const {
+    ssize_t index = mWindows.indexOfKey(windowName);
+    return index >= 0 ? &mWindows.valueAt(index).stages[stage] : NULL;
+}
+
+const char* InputLatencyTracker::getStageLabel(Stage stage) {
+    switch (stage) {
+    case STAGE_READ: return "read";
+    case STAGE_COOK: return "cook";
+    case STAGE_ENQUEUE: return "enqueue";
+    case STAGE_QUEUE: return "queue";
+    case STAGE_DELIVER: return "deliver";
+    case STAGE_FINISH: return "finish";
+    case STAGE_TOTAL: return "total";
+    default: return "?";
+    }
+}
+
+void InputLatencyTracker::dump(String8& dump) const {
+    dump.appendFormat("samples=%u, windows=%zu\n", mSampleCount, mWindows.size());
+    for (size_t i = 0; i < mWindows.size(); i++) {
+        const WindowStats& stats = mWindows.valueAt(i);
+        dump.appendFormat("    '%s': samples=%u\n", mWindows.keyAt(i).string(),
+                stats.stages[STAGE_TOTAL].count);
+        for (size_t j = 0; j < STAGE_COUNT; j++) {
+            const Histogram& histogram = stats.stages[j];
+            dump.appendFormat("      %s: mean=", getStageLabel(Stage(j)));
+            appendDuration(dump, histogram.count ? histogram.sum / histogram.count : 0);
+            for (size_t k = 0; k < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]); k++) {
+                nsecs_t bound = histogram.getPercentileBound(PERCENTILES[k]);
+                if (bound < 0) {
+                    dump.appendFormat(", p%u>=", PERCENTILES[k]);
+                    appendDuration(dump, Histogram::getBucketBound(BUCKET_COUNT - 2));
+                } else {
+                    dump.appendFormat(", p%u<", PERCENTILES[k]);
+                    appendDuration(dump, bound);
+                }
+            }
+            dump.append(", max=");
+            appendDuration(dump, histogram.max);
+            dump.append("\n");
+        }
+    }
+
+    uint32_t recentCount = mSampleCount < MAX_RECENT_SAMPLES ? mSampleCount : MAX_RECENT_SAMPLES;
+    if (recentCount) {
+        dump.append("    Recent:\n");
+        for (uint32_t i = mSampleCount - recentCount; i < mSampleCount; i++) {
+            const Sample& sample = mRecentSamples[i % MAX_RECENT_SAMPLES];
+            dump.appendFormat("      '%s': eventTime=%lld", sample.windowName.string(),
+                    (long long) sample.eventTime);
+            for (size_t j = 0; j < STAGE_COUNT; j++) {
+                dump.appendFormat(", %s=", getStageLabel(Stage(j)));
+                appendDuration(dump, sample.durations[j]);
+            }
+            dump.append("\n");
+        }
+    }
+}
+
+} // namespace android
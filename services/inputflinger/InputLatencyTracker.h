@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_LATENCY_TRACKER_H
+#define _UI_INPUT_LATENCY_TRACKER_H
+
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include "InputListener.h"
+
+namespace android {
+
+/*
+ * Aggregates the latency traces of the sampled input events into histograms,
+ * one set per window, so that input lag can be attributed to the reader, the
+ * dispatcher or the application.
+ *
+ * Each finished delivery of a sampled event is split into the following stages:
+ *   read:     kernel timestamp to EventHub read
+ *   cook:     EventHub read to InputReader producing the event
+ *   enqueue:  InputReader to the inbound queue, includes policy interception
+ *   queue:    time spent in the inbound queue
+ *   deliver:  targeting and outbound queue until the event is published
+ *   finish:   publication until the application finishes the event
+ *   total:    kernel timestamp until the application finishes the event
+ *
+ * Only the most recently updated windows are kept. The tracker is not
+ * thread-safe, the dispatcher uses it with its lock held and dumps a copy of
+ * it after releasing the lock.
+ */
+class InputLatencyTracker {
+public:
+    enum Stage {
+        STAGE_READ,
+        STAGE_COOK,
+        STAGE_ENQUEUE,
+        STAGE_QUEUE,
+        STAGE_DELIVER,
+        STAGE_FINISH,
+        STAGE_TOTAL,
+
+        STAGE_COUNT
+    };
+
+    // Maximum number of windows to keep histograms for.
+    enum { MAX_WINDOWS = 32 };
+    // Number of recent samples to keep for dumpsys.
+    enum { MAX_RECENT_SAMPLES = 8 };
+
+    // Histogram buckets are powers of two of 125us, the last one is unbounded.
+    enum { BUCKET_COUNT = 13 };
+
+    struct Histogram {
+        uint32_t buckets[BUCKET_COUNT];
+        uint32_t count;
+        nsecs_t sum;
+        nsecs_t max;
+
+        Histogram();
+        void add(nsecs_t duration);
+        // Returns the upper bound of the bucket that contains the given percentile
+        // of the samples, or -1 if it is the unbounded bucket.
+        nsecs_t getPercentileBound(uint32_t percentile) const;
+
+        static size_t getBucket(nsecs_t duration);
+        static nsecs_t getBucketBound(size_t bucket);
+    };
+
+    InputLatencyTracker();
+
+    // Records a sampled event that the given window finished.
+    void addSample(const String8& windowName, nsecs_t eventTime,
+            const InputLatencyTrace& trace, nsecs_t deliveryTime, nsecs_t finishTime);
+
+    void clear();
+
+    void dump(String8& dump) const;
+
+    // Returns the histogram of the stage for the window, or NULL if there were
+    // no samples for it.
+    const Histogram* getHistogram(const String8& windowName, Stage stage) const;
+
+    static const char* getStageLabel(Stage stage);
+
+private:
+    struct WindowStats {
+        Histogram stages[STAGE_COUNT];
+        uint32_t lastUpdate;
+    };
+
+    struct Sample {
+        String8 windowName;
+        nsecs_t eventTime;
+        nsecs_t durations[STAGE_COUNT];
+    };
+
+    KeyedVector<String8, WindowStats> mWindows;
+
+    Sample mRecentSamples[MAX_RECENT_SAMPLES];
+    uint32_t mSampleCount;
+};
+
+} // namespace android
+
+#endif // _UI_INPUT_LATENCY_TRACKER_H
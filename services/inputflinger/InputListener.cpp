@@ -56,7 +56,8 @@ NotifyKeyArgs::NotifyKeyArgs(const NotifyKeyArgs& other) :
         policyFlags(other.policyFlags),
         action(other.action), flags(other.flags),
         keyCode(other.keyCode), scanCode(other.scanCode),
-        metaState(other.metaState), downTime(other.downTime) {
+        metaState(other.metaState), downTime(other.downTime),
+        latencyTrace(other.latencyTrace) {
 }
 
 void NotifyKeyArgs::notify(const sp<InputListenerInterface>& listener) const {
@@ -89,7 +90,8 @@ NotifyMotionArgs::NotifyMotionArgs(const NotifyMotionArgs& other) :
         action(other.action), actionButton(other.actionButton), flags(other.flags),
         metaState(other.metaState), buttonState(other.buttonState),
         edgeFlags(other.edgeFlags), displayId(other.displayId), pointerCount(other.pointerCount),
-        xPrecision(other.xPrecision), yPrecision(other.yPrecision), downTime(other.downTime) {
+        xPrecision(other.xPrecision), yPrecision(other.yPrecision), downTime(other.downTime),
+        latencyTrace(other.latencyTrace) {
     for (uint32_t i = 0; i < pointerCount; i++) {
         pointerProperties[i].copyFrom(other.pointerProperties[i]);
         pointerCoords[i].copyFrom(other.pointerCoords[i]);
@@ -179,4 +181,55 @@ void QueuedInputListener::flush() {
 }
 
 
+
+// --- InputLatencySampler ---
+
+InputLatencySampler::InputLatencySampler(const sp<InputListenerInterface>& innerListener,
+        uint32_t sampleInterval) :
+        mInnerListener(innerListener), mSampleInterval(sampleInterval),
+        mMotionCount(0), mReadTime(0) {
+}
+
+InputLatencySampler::~InputLatencySampler() {
+}
+
+void InputLatencySampler::notifyConfigurationChanged(
+        const NotifyConfigurationChangedArgs* args) {
+    mInnerListener->notifyConfigurationChanged(args);
+}
+
+void InputLatencySampler::notifyKey(const NotifyKeyArgs* args) {
+    if (!mReadTime || mSampleInterval == 0) {
+        mInnerListener->notifyKey(args);
+        return;
+    }
+
+    NotifyKeyArgs sampledArgs(*args);
+    sampledArgs.latencyTrace.readTime = mReadTime;
+    sampledArgs.latencyTrace.cookTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    mInnerListener->notifyKey(&sampledArgs);
+}
+
+void InputLatencySampler::notifyMotion(const NotifyMotionArgs* args) {
+    if (!mReadTime || mSampleInterval == 0 || ++mMotionCount < mSampleInterval) {
+        mInnerListener->notifyMotion(args);
+        return;
+    }
+
+    mMotionCount = 0;
+    NotifyMotionArgs sampledArgs(*args);
+    sampledArgs.latencyTrace.readTime = mReadTime;
+    sampledArgs.latencyTrace.cookTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    mInnerListener->notifyMotion(&sampledArgs);
+}
+
+void InputLatencySampler::notifySwitch(const NotifySwitchArgs* args) {
+    mInnerListener->notifySwitch(args);
+}
+
+void InputLatencySampler::notifyDeviceReset(const NotifyDeviceResetArgs* args) {
+    mInnerListener->notifyDeviceReset(args);
+}
+
+
 } // namespace android
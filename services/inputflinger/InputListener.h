@@ -26,6 +26,24 @@ namespace android {
 class InputListenerInterface;
 
 
+/*
+ * Stage timestamps of an input event sampled for latency tracing, in the
+ * SYSTEM_TIME_MONOTONIC time base. The kernel timestamp is the event time of
+ * the event itself. Events that are not sampled have a readTime of 0.
+ */
+struct InputLatencyTrace {
+    nsecs_t readTime;     // EventHub read the raw events from the device
+    nsecs_t cookTime;     // InputReader produced the event
+    nsecs_t enqueueTime;  // InputDispatcher added it to the inbound queue
+    nsecs_t dispatchTime; // InputDispatcher took it off the inbound queue
+
+    inline InputLatencyTrace() :
+            readTime(0), cookTime(0), enqueueTime(0), dispatchTime(0) { }
+
+    inline bool isSampled() const { return readTime != 0; }
+};
+
+
 /* Superclass of all input event argument objects */
 struct NotifyArgs {
     virtual ~NotifyArgs() { }
@@ -62,6 +80,7 @@ struct NotifyKeyArgs : public NotifyArgs {
     int32_t scanCode;
     int32_t metaState;
     nsecs_t downTime;
+    InputLatencyTrace latencyTrace;
 
     inline NotifyKeyArgs() { }
 
@@ -96,6 +115,7 @@ struct NotifyMotionArgs : public NotifyArgs {
     float xPrecision;
     float yPrecision;
     nsecs_t downTime;
+    InputLatencyTrace latencyTrace;
 
     inline NotifyMotionArgs() { }
 
@@ -193,6 +213,41 @@ private:
     Vector<NotifyArgs*> mArgsQueue;
 };
 
+
+/*
+ * An implementation of the listener interface that samples key and motion
+ * events for latency tracing on their way to another listener.
+ *
+ * Every key event and one in every sampleInterval motion events produced from
+ * raw events gets its read and cook times stamped into its latency trace, the
+ * other events are passed through untouched. Key events are few enough to
+ * trace them all.
+ */
+class InputLatencySampler : public InputListenerInterface {
+protected:
+    virtual ~InputLatencySampler();
+
+public:
+    InputLatencySampler(const sp<InputListenerInterface>& innerListener,
+            uint32_t sampleInterval);
+
+    // Sets the time the raw events being processed were read at, or 0 if the
+    // events that follow are not produced from raw events.
+    inline void setReadTime(nsecs_t readTime) { mReadTime = readTime; }
+
+    virtual void notifyConfigurationChanged(const NotifyConfigurationChangedArgs* args);
+    virtual void notifyKey(const NotifyKeyArgs* args);
+    virtual void notifyMotion(const NotifyMotionArgs* args);
+    virtual void notifySwitch(const NotifySwitchArgs* args);
+    virtual void notifyDeviceReset(const NotifyDeviceResetArgs* args);
+
+private:
+    sp<InputListenerInterface> mInnerListener;
+    uint32_t mSampleInterval;
+    uint32_t mMotionCount;
+    nsecs_t mReadTime;
+};
+
 } // namespace android
 
 #endif // _UI_INPUT_LISTENER_H
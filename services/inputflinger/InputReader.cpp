@@ -69,6 +69,21 @@ namespace android {
 // Maximum number of slots supported when using the slot-based Multitouch Protocol B.
 static const size_t MAX_SLOTS = 32;
 
+// One in this many motion events is traced through the dispatch pipeline for latency
+// statistics.
+static const uint32_t LATENCY_SAMPLE_INTERVAL = 16;
+
+// Maximum number of device lanes.
+static const size_t MAX_DEVICE_LANES = 8;
+
+// Device classes that may be cooked on a device lane.  Their mappers only change the
+// state of their own device, unlike keyboards which update the global meta state and
+// external styluses which update the state of the touch devices.
+static const uint32_t LANE_DEVICE_CLASSES = INPUT_DEVICE_CLASS_TOUCH
+        | INPUT_DEVICE_CLASS_CURSOR | INPUT_DEVICE_CLASS_JOYSTICK;
+static const uint32_t NON_LANE_DEVICE_CLASSES = INPUT_DEVICE_CLASS_KEYBOARD
+        | INPUT_DEVICE_CLASS_SWITCH | INPUT_DEVICE_CLASS_EXTERNAL_STYLUS;
+
 // Maximum amount of latency to add to touch events while waiting for data from an
 // external stylus.
 static const nsecs_t EXTERNAL_STYLUS_DATA_TIMEOUT = ms2ns(72);
@@ -272,6 +287,11 @@ InputReader::InputReader(const sp<EventHubInterface>& eventHub,
         mDisableVirtualKeysTimeout(LLONG_MIN), mNextTimeout(LLONG_MAX),
         mConfigurationChangesToRefresh(0) {
     mQueuedListener = new QueuedInputListener(listener);
+    mLatencySampler = new InputLatencySampler(mQueuedListener, LATENCY_SAMPLE_INTERVAL);
+    mReaderLaneListener = new LaneInputListener();
+    mLaneRouter = new LaneRouter(mReaderLaneListener);
+    mLanesActive = false;
+    mParallelBatchCount = 0;
 
     { // acquire lock
         AutoMutex _l(mLock);
@@ -282,6 +302,8 @@ InputReader::InputReader(const sp<EventHubInterface>& eventHub,
 }
 
 InputReader::~InputReader() {
+    stopLanesLocked();
+
     for (size_t i = 0; i < mDevices.size(); i++) {
         delete mDevices.valueAt(i);
     }
@@ -355,7 +377,15 @@ void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
     for (const RawEvent* rawEvent = rawEvents; count;) {
         int32_t type = rawEvent->type;
         size_t batchSize = 1;
-        if (type < EventHubInterface::FIRST_SYNTHETIC_EVENT) {
+        if (type < EventHubInterface::FIRST_SYNTHETIC_EVENT && !mLanes.isEmpty()) {
+            // Devices only come and go between synthetic events so all the raw events
+            // up to the next one can be cooked in parallel.
+            while (batchSize < count
+                    && rawEvent[batchSize].type < EventHubInterface::FIRST_SYNTHETIC_EVENT) {
+                batchSize += 1;
+            }
+            processEventsInLanesLocked(rawEvent, batchSize);
+        } else if (type < EventHubInterface::FIRST_SYNTHETIC_EVENT) {
             int32_t deviceId = rawEvent->deviceId;
             while (batchSize < count) {
                 if (rawEvent[batchSize].type >= EventHubInterface::FIRST_SYNTHETIC_EVENT
@@ -367,7 +397,9 @@ void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
 #if DEBUG_RAW_EVENTS
             ALOGD("BatchSize: %d Count: %d", batchSize, count);
 #endif
+            mLatencySampler->setReadTime(rawEvent[batchSize - 1].readTime);
             processEventsForDeviceLocked(deviceId, rawEvent, batchSize);
+            mLatencySampler->setReadTime(0);
         } else {
             switch (rawEvent->type) {
             case EventHubInterface::DEVICE_ADDED:
@@ -389,6 +421,167 @@ void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
     }
 }
 
+void InputReader::processEventsInLanesLocked(const RawEvent* rawEvents, size_t count) {
+    // Assign the devices that can use a lane to the lanes in order of appearance.
+    KeyedVector<int32_t, InputReaderLane*> deviceLanes;
+    for (size_t i = 0; i < count; i++) {
+        int32_t deviceId = rawEvents[i].deviceId;
+        if ((i == 0 || rawEvents[i - 1].deviceId != deviceId)
+                && deviceLanes.indexOfKey(deviceId) < 0) {
+            ssize_t deviceIndex = mDevices.indexOfKey(deviceId);
+            if (deviceIndex >= 0 && canUseLaneLocked(mDevices.valueAt(deviceIndex))) {
+                deviceLanes.add(deviceId, mLanes[deviceLanes.size() % mLanes.size()].get());
+            }
+        }
+    }
+
+    // Waking up the lanes only pays off when at least two of them have work to do.
+    bool parallel = deviceLanes.size() >= 2 && mLanes.size() >= 2;
+    if (parallel) {
+        for (size_t i = 0; i < mDevices.size(); i++) {
+            if (mDevices.valueAt(i)->getClasses() & INPUT_DEVICE_CLASS_EXTERNAL_STYLUS) {
+                parallel = false;
+                break;
+            }
+        }
+    }
+
+    if (parallel) {
+        for (size_t i = 0; i < deviceLanes.size(); i++) {
+            mLaneRouter->addRoute(deviceLanes.keyAt(i), deviceLanes.valueAt(i)->getListener());
+        }
+        mLanesActive = true;
+
+        // Start the lanes first, so that they cook their devices while the reader thread
+        // cooks the others.
+        for (size_t i = 0; i < count;) {
+            int32_t deviceId = rawEvents[i].deviceId;
+            size_t batchSize = 1;
+            while (i + batchSize < count && rawEvents[i + batchSize].deviceId == deviceId) {
+                batchSize += 1;
+            }
+            ssize_t laneIndex = deviceLanes.indexOfKey(deviceId);
+            if (laneIndex >= 0) {
+                deviceLanes.valueAt(laneIndex)->addBatch(mDevices.valueFor(deviceId),
+                        &rawEvents[i], batchSize);
+            }
+            i += batchSize;
+        }
+        for (size_t i = 0; i < mLanes.size(); i++) {
+            if (mLanes[i]->hasBatches()) {
+                mLanes[i]->start();
+            }
+        }
+    }
+
+    for (const RawEvent* rawEvent = rawEvents; count;) {
+        int32_t deviceId = rawEvent->deviceId;
+        size_t batchSize = 1;
+        while (batchSize < count && rawEvent[batchSize].deviceId == deviceId) {
+            batchSize += 1;
+        }
+        nsecs_t readTime = rawEvent[batchSize - 1].readTime;
+        if (parallel && deviceLanes.indexOfKey(deviceId) >= 0) {
+            // Already handed to its lane.
+        } else if (parallel) {
+            // Cooked on the reader thread, the router queues the events until the merge.
+            mReaderLaneListener->setReadTime(readTime);
+            processEventsForDeviceLocked(deviceId, rawEvent, batchSize);
+            mReaderLaneListener->setReadTime(0);
+        } else {
+            mLatencySampler->setReadTime(readTime);
+            processEventsForDeviceLocked(deviceId, rawEvent, batchSize);
+            mLatencySampler->setReadTime(0);
+        }
+        count -= batchSize;
+        rawEvent += batchSize;
+    }
+
+    if (parallel) {
+        for (size_t i = 0; i < mLanes.size(); i++) {
+            mLanes[i]->waitUntilIdle();
+        }
+        mLanesActive = false;
+        mLaneRouter->clearRoutes();
+        mParallelBatchCount += 1;
+        mergeLanesLocked();
+    }
+}
+
+bool InputReader::canUseLaneLocked(InputDevice* device) {
+    uint32_t classes = device->getClasses();
+    return !device->isIgnored()
+            && (classes & LANE_DEVICE_CLASSES)
+            && !(classes & NON_LANE_DEVICE_CLASSES);
+}
+
+void InputReader::mergeLanesLocked() {
+    // The queue of each lane is in the order its devices were cooked in.  Merge the
+    // queues by event time, which keeps the order of the events of each device.
+    LaneInputListener* queues[MAX_DEVICE_LANES + 1];
+    size_t positions[MAX_DEVICE_LANES + 1];
+    size_t queueCount = 0;
+    queues[queueCount++] = mReaderLaneListener.get();
+    for (size_t i = 0; i < mLanes.size(); i++) {
+        queues[queueCount++] = mLanes[i]->getListener().get();
+    }
+    for (size_t i = 0; i < queueCount; i++) {
+        positions[i] = 0;
+    }
+
+    for (;;) {
+        ssize_t oldest = -1;
+        for (size_t i = 0; i < queueCount; i++) {
+            if (positions[i] < queues[i]->size() && (oldest < 0
+                    || queues[i]->itemAt(positions[i]).eventTime
+                            < queues[oldest]->itemAt(positions[oldest]).eventTime)) {
+                oldest = i;
+            }
+        }
+        if (oldest < 0) {
+            break;
+        }
+
+        const LaneInputListener::Entry& entry = queues[oldest]->itemAt(positions[oldest]++);
+        mLatencySampler->setReadTime(entry.readTime);
+        entry.args->notify(mLatencySampler);
+    }
+    mLatencySampler->setReadTime(0);
+
+    for (size_t i = 0; i < queueCount; i++) {
+        queues[i]->clear();
+    }
+}
+
+void InputReader::updateLanesLocked() {
+    size_t laneCount = mConfig.deviceLaneCount > 0 ? size_t(mConfig.deviceLaneCount) : 0;
+    if (laneCount > MAX_DEVICE_LANES) {
+        laneCount = MAX_DEVICE_LANES;
+    }
+    if (laneCount == mLanes.size()) {
+        return;
+    }
+
+    stopLanesLocked();
+    for (size_t i = 0; i < laneCount; i++) {
+        sp<InputReaderLane> lane = new InputReaderLane();
+        status_t result = lane->run("InputReaderLane", PRIORITY_URGENT_DISPLAY);
+        if (result) {
+            ALOGE("Could not start input reader lane %zu due to error %d.", i, result);
+            break;
+        }
+        mLanes.push(lane);
+    }
+    ALOGI("Using %zu input device lanes.", mLanes.size());
+}
+
+void InputReader::stopLanesLocked() {
+    for (size_t i = 0; i < mLanes.size(); i++) {
+        mLanes[i]->stop();
+    }
+    mLanes.clear();
+}
+
 void InputReader::addDeviceLocked(nsecs_t when, int32_t deviceId) {
     ssize_t deviceIndex = mDevices.indexOfKey(deviceId);
     if (deviceIndex >= 0) {
@@ -561,6 +754,7 @@ void InputReader::handleConfigurationChangedLocked(nsecs_t when) {
 void InputReader::refreshConfigurationLocked(uint32_t changes) {
     mPolicy->getReaderConfiguration(&mConfig);
     mEventHub->setExcludedDevices(mConfig.excludedDeviceNames);
+    updateLanesLocked();
 
     if (changes) {
         ALOGI("Reconfiguring input devices.  changes=0x%08x", changes);
@@ -809,6 +1003,9 @@ void InputReader::dump(String8& dump) {
         mDevices.valueAt(i)->dump(dump);
     }
 
+    dump.appendFormat(INDENT "DeviceLanes: %zu, ParallelBatches: %u\n",
+            mLanes.size(), mParallelBatchCount);
+
     dump.append(INDENT "Configuration:\n");
     dump.append(INDENT2 "ExcludedDeviceNames: [");
     for (size_t i = 0; i < mConfig.excludedDeviceNames.size(); i++) {
@@ -860,6 +1057,8 @@ void InputReader::dump(String8& dump) {
             mConfig.pointerGestureMovementSpeedRatio);
     dump.appendFormat(INDENT3 "ZoomSpeedRatio: %0.1f\n",
             mConfig.pointerGestureZoomSpeedRatio);
+
+    dump.appendFormat(INDENT2 "DeviceLaneCount: %d\n", mConfig.deviceLaneCount);
 }
 
 void InputReader::monitor() {
@@ -881,38 +1080,45 @@ InputReader::ContextImpl::ContextImpl(InputReader* reader) :
 }
 
 void InputReader::ContextImpl::updateGlobalMetaState() {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, the lanes take turns
+    AutoMutex _l(mReader->mLaneLock);
     mReader->updateGlobalMetaStateLocked();
 }
 
 int32_t InputReader::ContextImpl::getGlobalMetaState() {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, the lanes take turns
+    AutoMutex _l(mReader->mLaneLock);
     return mReader->getGlobalMetaStateLocked();
 }
 
 void InputReader::ContextImpl::disableVirtualKeysUntil(nsecs_t time) {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, the lanes take turns
+    AutoMutex _l(mReader->mLaneLock);
     mReader->disableVirtualKeysUntilLocked(time);
 }
 
 bool InputReader::ContextImpl::shouldDropVirtualKey(nsecs_t now,
         InputDevice* device, int32_t keyCode, int32_t scanCode) {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, the lanes take turns
+    AutoMutex _l(mReader->mLaneLock);
     return mReader->shouldDropVirtualKeyLocked(now, device, keyCode, scanCode);
 }
 
 void InputReader::ContextImpl::fadePointer() {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, the lanes take turns
+    AutoMutex _l(mReader->mLaneLock);
     mReader->fadePointerLocked();
 }
 
 void InputReader::ContextImpl::requestTimeoutAtTime(nsecs_t when) {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, the lanes take turns
+    AutoMutex _l(mReader->mLaneLock);
     mReader->requestTimeoutAtTimeLocked(when);
 }
 
 int32_t InputReader::ContextImpl::bumpGeneration() {
-    // lock is already held by the input loop
+    // lock is already held by the input loop, the lanes take turns
+    AutoMutex _l(mReader->mLaneLock);
     return mReader->bumpGenerationLocked();
 }
 
@@ -930,7 +1136,10 @@ InputReaderPolicyInterface* InputReader::ContextImpl::getPolicy() {
 }
 
 InputListenerInterface* InputReader::ContextImpl::getListener() {
-    return mReader->mQueuedListener.get();
+    if (mReader->mLanesActive) {
+        return mReader->mLaneRouter.get();
+    }
+    return mReader->mLatencySampler.get();
 }
 
 EventHubInterface* InputReader::ContextImpl::getEventHub() {
@@ -938,6 +1147,42 @@ EventHubInterface* InputReader::ContextImpl::getEventHub() {
 }
 
 
+// --- InputReader::LaneRouter ---
+
+InputReader::LaneRouter::LaneRouter(const sp<LaneInputListener>& defaultListener) :
+        mDefaultListener(defaultListener) {
+}
+
+InputReader::LaneRouter::~LaneRouter() {
+}
+
+LaneInputListener* InputReader::LaneRouter::getListener(int32_t deviceId) const {
+    ssize_t index = mRoutes.indexOfKey(deviceId);
+    return index >= 0 ? mRoutes.valueAt(index).get() : mDefaultListener.get();
+}
+
+void InputReader::LaneRouter::notifyConfigurationChanged(
+        const NotifyConfigurationChangedArgs* args) {
+    mDefaultListener->notifyConfigurationChanged(args);
+}
+
+void InputReader::LaneRouter::notifyKey(const NotifyKeyArgs* args) {
+    getListener(args->deviceId)->notifyKey(args);
+}
+
+void InputReader::LaneRouter::notifyMotion(const NotifyMotionArgs* args) {
+    getListener(args->deviceId)->notifyMotion(args);
+}
+
+void InputReader::LaneRouter::notifySwitch(const NotifySwitchArgs* args) {
+    mDefaultListener->notifySwitch(args);
+}
+
+void InputReader::LaneRouter::notifyDeviceReset(const NotifyDeviceResetArgs* args) {
+    getListener(args->deviceId)->notifyDeviceReset(args);
+}
+
+
 // --- InputReaderThread ---
 
 InputReaderThread::InputReaderThread(const sp<InputReaderInterface>& reader) :
@@ -953,6 +1198,118 @@ bool InputReaderThread::threadLoop() {
 }
 
 
+// --- LaneInputListener ---
+
+LaneInputListener::LaneInputListener() :
+        mReadTime(0) {
+}
+
+LaneInputListener::~LaneInputListener() {
+    clear();
+}
+
+void LaneInputListener::clear() {
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        delete mEntries[i].args;
+    }
+    mEntries.clear();
+}
+
+void LaneInputListener::enqueue(NotifyArgs* args, nsecs_t eventTime) {
+    Entry entry;
+    entry.args = args;
+    entry.eventTime = eventTime;
+    entry.readTime = mReadTime;
+    mEntries.push(entry);
+}
+
+void LaneInputListener::notifyConfigurationChanged(const NotifyConfigurationChangedArgs* args) {
+    enqueue(new NotifyConfigurationChangedArgs(*args), args->eventTime);
+}
+
+void LaneInputListener::notifyKey(const NotifyKeyArgs* args) {
+    enqueue(new NotifyKeyArgs(*args), args->eventTime);
+}
+
+void LaneInputListener::notifyMotion(const NotifyMotionArgs* args) {
+    enqueue(new NotifyMotionArgs(*args), args->eventTime);
+}
+
+void LaneInputListener::notifySwitch(const NotifySwitchArgs* args) {
+    enqueue(new NotifySwitchArgs(*args), args->eventTime);
+}
+
+void LaneInputListener::notifyDeviceReset(const NotifyDeviceResetArgs* args) {
+    enqueue(new NotifyDeviceResetArgs(*args), args->eventTime);
+}
+
+
+// --- InputReaderLane ---
+
+InputReaderLane::InputReaderLane() :
+        Thread(/*canCallJava*/ false), mBusy(false) {
+    mListener = new LaneInputListener();
+}
+
+InputReaderLane::~InputReaderLane() {
+}
+
+void InputReaderLane::addBatch(InputDevice* device, const RawEvent* rawEvents, size_t count) {
+    Batch batch;
+    batch.device = device;
+    batch.rawEvents = rawEvents;
+    batch.count = count;
+    mBatches.push(batch);
+}
+
+void InputReaderLane::start() {
+    AutoMutex _l(mLock);
+    mBusy = true;
+    mCondition.broadcast();
+}
+
+void InputReaderLane::waitUntilIdle() {
+    AutoMutex _l(mLock);
+    while (mBusy) {
+        mCondition.wait(mLock);
+    }
+}
+
+void InputReaderLane::stop() {
+    { // acquire lock
+        AutoMutex _l(mLock);
+        requestExit();
+        mCondition.broadcast();
+    } // release lock
+    join();
+}
+
+bool InputReaderLane::threadLoop() {
+    { // acquire lock
+        AutoMutex _l(mLock);
+        while (!mBusy) {
+            if (exitPending()) {
+                return false;
+            }
+            mCondition.wait(mLock);
+        }
+    } // release lock
+
+    for (size_t i = 0; i < mBatches.size(); i++) {
+        const Batch& batch = mBatches.itemAt(i);
+        mListener->setReadTime(batch.rawEvents[batch.count - 1].readTime);
+        batch.device->process(batch.rawEvents, batch.count);
+    }
+    mListener->setReadTime(0);
+    mBatches.clear();
+
+    AutoMutex _l(mLock);
+    mBusy = false;
+    mCondition.broadcast();
+    return true;
+}
+
+
 // --- InputDevice ---
 
 InputDevice::InputDevice(InputReaderContext* context, int32_t id, int32_t generation,
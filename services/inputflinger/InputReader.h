@@ -247,6 +247,11 @@ struct InputReaderConfiguration {
     // 0 - disabled, 1 - phone or hybrid rotation mode, 2 - tablet rotation mode
     int volumeKeysRotationMode;
 
+    // Number of threads that cook the raw events of touch, cursor and joystick devices
+    // in parallel when several of them report at the same time.
+    // May be 0 to cook all events on the reader thread.
+    int32_t deviceLaneCount;
+
     InputReaderConfiguration() :
             virtualKeyQuietTime(0),
             pointerVelocityControlParameters(1.0f, 500.0f, 3000.0f, 3.0f),
@@ -266,7 +271,8 @@ struct InputReaderConfiguration {
             showTouches(false),
             stylusIconEnabled(false),
             stylusPalmRejectionTime(50 * 10000000LL), // 50 ms
-            volumeKeysRotationMode(0)
+            volumeKeysRotationMode(0),
+            deviceLaneCount(0)
     { }
 
     bool getDisplayInfo(bool external, DisplayViewport* outViewport) const;
@@ -452,6 +458,87 @@ public:
 };
 
 
+/*
+ * An implementation of the listener interface that queues up the events cooked on one
+ * device lane, along with the read time of the raw events they were produced from,
+ * until the reader merges the lanes back into its own queue.
+ */
+class LaneInputListener : public InputListenerInterface {
+protected:
+    virtual ~LaneInputListener();
+
+public:
+    struct Entry {
+        NotifyArgs* args;
+        nsecs_t eventTime;
+        nsecs_t readTime;
+    };
+
+    LaneInputListener();
+
+    // Sets the read time of the raw events being cooked.
+    inline void setReadTime(nsecs_t readTime) { mReadTime = readTime; }
+
+    inline size_t size() const { return mEntries.size(); }
+    inline const Entry& itemAt(size_t index) const { return mEntries.itemAt(index); }
+    void clear();
+
+    virtual void notifyConfigurationChanged(const NotifyConfigurationChangedArgs* args);
+    virtual void notifyKey(const NotifyKeyArgs* args);
+    virtual void notifyMotion(const NotifyMotionArgs* args);
+    virtual void notifySwitch(const NotifySwitchArgs* args);
+    virtual void notifyDeviceReset(const NotifyDeviceResetArgs* args);
+
+private:
+    Vector<Entry> mEntries;
+    nsecs_t mReadTime;
+
+    void enqueue(NotifyArgs* args, nsecs_t eventTime);
+};
+
+
+/*
+ * Cooks the raw events of the input devices assigned to it on its own thread.
+ *
+ * The reader thread adds batches of raw events while the lane is idle, starts it and
+ * waits for it to become idle again, so the devices are never touched by two threads
+ * at once.  See InputReader::processEventsInLanesLocked.
+ */
+class InputReaderLane : public Thread {
+public:
+    InputReaderLane();
+    virtual ~InputReaderLane();
+
+    inline const sp<LaneInputListener>& getListener() const { return mListener; }
+
+    void addBatch(InputDevice* device, const RawEvent* rawEvents, size_t count);
+    inline bool hasBatches() const { return !mBatches.isEmpty(); }
+
+    // Processes the batches on the lane thread.
+    void start();
+    // Waits until all the batches have been processed.
+    void waitUntilIdle();
+    // Stops the lane thread and waits for it to exit.
+    void stop();
+
+private:
+    struct Batch {
+        InputDevice* device;
+        const RawEvent* rawEvents;
+        size_t count;
+    };
+
+    Mutex mLock;
+    Condition mCondition;
+    bool mBusy;
+    Vector<Batch> mBatches;
+
+    sp<LaneInputListener> mListener;
+
+    virtual bool threadLoop();
+};
+
+
 /* The input reader reads raw event data from the event hub and processes it into input events
  * that it sends to the input listener.  Some functions of the input reader, such as early
  * event filtering in low power states, are controlled by a separate policy object.
@@ -524,6 +611,35 @@ protected:
     friend class ContextImpl;
 
 private:
+    /*
+     * Routes the events cooked while the lanes are running to the queue of the thread
+     * that cooks the device.  Events of devices without a lane go to the default queue.
+     */
+    class LaneRouter : public InputListenerInterface {
+    protected:
+        virtual ~LaneRouter();
+
+    public:
+        LaneRouter(const sp<LaneInputListener>& defaultListener);
+
+        inline void addRoute(int32_t deviceId, const sp<LaneInputListener>& listener) {
+            mRoutes.add(deviceId, listener);
+        }
+        inline void clearRoutes() { mRoutes.clear(); }
+
+        virtual void notifyConfigurationChanged(const NotifyConfigurationChangedArgs* args);
+        virtual void notifyKey(const NotifyKeyArgs* args);
+        virtual void notifyMotion(const NotifyMotionArgs* args);
+        virtual void notifySwitch(const NotifySwitchArgs* args);
+        virtual void notifyDeviceReset(const NotifyDeviceResetArgs* args);
+
+    private:
+        sp<LaneInputListener> mDefaultListener;
+        KeyedVector<int32_t, sp<LaneInputListener> > mRoutes;
+
+        LaneInputListener* getListener(int32_t deviceId) const;
+    };
+
     Mutex mLock;
 
     Condition mReaderIsAliveCondition;
@@ -531,6 +647,7 @@ private:
     sp<EventHubInterface> mEventHub;
     sp<InputReaderPolicyInterface> mPolicy;
     sp<QueuedInputListener> mQueuedListener;
+    sp<InputLatencySampler> mLatencySampler;
 
     InputReaderConfiguration mConfig;
 
@@ -540,8 +657,23 @@ private:
 
     KeyedVector<int32_t, InputDevice*> mDevices;
 
+    // Parallel cooking of the raw events of independent devices.
+    // The context calls of the mappers running on the lanes, and of the mappers cooked on
+    // the reader thread meanwhile, are serialized by mLaneLock.
+    Mutex mLaneLock;
+    Vector<sp<InputReaderLane> > mLanes;
+    sp<LaneInputListener> mReaderLaneListener;
+    sp<LaneRouter> mLaneRouter;
+    bool mLanesActive;
+    uint32_t mParallelBatchCount;
+
     // low-level input event decoding and device management
     void processEventsLocked(const RawEvent* rawEvents, size_t count);
+    void processEventsInLanesLocked(const RawEvent* rawEvents, size_t count);
+    bool canUseLaneLocked(InputDevice* device);
+    void mergeLanesLocked();
+    void updateLanesLocked();
+    void stopLanesLocked();
 
     void addDeviceLocked(nsecs_t when, int32_t deviceId);
     void removeDeviceLocked(nsecs_t when, int32_t deviceId);
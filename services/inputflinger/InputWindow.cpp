@@ -26,6 +26,22 @@
 
 namespace android {
 
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+template<typename T>
+static uint64_t hashValue(uint64_t hash, const T& value) {
+    return hashBytes(hash, &value, sizeof(value));
+}
+
 // --- InputWindowInfo ---
 void InputWindowInfo::addTouchableRegion(const Rect& region) {
     touchableRegion.orSelf(region);
@@ -59,6 +75,38 @@ bool InputWindowInfo::overlaps(const InputWindowInfo* other) const {
             && frameTop < other->frameBottom && frameBottom > other->frameTop;
 }
 
+uint64_t InputWindowInfo::getContentHash() const {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    hash = hashValue(hash, inputChannel.get());
+    hash = hashBytes(hash, name.string(), name.size());
+    hash = hashValue(hash, layoutParamsFlags);
+    hash = hashValue(hash, layoutParamsType);
+    hash = hashValue(hash, dispatchingTimeout);
+    hash = hashValue(hash, frameLeft);
+    hash = hashValue(hash, frameTop);
+    hash = hashValue(hash, frameRight);
+    hash = hashValue(hash, frameBottom);
+    hash = hashValue(hash, scaleFactor);
+    for (Region::const_iterator rect = touchableRegion.begin();
+            rect != touchableRegion.end(); rect++) {
+        hash = hashValue(hash, rect->left);
+        hash = hashValue(hash, rect->top);
+        hash = hashValue(hash, rect->right);
+        hash = hashValue(hash, rect->bottom);
+    }
+    hash = hashValue(hash, visible);
+    hash = hashValue(hash, canReceiveKeys);
+    hash = hashValue(hash, hasFocus);
+    hash = hashValue(hash, hasWallpaper);
+    hash = hashValue(hash, paused);
+    hash = hashValue(hash, layer);
+    hash = hashValue(hash, ownerPid);
+    hash = hashValue(hash, ownerUid);
+    hash = hashValue(hash, inputFeatures);
+    hash = hashValue(hash, displayId);
+    return hash;
+}
+
 
 // --- InputWindowHandle ---
 
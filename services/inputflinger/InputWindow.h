@@ -149,6 +149,11 @@ struct InputWindowInfo {
     bool supportsSplitTouch() const;
 
     bool overlaps(const InputWindowInfo* other) const;
+
+    /* Returns a hash of all of the fields, which tells whether the window changed
+     * between two updates without keeping a copy of the previous info around.
+     */
+    uint64_t getContentHash() const;
 };
 
 
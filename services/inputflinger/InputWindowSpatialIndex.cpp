@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputWindowSpatialIndex"
+
+#include "InputWindowSpatialIndex.h"
+
+#include <utils/SortedVector.h>
+
+#include <algorithm>
+
+namespace android {
+
+// A window that covers more than this many cells is returned by every query
+// of its display instead of being added to each of the cells.
+static const int32_t MAX_CELLS_PER_ENTRY =
+        InputWindowSpatialIndex::GRID_SIZE * InputWindowSpatialIndex::GRID_SIZE / 4;
+
+static inline bool rectContainsPoint(const Rect& rect, int32_t x, int32_t y) {
+    return x >= rect.left && x < rect.right && y >= rect.top && y < rect.bottom;
+}
+
+static inline bool rectsOverlap(const Rect& a, const Rect& b) {
+    return a.left < b.right && a.right > b.left && a.top < b.bottom && a.bottom > b.top;
+}
+
+static Rect unionRects(const Rect& a, const Rect& b) {
+    if (a.isEmpty()) {
+        return b;
+    }
+    if (b.isEmpty()) {
+        return a;
+    }
+    return Rect(std::min(a.left, b.left), std::min(a.top, b.top),
+            std::max(a.right, b.right), std::max(a.bottom, b.bottom));
+}
+
+
+// --- InputWindowSpatialIndex ---
+
+InputWindowSpatialIndex::InputWindowSpatialIndex() :
+        mUpdateCount(0), mRebuildCount(0) {
+}
+
+bool InputWindowSpatialIndex::Entry::operator==(const Entry& other) const {
+    return handle == other.handle && bounds == other.bounds && global == other.global;
+}
+
+bool InputWindowSpatialIndex::makeEntry(const sp<InputWindowHandle>& windowHandle,
+        Entry* outEntry) {
+    const InputWindowInfo* info = windowHandle->getInfo();
+    if (!info || !info->visible) {
+        return false;
+    }
+
+    int32_t flags = info->layoutParamsFlags;
+    bool isTouchModal = !(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)
+            && (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+                    | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+
+    outEntry->handle = windowHandle.get();
+    outEntry->bounds = unionRects(
+            Rect(info->frameLeft, info->frameTop, info->frameRight, info->frameBottom),
+            info->touchableRegion.getBounds());
+    outEntry->global = isTouchModal || (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH);
+    return true;
+}
+
+void InputWindowSpatialIndex::update(const Vector<sp<InputWindowHandle> >& windowHandles) {
+    mUpdateCount += 1;
+
+    KeyedVector<int32_t, DisplayIndex> displays;
+    mWindowIndices.clear();
+    for (size_t i = 0; i < windowHandles.size(); i++) {
+        const sp<InputWindowHandle>& windowHandle = windowHandles.itemAt(i);
+        if (mWindowIndices.indexOfKey(windowHandle.get()) < 0) {
+            mWindowIndices.add(windowHandle.get(), i);
+        }
+
+        Entry entry;
+        if (!makeEntry(windowHandle, &entry)) {
+            continue;
+        }
+        int32_t displayId = windowHandle->getInfo()->displayId;
+        ssize_t index = displays.indexOfKey(displayId);
+        if (index < 0) {
+            index = displays.add(displayId, DisplayIndex());
+        }
+        DisplayIndex& display = displays.editValueAt(index);
+        display.entries.push(entry);
+        display.windowIndices.push(i);
+    }
+
+    for (size_t d = 0; d < displays.size(); d++) {
+        DisplayIndex& display = displays.editValueAt(d);
+
+        // Most updates only touch the windows of one display, keep the grids
+        // of the others. Their positions in the window list were refreshed above.
+        ssize_t oldIndex = mDisplays.indexOfKey(displays.keyAt(d));
+        bool unchanged = oldIndex >= 0;
+        if (unchanged) {
+            const DisplayIndex& oldDisplay = mDisplays.valueAt(oldIndex);
+            unchanged = oldDisplay.entries.size() == display.entries.size();
+            for (size_t i = 0; unchanged && i < display.entries.size(); i++) {
+                unchanged = oldDisplay.entries.itemAt(i) == display.entries.itemAt(i);
+            }
+            if (unchanged) {
+                display.globalEntries = oldDisplay.globalEntries;
+                display.bounds = oldDisplay.bounds;
+                display.cellWidth = oldDisplay.cellWidth;
+                display.cellHeight = oldDisplay.cellHeight;
+                display.cellStarts = oldDisplay.cellStarts;
+                display.cellEntries = oldDisplay.cellEntries;
+            }
+        }
+        if (!unchanged) {
+            display.build();
+            mRebuildCount += 1;
+        }
+    }
+    mDisplays = displays;
+}
+
+void InputWindowSpatialIndex::clear() {
+    mDisplays.clear();
+    mWindowIndices.clear();
+}
+
+ssize_t InputWindowSpatialIndex::indexOf(const sp<InputWindowHandle>& windowHandle) const {
+    ssize_t index = mWindowIndices.indexOfKey(windowHandle.get());
+    return index >= 0 ? ssize_t(mWindowIndices.valueAt(index)) : -1;
+}
+
+void InputWindowSpatialIndex::findCandidatesAt(int32_t displayId, int32_t x, int32_t y,
+        Vector<size_t>& outIndices) const {
+    outIndices.clear();
+    ssize_t index = mDisplays.indexOfKey(displayId);
+    if (index < 0) {
+        return;
+    }
+    const DisplayIndex& display = mDisplays.valueAt(index);
+
+    const uint32_t* cell = NULL;
+    const uint32_t* cellEnd = NULL;
+    if (rectContainsPoint(display.bounds, x, y)) {
+        size_t c = size_t((y - display.bounds.top) / display.cellHeight) * GRID_SIZE
+                + size_t((x - display.bounds.left) / display.cellWidth);
+        cell = display.cellEntries.array() + display.cellStarts.itemAt(c);
+        cellEnd = display.cellEntries.array() + display.cellStarts.itemAt(c + 1);
+    }
+
+    // Both lists are sorted front to back, merge them.
+    const uint32_t* global = display.globalEntries.array();
+    const uint32_t* globalEnd = global + display.globalEntries.size();
+    while (cell != cellEnd || global != globalEnd) {
+        uint32_t entry;
+        if (global == globalEnd || (cell != cellEnd && *cell < *global)) {
+            entry = *cell++;
+            if (!rectContainsPoint(display.entries.itemAt(entry).bounds, x, y)) {
+                continue;
+            }
+        } else {
+            entry = *global++;
+        }
+        outIndices.push(display.windowIndices.itemAt(entry));
+    }
+}
+
+void InputWindowSpatialIndex::findCandidatesInRect(int32_t displayId, const Rect& rect,
+        Vector<size_t>& outIndices) const {
+    outIndices.clear();
+    ssize_t index = mDisplays.indexOfKey(displayId);
+    if (index < 0) {
+        return;
+    }
+    const DisplayIndex& display = mDisplays.valueAt(index);
+
+    SortedVector<uint32_t> entries;
+    for (size_t i = 0; i < display.globalEntries.size(); i++) {
+        entries.add(display.globalEntries.itemAt(i));
+    }
+    int32_t left, top, right, bottom;
+    if (display.getCellRange(rect, &left, &top, &right, &bottom)) {
+        for (int32_t row = top; row <= bottom; row++) {
+            for (int32_t col = left; col <= right; col++) {
+                size_t c = size_t(row) * GRID_SIZE + size_t(col);
+                for (uint32_t i = display.cellStarts.itemAt(c);
+                        i < display.cellStarts.itemAt(c + 1); i++) {
+                    uint32_t entry = display.cellEntries.itemAt(i);
+                    if (rectsOverlap(display.entries.itemAt(entry).bounds, rect)) {
+                        entries.add(entry);
+                    }
+                }
+            }
+        }
+    }
+
+    outIndices.setCapacity(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        outIndices.push(display.windowIndices.itemAt(entries.itemAt(i)));
+    }
+}
+
+void InputWindowSpatialIndex::dump(String8& dump) const {
+    dump.appendFormat("updates=%u, rebuilds=%u\n", mUpdateCount, mRebuildCount);
+    for (size_t d = 0; d < mDisplays.size(); d++) {
+        const DisplayIndex& display = mDisplays.valueAt(d);
+        dump.appendFormat("    display %d: windows=%zu, global=%zu, "
+                "bounds=[%d,%d][%d,%d], cell=%dx%d, cellEntries=%zu\n",
+                mDisplays.keyAt(d), display.entries.size(), display.globalEntries.size(),
+                display.bounds.left, display.bounds.top,
+                display.bounds.right, display.bounds.bottom,
+                display.cellWidth, display.cellHeight, display.cellEntries.size());
+    }
+}
+
+
+// --- InputWindowSpatialIndex::DisplayIndex ---
+
+InputWindowSpatialIndex::DisplayIndex::DisplayIndex() :
+        cellWidth(0), cellHeight(0) {
+}
+
+void InputWindowSpatialIndex::DisplayIndex::build() {
+    globalEntries.clear();
+    cellStarts.clear();
+    cellEntries.clear();
+
+    bounds = Rect();
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry& entry = entries.itemAt(i);
+        if (!entry.global) {
+            bounds = unionRects(bounds, entry.bounds);
+        }
+    }
+    cellWidth = std::max(int32_t(1), (bounds.getWidth() + GRID_SIZE - 1) / GRID_SIZE);
+    cellHeight = std::max(int32_t(1), (bounds.getHeight() + GRID_SIZE - 1) / GRID_SIZE);
+
+    // Count the entries of each cell first so that they can all be stored
+    // contiguously, then fill the cells front to back.
+    cellStarts.insertAt(0, 0, GRID_SIZE * GRID_SIZE + 1);
+    uint32_t* starts = cellStarts.editArray();
+    Vector<bool> bucketed;
+    bucketed.insertAt(false, 0, entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry& entry = entries.itemAt(i);
+        int32_t left, top, right, bottom;
+        if (entry.global) {
+            globalEntries.push(i);
+            continue;
+        }
+        if (!getCellRange(entry.bounds, &left, &top, &right, &bottom)) {
+            continue; // empty, can't contain anything
+        }
+        if ((right - left + 1) * (bottom - top + 1) > MAX_CELLS_PER_ENTRY) {
+            globalEntries.push(i);
+            continue;
+        }
+        bucketed.editItemAt(i) = true;
+        for (int32_t row = top; row <= bottom; row++) {
+            for (int32_t col = left; col <= right; col++) {
+                starts[row * GRID_SIZE + col + 1] += 1;
+            }
+        }
+    }
+    for (size_t c = 0; c < GRID_SIZE * GRID_SIZE; c++) {
+        starts[c + 1] += starts[c];
+    }
+
+    cellEntries.insertAt(0, 0, starts[GRID_SIZE * GRID_SIZE]);
+    uint32_t* cells = cellEntries.editArray();
+    Vector<uint32_t> fill(cellStarts);
+    uint32_t* next = fill.editArray();
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (!bucketed.itemAt(i)) {
+            continue;
+        }
+        int32_t left, top, right, bottom;
+        getCellRange(entries.itemAt(i).bounds, &left, &top, &right, &bottom);
+        for (int32_t row = top; row <= bottom; row++) {
+            for (int32_t col = left; col <= right; col++) {
+                cells[next[row * GRID_SIZE + col]++] = i;
+            }
+        }
+    }
+}
+
+bool InputWindowSpatialIndex::DisplayIndex::getCellRange(const Rect& rect,
+        int32_t* outLeft, int32_t* outTop, int32_t* outRight, int32_t* outBottom) const {
+    if (!rectsOverlap(rect, bounds)) {
+        return false;
+    }
+    *outLeft = (std::max(rect.left, bounds.left) - bounds.left) / cellWidth;
+    *outTop = (std::max(rect.top, bounds.top) - bounds.top) / cellHeight;
+    *outRight = (std::min(rect.right, bounds.right) - 1 - bounds.left) / cellWidth;
+    *outBottom = (std::min(rect.bottom, bounds.bottom) - 1 - bounds.top) / cellHeight;
+    return true;
+}
+
+} // namespace android
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_WINDOW_SPATIAL_INDEX_H
+#define _UI_INPUT_WINDOW_SPATIAL_INDEX_H
+
+#include <ui/Rect.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include "InputWindow.h"
+
+namespace android {
+
+/*
+ * Speeds up hit-testing of the input windows.
+ *
+ * The windows of each display are bucketed into a uniform grid over the area
+ * they cover. A query returns the windows that may contain a point (or overlap
+ * a rectangle), front to back, as indices into the z-ordered window list the
+ * index was last updated with. The caller still has to check each candidate
+ * against its own criteria: the index only rules out windows that cannot
+ * possibly match because neither their frame nor their touchable region
+ * reaches the queried area.
+ *
+ * Some windows are returned by every query of their display: touch modal
+ * windows and windows that watch outside touches, which must be considered
+ * wherever the touch is, as well as windows large enough that bucketing them
+ * would cost more than it saves. Invisible windows are never returned.
+ *
+ * The index is not thread-safe, the dispatcher updates and queries it with
+ * its lock held.
+ */
+class InputWindowSpatialIndex {
+public:
+    // Number of cells of the grid along each axis.
+    enum { GRID_SIZE = 16 };
+
+    InputWindowSpatialIndex();
+
+    // Updates the index for the given window list, ordered front to back.
+    // The grids of the displays whose windows did not move since the previous
+    // update are kept as they are.
+    void update(const Vector<sp<InputWindowHandle> >& windowHandles);
+
+    void clear();
+
+    // Returns the position of the window in the window list, or -1 if the
+    // index doesn't know about it.
+    ssize_t indexOf(const sp<InputWindowHandle>& windowHandle) const;
+
+    // Collects the windows of the display whose frame or touchable region may
+    // contain the point, in increasing order of their position in the window list.
+    void findCandidatesAt(int32_t displayId, int32_t x, int32_t y,
+            Vector<size_t>& outIndices) const;
+
+    // Collects the windows of the display whose frame or touchable region may
+    // overlap the rectangle, in increasing order of their position in the
+    // window list.
+    void findCandidatesInRect(int32_t displayId, const Rect& rect,
+            Vector<size_t>& outIndices) const;
+
+    void dump(String8& dump) const;
+
+private:
+    struct Entry {
+        const InputWindowHandle* handle;
+        // Union of the frame and the bounds of the touchable region.
+        Rect bounds;
+        // True if the window must be returned by every query of the display.
+        bool global;
+
+        bool operator==(const Entry& other) const;
+        bool operator!=(const Entry& other) const { return !(*this == other); }
+    };
+
+    struct DisplayIndex {
+        DisplayIndex();
+
+        // Indexed windows of the display, front to back.
+        Vector<Entry> entries;
+        // Position of each entry in the window list.
+        Vector<size_t> windowIndices;
+        // Entries that are returned by every query.
+        Vector<uint32_t> globalEntries;
+
+        // Area covered by the grid, the union of the bounds of the entries.
+        Rect bounds;
+        int32_t cellWidth;
+        int32_t cellHeight;
+        // The entries of cell c are cellEntries[cellStarts[c]..cellStarts[c + 1]),
+        // front to back.
+        Vector<uint32_t> cellStarts;
+        Vector<uint32_t> cellEntries;
+
+        void build();
+        // Computes the cells covered by the rectangle, returns false if it
+        // misses the grid.
+        bool getCellRange(const Rect& rect, int32_t* outLeft, int32_t* outTop,
+                int32_t* outRight, int32_t* outBottom) const;
+    };
+
+    static bool makeEntry(const sp<InputWindowHandle>& windowHandle, Entry* outEntry);
+
+    KeyedVector<int32_t, DisplayIndex> mDisplays;
+    KeyedVector<const InputWindowHandle*, size_t> mWindowIndices;
+
+    // Statistics, for dumpsys.
+    uint32_t mUpdateCount;
+    uint32_t mRebuildCount;
+};
+
+} // namespace android
+
+#endif // _UI_INPUT_WINDOW_SPATIAL_INDEX_H
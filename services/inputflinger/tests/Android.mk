@@ -5,7 +5,9 @@ include $(CLEAR_VARS)
 # Build the unit tests.
 test_src_files := \
     InputReader_test.cpp \
-    InputDispatcher_test.cpp
+    InputDispatcher_test.cpp \
+    InputLatencyTracker_test.cpp \
+    InputWindowSpatialIndex_test.cpp
 
 shared_libraries := \
     libcutils \
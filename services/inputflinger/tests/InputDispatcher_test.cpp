@@ -97,6 +97,53 @@ private:
 };
 
 
+// --- FakeInputWindowHandle ---
+
+class FakeInputWindowHandle : public InputWindowHandle {
+public:
+    InputWindowInfo info;
+
+    FakeInputWindowHandle(const char* name, int32_t left, int32_t top,
+            int32_t right, int32_t bottom) :
+            InputWindowHandle(NULL) {
+        sp<InputChannel> clientChannel;
+        InputChannel::openInputChannelPair(String8(name), info.inputChannel, clientChannel);
+        info.name = name;
+        info.layoutParamsFlags = 0;
+        info.layoutParamsType = InputWindowInfo::TYPE_APPLICATION;
+        info.dispatchingTimeout = seconds_to_nanoseconds(5);
+        info.frameLeft = left;
+        info.frameTop = top;
+        info.frameRight = right;
+        info.frameBottom = bottom;
+        info.scaleFactor = 1.0f;
+        info.addTouchableRegion(Rect(left, top, right, bottom));
+        info.visible = true;
+        info.canReceiveKeys = true;
+        info.hasFocus = false;
+        info.hasWallpaper = false;
+        info.paused = false;
+        info.layer = 0;
+        info.ownerPid = INJECTOR_PID;
+        info.ownerUid = INJECTOR_UID;
+        info.inputFeatures = 0;
+        info.displayId = DISPLAY_ID;
+    }
+
+    virtual bool updateInfo() {
+        if (!mInfo) {
+            mInfo = new InputWindowInfo();
+        }
+        *mInfo = info;
+        return true;
+    }
+
+protected:
+    virtual ~FakeInputWindowHandle() {
+    }
+};
+
+
 // --- InputDispatcherTest ---
 
 class InputDispatcherTest : public testing::Test {
@@ -113,6 +160,19 @@ protected:
         mFakePolicy.clear();
         mDispatcher.clear();
     }
+
+    void assertDumpContains(const char* expected) {
+        String8 dump;
+        mDispatcher->dump(dump);
+        ASSERT_TRUE(strstr(dump.string(), expected) != NULL)
+                << "Expected '" << expected << "' in:\n" << dump.string();
+    }
+
+    void enqueueKey() {
+        NotifyKeyArgs args(ARBITRARY_TIME, DEVICE_ID, AINPUT_SOURCE_KEYBOARD, 0,
+                AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_A, KEY_A, AMETA_NONE, ARBITRARY_TIME);
+        mDispatcher->notifyKey(&args);
+    }
 };
 
 
@@ -253,4 +313,91 @@ TEST_F(InputDispatcherTest, InjectInputEvent_ValidatesMotionEvents) {
             << "Should reject motion events with duplicate pointer ids.";
 }
 
+TEST_F(InputDispatcherTest, SetInputWindows_SkipsUnchangedWindows) {
+    sp<FakeInputWindowHandle> first = new FakeInputWindowHandle("first", 0, 0, 100, 100);
+    sp<FakeInputWindowHandle> second = new FakeInputWindowHandle("second", 0, 100, 100, 200);
+    Vector<sp<InputWindowHandle> > windows;
+    windows.push(first);
+    windows.push(second);
+
+    mDispatcher->setInputWindows(windows);
+    mDispatcher->setInputWindows(windows);
+    ASSERT_NO_FATAL_FAILURE(assertDumpContains("applied=1, skipped=1,"));
+
+    // Moving a window is a change even though the same handles come back.
+    second->info.frameTop = 120;
+    mDispatcher->setInputWindows(windows);
+    ASSERT_NO_FATAL_FAILURE(assertDumpContains("applied=2, skipped=1,"));
+
+    // So is reordering them.
+    windows.clear();
+    windows.push(second);
+    windows.push(first);
+    mDispatcher->setInputWindows(windows);
+    ASSERT_NO_FATAL_FAILURE(assertDumpContains("applied=3, skipped=1,"));
+}
+
+TEST_F(InputDispatcherTest, SetInputWindows_DefersAndCoalescesUpdatesWhileBusy) {
+    sp<FakeInputWindowHandle> first = new FakeInputWindowHandle("first", 0, 0, 100, 100);
+    sp<FakeInputWindowHandle> second = new FakeInputWindowHandle("second", 0, 100, 100, 200);
+    Vector<sp<InputWindowHandle> > windows;
+    windows.push(first);
+    mDispatcher->setInputWindows(windows);
+
+    // Nobody dispatches the key, so the dispatcher stays busy.
+    enqueueKey();
+    second->info.frameTop = 120;
+    mDispatcher->setInputWindows(windows);
+    windows.push(second);
+    mDispatcher->setInputWindows(windows);
+
+    // Dumping leaves the deferred updates alone.
+    ASSERT_NO_FATAL_FAILURE(assertDumpContains(
+            "applied=1, skipped=0, deferred=2, coalesced=1,"));
+    ASSERT_NO_FATAL_FAILURE(assertDumpContains("PendingWindows: 2,"));
+
+    // The dispatch thread applies the latest of them, once, before it takes the key.
+    mDispatcher->dispatchOnce();
+    ASSERT_NO_FATAL_FAILURE(assertDumpContains(
+            "applied=2, skipped=0, deferred=2, coalesced=1,"));
+    ASSERT_NO_FATAL_FAILURE(assertDumpContains("name='second'"));
+    String8 dump;
+    mDispatcher->dump(dump);
+    ASSERT_TRUE(strstr(dump.string(), "PendingWindows:") == NULL);
+}
+
+TEST_F(InputDispatcherTest, SetInputWindows_FocusAndDispatchModeFollowDeferredUpdates) {
+    sp<FakeInputWindowHandle> first = new FakeInputWindowHandle("first", 0, 0, 100, 100);
+    sp<FakeInputWindowHandle> second = new FakeInputWindowHandle("second", 0, 100, 100, 200);
+    Vector<sp<InputWindowHandle> > windows;
+    windows.push(first);
+    mDispatcher->setInputWindows(windows);
+
+    enqueueKey();
+    windows.push(second);
+    mDispatcher->setInputWindows(windows);
+    mDispatcher->setFocusedApplication(NULL);
+    ASSERT_NO_FATAL_FAILURE(assertDumpContains("applied=2, skipped=0, deferred=1,"));
+
+    second->info.frameTop = 120;
+    mDispatcher->setInputWindows(windows);
+    mDispatcher->setInputDispatchMode(true, false);
+    ASSERT_NO_FATAL_FAILURE(assertDumpContains("applied=3, skipped=0, deferred=2,"));
+}
+
+TEST_F(InputDispatcherTest, SetInputWindows_AppliesRemovalsWhileBusy) {
+    sp<FakeInputWindowHandle> first = new FakeInputWindowHandle("first", 0, 0, 100, 100);
+    sp<FakeInputWindowHandle> second = new FakeInputWindowHandle("second", 0, 100, 100, 200);
+    Vector<sp<InputWindowHandle> > windows;
+    windows.push(first);
+    windows.push(second);
+    mDispatcher->setInputWindows(windows);
+
+    enqueueKey();
+    windows.removeAt(1);
+    mDispatcher->setInputWindows(windows);
+    ASSERT_NO_FATAL_FAILURE(assertDumpContains(
+            "applied=2, skipped=0, deferred=0, coalesced=0,"));
+}
+
 } // namespace android
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../InputLatencyTracker.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+
+static const nsecs_t EVENT_TIME = ms2ns(1000);
+
+static InputLatencyTrace makeTrace(nsecs_t read, nsecs_t cook, nsecs_t enqueue,
+        nsecs_t dispatch) {
+    InputLatencyTrace trace;
+    trace.readTime = EVENT_TIME + read;
+    trace.cookTime = trace.readTime + cook;
+    trace.enqueueTime = trace.cookTime + enqueue;
+    trace.dispatchTime = trace.enqueueTime + dispatch;
+    return trace;
+}
+
+
+// --- InputLatencyTrackerTest ---
+
+class InputLatencyTrackerTest : public testing::Test {
+protected:
+    InputLatencyTracker mTracker;
+
+    void addSample(const char* windowName, const InputLatencyTrace& trace,
+            nsecs_t deliver, nsecs_t finish) {
+        nsecs_t deliveryTime = trace.dispatchTime + deliver;
+        mTracker.addSample(String8(windowName), EVENT_TIME, trace,
+                deliveryTime, deliveryTime + finish);
+    }
+};
+
+TEST_F(InputLatencyTrackerTest, AddSample_SplitsTheTraceIntoStages) {
+    addSample("window", makeTrace(us2ns(100), us2ns(300), us2ns(600), ms2ns(1)),
+            ms2ns(3), ms2ns(9));
+
+    const InputLatencyTracker::Histogram* histogram;
+    histogram = mTracker.getHistogram(String8("window"), InputLatencyTracker::STAGE_READ);
+    ASSERT_TRUE(histogram != NULL);
+    EXPECT_EQ(1U, histogram->count);
+    EXPECT_EQ(us2ns(100), histogram->sum);
+    EXPECT_EQ(us2ns(300),
+            mTracker.getHistogram(String8("window"), InputLatencyTracker::STAGE_COOK)->sum);
+    EXPECT_EQ(us2ns(600),
+            mTracker.getHistogram(String8("window"), InputLatencyTracker::STAGE_ENQUEUE)->sum);
+    EXPECT_EQ(ms2ns(1),
+            mTracker.getHistogram(String8("window"), InputLatencyTracker::STAGE_QUEUE)->sum);
+    EXPECT_EQ(ms2ns(3),
+            mTracker.getHistogram(String8("window"), InputLatencyTracker::STAGE_DELIVER)->sum);
+    EXPECT_EQ(ms2ns(9),
+            mTracker.getHistogram(String8("window"), InputLatencyTracker::STAGE_FINISH)->sum);
+    EXPECT_EQ(us2ns(100 + 300 + 600) + ms2ns(1 + 3 + 9),
+            mTracker.getHistogram(String8("window"), InputLatencyTracker::STAGE_TOTAL)->sum);
+
+    EXPECT_TRUE(mTracker.getHistogram(String8("other"), InputLatencyTracker::STAGE_READ)
+            == NULL);
+}
+
+TEST_F(InputLatencyTrackerTest, AddSample_KeepsWindowsApart) {
+    for (int i = 0; i < 10; i++) {
+        addSample("fast", makeTrace(0, 0, 0, 0), 0, ms2ns(1));
+    }
+    addSample("slow", makeTrace(0, 0, 0, 0), 0, ms2ns(50));
+
+    EXPECT_EQ(10U,
+            mTracker.getHistogram(String8("fast"), InputLatencyTracker::STAGE_FINISH)->count);
+    EXPECT_EQ(ms2ns(1),
+            mTracker.getHistogram(String8("fast"), InputLatencyTracker::STAGE_FINISH)->max);
+    EXPECT_EQ(1U,
+            mTracker.getHistogram(String8("slow"), InputLatencyTracker::STAGE_FINISH)->count);
+    EXPECT_EQ(ms2ns(50),
+            mTracker.getHistogram(String8("slow"), InputLatencyTracker::STAGE_FINISH)->max);
+}
+
+TEST_F(InputLatencyTrackerTest, AddSample_ClampsNegativeDurations) {
+    // A kernel timestamp after the read time.
+    addSample("window", makeTrace(-us2ns(50), 0, 0, 0), 0, 0);
+
+    EXPECT_EQ(0,
+            mTracker.getHistogram(String8("window"), InputLatencyTracker::STAGE_READ)->sum);
+}
+
+TEST_F(InputLatencyTrackerTest, AddSample_EvictsTheLeastRecentlyUpdatedWindow) {
+    for (int i = 0; i < InputLatencyTracker::MAX_WINDOWS; i++) {
+        String8 name;
+        name.appendFormat("window %d", i);
+        addSample(name.string(), makeTrace(0, 0, 0, 0), 0, 0);
+    }
+    addSample("window 0", makeTrace(0, 0, 0, 0), 0, 0);
+    addSample("new window", makeTrace(0, 0, 0, 0), 0, 0);
+
+    EXPECT_TRUE(mTracker.getHistogram(String8("window 0"), InputLatencyTracker::STAGE_READ)
+            != NULL);
+    EXPECT_TRUE(mTracker.getHistogram(String8("window 1"), InputLatencyTracker::STAGE_READ)
+            == NULL);
+    EXPECT_TRUE(mTracker.getHistogram(String8("new window"), InputLatencyTracker::STAGE_READ)
+            != NULL);
+}
+
+TEST_F(InputLatencyTrackerTest, Histogram_ReportsPercentileBuckets) {
+    InputLatencyTracker::Histogram histogram;
+    for (int i = 0; i < 90; i++) {
+        histogram.add(us2ns(100)); // first bucket, below 125us
+    }
+    for (int i = 0; i < 9; i++) {
+        histogram.add(ms2ns(3)); // below 4ms
+    }
+    histogram.add(ms2ns(1000)); // unbounded bucket
+
+    EXPECT_EQ(us2ns(125), histogram.getPercentileBound(50));
+    EXPECT_EQ(us2ns(125), histogram.getPercentileBound(90));
+    EXPECT_EQ(ms2ns(4), histogram.getPercentileBound(99));
+    EXPECT_EQ(-1, histogram.getPercentileBound(100));
+    EXPECT_EQ(ms2ns(1000), histogram.max);
+}
+
+TEST_F(InputLatencyTrackerTest, Dump_ListsWindowsAndRecentSamples) {
+    addSample("window", makeTrace(us2ns(100), us2ns(300), us2ns(600), ms2ns(1)),
+            ms2ns(3), ms2ns(9));
+
+    String8 dump;
+    mTracker.dump(dump);
+    EXPECT_TRUE(strstr(dump.string(), "samples=1, windows=1") != NULL);
+    EXPECT_TRUE(strstr(dump.string(), "'window': samples=1") != NULL);
+    EXPECT_TRUE(strstr(dump.string(), "finish: mean=9.00ms") != NULL);
+    EXPECT_TRUE(strstr(dump.string(), "Recent:") != NULL);
+}
+
+TEST_F(InputLatencyTrackerTest, Clear_DropsHistogramsAndRecentSamples) {
+    for (int i = 0; i < InputLatencyTracker::MAX_RECENT_SAMPLES; i++) {
+        addSample("old window", makeTrace(us2ns(100), us2ns(300), us2ns(600), ms2ns(1)),
+                ms2ns(3), ms2ns(9));
+    }
+    mTracker.clear();
+    addSample("window", makeTrace(us2ns(100), us2ns(300), us2ns(600), ms2ns(1)),
+            ms2ns(3), ms2ns(9));
+
+    EXPECT_TRUE(mTracker.getHistogram(String8("old window"), InputLatencyTracker::STAGE_READ)
+            == NULL);
+    String8 dump;
+    mTracker.dump(dump);
+    EXPECT_TRUE(strstr(dump.string(), "samples=1, windows=1") != NULL);
+    EXPECT_TRUE(strstr(dump.string(), "old window") == NULL);
+}
+
+} // namespace android
@@ -19,6 +19,7 @@
 #include <utils/List.h>
 #include <gtest/gtest.h>
 #include <math.h>
+#include <pthread.h>
 
 namespace android {
 
@@ -161,6 +162,10 @@ public:
         mConfig.excludedDeviceNames.push(deviceName);
     }
 
+    void setDeviceLaneCount(int32_t deviceLaneCount) {
+        mConfig.deviceLaneCount = deviceLaneCount;
+    }
+
     void setPointerController(int32_t deviceId, const sp<FakePointerController>& controller) {
         mPointerControllers.add(deviceId, controller);
     }
@@ -270,6 +275,18 @@ public:
                 << "Expected notifyMotion() to not have been called.";
     }
 
+    bool hasNotifyConfigurationChanged() const {
+        return !mNotifyConfigurationChangedArgsQueue.empty();
+    }
+
+    bool hasNotifyDeviceReset() const {
+        return !mNotifyDeviceResetArgsQueue.empty();
+    }
+
+    bool hasNotifyMotion() const {
+        return !mNotifyMotionArgsQueue.empty();
+    }
+
     void assertNotifySwitchWasCalled(NotifySwitchArgs* outEventArgs = NULL) {
         ASSERT_FALSE(mNotifySwitchArgsQueue.empty())
                 << "Expected notifySwitch() to have been called.";
@@ -333,6 +350,7 @@ class FakeEventHub : public EventHubInterface {
     KeyedVector<int32_t, Device*> mDevices;
     Vector<String8> mExcludedDevices;
     List<RawEvent> mEvents;
+    size_t mMaxEventsPerRead;
 
 protected:
     virtual ~FakeEventHub() {
@@ -342,7 +360,11 @@ protected:
     }
 
 public:
-    FakeEventHub() { }
+    FakeEventHub() : mMaxEventsPerRead(1) { }
+
+    void setMaxEventsPerRead(size_t maxEventsPerRead) {
+        mMaxEventsPerRead = maxEventsPerRead;
+    }
 
     void addDevice(int32_t deviceId, const String8& name, uint32_t classes) {
         Device* device = new Device(classes);
@@ -449,6 +471,7 @@ public:
             int32_t code, int32_t value) {
         RawEvent event;
         event.when = when;
+        event.readTime = when;
         event.deviceId = deviceId;
         event.type = type;
         event.code = code;
@@ -465,6 +488,10 @@ public:
                 << "Expected the event queue to be empty (fully consumed).";
     }
 
+    bool isQueueEmpty() const {
+        return mEvents.empty();
+    }
+
 private:
     Device* getDevice(int32_t deviceId) const {
         ssize_t index = mDevices.indexOfKey(deviceId);
@@ -564,14 +591,13 @@ private:
         mExcludedDevices = devices;
     }
 
-    virtual size_t getEvents(int, RawEvent* buffer, size_t) {
-        if (mEvents.empty()) {
-            return 0;
+    virtual size_t getEvents(int, RawEvent* buffer, size_t bufferSize) {
+        size_t count = 0;
+        while (!mEvents.empty() && count < bufferSize && count < mMaxEventsPerRead) {
+            buffer[count++] = *mEvents.begin();
+            mEvents.erase(mEvents.begin());
         }
-
-        *buffer = *mEvents.begin();
-        mEvents.erase(mEvents.begin());
-        return 1;
+        return count;
     }
 
     virtual int32_t getScanCodeState(int32_t deviceId, int32_t scanCode) const {
@@ -803,6 +829,7 @@ class FakeInputMapper : public InputMapper {
     KeyedVector<int32_t, int32_t> mSwitchStates;
     Vector<int32_t> mSupportedKeyCodes;
     RawEvent mLastEvent;
+    pthread_t mLastProcessThread;
 
     bool mConfigureWasCalled;
     bool mResetWasCalled;
@@ -813,6 +840,7 @@ public:
             InputMapper(device),
             mSources(sources), mKeyboardType(AINPUT_KEYBOARD_TYPE_NONE),
             mMetaState(0),
+            mLastProcessThread(pthread_self()),
             mConfigureWasCalled(false), mResetWasCalled(false), mProcessWasCalled(false) {
     }
 
@@ -847,6 +875,11 @@ public:
         mProcessWasCalled = false;
     }
 
+    // The thread the last event was processed on.
+    pthread_t getLastProcessThread() const {
+        return mLastProcessThread;
+    }
+
     void setKeyCodeState(int32_t keyCode, int32_t state) {
         mKeyCodeStates.replaceValueFor(keyCode, state);
     }
@@ -886,6 +919,7 @@ private:
 
     virtual void process(const RawEvent* rawEvent) {
         mLastEvent = *rawEvent;
+        mLastProcessThread = pthread_self();
         mProcessWasCalled = true;
     }
 
@@ -927,6 +961,65 @@ private:
 };
 
 
+// --- FakeCookingInputMapper ---
+
+/*
+ * Stands in for the touch mappers of a high rate device: burns a fixed amount of
+ * work on every sync and reports a motion event carrying the sequence number of
+ * the sync and the value of the last absolute axis event.
+ */
+class FakeCookingInputMapper : public InputMapper {
+    uint32_t mCookingIterations;
+    int32_t mValue;
+    int32_t mSequence;
+    volatile uint32_t mSink;
+    pthread_t mLastProcessThread;
+
+public:
+    FakeCookingInputMapper(InputDevice* device, uint32_t cookingIterations) :
+            InputMapper(device), mCookingIterations(cookingIterations),
+            mValue(0), mSequence(0), mSink(0), mLastProcessThread(pthread_self()) {
+    }
+
+    virtual ~FakeCookingInputMapper() { }
+
+    // The thread the last event was processed on.
+    pthread_t getLastProcessThread() const {
+        return mLastProcessThread;
+    }
+
+private:
+    virtual uint32_t getSources() {
+        return AINPUT_SOURCE_TOUCHSCREEN;
+    }
+
+    virtual void process(const RawEvent* rawEvent) {
+        mLastProcessThread = pthread_self();
+        if (rawEvent->type == EV_ABS) {
+            mValue = rawEvent->value;
+        } else if (rawEvent->type == EV_SYN && rawEvent->code == SYN_REPORT) {
+            uint32_t hash = uint32_t(mValue);
+            for (uint32_t i = 0; i < mCookingIterations; i++) {
+                hash = hash * 1664525 + 1013904223;
+            }
+            mSink = hash;
+
+            PointerProperties properties;
+            properties.clear();
+            PointerCoords coords;
+            coords.clear();
+            coords.setAxisValue(AMOTION_EVENT_AXIS_X, mValue);
+            coords.setAxisValue(AMOTION_EVENT_AXIS_Y, mSequence++);
+            NotifyMotionArgs args(rawEvent->when, getDeviceId(), AINPUT_SOURCE_TOUCHSCREEN,
+                    0, AMOTION_EVENT_ACTION_MOVE, 0, 0, getContext()->getGlobalMetaState(), 0,
+                    AMOTION_EVENT_EDGE_FLAG_NONE, DISPLAY_ID, 1, &properties, &coords,
+                    0, 0, rawEvent->when);
+            getListener()->notifyMotion(&args);
+        }
+    }
+};
+
+
 // --- InstrumentedInputReader ---
 
 class InstrumentedInputReader : public InputReader {
@@ -1194,6 +1287,162 @@ TEST_F(InputReaderTest, LoopOnce_ForwardsRawEventsToMappers) {
 }
 
 
+// --- InputReaderLanesTest ---
+
+// Number of high rate devices used by the lane tests.
+static const int32_t LANE_DEVICE_COUNT = 4;
+
+class InputReaderLanesTest : public InputReaderTest {
+protected:
+    FakeCookingInputMapper* mCookingMappers[LANE_DEVICE_COUNT + 1];
+
+    // Recreates the event hub and the reader with the given number of lanes and adds the
+    // high rate devices.
+    void setUpReader(int32_t laneCount, uint32_t cookingIterations) {
+        mFakePolicy->setDeviceLaneCount(laneCount);
+        mReader.clear();
+        mFakeEventHub = new FakeEventHub();
+        mReader = new InstrumentedInputReader(mFakeEventHub, mFakePolicy, mFakeListener);
+        for (int32_t deviceId = 1; deviceId <= LANE_DEVICE_COUNT; deviceId++) {
+            mCookingMappers[deviceId] = addDeviceWithCookingInputMapper(deviceId,
+                    cookingIterations);
+        }
+        while (mFakeListener->hasNotifyDeviceReset()) {
+            mFakeListener->assertNotifyDeviceResetWasCalled();
+        }
+        mFakeEventHub->setMaxEventsPerRead(256);
+    }
+
+    FakeCookingInputMapper* addDeviceWithCookingInputMapper(int32_t deviceId,
+            uint32_t cookingIterations) {
+        String8 name;
+        name.appendFormat("touch %d", deviceId);
+        InputDevice* device = mReader->newDevice(deviceId, 0, name, INPUT_DEVICE_CLASS_TOUCH);
+        FakeCookingInputMapper* mapper = new FakeCookingInputMapper(device, cookingIterations);
+        device->addMapper(mapper);
+        mReader->setNextDevice(device);
+        addDevice(deviceId, name, INPUT_DEVICE_CLASS_TOUCH, NULL);
+        while (mFakeListener->hasNotifyConfigurationChanged()) {
+            mFakeListener->assertNotifyConfigurationChangedWasCalled();
+        }
+        return mapper;
+    }
+
+    // Enqueues a sync of every device at each time step, the devices taking turns.
+    void enqueueSyncs(nsecs_t startTime, int32_t syncCount) {
+        for (int32_t i = 0; i < syncCount; i++) {
+            for (int32_t deviceId = 1; deviceId <= LANE_DEVICE_COUNT; deviceId++) {
+                nsecs_t when = startTime + i * us2ns(100) + deviceId;
+                mFakeEventHub->enqueueEvent(when, deviceId, EV_ABS, ABS_X, i);
+                mFakeEventHub->enqueueEvent(when, deviceId, EV_SYN, SYN_REPORT, 0);
+            }
+        }
+    }
+
+    void loopUntilIdle() {
+        while (!mFakeEventHub->isQueueEmpty()) {
+            mReader->loopOnce();
+        }
+    }
+};
+
+TEST_F(InputReaderLanesTest, LoopOnce_WithLanes_KeepsPerDeviceAndTimestampOrder) {
+    setUpReader(3, 100);
+    const int32_t syncCount = 200;
+    enqueueSyncs(ARBITRARY_TIME, syncCount);
+    loopUntilIdle();
+
+    int32_t nextSequence[LANE_DEVICE_COUNT + 1] = { 0 };
+    nsecs_t lastEventTime = LLONG_MIN;
+    for (int32_t i = 0; i < syncCount * LANE_DEVICE_COUNT; i++) {
+        NotifyMotionArgs args;
+        ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasCalled(&args));
+        ASSERT_GE(args.eventTime, lastEventTime);
+        lastEventTime = args.eventTime;
+        ASSERT_GE(args.deviceId, 1);
+        ASSERT_LE(args.deviceId, LANE_DEVICE_COUNT);
+        ASSERT_EQ(nextSequence[args.deviceId]++,
+                args.pointerCoords[0].getAxisValue(AMOTION_EVENT_AXIS_Y));
+    }
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasNotCalled());
+
+    String8 dump;
+    mReader->dump(dump);
+    ASSERT_TRUE(strstr(dump.string(), "DeviceLanes: 3") != NULL);
+    ASSERT_TRUE(strstr(dump.string(), "ParallelBatches: 0") == NULL)
+            << "The devices should have been cooked in parallel.";
+}
+
+TEST_F(InputReaderLanesTest, LoopOnce_WithLanes_CooksKeyboardsOnTheReaderThread) {
+    setUpReader(2, 0);
+    FakeInputMapper* keyboardMapper = NULL;
+    ASSERT_NO_FATAL_FAILURE(keyboardMapper = addDeviceWithFakeInputMapper(LANE_DEVICE_COUNT + 1, 0,
+            String8("keyboard"), INPUT_DEVICE_CLASS_KEYBOARD, AINPUT_SOURCE_KEYBOARD, NULL));
+    mFakeEventHub->setMaxEventsPerRead(256);
+
+    enqueueSyncs(ARBITRARY_TIME, 1);
+    mFakeEventHub->enqueueEvent(ARBITRARY_TIME + 1, LANE_DEVICE_COUNT + 1, EV_KEY, KEY_A, 1);
+    enqueueSyncs(ARBITRARY_TIME + 2, 1);
+    loopUntilIdle();
+
+    RawEvent event;
+    ASSERT_NO_FATAL_FAILURE(keyboardMapper->assertProcessWasCalled(&event));
+    ASSERT_EQ(KEY_A, event.code);
+    ASSERT_TRUE(pthread_equal(pthread_self(), keyboardMapper->getLastProcessThread()))
+            << "The keyboard should have been cooked on the reader thread.";
+    for (int32_t deviceId = 1; deviceId <= LANE_DEVICE_COUNT; deviceId++) {
+        ASSERT_FALSE(pthread_equal(pthread_self(),
+                mCookingMappers[deviceId]->getLastProcessThread()))
+                << "Touch device " << deviceId << " should have been cooked on a lane.";
+    }
+    for (int32_t i = 0; i < 2 * LANE_DEVICE_COUNT; i++) {
+        ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasCalled());
+    }
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasNotCalled());
+}
+
+TEST_F(InputReaderLanesTest, LoopOnce_WithoutLanes_CooksOnTheReaderThread) {
+    setUpReader(0, 0);
+    enqueueSyncs(ARBITRARY_TIME, 10);
+    loopUntilIdle();
+
+    for (int32_t i = 0; i < 10 * LANE_DEVICE_COUNT; i++) {
+        ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasCalled());
+    }
+
+    String8 dump;
+    mReader->dump(dump);
+    ASSERT_TRUE(strstr(dump.string(), "DeviceLanes: 0, ParallelBatches: 0") != NULL);
+}
+
+// Compares the throughput of the reader thread alone with the lanes for four devices
+// reporting at the same time.  Not a pass/fail test, the numbers are printed for
+// comparison on the device.
+TEST_F(InputReaderLanesTest, Benchmark_LoopOnce_HighRateDevices) {
+    const int32_t kSyncCount = 2000;
+    const uint32_t kCookingIterations = 5000;
+    const int32_t laneCounts[] = { 0, 2, 4 };
+
+    for (size_t i = 0; i < sizeof(laneCounts) / sizeof(laneCounts[0]); i++) {
+        setUpReader(laneCounts[i], kCookingIterations);
+        enqueueSyncs(ARBITRARY_TIME, kSyncCount);
+
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        loopUntilIdle();
+        nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        int32_t eventCount = 0;
+        while (mFakeListener->hasNotifyMotion()) {
+            mFakeListener->assertNotifyMotionWasCalled();
+            eventCount += 1;
+        }
+        ASSERT_EQ(kSyncCount * LANE_DEVICE_COUNT, eventCount);
+        printf("%d lanes: %d events in %.3f ms, %.0f events/s\n", laneCounts[i],
+                eventCount, elapsed * 0.000001, eventCount * 1000000000.0 / elapsed);
+    }
+}
+
+
 // --- InputDeviceTest ---
 
 class InputDeviceTest : public testing::Test {
@@ -1442,6 +1691,7 @@ protected:
             int32_t code, int32_t value) {
         RawEvent event;
         event.when = when;
+        event.readTime = when;
         event.deviceId = deviceId;
         event.type = type;
         event.code = code;
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../InputWindowSpatialIndex.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+static const int32_t DISPLAY_ID = 0;
+static const int32_t DISPLAY_WIDTH = 1440;
+static const int32_t DISPLAY_HEIGHT = 2560;
+
+// Flags of a window that only receives touches inside of its touchable region.
+static const int32_t NOT_TOUCH_MODAL = InputWindowInfo::FLAG_NOT_TOUCH_MODAL;
+
+
+// --- FakeInputWindowHandle ---
+
+class FakeInputWindowHandle : public InputWindowHandle {
+public:
+    FakeInputWindowHandle(int32_t displayId, const Rect& frame, int32_t flags) :
+            InputWindowHandle(NULL) {
+        mInfo = new InputWindowInfo();
+        mInfo->name = String8("com.example.fake/com.example.fake.FakeActivity");
+        mInfo->layoutParamsFlags = flags;
+        mInfo->layoutParamsType = InputWindowInfo::TYPE_APPLICATION;
+        mInfo->displayId = displayId;
+        mInfo->visible = true;
+        setFrame(frame);
+    }
+
+    void setFrame(const Rect& frame) {
+        mInfo->frameLeft = frame.left;
+        mInfo->frameTop = frame.top;
+        mInfo->frameRight = frame.right;
+        mInfo->frameBottom = frame.bottom;
+        mInfo->touchableRegion.clear();
+        mInfo->addTouchableRegion(frame);
+    }
+
+    void setVisible(bool visible) {
+        mInfo->visible = visible;
+    }
+
+    virtual bool updateInfo() {
+        return true;
+    }
+
+protected:
+    virtual ~FakeInputWindowHandle() {
+    }
+};
+
+
+// --- InputWindowSpatialIndexTest ---
+
+class InputWindowSpatialIndexTest : public testing::Test {
+protected:
+    Vector<sp<InputWindowHandle> > mWindowHandles;
+    InputWindowSpatialIndex mIndex;
+
+    sp<FakeInputWindowHandle> addWindow(int32_t displayId, const Rect& frame,
+            int32_t flags = NOT_TOUCH_MODAL) {
+        sp<FakeInputWindowHandle> windowHandle =
+                new FakeInputWindowHandle(displayId, frame, flags);
+        mWindowHandles.push(windowHandle);
+        return windowHandle;
+    }
+
+    // Adds windows of random sizes at random positions, most of them small
+    // like notifications, popups and floating views, with a few fullscreen
+    // windows at the bottom of the stack.
+    void addRandomWindows(size_t count, unsigned int seed) {
+        srand(seed);
+        for (size_t i = 0; i < count; i++) {
+            if (i + 3 >= count) {
+                addWindow(DISPLAY_ID, Rect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT));
+                continue;
+            }
+            int32_t width = 16 + rand() % (DISPLAY_WIDTH / 4);
+            int32_t height = 16 + rand() % (DISPLAY_HEIGHT / 8);
+            int32_t left = rand() % (DISPLAY_WIDTH - width);
+            int32_t top = rand() % (DISPLAY_HEIGHT - height);
+            int32_t flags = NOT_TOUCH_MODAL;
+            if (rand() % 20 == 0) {
+                flags |= InputWindowInfo::FLAG_NOT_TOUCHABLE;
+            }
+            if (rand() % 50 == 0) {
+                flags |= InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH;
+            }
+            sp<FakeInputWindowHandle> windowHandle =
+                    addWindow(DISPLAY_ID, Rect(left, top, left + width, top + height), flags);
+            if (rand() % 10 == 0) {
+                windowHandle->setVisible(false);
+            }
+        }
+    }
+
+    // Same search as InputDispatcher::findTouchedWindowAtLocked, over all the windows.
+    ssize_t findTouchedWindowLinear(int32_t displayId, int32_t x, int32_t y) const {
+        for (size_t i = 0; i < mWindowHandles.size(); i++) {
+            if (isTouchedAt(i, displayId, x, y)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Same search as InputDispatcher::findTouchedWindowAtLocked, over the candidates.
+    ssize_t findTouchedWindowIndexed(int32_t displayId, int32_t x, int32_t y) const {
+        Vector<size_t> candidates;
+        mIndex.findCandidatesAt(displayId, x, y, candidates);
+        for (size_t i = 0; i < candidates.size(); i++) {
+            if (isTouchedAt(candidates.itemAt(i), displayId, x, y)) {
+                return candidates.itemAt(i);
+            }
+        }
+        return -1;
+    }
+
+    bool isTouchedAt(size_t i, int32_t displayId, int32_t x, int32_t y) const {
+        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
+        const InputWindowInfo* info = windowHandle->getInfo();
+        if (windowHandle->getName().find("SingleMode_windowbg") != -1) {
+            return false;
+        }
+        int32_t flags = info->layoutParamsFlags;
+        if (info->displayId != displayId || !info->visible
+                || (flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
+            return false;
+        }
+        bool isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+                | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+        return isTouchModal || info->touchableRegionContainsPoint(x, y);
+    }
+
+    // Same check as InputDispatcher::isWindowObscuredLocked, over all the windows.
+    bool isObscuredLinear(size_t windowIndex) const {
+        const InputWindowInfo* windowInfo = mWindowHandles.itemAt(windowIndex)->getInfo();
+        for (size_t i = 0; i < windowIndex; i++) {
+            const InputWindowInfo* otherInfo = mWindowHandles.itemAt(i)->getInfo();
+            if (otherInfo->displayId == windowInfo->displayId && otherInfo->visible
+                    && otherInfo->overlaps(windowInfo)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Same check as InputDispatcher::isWindowObscuredLocked, over the candidates.
+    bool isObscuredIndexed(size_t windowIndex) const {
+        const InputWindowInfo* windowInfo = mWindowHandles.itemAt(windowIndex)->getInfo();
+        Vector<size_t> candidates;
+        mIndex.findCandidatesInRect(windowInfo->displayId, Rect(windowInfo->frameLeft,
+                windowInfo->frameTop, windowInfo->frameRight, windowInfo->frameBottom),
+                candidates);
+        for (size_t i = 0; i < candidates.size() && candidates.itemAt(i) < windowIndex; i++) {
+            const InputWindowInfo* otherInfo =
+                    mWindowHandles.itemAt(candidates.itemAt(i))->getInfo();
+            if (otherInfo->displayId == windowInfo->displayId && otherInfo->visible
+                    && otherInfo->overlaps(windowInfo)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+TEST_F(InputWindowSpatialIndexTest, FindCandidatesAt_ReturnsTopmostWindowFirst) {
+    addWindow(DISPLAY_ID, Rect(100, 100, 200, 200));
+    addWindow(DISPLAY_ID, Rect(0, 0, 400, 400));
+    addWindow(DISPLAY_ID, Rect(300, 300, 500, 500));
+    addWindow(DISPLAY_ID, Rect(1000, 1000, 1400, 2000));
+    mIndex.update(mWindowHandles);
+
+    Vector<size_t> candidates;
+    mIndex.findCandidatesAt(DISPLAY_ID, 150, 150, candidates);
+    ASSERT_EQ(2U, candidates.size());
+    ASSERT_EQ(0U, candidates[0]);
+    ASSERT_EQ(1U, candidates[1]);
+
+    mIndex.findCandidatesAt(DISPLAY_ID, 450, 450, candidates);
+    ASSERT_EQ(1U, candidates.size());
+    ASSERT_EQ(2U, candidates[0]);
+
+    mIndex.findCandidatesAt(DISPLAY_ID, 600, 600, candidates);
+    ASSERT_EQ(0U, candidates.size());
+}
+
+TEST_F(InputWindowSpatialIndexTest, FindCandidatesAt_AlwaysReturnsTouchModalAndOutsideWatchers) {
+    addWindow(DISPLAY_ID, Rect(0, 0, 10, 10), 0);
+    addWindow(DISPLAY_ID, Rect(0, 0, 10, 10),
+            NOT_TOUCH_MODAL | InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH);
+    addWindow(DISPLAY_ID, Rect(0, 0, 10, 10));
+    addWindow(DISPLAY_ID, Rect(500, 500, 600, 600));
+    mIndex.update(mWindowHandles);
+
+    Vector<size_t> candidates;
+    mIndex.findCandidatesAt(DISPLAY_ID, 550, 550, candidates);
+    ASSERT_EQ(3U, candidates.size());
+    ASSERT_EQ(0U, candidates[0]);
+    ASSERT_EQ(1U, candidates[1]);
+    ASSERT_EQ(3U, candidates[2]);
+}
+
+TEST_F(InputWindowSpatialIndexTest, FindCandidatesAt_IgnoresInvisibleWindowsAndOtherDisplays) {
+    addWindow(DISPLAY_ID, Rect(0, 0, 100, 100))->setVisible(false);
+    addWindow(DISPLAY_ID + 1, Rect(0, 0, 100, 100));
+    addWindow(DISPLAY_ID, Rect(0, 0, 100, 100));
+    mIndex.update(mWindowHandles);
+
+    Vector<size_t> candidates;
+    mIndex.findCandidatesAt(DISPLAY_ID, 50, 50, candidates);
+    ASSERT_EQ(1U, candidates.size());
+    ASSERT_EQ(2U, candidates[0]);
+
+    mIndex.findCandidatesAt(DISPLAY_ID + 1, 50, 50, candidates);
+    ASSERT_EQ(1U, candidates.size());
+    ASSERT_EQ(1U, candidates[0]);
+}
+
+TEST_F(InputWindowSpatialIndexTest, Update_FollowsMovedAndRestackedWindows) {
+    sp<FakeInputWindowHandle> first = addWindow(DISPLAY_ID, Rect(0, 0, 100, 100));
+    sp<FakeInputWindowHandle> second = addWindow(DISPLAY_ID, Rect(0, 0, 100, 100));
+    sp<FakeInputWindowHandle> other = addWindow(DISPLAY_ID + 1, Rect(0, 0, 100, 100));
+    mIndex.update(mWindowHandles);
+    ASSERT_EQ(0, findTouchedWindowIndexed(DISPLAY_ID, 50, 50));
+    ASSERT_EQ(2, mIndex.indexOf(other));
+
+    first->setFrame(Rect(1000, 1000, 1100, 1100));
+    mIndex.update(mWindowHandles);
+    ASSERT_EQ(1, findTouchedWindowIndexed(DISPLAY_ID, 50, 50));
+    ASSERT_EQ(0, findTouchedWindowIndexed(DISPLAY_ID, 1050, 1050));
+
+    mWindowHandles.clear();
+    mWindowHandles.push(other);
+    mWindowHandles.push(second);
+    mWindowHandles.push(first);
+    mIndex.update(mWindowHandles);
+    ASSERT_EQ(1, findTouchedWindowIndexed(DISPLAY_ID, 50, 50));
+    ASSERT_EQ(2, findTouchedWindowIndexed(DISPLAY_ID, 1050, 1050));
+    ASSERT_EQ(0, findTouchedWindowIndexed(DISPLAY_ID + 1, 50, 50));
+    ASSERT_EQ(0, mIndex.indexOf(other));
+}
+
+TEST_F(InputWindowSpatialIndexTest, Queries_MatchLinearScan) {
+    addRandomWindows(300, 1);
+    mIndex.update(mWindowHandles);
+
+    for (int32_t y = -8; y < DISPLAY_HEIGHT + 8; y += 7) {
+        for (int32_t x = -8; x < DISPLAY_WIDTH + 8; x += 7) {
+            ASSERT_EQ(findTouchedWindowLinear(DISPLAY_ID, x, y),
+                    findTouchedWindowIndexed(DISPLAY_ID, x, y))
+                    << "at (" << x << ", " << y << ")";
+        }
+    }
+    for (size_t i = 0; i < mWindowHandles.size(); i++) {
+        ASSERT_EQ(isObscuredLinear(i), isObscuredIndexed(i)) << "window " << i;
+    }
+}
+
+// Not a correctness test: reports how long hit-testing synthetic touches
+// takes with and without the index as the number of windows grows.
+TEST_F(InputWindowSpatialIndexTest, Benchmark_HitTesting) {
+    static const size_t WINDOW_COUNTS[] = { 10, 100, 500 };
+    static const size_t TOUCH_COUNT = 20000;
+
+    for (size_t c = 0; c < sizeof(WINDOW_COUNTS) / sizeof(WINDOW_COUNTS[0]); c++) {
+        mWindowHandles.clear();
+        addRandomWindows(WINDOW_COUNTS[c], 42);
+
+        nsecs_t updateStart = systemTime(SYSTEM_TIME_MONOTONIC);
+        mIndex.update(mWindowHandles);
+        nsecs_t updateTime = systemTime(SYSTEM_TIME_MONOTONIC) - updateStart;
+
+        Vector<int32_t> xs, ys;
+        srand(7);
+        for (size_t i = 0; i < TOUCH_COUNT; i++) {
+            xs.push(rand() % DISPLAY_WIDTH);
+            ys.push(rand() % DISPLAY_HEIGHT);
+        }
+
+        ssize_t linearSum = 0;
+        nsecs_t linearStart = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < TOUCH_COUNT; i++) {
+            linearSum += findTouchedWindowLinear(DISPLAY_ID, xs[i], ys[i]);
+        }
+        nsecs_t linearTime = systemTime(SYSTEM_TIME_MONOTONIC) - linearStart;
+
+        ssize_t indexedSum = 0;
+        nsecs_t indexedStart = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i = 0; i < TOUCH_COUNT; i++) {
+            indexedSum += findTouchedWindowIndexed(DISPLAY_ID, xs[i], ys[i]);
+        }
+        nsecs_t indexedTime = systemTime(SYSTEM_TIME_MONOTONIC) - indexedStart;
+
+        ASSERT_EQ(linearSum, indexedSum);
+        printf("%zu windows: linear %.3f us/touch, indexed %.3f us/touch, update %.3f ms\n",
+                WINDOW_COUNTS[c],
+                linearTime / 1000.0 / TOUCH_COUNT, indexedTime / 1000.0 / TOUCH_COUNT,
+                updateTime / 1000000.0);
+    }
+}
+
+} // namespace android
@@ -4,11 +4,14 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= \
     BatteryService.cpp \
     CorrectedGyroSensor.cpp \
+    EventMerger.cpp \
     Fusion.cpp \
     GravitySensor.cpp \
     LinearAccelerationSensor.cpp \
     OrientationSensor.cpp \
+    PipelineStats.cpp \
     RecentEventLogger.cpp \
+    ReplaySensorHal.cpp \
     RotationVectorSensor.cpp \
     SensorDevice.cpp \
     SensorEventConnection.cpp \
@@ -18,6 +21,7 @@ LOCAL_SRC_FILES:= \
     SensorRecord.cpp \
     SensorService.cpp \
     SensorServiceUtils.cpp \
+    WakeLockPolicy.cpp \
 
 
 LOCAL_CFLAGS:= -DLOG_TAG=\"SensorService\"
@@ -55,16 +55,25 @@ CorrectedGyroSensor::CorrectedGyroSensor(sensor_t const* list, size_t count)
 bool CorrectedGyroSensor::process(sensors_event_t* outEvent,
         const sensors_event_t& event)
 {
-    if (event.type == SENSOR_TYPE_GYROSCOPE) {
-        const vec3_t bias(mSensorFusion.getGyroBias());
-        *outEvent = event;
-        outEvent->data[0] -= bias.x;
-        outEvent->data[1] -= bias.y;
-        outEvent->data[2] -= bias.z;
-        outEvent->sensor = '_cgy';
-        return true;
+    return processBatch(outEvent, 1, &event, 1) == 1;
+}
+
+size_t CorrectedGyroSensor::processBatch(sensors_event_t* outEvents, size_t maxCount,
+        const sensors_event_t* events, size_t count)
+{
+    const vec3_t bias(mSensorFusion.getGyroBias());
+    size_t n = 0;
+    for (size_t i = 0; i < count && n < maxCount; i++) {
+        if (events[i].type == SENSOR_TYPE_GYROSCOPE) {
+            sensors_event_t* outEvent = &outEvents[n++];
+            *outEvent = events[i];
+            outEvent->data[0] -= bias.x;
+            outEvent->data[1] -= bias.y;
+            outEvent->data[2] -= bias.z;
+            outEvent->sensor = '_cgy';
+        }
     }
-    return false;
+    return n;
 }
 
 status_t CorrectedGyroSensor::activate(void* ident, bool enabled) {
@@ -37,6 +37,8 @@ class CorrectedGyroSensor : public VirtualSensor {
 public:
     CorrectedGyroSensor(sensor_t const* list, size_t count);
     virtual bool process(sensors_event_t* outEvent, const sensors_event_t& event) override;
+    virtual size_t processBatch(sensors_event_t* outEvents, size_t maxCount,
+                                const sensors_event_t* events, size_t count) override;
     virtual status_t activate(void* ident, bool enabled) override;
     virtual status_t setDelay(void* ident, int handle, int64_t ns) override;
 };
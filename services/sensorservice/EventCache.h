@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_SERVICE_UTIL_EVENT_CACHE_H
+#define ANDROID_SENSOR_SERVICE_UTIL_EVENT_CACHE_H
+
+#include <hardware/sensors.h>
+#include <cutils/compiler.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <vector>
+
+namespace android {
+namespace SensorServiceUtil {
+
+/**
+ * A FIFO of the sensor events that couldn't be written to the socket of a connection.
+ *
+ * The events are kept in a ring whose capacity is a power of two, so appending and removing
+ * events never moves the other cached events and costs the same per event however full the
+ * cache is. Whether each event comes from a wake up sensor is recorded in a bitmap when it is
+ * cached, and the number of cached flush complete events is tracked so that dropping events
+ * only looks for flush complete events when there are some.
+ */
+class EventCache final {
+public:
+    EventCache();
+
+    /**
+     * Return the number of cached events.
+     */
+    size_t size() const;
+
+    /**
+     * Return true if there are no cached events.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Return the maximum number of events this cache holds.
+     */
+    size_t maxSize() const;
+
+    /**
+     * Return the number of cached flush complete events.
+     */
+    size_t flushCompleteCount() const;
+
+    /**
+     * Return the number of events dropped by dropOldest() since this cache was created.
+     */
+    uint64_t droppedCount() const;
+
+    /**
+     * Raise the maximum number of events this cache holds to at least maxSize.  The cached events
+     * are kept.  The cache never shrinks.
+     */
+    void reserve(size_t maxSize);
+
+    /**
+     * Append count events.  isWakeUp(event) tells whether an event comes from a wake up sensor.
+     * There must be room for the events, see maxSize().
+     */
+    template <class IsWakeUp>
+    void push(sensors_event_t const* events, size_t count, IsWakeUp&& isWakeUp);
+
+    /**
+     * Remove the count oldest events, calling onFlushComplete(event) for each flush complete
+     * event among them.
+     */
+    template <class OnFlushComplete>
+    void dropOldest(size_t count, OnFlushComplete&& onFlushComplete);
+
+    /**
+     * Return the oldest events that are contiguous in memory, at most maxCount of them, and
+     * set outCount to their number.  The events may be modified in place.
+     */
+    sensors_event_t* front(size_t maxCount, size_t* outCount);
+
+    /**
+     * Return the index of the first wake up sensor event among the count oldest events, or -1
+     * if there is none.  count must not exceed the count returned by front().
+     */
+    ssize_t findWakeUp(size_t count) const;
+
+    /**
+     * Remove the count oldest events.
+     */
+    void pop(size_t count);
+
+private:
+    bool isWakeUpAt(size_t pos) const;
+    void setWakeUpAt(size_t pos, bool wakeUp);
+    void remove(size_t count);
+
+    std::vector<sensors_event_t> mEvents;
+    // One bit per slot of mEvents, set if the event in the slot comes from a wake up sensor.
+    std::vector<uint32_t> mWakeUpBits;
+    size_t mHead;
+    size_t mSize;
+    size_t mMaxSize;
+    size_t mWakeUpCount;
+    size_t mFlushCompleteCount;
+    uint64_t mDroppedCount;
+}; // class EventCache
+
+
+inline EventCache::EventCache() : mHead{0}, mSize{0}, mMaxSize{0}, mWakeUpCount{0},
+        mFlushCompleteCount{0}, mDroppedCount{0} {}
+
+inline size_t EventCache::size() const {
+    return mSize;
+}
+
+inline bool EventCache::isEmpty() const {
+    return mSize == 0;
+}
+
+inline size_t EventCache::maxSize() const {
+    return mMaxSize;
+}
+
+inline size_t EventCache::flushCompleteCount() const {
+    return mFlushCompleteCount;
+}
+
+inline uint64_t EventCache::droppedCount() const {
+    return mDroppedCount;
+}
+
+inline bool EventCache::isWakeUpAt(size_t pos) const {
+    return (mWakeUpBits[pos >> 5] >> (pos & 31)) & 1;
+}
+
+inline void EventCache::setWakeUpAt(size_t pos, bool wakeUp) {
+    if (wakeUp) {
+        mWakeUpBits[pos >> 5] |= 1u << (pos & 31);
+    } else {
+        mWakeUpBits[pos >> 5] &= ~(1u << (pos & 31));
+    }
+}
+
+inline void EventCache::reserve(size_t maxSize) {
+    if (maxSize <= mMaxSize) {
+        return;
+    }
+    mMaxSize = maxSize;
+    if (maxSize <= mEvents.size()) {
+        return;
+    }
+
+    size_t capacity = 32;
+    while (capacity < maxSize) {
+        capacity <<= 1;
+    }
+    // Unwrap the cached events at the start of the new ring.
+    std::vector<sensors_event_t> events(capacity);
+    std::vector<uint32_t> wakeUpBits(capacity / 32);
+    const size_t mask = mEvents.size() - 1;
+    for (size_t i = 0; i < mSize; i++) {
+        const size_t pos = (mHead + i) & mask;
+        events[i] = mEvents[pos];
+        if (isWakeUpAt(pos)) {
+            wakeUpBits[i >> 5] |= 1u << (i & 31);
+        }
+    }
+    mEvents.swap(events);
+    mWakeUpBits.swap(wakeUpBits);
+    mHead = 0;
+}
+
+template <class IsWakeUp>
+void EventCache::push(sensors_event_t const* events, size_t count, IsWakeUp&& isWakeUp) {
+    const size_t mask = mEvents.size() - 1;
+    size_t pos = (mHead + mSize) & mask;
+    for (size_t i = 0; i < count; i++) {
+        mEvents[pos] = events[i];
+        const bool wakeUp = isWakeUp(events[i]);
+        setWakeUpAt(pos, wakeUp);
+        mWakeUpCount += wakeUp;
+        mFlushCompleteCount += events[i].type == SENSOR_TYPE_META_DATA;
+        pos = (pos + 1) & mask;
+    }
+    mSize += count;
+}
+
+template <class OnFlushComplete>
+void EventCache::dropOldest(size_t count, OnFlushComplete&& onFlushComplete) {
+    if (mFlushCompleteCount > 0) {
+        const size_t mask = mEvents.size() - 1;
+        for (size_t i = 0; i < count; i++) {
+            const sensors_event_t& event = mEvents[(mHead + i) & mask];
+            if (event.type == SENSOR_TYPE_META_DATA) {
+                onFlushComplete(event);
+            }
+        }
+    }
+    mDroppedCount += count;
+    remove(count);
+}
+
+inline sensors_event_t* EventCache::front(size_t maxCount, size_t* outCount) {
+    size_t count = mEvents.size() - mHead;
+    if (count > mSize) {
+        count = mSize;
+    }
+    *outCount = count > maxCount ? maxCount : count;
+    return mEvents.data() + mHead;
+}
+
+inline ssize_t EventCache::findWakeUp(size_t count) const {
+    if (mWakeUpCount == 0) {
+        return -1;
+    }
+    // The events returned by front() don't wrap around, so look a word of the bitmap at a time.
+    size_t pos = mHead;
+    const size_t end = mHead + count;
+    while (pos < end) {
+        uint32_t bits = mWakeUpBits[pos >> 5] >> (pos & 31);
+        if (bits != 0) {
+            const size_t found = pos + __builtin_ctz(bits);
+            return found < end ? ssize_t(found - mHead) : -1;
+        }
+        pos = (pos | 31) + 1;
+    }
+    return -1;
+}
+
+inline void EventCache::pop(size_t count) {
+    remove(count);
+}
+
+inline void EventCache::remove(size_t count) {
+    if (CC_UNLIKELY(count > mSize)) {
+        count = mSize;
+    }
+    const size_t mask = mEvents.size() - 1;
+    if (mWakeUpCount > 0 || mFlushCompleteCount > 0) {
+        for (size_t i = 0; i < count; i++) {
+            const size_t pos = (mHead + i) & mask;
+            mWakeUpCount -= isWakeUpAt(pos);
+            mFlushCompleteCount -= mEvents[pos].type == SENSOR_TYPE_META_DATA;
+        }
+    }
+    mHead = (mHead + count) & mask;
+    mSize -= count;
+    if (mSize == 0) {
+        mHead = 0;
+    }
+}
+
+} // namespace SensorServiceUtil
+} // namespace android;
+
+#endif // ANDROID_SENSOR_SERVICE_UTIL_EVENT_CACHE_H
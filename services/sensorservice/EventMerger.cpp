@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "EventMerger.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace android {
+namespace SensorServiceUtil {
+
+sensors_event_t* EventMerger::merge(sensors_event_t* buffer, size_t count,
+        sensors_event_t* out) {
+    mRunNext.clear();
+    mRunEnd.clear();
+    mRunNext.push_back(0);
+    for (size_t i = 1; i < count; i++) {
+        if (buffer[i].timestamp < buffer[i - 1].timestamp) {
+            mRunEnd.push_back(i);
+            mRunNext.push_back(i);
+        }
+    }
+    mRunEnd.push_back(count);
+    mRunCount = mRunNext.size();
+    if (mRunCount == 1) {
+        return buffer;
+    }
+    if (mRunCount > count / MIN_EVENTS_PER_RUN) {
+        // Hardly in order at all, merging would copy the events one at a time.
+        std::stable_sort(buffer, buffer + count,
+                [](const sensors_event_t& lhs, const sensors_event_t& rhs) {
+                    return lhs.timestamp < rhs.timestamp;
+                });
+        return buffer;
+    }
+
+    mEvents = buffer;
+    mHeap.resize(mRunCount);
+    for (size_t i = 0; i < mRunCount; i++) {
+        mHeap[i] = i;
+    }
+    for (size_t i = mRunCount / 2; i-- > 0; ) {
+        siftDown(i);
+    }
+
+    size_t written = 0;
+    while (!mHeap.empty()) {
+        // Copy events of the first run for as long as they come before the head of the runner-up,
+        // which is one of the children of the root. Runs mostly hold several events in a row.
+        const uint32_t run = mHeap[0];
+        size_t next = mRunNext[run];
+        const size_t end = mRunEnd[run];
+        size_t runnerUp = 0;
+        if (mHeap.size() > 1) {
+            runnerUp = 1;
+            if (mHeap.size() > 2 && less(2, 1)) {
+                runnerUp = 2;
+            }
+        }
+        size_t last = next + 1;
+        if (runnerUp) {
+            const uint32_t other = mHeap[runnerUp];
+            const int64_t limit = buffer[mRunNext[other]].timestamp;
+            // Ties go to the run that comes first in the buffer.
+            while (last < end && (buffer[last].timestamp < limit
+                    || (buffer[last].timestamp == limit && run < other))) {
+                last++;
+            }
+        } else {
+            last = end;
+        }
+        memcpy(&out[written], &buffer[next], (last - next) * sizeof(sensors_event_t));
+        written += last - next;
+
+        if (last == end) {
+            mHeap[0] = mHeap.back();
+            mHeap.pop_back();
+        } else {
+            mRunNext[run] = last;
+        }
+        if (!mHeap.empty()) {
+            siftDown(0);
+        }
+    }
+    return out;
+}
+
+size_t EventMerger::getRunCount() const {
+    return mRunCount;
+}
+
+bool EventMerger::less(size_t lhs, size_t rhs) const {
+    const uint32_t l = mHeap[lhs];
+    const uint32_t r = mHeap[rhs];
+    const int64_t lt = mEvents[mRunNext[l]].timestamp;
+    const int64_t rt = mEvents[mRunNext[r]].timestamp;
+    return lt < rt || (lt == rt && l < r);
+}
+
+void EventMerger::siftDown(size_t position) {
+    const size_t size = mHeap.size();
+    for (;;) {
+        size_t smallest = position;
+        const size_t left = 2 * position + 1;
+        const size_t right = left + 1;
+        if (left < size && less(left, smallest)) {
+            smallest = left;
+        }
+        if (right < size && less(right, smallest)) {
+            smallest = right;
+        }
+        if (smallest == position) {
+            return;
+        }
+        const uint32_t run = mHeap[position];
+        mHeap[position] = mHeap[smallest];
+        mHeap[smallest] = run;
+        position = smallest;
+    }
+}
+
+} // namespace SensorServiceUtil
+} // namespace android
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_SERVICE_UTIL_EVENT_MERGER_H
+#define ANDROID_SENSOR_SERVICE_UTIL_EVENT_MERGER_H
+
+#include <hardware/sensors.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+namespace android {
+namespace SensorServiceUtil {
+
+/**
+ * Orders a buffer of sensor events by timestamp by merging the runs already in order.
+ *
+ * A poll of SensorService::threadLoop holds the events of the HAL, mostly in order, followed by
+ * the events of each virtual sensor, each in the order of the events they were computed from.
+ * The merger splits the buffer where a timestamp goes backwards and does a k-way merge of the
+ * resulting runs, so the usual poll costs a linear scan and one copy rather than a comparison
+ * sort.  Events with the same timestamp keep their order in the buffer, so a virtual sensor event
+ * comes after the event it was computed from.  A buffer with few events per run, such as a HAL
+ * batch out of order, is sorted in place instead.
+ *
+ * The run bookkeeping is kept between calls; only use a merger from one thread.
+ */
+class EventMerger {
+public:
+    /**
+     * Order the count events of buffer by timestamp.  Return buffer if they already were in
+     * order, otherwise merge them into out, which must hold count events, and return out.
+     */
+    sensors_event_t* merge(sensors_event_t* buffer, size_t count, sensors_event_t* out);
+
+    /**
+     * Return the number of runs the last merge() found.
+     */
+    size_t getRunCount() const;
+
+private:
+    // Below this many events per run on average, merge() sorts the buffer in place instead.
+    static constexpr size_t MIN_EVENTS_PER_RUN = 4;
+
+    bool less(size_t lhs, size_t rhs) const;
+    void siftDown(size_t position);
+
+    sensors_event_t const* mEvents = nullptr;
+    // Next event and end of each run, as indices into mEvents.
+    std::vector<uint32_t> mRunNext, mRunEnd;
+    // Min-heap of the runs not merged yet, by next timestamp then run index.
+    std::vector<uint32_t> mHeap;
+    size_t mRunCount = 0;
+};
+
+} // namespace SensorServiceUtil
+} // namespace android
+
+#endif // ANDROID_SENSOR_SERVICE_UTIL_EVENT_MERGER_H
@@ -54,25 +54,34 @@ GravitySensor::GravitySensor(sensor_t const* list, size_t count) {
 bool GravitySensor::process(sensors_event_t* outEvent,
         const sensors_event_t& event)
 {
-    if (event.type == SENSOR_TYPE_ACCELEROMETER) {
-        vec3_t g;
-        if (!mSensorFusion.hasEstimate(FUSION_NOMAG))
-            return false;
-        const mat33_t R(mSensorFusion.getRotationMatrix(FUSION_NOMAG));
-        // FIXME: we need to estimate the length of gravity because
-        // the accelerometer may have a small scaling error. This
-        // translates to an offset in the linear-acceleration sensor.
-        g = R[2] * GRAVITY_EARTH;
+    return processBatch(outEvent, 1, &event, 1) == 1;
+}
+
+size_t GravitySensor::processBatch(sensors_event_t* outEvents, size_t maxCount,
+        const sensors_event_t* events, size_t count)
+{
+    if (!mSensorFusion.hasEstimate(FUSION_NOMAG))
+        return 0;
+    // The fusion has already seen all the events, so every output uses the same gravity.
+    const mat33_t R(mSensorFusion.getRotationMatrix(FUSION_NOMAG));
+    // FIXME: we need to estimate the length of gravity because
+    // the accelerometer may have a small scaling error. This
+    // translates to an offset in the linear-acceleration sensor.
+    const vec3_t g(R[2] * GRAVITY_EARTH);
 
-        *outEvent = event;
-        outEvent->data[0] = g.x;
-        outEvent->data[1] = g.y;
-        outEvent->data[2] = g.z;
-        outEvent->sensor = '_grv';
-        outEvent->type = SENSOR_TYPE_GRAVITY;
-        return true;
+    size_t n = 0;
+    for (size_t i = 0; i < count && n < maxCount; i++) {
+        if (events[i].type == SENSOR_TYPE_ACCELEROMETER) {
+            sensors_event_t* outEvent = &outEvents[n++];
+            *outEvent = events[i];
+            outEvent->data[0] = g.x;
+            outEvent->data[1] = g.y;
+            outEvent->data[2] = g.z;
+            outEvent->sensor = '_grv';
+            outEvent->type = SENSOR_TYPE_GRAVITY;
+        }
     }
-    return false;
+    return n;
 }
 
 status_t GravitySensor::activate(void* ident, bool enabled) {
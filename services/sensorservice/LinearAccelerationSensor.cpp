@@ -49,16 +49,27 @@ LinearAccelerationSensor::LinearAccelerationSensor(sensor_t const* list, size_t
 bool LinearAccelerationSensor::process(sensors_event_t* outEvent,
         const sensors_event_t& event)
 {
-    bool result = mGravitySensor.process(outEvent, event);
-    if (result && event.type == SENSOR_TYPE_ACCELEROMETER) {
-        outEvent->data[0] = event.acceleration.x - outEvent->data[0];
-        outEvent->data[1] = event.acceleration.y - outEvent->data[1];
-        outEvent->data[2] = event.acceleration.z - outEvent->data[2];
-        outEvent->sensor = '_lin';
-        outEvent->type = SENSOR_TYPE_LINEAR_ACCELERATION;
-        return true;
+    return processBatch(outEvent, 1, &event, 1) == 1;
+}
+
+size_t LinearAccelerationSensor::processBatch(sensors_event_t* outEvents, size_t maxCount,
+        const sensors_event_t* events, size_t count)
+{
+    // The gravity events keep the data of the accelerometer event they were made from, apart
+    // from the acceleration, and are in the same order.
+    const size_t n = mGravitySensor.processBatch(outEvents, maxCount, events, count);
+    size_t j = 0;
+    for (size_t i = 0; i < count && j < n; i++) {
+        if (events[i].type == SENSOR_TYPE_ACCELEROMETER) {
+            sensors_event_t* outEvent = &outEvents[j++];
+            outEvent->data[0] = events[i].acceleration.x - outEvent->data[0];
+            outEvent->data[1] = events[i].acceleration.y - outEvent->data[1];
+            outEvent->data[2] = events[i].acceleration.z - outEvent->data[2];
+            outEvent->sensor = '_lin';
+            outEvent->type = SENSOR_TYPE_LINEAR_ACCELERATION;
+        }
     }
-    return false;
+    return n;
 }
 
 status_t LinearAccelerationSensor::activate(void* ident, bool enabled) {
@@ -37,6 +37,8 @@ class LinearAccelerationSensor : public VirtualSensor {
 
     virtual bool process(sensors_event_t* outEvent,
             const sensors_event_t& event);
+    virtual size_t processBatch(sensors_event_t* outEvents, size_t maxCount,
+                                const sensors_event_t* events, size_t count) override;
 public:
     LinearAccelerationSensor(sensor_t const* list, size_t count);
     virtual status_t activate(void* ident, bool enabled) override;
@@ -47,28 +47,38 @@ OrientationSensor::OrientationSensor() {
 bool OrientationSensor::process(sensors_event_t* outEvent,
         const sensors_event_t& event)
 {
-    if (event.type == SENSOR_TYPE_ACCELEROMETER) {
-        if (mSensorFusion.hasEstimate()) {
-            vec3_t g;
-            const float rad2deg = 180 / M_PI;
-            const mat33_t R(mSensorFusion.getRotationMatrix());
-            g[0] = atan2f(-R[1][0], R[0][0])    * rad2deg;
-            g[1] = atan2f(-R[2][1], R[2][2])    * rad2deg;
-            g[2] = asinf ( R[2][0])             * rad2deg;
-            if (g[0] < 0)
-                g[0] += 360;
+    return processBatch(outEvent, 1, &event, 1) == 1;
+}
+
+size_t OrientationSensor::processBatch(sensors_event_t* outEvents, size_t maxCount,
+        const sensors_event_t* events, size_t count)
+{
+    if (!mSensorFusion.hasEstimate())
+        return 0;
+    // The fusion has already seen all the events, so every output has the same angles.
+    vec3_t g;
+    const float rad2deg = 180 / M_PI;
+    const mat33_t R(mSensorFusion.getRotationMatrix());
+    g[0] = atan2f(-R[1][0], R[0][0])    * rad2deg;
+    g[1] = atan2f(-R[2][1], R[2][2])    * rad2deg;
+    g[2] = asinf ( R[2][0])             * rad2deg;
+    if (g[0] < 0)
+        g[0] += 360;
 
-            *outEvent = event;
+    size_t n = 0;
+    for (size_t i = 0; i < count && n < maxCount; i++) {
+        if (events[i].type == SENSOR_TYPE_ACCELEROMETER) {
+            sensors_event_t* outEvent = &outEvents[n++];
+            *outEvent = events[i];
             outEvent->orientation.azimuth = g.x;
             outEvent->orientation.pitch   = g.y;
             outEvent->orientation.roll    = g.z;
             outEvent->orientation.status  = SENSOR_STATUS_ACCURACY_HIGH;
             outEvent->sensor = '_ypr';
             outEvent->type = SENSOR_TYPE_ORIENTATION;
-            return true;
         }
     }
-    return false;
+    return n;
 }
 
 status_t OrientationSensor::activate(void* ident, bool enabled) {
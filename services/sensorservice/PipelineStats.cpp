@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PipelineStats.h"
+
+#include <utils/String8.h>
+
+#include <inttypes.h>
+#include <string.h>
+
+namespace android {
+namespace SensorServiceUtil {
+
+namespace {
+template <class T>
+void append(std::vector<uint8_t>* out, T value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out->insert(out->end(), bytes, bytes + sizeof(value));
+}
+
+void alignTo8(std::vector<uint8_t>* out) {
+    out->resize((out->size() + 7) & ~size_t(7), 0);
+}
+} // unnamed namespace
+
+constexpr size_t LatencyHistogram::NUM_BUCKETS;
+constexpr uint32_t PipelineStats::SERIALIZED_MAGIC;
+constexpr uint16_t PipelineStats::SERIALIZED_VERSION;
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::add(nsecs_t duration) {
+    if (duration < 0) {
+        duration = 0;
+    }
+    const uint64_t us = uint64_t(duration) / 1000;
+    size_t bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+    if (bucket >= NUM_BUCKETS) {
+        bucket = NUM_BUCKETS - 1;
+    }
+    mBuckets[bucket]++;
+    mCount++;
+    mTotal += duration;
+    if (duration > mMax) {
+        mMax = duration;
+    }
+}
+
+void LatencyHistogram::reset() {
+    mCount = 0;
+    mTotal = 0;
+    mMax = 0;
+    memset(mBuckets, 0, sizeof(mBuckets));
+}
+
+uint64_t LatencyHistogram::count() const {
+    return mCount;
+}
+
+nsecs_t LatencyHistogram::mean() const {
+    return mCount ? mTotal / nsecs_t(mCount) : 0;
+}
+
+nsecs_t LatencyHistogram::max() const {
+    return mMax;
+}
+
+nsecs_t LatencyHistogram::percentile(int percent) const {
+    // Rank of the percentile among the counted durations, rounded up.
+    const uint64_t rank = (mCount * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS - 1; i++) {
+        seen += mBuckets[i];
+        if (seen >= rank && seen > 0) {
+            const nsecs_t end = nsecs_t(1000) << i;
+            return end < mMax ? end : mMax;
+        }
+    }
+    return mMax;
+}
+
+std::string LatencyHistogram::dump() const {
+    String8 buffer;
+    buffer.appendFormat("count %" PRIu64 " | mean %.1fus | p50 %.1fus | p90 %.1fus | "
+            "p99 %.1fus | max %.1fus", mCount, mean() / 1000.0, percentile(50) / 1000.0,
+            percentile(90) / 1000.0, percentile(99) / 1000.0, mMax / 1000.0);
+    return std::string(buffer.string());
+}
+
+void LatencyHistogram::serialize(std::vector<uint8_t>* out) const {
+    append(out, mCount);
+    append(out, int64_t(mTotal));
+    append(out, int64_t(mMax));
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        append(out, mBuckets[i]);
+    }
+    alignTo8(out);
+}
+
+PipelineStats::PipelineStats() : mEnabled(false), mStartTime(0), mPollCount(0) {
+}
+
+void PipelineStats::setEnabled(bool enabled) {
+    if (enabled && !isEnabled()) {
+        reset();
+    }
+    mEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void PipelineStats::reset() {
+    mStartTime = systemTime();
+    mPollCount = 0;
+    for (size_t i = 0; i < NUM_STAGES; i++) {
+        mStages[i].reset();
+    }
+    mEventAges.clear();
+}
+
+nsecs_t PipelineStats::endStage(Stage stage, nsecs_t start) {
+    const nsecs_t now = systemTime();
+    mStages[stage].add(now - start);
+    return now;
+}
+
+void PipelineStats::addStage(Stage stage, nsecs_t duration) {
+    mStages[stage].add(duration);
+}
+
+void PipelineStats::addEventAges(sensors_event_t const* events, size_t count, nsecs_t now) {
+    // Events come in runs of the same sensor, look up each sensor once per run.
+    int lastHandle = 0;
+    LatencyHistogram* ages = nullptr;
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].type == SENSOR_TYPE_META_DATA) {
+            continue;
+        }
+        const int handle = events[i].sensor;
+        if (ages == nullptr || handle != lastHandle) {
+            ssize_t index = mEventAges.indexOfKey(handle);
+            if (index < 0) {
+                index = mEventAges.add(handle, LatencyHistogram());
+            }
+            ages = &mEventAges.editValueAt(index);
+            lastHandle = handle;
+        }
+        ages->add(now - events[i].timestamp);
+    }
+}
+
+void PipelineStats::countPoll() {
+    mPollCount++;
+}
+
+const LatencyHistogram& PipelineStats::getStage(Stage stage) const {
+    return mStages[stage];
+}
+
+const KeyedVector<int, LatencyHistogram>& PipelineStats::getEventAges() const {
+    return mEventAges;
+}
+
+uint64_t PipelineStats::getPollCount() const {
+    return mPollCount;
+}
+
+nsecs_t PipelineStats::getDuration() const {
+    return mStartTime ? systemTime() - mStartTime : 0;
+}
+
+const char* PipelineStats::getStageName(Stage stage) {
+    switch (stage) {
+        case STAGE_POLL:
+            return "poll";
+        case STAGE_FUSION:
+            return "fusion";
+        case STAGE_VIRTUAL_SENSORS:
+            return "virtual sensors";
+        case STAGE_SORT:
+            return "sort";
+        case STAGE_FAN_OUT:
+            return "fan-out";
+        default:
+            return "unknown";
+    }
+}
+
+void PipelineStats::serialize(const std::vector<ConnectionStats>& connections,
+        std::vector<uint8_t>* out) const {
+    append(out, SERIALIZED_MAGIC);
+    append(out, SERIALIZED_VERSION);
+    append(out, uint16_t(LatencyHistogram::NUM_BUCKETS));
+    append(out, int64_t(getDuration()));
+    append(out, mPollCount);
+    append(out, uint32_t(NUM_STAGES));
+    append(out, uint32_t(mEventAges.size()));
+    append(out, uint32_t(connections.size()));
+    append(out, uint32_t(0));
+
+    for (size_t i = 0; i < NUM_STAGES; i++) {
+        mStages[i].serialize(out);
+    }
+    for (size_t i = 0; i < mEventAges.size(); i++) {
+        append(out, int32_t(mEventAges.keyAt(i)));
+        append(out, uint32_t(0));
+        mEventAges.valueAt(i).serialize(out);
+    }
+    for (const ConnectionStats& connection : connections) {
+        append(out, uint32_t(connection.uid));
+        append(out, uint32_t(0));
+        append(out, connection.cachedCount);
+        append(out, connection.droppedCount);
+        connection.age.serialize(out);
+    }
+}
+
+} // namespace SensorServiceUtil
+} // namespace android
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_SERVICE_UTIL_PIPELINE_STATS_H
+#define ANDROID_SENSOR_SERVICE_UTIL_PIPELINE_STATS_H
+
+#include <cutils/compiler.h>
+#include <hardware/sensors.h>
+#include <utils/KeyedVector.h>
+#include <utils/Timers.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace SensorServiceUtil {
+
+/**
+ * A histogram of durations with one bucket per power of two microseconds.
+ *
+ * Bucket 0 counts the durations under 1us and bucket i the durations in [2^(i-1)us, 2^i us),
+ * the last bucket also counting everything longer.  Adding a duration costs a division and a
+ * count of leading zeros, so it can be done for every sensor event.  Exported for the replay
+ * benchmark.
+ */
+class ANDROID_API LatencyHistogram {
+public:
+    static constexpr size_t NUM_BUCKETS = 24;
+
+    LatencyHistogram();
+
+    /**
+     * Count a duration.  Negative durations are counted as 0.
+     */
+    void add(nsecs_t duration);
+
+    void reset();
+
+    uint64_t count() const;
+    nsecs_t mean() const;
+    nsecs_t max() const;
+
+    /**
+     * Return an upper bound of the given percentile, the end of the bucket it falls in, or the
+     * longest duration for the last bucket.
+     */
+    nsecs_t percentile(int percent) const;
+
+    /**
+     * Return a one line summary: count, mean, p50, p90, p99 and max.
+     */
+    std::string dump() const;
+
+    /**
+     * Append the record described in PipelineStats::serialize.
+     */
+    void serialize(std::vector<uint8_t>* out) const;
+
+private:
+    uint64_t mCount;
+    nsecs_t mTotal;
+    nsecs_t mMax;
+    uint32_t mBuckets[NUM_BUCKETS];
+};
+
+/**
+ * Delivery statistics of one connection, as reported by PipelineStats::serialize.
+ */
+struct ConnectionStats {
+    uid_t uid;
+    // Events written to the cache because the socket was full, since the stats were reset.
+    uint64_t cachedCount;
+    // Events dropped by the cache or the direct channel since the connection was created.
+    uint64_t droppedCount;
+    // Age of the events when they were written to the socket or the direct channel.
+    LatencyHistogram age;
+};
+
+/**
+ * Latency statistics of the sensor pipeline of SensorService.
+ *
+ * Records how long each stage of threadLoop takes and how old the events of each sensor are
+ * when they are sent to the connections.  Nothing is recorded until the statistics are enabled,
+ * checking whether they are costs an atomic load per poll.  isEnabled() may be called from any
+ * thread, the other calls must be serialized by the caller.
+ */
+class PipelineStats {
+public:
+    enum Stage {
+        STAGE_POLL,             // waiting for the HAL, from the call to poll() to its return
+        STAGE_FUSION,           // feeding the events to the sensor fusion
+        STAGE_VIRTUAL_SENSORS,  // computing the virtual sensor events
+        STAGE_SORT,             // ordering the real and virtual events by timestamp
+        STAGE_FAN_OUT,          // routing the events and writing them to the connections
+        NUM_STAGES
+    };
+
+    PipelineStats();
+
+    bool isEnabled() const {
+        return mEnabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Start or stop recording.  Enabling the statistics resets them.
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * Clear the statistics and restart the period they cover.
+     */
+    void reset();
+
+    /**
+     * Count a stage which started at time start (SYSTEM_TIME_MONOTONIC) and return the current
+     * time, which is the start of the next stage.
+     */
+    nsecs_t endStage(Stage stage, nsecs_t start);
+
+    /**
+     * Count a stage of the given duration.
+     */
+    void addStage(Stage stage, nsecs_t duration);
+
+    /**
+     * Count the age of the sensor events at time now (elapsedRealtimeNano), by sensor handle.
+     * Meta data events are skipped.
+     */
+    void addEventAges(sensors_event_t const* events, size_t count, nsecs_t now);
+
+    void countPoll();
+
+    const LatencyHistogram& getStage(Stage stage) const;
+    const KeyedVector<int, LatencyHistogram>& getEventAges() const;
+    uint64_t getPollCount() const;
+    // Time covered by the statistics, since they were last enabled or reset.
+    nsecs_t getDuration() const;
+
+    static const char* getStageName(Stage stage);
+
+    /**
+     * Append the statistics in a compact binary form, for tools that collect them periodically.
+     * All the fields are in the byte order of the device and the records are 8 byte aligned:
+     *
+     *  header          uint32 magic ('SPST'), uint16 version (1), uint16 number of buckets,
+     *                  int64 duration (ns), uint64 polls,
+     *                  uint32 number of stages, uint32 number of sensors,
+     *                  uint32 number of connections, uint32 0
+     *  histogram       uint64 count, int64 total (ns), int64 max (ns), uint32 buckets[]
+     *                  padded to 8 bytes
+     *  stages          one histogram per stage, in the order of enum Stage
+     *  sensors         int32 handle, uint32 0, histogram of the event ages
+     *  connections     uint32 uid, uint32 0, uint64 cached, uint64 dropped,
+     *                  histogram of the event ages
+     */
+    void serialize(const std::vector<ConnectionStats>& connections,
+            std::vector<uint8_t>* out) const;
+
+    static constexpr uint32_t SERIALIZED_MAGIC = 0x54535053; // 'SPST'
+    static constexpr uint16_t SERIALIZED_VERSION = 1;
+
+private:
+    std::atomic<bool> mEnabled;
+    nsecs_t mStartTime;
+    uint64_t mPollCount;
+    LatencyHistogram mStages[NUM_STAGES];
+    KeyedVector<int, LatencyHistogram> mEventAges;
+};
+
+} // namespace SensorServiceUtil
+} // namespace android;
+
+#endif // ANDROID_SENSOR_SERVICE_UTIL_PIPELINE_STATS_H
@@ -0,0 +1,575 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <cutils/properties.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/SystemClock.h>
+#include <utils/threads.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "ReplaySensorHal.h"
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// The sensors the replay knows how to describe. Synthetic events vary around base.
+struct SensorModel {
+    int type;
+    const char* stringType;
+    const char* name;
+    float maxRange;
+    float resolution;
+    int32_t minDelayUs;
+    uint32_t flags;
+    bool synthetic;
+    float base[3];
+    float amplitude;
+};
+
+const SensorModel MODELS[] = {
+    { SENSOR_TYPE_ACCELEROMETER, SENSOR_STRING_TYPE_ACCELEROMETER, "Replay Accelerometer",
+      78.4f, 0.01f, 1000, SENSOR_FLAG_CONTINUOUS_MODE, true, { 0, 0, 9.81f }, 0.2f },
+    { SENSOR_TYPE_GYROSCOPE, SENSOR_STRING_TYPE_GYROSCOPE, "Replay Gyroscope",
+      34.9f, 0.001f, 1000, SENSOR_FLAG_CONTINUOUS_MODE, true, { 0, 0, 0 }, 0.05f },
+    { SENSOR_TYPE_MAGNETIC_FIELD, SENSOR_STRING_TYPE_MAGNETIC_FIELD, "Replay Magnetometer",
+      1300.0f, 0.1f, 10000, SENSOR_FLAG_CONTINUOUS_MODE, true, { 0, 22.0f, -40.0f }, 1.0f },
+    { SENSOR_TYPE_PRESSURE, SENSOR_STRING_TYPE_PRESSURE, "Replay Barometer",
+      1100.0f, 0.01f, 40000, SENSOR_FLAG_CONTINUOUS_MODE, true, { 1013.25f, 0, 0 }, 0.1f },
+    { SENSOR_TYPE_LIGHT, SENSOR_STRING_TYPE_LIGHT, "Replay Light",
+      10000.0f, 1.0f, 0, SENSOR_FLAG_ON_CHANGE_MODE, false, { 300.0f, 0, 0 }, 50.0f },
+};
+
+// Describes the trace sensors of other types.
+const SensorModel GENERIC_MODEL = {
+    0, "", "Replay Sensor", 1000.0f, 0.01f, 1000, SENSOR_FLAG_CONTINUOUS_MODE, false,
+    { 0, 0, 0 }, 0
+};
+
+struct Stream {
+    const SensorModel* model;
+    int type;
+    // Events of a trace, with timestamps relative to the start of the trace. Empty when the
+    // events are generated.
+    std::vector<sensors_event_t> trace;
+    bool active;
+    nsecs_t period;
+    nsecs_t maxLatency;
+    // Index of the next event, trace events repeating every trace.size() events, and the time
+    // it is played at (elapsedRealtimeNano).
+    uint64_t next;
+    nsecs_t nextTime;
+    int pendingFlushes;
+};
+
+class Replay {
+public:
+    Replay() : mMode(SENSOR_HAL_NORMAL_MODE), mStart(0), mLoopLength(0), mSpeed(1) {}
+
+    bool load(const String8& source, float speed);
+    const String8& getDescription() const { return mDescription; }
+
+    int getSensorsList(sensor_t const** list) const;
+    int setOperationMode(unsigned int mode);
+    int activate(int handle, int enabled);
+    int batch(int handle, int64_t samplingPeriodNs, int64_t maxReportLatencyNs);
+    int flush(int handle);
+    int injectSensorData(const sensors_event_t* event);
+    int poll(sensors_event_t* buffer, int count);
+
+private:
+    bool loadTrace(const char* path);
+    void addStream(int type);
+    Stream* getStreamLocked(int handle);
+    // Moves the next event of a stream to the first one played at or after now.
+    void seekLocked(Stream& stream, nsecs_t now);
+    nsecs_t getTraceTime(const Stream& stream, uint64_t index) const;
+    void playLocked(Stream& stream, int handle, sensors_event_t* event);
+
+    Mutex mLock;
+    Condition mCondition;
+    unsigned int mMode;
+    std::vector<Stream> mStreams;
+    // Handle i + 1 is mStreams[i].
+    std::vector<sensor_t> mSensorList;
+    std::vector<sensors_event_t> mInjectedEvents;
+    nsecs_t mStart;
+    nsecs_t mLoopLength;
+    float mSpeed;
+    String8 mDescription;
+};
+
+bool Replay::load(const String8& source, float speed) {
+    mSpeed = speed > 0 ? speed : 1;
+    if (source == "synthetic") {
+        for (const SensorModel& model : MODELS) {
+            if (model.synthetic) {
+                addStream(model.type);
+            }
+        }
+        mDescription = "synthetic events";
+    } else {
+        if (!loadTrace(source.string())) {
+            return false;
+        }
+        mDescription.appendFormat("%s at %.2fx", source.string(), mSpeed);
+    }
+
+    mSensorList.resize(mStreams.size());
+    for (size_t i = 0; i < mStreams.size(); i++) {
+        const SensorModel& model = *mStreams[i].model;
+        sensor_t& sensor = mSensorList[i];
+        memset(&sensor, 0, sizeof(sensor));
+        sensor.name = model.name;
+        sensor.vendor = "AOSP";
+        sensor.version = 1;
+        sensor.handle = i + 1;
+        sensor.type = mStreams[i].type;
+        sensor.maxRange = model.maxRange;
+        sensor.resolution = model.resolution;
+        sensor.power = 0.1f;
+        sensor.minDelay = model.minDelayUs;
+        sensor.fifoReservedEventCount = 0;
+        sensor.fifoMaxEventCount = 1000;
+        sensor.stringType = model.stringType;
+        sensor.requiredPermission = "";
+        sensor.maxDelay = model.minDelayUs ? 1000000 : 0;
+        sensor.flags = model.flags;
+    }
+    mStart = elapsedRealtimeNano();
+    return !mStreams.empty();
+}
+
+bool Replay::loadTrace(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        ALOGE("can't open sensor trace %s (%s)", path, strerror(errno));
+        return false;
+    }
+    std::vector<sensors_event_t> events;
+    sensors_event_t event;
+    // A file of raw events starts with the version of the first one.
+    if (fread(&event, sizeof(event), 1, f) == 1 && event.version == sizeof(sensors_event_t)) {
+        do {
+            events.push_back(event);
+        } while (fread(&event, sizeof(event), 1, f) == 1);
+    } else {
+        rewind(f);
+        char line[512];
+        while (fgets(line, sizeof(line), f)) {
+            memset(&event, 0, sizeof(event));
+            char* p = line;
+            char* end;
+            event.type = strtol(p, &end, 10);
+            if (end == p) {
+                continue;
+            }
+            p = end;
+            event.timestamp = strtoll(p, &end, 10);
+            if (end == p) {
+                continue;
+            }
+            p = end;
+            for (size_t i = 0; i < 16; i++, p = end) {
+                event.data[i] = strtof(p, &end);
+                if (end == p) {
+                    break;
+                }
+            }
+            events.push_back(event);
+        }
+    }
+    fclose(f);
+
+    nsecs_t first = INT64_MAX, last = INT64_MIN;
+    for (const sensors_event_t& e : events) {
+        if (e.type <= 0 || e.type == SENSOR_TYPE_META_DATA) {
+            continue;
+        }
+        first = std::min(first, nsecs_t(e.timestamp));
+        last = std::max(last, nsecs_t(e.timestamp));
+    }
+    if (first > last) {
+        ALOGE("no sensor events in trace %s", path);
+        return false;
+    }
+
+    for (const sensors_event_t& e : events) {
+        if (e.type <= 0 || e.type == SENSOR_TYPE_META_DATA) {
+            continue;
+        }
+        Stream* stream = nullptr;
+        for (Stream& s : mStreams) {
+            if (s.type == e.type) {
+                stream = &s;
+                break;
+            }
+        }
+        if (stream == nullptr) {
+            addStream(e.type);
+            stream = &mStreams.back();
+        }
+        stream->trace.push_back(e);
+        stream->trace.back().timestamp -= first;
+    }
+
+    // The trace starts over after its last event, as long after as the events of its fastest
+    // sensor are apart.
+    nsecs_t interval = INT64_MAX;
+    for (Stream& stream : mStreams) {
+        std::stable_sort(stream.trace.begin(), stream.trace.end(),
+                [](const sensors_event_t& a, const sensors_event_t& b) {
+                    return a.timestamp < b.timestamp;
+                });
+        for (size_t i = 1; i < stream.trace.size(); i++) {
+            const nsecs_t d = stream.trace[i].timestamp - stream.trace[i - 1].timestamp;
+            if (d > 0) {
+                interval = std::min(interval, d);
+            }
+        }
+    }
+    mLoopLength = last - first + (interval == INT64_MAX ? ms2ns(10) : interval);
+    return true;
+}
+
+void Replay::addStream(int type) {
+    Stream stream;
+    stream.model = &GENERIC_MODEL;
+    for (const SensorModel& model : MODELS) {
+        if (model.type == type) {
+            stream.model = &model;
+        }
+    }
+    stream.type = type;
+    stream.active = false;
+    stream.period = us2ns(stream.model->minDelayUs);
+    stream.maxLatency = 0;
+    stream.next = 0;
+    stream.nextTime = 0;
+    stream.pendingFlushes = 0;
+    mStreams.push_back(stream);
+}
+
+int Replay::getSensorsList(sensor_t const** list) const {
+    *list = mSensorList.data();
+    return mSensorList.size();
+}
+
+Stream* Replay::getStreamLocked(int handle) {
+    if (handle < 1 || size_t(handle) > mStreams.size()) {
+        return nullptr;
+    }
+    return &mStreams[handle - 1];
+}
+
+nsecs_t Replay::getTraceTime(const Stream& stream, uint64_t index) const {
+    const uint64_t cycle = index / stream.trace.size();
+    const nsecs_t offset = stream.trace[index % stream.trace.size()].timestamp;
+    return mStart + nsecs_t(double(cycle * mLoopLength + offset) / mSpeed);
+}
+
+void Replay::seekLocked(Stream& stream, nsecs_t now) {
+    if (stream.trace.empty()) {
+        stream.nextTime = now + stream.period;
+        return;
+    }
+    const nsecs_t elapsed = nsecs_t((now - mStart) * double(mSpeed));
+    uint64_t cycle = elapsed / mLoopLength;
+    const nsecs_t offset = elapsed % mLoopLength;
+    size_t i = std::lower_bound(stream.trace.begin(), stream.trace.end(), offset,
+            [](const sensors_event_t& e, nsecs_t t) { return e.timestamp < t; })
+            - stream.trace.begin();
+    if (i == stream.trace.size()) {
+        cycle++;
+        i = 0;
+    }
+    stream.next = cycle * stream.trace.size() + i;
+    stream.nextTime = getTraceTime(stream, stream.next);
+}
+
+void Replay::playLocked(Stream& stream, int handle, sensors_event_t* event) {
+    memset(event, 0, sizeof(*event));
+    event->version = sizeof(sensors_event_t);
+    event->sensor = handle;
+    event->type = stream.type;
+    event->timestamp = stream.nextTime;
+    if (!stream.trace.empty()) {
+        memcpy(event->data, stream.trace[stream.next % stream.trace.size()].data,
+                sizeof(event->data));
+        stream.next++;
+        stream.nextTime = getTraceTime(stream, stream.next);
+    } else {
+        const float t = stream.nextTime / 1e9f;
+        for (size_t k = 0; k < 3; k++) {
+            event->data[k] = stream.model->base[k]
+                    + stream.model->amplitude * sinf(float(M_PI) * t + k);
+        }
+        stream.next++;
+        stream.nextTime += stream.period;
+    }
+}
+
+int Replay::setOperationMode(unsigned int mode) {
+    if (mode != SENSOR_HAL_NORMAL_MODE && mode != SENSOR_HAL_DATA_INJECTION_MODE) {
+        return -EINVAL;
+    }
+    Mutex::Autolock _l(mLock);
+    if (mode == SENSOR_HAL_NORMAL_MODE && mMode != mode) {
+        // Pick up the replay where it is now rather than playing what was missed.
+        const nsecs_t now = elapsedRealtimeNano();
+        for (Stream& stream : mStreams) {
+            if (stream.active) {
+                seekLocked(stream, now);
+            }
+        }
+        mInjectedEvents.clear();
+    }
+    mMode = mode;
+    mCondition.signal();
+    return 0;
+}
+
+int Replay::activate(int handle, int enabled) {
+    Mutex::Autolock _l(mLock);
+    Stream* stream = getStreamLocked(handle);
+    if (stream == nullptr) {
+        return -EINVAL;
+    }
+    if (enabled && !stream->active) {
+        seekLocked(*stream, elapsedRealtimeNano());
+    }
+    stream->active = enabled;
+    mCondition.signal();
+    return 0;
+}
+
+int Replay::batch(int handle, int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
+    Mutex::Autolock _l(mLock);
+    Stream* stream = getStreamLocked(handle);
+    if (stream == nullptr) {
+        return -EINVAL;
+    }
+    stream->period = std::max(samplingPeriodNs, int64_t(us2ns(stream->model->minDelayUs)));
+    stream->maxLatency = maxReportLatencyNs;
+    mCondition.signal();
+    return 0;
+}
+
+int Replay::flush(int handle) {
+    Mutex::Autolock _l(mLock);
+    Stream* stream = getStreamLocked(handle);
+    if (stream == nullptr || !stream->active) {
+        return -EINVAL;
+    }
+    stream->pendingFlushes++;
+    mCondition.signal();
+    return 0;
+}
+
+int Replay::injectSensorData(const sensors_event_t* event) {
+    Mutex::Autolock _l(mLock);
+    if (mMode != SENSOR_HAL_DATA_INJECTION_MODE) {
+        return -EPERM;
+    }
+    mInjectedEvents.push_back(*event);
+    mCondition.signal();
+    return 0;
+}
+
+int Replay::poll(sensors_event_t* buffer, int count) {
+    Mutex::Autolock _l(mLock);
+    for (;;) {
+        int n = 0;
+        if (mMode == SENSOR_HAL_DATA_INJECTION_MODE) {
+            n = std::min(size_t(count), mInjectedEvents.size());
+            std::copy(mInjectedEvents.begin(), mInjectedEvents.begin() + n, buffer);
+            mInjectedEvents.erase(mInjectedEvents.begin(), mInjectedEvents.begin() + n);
+            if (n > 0) {
+                return n;
+            }
+            mCondition.wait(mLock);
+            continue;
+        }
+
+        const nsecs_t now = elapsedRealtimeNano();
+        nsecs_t wakeUpTime = INT64_MAX;
+        for (size_t i = 0; i < mStreams.size() && n < count; i++) {
+            Stream& stream = mStreams[i];
+            // Batched events are reported once the oldest one is maxLatency old, or on flush.
+            if (stream.pendingFlushes > 0
+                    || (stream.active && stream.nextTime + stream.maxLatency <= now)) {
+                while (stream.active && stream.nextTime <= now && n < count) {
+                    playLocked(stream, i + 1, &buffer[n++]);
+                }
+                while (stream.pendingFlushes > 0 && n < count
+                        && !(stream.active && stream.nextTime <= now)) {
+                    sensors_event_t& event = buffer[n++];
+                    memset(&event, 0, sizeof(event));
+                    event.version = META_DATA_VERSION;
+                    event.type = SENSOR_TYPE_META_DATA;
+                    event.meta_data.what = META_DATA_FLUSH_COMPLETE;
+                    event.meta_data.sensor = i + 1;
+                    stream.pendingFlushes--;
+                }
+            }
+            if (stream.active) {
+                wakeUpTime = std::min(wakeUpTime, stream.nextTime + stream.maxLatency);
+            }
+        }
+        if (n > 0) {
+            return n;
+        }
+        if (wakeUpTime == INT64_MAX) {
+            mCondition.wait(mLock);
+        } else {
+            mCondition.waitRelative(mLock, wakeUpTime - now);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// HAL entry points
+
+Replay* sReplay = nullptr;
+String8 sConfiguredSource;
+float sConfiguredSpeed = 1;
+sensors_module_t sModule;
+sensors_poll_device_1_t sDevice;
+
+int getSensorsList(struct sensors_module_t* /*module*/, struct sensor_t const** list) {
+    return sReplay->getSensorsList(list);
+}
+
+int setOperationMode(unsigned int mode) {
+    return sReplay->setOperationMode(mode);
+}
+
+int activate(struct sensors_poll_device_t* /*dev*/, int handle, int enabled) {
+    return sReplay->activate(handle, enabled);
+}
+
+int setDelay(struct sensors_poll_device_t* /*dev*/, int handle, int64_t samplingPeriodNs) {
+    return sReplay->batch(handle, samplingPeriodNs, 0);
+}
+
+int poll(struct sensors_poll_device_t* /*dev*/, sensors_event_t* buffer, int count) {
+    return sReplay->poll(buffer, count);
+}
+
+int batch(struct sensors_poll_device_1* /*dev*/, int handle, int /*flags*/,
+        int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
+    return sReplay->batch(handle, samplingPeriodNs, maxReportLatencyNs);
+}
+
+int flush(struct sensors_poll_device_1* /*dev*/, int handle) {
+    return sReplay->flush(handle);
+}
+
+int injectSensorData(struct sensors_poll_device_1* /*dev*/, const sensors_event_t* event) {
+    return sReplay->injectSensorData(event);
+}
+
+int closeDevice(struct hw_device_t* /*device*/) {
+    return 0;
+}
+
+int openDevice(const struct hw_module_t* module, const char* id, struct hw_device_t** device) {
+    if (strcmp(id, SENSORS_HARDWARE_POLL) != 0) {
+        return -EINVAL;
+    }
+    memset(&sDevice, 0, sizeof(sDevice));
+    sDevice.common.tag = HARDWARE_DEVICE_TAG;
+    sDevice.common.version = SENSORS_DEVICE_API_VERSION_1_4;
+    sDevice.common.module = const_cast<hw_module_t*>(module);
+    sDevice.common.close = closeDevice;
+    sDevice.activate = activate;
+    sDevice.setDelay = setDelay;
+    sDevice.poll = poll;
+    sDevice.batch = batch;
+    sDevice.flush = flush;
+    sDevice.inject_sensor_data = injectSensorData;
+    *device = &sDevice.common;
+    return 0;
+}
+
+hw_module_methods_t sMethods = { openDevice };
+
+} // unnamed namespace
+
+void ReplaySensorHal::configure(const char* source, float speed) {
+    sConfiguredSource.setTo(source);
+    sConfiguredSpeed = speed;
+}
+
+sensors_module_t* ReplaySensorHal::getModule() {
+    if (sReplay != nullptr) {
+        return &sModule;
+    }
+
+    String8 source(sConfiguredSource);
+    float speed = sConfiguredSpeed;
+    if (source.isEmpty()) {
+        // Apps must not be fed made up sensor data on a user build.
+        char value[PROPERTY_VALUE_MAX];
+        property_get("ro.debuggable", value, "0");
+        if (strcmp(value, "1") != 0) {
+            return nullptr;
+        }
+        if (property_get("debug.sensors.replay", value, "") <= 0) {
+            return nullptr;
+        }
+        source.setTo(value);
+        property_get("debug.sensors.replay.speed", value, "1");
+        speed = atof(value);
+    }
+
+    Replay* replay = new Replay();
+    if (!replay->load(source, speed)) {
+        ALOGE("can't replay %s, using the sensors HAL", source.string());
+        delete replay;
+        return nullptr;
+    }
+    ALOGI("replaying %s instead of using the sensors HAL", replay->getDescription().string());
+    sReplay = replay;
+
+    memset(&sModule, 0, sizeof(sModule));
+    sModule.common.tag = HARDWARE_MODULE_TAG;
+    sModule.common.module_api_version = SENSORS_MODULE_API_VERSION_0_1;
+    sModule.common.hal_api_version = HARDWARE_HAL_API_VERSION;
+    sModule.common.id = SENSORS_HARDWARE_MODULE_ID;
+    sModule.common.name = "Sensor replay";
+    sModule.common.author = "The Android Open Source Project";
+    sModule.common.methods = &sMethods;
+    sModule.get_sensors_list = getSensorsList;
+    sModule.set_operation_mode = setOperationMode;
+    return &sModule;
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_REPLAY_SENSOR_HAL_H
+#define ANDROID_REPLAY_SENSOR_HAL_H
+
+#include <cutils/compiler.h>
+#include <hardware/sensors.h>
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+// A sensors HAL which plays back recorded or generated events, which SensorDevice loads instead
+// of the real HAL when a replay is configured. It lets SensorService run, and be profiled, with a
+// known load and without sensor hardware.
+//
+// The replay either generates accelerometer, gyroscope, magnetometer and barometer events at the
+// rates the clients request ("synthetic"), or plays a trace in a loop. A trace is a text file
+// with one event per line, "<sensor type> <timestamp ns> <value> <value> ...", or a file of raw
+// sensors_event_t. There is one sensor per type of the trace, playing the events of that type at
+// their recorded times, speed times faster. In both cases the events are timestamped when they
+// are played, batching and flush behave like the HAL, and the data injection mode replaces the
+// played events with the injected ones.
+class ReplaySensorHal {
+public:
+    // Sets the replay source used by the next getModule(): "synthetic" or the path of a trace.
+    static void configure(const char* source, float speed) ANDROID_API;
+
+    // Returns the module to use instead of the sensors HAL, or NULL if no replay is configured,
+    // with configure() or with the debug.sensors.replay and debug.sensors.replay.speed properties,
+    // or if the trace can't be read. The properties are only honored on debuggable builds.
+    // Called once, when SensorDevice is created.
+    static sensors_module_t* getModule();
+};
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_REPLAY_SENSOR_HAL_H
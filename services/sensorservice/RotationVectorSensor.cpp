@@ -46,20 +46,31 @@ RotationVectorSensor::RotationVectorSensor(int mode) :
 bool RotationVectorSensor::process(sensors_event_t* outEvent,
         const sensors_event_t& event)
 {
-    if (event.type == SENSOR_TYPE_ACCELEROMETER) {
-        if (mSensorFusion.hasEstimate(mMode)) {
-            const vec4_t q(mSensorFusion.getAttitude(mMode));
-            *outEvent = event;
+    return processBatch(outEvent, 1, &event, 1) == 1;
+}
+
+size_t RotationVectorSensor::processBatch(sensors_event_t* outEvents, size_t maxCount,
+        const sensors_event_t* events, size_t count)
+{
+    if (!mSensorFusion.hasEstimate(mMode))
+        return 0;
+    const vec4_t q(mSensorFusion.getAttitude(mMode));
+    const int token = getSensorToken();
+    const int type = getSensorType();
+    size_t n = 0;
+    for (size_t i = 0; i < count && n < maxCount; i++) {
+        if (events[i].type == SENSOR_TYPE_ACCELEROMETER) {
+            sensors_event_t* outEvent = &outEvents[n++];
+            *outEvent = events[i];
             outEvent->data[0] = q.x;
             outEvent->data[1] = q.y;
             outEvent->data[2] = q.z;
             outEvent->data[3] = q.w;
-            outEvent->sensor = getSensorToken();
-            outEvent->type = getSensorType();
-            return true;
+            outEvent->sensor = token;
+            outEvent->type = type;
         }
     }
-    return false;
+    return n;
 }
 
 status_t RotationVectorSensor::activate(void* ident, bool enabled) {
@@ -132,19 +143,28 @@ GyroDriftSensor::GyroDriftSensor() {
 bool GyroDriftSensor::process(sensors_event_t* outEvent,
         const sensors_event_t& event)
 {
-    if (event.type == SENSOR_TYPE_ACCELEROMETER) {
-        if (mSensorFusion.hasEstimate()) {
-            const vec3_t b(mSensorFusion.getGyroBias());
-            *outEvent = event;
+    return processBatch(outEvent, 1, &event, 1) == 1;
+}
+
+size_t GyroDriftSensor::processBatch(sensors_event_t* outEvents, size_t maxCount,
+        const sensors_event_t* events, size_t count)
+{
+    if (!mSensorFusion.hasEstimate())
+        return 0;
+    const vec3_t b(mSensorFusion.getGyroBias());
+    size_t n = 0;
+    for (size_t i = 0; i < count && n < maxCount; i++) {
+        if (events[i].type == SENSOR_TYPE_ACCELEROMETER) {
+            sensors_event_t* outEvent = &outEvents[n++];
+            *outEvent = events[i];
             outEvent->data[0] = b.x;
             outEvent->data[1] = b.y;
             outEvent->data[2] = b.z;
             outEvent->sensor = '_gbs';
             outEvent->type = SENSOR_TYPE_ACCELEROMETER;
-            return true;
         }
     }
-    return false;
+    return n;
 }
 
 status_t GyroDriftSensor::activate(void* ident, bool enabled) {
@@ -36,6 +36,8 @@ class RotationVectorSensor : public VirtualSensor {
 public:
     RotationVectorSensor(int mode = FUSION_9AXIS);
     virtual bool process(sensors_event_t* outEvent, const sensors_event_t& event) override;
+    virtual size_t processBatch(sensors_event_t* outEvents, size_t maxCount,
+                                const sensors_event_t* events, size_t count) override;
     virtual status_t activate(void* ident, bool enabled) override;
     virtual status_t setDelay(void* ident, int handle, int64_t ns) override;
 
@@ -60,6 +62,8 @@ class GyroDriftSensor : public VirtualSensor {
 public:
     GyroDriftSensor();
     virtual bool process(sensors_event_t* outEvent, const sensors_event_t& event) override;
+    virtual size_t processBatch(sensors_event_t* outEvents, size_t maxCount,
+                                const sensors_event_t* events, size_t count) override;
     virtual status_t activate(void* ident, bool enabled) override;
     virtual status_t setDelay(void* ident, int handle, int64_t ns) override;
 };
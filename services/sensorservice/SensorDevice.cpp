@@ -29,6 +29,7 @@
 
 #include <hardware/sensors.h>
 
+#include "ReplaySensorHal.h"
 #include "SensorDevice.h"
 #include "SensorService.h"
 
@@ -40,8 +41,13 @@ ANDROID_SINGLETON_STATIC_INSTANCE(SensorDevice)
 SensorDevice::SensorDevice()
     :  mSensorDevice(0),
        mSensorModule(0) {
-    status_t err = hw_get_module(SENSORS_HARDWARE_MODULE_ID,
-            (hw_module_t const**)&mSensorModule);
+    status_t err = NO_ERROR;
+    // A configured replay stands in for the HAL, see ReplaySensorHal.h.
+    mSensorModule = ReplaySensorHal::getModule();
+    if (!mSensorModule) {
+        err = hw_get_module(SENSORS_HARDWARE_MODULE_ID,
+                (hw_module_t const**)&mSensorModule);
+    }
 
     ALOGE_IF(err, "couldn't load %s module (%s)",
             SENSORS_HARDWARE_MODULE_ID, strerror(-err));
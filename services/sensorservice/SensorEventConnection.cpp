@@ -14,10 +14,14 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <inttypes.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <utils/threads.h>
 
 #include <gui/SensorEventQueue.h>
+#include <utils/SystemClock.h>
 
 #include "vec.h"
 #include "SensorEventConnection.h"
@@ -29,8 +33,9 @@ SensorService::SensorEventConnection::SensorEventConnection(
         const sp<SensorService>& service, uid_t uid, String8 packageName, bool isDataInjectionMode,
         const String16& opPackageName)
     : mService(service), mUid(uid), mWakeLockRefCount(0), mHasLooperCallbacks(false),
-      mDead(false), mDataInjectionMode(isDataInjectionMode), mEventCache(NULL),
-      mCacheSize(0), mMaxCacheSize(0), mPackageName(packageName), mOpPackageName(opPackageName) {
+      mDead(false), mDataInjectionMode(isDataInjectionMode), mUncachedDropCount(0),
+      mCachedEventCount(0), mDirectChannelMaxLatency(0), mDirectWakeupPendingSince(0),
+      mDirectWakeupTimerFd(-1), mPackageName(packageName), mOpPackageName(opPackageName) {
     mChannel = new BitTube(mService->mSocketBufferSize);
 #if DEBUG_CONNECTIONS
     mEventsReceived = mEventsSentFromCache = mEventsSent = 0;
@@ -38,12 +43,31 @@ SensorService::SensorEventConnection::SensorEventConnection(
 #endif
 }
 
+// Holds the connection weakly, as the looper keeps the callbacks of its fds alive.
+class SensorService::SensorEventConnection::DirectWakeupTimer : public LooperCallback {
+public:
+    explicit DirectWakeupTimer(const wp<SensorEventConnection>& connection)
+        : mConnection(connection) {
+    }
+
+    virtual int handleEvent(int fd, int /*events*/, void* /*data*/) {
+        uint64_t expirations;
+        ::read(fd, &expirations, sizeof(expirations));
+        sp<SensorEventConnection> connection(mConnection.promote());
+        if (connection != NULL) {
+            connection->onDirectWakeupTimer();
+        }
+        return 1;
+    }
+
+private:
+    wp<SensorEventConnection> mConnection;
+};
+
 SensorService::SensorEventConnection::~SensorEventConnection() {
     ALOGD_IF(DEBUG_CONNECTIONS, "~SensorEventConnection(%p)", this);
+    closeDirectWakeupTimerLocked();
     mService->cleanupConnection(this);
-    if (mEventCache != NULL) {
-        delete mEventCache;
-    }
 }
 
 void SensorService::SensorEventConnection::onFirstRef() {
@@ -63,9 +87,19 @@ void SensorService::SensorEventConnection::resetWakeLockRefCount() {
 void SensorService::SensorEventConnection::dump(String8& result) {
     Mutex::Autolock _l(mConnectionLock);
     result.appendFormat("\tOperating Mode: %s\n",mDataInjectionMode ? "DATA_INJECTION" : "NORMAL");
-    result.appendFormat("\t %s | WakeLockRefCount %d | uid %d | cache size %d | "
-            "max cache size %d\n", mPackageName.string(), mWakeLockRefCount, mUid, mCacheSize,
-            mMaxCacheSize);
+    result.appendFormat("\t %s | WakeLockRefCount %d | uid %d | cache size %zu | "
+            "max cache size %zu | cache dropped %" PRIu64 "\n", mPackageName.string(),
+            mWakeLockRefCount, mUid, mEventCache.size(), mEventCache.maxSize(),
+            mEventCache.droppedCount() + mUncachedDropCount);
+    if (mService->mPipelineStats.isEnabled()) {
+        result.appendFormat("\t delivery age | cached %" PRIu64 " | %s\n", mCachedEventCount,
+                mDeliveryAge.dump().c_str());
+    }
+    if (mDirectChannel != NULL) {
+        result.appendFormat("\t direct channel | capacity %zu | queued %zu | dropped %u | "
+                "max latency %.1fms\n", mDirectChannel->getCapacity(), mDirectChannel->getSize(),
+                mDirectChannel->getDroppedCount(), mDirectChannelMaxLatency / 1000000.0);
+    }
     for (size_t i = 0; i < mSensorInfo.size(); ++i) {
         const FlushInfo& flushInfo = mSensorInfo.valueAt(i);
         result.appendFormat("\t %s 0x%08x | status: %s | pending flush events %d \n",
@@ -81,12 +115,40 @@ void SensorService::SensorEventConnection::dump(String8& result) {
             mEventsReceived,
             mEventsSent,
             mEventsSentFromCache,
-            mEventsReceived - (mEventsSentFromCache + mEventsSent + mCacheSize),
+            mEventsReceived - (mEventsSentFromCache + mEventsSent + int(mEventCache.size())),
             mTotalAcksNeeded,
             mTotalAcksReceived);
 #endif
 }
 
+void SensorService::SensorEventConnection::getStats(SensorServiceUtil::ConnectionStats* outStats) {
+    Mutex::Autolock _l(mConnectionLock);
+    outStats->uid = mUid;
+    outStats->cachedCount = mCachedEventCount;
+    outStats->droppedCount = mEventCache.droppedCount() + mUncachedDropCount;
+    if (mDirectChannel != NULL) {
+        outStats->droppedCount += mDirectChannel->getDroppedCount();
+    }
+    outStats->age = mDeliveryAge;
+}
+
+void SensorService::SensorEventConnection::resetStats() {
+    Mutex::Autolock _l(mConnectionLock);
+    mCachedEventCount = 0;
+    mDeliveryAge.reset();
+}
+
+void SensorService::SensorEventConnection::countDeliveredEventsLocked(
+        sensors_event_t const* events, size_t count) {
+    // Sensor timestamps use the same clock as elapsedRealtimeNano().
+    const nsecs_t now = elapsedRealtimeNano();
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].type != SENSOR_TYPE_META_DATA) {
+            mDeliveryAge.add(now - events[i].timestamp);
+        }
+    }
+}
+
 bool SensorService::SensorEventConnection::addSensor(int32_t handle) {
     Mutex::Autolock _l(mConnectionLock);
     sp<SensorInterface> si = mService->getSensorInterfaceFromHandle(handle);
@@ -161,7 +223,7 @@ void SensorService::SensorEventConnection::updateLooperRegistrationLocked(
     return; }
 
     int looper_flags = 0;
-    if (mCacheSize > 0) looper_flags |= ALOOPER_EVENT_OUTPUT;
+    if (!mEventCache.isEmpty()) looper_flags |= ALOOPER_EVENT_OUTPUT;
     if (mDataInjectionMode) looper_flags |= ALOOPER_EVENT_INPUT;
     for (size_t i = 0; i < mSensorInfo.size(); ++i) {
         const int handle = mSensorInfo.keyAt(i);
@@ -273,7 +335,54 @@ status_t SensorService::SensorEventConnection::sendEvents(
         count = numEvents;
     }
 
+    return writeEventsLocked(scratch, count);
+}
+
+status_t SensorService::SensorEventConnection::sendEvents(
+        sensors_event_t const* buffer, uint32_t const* indices, size_t numIndices,
+        sensors_event_t* scratch,
+        wp<const SensorEventConnection> const * mapFlushEventsToConnections) {
+    // The events were routed to this connection by sensor handle, so only the flush state of
+    // the sensors needs to be checked here.
+    int count = 0;
+    Mutex::Autolock _l(mConnectionLock);
+    for (size_t k = 0; k < numIndices; k++) {
+        const size_t i = indices[k];
+        int32_t sensor_handle = buffer[i].sensor;
+        if (buffer[i].type == SENSOR_TYPE_META_DATA) {
+            sensor_handle = buffer[i].meta_data.sensor;
+        }
+
+        ssize_t index = mSensorInfo.indexOfKey(sensor_handle);
+        if (index < 0) {
+            continue;
+        }
+
+        FlushInfo& flushInfo = mSensorInfo.editValueAt(index);
+        if (buffer[i].type == SENSOR_TYPE_META_DATA && flushInfo.mFirstFlushPending == true &&
+                mapFlushEventsToConnections[i] == this) {
+            flushInfo.mFirstFlushPending = false;
+            ALOGD_IF(DEBUG_CONNECTIONS, "First flush event for sensor==%d ",
+                    buffer[i].meta_data.sensor);
+            continue;
+        }
+        if (flushInfo.mFirstFlushPending) {
+            continue;
+        }
+        if (buffer[i].type != SENSOR_TYPE_META_DATA || mapFlushEventsToConnections[i] == this) {
+            scratch[count++] = buffer[i];
+        }
+    }
+
+    return writeEventsLocked(scratch, count);
+}
+
+status_t SensorService::SensorEventConnection::writeEventsLocked(sensors_event_t* scratch,
+        int count) {
     sendPendingFlushEventsLocked();
+    if (mDirectChannel != NULL) {
+        count = writeToDirectChannelLocked(scratch, count);
+    }
     // Early return if there are no events for this connection.
     if (count == 0) {
         return status_t(NO_ERROR);
@@ -282,35 +391,10 @@ status_t SensorService::SensorEventConnection::sendEvents(
 #if DEBUG_CONNECTIONS
      mEventsReceived += count;
 #endif
-    if (mCacheSize != 0) {
+    if (!mEventCache.isEmpty()) {
         // There are some events in the cache which need to be sent first. Copy this buffer to
         // the end of cache.
-        if (mCacheSize + count <= mMaxCacheSize) {
-            memcpy(&mEventCache[mCacheSize], scratch, count * sizeof(sensors_event_t));
-            mCacheSize += count;
-        } else {
-            // Check if any new sensors have registered on this connection which may have increased
-            // the max cache size that is desired.
-            if (mCacheSize + count < computeMaxCacheSizeLocked()) {
-                reAllocateCacheLocked(scratch, count);
-                return status_t(NO_ERROR);
-            }
-            // Some events need to be dropped.
-            int remaningCacheSize = mMaxCacheSize - mCacheSize;
-            if (remaningCacheSize != 0) {
-                memcpy(&mEventCache[mCacheSize], scratch,
-                                                remaningCacheSize * sizeof(sensors_event_t));
-            }
-            int numEventsDropped = count - remaningCacheSize;
-            countFlushCompleteEventsLocked(mEventCache, numEventsDropped);
-            // Drop the first "numEventsDropped" in the cache.
-            memmove(mEventCache, &mEventCache[numEventsDropped],
-                    (mCacheSize - numEventsDropped) * sizeof(sensors_event_t));
-
-            // Copy the remainingEvents in scratch buffer to the end of cache.
-            memcpy(&mEventCache[mCacheSize - numEventsDropped], scratch + remaningCacheSize,
-                                            numEventsDropped * sizeof(sensors_event_t));
-        }
+        cacheEventsLocked(scratch, count);
         return status_t(NO_ERROR);
     }
 
@@ -338,13 +422,7 @@ status_t SensorService::SensorEventConnection::sendEvents(
             --mTotalAcksNeeded;
 #endif
         }
-        if (mEventCache == NULL) {
-            mMaxCacheSize = computeMaxCacheSizeLocked();
-            mEventCache = new sensors_event_t[mMaxCacheSize];
-            mCacheSize = 0;
-        }
-        memcpy(&mEventCache[mCacheSize], scratch, count * sizeof(sensors_event_t));
-        mCacheSize += count;
+        cacheEventsLocked(scratch, count);
 
         // Add this file descriptor to the looper to get a callback when this fd is available for
         // writing.
@@ -352,6 +430,9 @@ status_t SensorService::SensorEventConnection::sendEvents(
         return size;
     }
 
+    if (mService->mPipelineStats.isEnabled()) {
+        countDeliveredEventsLocked(scratch, count);
+    }
 #if DEBUG_CONNECTIONS
     if (size > 0) {
         mEventsSent += count;
@@ -361,22 +442,156 @@ status_t SensorService::SensorEventConnection::sendEvents(
     return size < 0 ? status_t(size) : status_t(NO_ERROR);
 }
 
-void SensorService::SensorEventConnection::reAllocateCacheLocked(sensors_event_t const* scratch,
-                                                                 int count) {
-    sensors_event_t *eventCache_new;
-    const int new_cache_size = computeMaxCacheSizeLocked();
-    // Allocate new cache, copy over events from the old cache & scratch, free up memory.
-    eventCache_new = new sensors_event_t[new_cache_size];
-    memcpy(eventCache_new, mEventCache, mCacheSize * sizeof(sensors_event_t));
-    memcpy(&eventCache_new[mCacheSize], scratch, count * sizeof(sensors_event_t));
+int SensorService::SensorEventConnection::writeToDirectChannelLocked(sensors_event_t* scratch,
+        int count) {
+    const nsecs_t now = systemTime();
+    // The events of wake-up sensors are moved to the front of scratch as they are found, and
+    // the runs of other events between them are written to the ring.
+    int socketCount = 0;
+    int runStart = 0;
+    for (int i = 0; i <= count; i++) {
+        if (i < count && !mService->isWakeUpSensorEvent(scratch[i])) {
+            continue;
+        }
+        if (i > runStart && !writeToRingLocked(scratch + runStart, i - runStart, now)) {
+            // The ring is corrupted, the socket gets all the events that are left.
+            memmove(scratch + socketCount, scratch + runStart,
+                    (count - runStart) * sizeof(sensors_event_t));
+            return socketCount + count - runStart;
+        }
+        if (i < count) {
+            scratch[socketCount++] = scratch[i];
+        }
+        runStart = i + 1;
+    }
 
-    ALOGD_IF(DEBUG_CONNECTIONS, "reAllocateCacheLocked maxCacheSize=%d %d", mMaxCacheSize,
-            new_cache_size);
+    // The timer signals the events that no later poll of the sensors gets to in time.
+    if (mDirectWakeupPendingSince != 0
+            && (now - mDirectWakeupPendingSince >= mDirectChannelMaxLatency
+                    || mDirectChannel->getSize() * 2 >= mDirectChannel->getCapacity())) {
+        wakeDirectChannelLocked();
+    }
+    return socketCount;
+}
+
+bool SensorService::SensorEventConnection::writeToRingLocked(sensors_event_t const* events,
+        int count, nsecs_t now) {
+    // NOTE: ASensorEvent and sensors_event_t are the same type.
+    ssize_t written = mDirectChannel->write(reinterpret_cast<ASensorEvent const*>(events), count);
+    if (written < 0) {
+        ALOGE("direct channel of %s is corrupted, going back to the socket",
+                mPackageName.string());
+        // Let the application find out, its queue reads the socket from then on.
+        SensorDirectChannel::wake(mChannel);
+        mDirectChannel.clear();
+        mDirectWakeupPendingSince = 0;
+        closeDirectWakeupTimerLocked();
+        return false;
+    }
+#if DEBUG_CONNECTIONS
+    mEventsReceived += count;
+#endif
+    if (written < count) {
+        countFlushCompleteEventsLocked(events + written, count - written);
+    }
+    if (written > 0) {
+        armDirectWakeupLocked(now);
+    }
+    if (mService->mPipelineStats.isEnabled()) {
+        countDeliveredEventsLocked(events, written);
+    }
+#if DEBUG_CONNECTIONS
+    mEventsSent += written;
+#endif
+    return true;
+}
+
+void SensorService::SensorEventConnection::armDirectWakeupLocked(nsecs_t now) {
+    if (mDirectWakeupPendingSince != 0) {
+        return;
+    }
+    mDirectWakeupPendingSince = now;
+    if (mDirectWakeupTimerFd >= 0 && mDirectChannelMaxLatency > 0) {
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        spec.it_value.tv_sec = mDirectChannelMaxLatency / 1000000000;
+        spec.it_value.tv_nsec = mDirectChannelMaxLatency % 1000000000;
+        timerfd_settime(mDirectWakeupTimerFd, 0, &spec, NULL);
+    }
+}
+
+void SensorService::SensorEventConnection::wakeDirectChannelLocked() {
+    // The timer is left armed, it finds nothing pending when it fires. The next event written
+    // arms it again.
+    SensorDirectChannel::wake(mChannel);
+    mDirectWakeupPendingSince = 0;
+}
+
+void SensorService::SensorEventConnection::onDirectWakeupTimer() {
+    Mutex::Autolock _l(mConnectionLock);
+    if (mDirectChannel != NULL && mDirectWakeupPendingSince != 0) {
+        wakeDirectChannelLocked();
+    }
+}
+
+void SensorService::SensorEventConnection::closeDirectWakeupTimerLocked() {
+    if (mDirectWakeupTimerFd >= 0) {
+        mService->getLooper()->removeFd(mDirectWakeupTimerFd);
+        close(mDirectWakeupTimerFd);
+        mDirectWakeupTimerFd = -1;
+        mDirectWakeupTimer.clear();
+    }
+}
 
-    delete mEventCache;
-    mEventCache = eventCache_new;
-    mCacheSize += count;
-    mMaxCacheSize = new_cache_size;
+void SensorService::SensorEventConnection::cacheEventsLocked(sensors_event_t const* scratch,
+                                                             int count) {
+    if (mEventCache.size() + count > mEventCache.maxSize()) {
+        // Check if any new sensors have registered on this connection which may have increased
+        // the max cache size that is desired.
+        const size_t maxCacheSize = computeMaxCacheSizeLocked();
+        if (maxCacheSize > mEventCache.maxSize()) {
+            ALOGD_IF(DEBUG_CONNECTIONS, "growing cache maxCacheSize=%zu %zu",
+                    mEventCache.maxSize(), maxCacheSize);
+            mEventCache.reserve(maxCacheSize);
+        }
+    }
+
+    const size_t room = mEventCache.maxSize() - mEventCache.size();
+    if (size_t(count) > room) {
+        // Some events need to be dropped, starting with the oldest ones in the cache.
+        size_t numEventsDropped = count - room;
+        const size_t numCachedEventsDropped = helpers::min(numEventsDropped, mEventCache.size());
+        ALOGD_IF(DEBUG_CONNECTIONS, "dropping %zu events ", numEventsDropped);
+        mEventCache.dropOldest(numCachedEventsDropped, [this](const sensors_event_t& event) {
+            countFlushCompleteEventsLocked(&event, 1);
+        });
+        numEventsDropped -= numCachedEventsDropped;
+        if (numEventsDropped > 0) {
+            // More events arrived than the cache can hold at all.
+            countFlushCompleteEventsLocked(scratch, numEventsDropped);
+            mUncachedDropCount += numEventsDropped;
+            scratch += numEventsDropped;
+            count -= numEventsDropped;
+        }
+    }
+    if (mService->mPipelineStats.isEnabled()) {
+        mCachedEventCount += count;
+    }
+
+    // Events come in runs of the same sensor, look up each sensor once per run.
+    int32_t lastHandle = 0;
+    bool lastIsWakeUp = false;
+    bool first = true;
+    mEventCache.push(scratch, count, [&](const sensors_event_t& event) {
+        const int32_t handle = event.type == SENSOR_TYPE_META_DATA ?
+                event.meta_data.sensor : event.sensor;
+        if (first || handle != lastHandle) {
+            lastIsWakeUp = mService->isWakeUpSensorEvent(event);
+            lastHandle = handle;
+            first = false;
+        }
+        return lastIsWakeUp;
+    });
 }
 
 void SensorService::SensorEventConnection::sendPendingFlushEventsLocked() {
@@ -396,6 +611,16 @@ void SensorService::SensorEventConnection::sendPendingFlushEventsLocked() {
         while (flushInfo.mPendingFlushEventsToSend > 0) {
             flushCompleteEvent.meta_data.sensor = handle;
             bool wakeUpSensor = si->getSensor().isWakeUpSensor();
+            if (mDirectChannel != NULL && !wakeUpSensor) {
+                // Try again after the next poll if the ring is still full.
+                if (mDirectChannel->getSize() >= mDirectChannel->getCapacity() ||
+                        mDirectChannel->write(&flushCompleteEvent, 1) != 1) {
+                    return;
+                }
+                armDirectWakeupLocked(systemTime());
+                flushInfo.mPendingFlushEventsToSend--;
+                continue;
+            }
             if (wakeUpSensor) {
                ++mWakeLockRefCount;
                flushCompleteEvent.flags |= WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
@@ -420,13 +645,13 @@ void SensorService::SensorEventConnection::writeToSocketFromCache() {
     Mutex::Autolock _l(mConnectionLock);
     // Send pending flush complete events (if any)
     sendPendingFlushEventsLocked();
-    for (int numEventsSent = 0; numEventsSent < mCacheSize;) {
-        const int numEventsToWrite = helpers::min(mCacheSize - numEventsSent, maxWriteSize);
-        int index_wake_up_event =
-                  findWakeUpSensorEventLocked(mEventCache + numEventsSent, numEventsToWrite);
+    while (!mEventCache.isEmpty()) {
+        // The cache is a ring, so the events at its end and at its start are written separately.
+        size_t numEventsToWrite;
+        sensors_event_t* events = mEventCache.front(maxWriteSize, &numEventsToWrite);
+        ssize_t index_wake_up_event = mEventCache.findWakeUp(numEventsToWrite);
         if (index_wake_up_event >= 0) {
-            mEventCache[index_wake_up_event + numEventsSent].flags |=
-                    WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
+            events[index_wake_up_event].flags |= WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
             ++mWakeLockRefCount;
 #if DEBUG_CONNECTIONS
             ++mTotalAcksNeeded;
@@ -434,13 +659,11 @@ void SensorService::SensorEventConnection::writeToSocketFromCache() {
         }
 
         ssize_t size = SensorEventQueue::write(mChannel,
-                          reinterpret_cast<ASensorEvent const*>(mEventCache + numEventsSent),
-                          numEventsToWrite);
+                          reinterpret_cast<ASensorEvent const*>(events), numEventsToWrite);
         if (size < 0) {
             if (index_wake_up_event >= 0) {
                 // If there was a wake_up sensor_event, reset the flag.
-                mEventCache[index_wake_up_event + numEventsSent].flags  &=
-                        ~WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
+                events[index_wake_up_event].flags &= ~WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
                 if (mWakeLockRefCount > 0) {
                     --mWakeLockRefCount;
                 }
@@ -448,21 +671,18 @@ void SensorService::SensorEventConnection::writeToSocketFromCache() {
                 --mTotalAcksNeeded;
 #endif
             }
-            memmove(mEventCache, &mEventCache[numEventsSent],
-                                 (mCacheSize - numEventsSent) * sizeof(sensors_event_t));
-            ALOGD_IF(DEBUG_CONNECTIONS, "wrote %d events from cache size==%d ",
-                    numEventsSent, mCacheSize);
-            mCacheSize -= numEventsSent;
+            ALOGD_IF(DEBUG_CONNECTIONS, "%zu events left in cache", mEventCache.size());
             return;
         }
-        numEventsSent += numEventsToWrite;
+        if (mService->mPipelineStats.isEnabled()) {
+            countDeliveredEventsLocked(events, numEventsToWrite);
+        }
+        mEventCache.pop(numEventsToWrite);
 #if DEBUG_CONNECTIONS
         mEventsSentFromCache += numEventsToWrite;
 #endif
     }
-    ALOGD_IF(DEBUG_CONNECTIONS, "wrote all events from cache size=%d ", mCacheSize);
-    // All events from the cache have been sent. Reset cache size to zero.
-    mCacheSize = 0;
+    ALOGD_IF(DEBUG_CONNECTIONS, "wrote all events from cache");
     // There are no more events in the cache. We don't need to poll for write on the fd.
     // Update Looper registration.
     updateLooperRegistrationLocked(mService->getLooper());
@@ -524,6 +744,33 @@ status_t  SensorService::SensorEventConnection::flush() {
     return  mService->flushSensor(this, mOpPackageName);
 }
 
+status_t SensorService::SensorEventConnection::setDirectChannel(
+        const sp<SensorDirectChannel>& channel, nsecs_t maxLatencyNs) {
+    if (channel != NULL && (channel->initCheck() != NO_ERROR || maxLatencyNs < 0)) {
+        return BAD_VALUE;
+    }
+    Mutex::Autolock _l(mConnectionLock);
+    if (mDirectChannel != NULL && mDirectWakeupPendingSince != 0) {
+        wakeDirectChannelLocked();
+    }
+    if (channel == NULL) {
+        closeDirectWakeupTimerLocked();
+    } else if (mDirectWakeupTimerFd < 0) {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0) {
+            ALOGE("can't create the wakeup timer of a direct channel (%s)", strerror(errno));
+            return -errno;
+        }
+        mDirectWakeupTimer = new DirectWakeupTimer(this);
+        mService->getLooper()->addFd(fd, 0, ALOOPER_EVENT_INPUT, mDirectWakeupTimer, NULL);
+        mDirectWakeupTimerFd = fd;
+    }
+    mDirectChannel = channel;
+    mDirectChannelMaxLatency = maxLatencyNs;
+    mDirectWakeupPendingSince = 0;
+    return NO_ERROR;
+}
+
 int SensorService::SensorEventConnection::handleEvent(int fd, int events, void* /*data*/) {
     if (events & ALOOPER_EVENT_HANGUP || events & ALOOPER_EVENT_ERROR) {
         {
@@ -547,49 +794,62 @@ int SensorService::SensorEventConnection::handleEvent(int fd, int events, void*
     }
 
     if (events & ALOOPER_EVENT_INPUT) {
+        // Drain the messages queued since the last callback and apply their acks at once, so
+        // that a client acknowledging many reads in a row costs a single wakelock check. Bounded
+        // so that a client injecting events can't keep this thread to itself.
         unsigned char buf[sizeof(sensors_event_t)];
-        ssize_t numBytesRead = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
         {
             Mutex::Autolock _l(mConnectionLock);
-            if (numBytesRead == sizeof(sensors_event_t)) {
-                if (!mDataInjectionMode) {
-                    ALOGE("Data injected in normal mode, dropping event"
-                          "package=%s uid=%d", mPackageName.string(), mUid);
-                    // Unregister call backs.
-                    return 0;
-                }
-                sensors_event_t sensor_event;
-                memcpy(&sensor_event, buf, sizeof(sensors_event_t));
-                sp<SensorInterface> si =
-                        mService->getSensorInterfaceFromHandle(sensor_event.sensor);
-                if (si == nullptr) {
-                    return 1;
+            uint32_t numAcks = 0;
+            bool ackError = false;
+            for (size_t n = 0; n < MAX_MESSAGES_PER_CALLBACK; n++) {
+                ssize_t numBytesRead = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (numBytesRead < 0 && n > 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    break;
                 }
+                if (numBytesRead == sizeof(sensors_event_t)) {
+                    if (!mDataInjectionMode) {
+                        ALOGE("Data injected in normal mode, dropping event"
+                              "package=%s uid=%d", mPackageName.string(), mUid);
+                        // Unregister call backs.
+                        return 0;
+                    }
+                    sensors_event_t sensor_event;
+                    memcpy(&sensor_event, buf, sizeof(sensors_event_t));
+                    sp<SensorInterface> si =
+                            mService->getSensorInterfaceFromHandle(sensor_event.sensor);
+                    if (si == nullptr) {
+                        continue;
+                    }
 
-                SensorDevice& dev(SensorDevice::getInstance());
-                sensor_event.type = si->getSensor().getType();
-                dev.injectSensorData(&sensor_event);
+                    SensorDevice& dev(SensorDevice::getInstance());
+                    sensor_event.type = si->getSensor().getType();
+                    dev.injectSensorData(&sensor_event);
 #if DEBUG_CONNECTIONS
-                ++mEventsReceived;
+                    ++mEventsReceived;
 #endif
-            } else if (numBytesRead == sizeof(uint32_t)) {
-                uint32_t numAcks = 0;
-                memcpy(&numAcks, buf, numBytesRead);
-                // Sanity check to ensure  there are no read errors in recv, numAcks is always
-                // within the range and not zero. If any of the above don't hold reset
-                // mWakeLockRefCount to zero.
-                if (numAcks > 0 && numAcks < mWakeLockRefCount) {
-                    mWakeLockRefCount -= numAcks;
-                } else {
-                    mWakeLockRefCount = 0;
-                }
+                } else if (numBytesRead == sizeof(uint32_t)) {
+                    uint32_t acks = 0;
+                    memcpy(&acks, buf, numBytesRead);
+                    // An ack is never zero.
+                    ackError |= acks == 0;
+                    numAcks += acks;
 #if DEBUG_CONNECTIONS
-                mTotalAcksReceived += numAcks;
+                    mTotalAcksReceived += acks;
 #endif
-           } else {
-               // Read error, reset wakelock refcount.
-               mWakeLockRefCount = 0;
-           }
+                } else {
+                    // Read error.
+                    ackError = true;
+                    break;
+                }
+            }
+            // Sanity check to ensure there are no read errors in recv and numAcks is within the
+            // range. If any of the above don't hold reset mWakeLockRefCount to zero.
+            if (numAcks > 0 && numAcks < mWakeLockRefCount && !ackError) {
+                mWakeLockRefCount -= numAcks;
+            } else if (numAcks > 0 || ackError) {
+                mWakeLockRefCount = 0;
+            }
         }
         // Check if wakelock can be released by sensorservice. mConnectionLock needs to be released
         // here as checkWakeLockState() will need it.
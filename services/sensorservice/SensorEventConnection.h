@@ -33,9 +33,11 @@
 
 #include <gui/Sensor.h>
 #include <gui/BitTube.h>
+#include <gui/SensorDirectChannel.h>
 #include <gui/ISensorServer.h>
 #include <gui/ISensorEventConnection.h>
 
+#include "EventCache.h"
 #include "SensorService.h"
 
 namespace android {
@@ -53,6 +55,11 @@ public:
 
     status_t sendEvents(sensors_event_t const* buffer, size_t count, sensors_event_t* scratch,
                         wp<const SensorEventConnection> const * mapFlushEventsToConnections = NULL);
+    // Same as above for the events of the buffer at the given indices, which SensorService has
+    // already matched against the sensors of this connection.
+    status_t sendEvents(sensors_event_t const* buffer, uint32_t const* indices, size_t numIndices,
+                        sensors_event_t* scratch,
+                        wp<const SensorEventConnection> const * mapFlushEventsToConnections);
     bool hasSensor(int32_t handle) const;
     bool hasAnySensor() const;
     bool hasOneShotSensors() const;
@@ -63,6 +70,9 @@ public:
     bool needsWakeLock();
     void resetWakeLockRefCount();
     String8 getPackageName() const;
+    // Delivery statistics for SensorService::mPipelineStats.
+    void getStats(SensorServiceUtil::ConnectionStats* outStats);
+    void resetStats();
 
     uid_t getUid() const { return mUid; }
 
@@ -74,6 +84,8 @@ private:
                                    nsecs_t maxBatchReportLatencyNs, int reservedFlags);
     virtual status_t setEventRate(int handle, nsecs_t samplingPeriodNs);
     virtual status_t flush();
+    virtual status_t setDirectChannel(const sp<SensorDirectChannel>& channel,
+                                      nsecs_t maxLatencyNs);
     // Count the number of flush complete events which are about to be dropped in the buffer.
     // Increment mPendingFlushEventsToSend in mSensorInfo. These flush complete events will be sent
     // separately before the next batch of events.
@@ -85,28 +97,57 @@ private:
     // flag set. SOCK_SEQPACKET ensures that either the entire packet is read or dropped.
     int findWakeUpSensorEventLocked(sensors_event_t const* scratch, int count);
 
+    // Writes the filtered events in the scratch buffer to the socket, or to the cache if the
+    // socket is full or there are older events in the cache.
+    status_t writeEventsLocked(sensors_event_t* scratch, int count);
+
+    // Writes the filtered events to the direct channel and signals it if the oldest event that
+    // wasn't signaled yet is due, or if the ring is half full. Events that don't fit are dropped.
+    // The events of wake-up sensors hold a wake lock until the application acknowledges them on
+    // the socket, so they are left to the socket: they are moved to the front of scratch and
+    // their number is returned. If the ring is corrupted, closes the channel and leaves all the
+    // events that weren't written to the socket.
+    int writeToDirectChannelLocked(sensors_event_t* scratch, int count);
+    // Writes a run of events to the ring, and returns false if the ring is corrupted.
+    bool writeToRingLocked(sensors_event_t const* events, int count, nsecs_t now);
+
+    // Notes that an event was written to the direct channel at now, and if it is the oldest one
+    // that wasn't signaled, arms mDirectWakeupTimerFd to signal it by its max latency.
+    void armDirectWakeupLocked(nsecs_t now);
+    void wakeDirectChannelLocked();
+    // Called by mDirectWakeupTimer when no poll of the sensors signaled the channel in time.
+    void onDirectWakeupTimer();
+    void closeDirectWakeupTimerLocked();
+
     // Send pending flush_complete events. There may have been flush_complete_events that are
     // dropped which need to be sent separately before other events. On older HALs (1_0) this method
     // emulates the behavior of flush().
     void sendPendingFlushEventsLocked();
 
+    // Appends the filtered events in the scratch buffer to mEventCache, dropping the oldest events
+    // if the cache is full. Flush complete events which are dropped are counted and sent later.
+    void cacheEventsLocked(sensors_event_t const* scratch, int count);
+
     // Writes events from mEventCache to the socket.
     void writeToSocketFromCache();
 
+    // Counts the age of events written to the socket or to the direct channel in mDeliveryAge.
+    // Only called when the pipeline statistics of SensorService are enabled.
+    void countDeliveredEventsLocked(sensors_event_t const* events, size_t count);
+
     // Compute the approximate cache size from the FIFO sizes of various sensors registered for this
     // connection. Wake up and non-wake up sensors have separate FIFOs but FIFO may be shared
     // amongst wake-up sensors and non-wake up sensors.
     int computeMaxCacheSizeLocked() const;
 
-    // When more sensors register, the maximum cache size desired may change.  Compute max cache
-    // size, reallocate memory and copy over events from the older cache.
-    void reAllocateCacheLocked(sensors_event_t const* scratch, int count);
-
     // LooperCallback method. If there is data to read on this fd, it is an ack from the app that it
     // has read events from a wake up sensor, decrement mWakeLockRefCount.  If this fd is available
     // for writing send the data from the cache.
     virtual int handleEvent(int fd, int events, void* data);
 
+    // Most messages handleEvent reads from the socket per callback.
+    static constexpr size_t MAX_MESSAGES_PER_CALLBACK = 64;
+
     // Increment mPendingFlushEventsToSend for the given sensor handle.
     void incrementPendingFlushCount(int32_t handle);
 
@@ -153,8 +194,24 @@ private:
     // protected by SensorService::mLock. Key for this vector is the sensor handle.
     KeyedVector<int, FlushInfo> mSensorInfo;
 
-    sensors_event_t *mEventCache;
-    int mCacheSize, mMaxCacheSize;
+    SensorServiceUtil::EventCache mEventCache;
+    // Events that didn't fit in mEventCache at all and were dropped without being cached.
+    uint64_t mUncachedDropCount;
+    // Delivery statistics, updated while the pipeline statistics are enabled.
+    SensorServiceUtil::LatencyHistogram mDeliveryAge;
+    uint64_t mCachedEventCount;
+
+    // Shared memory ring set by the application, which replaces mChannel and mEventCache for the
+    // events of the sensors of this connection that aren't wake-up sensors. mChannel carries its
+    // wakeups.
+    sp<SensorDirectChannel> mDirectChannel;
+    nsecs_t mDirectChannelMaxLatency;
+    // Time the oldest event in the ring that wasn't signaled yet was written, 0 if none.
+    nsecs_t mDirectWakeupPendingSince;
+    // timerfd on the looper of SensorService, for the wakeups no poll of the sensors gets to.
+    class DirectWakeupTimer;
+    int mDirectWakeupTimerFd;
+    sp<LooperCallback> mDirectWakeupTimer;
     String8 mPackageName;
     const String16 mOpPackageName;
 #if DEBUG_CONNECTIONS
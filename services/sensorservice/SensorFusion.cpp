@@ -69,51 +69,61 @@ SensorFusion::SensorFusion()
 }
 
 void SensorFusion::process(const sensors_event_t& event) {
+    process(&event, 1);
+}
 
-    if (event.type == mGyro.getType()) {
-        float dT;
-        if ( event.timestamp - mGyroTime> 0 &&
-             event.timestamp - mGyroTime< (int64_t)(5e7) ) { //0.05sec
-
-            dT = (event.timestamp - mGyroTime) / 1000000000.0f;
-            // here we estimate the gyro rate (useful for debugging)
-            const float freq = 1 / dT;
-            if (freq >= 100 && freq<1000) { // filter values obviously wrong
-                const float alpha = 1 / (1 + dT); // 1s time-constant
-                mEstimatedGyroRate = freq + (mEstimatedGyroRate - freq)*alpha;
-            }
+void SensorFusion::process(const sensors_event_t* events, size_t count) {
+    // Neither the enabled modes nor the sensors change during a poll, look them up once.
+    int modes[NUM_FUSION_MODE];
+    size_t numModes = 0;
+    for (int i = 0; i<NUM_FUSION_MODE; ++i) {
+        if (mEnabled[i]) {
+            modes[numModes++] = i;
+        }
+    }
+    const int gyroType = mGyro.getType();
+
+    for (size_t e = 0; e < count; e++) {
+        const sensors_event_t& event(events[e]);
+        if (event.type == gyroType) {
+            float dT;
+            if ( event.timestamp - mGyroTime> 0 &&
+                 event.timestamp - mGyroTime< (int64_t)(5e7) ) { //0.05sec
+
+                dT = (event.timestamp - mGyroTime) / 1000000000.0f;
+                // here we estimate the gyro rate (useful for debugging)
+                const float freq = 1 / dT;
+                if (freq >= 100 && freq<1000) { // filter values obviously wrong
+                    const float alpha = 1 / (1 + dT); // 1s time-constant
+                    mEstimatedGyroRate = freq + (mEstimatedGyroRate - freq)*alpha;
+                }
 
-            const vec3_t gyro(event.data);
-            for (int i = 0; i<NUM_FUSION_MODE; ++i) {
-                if (mEnabled[i]) {
+                const vec3_t gyro(event.data);
+                for (size_t i = 0; i < numModes; ++i) {
                     // fusion in no gyro mode will ignore
-                    mFusions[i].handleGyro(gyro, dT);
+                    mFusions[modes[i]].handleGyro(gyro, dT);
                 }
             }
-        }
-        mGyroTime = event.timestamp;
-    } else if (event.type == SENSOR_TYPE_MAGNETIC_FIELD) {
-        const vec3_t mag(event.data);
-        for (int i = 0; i<NUM_FUSION_MODE; ++i) {
-            if (mEnabled[i]) {
-                mFusions[i].handleMag(mag);// fusion in no mag mode will ignore
+            mGyroTime = event.timestamp;
+        } else if (event.type == SENSOR_TYPE_MAGNETIC_FIELD) {
+            const vec3_t mag(event.data);
+            for (size_t i = 0; i < numModes; ++i) {
+                mFusions[modes[i]].handleMag(mag);// fusion in no mag mode will ignore
             }
-        }
-    } else if (event.type == SENSOR_TYPE_ACCELEROMETER) {
-        float dT;
-        if ( event.timestamp - mAccTime> 0 &&
-             event.timestamp - mAccTime< (int64_t)(1e8) ) { //0.1sec
-            dT = (event.timestamp - mAccTime) / 1000000000.0f;
-
-            const vec3_t acc(event.data);
-            for (int i = 0; i<NUM_FUSION_MODE; ++i) {
-                if (mEnabled[i]) {
-                    mFusions[i].handleAcc(acc, dT);
-                    mAttitudes[i] = mFusions[i].getAttitude();
+        } else if (event.type == SENSOR_TYPE_ACCELEROMETER) {
+            float dT;
+            if ( event.timestamp - mAccTime> 0 &&
+                 event.timestamp - mAccTime< (int64_t)(1e8) ) { //0.1sec
+                dT = (event.timestamp - mAccTime) / 1000000000.0f;
+
+                const vec3_t acc(event.data);
+                for (size_t i = 0; i < numModes; ++i) {
+                    mFusions[modes[i]].handleAcc(acc, dT);
+                    mAttitudes[modes[i]] = mFusions[modes[i]].getAttitude();
                 }
             }
+            mAccTime = event.timestamp;
         }
-        mAccTime = event.timestamp;
     }
 }
 
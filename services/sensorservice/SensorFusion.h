@@ -62,6 +62,8 @@ class SensorFusion : public Singleton<SensorFusion> {
 
 public:
     void process(const sensors_event_t& event);
+    // Same as above for all the events of a poll, in order.
+    void process(const sensors_event_t* events, size_t count);
 
     bool isEnabled() const {
         return mEnabled[FUSION_9AXIS] ||
@@ -29,6 +29,17 @@ const sensor_t DUMMY_SENSOR = {
         .name = "", .vendor = "", .stringType = "", .requiredPermission = ""};
 } //unnamed namespace
 
+size_t SensorInterface::processBatch(sensors_event_t* outEvents, size_t maxCount,
+        const sensors_event_t* events, size_t count) {
+    size_t n = 0;
+    for (size_t i = 0; i < count && n < maxCount; i++) {
+        if (process(&outEvents[n], events[i])) {
+            n++;
+        }
+    }
+    return n;
+}
+
 BaseSensor::BaseSensor(const sensor_t& sensor) :
         mSensorDevice(SensorDevice::getInstance()),
         mSensor(&sensor, mSensorDevice.getHalDeviceVersion()) {
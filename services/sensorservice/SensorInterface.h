@@ -33,6 +33,11 @@ public:
 
     virtual bool process(sensors_event_t* outEvent, const sensors_event_t& event) = 0;
 
+    // Processes the count events of a poll at once, writing at most maxCount events to outEvents.
+    // Returns the number of events written. Calls process() for each event by default.
+    virtual size_t processBatch(sensors_event_t* outEvents, size_t maxCount,
+                                const sensors_event_t* events, size_t count);
+
     virtual status_t activate(void* ident, bool enabled) = 0;
     virtual status_t setDelay(void* ident, int handle, int64_t ns) = 0;
     virtual status_t batch(void* ident, int handle, int /*flags*/, int64_t samplingPeriodNs,
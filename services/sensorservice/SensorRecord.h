@@ -29,6 +29,11 @@ public:
     bool addConnection(const sp<const SensorEventConnection>& connection);
     bool removeConnection(const wp<const SensorEventConnection>& connection);
     size_t getNumConnections() const { return mConnections.size(); }
+    // The connections that enabled this sensor, ordered by address. SensorService routes the
+    // events of the sensor to these connections.
+    const SortedVector< wp<const SensorEventConnection> >& getConnections() const {
+        return mConnections;
+    }
 
     void addPendingFlushConnection(const sp<const SensorEventConnection>& connection);
     void removeFirstPendingFlushConnection();
@@ -30,6 +30,8 @@
 #include <openssl/hmac.h>
 #include <openssl/rand.h>
 
+#include <utils/SystemClock.h>
+
 #include "BatteryService.h"
 #include "CorrectedGyroSensor.h"
 #include "GravitySensor.h"
@@ -45,10 +47,12 @@
 #include "SensorRecord.h"
 #include "SensorRegistrationInfo.h"
 
+#include <errno.h>
 #include <inttypes.h>
 #include <math.h>
 #include <sched.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -79,7 +83,8 @@ static const String16 sDump("android.permission.DUMP");
 
 SensorService::SensorService()
     : mInitCheck(NO_INIT), mSocketBufferSize(SOCKET_BUFFER_SIZE_NON_BATCHED),
-      mWakeLockAcquired(false) {
+      mWakeLockAcquired(false), mWakeLockReleasePending(false), mPollCount(0),
+      mRoutedEventCount(0), mThreadLoopCpuTime(0), mThreadLoopMaxCpuTime(0) {
 }
 
 bool SensorService::initializeHmacKey() {
@@ -261,6 +266,7 @@ void SensorService::onFirstRef() {
             const size_t minBufferSize = SensorEventQueue::MAX_RECEIVE_BUFFER_EVENT_COUNT;
             mSensorEventBuffer = new sensors_event_t[minBufferSize];
             mSensorEventScratch = new sensors_event_t[minBufferSize];
+            mSensorEventMergeBuffer = new sensors_event_t[minBufferSize];
             mMapFlushEventsToConnections = new wp<const SensorEventConnection> [minBufferSize];
             mCurrentOperatingMode = NORMAL;
 
@@ -324,7 +330,7 @@ status_t SensorService::dump(int fd, const Vector<String16>& args) {
                 IPCThreadState::self()->getCallingUid());
     } else {
         bool privileged = IPCThreadState::self()->getCallingUid() == 0;
-        if (args.size() > 2) {
+        if (args.size() > 3 || (args.size() == 3 && args[0] != String16("wakelock"))) {
            return INVALID_OPERATION;
         }
         Mutex::Autolock _l(mLock);
@@ -378,6 +384,10 @@ status_t SensorService::dump(int fd, const Vector<String16>& args) {
                 // Transition to data injection mode supported only from NORMAL mode.
                 return INVALID_OPERATION;
             }
+        } else if (args.size() == 2 && args[0] == String16("stats")) {
+            return dumpPipelineStatsLocked(fd, String8(args[1]));
+        } else if (args.size() == 3 && args[0] == String16("wakelock")) {
+            return setWakeLockHoldLocked(String8(args[1]), String8(args[2]));
         } else if (!mSensors.hasAnySensor()) {
             result.append("No Sensors on the device\n");
         } else {
@@ -418,8 +428,15 @@ status_t SensorService::dump(int fd, const Vector<String16>& args) {
 
             result.appendFormat("Socket Buffer size = %zd events\n",
                                 mSocketBufferSize/sizeof(sensors_event_t));
-            result.appendFormat("WakeLock Status: %s \n", mWakeLockAcquired ? "acquired" :
-                    "not held");
+            result.appendFormat("WakeLock Status: %s%s \n", mWakeLockAcquired ? "acquired" :
+                    "not held", mWakeLockReleasePending ? " (release pending)" : "");
+            result.appendFormat("WakeLock usage: %s\n",
+                    mWakeLockPolicy.dump(systemTime()).c_str());
+            for (size_t i = 0; i < mWakeLockPolicy.getSensorCount(); i++) {
+                const int handle = mWakeLockPolicy.getSensorHandle(i);
+                result.appendFormat("\t%s (handle=0x%08x) | %s\n", getSensorName(handle).string(),
+                        handle, mWakeLockPolicy.dumpSensor(i).c_str());
+            }
             result.appendFormat("Mode :");
             switch(mCurrentOperatingMode) {
                case NORMAL:
@@ -431,6 +448,29 @@ status_t SensorService::dump(int fd, const Vector<String16>& args) {
                case DATA_INJECTION:
                    result.appendFormat(" DATA_INJECTION : %s\n", mWhiteListedPackage.string());
             }
+            result.appendFormat("Event fan-out: %" PRIu64 " polls | %" PRIu64 " events routed | "
+                    "threadLoop cpu %.2fus per poll (max %.2fus)\n",
+                    mPollCount, mRoutedEventCount,
+                    mPollCount ? mThreadLoopCpuTime / 1000.0 / mPollCount : 0.0,
+                    mThreadLoopMaxCpuTime / 1000.0);
+            if (mPipelineStats.isEnabled()) {
+                result.appendFormat("Pipeline latency: %" PRIu64 " polls in %.1fs\n",
+                        mPipelineStats.getPollCount(), mPipelineStats.getDuration() / 1e9);
+                for (int i = 0; i < PipelineStats::NUM_STAGES; i++) {
+                    const PipelineStats::Stage stage = PipelineStats::Stage(i);
+                    result.appendFormat("\t%-15s | %s\n", PipelineStats::getStageName(stage),
+                            mPipelineStats.getStage(stage).dump().c_str());
+                }
+                const KeyedVector<int, LatencyHistogram>& ages = mPipelineStats.getEventAges();
+                for (size_t i = 0; i < ages.size(); i++) {
+                    result.appendFormat("\tevent age of %s (handle=0x%08x) | %s\n",
+                            getSensorName(ages.keyAt(i)).string(), ages.keyAt(i),
+                            ages.valueAt(i).dump().c_str());
+                }
+            } else {
+                result.append("Pipeline latency: off, enable with "
+                        "\"dumpsys sensorservice stats enable\"\n");
+            }
             result.appendFormat("%zd active connections\n", mActiveConnections.size());
 
             for (size_t i=0 ; i < mActiveConnections.size() ; i++) {
@@ -474,6 +514,65 @@ status_t SensorService::dump(int fd, const Vector<String16>& args) {
     return NO_ERROR;
 }
 
+status_t SensorService::dumpPipelineStatsLocked(int fd, const String8& command) {
+    if (command == "enable") {
+        if (!mPipelineStats.isEnabled()) {
+            resetConnectionStatsLocked();
+        }
+        mPipelineStats.setEnabled(true);
+    } else if (command == "disable") {
+        mPipelineStats.setEnabled(false);
+    } else if (command == "reset") {
+        mPipelineStats.reset();
+        resetConnectionStatsLocked();
+    } else if (command == "binary") {
+        std::vector<ConnectionStats> connections;
+        for (size_t i = 0; i < mActiveConnections.size(); i++) {
+            sp<SensorEventConnection> connection(mActiveConnections[i].promote());
+            if (connection != 0) {
+                connections.emplace_back();
+                connection->getStats(&connections.back());
+            }
+        }
+        std::vector<uint8_t> data;
+        mPipelineStats.serialize(connections, &data);
+        if (write(fd, data.data(), data.size()) != ssize_t(data.size())) {
+            return -errno;
+        }
+    } else {
+        return BAD_VALUE;
+    }
+    return NO_ERROR;
+}
+
+status_t SensorService::setWakeLockHoldLocked(const String8& sensor, const String8& hold) {
+    char* end;
+    const int handle = strtol(sensor.string(), &end, 0);
+    sp<SensorInterface> si = getSensorInterfaceFromHandle(handle);
+    if (*end != '\0' || si == nullptr || !si->getSensor().isWakeUpSensor()) {
+        return BAD_VALUE;
+    }
+    if (hold == "auto") {
+        mWakeLockPolicy.setHold(handle, WakeLockPolicy::HOLD_AUTO);
+        return NO_ERROR;
+    }
+    const long holdMs = strtol(hold.string(), &end, 10);
+    if (*end != '\0' || holdMs < 0) {
+        return BAD_VALUE;
+    }
+    mWakeLockPolicy.setHold(handle, ms2ns(holdMs));
+    return NO_ERROR;
+}
+
+void SensorService::resetConnectionStatsLocked() {
+    for (size_t i = 0; i < mActiveConnections.size(); i++) {
+        sp<SensorEventConnection> connection(mActiveConnections[i].promote());
+        if (connection != 0) {
+            connection->resetStats();
+        }
+    }
+}
+
 //TODO: move to SensorEventConnection later
 void SensorService::cleanupAutoDisabledSensorLocked(const sp<SensorEventConnection>& connection,
         sensors_event_t const* buffer, const int count) {
@@ -510,11 +609,16 @@ bool SensorService::threadLoop() {
 
     const int halVersion = device.getHalDeviceVersion();
     do {
+        // Checked once per poll, so that the statistics cost nothing more when they are off.
+        const bool recordStats = mPipelineStats.isEnabled();
+        const nsecs_t pollStartTime = recordStats ? systemTime() : 0;
         ssize_t count = device.poll(mSensorEventBuffer, numEventMax);
         if (count < 0) {
             ALOGE("sensor poll failed (%s)", strerror(-count));
             break;
         }
+        const nsecs_t pollEndTime = recordStats ? systemTime() : 0;
+        const nsecs_t cpuStartTime = systemTime(SYSTEM_TIME_THREAD);
 
         // Reset sensors_event_t.flags to zero for all events in the buffer.
         for (int i = 0; i < count; i++) {
@@ -536,57 +640,91 @@ bool SensorService::threadLoop() {
         // sending events to clients (incrementing SensorEventConnection::mWakeLockRefCount) should
         // not be interleaved with decrementing SensorEventConnection::mWakeLockRefCount and
         // releasing the wakelock.
+        //
+        // The wake-up sensors which delivered are also reported to mWakeLockPolicy, which decides
+        // how long to hold the wakelock after their events are acknowledged. Events come in runs
+        // of the same sensor, so each run is looked up once.
         bool bufferHasWakeUpEvent = false;
+        nsecs_t deliveryTime = 0;
+        int lastHandle = 0;
         for (int i = 0; i < count; i++) {
-            if (isWakeUpSensorEvent(mSensorEventBuffer[i])) {
-                bufferHasWakeUpEvent = true;
-                break;
+            const sensors_event_t& event = mSensorEventBuffer[i];
+            const int handle = event.type == SENSOR_TYPE_META_DATA ?
+                    event.meta_data.sensor : event.sensor;
+            if (i > 0 && handle == lastHandle) {
+                continue;
+            }
+            lastHandle = handle;
+            if (isWakeUpSensorEvent(event)) {
+                if (!bufferHasWakeUpEvent) {
+                    bufferHasWakeUpEvent = true;
+                    deliveryTime = systemTime();
+                }
+                if (event.type != SENSOR_TYPE_META_DATA) {
+                    mWakeLockPolicy.onDelivery(handle, deliveryTime);
+                }
             }
         }
 
-        if (bufferHasWakeUpEvent && !mWakeLockAcquired) {
+        if (bufferHasWakeUpEvent && (!mWakeLockAcquired || mWakeLockReleasePending)) {
             setWakeLockAcquiredLocked(true);
         }
         recordLastValueLocked(mSensorEventBuffer, count);
+        if (recordStats) {
+            mPipelineStats.addStage(PipelineStats::STAGE_POLL, pollEndTime - pollStartTime);
+        }
 
         // handle virtual sensors
         if (count && vcount) {
             sensors_event_t const * const event = mSensorEventBuffer;
             if (!mActiveVirtualSensors.empty()) {
                 size_t k = 0;
+                nsecs_t stageStartTime = recordStats ? systemTime() : 0;
                 SensorFusion& fusion(SensorFusion::getInstance());
                 if (fusion.isEnabled()) {
-                    for (size_t i=0 ; i<size_t(count) ; i++) {
-                        fusion.process(event[i]);
+                    fusion.process(event, count);
+                    if (recordStats) {
+                        stageStartTime = mPipelineStats.endStage(PipelineStats::STAGE_FUSION,
+                                stageStartTime);
                     }
                 }
-                for (size_t i=0 ; i<size_t(count) && k<minBufferSize ; i++) {
-                    for (int handle : mActiveVirtualSensors) {
-                        if (count + k >= minBufferSize) {
-                            ALOGE("buffer too small to hold all events: "
-                                    "count=%zd, k=%zu, size=%zu",
-                                    count, k, minBufferSize);
-                            break;
-                        }
-                        sensors_event_t out;
-                        sp<SensorInterface> si = mSensors.getInterface(handle);
-                        if (si == nullptr) {
-                            ALOGE("handle %d is not an valid virtual sensor", handle);
-                            continue;
-                        }
-
-                        if (si->process(&out, event[i])) {
-                            mSensorEventBuffer[count + k] = out;
-                            k++;
-                        }
+                // The virtual sensors only read the state of the fusion, which has now seen all
+                // the events, so each of them processes the whole poll at once.
+                for (int handle : mActiveVirtualSensors) {
+                    if (count + k >= minBufferSize) {
+                        ALOGE("buffer too small to hold all events: "
+                                "count=%zd, k=%zu, size=%zu",
+                                count, k, minBufferSize);
+                        break;
+                    }
+                    sp<SensorInterface> si = mSensors.getInterface(handle);
+                    if (si == nullptr) {
+                        ALOGE("handle %d is not an valid virtual sensor", handle);
+                        continue;
                     }
+                    k += si->processBatch(&mSensorEventBuffer[count + k],
+                            minBufferSize - count - k, event, count);
+                }
+                if (recordStats) {
+                    stageStartTime = mPipelineStats.endStage(PipelineStats::STAGE_VIRTUAL_SENSORS,
+                            stageStartTime);
                 }
                 if (k) {
                     // record the last synthesized values
                     recordLastValueLocked(&mSensorEventBuffer[count], k);
                     count += k;
-                    // sort the buffer by time-stamps
-                    sortEventBuffer(mSensorEventBuffer, count);
+                    // Order the buffer by timestamp. The HAL events and the events of each
+                    // virtual sensor are runs mostly in order already, so merging them into the
+                    // other buffer beats sorting in place, and the buffers trade places after.
+                    sensors_event_t* merged = mEventMerger.merge(mSensorEventBuffer, count,
+                            mSensorEventMergeBuffer);
+                    if (merged != mSensorEventBuffer) {
+                        mSensorEventMergeBuffer = mSensorEventBuffer;
+                        mSensorEventBuffer = merged;
+                    }
+                    if (recordStats) {
+                        mPipelineStats.endStage(PipelineStats::STAGE_SORT, stageStartTime);
+                    }
                 }
             }
         }
@@ -664,14 +802,18 @@ bool SensorService::threadLoop() {
         }
 
 
-        // Send our events to clients. Check the state of wake lock for each client and release the
-        // lock if none of the clients need it.
+        // Send our events to clients. Each client only gets the events routed to it. Check the
+        // state of wake lock for each client and release the lock if none of the clients need it.
+        const nsecs_t fanOutStartTime = recordStats ? systemTime() : 0;
+        routeEventsLocked(activeConnections, count);
         bool needsWakeLock = false;
         size_t numConnections = activeConnections.size();
         for (size_t i=0 ; i < numConnections; ++i) {
             if (activeConnections[i] != 0) {
-                activeConnections[i]->sendEvents(mSensorEventBuffer, count, mSensorEventScratch,
-                        mMapFlushEventsToConnections);
+                const uint32_t offset = mRoutedEventOffsets[i];
+                activeConnections[i]->sendEvents(mSensorEventBuffer,
+                        mRoutedEvents.array() + offset, mRoutedEventOffsets[i + 1] - offset,
+                        mSensorEventScratch, mMapFlushEventsToConnections);
                 needsWakeLock |= activeConnections[i]->needsWakeLock();
                 // If the connection has one-shot sensors, it may be cleaned up after first trigger.
                 // Early check for one-shot sensors.
@@ -683,7 +825,21 @@ bool SensorService::threadLoop() {
         }
 
         if (mWakeLockAcquired && !needsWakeLock) {
-            setWakeLockAcquiredLocked(false);
+            releaseWakeLockLocked();
+        }
+        if (recordStats) {
+            mPipelineStats.endStage(PipelineStats::STAGE_FAN_OUT, fanOutStartTime);
+            // Sensor timestamps use the same clock as elapsedRealtimeNano().
+            mPipelineStats.addEventAges(mSensorEventBuffer, count, elapsedRealtimeNano());
+            mPipelineStats.countPoll();
+        }
+
+        const nsecs_t cpuTime = systemTime(SYSTEM_TIME_THREAD) - cpuStartTime;
+        mPollCount++;
+        mRoutedEventCount += mRoutedEvents.size();
+        mThreadLoopCpuTime += cpuTime;
+        if (cpuTime > mThreadLoopMaxCpuTime) {
+            mThreadLoopMaxCpuTime = cpuTime;
         }
     } while (!Thread::exitPending());
 
@@ -692,6 +848,81 @@ bool SensorService::threadLoop() {
     return false;
 }
 
+void SensorService::routeEventsLocked(
+        const SortedVector< sp<SensorEventConnection> >& activeConnections, size_t count) {
+    const size_t numConnections = activeConnections.size();
+
+    // Find the subscribers of each event. Events usually come in runs from the same sensor, so
+    // the subscribers of a run are only looked up once.
+    mRouteConnections.clear();
+    mRouteEvents.clear();
+    int lastHandle = -1;
+    size_t runStart = 0, runSize = 0;
+    for (size_t i = 0; i < count; i++) {
+        const int handle = mSensorEventBuffer[i].type == SENSOR_TYPE_META_DATA ?
+                mSensorEventBuffer[i].meta_data.sensor : mSensorEventBuffer[i].sensor;
+        if (i > 0 && handle == lastHandle) {
+            for (size_t j = runStart; j < runStart + runSize; j++) {
+                const uint32_t connection = mRouteConnections[j];
+                mRouteConnections.push(connection);
+                mRouteEvents.push(i);
+            }
+            continue;
+        }
+        lastHandle = handle;
+        runStart = mRouteConnections.size();
+        runSize = 0;
+
+        SensorRecord* rec = mActiveSensors.valueFor(handle);
+        if (rec == NULL) {
+            continue;
+        }
+        const SortedVector< wp<const SensorEventConnection> >& connections =
+                rec->getConnections();
+        for (size_t j = 0; j < connections.size(); j++) {
+            // Look the connection up among the active ones, both are ordered by address. It is
+            // missing if it could not be promoted because it is being destroyed.
+            const SensorEventConnection* connection = connections[j].unsafe_get();
+            size_t lo = 0, hi = numConnections;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (activeConnections[mid].get() < connection) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo < numConnections && activeConnections[lo].get() == connection) {
+                mRouteConnections.push(lo);
+                mRouteEvents.push(i);
+                runSize++;
+            }
+        }
+    }
+
+    // Group the routes by connection, keeping the events of each connection in order.
+    mRoutedEventOffsets.clear();
+    mRoutedEventOffsets.insertAt(0, 0, numConnections + 1);
+    uint32_t* offsets = mRoutedEventOffsets.editArray();
+    for (size_t j = 0; j < mRouteConnections.size(); j++) {
+        offsets[mRouteConnections[j] + 1]++;
+    }
+    for (size_t i = 0; i < numConnections; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    mRoutedEvents.clear();
+    mRoutedEvents.insertAt(0, 0, mRouteConnections.size());
+    uint32_t* events = mRoutedEvents.editArray();
+    for (size_t j = 0; j < mRouteConnections.size(); j++) {
+        events[offsets[mRouteConnections[j]]++] = mRouteEvents[j];
+    }
+    // Placing the events advanced each offset to the start of the next connection.
+    for (size_t i = numConnections; i > 0; i--) {
+        offsets[i] = offsets[i - 1];
+    }
+    offsets[0] = 0;
+}
+
 sp<Looper> SensorService::getLooper() const {
     return mLooper;
 }
@@ -715,18 +946,40 @@ void SensorService::setWakeLockAcquiredLocked(bool acquire) {
         if (!mWakeLockAcquired) {
             acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_NAME);
             mWakeLockAcquired = true;
+            mWakeLockPolicy.onAcquire(systemTime());
+        } else if (mWakeLockReleasePending) {
+            mWakeLockPolicy.onReleaseSkipped();
         }
+        mWakeLockReleasePending = false;
         mLooper->wake();
     } else {
         if (mWakeLockAcquired) {
             release_wake_lock(WAKE_LOCK_NAME);
             mWakeLockAcquired = false;
+            mWakeLockPolicy.onRelease(systemTime());
         }
+        mWakeLockReleasePending = false;
     }
 }
 
-bool SensorService::isWakeLockAcquired() {
+void SensorService::releaseWakeLockLocked() {
+    if (!mWakeLockAcquired) {
+        return;
+    }
+    if (systemTime() < mWakeLockPolicy.getHoldUntil()) {
+        if (!mWakeLockReleasePending) {
+            // Let SensorEventAckReceiver pick up the new timeout.
+            mWakeLockReleasePending = true;
+            mLooper->wake();
+        }
+        return;
+    }
+    setWakeLockAcquiredLocked(false);
+}
+
+bool SensorService::isWakeLockAcquired(nsecs_t* outReleaseTime) {
     Mutex::Autolock _l(mLock);
+    *outReleaseTime = mWakeLockReleasePending ? mWakeLockPolicy.getHoldUntil() : 0;
     return mWakeLockAcquired;
 }
 
@@ -734,12 +987,21 @@ bool SensorService::SensorEventAckReceiver::threadLoop() {
     ALOGD("new thread SensorEventAckReceiver");
     sp<Looper> looper = mService->getLooper();
     do {
-        bool wakeLockAcquired = mService->isWakeLockAcquired();
+        nsecs_t releaseTime;
+        bool wakeLockAcquired = mService->isWakeLockAcquired(&releaseTime);
         int timeout = -1;
         if (wakeLockAcquired) timeout = 5000;
+        if (releaseTime != 0) {
+            // No connection needs the wakelock anymore, it is only held until releaseTime.
+            timeout = toMillisecondTimeoutDelay(systemTime(), releaseTime);
+        }
         int ret = looper->pollOnce(timeout);
         if (ret == ALOOPER_POLL_TIMEOUT) {
-           mService->resetAllWakeLockRefCounts();
+            if (releaseTime != 0) {
+                mService->checkWakeLockState();
+            } else {
+                mService->resetAllWakeLockRefCounts();
+            }
         }
     } while(!Thread::exitPending());
     return false;
@@ -761,17 +1023,6 @@ void SensorService::recordLastValueLocked(
     }
 }
 
-void SensorService::sortEventBuffer(sensors_event_t* buffer, size_t count) {
-    struct compar {
-        static int cmp(void const* lhs, void const* rhs) {
-            sensors_event_t const* l = static_cast<sensors_event_t const*>(lhs);
-            sensors_event_t const* r = static_cast<sensors_event_t const*>(rhs);
-            return l->timestamp - r->timestamp;
-        }
-    };
-    qsort(buffer, count, sizeof(sensors_event_t), compar::cmp);
-}
-
 String8 SensorService::getSensorName(int handle) const {
     return mSensors.getName(handle);
 }
@@ -1310,7 +1561,10 @@ void SensorService::checkWakeLockStateLocked() {
         }
     }
     if (releaseLock) {
-        setWakeLockAcquiredLocked(false);
+        releaseWakeLockLocked();
+    } else {
+        // A connection needs the wakelock again before the end of the hold.
+        mWakeLockReleasePending = false;
     }
 }
 
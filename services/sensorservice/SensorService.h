@@ -17,8 +17,11 @@
 #ifndef ANDROID_SENSOR_SERVICE_H
 #define ANDROID_SENSOR_SERVICE_H
 
+#include "EventMerger.h"
+#include "PipelineStats.h"
 #include "SensorList.h"
 #include "RecentEventLogger.h"
+#include "WakeLockPolicy.h"
 
 #include <binder/BinderService.h>
 #include <cutils/compiler.h>
@@ -155,13 +158,17 @@ private:
             int requestedMode, const String16& opPackageName);
     virtual int isDataInjectionEnabled();
     virtual status_t dump(int fd, const Vector<String16>& args);
+    // Handles "dumpsys sensorservice stats <command>": "enable", "disable" and "reset" control
+    // mPipelineStats and the delivery statistics of the connections, "binary" writes them to fd
+    // in the format of PipelineStats::serialize.
+    status_t dumpPipelineStatsLocked(int fd, const String8& command);
+    void resetConnectionStatsLocked();
 
     String8 getSensorName(int handle) const;
     bool isVirtualSensor(int handle) const;
     sp<SensorInterface> getSensorInterfaceFromHandle(int handle) const;
     bool isWakeUpSensor(int type) const;
     void recordLastValueLocked(sensors_event_t const* buffer, size_t count);
-    static void sortEventBuffer(sensors_event_t* buffer, size_t count);
     const Sensor& registerSensor(SensorInterface* sensor,
                                  bool isDebug = false, bool isVirtual = false);
     const Sensor& registerVirtualSensor(SensorInterface* sensor, bool isDebug = false);
@@ -178,7 +185,9 @@ private:
     // corresponding applications, if yes the wakelock is released.
     void checkWakeLockState();
     void checkWakeLockStateLocked();
-    bool isWakeLockAcquired();
+    // Returns whether the wakelock is held, and in outReleaseTime when it will be released if no
+    // connection needs it anymore, 0 if a connection still needs it or it isn't held.
+    bool isWakeLockAcquired(nsecs_t* outReleaseTime);
     bool isWakeUpSensorEvent(const sensors_event_t& event) const;
 
     sp<Looper> getLooper() const;
@@ -192,6 +201,16 @@ private:
     // seconds and wake the looper.
     void setWakeLockAcquiredLocked(bool acquire);
 
+    // Release the wakelock once no connection needs it, which is now unless mWakeLockPolicy holds
+    // it a little longer for wake-up sensors about to deliver again. The release is then left to
+    // SensorEventAckReceiver, which times out when the hold ends.
+    void releaseWakeLockLocked();
+
+    // "dumpsys sensorservice wakelock <handle> <ms>|auto" sets how long the wakelock is held after
+    // the events of the wake-up sensor with that handle are acknowledged, "auto" going back to a
+    // hold based on the rate of the sensor.
+    status_t setWakeLockHoldLocked(const String8& sensor, const String8& hold);
+
     // Send events from the event cache for this particular connection.
     void sendEventsFromCache(const sp<SensorEventConnection>& connection);
 
@@ -199,6 +218,12 @@ private:
     // to the output vector.
     void populateActiveConnections( SortedVector< sp<SensorEventConnection> >* activeConnections);
 
+    // Match the first count events in mSensorEventBuffer with the connections that enabled their
+    // sensors. The events for activeConnections[i] end up in mRoutedEvents, from
+    // mRoutedEventOffsets[i] to mRoutedEventOffsets[i + 1].
+    void routeEventsLocked(const SortedVector< sp<SensorEventConnection> >& activeConnections,
+            size_t count);
+
     // If SensorService is operating in RESTRICTED mode, only select whitelisted packages are
     // allowed to register for or call flush on sensors. Typically only cts test packages are
     // allowed.
@@ -236,8 +261,24 @@ private:
     std::unordered_set<int> mActiveVirtualSensors;
     SortedVector< wp<SensorEventConnection> > mActiveConnections;
     bool mWakeLockAcquired;
+    // Whether the wakelock is only held until mWakeLockPolicy.getHoldUntil().
+    bool mWakeLockReleasePending;
+    WakeLockPolicy mWakeLockPolicy;
     sensors_event_t *mSensorEventBuffer, *mSensorEventScratch;
+    // Where mEventMerger orders mSensorEventBuffer when virtual sensors added events to it. The
+    // two buffers are swapped afterwards.
+    sensors_event_t *mSensorEventMergeBuffer;
+    EventMerger mEventMerger;
     wp<const SensorEventConnection> * mMapFlushEventsToConnections;
+    // Indices of the events in mSensorEventBuffer routed to each active connection, rebuilt by
+    // routeEventsLocked for each batch of events. Kept around to reuse their storage.
+    Vector<uint32_t> mRoutedEvents, mRoutedEventOffsets;
+    Vector<uint32_t> mRouteConnections, mRouteEvents;
+    // Fan-out statistics of threadLoop.
+    uint64_t mPollCount, mRoutedEventCount;
+    nsecs_t mThreadLoopCpuTime, mThreadLoopMaxCpuTime;
+    // Latency statistics of threadLoop, off unless enabled with "dumpsys sensorservice stats".
+    PipelineStats mPipelineStats;
     std::unordered_map<int, RecentEventLogger*> mRecentEvent;
     Mode mCurrentOperatingMode;
 
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WakeLockPolicy.h"
+
+#include <utils/String8.h>
+
+#include <inttypes.h>
+
+namespace android {
+namespace SensorServiceUtil {
+
+namespace {
+const nsecs_t MINUTE = s2ns(60);
+} // unnamed namespace
+
+constexpr nsecs_t WakeLockPolicy::DEFAULT_MAX_HOLD;
+constexpr nsecs_t WakeLockPolicy::HOLD_AUTO;
+
+WakeLockPolicy::WakeLockPolicy()
+        : mHoldUntil(0), mStartTime(systemTime()), mAcquireCount(0), mReleaseSkippedCount(0),
+          mAcquireTime(0), mHeldTime(0), mMinuteStart(mStartTime), mAcquiresThisMinute(0),
+          mAcquiresLastMinute(0) {
+}
+
+void WakeLockPolicy::setHold(int handle, nsecs_t hold) {
+    ssize_t index = mSensors.indexOfKey(handle);
+    if (index < 0) {
+        index = mSensors.add(handle, SensorHold());
+    }
+    mSensors.editValueAt(index).hold = hold < 0 ? HOLD_AUTO : hold;
+}
+
+void WakeLockPolicy::onDelivery(int handle, nsecs_t now) {
+    ssize_t index = mSensors.indexOfKey(handle);
+    if (index < 0) {
+        index = mSensors.add(handle, SensorHold());
+    }
+    SensorHold& sensor = mSensors.editValueAt(index);
+    if (sensor.lastDelivery == now) {
+        return;
+    }
+    if (sensor.lastDelivery != 0) {
+        const nsecs_t interval = now - sensor.lastDelivery;
+        sensor.interval = sensor.interval ? (3 * sensor.interval + interval) / 4 : interval;
+    }
+    sensor.lastDelivery = now;
+    const nsecs_t holdUntil = now + getHold(sensor);
+    if (holdUntil > mHoldUntil) {
+        mHoldUntil = holdUntil;
+    }
+}
+
+nsecs_t WakeLockPolicy::getHoldUntil() const {
+    return mHoldUntil;
+}
+
+nsecs_t WakeLockPolicy::getHold(const SensorHold& sensor) const {
+    if (sensor.hold != HOLD_AUTO) {
+        return sensor.hold;
+    }
+    if (sensor.interval == 0 || sensor.interval > DEFAULT_MAX_HOLD) {
+        return 0;
+    }
+    // Leave room for the jitter of the deliveries.
+    const nsecs_t hold = sensor.interval + sensor.interval / 4;
+    return hold < DEFAULT_MAX_HOLD ? hold : DEFAULT_MAX_HOLD;
+}
+
+void WakeLockPolicy::onAcquire(nsecs_t now) {
+    advanceMinute(now);
+    mAcquireCount++;
+    mAcquiresThisMinute++;
+    mAcquireTime = now;
+}
+
+void WakeLockPolicy::onRelease(nsecs_t now) {
+    if (mAcquireTime != 0) {
+        mHeldTime += now - mAcquireTime;
+        mAcquireTime = 0;
+    }
+}
+
+void WakeLockPolicy::onReleaseSkipped() {
+    mReleaseSkippedCount++;
+}
+
+uint64_t WakeLockPolicy::getAcquireCount() const {
+    return mAcquireCount;
+}
+
+uint64_t WakeLockPolicy::getReleaseSkippedCount() const {
+    return mReleaseSkippedCount;
+}
+
+nsecs_t WakeLockPolicy::getHeldTime(nsecs_t now) const {
+    return mHeldTime + (mAcquireTime != 0 ? now - mAcquireTime : 0);
+}
+
+void WakeLockPolicy::advanceMinute(nsecs_t now) {
+    if (now - mMinuteStart < MINUTE) {
+        return;
+    }
+    // The previous minute had no acquisitions if more than one went by.
+    mAcquiresLastMinute = now - mMinuteStart < 2 * MINUTE ? mAcquiresThisMinute : 0;
+    mAcquiresThisMinute = 0;
+    mMinuteStart += (now - mMinuteStart) / MINUTE * MINUTE;
+}
+
+std::string WakeLockPolicy::dump(nsecs_t now) const {
+    // advanceMinute() without changing the counters.
+    uint32_t lastMinute = mAcquiresLastMinute;
+    if (now - mMinuteStart >= 2 * MINUTE) {
+        lastMinute = 0;
+    } else if (now - mMinuteStart >= MINUTE) {
+        lastMinute = mAcquiresThisMinute;
+    }
+    const nsecs_t elapsed = now - mStartTime;
+    const nsecs_t held = getHeldTime(now);
+    String8 buffer;
+    buffer.appendFormat("%" PRIu64 " acquisitions, %u in the previous minute, %.1f per minute | "
+            "held %.1fs of %.1fs (%.1f%%) | %" PRIu64 " releases skipped by the hold",
+            mAcquireCount, lastMinute, elapsed > 0 ? mAcquireCount * double(MINUTE) / elapsed : 0.0,
+            held / 1e9, elapsed / 1e9, elapsed > 0 ? held * 100.0 / elapsed : 0.0,
+            mReleaseSkippedCount);
+    return std::string(buffer.string());
+}
+
+size_t WakeLockPolicy::getSensorCount() const {
+    return mSensors.size();
+}
+
+int WakeLockPolicy::getSensorHandle(size_t index) const {
+    return mSensors.keyAt(index);
+}
+
+std::string WakeLockPolicy::dumpSensor(size_t index) const {
+    const SensorHold& sensor = mSensors.valueAt(index);
+    String8 buffer;
+    buffer.appendFormat("delivery interval %.1fms | hold %.1fms%s", sensor.interval / 1e6,
+            getHold(sensor) / 1e6, sensor.hold == HOLD_AUTO ? " (auto)" : "");
+    return std::string(buffer.string());
+}
+
+} // namespace SensorServiceUtil
+} // namespace android
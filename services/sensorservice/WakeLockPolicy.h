@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_SERVICE_UTIL_WAKE_LOCK_POLICY_H
+#define ANDROID_SENSOR_SERVICE_UTIL_WAKE_LOCK_POLICY_H
+
+#include <utils/KeyedVector.h>
+#include <utils/Timers.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+
+namespace android {
+namespace SensorServiceUtil {
+
+/**
+ * Decides how long SensorService keeps its wake lock after the events of the wake-up sensors have
+ * been acknowledged, and counts how often and how long the wake lock is held.
+ *
+ * Releasing the wake lock as soon as the last ack comes in makes a wake-up sensor delivering every
+ * few milliseconds acquire and release it on every delivery.  Instead, each delivery of a wake-up
+ * sensor holds the wake lock until a little after its next delivery is expected, so the lock stays
+ * acquired while deliveries keep coming.  The expected interval is measured from the deliveries
+ * themselves, not from the event timestamps, so a batched sensor whose FIFO is flushed once in a
+ * while doesn't hold the lock between flushes.  Sensors delivering less often than every
+ * DEFAULT_MAX_HOLD don't hold it at all.  The hold of a sensor can be set instead with setHold().
+ *
+ * Not thread safe, SensorService calls it with mLock held.
+ */
+class WakeLockPolicy {
+public:
+    // Longest hold of the rate-aware default.
+    static constexpr nsecs_t DEFAULT_MAX_HOLD = 100000000;  // 100ms
+    // Use the rate-aware hold for a sensor.
+    static constexpr nsecs_t HOLD_AUTO = -1;
+
+    WakeLockPolicy();
+
+    /**
+     * Hold the wake lock for hold after each delivery of the sensor, or use the rate-aware default
+     * with HOLD_AUTO.  0 releases it as soon as the events are acknowledged.
+     */
+    void setHold(int handle, nsecs_t hold);
+
+    /**
+     * Record a delivery of the events of a wake-up sensor at now.  Counted once per sensor and
+     * time, so it can be called for every event of a poll with the same time.
+     */
+    void onDelivery(int handle, nsecs_t now);
+
+    /**
+     * Return the time before which the wake lock should not be released.
+     */
+    nsecs_t getHoldUntil() const;
+
+    /**
+     * Count an acquisition or a release of the wake lock.
+     */
+    void onAcquire(nsecs_t now);
+    void onRelease(nsecs_t now);
+
+    /**
+     * Count a release which was deferred until getHoldUntil() and didn't happen because the
+     * wake lock was needed again by then.
+     */
+    void onReleaseSkipped();
+
+    uint64_t getAcquireCount() const;
+    uint64_t getReleaseSkippedCount() const;
+    nsecs_t getHeldTime(nsecs_t now) const;
+
+    /**
+     * Return a one line summary of the counters.
+     */
+    std::string dump(nsecs_t now) const;
+
+    /**
+     * The wake-up sensors seen or configured, and a one line summary of their hold.
+     */
+    size_t getSensorCount() const;
+    int getSensorHandle(size_t index) const;
+    std::string dumpSensor(size_t index) const;
+
+private:
+    struct SensorHold {
+        nsecs_t lastDelivery;
+        // Smoothed interval between deliveries, 0 until there were two.
+        nsecs_t interval;
+        nsecs_t hold;
+        SensorHold() : lastDelivery(0), interval(0), hold(HOLD_AUTO) {}
+    };
+
+    nsecs_t getHold(const SensorHold& sensor) const;
+    void advanceMinute(nsecs_t now);
+
+    KeyedVector<int, SensorHold> mSensors;
+    nsecs_t mHoldUntil;
+
+    nsecs_t mStartTime;
+    uint64_t mAcquireCount;
+    uint64_t mReleaseSkippedCount;
+    // Time the wake lock was acquired while it is held, 0 otherwise.
+    nsecs_t mAcquireTime;
+    nsecs_t mHeldTime;
+    // Acquisitions in the current and the previous minute since mStartTime.
+    nsecs_t mMinuteStart;
+    uint32_t mAcquiresThisMinute;
+    uint32_t mAcquiresLastMinute;
+};
+
+} // namespace SensorServiceUtil
+} // namespace android
+
+#endif // ANDROID_SENSOR_SERVICE_UTIL_WAKE_LOCK_POLICY_H
@@ -20,6 +20,16 @@
 #include "vec.h"
 #include "traits.h"
 
+// Define MAT_NO_SIMD to use the generic code for all the products.
+#if defined(MAT_NO_SIMD)
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MAT_SIMD_NEON 1
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define MAT_SIMD_SSE 1
+#endif
+
 // -----------------------------------------------------------------------
 
 namespace android {
@@ -380,6 +390,116 @@ mat<T, N, N> PURE invert(const mat<T, N, N>& src) {
     return inverse;
 }
 
+// -----------------------------------------------------------------------
+// SIMD versions of the 3x3 and 4x4 float products, which the sensor fusion
+// runs for every gyro and accelerometer event. A column of the result is a
+// linear combination of the columns of lhs; the products are added in the
+// same order as in the generic code.
+
+#if defined(MAT_SIMD_NEON) || defined(MAT_SIMD_SSE)
+
+namespace helpers {
+
+#if defined(MAT_SIMD_NEON)
+typedef float32x4_t simd4f_t;
+
+inline simd4f_t simdLoad4(const float* p) { return vld1q_f32(p); }
+inline simd4f_t simdLoad3(const float* p) {
+    return vcombine_f32(vld1_f32(p), vld1_lane_f32(p + 2, vdup_n_f32(0), 0));
+}
+inline void simdStore4(float* p, simd4f_t v) { vst1q_f32(p, v); }
+inline void simdStore3(float* p, simd4f_t v) {
+    vst1_f32(p, vget_low_f32(v));
+    vst1q_lane_f32(p + 2, v, 2);
+}
+inline simd4f_t simdMul(simd4f_t a, float b) { return vmulq_n_f32(a, b); }
+inline simd4f_t simdAdd(simd4f_t a, simd4f_t b) { return vaddq_f32(a, b); }
+#else
+typedef __m128 simd4f_t;
+
+inline simd4f_t simdLoad4(const float* p) { return _mm_loadu_ps(p); }
+inline simd4f_t simdLoad3(const float* p) {
+    return _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(p)),
+            _mm_load_ss(p + 2));
+}
+inline void simdStore4(float* p, simd4f_t v) { _mm_storeu_ps(p, v); }
+inline void simdStore3(float* p, simd4f_t v) {
+    _mm_storel_pi(reinterpret_cast<__m64*>(p), v);
+    _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+}
+inline simd4f_t simdMul(simd4f_t a, float b) { return _mm_mul_ps(a, _mm_set1_ps(b)); }
+inline simd4f_t simdAdd(simd4f_t a, simd4f_t b) { return _mm_add_ps(a, b); }
+#endif
+
+template <>
+inline mat<float, 3, 3> PURE doMul<float, 3, 3, 3>(
+        const mat<float, 3, 3>& lhs,
+        const mat<float, 3, 3>& rhs)
+{
+    const simd4f_t l0 = simdLoad3(&lhs[0][0]);
+    const simd4f_t l1 = simdLoad3(&lhs[1][0]);
+    const simd4f_t l2 = simdLoad3(&lhs[2][0]);
+    mat<float, 3, 3> res;
+    for (size_t c=0 ; c<3 ; c++) {
+        simd4f_t v = simdMul(l0, rhs[c][0]);
+        v = simdAdd(v, simdMul(l1, rhs[c][1]));
+        v = simdAdd(v, simdMul(l2, rhs[c][2]));
+        simdStore3(&res[c][0], v);
+    }
+    return res;
+}
+
+template <>
+inline vec<float, 3> PURE doMul<float, 3, 3>(
+        const mat<float, 3, 3>& lhs,
+        const vec<float, 3>& rhs)
+{
+    simd4f_t v = simdMul(simdLoad3(&lhs[0][0]), rhs[0]);
+    v = simdAdd(v, simdMul(simdLoad3(&lhs[1][0]), rhs[1]));
+    v = simdAdd(v, simdMul(simdLoad3(&lhs[2][0]), rhs[2]));
+    vec<float, 3> res;
+    simdStore3(&res[0], v);
+    return res;
+}
+
+template <>
+inline mat<float, 4, 4> PURE doMul<float, 4, 4, 4>(
+        const mat<float, 4, 4>& lhs,
+        const mat<float, 4, 4>& rhs)
+{
+    const simd4f_t l0 = simdLoad4(&lhs[0][0]);
+    const simd4f_t l1 = simdLoad4(&lhs[1][0]);
+    const simd4f_t l2 = simdLoad4(&lhs[2][0]);
+    const simd4f_t l3 = simdLoad4(&lhs[3][0]);
+    mat<float, 4, 4> res;
+    for (size_t c=0 ; c<4 ; c++) {
+        simd4f_t v = simdMul(l0, rhs[c][0]);
+        v = simdAdd(v, simdMul(l1, rhs[c][1]));
+        v = simdAdd(v, simdMul(l2, rhs[c][2]));
+        v = simdAdd(v, simdMul(l3, rhs[c][3]));
+        simdStore4(&res[c][0], v);
+    }
+    return res;
+}
+
+template <>
+inline vec<float, 4> PURE doMul<float, 4, 4>(
+        const mat<float, 4, 4>& lhs,
+        const vec<float, 4>& rhs)
+{
+    simd4f_t v = simdMul(simdLoad4(&lhs[0][0]), rhs[0]);
+    v = simdAdd(v, simdMul(simdLoad4(&lhs[1][0]), rhs[1]));
+    v = simdAdd(v, simdMul(simdLoad4(&lhs[2][0]), rhs[2]));
+    v = simdAdd(v, simdMul(simdLoad4(&lhs[3][0]), rhs[3]));
+    vec<float, 4> res;
+    simdStore4(&res[0], v);
+    return res;
+}
+
+}; // namespace helpers
+
+#endif // MAT_SIMD_NEON || MAT_SIMD_SSE
+
 // -----------------------------------------------------------------------
 
 typedef mat<float, 2, 2> mat22_t;
@@ -12,3 +12,157 @@ LOCAL_MODULE:= test-sensorservice
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	fanoutbenchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils libutils libui libgui
+
+LOCAL_MODULE:= benchmark-sensorservice-fanout
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	directchannelbenchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils libutils libui libgui
+
+LOCAL_MODULE:= benchmark-sensorservice-directchannel
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	eventcachestress.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/..
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils libutils libhardware
+
+LOCAL_MODULE:= test-sensorservice-eventcache
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	fusionbenchmark.cpp \
+	../Fusion.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/..
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils libutils liblog libhardware
+
+LOCAL_MODULE:= benchmark-sensorservice-fusion
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	fusionbenchmark.cpp \
+	../Fusion.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/..
+
+LOCAL_CFLAGS := -DMAT_NO_SIMD
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils libutils liblog libhardware
+
+LOCAL_MODULE:= benchmark-sensorservice-fusion-scalar
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	pipelinestatstest.cpp \
+	../PipelineStats.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/..
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils libutils libhardware
+
+LOCAL_MODULE:= test-sensorservice-pipelinestats
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	replaybenchmark.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/..
+
+LOCAL_SHARED_LIBRARIES := \
+	libsensorservice libcutils libutils libbinder libui libgui libhardware
+
+LOCAL_MODULE:= benchmark-sensorservice-replay
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	eventmergebenchmark.cpp \
+	../EventMerger.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/..
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils libutils libui libgui
+
+LOCAL_MODULE:= benchmark-sensorservice-eventmerge
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	wakelockpolicytest.cpp \
+	../WakeLockPolicy.cpp
+
+LOCAL_C_INCLUDES := \
+	$(LOCAL_PATH)/..
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils libutils
+
+LOCAL_MODULE:= test-sensorservice-wakelockpolicy
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
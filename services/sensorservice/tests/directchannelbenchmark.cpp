@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares the delivery of a high rate sensor through the socket of a SensorEventQueue with
+ * its delivery through a shared memory direct channel.
+ *
+ * Listens to the accelerometer at its fastest rate in each mode in turn and reports the
+ * delivery latency of the events, the number of wakeups and the CPU time of the client, and
+ * the threadLoop CPU time per poll from the "Event fan-out" line of dumpsys sensorservice.
+ *
+ * Usage: benchmark-sensorservice-directchannel [seconds] [maxLatencyMs]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <android/sensor.h>
+#include <gui/Sensor.h>
+#include <gui/SensorManager.h>
+#include <gui/SensorEventQueue.h>
+#include <utils/Looper.h>
+
+using namespace android;
+
+static const size_t DIRECT_CHANNEL_CAPACITY = 1024;
+
+struct DeliveryStats {
+    uint64_t wakeups;
+    uint64_t events;
+    nsecs_t totalLatency;
+    nsecs_t maxLatency;
+};
+
+static DeliveryStats sStats;
+
+// Sensor timestamps use the boot time clock.
+static nsecs_t bootTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return nsecs_t(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static int receiver(__unused int fd, __unused int events, void* data)
+{
+    SensorEventQueue* q = static_cast<SensorEventQueue*>(data);
+    ASensorEvent buffer[64];
+    ssize_t n;
+    sStats.wakeups++;
+    while ((n = q->read(buffer, 64)) > 0) {
+        nsecs_t now = bootTime();
+        for (ssize_t i = 0; i < n; i++) {
+            if (buffer[i].type != ASENSOR_TYPE_ACCELEROMETER) {
+                continue;
+            }
+            nsecs_t latency = now - buffer[i].timestamp;
+            sStats.totalLatency += latency;
+            if (latency > sStats.maxLatency) {
+                sStats.maxLatency = latency;
+            }
+            sStats.events++;
+        }
+    }
+    return 1;
+}
+
+static bool readFanOutCpuTime(double* outCpuTimeUs, uint64_t* outPolls)
+{
+    FILE* f = popen("dumpsys sensorservice", "r");
+    if (!f) {
+        return false;
+    }
+    bool found = false;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        uint64_t routedEvents;
+        double cpuPerPollUs;
+        if (sscanf(line, "Event fan-out: %" SCNu64 " polls | %" SCNu64 " events routed | "
+                "threadLoop cpu %lfus per poll", outPolls, &routedEvents, &cpuPerPollUs) == 3) {
+            *outCpuTimeUs = cpuPerPollUs * *outPolls;
+            found = true;
+        }
+    }
+    pclose(f);
+    return found;
+}
+
+static bool run(SensorManager& mgr, Sensor const* sensor, int seconds, nsecs_t maxLatency,
+        bool direct)
+{
+    sp<Looper> loop = new Looper(false);
+    sp<SensorEventQueue> q = mgr.createEventQueue();
+    if (direct) {
+        status_t err = q->enableDirectChannel(DIRECT_CHANNEL_CAPACITY, maxLatency);
+        if (err != NO_ERROR) {
+            printf("could not enable the direct channel (%s)\n", strerror(-err));
+            return false;
+        }
+    }
+    q->enableSensor(sensor, int32_t(ns2us(sensor->getMinDelayNs())));
+    loop->addFd(q->getFd(), 0, ALOOPER_EVENT_INPUT, receiver, q.get());
+
+    // Let the sensor settle before measuring.
+    nsecs_t settleTime = systemTime() + s2ns(1);
+    while (systemTime() < settleTime) {
+        loop->pollOnce(int(ns2ms(settleTime - systemTime())));
+    }
+
+    double serviceCpuStart, serviceCpuEnd;
+    uint64_t pollsStart, pollsEnd;
+    if (!readFanOutCpuTime(&serviceCpuStart, &pollsStart)) {
+        printf("could not read the fan-out statistics of sensorservice\n");
+        return false;
+    }
+    memset(&sStats, 0, sizeof(sStats));
+    nsecs_t cpuStart = systemTime(SYSTEM_TIME_THREAD);
+    nsecs_t endTime = systemTime() + s2ns(seconds);
+    while (systemTime() < endTime) {
+        loop->pollOnce(int(ns2ms(endTime - systemTime())));
+    }
+    nsecs_t cpuTime = systemTime(SYSTEM_TIME_THREAD) - cpuStart;
+    if (!readFanOutCpuTime(&serviceCpuEnd, &pollsEnd)) {
+        printf("could not read the fan-out statistics of sensorservice\n");
+        return false;
+    }
+
+    loop->removeFd(q->getFd());
+    q->disableSensor(sensor);
+    if (direct) {
+        q->disableDirectChannel();
+    }
+
+    uint64_t polls = pollsEnd - pollsStart;
+    printf("%s: events=%" PRIu64 " wakeups=%" PRIu64 " latency avg=%.2fms max=%.2fms "
+            "client cpu=%.2fms service cpu per poll=%.2fus\n",
+            direct ? "direct" : "socket", sStats.events, sStats.wakeups,
+            sStats.events ? sStats.totalLatency / 1000000.0 / sStats.events : 0.0,
+            sStats.maxLatency / 1000000.0, cpuTime / 1000000.0,
+            polls ? (serviceCpuEnd - serviceCpuStart) / polls : 0.0);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 10;
+    nsecs_t maxLatency = ms2ns(argc > 2 ? atoi(argv[2]) : 10);
+
+    SensorManager& mgr = SensorManager::getInstanceForPackage(
+            String16("Sensor Service Direct Channel Benchmark"));
+    Sensor const* sensor = mgr.getDefaultSensor(Sensor::TYPE_ACCELEROMETER);
+    if (!sensor) {
+        printf("no accelerometer to benchmark with\n");
+        return 1;
+    }
+
+    printf("sensor=%s period=%" PRId64 "us duration=%ds maxLatency=%" PRId64 "ms\n",
+            sensor->getName().string(), ns2us(sensor->getMinDelayNs()), seconds,
+            ns2ms(maxLatency));
+    if (!run(mgr, sensor, seconds, maxLatency, false)
+            || !run(mgr, sensor, seconds, maxLatency, true)) {
+        return 1;
+    }
+    return 0;
+}
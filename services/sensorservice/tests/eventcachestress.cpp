@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stress test of the event cache of SensorEventConnection.
+ *
+ * A writer appends batches of events to the cache of a connection whose reader is too slow to
+ * keep up, so the cache stays full and drops its oldest events. Checks that the events come out
+ * in order, that every dropped flush complete event is reported and that the wake up events are
+ * found, then measures the cost per cached event for growing cache sizes, next to a flat array
+ * that is shifted down whenever events are dropped or sent.
+ *
+ * Usage: test-sensorservice-eventcache
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <utils/Timers.h>
+
+#include <vector>
+
+#include "EventCache.h"
+
+using namespace android;
+using namespace android::SensorServiceUtil;
+
+static const int32_t WAKE_UP_HANDLE = 2;
+static const size_t BATCH_SIZE = 20;
+// The reader writes at most this many events at a time, every READ_INTERVAL batches.
+static const size_t READ_SIZE = 64;
+static const size_t READ_INTERVAL = 8;
+
+static uint64_t sFlushCompleteDropped = 0;
+
+static void makeEvent(sensors_event_t* event, uint64_t sequence)
+{
+    memset(event, 0, sizeof(*event));
+    event->version = sizeof(sensors_event_t);
+    event->timestamp = int64_t(sequence);
+    if (sequence % 97 == 0) {
+        event->type = SENSOR_TYPE_META_DATA;
+        event->meta_data.what = META_DATA_FLUSH_COMPLETE;
+        event->meta_data.sensor = 1;
+    } else {
+        event->type = SENSOR_TYPE_ACCELEROMETER;
+        event->sensor = sequence % 5 == 0 ? WAKE_UP_HANDLE : 1;
+    }
+}
+
+static bool isWakeUp(const sensors_event_t& event)
+{
+    return event.type != SENSOR_TYPE_META_DATA && event.sensor == WAKE_UP_HANDLE;
+}
+
+static void onFlushCompleteDropped(const sensors_event_t&)
+{
+    sFlushCompleteDropped++;
+}
+
+// Appends a batch to the cache the way SensorEventConnection does, dropping the oldest events.
+static void cacheBatch(EventCache& cache, sensors_event_t const* events, size_t count)
+{
+    const size_t room = cache.maxSize() - cache.size();
+    if (count > room) {
+        cache.dropOldest(count - room, onFlushCompleteDropped);
+    }
+    cache.push(events, count, isWakeUp);
+}
+
+static bool checkSlowReader(size_t maxCacheSize)
+{
+    EventCache cache;
+    cache.reserve(maxCacheSize / 2);
+
+    sensors_event_t batch[BATCH_SIZE];
+    uint64_t sequence = 1;
+    uint64_t lastReceived = 0;
+    uint64_t received = 0;
+    uint64_t flushCompletePushed = 0;
+    uint64_t flushCompleteReceived = 0;
+    sFlushCompleteDropped = 0;
+
+    for (size_t n = 0; n < 20000; n++) {
+        for (size_t i = 0; i < BATCH_SIZE; i++) {
+            makeEvent(&batch[i], sequence++);
+            flushCompletePushed += batch[i].type == SENSOR_TYPE_META_DATA;
+        }
+        if (n == 1000) {
+            // A sensor with a bigger FIFO registers while the cache is full.
+            cache.reserve(maxCacheSize);
+        }
+        cacheBatch(cache, batch, BATCH_SIZE);
+
+        if (n % READ_INTERVAL != 0) {
+            continue;
+        }
+        size_t count;
+        sensors_event_t* events = cache.front(READ_SIZE, &count);
+        ssize_t wakeUp = cache.findWakeUp(count);
+        ssize_t expectedWakeUp = -1;
+        for (size_t i = 0; i < count; i++) {
+            if (events[i].timestamp <= int64_t(lastReceived)) {
+                printf("FAIL: event %" PRId64 " received after %" PRIu64 "\n",
+                        events[i].timestamp, lastReceived);
+                return false;
+            }
+            lastReceived = events[i].timestamp;
+            flushCompleteReceived += events[i].type == SENSOR_TYPE_META_DATA;
+            if (expectedWakeUp < 0 && isWakeUp(events[i])) {
+                expectedWakeUp = i;
+            }
+        }
+        if (wakeUp != expectedWakeUp) {
+            printf("FAIL: first wake up event at %zd instead of %zd\n", wakeUp, expectedWakeUp);
+            return false;
+        }
+        cache.pop(count);
+        received += count;
+    }
+
+    const uint64_t pushed = sequence - 1;
+    if (received + cache.droppedCount() + cache.size() != pushed) {
+        printf("FAIL: %" PRIu64 " events pushed, %" PRIu64 " received, %" PRIu64 " dropped, "
+                "%zu cached\n", pushed, received, cache.droppedCount(), cache.size());
+        return false;
+    }
+    if (flushCompleteReceived + sFlushCompleteDropped + cache.flushCompleteCount()
+            != flushCompletePushed) {
+        printf("FAIL: %" PRIu64 " flush complete events pushed, %" PRIu64 " received, %" PRIu64
+                " dropped, %zu cached\n", flushCompletePushed, flushCompleteReceived,
+                sFlushCompleteDropped, cache.flushCompleteCount());
+        return false;
+    }
+    printf("slow reader, max cache size %zu: %" PRIu64 " events, %" PRIu64 " dropped, "
+            "%" PRIu64 " flush complete dropped: OK\n", maxCacheSize, pushed,
+            cache.droppedCount(), sFlushCompleteDropped);
+    return true;
+}
+
+// The cache as it was before, a flat array that is shifted down whenever events leave it.
+class FlatCache {
+public:
+    explicit FlatCache(size_t maxSize) : mEvents(maxSize), mSize(0) {}
+
+    void cacheBatch(sensors_event_t const* events, size_t count) {
+        const size_t room = mEvents.size() - mSize;
+        if (count > room) {
+            const size_t dropped = count - room;
+            for (size_t i = 0; i < dropped; i++) {
+                if (mEvents[i].type == SENSOR_TYPE_META_DATA) {
+                    sFlushCompleteDropped++;
+                }
+            }
+            memmove(&mEvents[0], &mEvents[dropped], (mSize - dropped) * sizeof(sensors_event_t));
+            mSize -= dropped;
+        }
+        memcpy(&mEvents[mSize], events, count * sizeof(sensors_event_t));
+        mSize += count;
+    }
+
+    void send(size_t maxCount) {
+        const size_t count = mSize < maxCount ? mSize : maxCount;
+        for (size_t i = 0; i < count && !isWakeUp(mEvents[i]); i++) {
+        }
+        memmove(&mEvents[0], &mEvents[count], (mSize - count) * sizeof(sensors_event_t));
+        mSize -= count;
+    }
+
+private:
+    std::vector<sensors_event_t> mEvents;
+    size_t mSize;
+};
+
+static double measureRing(size_t maxCacheSize, size_t batches)
+{
+    EventCache cache;
+    cache.reserve(maxCacheSize);
+    sensors_event_t batch[BATCH_SIZE];
+    for (size_t i = 0; i < BATCH_SIZE; i++) {
+        makeEvent(&batch[i], i + 1);
+    }
+    nsecs_t start = systemTime(SYSTEM_TIME_THREAD);
+    for (size_t n = 0; n < batches; n++) {
+        cacheBatch(cache, batch, BATCH_SIZE);
+        if (n % READ_INTERVAL == 0) {
+            size_t count;
+            cache.front(READ_SIZE, &count);
+            cache.findWakeUp(count);
+            cache.pop(count);
+        }
+    }
+    return double(systemTime(SYSTEM_TIME_THREAD) - start) / (batches * BATCH_SIZE);
+}
+
+static double measureFlat(size_t maxCacheSize, size_t batches)
+{
+    FlatCache cache(maxCacheSize);
+    sensors_event_t batch[BATCH_SIZE];
+    for (size_t i = 0; i < BATCH_SIZE; i++) {
+        makeEvent(&batch[i], i + 1);
+    }
+    nsecs_t start = systemTime(SYSTEM_TIME_THREAD);
+    for (size_t n = 0; n < batches; n++) {
+        cache.cacheBatch(batch, BATCH_SIZE);
+        if (n % READ_INTERVAL == 0) {
+            cache.send(READ_SIZE);
+        }
+    }
+    return double(systemTime(SYSTEM_TIME_THREAD) - start) / (batches * BATCH_SIZE);
+}
+
+int main()
+{
+    const size_t sizes[] = { 1024, 4096, 16384, 65536 };
+    const size_t numSizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    for (size_t i = 0; i < numSizes; i++) {
+        if (!checkSlowReader(sizes[i])) {
+            return 1;
+        }
+    }
+
+    printf("cost per cached event with a slow reader:\n");
+    printf("%16s %12s %12s\n", "max cache size", "ring (ns)", "flat (ns)");
+    for (size_t i = 0; i < numSizes; i++) {
+        // Run long enough for the cache to be full most of the time.
+        const size_t batches = 4 * sizes[i] / BATCH_SIZE + 20000;
+        printf("%16zu %12.1f %12.1f\n", sizes[i], measureRing(sizes[i], batches),
+                measureFlat(sizes[i], batches));
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures ordering the events of a poll of SensorService::threadLoop by timestamp.
+ *
+ * Builds polls the way threadLoop does: a batch of HAL events from an accelerometer, a gyroscope
+ * and a magnetometer, followed by the events computed by a number of virtual sensors, one per
+ * accelerometer or gyroscope event.  Checks that EventMerger orders them like a stable sort, then
+ * compares its cost with the qsort that threadLoop used to do, for batch sizes up to
+ * SensorEventQueue::MAX_RECEIVE_BUFFER_EVENT_COUNT.
+ *
+ * Usage: benchmark-sensorservice-eventmerge [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gui/SensorEventQueue.h>
+#include <utils/Timers.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "EventMerger.h"
+
+using namespace android;
+using namespace android::SensorServiceUtil;
+
+static const size_t MAX_EVENTS = SensorEventQueue::MAX_RECEIVE_BUFFER_EVENT_COUNT;
+
+static int compareTimestamps(void const* lhs, void const* rhs)
+{
+    sensors_event_t const* l = static_cast<sensors_event_t const*>(lhs);
+    sensors_event_t const* r = static_cast<sensors_event_t const*>(rhs);
+    return l->timestamp < r->timestamp ? -1 : (l->timestamp > r->timestamp ? 1 : 0);
+}
+
+// Fills events with a poll of halCount HAL events followed by the events of numVirtual virtual
+// sensors, and returns the total count. With shuffled set, the HAL batch is out of order.
+static size_t makePoll(sensors_event_t* events, size_t halCount, size_t numVirtual,
+        bool shuffled)
+{
+    memset(events, 0, MAX_EVENTS * sizeof(*events));
+    const nsecs_t start = s2ns(1000);
+    for (size_t i = 0; i < halCount; i++) {
+        sensors_event_t& e = events[i];
+        e.version = sizeof(sensors_event_t);
+        // 200Hz accelerometer and gyroscope, 50Hz magnetometer, with some jitter.
+        switch (i % 9) {
+            case 8:
+                e.sensor = 3;
+                e.type = SENSOR_TYPE_MAGNETIC_FIELD;
+                break;
+            default:
+                e.sensor = i % 2 ? 2 : 1;
+                e.type = i % 2 ? SENSOR_TYPE_GYROSCOPE : SENSOR_TYPE_ACCELEROMETER;
+                break;
+        }
+        e.timestamp = start + (i / 2) * us2ns(5000) + (i % 2) * us2ns(20) + (rand() % 10);
+    }
+    if (shuffled) {
+        for (size_t i = halCount; i > 1; i--) {
+            std::swap(events[i - 1], events[rand() % i]);
+        }
+    }
+
+    size_t count = halCount;
+    for (size_t v = 0; v < numVirtual; v++) {
+        for (size_t i = 0; i < halCount && count < MAX_EVENTS; i++) {
+            if (events[i].type == SENSOR_TYPE_MAGNETIC_FIELD) {
+                continue;
+            }
+            sensors_event_t& e = events[count++];
+            e = events[i];
+            e.sensor = 100 + v;
+            e.type = SENSOR_TYPE_ROTATION_VECTOR;
+        }
+    }
+    // Tag each event with its position so that equal timestamps can be told apart.
+    for (size_t i = 0; i < count; i++) {
+        events[i].data[15] = i;
+    }
+    return count;
+}
+
+static bool check(EventMerger& merger, size_t halCount, size_t numVirtual, bool shuffled)
+{
+    sensors_event_t events[MAX_EVENTS], out[MAX_EVENTS], expected[MAX_EVENTS];
+    const size_t count = makePoll(events, halCount, numVirtual, shuffled);
+    memcpy(expected, events, count * sizeof(*events));
+    std::stable_sort(expected, expected + count,
+            [](const sensors_event_t& l, const sensors_event_t& r) {
+                return l.timestamp < r.timestamp;
+            });
+    sensors_event_t const* merged = merger.merge(events, count, out);
+    if (memcmp(merged, expected, count * sizeof(*events)) != 0) {
+        printf("FAIL: %zu HAL events, %zu virtual sensors%s are not in order\n", halCount,
+                numVirtual, shuffled ? ", shuffled" : "");
+        return false;
+    }
+    return true;
+}
+
+static void measure(EventMerger& merger, size_t halCount, size_t numVirtual, bool shuffled,
+        int iterations)
+{
+    sensors_event_t poll[MAX_EVENTS], events[MAX_EVENTS], out[MAX_EVENTS];
+    const size_t count = makePoll(poll, halCount, numVirtual, shuffled);
+
+    // Both include restoring the poll, which threadLoop doesn't do.
+    nsecs_t start = systemTime(SYSTEM_TIME_THREAD);
+    for (int i = 0; i < iterations; i++) {
+        memcpy(events, poll, count * sizeof(*events));
+        qsort(events, count, sizeof(sensors_event_t), compareTimestamps);
+    }
+    const nsecs_t sortTime = systemTime(SYSTEM_TIME_THREAD) - start;
+
+    start = systemTime(SYSTEM_TIME_THREAD);
+    for (int i = 0; i < iterations; i++) {
+        memcpy(events, poll, count * sizeof(*events));
+        merger.merge(events, count, out);
+    }
+    const nsecs_t mergeTime = systemTime(SYSTEM_TIME_THREAD) - start;
+
+    printf("%4zu events (%3zu HAL, %zu virtual sensors%s): %3zu runs | qsort %7.2fus | "
+            "merge %7.2fus\n", count, halCount, numVirtual, shuffled ? ", shuffled" : "",
+            merger.getRunCount(), sortTime / 1000.0 / iterations,
+            mergeTime / 1000.0 / iterations);
+}
+
+int main(int argc, char** argv)
+{
+    const int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+    EventMerger merger;
+
+    static const size_t halCounts[] = { 1, 4, 16, 64 };
+    for (size_t numVirtual = 0; numVirtual <= 3; numVirtual++) {
+        for (size_t halCount : halCounts) {
+            if (!check(merger, halCount, numVirtual, false)
+                    || !check(merger, halCount, numVirtual, true)) {
+                return 1;
+            }
+        }
+    }
+    // A poll filling the buffer, as threadLoop sizes it for 3 virtual sensors.
+    if (!check(merger, MAX_EVENTS / 4, 3, true)) {
+        return 1;
+    }
+    printf("merge matches a stable sort: OK\n");
+
+    for (size_t numVirtual = 1; numVirtual <= 3; numVirtual++) {
+        for (size_t halCount : halCounts) {
+            measure(merger, halCount, numVirtual, false, iterations);
+        }
+    }
+    measure(merger, MAX_EVENTS / 4, 3, false, iterations);
+    measure(merger, MAX_EVENTS / 4, 3, true, iterations);
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the cost of fanning sensor events out to many connections in
+ * SensorService::threadLoop.
+ *
+ * Opens 50 connections that listen to a mix of sensors at 200Hz and 50Hz, drains them for a
+ * while and reports the threadLoop CPU time per poll from the "Event fan-out" line of
+ * dumpsys sensorservice.
+ *
+ * Usage: benchmark-sensorservice-fanout [seconds]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <android/sensor.h>
+#include <gui/Sensor.h>
+#include <gui/SensorManager.h>
+#include <gui/SensorEventQueue.h>
+#include <utils/Looper.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+static const size_t NUM_CONNECTIONS = 50;
+static const nsecs_t FAST_PERIOD = ms2ns(5);
+static const nsecs_t SLOW_PERIOD = ms2ns(20);
+
+struct FanOutStats {
+    uint64_t polls;
+    uint64_t routedEvents;
+    double cpuTimeUs;
+};
+
+static uint64_t sReceivedEvents = 0;
+
+static int receiver(__unused int fd, __unused int events, void* data)
+{
+    SensorEventQueue* q = static_cast<SensorEventQueue*>(data);
+    ASensorEvent buffer[16];
+    ssize_t n;
+    while ((n = q->read(buffer, 16)) > 0) {
+        sReceivedEvents += n;
+    }
+    return 1;
+}
+
+static bool readFanOutStats(FanOutStats* outStats)
+{
+    FILE* f = popen("dumpsys sensorservice", "r");
+    if (!f) {
+        return false;
+    }
+    bool found = false;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        double cpuPerPollUs;
+        if (sscanf(line, "Event fan-out: %" SCNu64 " polls | %" SCNu64 " events routed | "
+                "threadLoop cpu %lfus per poll", &outStats->polls, &outStats->routedEvents,
+                &cpuPerPollUs) == 3) {
+            outStats->cpuTimeUs = cpuPerPollUs * outStats->polls;
+            found = true;
+        }
+    }
+    pclose(f);
+    return found;
+}
+
+int main(int argc, char** argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : 10;
+
+    SensorManager& mgr = SensorManager::getInstanceForPackage(
+            String16("Sensor Service Fan-out Benchmark"));
+    const int types[] = {
+        Sensor::TYPE_ACCELEROMETER,
+        Sensor::TYPE_GYROSCOPE,
+        Sensor::TYPE_MAGNETIC_FIELD,
+        Sensor::TYPE_GAME_ROTATION_VECTOR,
+    };
+    Vector<Sensor const*> sensors;
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        Sensor const* sensor = mgr.getDefaultSensor(types[i]);
+        if (sensor) {
+            sensors.push(sensor);
+        }
+    }
+    if (sensors.isEmpty()) {
+        printf("no sensors to benchmark with\n");
+        return 1;
+    }
+
+    sp<Looper> loop = new Looper(false);
+    Vector<sp<SensorEventQueue> > queues;
+    for (size_t i = 0; i < NUM_CONNECTIONS; i++) {
+        sp<SensorEventQueue> q = mgr.createEventQueue();
+        Sensor const* sensor = sensors[i % sensors.size()];
+        // Alternate between fast and slow listeners of each sensor.
+        nsecs_t period = (i / sensors.size()) % 2 ? SLOW_PERIOD : FAST_PERIOD;
+        q->enableSensor(sensor, int32_t(ns2us(period)));
+        loop->addFd(q->getFd(), 0, ALOOPER_EVENT_INPUT, receiver, q.get());
+        queues.push(q);
+    }
+
+    // Let the sensors settle before measuring.
+    nsecs_t settleTime = systemTime() + s2ns(1);
+    while (systemTime() < settleTime) {
+        loop->pollOnce(int(ns2ms(settleTime - systemTime())));
+    }
+
+    FanOutStats start;
+    if (!readFanOutStats(&start)) {
+        printf("could not read the fan-out statistics of sensorservice\n");
+        return 1;
+    }
+    sReceivedEvents = 0;
+    nsecs_t startTime = systemTime();
+    nsecs_t endTime = startTime + s2ns(seconds);
+    while (systemTime() < endTime) {
+        loop->pollOnce(int(ns2ms(endTime - systemTime())));
+    }
+    FanOutStats end;
+    if (!readFanOutStats(&end)) {
+        printf("could not read the fan-out statistics of sensorservice\n");
+        return 1;
+    }
+
+    uint64_t polls = end.polls - start.polls;
+    printf("connections=%zu sensors=%zu duration=%ds\n", queues.size(), sensors.size(), seconds);
+    printf("polls=%" PRIu64 " routedEvents=%" PRIu64 " receivedEvents=%" PRIu64 "\n",
+            polls, end.routedEvents - start.routedEvents, sReceivedEvents);
+    printf("threadLoop cpu per poll: %.2fus\n",
+            polls ? (end.cpuTimeUs - start.cpuTimeUs) / polls : 0.0);
+
+    for (size_t i = 0; i < queues.size(); i++) {
+        loop->removeFd(queues[i]->getFd());
+        queues[i]->disableSensor(sensors[i % sensors.size()]);
+    }
+    return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the sensor fusion on an IMU trace.
+ *
+ * Checks the SIMD matrix products of mat.h against the generic products and reports how long
+ * each takes, then runs the trace through the fusion in its three modes and reports the events
+ * per second and the final attitudes. benchmark-sensorservice-fusion-scalar is the same program
+ * built without the SIMD products; the attitudes printed by both should match closely.
+ *
+ * The trace is a text file with one event per line: "<sensor type> <timestamp ns> <x> <y> <z>",
+ * using the types of hardware/sensors.h for the accelerometer, magnetometer and gyroscope.
+ * Without a trace, a device slowly turning on itself is simulated.
+ *
+ * Usage: benchmark-sensorservice-fusion [trace] [repeat]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <hardware/sensors.h>
+#include <utils/Timers.h>
+
+#include <vector>
+
+#include "Fusion.h"
+
+using namespace android;
+
+struct TraceEvent {
+    int type;
+    int64_t timestamp;
+    vec3_t data;
+};
+
+static bool loadTrace(const char* path, std::vector<TraceEvent>* outTrace)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    TraceEvent e;
+    while (fscanf(f, "%d %" SCNd64 " %f %f %f", &e.type, &e.timestamp,
+            &e.data.x, &e.data.y, &e.data.z) == 5) {
+        outTrace->push_back(e);
+    }
+    fclose(f);
+    return !outTrace->empty();
+}
+
+// 60s of a device turning around a tilted axis, with gyro at 200Hz, accelerometer at 100Hz and
+// magnetometer at 50Hz.
+static void simulateTrace(std::vector<TraceEvent>* outTrace)
+{
+    static const float AXIS[3] = { 0.2f, 0.3f, 1.0f };
+    static const float GRAVITY[3] = { 0, 0, 9.81f };
+    static const float FIELD[3] = { 0, 22.0f, -40.0f }; // uT
+    const int64_t period = ms2ns(5);
+    const vec3_t axis(normalize(vec3_t(AXIS)));
+    const float rate = 0.5f; // rad/s
+    const vec3_t gravity(GRAVITY);
+    const vec3_t field(FIELD);
+    uint32_t seed = 1;
+    for (int i = 0; i < 12000; i++) {
+        const int64_t t = i * period;
+        const float angle = rate * t / 1e9f;
+        // Rodrigues rotation of the world vectors into the device frame.
+        const float c = cosf(angle), s = sinf(angle);
+        vec3_t noise;
+        for (int k = 0; k < 3; k++) {
+            seed = seed * 1103515245 + 12345;
+            noise[k] = ((seed >> 16) & 0x7fff) / 32768.0f - 0.5f;
+        }
+        TraceEvent e;
+        e.timestamp = t;
+        e.type = SENSOR_TYPE_GYROSCOPE;
+        e.data = axis * rate + noise * 0.002f;
+        outTrace->push_back(e);
+        if (i % 2 == 0) {
+            e.type = SENSOR_TYPE_ACCELEROMETER;
+            e.data = gravity * c + cross_product(gravity, axis) * s
+                    + axis * (dot_product(axis, gravity) * (1 - c)) + noise * 0.05f;
+            outTrace->push_back(e);
+        }
+        if (i % 4 == 0) {
+            e.type = SENSOR_TYPE_MAGNETIC_FIELD;
+            e.data = field * c + cross_product(field, axis) * s
+                    + axis * (dot_product(axis, field) * (1 - c)) + noise * 0.5f;
+            outTrace->push_back(e);
+        }
+    }
+}
+
+// Feeds the trace to the fusion the way SensorFusion does.
+static void runFusion(Fusion& fusion, const std::vector<TraceEvent>& trace)
+{
+    int64_t gyroTime = 0;
+    int64_t accTime = 0;
+    for (size_t i = 0; i < trace.size(); i++) {
+        const TraceEvent& e = trace[i];
+        if (e.type == SENSOR_TYPE_GYROSCOPE) {
+            if (e.timestamp - gyroTime > 0 && e.timestamp - gyroTime < int64_t(5e7)) {
+                fusion.handleGyro(e.data, (e.timestamp - gyroTime) / 1000000000.0f);
+            }
+            gyroTime = e.timestamp;
+        } else if (e.type == SENSOR_TYPE_MAGNETIC_FIELD) {
+            fusion.handleMag(e.data);
+        } else if (e.type == SENSOR_TYPE_ACCELEROMETER) {
+            if (e.timestamp - accTime > 0 && e.timestamp - accTime < int64_t(1e8)) {
+                fusion.handleAcc(e.data, (e.timestamp - accTime) / 1000000000.0f);
+            }
+            accTime = e.timestamp;
+        }
+    }
+}
+
+template <size_t C, size_t R, size_t D>
+static mat<float, C, R> referenceMul(const mat<float, D, R>& lhs, const mat<float, C, D>& rhs)
+{
+    mat<float, C, R> res;
+    for (size_t c = 0; c < C; c++) {
+        for (size_t r = 0; r < R; r++) {
+            float v(0);
+            for (size_t k = 0; k < D; k++) {
+                v += lhs[k][r] * rhs[c][k];
+            }
+            res[c][r] = v;
+        }
+    }
+    return res;
+}
+
+template <size_t C, size_t R>
+static float maxDifference(const mat<float, C, R>& a, const mat<float, C, R>& b)
+{
+    float d = 0;
+    for (size_t c = 0; c < C; c++) {
+        for (size_t r = 0; r < R; r++) {
+            d = fmaxf(d, fabsf(a[c][r] - b[c][r]));
+        }
+    }
+    return d;
+}
+
+template <size_t N>
+static void randomize(mat<float, N, N>* m)
+{
+    for (size_t c = 0; c < N; c++) {
+        for (size_t r = 0; r < N; r++) {
+            (*m)[c][r] = rand() / float(RAND_MAX) * 2 - 1;
+        }
+    }
+}
+
+template <size_t N>
+static bool checkProduct(const char* name)
+{
+    const int count = 1000000;
+    std::vector<mat<float, N, N> > a(64), b(64);
+    float diff = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        randomize(&a[i]);
+        randomize(&b[i]);
+        diff = fmaxf(diff, maxDifference(a[i] * b[i], referenceMul<N, N, N>(a[i], b[i])));
+        mat<float, 1, N> v(b[i][0]);
+        diff = fmaxf(diff, maxDifference(mat<float, 1, N>(a[i] * b[i][0]),
+                referenceMul<1, N, N>(a[i], v)));
+    }
+
+    volatile float sink = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_THREAD);
+    for (int i = 0; i < count; i++) {
+        sink = sink + (a[i & 63] * b[(i + 1) & 63])[0][0];
+    }
+    nsecs_t simd = systemTime(SYSTEM_TIME_THREAD) - start;
+    start = systemTime(SYSTEM_TIME_THREAD);
+    for (int i = 0; i < count; i++) {
+        sink = sink + referenceMul<N, N, N>(a[i & 63], b[(i + 1) & 63])[0][0];
+    }
+    nsecs_t generic = systemTime(SYSTEM_TIME_THREAD) - start;
+
+    printf("%s product: %.1fns (generic loops %.1fns), max difference %g\n", name,
+            double(simd) / count, double(generic) / count, diff);
+    return diff < 1e-6f;
+}
+
+int main(int argc, char** argv)
+{
+#if defined(MAT_SIMD_NEON)
+    printf("matrix products: NEON\n");
+#elif defined(MAT_SIMD_SSE)
+    printf("matrix products: SSE\n");
+#else
+    printf("matrix products: generic\n");
+#endif
+    if (!checkProduct<3>("mat33") || !checkProduct<4>("mat44")) {
+        printf("FAIL: the matrix products don't match the generic ones\n");
+        return 1;
+    }
+
+    std::vector<TraceEvent> trace;
+    if (argc > 1) {
+        if (!loadTrace(argv[1], &trace)) {
+            printf("could not read a trace from %s\n", argv[1]);
+            return 1;
+        }
+    } else {
+        simulateTrace(&trace);
+    }
+    const int repeat = argc > 2 ? atoi(argv[2]) : 20;
+
+    static const char* const names[NUM_FUSION_MODE] = { "9-axis", "game", "geomag" };
+    for (int mode = 0; mode < NUM_FUSION_MODE; mode++) {
+        Fusion fusion;
+        nsecs_t elapsed = 0;
+        for (int i = 0; i < repeat; i++) {
+            fusion.init(mode);
+            nsecs_t start = systemTime(SYSTEM_TIME_THREAD);
+            runFusion(fusion, trace);
+            elapsed += systemTime(SYSTEM_TIME_THREAD) - start;
+        }
+        const vec4_t q(fusion.getAttitude());
+        printf("%s fusion: %.0f events/s, q=< %.9g, %.9g, %.9g, %.9g >\n", names[mode],
+                double(trace.size()) * repeat / (elapsed / 1e9), q.x, q.y, q.z, q.w);
+    }
+    return 0;
+}
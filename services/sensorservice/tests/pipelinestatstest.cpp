@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of the pipeline latency statistics of SensorService.
+ *
+ * Checks the percentiles of the latency histograms and that the binary form written by
+ * "dumpsys sensorservice stats binary" decodes to the recorded statistics, then measures what
+ * recording costs per event.  With a file argument, decodes binary statistics saved from a
+ * device instead, e.g. with "adb shell dumpsys sensorservice stats binary > stats.bin".
+ *
+ * Usage: test-sensorservice-pipelinestats [stats.bin]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <utils/Timers.h>
+
+#include <vector>
+
+#include "PipelineStats.h"
+
+using namespace android;
+using namespace android::SensorServiceUtil;
+
+// Reads the binary statistics back, in the layout documented by PipelineStats::serialize.
+class Reader {
+public:
+    Reader(const std::vector<uint8_t>& data) : mData(data), mPos(0), mError(false) {}
+
+    template <class T>
+    T read() {
+        T value = T();
+        if (mPos + sizeof(T) > mData.size()) {
+            mError = true;
+            return value;
+        }
+        memcpy(&value, &mData[mPos], sizeof(T));
+        mPos += sizeof(T);
+        return value;
+    }
+
+    // Reads a histogram, printing it if name isn't null, and returns its count.
+    uint64_t readHistogram(size_t numBuckets, const char* name) {
+        const uint64_t count = read<uint64_t>();
+        const int64_t total = read<int64_t>();
+        const int64_t max = read<int64_t>();
+        std::vector<uint32_t> buckets(numBuckets);
+        for (size_t i = 0; i < numBuckets; i++) {
+            buckets[i] = read<uint32_t>();
+        }
+        mPos = (mPos + 7) & ~size_t(7);
+        if (name) {
+            printf("%-24s count %" PRIu64 " | mean %.1fus | max %.1fus |", name, count,
+                    count ? total / 1000.0 / count : 0.0, max / 1000.0);
+            for (size_t i = 0; i < numBuckets; i++) {
+                if (buckets[i]) {
+                    printf(" <%zuus:%u", size_t(1) << i, buckets[i]);
+                }
+            }
+            printf("\n");
+        }
+        return count;
+    }
+
+    bool atEnd() const { return mPos == mData.size(); }
+    bool hasError() const { return mError; }
+
+private:
+    const std::vector<uint8_t>& mData;
+    size_t mPos;
+    bool mError;
+};
+
+static bool decode(const std::vector<uint8_t>& data, bool print,
+        uint64_t* outStageCounts, std::vector<ConnectionStats>* outConnections)
+{
+    Reader reader(data);
+    if (reader.read<uint32_t>() != PipelineStats::SERIALIZED_MAGIC
+            || reader.read<uint16_t>() != PipelineStats::SERIALIZED_VERSION) {
+        printf("not pipeline statistics\n");
+        return false;
+    }
+    const size_t numBuckets = reader.read<uint16_t>();
+    const int64_t duration = reader.read<int64_t>();
+    const uint64_t polls = reader.read<uint64_t>();
+    const uint32_t numStages = reader.read<uint32_t>();
+    const uint32_t numSensors = reader.read<uint32_t>();
+    const uint32_t numConnections = reader.read<uint32_t>();
+    reader.read<uint32_t>();
+    if (print) {
+        printf("%" PRIu64 " polls in %.1fs, %u sensors, %u connections\n", polls,
+                duration / 1e9, numSensors, numConnections);
+    }
+
+    for (uint32_t i = 0; i < numStages; i++) {
+        const char* name = i < PipelineStats::NUM_STAGES ?
+                PipelineStats::getStageName(PipelineStats::Stage(i)) : "unknown stage";
+        const uint64_t count = reader.readHistogram(numBuckets, print ? name : nullptr);
+        if (outStageCounts && i < PipelineStats::NUM_STAGES) {
+            outStageCounts[i] = count;
+        }
+    }
+    for (uint32_t i = 0; i < numSensors; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "sensor 0x%08x", reader.read<int32_t>());
+        reader.read<uint32_t>();
+        reader.readHistogram(numBuckets, print ? name : nullptr);
+    }
+    for (uint32_t i = 0; i < numConnections; i++) {
+        ConnectionStats connection;
+        connection.uid = reader.read<uint32_t>();
+        reader.read<uint32_t>();
+        connection.cachedCount = reader.read<uint64_t>();
+        connection.droppedCount = reader.read<uint64_t>();
+        char name[32];
+        snprintf(name, sizeof(name), "uid %u", connection.uid);
+        if (print) {
+            printf("%s: cached %" PRIu64 " | dropped %" PRIu64 "\n", name,
+                    connection.cachedCount, connection.droppedCount);
+        }
+        reader.readHistogram(numBuckets, print ? name : nullptr);
+        if (outConnections) {
+            outConnections->push_back(connection);
+        }
+    }
+    if (reader.hasError() || !reader.atEnd()) {
+        printf("FAIL: truncated or trailing data\n");
+        return false;
+    }
+    return true;
+}
+
+static bool checkHistogram()
+{
+    LatencyHistogram h;
+    // 90 fast deliveries around 300us, 9 around 3ms and one of 50ms.
+    for (int i = 0; i < 90; i++) {
+        h.add(us2ns(300));
+    }
+    for (int i = 0; i < 9; i++) {
+        h.add(ms2ns(3));
+    }
+    h.add(ms2ns(50));
+    h.add(-5);
+
+    bool ok = true;
+    // 300us is in [256us, 512us), 3ms in [2048us, 4096us).
+    ok &= h.count() == 101;
+    ok &= h.percentile(50) == us2ns(512);
+    ok &= h.percentile(90) == us2ns(512);
+    ok &= h.percentile(99) == us2ns(4096);
+    ok &= h.percentile(100) == ms2ns(50);
+    ok &= h.max() == ms2ns(50);
+    if (!ok) {
+        printf("FAIL: histogram %s\n", h.dump().c_str());
+        return false;
+    }
+
+    LatencyHistogram slow;
+    slow.add(s2ns(100));
+    if (slow.percentile(50) != s2ns(100)) {
+        printf("FAIL: the last bucket should report the max, %s\n", slow.dump().c_str());
+        return false;
+    }
+    printf("histogram %s: OK\n", h.dump().c_str());
+    return true;
+}
+
+static void makeEvents(sensors_event_t* events, size_t count, nsecs_t now)
+{
+    memset(events, 0, count * sizeof(*events));
+    for (size_t i = 0; i < count; i++) {
+        events[i].version = sizeof(sensors_event_t);
+        events[i].sensor = i < count / 2 ? 1 : 2;
+        events[i].type = SENSOR_TYPE_ACCELEROMETER;
+        events[i].timestamp = now - ms2ns(1) - i * us2ns(100);
+    }
+    events[count - 1].type = SENSOR_TYPE_META_DATA;
+    events[count - 1].sensor = 0;
+    events[count - 1].meta_data.sensor = 2;
+    events[count - 1].meta_data.what = META_DATA_FLUSH_COMPLETE;
+}
+
+static bool checkSerialization()
+{
+    PipelineStats stats;
+    stats.setEnabled(true);
+    const nsecs_t now = systemTime();
+    sensors_event_t events[16];
+    makeEvents(events, 16, now);
+    for (int poll = 0; poll < 10; poll++) {
+        stats.addStage(PipelineStats::STAGE_POLL, ms2ns(5));
+        stats.addStage(PipelineStats::STAGE_FAN_OUT, us2ns(20));
+        stats.addEventAges(events, 16, now);
+        stats.countPoll();
+    }
+
+    std::vector<ConnectionStats> connections(2);
+    connections[0].uid = 1000;
+    connections[0].cachedCount = 12;
+    connections[0].droppedCount = 3;
+    connections[0].age.add(ms2ns(2));
+    connections[1].uid = 10042;
+    connections[1].cachedCount = 0;
+    connections[1].droppedCount = 0;
+
+    std::vector<uint8_t> data;
+    stats.serialize(connections, &data);
+    if (data.size() % 8 != 0) {
+        printf("FAIL: %zu bytes, not a multiple of 8\n", data.size());
+        return false;
+    }
+
+    uint64_t stageCounts[PipelineStats::NUM_STAGES];
+    std::vector<ConnectionStats> decoded;
+    if (!decode(data, false, stageCounts, &decoded)) {
+        return false;
+    }
+    if (stageCounts[PipelineStats::STAGE_POLL] != 10
+            || stageCounts[PipelineStats::STAGE_FUSION] != 0
+            || stageCounts[PipelineStats::STAGE_FAN_OUT] != 10) {
+        printf("FAIL: stage counts don't match\n");
+        return false;
+    }
+    if (decoded.size() != 2 || decoded[0].uid != 1000 || decoded[0].cachedCount != 12
+            || decoded[0].droppedCount != 3 || decoded[1].uid != 10042) {
+        printf("FAIL: connections don't match\n");
+        return false;
+    }
+    // The flush complete event isn't counted, the other events are split between 2 sensors.
+    const KeyedVector<int, LatencyHistogram>& ages = stats.getEventAges();
+    if (ages.size() != 2 || ages.valueFor(1).count() != 80 || ages.valueFor(2).count() != 70) {
+        printf("FAIL: event ages by sensor don't match\n");
+        return false;
+    }
+    printf("binary statistics, %zu bytes: OK\n", data.size());
+    decode(data, true, nullptr, nullptr);
+    return true;
+}
+
+static void measureOverhead()
+{
+    const size_t count = 64;
+    const int polls = 200000;
+    sensors_event_t events[count];
+    const nsecs_t now = systemTime();
+    makeEvents(events, count, now);
+
+    PipelineStats stats;
+    volatile size_t sink = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_THREAD);
+    for (int i = 0; i < polls; i++) {
+        // What threadLoop does per poll while the statistics are off.
+        if (stats.isEnabled()) {
+            stats.addEventAges(events, count, now);
+        }
+        sink = sink + i;
+    }
+    const nsecs_t off = systemTime(SYSTEM_TIME_THREAD) - start;
+
+    stats.setEnabled(true);
+    start = systemTime(SYSTEM_TIME_THREAD);
+    for (int i = 0; i < polls; i++) {
+        nsecs_t stageStart = systemTime();
+        stageStart = stats.endStage(PipelineStats::STAGE_VIRTUAL_SENSORS, stageStart);
+        stats.endStage(PipelineStats::STAGE_SORT, stageStart);
+        stats.addEventAges(events, count, now);
+        stats.countPoll();
+    }
+    const nsecs_t on = systemTime(SYSTEM_TIME_THREAD) - start;
+
+    printf("recording cost: off %.1fns per poll, on %.1fns per poll of %zu events "
+            "(%.1fns per event)\n", double(off) / polls, double(on) / polls, count,
+            double(on) / polls / count);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) {
+        FILE* f = fopen(argv[1], "rb");
+        if (!f) {
+            printf("could not open %s\n", argv[1]);
+            return 1;
+        }
+        std::vector<uint8_t> data;
+        uint8_t buffer[4096];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+            data.insert(data.end(), buffer, buffer + n);
+        }
+        fclose(f);
+        return decode(data, true, nullptr, nullptr) ? 0 : 1;
+    }
+
+    if (!checkHistogram() || !checkSerialization()) {
+        return 1;
+    }
+    measureOverhead();
+    return 0;
+}
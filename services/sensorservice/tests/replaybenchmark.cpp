@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Drives SensorService end to end with a replayed load.
+ *
+ * Runs a SensorService in this process on top of ReplaySensorHal, so that neither the sensor
+ * hardware nor the system SensorService is involved, and opens connections which listen to the
+ * replayed sensors, every fourth one also to the rotation vector to keep the fusion busy. Reports
+ * the events delivered per second, the CPU time per event of the whole process and of threadLoop,
+ * the latency from the time an event is played to its delivery, and the pipeline statistics of
+ * the service. Needs to run as root.
+ *
+ * Usage: benchmark-sensorservice-replay [connections] [seconds] [synthetic|trace [speed]]
+ */
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <android/sensor.h>
+#include <binder/IBinder.h>
+#include <gui/Sensor.h>
+#include <gui/SensorEventQueue.h>
+#include <hardware/sensors.h>
+#include <utils/Looper.h>
+#include <utils/String8.h>
+#include <utils/SystemClock.h>
+#include <utils/Vector.h>
+
+#include "PipelineStats.h"
+#include "ReplaySensorHal.h"
+#include "SensorService.h"
+
+using namespace android;
+using namespace android::SensorServiceUtil;
+
+static uint64_t sReceivedEvents = 0;
+static LatencyHistogram sLatency;
+
+static int receiver(__unused int fd, __unused int events, void* data)
+{
+    SensorEventQueue* q = static_cast<SensorEventQueue*>(data);
+    ASensorEvent buffer[64];
+    ssize_t n;
+    while ((n = q->read(buffer, 64)) > 0) {
+        // Replayed events are timestamped with the time they are played.
+        const nsecs_t now = elapsedRealtimeNano();
+        for (ssize_t i = 0; i < n; i++) {
+            if (buffer[i].type != ASENSOR_TYPE_META_DATA) {
+                sLatency.add(now - buffer[i].timestamp);
+                sReceivedEvents++;
+            }
+        }
+    }
+    return 1;
+}
+
+static String8 dump(const sp<IBinder>& service, const char* arg0 = nullptr,
+        const char* arg1 = nullptr)
+{
+    Vector<String16> args;
+    if (arg0) {
+        args.add(String16(arg0));
+    }
+    if (arg1) {
+        args.add(String16(arg1));
+    }
+    String8 result;
+    FILE* f = tmpfile();
+    if (!f) {
+        return result;
+    }
+    service->dump(fileno(f), args);
+    rewind(f);
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        result.append(buffer, n);
+    }
+    fclose(f);
+    return result;
+}
+
+static bool readFanOutStats(const sp<IBinder>& service, uint64_t* outPolls,
+        uint64_t* outRoutedEvents, double* outCpuTimeUs)
+{
+    String8 result(dump(service));
+    const char* line = strstr(result.string(), "Event fan-out:");
+    double cpuPerPollUs;
+    if (!line || sscanf(line, "Event fan-out: %" SCNu64 " polls | %" SCNu64 " events routed | "
+            "threadLoop cpu %lfus per poll", outPolls, outRoutedEvents, &cpuPerPollUs) != 3) {
+        return false;
+    }
+    *outCpuTimeUs = cpuPerPollUs * *outPolls;
+    return true;
+}
+
+static void printPipelineStats(const sp<IBinder>& service)
+{
+    String8 result(dump(service));
+    const char* start = strstr(result.string(), "Pipeline latency:");
+    if (!start) {
+        return;
+    }
+    const char* end = strstr(start, "active connections");
+    // Back up to the start of the line after the statistics.
+    while (end && end > start && end[-1] != '\n') {
+        end--;
+    }
+    fwrite(start, 1, end ? size_t(end - start) : strlen(start), stdout);
+}
+
+static bool isReplayed(const Sensor& sensor)
+{
+    switch (sensor.getType()) {
+        case SENSOR_TYPE_ACCELEROMETER:
+        case SENSOR_TYPE_GYROSCOPE:
+        case SENSOR_TYPE_MAGNETIC_FIELD:
+        case SENSOR_TYPE_PRESSURE:
+        case SENSOR_TYPE_LIGHT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t numConnections = argc > 1 ? atoi(argv[1]) : 20;
+    const int seconds = argc > 2 ? atoi(argv[2]) : 10;
+    const char* source = argc > 3 ? argv[3] : "synthetic";
+    const float speed = argc > 4 ? atof(argv[4]) : 1.0f;
+
+    signal(SIGPIPE, SIG_IGN);
+    ReplaySensorHal::configure(source, speed);
+    sp<SensorService> service = new SensorService();
+    sp<ISensorServer> server(service);
+    sp<IBinder> binder(IInterface::asBinder(server));
+
+    const String16 opPackageName("Sensor Service Replay Benchmark");
+    Vector<Sensor> sensors = server->getSensorList(opPackageName);
+    Vector<Sensor> replayed;
+    const Sensor* rotationVector = nullptr;
+    for (size_t i = 0; i < sensors.size(); i++) {
+        if (isReplayed(sensors[i])) {
+            replayed.add(sensors[i]);
+        } else if (sensors[i].getType() == SENSOR_TYPE_ROTATION_VECTOR) {
+            rotationVector = &sensors[i];
+        }
+    }
+    if (replayed.isEmpty()) {
+        printf("nothing to replay from %s\n", source);
+        return 1;
+    }
+
+    sp<Looper> loop = new Looper(false);
+    Vector< sp<SensorEventQueue> > queues;
+    for (size_t i = 0; i < numConnections; i++) {
+        sp<ISensorEventConnection> connection = server->createSensorEventConnection(
+                String8("Sensor Service Replay Benchmark"), 0 /* NORMAL */, opPackageName);
+        if (connection == NULL) {
+            printf("could not create connection %zu\n", i);
+            return 1;
+        }
+        sp<SensorEventQueue> q = new SensorEventQueue(connection);
+        const Sensor& sensor = replayed[i % replayed.size()];
+        const int32_t periodUs = sensor.getMinDelay() > 0 ? sensor.getMinDelay() * 5 : 20000;
+        q->enableSensor(sensor.getHandle(), periodUs, 0, 0);
+        if (rotationVector && i % 4 == 0) {
+            q->enableSensor(rotationVector->getHandle(), 10000, 0, 0);
+        }
+        loop->addFd(q->getFd(), 0, ALOOPER_EVENT_INPUT, receiver, q.get());
+        queues.add(q);
+    }
+    printf("replay=%s speed=%.2f connections=%zu sensors=%zu fusion=%s duration=%ds\n", source,
+            speed, numConnections, replayed.size(), rotationVector ? "yes" : "no", seconds);
+
+    // Let the sensors settle before measuring.
+    nsecs_t settleTime = systemTime() + s2ns(1);
+    while (systemTime() < settleTime) {
+        loop->pollOnce(int(ns2ms(settleTime - systemTime())));
+    }
+
+    uint64_t pollsStart, pollsEnd, routedStart, routedEnd;
+    double threadLoopCpuStart, threadLoopCpuEnd;
+    dump(binder, "stats", "enable");
+    if (!readFanOutStats(binder, &pollsStart, &routedStart, &threadLoopCpuStart)) {
+        printf("could not read the fan-out statistics of sensorservice\n");
+        return 1;
+    }
+    sReceivedEvents = 0;
+    sLatency.reset();
+    const nsecs_t cpuStart = systemTime(SYSTEM_TIME_PROCESS);
+    const nsecs_t start = systemTime();
+    const nsecs_t endTime = start + s2ns(seconds);
+    while (systemTime() < endTime) {
+        loop->pollOnce(int(ns2ms(endTime - systemTime())));
+    }
+    const nsecs_t elapsed = systemTime() - start;
+    const nsecs_t cpuTime = systemTime(SYSTEM_TIME_PROCESS) - cpuStart;
+    if (!readFanOutStats(binder, &pollsEnd, &routedEnd, &threadLoopCpuEnd)) {
+        printf("could not read the fan-out statistics of sensorservice\n");
+        return 1;
+    }
+
+    const uint64_t routed = routedEnd - routedStart;
+    printf("delivered %.0f events/s | process cpu %.2fus per event | threadLoop cpu %.2fus per "
+            "routed event, %.2fus per poll\n",
+            sReceivedEvents / (elapsed / 1e9),
+            sReceivedEvents ? cpuTime / 1000.0 / sReceivedEvents : 0.0,
+            routed ? (threadLoopCpuEnd - threadLoopCpuStart) / routed : 0.0,
+            pollsEnd > pollsStart ?
+                    (threadLoopCpuEnd - threadLoopCpuStart) / (pollsEnd - pollsStart) : 0.0);
+    printf("delivery latency | %s\n", sLatency.dump().c_str());
+    printPipelineStats(binder);
+    dump(binder, "stats", "disable");
+
+    for (size_t i = 0; i < queues.size(); i++) {
+        loop->removeFd(queues[i]->getFd());
+    }
+    // threadLoop never returns, leave without tearing the service down.
+    fflush(stdout);
+    _exit(0);
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test of the wakelock hold of SensorService.
+ *
+ * Replays the deliveries of wake-up sensors at various rates through WakeLockPolicy, releasing
+ * the wakelock the way SensorService does once each delivery is acknowledged, and checks how many
+ * times the wakelock is acquired with and without the hold.
+ *
+ * Usage: test-sensorservice-wakelockpolicy
+ */
+
+#include <stdio.h>
+
+#include "WakeLockPolicy.h"
+
+using namespace android;
+using namespace android::SensorServiceUtil;
+
+// A wakelock driven by WakeLockPolicy, with simulated time.
+class SimulatedWakeLock {
+public:
+    SimulatedWakeLock(WakeLockPolicy& policy) : mPolicy(policy), mAcquired(false),
+            mReleaseTime(0) {}
+
+    // A delivery of handle at now, acknowledged ackDelay later.
+    void deliver(int handle, nsecs_t now, nsecs_t ackDelay) {
+        advance(now);
+        mPolicy.onDelivery(handle, now);
+        if (!mAcquired) {
+            mAcquired = true;
+            mPolicy.onAcquire(now);
+        } else if (mReleaseTime != 0) {
+            mPolicy.onReleaseSkipped();
+        }
+        mReleaseTime = 0;
+        // The ack comes in, release now or when the hold ends.
+        const nsecs_t ackTime = now + ackDelay;
+        mReleaseTime = mPolicy.getHoldUntil() > ackTime ? mPolicy.getHoldUntil() : ackTime;
+    }
+
+    // Release the wakelock if its hold ended by now.
+    void advance(nsecs_t now) {
+        if (mAcquired && mReleaseTime != 0 && mReleaseTime <= now) {
+            mAcquired = false;
+            mPolicy.onRelease(mReleaseTime);
+            mReleaseTime = 0;
+        }
+    }
+
+private:
+    WakeLockPolicy& mPolicy;
+    bool mAcquired;
+    nsecs_t mReleaseTime;
+};
+
+// Delivers count events of a sensor every period and returns the number of acquisitions.
+static uint64_t run(WakeLockPolicy& policy, int handle, nsecs_t period, int count,
+        nsecs_t* outEnd = nullptr)
+{
+    SimulatedWakeLock wakeLock(policy);
+    const nsecs_t start = systemTime();
+    for (int i = 0; i < count; i++) {
+        // Deliveries jitter by up to 10%.
+        const nsecs_t jitter = (i % 3) * period / 20;
+        wakeLock.deliver(handle, start + i * period + jitter, us2ns(500));
+    }
+    const nsecs_t end = start + count * period + s2ns(1);
+    wakeLock.advance(end);
+    if (outEnd) {
+        *outEnd = end;
+    }
+    return policy.getAcquireCount();
+}
+
+static bool check(const char* name, uint64_t acquisitions, uint64_t min, uint64_t max)
+{
+    if (acquisitions < min || acquisitions > max) {
+        printf("FAIL: %s: %llu acquisitions, expected %llu to %llu\n", name,
+                (unsigned long long) acquisitions, (unsigned long long) min,
+                (unsigned long long) max);
+        return false;
+    }
+    printf("%s: %llu acquisitions: OK\n", name, (unsigned long long) acquisitions);
+    return true;
+}
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    bool ok = true;
+    {
+        // 50Hz: held from the second delivery on.
+        WakeLockPolicy policy;
+        nsecs_t end;
+        ok &= check("50Hz, auto", run(policy, 1, ms2ns(20), 500, &end), 1, 2);
+        printf("\t%s\n\t%s\n", policy.dump(end).c_str(), policy.dumpSensor(0).c_str());
+    }
+    {
+        // 5Hz is slower than the longest automatic hold, every delivery acquires.
+        WakeLockPolicy policy;
+        ok &= check("5Hz, auto", run(policy, 1, ms2ns(200), 100), 100, 100);
+    }
+    {
+        WakeLockPolicy policy;
+        policy.setHold(1, ms2ns(250));
+        ok &= check("5Hz, 250ms hold", run(policy, 1, ms2ns(200), 100), 1, 1);
+    }
+    {
+        WakeLockPolicy policy;
+        policy.setHold(1, 0);
+        ok &= check("50Hz, no hold", run(policy, 1, ms2ns(20), 500), 500, 500);
+    }
+    {
+        // A batched sensor flushing 50 events at once every second: all of a delivery counts once
+        // and the hold doesn't bridge the seconds between them.
+        WakeLockPolicy policy;
+        SimulatedWakeLock wakeLock(policy);
+        const nsecs_t start = systemTime();
+        for (int i = 0; i < 10; i++) {
+            const nsecs_t now = start + s2ns(i);
+            for (int event = 0; event < 50; event++) {
+                policy.onDelivery(2, now);
+            }
+            wakeLock.deliver(2, now, us2ns(500));
+        }
+        const nsecs_t end = start + s2ns(20);
+        wakeLock.advance(end);
+        ok &= check("batched, auto", policy.getAcquireCount(), 10, 10);
+        if (policy.getHeldTime(end) > ms2ns(10)) {
+            printf("FAIL: batched sensor held the wakelock for %.1fms\n",
+                    policy.getHeldTime(end) / 1e6);
+            ok = false;
+        }
+    }
+    if (!ok) {
+        return 1;
+    }
+    return 0;
+}
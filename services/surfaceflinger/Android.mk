@@ -6,6 +6,7 @@ LOCAL_CLANG := true
 LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
 LOCAL_SRC_FILES := \
     Client.cpp \
+    CompositionCostTracker.cpp \
     DisplayDevice.cpp \
     DispSync.cpp \
     EventControlThread.cpp \
@@ -13,11 +14,13 @@ LOCAL_SRC_FILES := \
     FenceTracker.cpp \
     FrameTracker.cpp \
     GpuService.cpp \
+    LatencyHistogram.cpp \
     Layer.cpp \
     LayerDim.cpp \
     LayerBlur.cpp \
     MessageQueue.cpp \
     MonitoredProducer.cpp \
+    PhaseOffsetController.cpp \
     SurfaceFlingerConsumer.cpp \
     Transform.cpp \
     DisplayHardware/FramebufferSurface.cpp \
@@ -0,0 +1,135 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+
+#include <gui/LayerCompositionStats.h>
+
+#include <utils/String8.h>
+
+#include "CompositionCostTracker.h"
+#include "RenderEngine/RenderEngine.h"
+
+namespace android {
+
+CompositionCostTracker::CompositionCostTracker() :
+        mOffset(0),
+        mNumPendingTimers(0) {
+}
+
+void CompositionCostTracker::addSample(nsecs_t cpuTime, uint32_t gpuTimer,
+        uint64_t pixels, bool textureUpload) {
+    Mutex::Autolock lock(mMutex);
+    SampleRecord& record(mSampleRecords[mOffset]);
+    if (record.gpuTimer != RenderEngine::NO_GPU_TIMER) {
+        // We're clobbering a sample whose GPU time never arrived.
+        mNumPendingTimers--;
+    }
+    record.cpuTime = cpuTime;
+    record.gpuTime = -1;
+    record.gpuTimer = gpuTimer;
+    record.pixels = pixels;
+    record.textureUpload = textureUpload;
+    record.valid = true;
+    if (gpuTimer != RenderEngine::NO_GPU_TIMER) {
+        mNumPendingTimers++;
+    }
+    mOffset = (mOffset + 1) % NUM_SAMPLE_RECORDS;
+}
+
+void CompositionCostTracker::processGpuTimers(RenderEngine& engine) {
+    Mutex::Autolock lock(mMutex);
+    for (size_t i = 1; i <= NUM_SAMPLE_RECORDS && mNumPendingTimers > 0; i++) {
+        SampleRecord& record(mSampleRecords[
+                (mOffset + NUM_SAMPLE_RECORDS - i) % NUM_SAMPLE_RECORDS]);
+        if (record.gpuTimer == RenderEngine::NO_GPU_TIMER) {
+            continue;
+        }
+        nsecs_t elapsed = 0;
+        status_t err = engine.getGpuTimerResult(record.gpuTimer, &elapsed);
+        if (err == WOULD_BLOCK) {
+            continue;
+        }
+        record.gpuTime = (err == NO_ERROR) ? elapsed : -1;
+        record.gpuTimer = RenderEngine::NO_GPU_TIMER;
+        mNumPendingTimers--;
+    }
+}
+
+void CompositionCostTracker::clearStats() {
+    Mutex::Autolock lock(mMutex);
+    for (size_t i = 0; i < NUM_SAMPLE_RECORDS; i++) {
+        mSampleRecords[i] = SampleRecord();
+    }
+    mNumPendingTimers = 0;
+}
+
+void CompositionCostTracker::getStats(LayerCompositionStats* outStats) const {
+    Mutex::Autolock lock(mMutex);
+    getStatsLocked(outStats);
+}
+
+void CompositionCostTracker::getStatsLocked(
+        LayerCompositionStats* outStats) const {
+    for (size_t i = 0; i < NUM_SAMPLE_RECORDS; i++) {
+        const SampleRecord& record(mSampleRecords[i]);
+        if (!record.valid) {
+            continue;
+        }
+        outStats->numFrames++;
+        outStats->totalCpuTime += record.cpuTime;
+        if (record.cpuTime > outStats->maxCpuTime) {
+            outStats->maxCpuTime = record.cpuTime;
+        }
+        if (record.gpuTime >= 0) {
+            outStats->numGpuSamples++;
+            outStats->totalGpuTime += record.gpuTime;
+            if (record.gpuTime > outStats->maxGpuTime) {
+                outStats->maxGpuTime = record.gpuTime;
+            }
+        }
+        outStats->totalPixels += record.pixels;
+        if (record.textureUpload) {
+            outStats->numTextureUploads++;
+        }
+    }
+}
+
+void CompositionCostTracker::dumpStats(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    LayerCompositionStats stats;
+    getStatsLocked(&stats);
+
+    if (stats.numFrames == 0) {
+        result.append("frames=0\n");
+        return;
+    }
+    result.appendFormat("frames=%u cpu(avg/max)=%" PRId64 "/%" PRId64 "us",
+            stats.numFrames,
+            ns2us(stats.totalCpuTime / stats.numFrames),
+            ns2us(stats.maxCpuTime));
+    if (stats.numGpuSamples > 0) {
+        result.appendFormat(" gpu(avg/max)=%" PRId64 "/%" PRId64 "us",
+                ns2us(stats.totalGpuTime / stats.numGpuSamples),
+                ns2us(stats.maxGpuTime));
+    } else {
+        result.append(" gpu=n/a");
+    }
+    result.appendFormat(" pixels/frame=%" PRIu64 " uploads=%u\n",
+            stats.totalPixels / stats.numFrames, stats.numTextureUploads);
+}
+
+} // namespace android
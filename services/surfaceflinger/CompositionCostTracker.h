@@ -0,0 +1,102 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_COMPOSITIONCOSTTRACKER_H
+#define ANDROID_COMPOSITIONCOSTTRACKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Mutex.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class String8;
+class RenderEngine;
+struct LayerCompositionStats;
+
+// CompositionCostTracker records how expensive it was to draw a layer with
+// the GPU over the most recent composition passes. It uses a circular buffer
+// of sample records so the statistics always cover a sliding window.
+//
+// GPU times are measured asynchronously with RenderEngine GPU timers; a
+// sample's GPU time is filled in by processGpuTimers once the GPU has caught
+// up, which must happen on the thread owning the GL context.
+class CompositionCostTracker {
+
+public:
+    // NUM_SAMPLE_RECORDS is the size of the circular buffer, i.e. the number
+    // of composition passes covered by the statistics.
+    enum { NUM_SAMPLE_RECORDS = 128 };
+
+    CompositionCostTracker();
+
+    // addSample records one composition pass of the layer. gpuTimer may be
+    // RenderEngine::NO_GPU_TIMER if GPU timing was not requested.
+    void addSample(nsecs_t cpuTime, uint32_t gpuTimer, uint64_t pixels,
+            bool textureUpload);
+
+    // processGpuTimers collects the results of the GPU timers that have
+    // completed since the last call. It never blocks.
+    void processGpuTimers(RenderEngine& engine);
+
+    // clearStats clears the tracked samples.
+    void clearStats();
+
+    // getStats aggregates the tracked samples.
+    void getStats(LayerCompositionStats* outStats) const;
+
+    // dumpStats appends a one-line summary of the tracked samples.
+    void dumpStats(String8& result) const;
+
+private:
+    struct SampleRecord {
+        SampleRecord() :
+            cpuTime(0),
+            gpuTime(-1),
+            gpuTimer(0),
+            pixels(0),
+            textureUpload(false),
+            valid(false) {}
+        nsecs_t cpuTime;
+        // -1 until the GPU timer result is known, or if it was lost
+        nsecs_t gpuTime;
+        uint32_t gpuTimer;
+        uint64_t pixels;
+        bool textureUpload;
+        bool valid;
+    };
+
+    void getStatsLocked(LayerCompositionStats* outStats) const;
+
+    SampleRecord mSampleRecords[NUM_SAMPLE_RECORDS];
+
+    // mOffset is the offset into mSampleRecords of the next sample.
+    size_t mOffset;
+
+    // mNumPendingTimers is the number of samples still waiting for a GPU
+    // timer result, so that processGpuTimers is free when timing is off.
+    size_t mNumPendingTimers;
+
+    // mMutex is used to protect access to all member variables, since the
+    // statistics are read from binder threads.
+    mutable Mutex mMutex;
+};
+
+}
+
+#endif // ANDROID_COMPOSITIONCOSTTRACKER_H
@@ -22,11 +22,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <inttypes.h>
 
 #include <cutils/properties.h>
 
 #include <utils/RefBase.h>
 #include <utils/Log.h>
+#include <utils/Vector.h>
 
 #include <ui/DisplayInfo.h>
 #include <ui/PixelFormat.h>
@@ -69,6 +71,7 @@ inline void eglSetSwapRectangleANDROID (EGLDisplay, EGLSurface, EGLint, EGLint,
  */
 
 uint32_t DisplayDevice::sPrimaryDisplayOrientation = 0;
+std::atomic<uint32_t> DisplayDevice::sNextProjectionGeneration(1);
 
 DisplayDevice::DisplayDevice(
         const sp<SurfaceFlinger>& flinger,
@@ -97,9 +100,14 @@ DisplayDevice::DisplayDevice(
 #endif
       mFlags(),
       mPageFlipCount(),
+      mComposingPartially(false),
+      mLastComposedPixels(0),
+      mTotalComposedPixels(0),
+      mNumComposedFrames(0),
       mIsSecure(isSecure),
       mLayerStack(NO_LAYER_STACK),
       mOrientation(),
+      mProjectionGeneration(sNextProjectionGeneration++),
       mPowerMode(HWC_POWER_MODE_OFF),
       mActiveConfig(0)
 {
@@ -145,6 +153,17 @@ DisplayDevice::DisplayDevice(
     mViewport.makeInvalid();
     mFrame.makeInvalid();
 
+    // Partial GLES composition needs to know how old the back buffer is and
+    // to tell the consumer what changed. Virtual displays are left out since
+    // their output buffers may be swapped with HWC's behind our back.
+    const char* const eglExtensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (mType < DisplayDevice::DISPLAY_VIRTUAL && eglExtensions &&
+            strstr(eglExtensions, "EGL_EXT_buffer_age") &&
+            strstr(eglExtensions, "EGL_KHR_swap_buffers_with_damage")) {
+        mFlags |= SWAP_WITH_DAMAGE;
+    }
+    mFrameDamage.set(getBounds());
+
     // virtual displays are always considered enabled
     mPowerMode = (mType >= DisplayDevice::DISPLAY_VIRTUAL) ?
                   HWC_POWER_MODE_NORMAL : HWC_POWER_MODE_OFF;
@@ -302,6 +321,65 @@ status_t DisplayDevice::prepareFrame(const HWComposer& hwc) const {
 }
 #endif
 
+Region DisplayDevice::getRepaintRegion() const {
+    EGLint age = 0;
+    if (!eglQuerySurface(mDisplay, mSurface, EGL_BUFFER_AGE_EXT, &age) ||
+            age <= 0 || size_t(age - 1) > mDamageHistory.size()) {
+        // the contents of the buffer are undefined or too old
+        return Region(getBounds());
+    }
+    Region repaint(mFrameDamage);
+    for (EGLint i = 0; i < age - 1; i++) {
+        repaint.orSelf(mDamageHistory[i]);
+    }
+    return repaint.intersect(getBounds());
+}
+
+void DisplayDevice::setFrameDamage(const Region& frameDamage) const {
+    mFrameDamage = frameDamage.intersect(getBounds());
+    mComposingPartially = true;
+}
+
+void DisplayDevice::resetFrameDamage() const {
+    mFrameDamage.set(getBounds());
+    mComposingPartially = false;
+}
+
+void DisplayDevice::recordComposedRegion(const Region& composed) const {
+    uint64_t pixels = 0;
+    size_t count;
+    Rect const* r = composed.getArray(&count);
+    for (size_t i=0 ; i<count ; i++, r++) {
+        pixels += uint64_t(r->getWidth()) * uint64_t(r->getHeight());
+    }
+    mLastComposedPixels = pixels;
+    mTotalComposedPixels += pixels;
+    mNumComposedFrames++;
+}
+
+EGLBoolean DisplayDevice::swapBuffersWithDamage() const {
+    // EGL damage rectangles have their origin at the bottom-left
+    size_t count;
+    Rect const* r = mFrameDamage.getArray(&count);
+    Vector<EGLint> rects;
+    rects.setCapacity(count * 4);
+    for (size_t i=0 ; i<count ; i++, r++) {
+        rects.add(r->left);
+        rects.add(mDisplayHeight - r->bottom);
+        rects.add(r->getWidth());
+        rects.add(r->getHeight());
+    }
+    EGLBoolean success = eglSwapBuffersWithDamageKHR(mDisplay, mSurface,
+            rects.editArray(), EGLint(count));
+
+    mDamageHistory.push_front(mFrameDamage);
+    if (mDamageHistory.size() > MAX_DAMAGE_HISTORY) {
+        mDamageHistory.pop_back();
+    }
+    resetFrameDamage();
+    return success;
+}
+
 void DisplayDevice::swapBuffers(HWComposer& hwc) const {
 #ifdef USE_HWC2
     if (hwc.hasClientComposition(mHwcDisplayId)) {
@@ -316,7 +394,8 @@ void DisplayDevice::swapBuffers(HWComposer& hwc) const {
             (hwc.hasGlesComposition(mHwcDisplayId) &&
              (hwc.supportsFramebufferTarget() || mType >= DISPLAY_VIRTUAL))) {
 #endif
-        EGLBoolean success = eglSwapBuffers(mDisplay, mSurface);
+        EGLBoolean success = (mFlags & SWAP_WITH_DAMAGE) ?
+                swapBuffersWithDamage() : eglSwapBuffers(mDisplay, mSurface);
         if (!success) {
             EGLint error = eglGetError();
             if (error == EGL_CONTEXT_LOST ||
@@ -513,6 +592,10 @@ void DisplayDevice::setDisplaySize(const int newWidth, const int newHeight) {
     eglQuerySurface(mDisplay, mSurface, EGL_WIDTH,  &mDisplayWidth);
     eglQuerySurface(mDisplay, mSurface, EGL_HEIGHT, &mDisplayHeight);
 
+    mDamageHistory.clear();
+    resetFrameDamage();
+    mProjectionGeneration = sNextProjectionGeneration++;
+
     LOG_FATAL_IF(mDisplayWidth != newWidth,
                 "Unable to set new width to %d", newWidth);
     LOG_FATAL_IF(mDisplayHeight != newHeight,
@@ -586,6 +669,7 @@ void DisplayDevice::setProjection(int orientation,
     if (mScissor.isEmpty()) {
         mScissor = getBounds();
     }
+    mProjectionGeneration = sNextProjectionGeneration++;
 
     mOrientation = orientation;
     if (mType == DisplayType::DISPLAY_PRIMARY) {
@@ -634,6 +718,12 @@ void DisplayDevice::dump(String8& result) const {
         tr[0][1], tr[1][1], tr[2][1],
         tr[0][2], tr[1][2], tr[2][2]);
 
+    result.appendFormat("   partial composition=%s, composed pixels: last=%" PRIu64
+            ", avg=%" PRIu64 " over %" PRIu64 " frames\n",
+            (mFlags & SWAP_WITH_DAMAGE) ? "on" : "off", mLastComposedPixels,
+            mNumComposedFrames ? mTotalComposedPixels / mNumComposedFrames : 0,
+            mNumComposedFrames);
+
     String8 surfaceDump;
     mDisplaySurface->dumpAsString(surfaceDump);
     result.append(surfaceDump);
@@ -39,6 +39,9 @@
 
 #include <hardware/hwcomposer_defs.h>
 
+#include <atomic>
+#include <deque>
+
 #ifdef USE_HWC2
 #include <memory>
 #endif
@@ -77,6 +80,7 @@ public:
     enum {
         PARTIAL_UPDATES = 0x00020000, // video driver feature
         SWAP_RECTANGLE  = 0x00080000,
+        SWAP_WITH_DAMAGE = 0x00100000, // EGL buffer age + swap with damage
     };
 
     enum {
@@ -135,6 +139,9 @@ public:
     const Rect              getFrame() const { return mFrame; }
     const Rect&             getScissor() const { return mScissor; }
     bool                    needsFiltering() const { return mNeedsFiltering; }
+    // Changes, across all displays, every time the size or projection of a
+    // display changes. Lets layers know when they can reuse their geometry.
+    uint32_t                getProjectionGeneration() const { return mProjectionGeneration; }
 
     uint32_t                getLayerStack() const { return mLayerStack; }
     int32_t                 getDisplayType() const { return mType; }
@@ -159,6 +166,22 @@ public:
     status_t compositionComplete() const;
 #endif
 
+    // Sets the damage reported by the next swapBuffers(), and marks the
+    // frame as partially recomposed. Both are reset after each swap, or by
+    // resetFrameDamage() for a frame that is redrawn as a whole.
+    void setFrameDamage(const Region& frameDamage) const;
+    void resetFrameDamage() const;
+    bool isComposingPartially() const { return mComposingPartially; }
+
+    // With SWAP_WITH_DAMAGE, returns the region that must be redrawn into
+    // the current back buffer: the damage of every frame since that buffer
+    // was last drawn is added to this frame's, based on its age. The
+    // display's surface must be current.
+    Region getRepaintRegion() const;
+
+    // Accounts the pixels recomposed with GLES for this frame
+    void recordComposedRegion(const Region& composed) const;
+
     // called after h/w composer has completed its set() call
 #ifdef USE_HWC2
     void onSwapBuffersCompleted() const;
@@ -229,6 +252,19 @@ private:
 #endif
     uint32_t        mFlags;
     mutable uint32_t mPageFlipCount;
+
+    // SWAP_WITH_DAMAGE bookkeeping: the damage passed to the next swap, and
+    // the damage of the previously swapped frames, most recent first
+    enum { MAX_DAMAGE_HISTORY = 4 };
+    mutable Region mFrameDamage;
+    mutable bool mComposingPartially;
+    mutable std::deque<Region> mDamageHistory;
+
+    // pixels recomposed with GLES, for dumpsys
+    mutable uint64_t mLastComposedPixels;
+    mutable uint64_t mTotalComposedPixels;
+    mutable uint64_t mNumComposedFrames;
+    EGLBoolean swapBuffersWithDamage() const;
     String8         mDisplayName;
     bool            mIsSecure;
 
@@ -257,6 +293,8 @@ private:
     Rect mScissor;
     Transform mGlobalTransform;
     bool mNeedsFiltering;
+    uint32_t mProjectionGeneration;
+    static std::atomic<uint32_t> sNextProjectionGeneration;
     // Current power mode
     int mPowerMode;
     // Current active config
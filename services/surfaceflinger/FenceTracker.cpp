@@ -119,7 +119,8 @@ void FenceTracker::checkFencesForCompletion() {
     }
 }
 
-void FenceTracker::addFrame(nsecs_t refreshStartTime, sp<Fence> retireFence,
+void FenceTracker::addFrame(nsecs_t refreshStartTime,
+        nsecs_t expectedPresentTime, sp<Fence> retireFence,
         const Vector<sp<Layer>>& layers, sp<Fence> glDoneFence) {
     ATRACE_CALL();
     Mutex::Autolock lock(mMutex);
@@ -176,6 +177,9 @@ void FenceTracker::addFrame(nsecs_t refreshStartTime, sp<Fence> retireFence,
 
     frame.frameId = mFrameCounter;
     frame.refreshStartTime = refreshStartTime;
+    frame.expectedPresentTime = expectedPresentTime;
+    frame.commitTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    frame.timingReported = false;
     frame.retireTime = 0;
     frame.glesCompositionDoneTime = 0;
     prevFrame.retireFence = retireFence;
@@ -187,6 +191,36 @@ void FenceTracker::addFrame(nsecs_t refreshStartTime, sp<Fence> retireFence,
     mFrameCounter++;
 }
 
+void FenceTracker::getPresentedFrames(std::vector<FrameTiming>* outFrames) {
+    Mutex::Autolock lock(mMutex);
+    checkFencesForCompletion();
+
+    // A frame's retire fence signals when the next one is presented, so the
+    // present time of a frame is the retire time of the frame before it.
+    for (size_t i = 1; i < MAX_FRAME_HISTORY; i++) {
+        FrameRecord& frame = mFrames[(mOffset + i) % MAX_FRAME_HISTORY];
+        const FrameRecord& prevFrame =
+                mFrames[(mOffset + i - 1) % MAX_FRAME_HISTORY];
+        if (frame.timingReported ||
+                prevFrame.frameId + 1 != frame.frameId ||
+                prevFrame.retireTime == 0 ||
+                frame.glesCompositionDoneFence != Fence::NO_FENCE) {
+            continue;
+        }
+
+        FrameTiming timing;
+        timing.refreshStartTime = frame.refreshStartTime;
+        timing.expectedPresentTime = frame.expectedPresentTime;
+        timing.compositionDoneTime = frame.commitTime;
+        if (frame.glesCompositionDoneTime > timing.compositionDoneTime) {
+            timing.compositionDoneTime = frame.glesCompositionDoneTime;
+        }
+        timing.presentTime = prevFrame.retireTime;
+        outFrames->push_back(timing);
+        frame.timingReported = true;
+    }
+}
+
 bool FenceTracker::getFrameTimestamps(const Layer& layer,
         uint64_t frameNumber, FrameTimestamps* outTimestamps) {
     Mutex::Autolock lock(mMutex);
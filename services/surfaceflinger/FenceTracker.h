@@ -25,6 +25,7 @@
 #include <utils/Vector.h>
 
 #include <unordered_map>
+#include <vector>
 
 namespace android {
 
@@ -38,11 +39,24 @@ class FenceTracker {
 public:
      FenceTracker();
      void dump(String8* outString);
-     void addFrame(nsecs_t refreshStartTime, sp<Fence> retireFence,
-             const Vector<sp<Layer>>& layers, sp<Fence> glDoneFence);
+     void addFrame(nsecs_t refreshStartTime, nsecs_t expectedPresentTime,
+             sp<Fence> retireFence, const Vector<sp<Layer>>& layers,
+             sp<Fence> glDoneFence);
      bool getFrameTimestamps(const Layer& layer, uint64_t frameNumber,
              FrameTimestamps* outTimestamps);
 
+     struct FrameTiming {
+         nsecs_t refreshStartTime;
+         nsecs_t expectedPresentTime;
+         // when composition was submitted to HWC, or GLES composition
+         // completed if later
+         nsecs_t compositionDoneTime;
+         nsecs_t presentTime;
+     };
+     // getPresentedFrames appends the timing of the frames presented since
+     // the last call, once all their fences have signaled.
+     void getPresentedFrames(std::vector<FrameTiming>* outFrames);
+
 protected:
      static constexpr size_t MAX_FRAME_HISTORY = 8;
 
@@ -77,6 +91,10 @@ protected:
          std::unordered_map<int32_t, LayerRecord> layers;
          // timestamp for when SurfaceFlinger::handleMessageRefresh() was called
          nsecs_t refreshStartTime;
+         // refresh the frame was composed for
+         nsecs_t expectedPresentTime;
+         // timestamp for when the frame was handed to HWC
+         nsecs_t commitTime;
          // timestamp from the retire fence
          nsecs_t retireTime;
          // timestamp from the GLES composition completion fence
@@ -85,11 +103,15 @@ protected:
          sp<Fence> retireFence;
          // if GLES composition was done, the fence for its completion
          sp<Fence> glesCompositionDoneFence;
+         // whether getPresentedFrames already returned this frame
+         bool timingReported;
 
          FrameRecord() : frameId(0), layers(), refreshStartTime(0),
+                 expectedPresentTime(0), commitTime(0),
                  retireTime(0), glesCompositionDoneTime(0),
                  retireFence(Fence::NO_FENCE),
-                 glesCompositionDoneFence(Fence::NO_FENCE) {}
+                 glesCompositionDoneFence(Fence::NO_FENCE),
+                 timingReported(true) {}
      };
 
      uint64_t mFrameCounter;
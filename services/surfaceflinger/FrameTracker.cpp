@@ -75,12 +75,14 @@ void FrameTracker::advanceFrame() {
 
     // Update the statistic to include the frame we just finished.
     updateStatsLocked(mOffset);
+    recordLatencyLocked(mOffset);
 
     // Advance to the next frame.
     mOffset = (mOffset+1) % NUM_FRAME_RECORDS;
     mFrameRecords[mOffset].desiredPresentTime = INT64_MAX;
     mFrameRecords[mOffset].frameReadyTime = INT64_MAX;
     mFrameRecords[mOffset].actualPresentTime = INT64_MAX;
+    mFrameRecords[mOffset].latencyRecorded = false;
 
     if (mFrameRecords[mOffset].frameReadyFence != NULL) {
         // We're clobbering an unsignaled fence, so we need to decrement the
@@ -109,8 +111,11 @@ void FrameTracker::clearStats() {
         mFrameRecords[i].actualPresentTime = 0;
         mFrameRecords[i].frameReadyFence.clear();
         mFrameRecords[i].actualPresentFence.clear();
+        mFrameRecords[i].latencyRecorded = false;
     }
     mNumFences = 0;
+    mLatency.presentLatency.clear();
+    mLatency.readyLatency.clear();
     mFrameRecords[mOffset].desiredPresentTime = INT64_MAX;
     mFrameRecords[mOffset].frameReadyTime = INT64_MAX;
     mFrameRecords[mOffset].actualPresentTime = INT64_MAX;
@@ -178,6 +183,7 @@ void FrameTracker::processFencesLocked() const {
 
         if (updated) {
             updateStatsLocked(idx);
+            recordLatencyLocked(idx);
         }
     }
 }
@@ -213,6 +219,34 @@ void FrameTracker::updateStatsLocked(size_t newFrameIdx) const {
     }
 }
 
+void FrameTracker::recordLatencyLocked(size_t idx) const {
+    FrameRecord& record = const_cast<FrameRecord&>(mFrameRecords[idx]);
+    if (record.latencyRecorded ||
+            record.frameReadyFence != NULL ||
+            record.actualPresentFence != NULL) {
+        return;
+    }
+
+    const nsecs_t desired = record.desiredPresentTime;
+    const nsecs_t ready = record.frameReadyTime;
+    const nsecs_t actual = record.actualPresentTime;
+    if (desired <= 0 || desired == INT64_MAX ||
+            ready <= 0 || ready == INT64_MAX ||
+            actual <= 0 || actual == INT64_MAX) {
+        return;
+    }
+
+    LatencyHistograms* histograms[] = {
+        const_cast<LatencyHistograms*>(&mLatency),
+        const_cast<LatencyHistograms*>(&mLifetimeLatency),
+    };
+    for (LatencyHistograms* h : histograms) {
+        h->presentLatency.addValue(actual - desired);
+        h->readyLatency.addValue(actual - ready);
+    }
+    record.latencyRecorded = true;
+}
+
 void FrameTracker::resetFrameCountersLocked() {
     for (int i = 0; i < NUM_FRAME_BUCKETS; i++) {
         mNumFrames[i] = 0;
@@ -248,4 +282,30 @@ void FrameTracker::dumpStats(String8& result) const {
     result.append("\n");
 }
 
+void FrameTracker::mergeLatencyHistograms(LatencyHistogram* outPresentLatency,
+        LatencyHistogram* outReadyLatency, bool sinceClear) const {
+    Mutex::Autolock lock(mMutex);
+    processFencesLocked();
+
+    const LatencyHistograms& h = sinceClear ? mLatency : mLifetimeLatency;
+    outPresentLatency->merge(h.presentLatency);
+    outReadyLatency->merge(h.readyLatency);
+}
+
+void FrameTracker::dumpLatencyHistograms(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    processFencesLocked();
+
+    result.append("    since clear:\n");
+    result.append("      desired-present to present: ");
+    mLatency.presentLatency.dump(result);
+    result.append("      ready to present: ");
+    mLatency.readyLatency.dump(result);
+    result.append("    lifetime:\n");
+    result.append("      desired-present to present: ");
+    mLifetimeLatency.presentLatency.dump(result);
+    result.append("      ready to present: ");
+    mLifetimeLatency.readyLatency.dump(result);
+}
+
 } // namespace android
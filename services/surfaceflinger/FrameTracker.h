@@ -23,6 +23,8 @@
 #include <utils/Timers.h>
 #include <utils/RefBase.h>
 
+#include "LatencyHistogram.h"
+
 namespace android {
 
 class String8;
@@ -36,6 +38,10 @@ class Fence;
 // Some of the time values tracked may be set either as a specific timestamp
 // or a fence.  When a non-NULL fence is set for a given time value, the
 // signal time of that fence is used instead of the timestamp.
+//
+// Besides the frame records, FrameTracker keeps latency histograms of every
+// frame it has seen, so that the latency distribution isn't limited to the
+// last NUM_FRAME_RECORDS frames.
 class FrameTracker {
 
 public:
@@ -91,15 +97,30 @@ public:
     // dumpStats dump appends the current frame display time history to the result string.
     void dumpStats(String8& result) const;
 
+    // mergeLatencyHistograms adds the latencies of the tracked frames to the
+    // given histograms: the desired-present to actual-present latency, and
+    // the frame-ready to actual-present latency. If sinceClear is true, only
+    // the frames since the last call to clearStats are included, otherwise
+    // all the frames since the FrameTracker was created are.
+    void mergeLatencyHistograms(LatencyHistogram* outPresentLatency,
+            LatencyHistogram* outReadyLatency, bool sinceClear) const;
+
+    // dumpLatencyHistograms appends a summary of the latency histograms,
+    // both since the last clearStats and since creation.
+    void dumpLatencyHistograms(String8& result) const;
+
 private:
     struct FrameRecord {
         FrameRecord() :
             desiredPresentTime(0),
             frameReadyTime(0),
-            actualPresentTime(0) {}
+            actualPresentTime(0),
+            latencyRecorded(false) {}
         nsecs_t desiredPresentTime;
         nsecs_t frameReadyTime;
         nsecs_t actualPresentTime;
+        // true once the frame has been added to the latency histograms
+        bool latencyRecorded;
         sp<Fence> frameReadyFence;
         sp<Fence> actualPresentFence;
     };
@@ -117,6 +138,10 @@ private:
     // about the frame times.
     void updateStatsLocked(size_t newFrameIdx) const;
 
+    // recordLatencyLocked adds the given frame to the latency histograms
+    // once all its times are known. Each frame is only added once.
+    void recordLatencyLocked(size_t idx) const;
+
     // resetFrameCounteresLocked sets all elements of the mNumFrames array to
     // 0.
     void resetFrameCountersLocked();
@@ -151,6 +176,15 @@ private:
     // all frames with duration greater than 2^(NUM_FRAME_BUCKETS-1).
     int32_t mNumFrames[NUM_FRAME_BUCKETS];
 
+    // mLatency holds the latency histograms of the frames since the last
+    // clearStats, mLifetimeLatency those of all the frames.
+    struct LatencyHistograms {
+        LatencyHistogram presentLatency;
+        LatencyHistogram readyLatency;
+    };
+    LatencyHistograms mLatency;
+    LatencyHistograms mLifetimeLatency;
+
     // mDisplayPeriod is the display refresh period of the display for which
     // this FrameTracker is gathering information.
     nsecs_t mDisplayPeriod;
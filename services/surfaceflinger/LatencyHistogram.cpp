@@ -0,0 +1,125 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <utils/String8.h>
+
+#include "LatencyHistogram.h"
+#include "clz.h"
+
+namespace android {
+
+LatencyHistogram::LatencyHistogram() {
+    clear();
+}
+
+void LatencyHistogram::addValue(nsecs_t latency) {
+    const nsecs_t maxUs = (1 << MAX_VALUE_BITS) - 1;
+    nsecs_t us = ns2us(latency);
+    if (us < 0) {
+        us = 0;
+    } else if (us > maxUs) {
+        us = maxUs;
+    }
+    const uint32_t valueUs = static_cast<uint32_t>(us);
+
+    mBuckets[getBucketIndex(valueUs)]++;
+    mCount++;
+    mTotalUs += valueUs;
+    if (valueUs > mMaxUs) {
+        mMaxUs = valueUs;
+    }
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        mBuckets[i] += other.mBuckets[i];
+    }
+    mCount += other.mCount;
+    mTotalUs += other.mTotalUs;
+    if (other.mMaxUs > mMaxUs) {
+        mMaxUs = other.mMaxUs;
+    }
+}
+
+void LatencyHistogram::clear() {
+    memset(mBuckets, 0, sizeof(mBuckets));
+    mCount = 0;
+    mTotalUs = 0;
+    mMaxUs = 0;
+}
+
+nsecs_t LatencyHistogram::getPercentile(double percent) const {
+    if (mCount == 0) {
+        return 0;
+    }
+
+    // Rank of the requested value, 1-based.
+    size_t rank = static_cast<size_t>(mCount * percent / 100.0 + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    } else if (rank > mCount) {
+        rank = mCount;
+    }
+
+    size_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        seen += mBuckets[i];
+        if (seen >= rank) {
+            // Nothing recorded is larger than the max, so don't report
+            // the end of its bucket.
+            return us2ns(min(getBucketUpperBound(i), mMaxUs));
+        }
+    }
+    return us2ns(mMaxUs);
+}
+
+void LatencyHistogram::dump(String8& result) const {
+    if (mCount == 0) {
+        result.append("no frames\n");
+        return;
+    }
+    result.appendFormat("frames=%zu mean=%.2f p50=%.2f p90=%.2f p99=%.2f "
+            "p99.9=%.2f max=%.2f ms\n", mCount,
+            mTotalUs / 1000.0 / mCount,
+            getPercentile(50.0) / 1e6, getPercentile(90.0) / 1e6,
+            getPercentile(99.0) / 1e6, getPercentile(99.9) / 1e6,
+            mMaxUs / 1000.0);
+}
+
+size_t LatencyHistogram::getBucketIndex(uint32_t valueUs) {
+    if (valueUs < 2 * NUM_SUB_BUCKETS) {
+        return valueUs;
+    }
+    // Keep the SUB_BUCKET_BITS bits following the most significant one.
+    const int msb = 31 - clz(static_cast<int32_t>(valueUs));
+    const int shift = msb - SUB_BUCKET_BITS;
+    return (shift + 1) * NUM_SUB_BUCKETS +
+            ((valueUs >> shift) - NUM_SUB_BUCKETS);
+}
+
+uint32_t LatencyHistogram::getBucketUpperBound(size_t index) {
+    if (index < 2 * NUM_SUB_BUCKETS) {
+        return index;
+    }
+    const int shift = index / NUM_SUB_BUCKETS - 1;
+    const uint32_t subBucket = index % NUM_SUB_BUCKETS + NUM_SUB_BUCKETS;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+} // namespace android
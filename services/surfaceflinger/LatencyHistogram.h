@@ -0,0 +1,83 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LATENCYHISTOGRAM_H
+#define ANDROID_LATENCYHISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Timers.h>
+
+namespace android {
+
+class String8;
+
+// LatencyHistogram accumulates a distribution of latencies in a fixed amount
+// of memory, no matter how many samples are added. Values are kept in
+// microseconds in log-linear buckets: every power of two is split into
+// NUM_SUB_BUCKETS equal buckets, so any value is recorded with a relative
+// error of at most 1/NUM_SUB_BUCKETS, and values below 2*NUM_SUB_BUCKETS us
+// are exact.
+//
+// Histograms of the same kind can be merged, which makes it cheap to
+// aggregate them over several layers. LatencyHistogram is *NOT* thread-safe.
+class LatencyHistogram {
+
+public:
+    enum {
+        SUB_BUCKET_BITS = 3,
+        NUM_SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+        // Values are clamped to 2^MAX_VALUE_BITS - 1 us, about 67 s.
+        MAX_VALUE_BITS = 26,
+        NUM_BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * NUM_SUB_BUCKETS
+    };
+
+    LatencyHistogram();
+
+    // addValue records one latency. Negative latencies are recorded as 0.
+    void addValue(nsecs_t latency);
+
+    // merge adds all the values recorded in other to this histogram.
+    void merge(const LatencyHistogram& other);
+
+    // clear removes all the recorded values.
+    void clear();
+
+    size_t getCount() const { return mCount; }
+
+    // getPercentile returns the latency below which the given percentage
+    // of the recorded values fall, rounded up to the end of its bucket,
+    // or 0 if the histogram is empty.
+    nsecs_t getPercentile(double percent) const;
+
+    // dump appends a one-line summary: count, mean, p50, p90, p99, p99.9
+    // and max, in milliseconds.
+    void dump(String8& result) const;
+
+private:
+    static size_t getBucketIndex(uint32_t valueUs);
+    static uint32_t getBucketUpperBound(size_t index);
+
+    uint32_t mBuckets[NUM_BUCKETS];
+    size_t mCount;
+    uint64_t mTotalUs;
+    uint32_t mMaxUs;
+};
+
+}
+
+#endif // ANDROID_LATENCYHISTOGRAM_H
@@ -93,6 +93,12 @@ Layer::Layer(SurfaceFlinger* flinger, const sp<Client>& client,
         mFiltering(false),
         mNeedsFiltering(false),
         mMesh(Mesh::TRIANGLE_FAN, 4, 2, 2),
+        mMeshCacheValid(false),
+        mMeshGeometryGeneration(0),
+        mMeshProjectionGeneration(0),
+        mMeshUseIdentityTransform(false),
+        mGeometryGeneration(0),
+        mLastComposedFrameNumber(0),
 #ifndef USE_HWC2
         mIsGlesComposition(false),
 #endif
@@ -905,7 +911,23 @@ Rect Layer::getPosition(
 // ---------------------------------------------------------------------------
 
 void Layer::draw(const sp<const DisplayDevice>& hw, const Region& clip) {
+    // This is the composition path (screenshots use the other variants), so
+    // account the cost of drawing the layer here.
+    RenderEngine& engine(mFlinger->getRenderEngine());
+    const nsecs_t startTime = systemTime(SYSTEM_TIME_THREAD);
+    const uint64_t frameNumber = mCurrentFrameNumber;
+    const bool textureUpload = mActiveBuffer != NULL &&
+            frameNumber != mLastComposedFrameNumber;
+    const uint32_t gpuTimer = mFlinger->mLayerGpuTiming ?
+            engine.beginGpuTimer() : uint32_t(RenderEngine::NO_GPU_TIMER);
+
     onDraw(hw, clip, false);
+
+    engine.endGpuTimer(gpuTimer);
+    mLastComposedFrameNumber = frameNumber;
+    mCompositionCostTracker.addSample(
+            systemTime(SYSTEM_TIME_THREAD) - startTime, gpuTimer,
+            computePixelsTouched(hw), textureUpload);
 }
 
 void Layer::draw(const sp<const DisplayDevice>& hw,
@@ -1017,14 +1039,28 @@ void Layer::onDraw(const sp<const DisplayDevice>& hw, const Region& clip,
 }
 
 
+uint64_t Layer::computePixelsTouched(const sp<const DisplayDevice>& hw) const {
+    // The whole layer quad is rasterized regardless of the clip, so this is
+    // what the GPU pays for.
+    const State& s(getDrawingState());
+    Rect win(s.active.transform.transform(computeBounds()));
+    if (!s.finalCrop.isEmpty() && !win.intersect(s.finalCrop, &win)) {
+        return 0;
+    }
+    win = hw->getTransform().transform(win);
+    if (!win.intersect(hw->bounds(), &win)) {
+        return 0;
+    }
+    return uint64_t(win.getWidth()) * uint64_t(win.getHeight());
+}
+
 void Layer::clearWithOpenGL(const sp<const DisplayDevice>& hw,
         const Region& /* clip */, float red, float green, float blue,
         float alpha) const
 {
     RenderEngine& engine(mFlinger->getRenderEngine());
-    computeGeometry(hw, mMesh, false);
     engine.setupFillWithColor(red, green, blue, alpha);
-    engine.drawMesh(mMesh);
+    engine.drawMesh(getDrawMesh(hw, false));
 }
 
 void Layer::clearWithOpenGL(
@@ -1044,6 +1080,21 @@ void Layer::handleOpenGLDraw(const sp<const DisplayDevice>& /* hw */,
 
 void Layer::drawWithOpenGL(const sp<const DisplayDevice>& hw,
         const Region& /* clip */, bool useIdentityTransform) const {
+    handleOpenGLDraw(hw, getDrawMesh(hw, useIdentityTransform));
+}
+
+Mesh& Layer::getDrawMesh(const sp<const DisplayDevice>& hw,
+        bool useIdentityTransform) const {
+    // The mesh only depends on the layer geometry, the current buffer's
+    // crop and transform, and the display projection; most layers keep
+    // those for many frames.
+    if (mMeshCacheValid &&
+            mMeshGeometryGeneration == mGeometryGeneration &&
+            mMeshProjectionGeneration == hw->getProjectionGeneration() &&
+            mMeshUseIdentityTransform == useIdentityTransform) {
+        return mMesh;
+    }
+
     const State& s(getDrawingState());
 
     computeGeometry(hw, mMesh, useIdentityTransform);
@@ -1122,7 +1173,16 @@ void Layer::drawWithOpenGL(const sp<const DisplayDevice>& hw,
     texCoords[2] = vec2(right, 1.0f - bottom);
     texCoords[3] = vec2(right, 1.0f - top);
 
-    handleOpenGLDraw(hw, mMesh);
+
+    mMeshCacheValid = true;
+    mMeshGeometryGeneration = mGeometryGeneration;
+    mMeshProjectionGeneration = hw->getProjectionGeneration();
+    mMeshUseIdentityTransform = useIdentityTransform;
+    return mMesh;
+}
+
+void Layer::invalidateMeshCache() const {
+    mMeshCacheValid = false;
 }
 
 #ifdef USE_HWC2
@@ -1681,6 +1741,7 @@ uint32_t Layer::doTransaction(uint32_t flags) {
 
 void Layer::commitTransaction(const State& stateToCommit) {
     mDrawingState = stateToCommit;
+    mGeometryGeneration++;
 }
 
 uint32_t Layer::getTransactionFlags(uint32_t flags) {
@@ -1894,6 +1955,8 @@ bool Layer::onPreComposition() {
 }
 
 bool Layer::onPostComposition() {
+    mCompositionCostTracker.processGpuTimers(mFlinger->getRenderEngine());
+
     bool frameLatencyNeeded = mFrameLatencyNeeded;
     if (mFrameLatencyNeeded) {
         nsecs_t desiredPresentTime = mSurfaceFlingerConsumer->getTimestamp();
@@ -1986,6 +2049,7 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
         const State& s(getDrawingState());
         const bool oldOpacity = isOpaque(s);
         sp<GraphicBuffer> oldActiveBuffer = mActiveBuffer;
+        const bool oldTransformToDisplayInverse = getTransformToDisplayInverse();
 
         struct Reject : public SurfaceFlingerConsumer::BufferRejecter {
             Layer::State& front;
@@ -1995,18 +2059,21 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
             const char* name;
             int32_t overrideScalingMode;
             bool& freezePositionUpdates;
+            uint32_t& geometryGeneration;
 
             Reject(Layer::State& front, Layer::State& current,
                     bool& recomputeVisibleRegions, bool stickySet,
                     const char* name,
                     int32_t overrideScalingMode,
-                    bool& freezePositionUpdates)
+                    bool& freezePositionUpdates,
+                    uint32_t& geometryGeneration)
                 : front(front), current(current),
                   recomputeVisibleRegions(recomputeVisibleRegions),
                   stickyTransformSet(stickySet),
                   name(name),
                   overrideScalingMode(overrideScalingMode),
-                  freezePositionUpdates(freezePositionUpdates) {
+                  freezePositionUpdates(freezePositionUpdates),
+                  geometryGeneration(geometryGeneration) {
             }
 
             virtual bool reject(const sp<GraphicBuffer>& buf,
@@ -2049,6 +2116,7 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
 
                         // recompute visible region
                         recomputeVisibleRegions = true;
+                        geometryGeneration++;
                     }
 
                     ALOGD_IF(DEBUG_RESIZE,
@@ -2096,12 +2164,14 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
 
                     // recompute visible region
                     recomputeVisibleRegions = true;
+                    geometryGeneration++;
                 }
 
                 if (front.crop != front.requestedCrop) {
                     front.crop = front.requestedCrop;
                     current.crop = front.requestedCrop;
                     recomputeVisibleRegions = true;
+                    geometryGeneration++;
                 }
                 freezePositionUpdates = false;
 
@@ -2111,7 +2181,8 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
 
         Reject r(mDrawingState, getCurrentState(), recomputeVisibleRegions,
                 getProducerStickyTransform() != 0, mName.string(),
-                mOverrideScalingMode, mFreezePositionUpdates);
+                mOverrideScalingMode, mFreezePositionUpdates,
+                mGeometryGeneration);
 
 
         // Check all of our local sync points to ensure that all transactions
@@ -2238,6 +2309,7 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
              // the first time we receive a buffer, we need to trigger a
              // geometry invalidation.
             recomputeVisibleRegions = true;
+            mGeometryGeneration++;
          }
 
         Rect crop(mSurfaceFlingerConsumer->getCurrentCrop());
@@ -2251,6 +2323,7 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
             mCurrentTransform = transform;
             mCurrentScalingMode = scalingMode;
             recomputeVisibleRegions = true;
+            mGeometryGeneration++;
         }
 
         if (oldActiveBuffer != NULL) {
@@ -2259,9 +2332,16 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
             if (bufWidth != uint32_t(oldActiveBuffer->width) ||
                 bufHeight != uint32_t(oldActiveBuffer->height)) {
                 recomputeVisibleRegions = true;
+                mGeometryGeneration++;
             }
         }
 
+        // Reject above takes care of the geometry it latches; the buffer
+        // may also have changed how the layer is oriented on the display.
+        if (getTransformToDisplayInverse() != oldTransformToDisplayInverse) {
+            mGeometryGeneration++;
+        }
+
         mCurrentOpacity = getOpacityForFormat(mActiveBuffer->format);
         if (oldOpacity != isOpaque(s)) {
             recomputeVisibleRegions = true;
@@ -2291,9 +2371,28 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
             }
         }
 
-        // FIXME: postedRegion should be dirty & bounds
         Region dirtyRegion(Rect(s.active.w, s.active.h));
 
+        // If only the contents changed and the buffer maps 1:1 onto the
+        // layer, just the damaged part of the buffer needs to be recomposed.
+        // (recomputeVisibleRegions may have been set by another layer, in
+        // which case we play it safe)
+        if (!recomputeVisibleRegions && !mFlinger->mForceFullDamage &&
+                (mCurrentTransform == 0) &&
+                !mSurfaceFlingerConsumer->getTransformToDisplayInverse() &&
+                (mCurrentCrop.isEmpty() ||
+                 mCurrentCrop == Rect(mActiveBuffer->getWidth(),
+                         mActiveBuffer->getHeight())) &&
+                (mActiveBuffer->getWidth() == s.active.w) &&
+                (mActiveBuffer->getHeight() == s.active.h)) {
+            const Region& damage(mSurfaceFlingerConsumer->getSurfaceDamage());
+            const bool damageUnknown = damage.isRect() &&
+                    damage.getBounds() == Rect::INVALID_RECT;
+            if (!damageUnknown) {
+                dirtyRegion.andSelf(damage);
+            }
+        }
+
         // transform the dirty region to window-manager space
         outDirtyRegion = (s.active.transform.transform(dirtyRegion));
     }
@@ -2327,7 +2426,10 @@ void Layer::updateTransformHint(const sp<const DisplayDevice>& hw) {
         }
     }
     mSurfaceFlingerConsumer->setTransformHint(orientation);
-    mTransformHint = orientation;
+    if (mTransformHint != orientation) {
+        mTransformHint = orientation;
+        mGeometryGeneration++;
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -2454,6 +2556,29 @@ void Layer::getFrameStats(FrameStats* outStats) const {
     mFrameTracker.getStats(outStats);
 }
 
+void Layer::dumpLatencyHistograms(String8& result) const {
+    mFrameTracker.dumpLatencyHistograms(result);
+}
+
+void Layer::mergeLatencyHistograms(LatencyHistogram* outPresentLatency,
+        LatencyHistogram* outReadyLatency, bool sinceClear) const {
+    mFrameTracker.mergeLatencyHistograms(outPresentLatency, outReadyLatency,
+            sinceClear);
+}
+
+void Layer::dumpCompositionStats(String8& result) const {
+    mCompositionCostTracker.dumpStats(result);
+}
+
+void Layer::clearCompositionStats() {
+    mCompositionCostTracker.clearStats();
+}
+
+void Layer::getCompositionStats(LayerCompositionStats* outStats) const {
+    outStats->name = mName;
+    mCompositionCostTracker.getStats(outStats);
+}
+
 void Layer::getFenceData(String8* outName, uint64_t* outFrameNumber,
         bool* outIsGlesComposition, nsecs_t* outPostedTime,
         sp<Fence>* outAcquireFence, sp<Fence>* outPrevReleaseFence) const {
@@ -33,11 +33,13 @@
 #include <ui/Region.h>
 
 #include <gui/ISurfaceComposerClient.h>
+#include <gui/LayerCompositionStats.h>
 
 #include <private/gui/LayerState.h>
 
 #include <list>
 
+#include "CompositionCostTracker.h"
 #include "FrameTracker.h"
 #include "Client.h"
 #include "MonitoredProducer.h"
@@ -190,6 +192,11 @@ public:
 
     virtual void computeGeometry(const sp<const DisplayDevice>& hw, Mesh& mesh,
             bool useIdentityTransform) const;
+    // getDrawMesh returns the positions and texture coordinates used to draw
+    // the layer on the given display, only recomputing them when the layer
+    // or display geometry changed since the last call.
+    Mesh& getDrawMesh(const sp<const DisplayDevice>& hw,
+            bool useIdentityTransform) const;
     Rect computeBounds(const Region& activeTransparentRegion) const;
     Rect computeBounds() const;
 
@@ -450,6 +457,13 @@ public:
     void clearFrameStats();
     void logFrameStats();
     void getFrameStats(FrameStats* outStats) const;
+    void dumpLatencyHistograms(String8& result) const;
+    void mergeLatencyHistograms(LatencyHistogram* outPresentLatency,
+            LatencyHistogram* outReadyLatency, bool sinceClear) const;
+
+    void dumpCompositionStats(String8& result) const;
+    void clearCompositionStats();
+    void getCompositionStats(LayerCompositionStats* outStats) const;
 
     void getFenceData(String8* outName, uint64_t* outFrameNumber,
             bool* outIsGlesComposition, nsecs_t* outPostedTime,
@@ -502,10 +516,13 @@ private:
     static bool getOpacityForFormat(uint32_t format);
 
     // drawing
+    uint64_t computePixelsTouched(const sp<const DisplayDevice>& hw) const;
     void clearWithOpenGL(const sp<const DisplayDevice>& hw, const Region& clip,
             float r, float g, float b, float alpha) const;
     virtual void drawWithOpenGL(const sp<const DisplayDevice>& hw, const Region& clip,
             bool useIdentityTransform) const;
+    // Must be called by subclasses that write mMesh themselves
+    void invalidateMeshCache() const;
 
     // Temporary - Used only for LEGACY camera mode.
     uint32_t getProducerStickyTransform() const;
@@ -598,6 +615,7 @@ private:
     volatile int32_t mQueuedFrames;
     volatile int32_t mSidebandStreamChanged; // used like an atomic boolean
     FrameTracker mFrameTracker;
+    CompositionCostTracker mCompositionCostTracker;
 
     // main thread
     sp<GraphicBuffer> mActiveBuffer;
@@ -617,8 +635,17 @@ private:
     bool mNeedsFiltering;
     // The mesh used to draw the layer in GLES composition mode
     mutable Mesh mMesh;
+    // What mMesh was computed for, see getDrawMesh
+    mutable bool mMeshCacheValid;
+    mutable uint32_t mMeshGeometryGeneration;
+    mutable uint32_t mMeshProjectionGeneration;
+    mutable bool mMeshUseIdentityTransform;
+    // Incremented every time the geometry used to compute mMesh changes
+    uint32_t mGeometryGeneration;
     // The texture used to draw the layer in GLES composition mode
     mutable Texture mTexture;
+    // The frame number of the buffer last bound to mTexture for composition
+    uint64_t mLastComposedFrameNumber;
 
 #ifdef USE_HWC2
     // HWC items, accessed from the main thread
@@ -274,6 +274,7 @@ bool LayerBlur::drawMaskLayer(sp<Layer>& maskLayer, const sp<const DisplayDevice
             Transform::ROT_0
             );
     setupMesh(mMesh, width, height, height);
+    invalidateMeshCache();
     mFlinger->getRenderEngine().clearWithColor(0.0f, 0.0f, 0.0f, 0.0f); // alpha must be ZERO
     maskLayer->draw(hw);
     glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
@@ -332,6 +333,7 @@ void LayerBlur::doDrawFinal(const sp<const DisplayDevice>& hw,
 
     setupMeshPartial(mMesh, frameToDraw, frameToMapTexture, hwWidth, hwHeight,
             savedProjectionSourceCrop.height());
+    invalidateMeshCache();
 
     engine.setupLayerTexturing(mTextureBlur);
     engine.setupLayerBlending(mPremultipliedAlpha, isOpaque(s), s.alpha);
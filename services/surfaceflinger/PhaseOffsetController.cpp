@@ -0,0 +1,161 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <inttypes.h>
+
+#include <algorithm>
+
+#include <cutils/log.h>
+
+#include <utils/String8.h>
+#include <utils/Trace.h>
+
+#include "PhaseOffsetController.h"
+
+namespace android {
+
+const nsecs_t PhaseOffsetController::MIN_COMPOSITION_BUDGET;
+const nsecs_t PhaseOffsetController::MIN_ADJUSTMENT_STEP;
+const nsecs_t PhaseOffsetController::MIN_MARGIN;
+
+PhaseOffsetController::PhaseOffsetController(nsecs_t appPhaseOffset,
+        nsecs_t sfPhaseOffset, float targetMissRate) :
+        mBaseAppPhaseOffset(appPhaseOffset),
+        mBaseSfPhaseOffset(sfPhaseOffset),
+        mTargetMissRate(targetMissRate),
+        mTotalFrames(0),
+        mTotalMissedFrames(0),
+        mNumAdjustments(0) {
+    reset();
+}
+
+void PhaseOffsetController::reset() {
+    Mutex::Autolock lock(mMutex);
+    mOffsetAdjustment = 0;
+    mMargin = 2 * MIN_MARGIN;
+    mLastAdjustmentTime = 0;
+    mNumFrames = 0;
+    mNumMissedFrames = 0;
+}
+
+bool PhaseOffsetController::addFrame(const FrameTiming& frame,
+        nsecs_t period, nsecs_t now) {
+    Mutex::Autolock lock(mMutex);
+
+    if (period <= 0 || frame.refreshStartTime < mLastAdjustmentTime) {
+        return false;
+    }
+
+    const bool missed =
+            frame.presentTime > frame.expectedPresentTime + period / 2;
+    mSlack[mNumFrames++] = frame.expectedPresentTime - frame.compositionDoneTime;
+    mTotalFrames++;
+    if (missed) {
+        mNumMissedFrames++;
+        mTotalMissedFrames++;
+    }
+
+    if (mNumFrames < WINDOW_SIZE) {
+        return false;
+    }
+
+    bool changed = updateOffsetsLocked(period);
+    if (changed) {
+        mLastAdjustmentTime = now;
+    }
+    mNumFrames = 0;
+    mNumMissedFrames = 0;
+    return changed;
+}
+
+bool PhaseOffsetController::updateOffsetsLocked(nsecs_t period) {
+    ATRACE_CALL();
+
+    // Don't let SurfaceFlinger wake up so late that less than
+    // MIN_COMPOSITION_BUDGET is left before the refresh.
+    nsecs_t sfOffset = mBaseSfPhaseOffset % period;
+    if (sfOffset < 0) {
+        sfOffset += period;
+    }
+    const nsecs_t maxAdjustment =
+            std::max(nsecs_t(0), period - MIN_COMPOSITION_BUDGET - sfOffset);
+
+    nsecs_t adjustment = mOffsetAdjustment;
+    const size_t allowedMisses =
+            static_cast<size_t>(mTargetMissRate * mNumFrames);
+    if (mNumMissedFrames > allowedMisses) {
+        // Back off right away, and keep more slack from now on.
+        adjustment -= period / 4;
+        mMargin = std::min(2 * mMargin, period / 4);
+    } else {
+        // Moving the wake up later by some amount reduces the slack of every
+        // frame by as much. Only allowedMisses frames may run out of slack.
+        nsecs_t* tail = mSlack + allowedMisses;
+        std::nth_element(mSlack, tail, mSlack + mNumFrames);
+        nsecs_t step = *tail - mMargin;
+        // Approach the limit progressively, composition times drift.
+        step = std::min(step, period / 8);
+        step = std::max(step, -period / 4);
+        adjustment += step;
+        mMargin = std::max(mMargin - mMargin / 4, MIN_MARGIN);
+    }
+    adjustment = std::min(std::max(adjustment, nsecs_t(0)), maxAdjustment);
+
+    nsecs_t delta = adjustment - mOffsetAdjustment;
+    if (delta < 0) {
+        delta = -delta;
+    }
+    // Always go back to the configured offsets, even for a small step
+    if (delta < MIN_ADJUSTMENT_STEP && adjustment != 0) {
+        return false;
+    }
+    if (adjustment == mOffsetAdjustment) {
+        return false;
+    }
+
+    ALOGV("phase offset adjustment %" PRId64 " -> %" PRId64 " (margin %"
+            PRId64 ", %zu/%zu missed)", mOffsetAdjustment, adjustment,
+            mMargin, mNumMissedFrames, mNumFrames);
+    mOffsetAdjustment = adjustment;
+    mNumAdjustments++;
+    return true;
+}
+
+nsecs_t PhaseOffsetController::getAppPhaseOffset() const {
+    Mutex::Autolock lock(mMutex);
+    return mBaseAppPhaseOffset + mOffsetAdjustment;
+}
+
+nsecs_t PhaseOffsetController::getSfPhaseOffset() const {
+    Mutex::Autolock lock(mMutex);
+    return mBaseSfPhaseOffset + mOffsetAdjustment;
+}
+
+void PhaseOffsetController::dump(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    result.appendFormat("Adaptive phase offsets: app %" PRId64 " sf %" PRId64
+            " (configured + %.3f ms, margin %.3f ms, target miss rate %.2f%%)\n",
+            mBaseAppPhaseOffset + mOffsetAdjustment,
+            mBaseSfPhaseOffset + mOffsetAdjustment,
+            mOffsetAdjustment / 1e6, mMargin / 1e6, mTargetMissRate * 100.0f);
+    result.appendFormat("  frames %" PRIu64 ", missed %" PRIu64
+            ", adjustments %u\n", mTotalFrames, mTotalMissedFrames,
+            mNumAdjustments);
+}
+
+} // namespace android
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PHASEOFFSETCONTROLLER_H
+#define ANDROID_PHASEOFFSETCONTROLLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Mutex.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class String8;
+
+// PhaseOffsetController tunes the app and SurfaceFlinger vsync phase offsets
+// from the timing of the frames SurfaceFlinger actually composed.
+//
+// The later in the vsync period SurfaceFlinger wakes up, the less time passes
+// between an app sampling input and its frame reaching the display, but the
+// more likely SurfaceFlinger is to miss the refresh it is aiming for. The
+// controller looks at how much time was left between the end of composition
+// and the refresh each frame targeted, and moves the SurfaceFlinger offset
+// so that only targetMissRate of the frames would have been late. The app
+// offset follows, keeping its configured distance to the SurfaceFlinger
+// offset so apps keep the same rendering budget.
+//
+// The offsets never go earlier in the period than the configured ones, so
+// the adaptive mode can't add latency. Missed frames make the controller
+// back off immediately and become more conservative.
+class PhaseOffsetController {
+
+public:
+    struct FrameTiming {
+        // when SurfaceFlinger woke up to compose the frame
+        nsecs_t refreshStartTime;
+        // the refresh the frame was composed for
+        nsecs_t expectedPresentTime;
+        // when both the GPU and HWC composition were submitted
+        nsecs_t compositionDoneTime;
+        // when the frame reached the display
+        nsecs_t presentTime;
+    };
+
+    // Number of frames looked at for each adjustment of the offsets
+    enum { WINDOW_SIZE = 120 };
+
+    // Composition time that's always left before the refresh, no matter how
+    // fast the recent frames were
+    static const nsecs_t MIN_COMPOSITION_BUDGET = 2000000;
+
+    // Smallest change of the offsets worth re-registering the vsync
+    // listeners for
+    static const nsecs_t MIN_ADJUSTMENT_STEP = 250000;
+
+    static const nsecs_t MIN_MARGIN = 500000;
+
+    PhaseOffsetController(nsecs_t appPhaseOffset, nsecs_t sfPhaseOffset,
+            float targetMissRate);
+
+    // addFrame feeds the timing of a presented frame to the controller; now
+    // is the current time. It returns true if the phase offsets changed as a
+    // result, in which case they should be applied right away with
+    // getAppPhaseOffset/getSfPhaseOffset.
+    bool addFrame(const FrameTiming& frame, nsecs_t period, nsecs_t now);
+
+    // reset forgets the frames seen so far and restores the configured
+    // phase offsets.
+    void reset();
+
+    nsecs_t getAppPhaseOffset() const;
+    nsecs_t getSfPhaseOffset() const;
+
+    void dump(String8& result) const;
+
+private:
+    bool updateOffsetsLocked(nsecs_t period);
+
+    // The offsets the device was configured with
+    const nsecs_t mBaseAppPhaseOffset;
+    const nsecs_t mBaseSfPhaseOffset;
+    const float mTargetMissRate;
+
+    // How much later than configured SurfaceFlinger and apps wake up
+    nsecs_t mOffsetAdjustment;
+
+    // Extra slack kept on top of the measured composition time. Doubled on
+    // every window with too many missed frames, slowly decays otherwise.
+    nsecs_t mMargin;
+
+    // Frames composed before the offsets last changed are ignored
+    nsecs_t mLastAdjustmentTime;
+
+    // Slack of the frames of the current window, i.e. how long before the
+    // expected refresh their composition was done; negative when late
+    nsecs_t mSlack[WINDOW_SIZE];
+    size_t mNumFrames;
+    size_t mNumMissedFrames;
+
+    // Lifetime statistics, for dumpsys
+    uint64_t mTotalFrames;
+    uint64_t mTotalMissedFrames;
+    uint32_t mNumAdjustments;
+
+    mutable Mutex mMutex;
+};
+
+}
+
+#endif // ANDROID_PHASEOFFSETCONTROLLER_H
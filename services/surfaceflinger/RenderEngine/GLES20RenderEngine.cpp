@@ -33,6 +33,7 @@
 #include <math.h>
 
 #include "GLES20RenderEngine.h"
+#include "GLExtensions.h"
 #include "Program.h"
 #include "ProgramCache.h"
 #include "Description.h"
@@ -44,7 +45,9 @@ namespace android {
 // ---------------------------------------------------------------------------
 
 GLES20RenderEngine::GLES20RenderEngine() :
-        mVpWidth(0), mVpHeight(0), mProjectionRotation(Transform::ROT_0) {
+        mVpWidth(0), mVpHeight(0), mProjectionRotation(Transform::ROT_0),
+        mHasTimerQuery(false), mTimerQueriesCreated(false), mNumDisjointFrames(0),
+        mMeshBuffer(0), mNextBatchedMesh(0) {
 
     glGetIntegerv(GL_MAX_TEXTURE_SIZE, &mMaxTextureSize);
     glGetIntegerv(GL_MAX_VIEWPORT_DIMS, mMaxViewportDims);
@@ -62,6 +65,9 @@ GLES20RenderEngine::GLES20RenderEngine() :
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0,
             GL_RGB, GL_UNSIGNED_SHORT_5_6_5, protTexData);
 
+    mHasTimerQuery = GLExtensions::getInstance().hasExtension(
+            "GL_EXT_disjoint_timer_query");
+
     //mColorBlindnessCorrection = M;
 }
 
@@ -307,30 +313,172 @@ void GLES20RenderEngine::drawMesh(const Mesh& mesh) {
 
     ProgramCache::getInstance().useProgram(mState);
 
+    const GLvoid* positions = mesh.getPositions();
+    const GLvoid* texCoords = mesh.getTexCoords();
+    const BatchedMesh* batched = findBatchedMesh(mesh);
+    if (batched) {
+        // source the vertices from mMeshBuffer, at the same layout
+        const uintptr_t base = batched->offset * sizeof(float);
+        const uintptr_t texCoordsOffset =
+                (mesh.getTexCoords() - mesh.getPositions()) * sizeof(float);
+        glBindBuffer(GL_ARRAY_BUFFER, mMeshBuffer);
+        positions = reinterpret_cast<const GLvoid*>(base);
+        texCoords = reinterpret_cast<const GLvoid*>(base + texCoordsOffset);
+    }
+
     if (mesh.getTexCoordsSize()) {
         glEnableVertexAttribArray(Program::texCoords);
         glVertexAttribPointer(Program::texCoords,
                 mesh.getTexCoordsSize(),
                 GL_FLOAT, GL_FALSE,
                 mesh.getByteStride(),
-                mesh.getTexCoords());
+                texCoords);
     }
 
     glVertexAttribPointer(Program::position,
             mesh.getVertexSize(),
             GL_FLOAT, GL_FALSE,
             mesh.getByteStride(),
-            mesh.getPositions());
+            positions);
 
     glDrawArrays(mesh.getPrimitive(), 0, mesh.getVertexCount());
 
     if (mesh.getTexCoordsSize()) {
         glDisableVertexAttribArray(Program::texCoords);
     }
+
+    if (batched) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+void GLES20RenderEngine::uploadMeshes(const Vector<const Mesh*>& meshes) {
+    clearMeshes();
+
+    // a single mesh is just as well drawn from client memory
+    if (meshes.size() < 2) {
+        return;
+    }
+
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const Mesh* mesh = meshes[i];
+        BatchedMesh batched;
+        batched.mesh = mesh;
+        batched.generation = mesh->getGeneration();
+        batched.offset = mMeshBatchData.size();
+        batched.size = mesh->getVertexCount() * mesh->getStride();
+        mMeshBatchData.insert(mMeshBatchData.end(), mesh->getPositions(),
+                mesh->getPositions() + batched.size);
+        mMeshBatch.push_back(batched);
+    }
+
+    if (mMeshBuffer == 0) {
+        glGenBuffers(1, &mMeshBuffer);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, mMeshBuffer);
+    glBufferData(GL_ARRAY_BUFFER, mMeshBatchData.size() * sizeof(float),
+            mMeshBatchData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GLES20RenderEngine::clearMeshes() {
+    // keep the storage, it is refilled every frame
+    mMeshBatch.clear();
+    mMeshBatchData.clear();
+    mNextBatchedMesh = 0;
+}
+
+const GLES20RenderEngine::BatchedMesh* GLES20RenderEngine::findBatchedMesh(
+        const Mesh& mesh) {
+    const size_t count = mMeshBatch.size();
+    if (count == 0) {
+        return NULL;
+    }
+
+    // meshes are normally drawn in the order they were uploaded
+    for (size_t n = 0; n < count; n++) {
+        const size_t i = (mNextBatchedMesh + n) % count;
+        const BatchedMesh& batched(mMeshBatch[i]);
+        if (batched.mesh != &mesh) {
+            continue;
+        }
+        // the mesh may have been rewritten since it was uploaded
+        if (batched.generation != mesh.getGeneration()) {
+            return NULL;
+        }
+        mNextBatchedMesh = (i + 1) % count;
+        return &batched;
+    }
+    return NULL;
+}
+
+uint32_t GLES20RenderEngine::beginGpuTimer() {
+    if (!mHasTimerQuery) {
+        return RenderEngine::beginGpuTimer();
+    }
+    if (!mTimerQueriesCreated) {
+        glGenQueriesEXT(MAX_GPU_TIMERS, mTimerQueries);
+        mTimerQueriesCreated = true;
+    }
+    uint32_t timer = allocGpuTimer();
+    glBeginQueryEXT(GL_TIME_ELAPSED_EXT, mTimerQueries[getGpuTimerSlot(timer)]);
+    return timer;
+}
+
+void GLES20RenderEngine::endGpuTimer(uint32_t timer) {
+    if (!mHasTimerQuery) {
+        RenderEngine::endGpuTimer(timer);
+        return;
+    }
+    if (isGpuTimerValid(timer)) {
+        glEndQueryEXT(GL_TIME_ELAPSED_EXT);
+    }
+}
+
+status_t GLES20RenderEngine::getGpuTimerResult(uint32_t timer,
+        nsecs_t* outElapsed) {
+    if (!mHasTimerQuery) {
+        return RenderEngine::getGpuTimerResult(timer, outElapsed);
+    }
+    if (!isGpuTimerValid(timer)) {
+        return NAME_NOT_FOUND;
+    }
+    const GLuint query = mTimerQueries[getGpuTimerSlot(timer)];
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuivEXT(query, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+    if (!available) {
+        return WOULD_BLOCK;
+    }
+    releaseGpuTimer(timer);
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64vEXT(query, GL_QUERY_RESULT_EXT, &elapsed);
+    *outElapsed = static_cast<nsecs_t>(elapsed);
+    return NO_ERROR;
+}
+
+void GLES20RenderEngine::checkGpuTimers() {
+    if (!mTimerQueriesCreated) {
+        return;
+    }
+    // A disjoint event makes the results of every query in flight
+    // meaningless. Reading the flag clears it, so it is only read here.
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint) {
+        releaseAllGpuTimers();
+        mNumDisjointFrames++;
+    }
 }
 
 void GLES20RenderEngine::dump(String8& result) {
     RenderEngine::dump(result);
+    if (mHasTimerQuery) {
+        result.appendFormat("GPU timers: GL_EXT_disjoint_timer_query, "
+                "%u disjoint frames\n", mNumDisjointFrames);
+    } else {
+        result.append("GPU timers: native fences\n");
+    }
 }
 
 void GLES20RenderEngine::setupLayerMasking(const Texture& maskTexture, float alphaThreshold) {
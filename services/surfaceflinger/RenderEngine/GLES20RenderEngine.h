@@ -24,6 +24,8 @@
 #include <GLES2/gl2.h>
 #include <Transform.h>
 
+#include <vector>
+
 #include "RenderEngine.h"
 #include "ProgramCache.h"
 #include "Description.h"
@@ -57,6 +59,32 @@ class GLES20RenderEngine : public RenderEngine {
     Description mState;
     Vector<Group> mGroupStack;
 
+    // GL_EXT_disjoint_timer_query objects backing the GPU timers, created
+    // on first use
+    bool mHasTimerQuery;
+    bool mTimerQueriesCreated;
+    GLuint mTimerQueries[MAX_GPU_TIMERS];
+    // number of frames whose GPU timers were dropped because of a GPU
+    // disjoint event
+    uint32_t mNumDisjointFrames;
+
+    // Vertices of the meshes given to uploadMeshes, packed in mMeshBuffer
+    struct BatchedMesh {
+        const Mesh* mesh;
+        // generation of the mesh when it was uploaded
+        uint32_t generation;
+        // offset and size of its vertices in mMeshBatchData, in floats
+        size_t offset;
+        size_t size;
+    };
+    GLuint mMeshBuffer;
+    std::vector<BatchedMesh> mMeshBatch;
+    std::vector<float> mMeshBatchData;
+    // index in mMeshBatch of the mesh likely to be drawn next
+    size_t mNextBatchedMesh;
+
+    const BatchedMesh* findBatchedMesh(const Mesh& mesh);
+
     virtual void bindImageAsFramebuffer(EGLImageKHR image,
             uint32_t* texName, uint32_t* fbName, uint32_t* status,
             bool useReadPixels, int reqWidth, int reqHeight);
@@ -93,6 +121,13 @@ protected:
     virtual void disableLayerMasking();
 
     virtual void drawMesh(const Mesh& mesh);
+    virtual void uploadMeshes(const Vector<const Mesh*>& meshes);
+    virtual void clearMeshes();
+
+    virtual uint32_t beginGpuTimer();
+    virtual void endGpuTimer(uint32_t timer);
+    virtual status_t getGpuTimerResult(uint32_t timer, nsecs_t* outElapsed);
+    virtual void checkGpuTimers();
 
     virtual size_t getMaxTextureSize() const;
     virtual size_t getMaxViewportDims() const;
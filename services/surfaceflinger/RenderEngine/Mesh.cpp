@@ -22,7 +22,7 @@ namespace android {
 
 Mesh::Mesh(Primitive primitive, size_t vertexCount, size_t vertexSize, size_t texCoordSize)
     : mVertexCount(vertexCount), mVertexSize(vertexSize), mTexCoordsSize(texCoordSize),
-      mPrimitive(primitive)
+      mPrimitive(primitive), mGeneration(0)
 {
     if (vertexCount == 0) {
         mVertices = new float[1];
@@ -96,4 +96,8 @@ size_t Mesh::getStride() const {
     return mStride;
 }
 
+uint32_t Mesh::getGeneration() const {
+    return mGeneration;
+}
+
 } /* namespace android */
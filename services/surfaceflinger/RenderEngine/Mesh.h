@@ -51,10 +51,16 @@ public:
     };
 
     template <typename TYPE>
-    VertexArray<TYPE> getPositionArray() { return VertexArray<TYPE>(getPositions(), mStride); }
+    VertexArray<TYPE> getPositionArray() {
+        mGeneration++;
+        return VertexArray<TYPE>(getPositions(), mStride);
+    }
 
     template <typename TYPE>
-    VertexArray<TYPE> getTexCoordArray() { return VertexArray<TYPE>(getTexCoords(), mStride); }
+    VertexArray<TYPE> getTexCoordArray() {
+        mGeneration++;
+        return VertexArray<TYPE>(getTexCoords(), mStride);
+    }
 
     Primitive getPrimitive() const;
 
@@ -79,6 +85,9 @@ public:
     // return stride in floats
     size_t getStride() const;
 
+    // changes whenever the vertices may have been written
+    uint32_t getGeneration() const;
+
 private:
     Mesh(const Mesh&);
     Mesh& operator = (const Mesh&);
@@ -92,6 +101,7 @@ private:
     size_t mTexCoordsSize;
     size_t mStride;
     Primitive mPrimitive;
+    uint32_t mGeneration;
 };
 
 
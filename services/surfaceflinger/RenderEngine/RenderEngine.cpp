@@ -15,6 +15,8 @@
  */
 
 #include <cutils/log.h>
+#include <gui/SyncFeatures.h>
+#include <ui/Fence.h>
 #include <ui/Rect.h>
 #include <ui/Region.h>
 
@@ -147,7 +149,11 @@ RenderEngine* RenderEngine::create(EGLDisplay display, int hwcFormat) {
     return engine;
 }
 
-RenderEngine::RenderEngine() : mEGLConfig(NULL), mEGLContext(EGL_NO_CONTEXT) {
+RenderEngine::RenderEngine() : mEGLConfig(NULL), mEGLContext(EGL_NO_CONTEXT),
+        mGpuTimerSerial(NO_GPU_TIMER) {
+    for (size_t i = 0; i < MAX_GPU_TIMERS; i++) {
+        mFenceTimers[i].timer = NO_GPU_TIMER;
+    }
 }
 
 RenderEngine::~RenderEngine() {
@@ -249,6 +255,97 @@ void RenderEngine::readPixels(size_t l, size_t b, size_t w, size_t h, uint32_t*
     glReadPixels(l, b, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 }
 
+uint32_t RenderEngine::allocGpuTimer() {
+    mGpuTimerSerial++;
+    if (mGpuTimerSerial == NO_GPU_TIMER) {
+        mGpuTimerSerial++;
+    }
+    FenceTimer& slot(mFenceTimers[getGpuTimerSlot(mGpuTimerSerial)]);
+    slot.timer = mGpuTimerSerial;
+    slot.start.clear();
+    slot.end.clear();
+    return mGpuTimerSerial;
+}
+
+void RenderEngine::releaseGpuTimer(uint32_t timer) {
+    if (isGpuTimerValid(timer)) {
+        FenceTimer& slot(mFenceTimers[getGpuTimerSlot(timer)]);
+        slot.timer = NO_GPU_TIMER;
+        slot.start.clear();
+        slot.end.clear();
+    }
+}
+
+void RenderEngine::releaseAllGpuTimers() {
+    for (size_t i = 0; i < MAX_GPU_TIMERS; i++) {
+        releaseGpuTimer(mFenceTimers[i].timer);
+    }
+}
+
+bool RenderEngine::isGpuTimerValid(uint32_t timer) const {
+    return timer != NO_GPU_TIMER &&
+            mFenceTimers[getGpuTimerSlot(timer)].timer == timer;
+}
+
+sp<Fence> RenderEngine::createNativeFence() {
+    if (!SyncFeatures::getInstance().useNativeFenceSync()) {
+        return Fence::NO_FENCE;
+    }
+    EGLDisplay dpy = eglGetCurrentDisplay();
+    EGLSyncKHR sync = eglCreateSyncKHR(dpy, EGL_SYNC_NATIVE_FENCE_ANDROID, NULL);
+    if (sync == EGL_NO_SYNC_KHR) {
+        return Fence::NO_FENCE;
+    }
+    // native fence fd will not be populated until flush() is done.
+    flush();
+    int fenceFd = eglDupNativeFenceFDANDROID(dpy, sync);
+    eglDestroySyncKHR(dpy, sync);
+    if (fenceFd == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+        return Fence::NO_FENCE;
+    }
+    return new Fence(fenceFd);
+}
+
+uint32_t RenderEngine::beginGpuTimer() {
+    sp<Fence> start(createNativeFence());
+    if (!start->isValid()) {
+        return NO_GPU_TIMER;
+    }
+    uint32_t timer = allocGpuTimer();
+    mFenceTimers[getGpuTimerSlot(timer)].start = start;
+    return timer;
+}
+
+void RenderEngine::endGpuTimer(uint32_t timer) {
+    if (!isGpuTimerValid(timer)) {
+        return;
+    }
+    mFenceTimers[getGpuTimerSlot(timer)].end = createNativeFence();
+}
+
+status_t RenderEngine::getGpuTimerResult(uint32_t timer, nsecs_t* outElapsed) {
+    if (!isGpuTimerValid(timer)) {
+        return NAME_NOT_FOUND;
+    }
+    const FenceTimer& slot(mFenceTimers[getGpuTimerSlot(timer)]);
+    if (slot.end == NULL || !slot.end->isValid()) {
+        releaseGpuTimer(timer);
+        return NAME_NOT_FOUND;
+    }
+    const nsecs_t endTime = slot.end->getSignalTime();
+    if (endTime == INT64_MAX) {
+        return WOULD_BLOCK;
+    }
+    // the start fence is older, so it has signaled too
+    const nsecs_t startTime = slot.start->getSignalTime();
+    releaseGpuTimer(timer);
+    if (startTime <= 0 || endTime < startTime) {
+        return NAME_NOT_FOUND;
+    }
+    *outElapsed = endTime - startTime;
+    return NO_ERROR;
+}
+
 void RenderEngine::dump(String8& result) {
     const GLExtensions& extensions(GLExtensions::getInstance());
     result.appendFormat("GLES: %s, %s, %s\n",
@@ -24,6 +24,10 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 #include <ui/mat4.h>
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 #include <Transform.h>
 
 #define EGL_NO_CONFIG ((EGLConfig)0)
@@ -37,8 +41,16 @@ class Rect;
 class Region;
 class Mesh;
 class Texture;
+class Fence;
 
 class RenderEngine {
+public:
+    // GPU timers are recycled; a timer's result must be collected before
+    // MAX_GPU_TIMERS newer timers have been started, or it is lost.
+    enum { MAX_GPU_TIMERS = 64 };
+    enum { NO_GPU_TIMER = 0 };
+
+private:
     enum GlesVersion {
         GLES_VERSION_1_0    = 0x10000,
         GLES_VERSION_1_1    = 0x10001,
@@ -57,10 +69,30 @@ class RenderEngine {
     virtual void unbindFramebuffer(uint32_t texName, uint32_t fbName,
             bool useReadPixels) = 0;
 
+    // GPU timer slots; the fences are only used by the fence-based timers
+    struct FenceTimer {
+        uint32_t timer;
+        sp<Fence> start;
+        sp<Fence> end;
+    };
+    uint32_t mGpuTimerSerial;
+    FenceTimer mFenceTimers[MAX_GPU_TIMERS];
+    sp<Fence> createNativeFence();
+
 protected:
     RenderEngine();
     virtual ~RenderEngine() = 0;
 
+    // GPU timer bookkeeping shared by all timer implementations: each
+    // handle owns a slot until it is released or recycled.
+    uint32_t allocGpuTimer();
+    void releaseGpuTimer(uint32_t timer);
+    void releaseAllGpuTimers();
+    bool isGpuTimerValid(uint32_t timer) const;
+    static size_t getGpuTimerSlot(uint32_t timer) {
+        return timer % MAX_GPU_TIMERS;
+    }
+
 public:
     static RenderEngine* create(EGLDisplay display, int hwcFormat);
 
@@ -125,6 +157,28 @@ public:
     // drawing
     virtual void drawMesh(const Mesh& mesh) = 0;
 
+    // uploadMeshes copies the vertices of all the given meshes to the GPU in
+    // one transfer. Until clearMeshes is called, drawMesh reads the vertices
+    // of these meshes from that copy instead of from client memory, unless
+    // they changed in the meantime. The base implementation does nothing.
+    virtual void uploadMeshes(const Vector<const Mesh*>& /* meshes */) { }
+    virtual void clearMeshes() { }
+
+    // GPU timing, used to account the composition cost of each layer.
+    // beginGpuTimer/endGpuTimer bracket a sequence of GL commands and
+    // getGpuTimerResult returns the GPU time spent executing them. It never
+    // blocks: WOULD_BLOCK is returned until the GPU has caught up, and
+    // NAME_NOT_FOUND if the result was lost (timer recycled, GPU disjoint).
+    // The base implementation measures the delta between two native fences,
+    // which requires a flush on each call.
+    virtual uint32_t beginGpuTimer();
+    virtual void endGpuTimer(uint32_t timer);
+    virtual status_t getGpuTimerResult(uint32_t timer, nsecs_t* outElapsed);
+    // checkGpuTimers is called once per frame, before the results are
+    // collected and outside of any begin/end pair. Implementations whose
+    // timers can be invalidated by the GPU drop the pending ones here.
+    virtual void checkGpuTimers() { }
+
     // queries
     virtual size_t getMaxTextureSize() const = 0;
     virtual size_t getMaxViewportDims() const = 0;
@@ -54,6 +54,7 @@
 #include "DisplayDevice.h"
 #include "DispSync.h"
 #include "FenceTracker.h"
+#include "PhaseOffsetController.h"
 #include "FrameTracker.h"
 #include "MessageQueue.h"
 
@@ -244,6 +245,8 @@ private:
     virtual status_t getAnimationFrameStats(FrameStats* outStats) const;
     virtual status_t getHdrCapabilities(const sp<IBinder>& display,
             HdrCapabilities* outCapabilities) const;
+    virtual status_t getLayerCompositionStats(
+            std::vector<LayerCompositionStats>* outStats) const;
 
     /* ------------------------------------------------------------------------
      * DeathRecipient interface
@@ -465,13 +468,18 @@ private:
             Region& dirtyRegion, Region& opaqueRegion);
 
     void preComposition();
-    void postComposition(nsecs_t refreshStartTime);
+    void postComposition(nsecs_t refreshStartTime, nsecs_t expectedPresentTime);
+    void updatePhaseOffsets();
     void rebuildLayerStacks();
     void setUpHWComposer();
     void doComposition();
     void doDebugFlashRegions();
     void doDisplayComposition(const sp<const DisplayDevice>& hw, const Region& dirtyRegion);
 
+    // whether this frame can be partially redrawn using the back buffer's
+    // age (see DisplayDevice::SWAP_WITH_DAMAGE)
+    bool canComposePartially(const sp<const DisplayDevice>& hw);
+
     // compose surfaces for display hw. this fails if using GL and the surface
     // has been destroyed and is no longer valid.
     bool doComposeSurfaces(const sp<const DisplayDevice>& hw, const Region& dirty);
@@ -499,6 +507,10 @@ private:
     void listLayersLocked(const Vector<String16>& args, size_t& index, String8& result) const;
     void dumpStatsLocked(const Vector<String16>& args, size_t& index, String8& result) const;
     void clearStatsLocked(const Vector<String16>& args, size_t& index, String8& result);
+    void dumpLatencyHistogramsLocked(const Vector<String16>& args,
+            size_t& index, String8& result) const;
+    void dumpCompositionStatsLocked(const Vector<String16>& args, size_t& index,
+            String8& result) const;
     void dumpAllLocked(const Vector<String16>& args, size_t& index, String8& result) const;
     bool startDdmConnection();
     static void appendSfConfigString(String8& result);
@@ -586,11 +598,18 @@ private:
     bool mPropagateBackpressure = true;
 #endif
     bool mUseHwcVirtualDisplays = true;
+    // measure the GPU time of each GLES-composed layer (costs a flush per
+    // layer on GPUs without timer queries)
+    bool mLayerGpuTiming = false;
 
     // these are thread safe
     mutable MessageQueue mEventQueue;
     FrameTracker mAnimFrameTracker;
     DispSync mPrimaryDispSync;
+    // tunes the app and sf phase offsets when debug.sf.adaptive_phase_offsets
+    // is set; turned off from binder threads when an offset is forced
+    std::atomic<bool> mAdaptivePhaseOffsets{false};
+    PhaseOffsetController mPhaseOffsetController;
 
     // protected by mDestroyedLayerLock;
     mutable Mutex mDestroyedLayerLock;
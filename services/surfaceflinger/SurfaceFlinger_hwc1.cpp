@@ -131,6 +131,10 @@ static const int64_t vsyncPhaseOffsetNs = VSYNC_EVENT_PHASE_OFFSET_NS;
 // This is the phase offset at which SurfaceFlinger's composition runs.
 static const int64_t sfVsyncPhaseOffsetNs = SF_VSYNC_EVENT_PHASE_OFFSET_NS;
 
+// With adaptive phase offsets, the share of frames allowed to miss the
+// refresh they were composed for.
+static const float adaptivePhaseOffsetsMissRate = 0.01f;
+
 // ---------------------------------------------------------------------------
 
 const String16 sHardwareTest("android.permission.HARDWARE_TEST");
@@ -163,6 +167,8 @@ SurfaceFlinger::SurfaceFlinger()
         mBootFinished(false),
         mForceFullDamage(false),
         mPrimaryDispSync("PrimaryDispSync"),
+        mPhaseOffsetController(vsyncPhaseOffsetNs, sfVsyncPhaseOffsetNs,
+                adaptivePhaseOffsetsMissRate),
         mPrimaryHWVsyncEnabled(false),
         mHWVsyncAvailable(false),
         mDaltonize(false),
@@ -200,6 +206,14 @@ SurfaceFlinger::SurfaceFlinger()
     mUseHwcVirtualDisplays = !atoi(value);
     ALOGI_IF(!mUseHwcVirtualDisplays, "Disabling HWC virtual displays");
 
+    property_get("debug.sf.layer_gpu_timing", value, "0");
+    mLayerGpuTiming = atoi(value);
+    ALOGI_IF(mLayerGpuTiming, "Per-layer GPU timing enabled");
+
+    property_get("debug.sf.adaptive_phase_offsets", value, "0");
+    mAdaptivePhaseOffsets = atoi(value);
+    ALOGI_IF(mAdaptivePhaseOffsets, "Adaptive phase offsets enabled");
+
     // we store the value as orientation:
     // 90 -> 1, 180 -> 2, 270 -> 3
     mHardwareRotation = property_get_int32("ro.sf.hwrotation", 0) / 90;
@@ -852,6 +866,18 @@ status_t SurfaceFlinger::getAnimationFrameStats(FrameStats* outStats) const {
     return NO_ERROR;
 }
 
+status_t SurfaceFlinger::getLayerCompositionStats(
+        std::vector<LayerCompositionStats>* outStats) const {
+    Mutex::Autolock _l(mStateLock);
+    const LayerVector& currentLayers = mCurrentState.layersSortedByZ;
+    const size_t count = currentLayers.size();
+    outStats->resize(count);
+    for (size_t i=0 ; i<count ; i++) {
+        currentLayers[i]->getCompositionStats(&(*outStats)[i]);
+    }
+    return NO_ERROR;
+}
+
 status_t SurfaceFlinger::getHdrCapabilities(const sp<IBinder>& display,
         HdrCapabilities* outCapabilities) const {
 
@@ -1087,13 +1113,14 @@ void SurfaceFlinger::handleMessageRefresh() {
     ATRACE_CALL();
 
     nsecs_t refreshStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t expectedPresentTime = mPrimaryDispSync.computeNextRefresh(0);
 
     preComposition();
     rebuildLayerStacks();
     setUpHWComposer();
     doDebugFlashRegions();
     doComposition();
-    postComposition(refreshStartTime);
+    postComposition(refreshStartTime, expectedPresentTime);
 }
 
 void SurfaceFlinger::doDebugFlashRegions()
@@ -1110,6 +1137,7 @@ void SurfaceFlinger::doDebugFlashRegions()
             const Region dirtyRegion(hw->getDirtyRegion(repaintEverything));
             if (!dirtyRegion.isEmpty()) {
                 // redraw the whole screen
+                hw->resetFrameDamage();
                 doComposeSurfaces(hw, Region(hw->bounds()));
 
                 // and draw the dirty region
@@ -1151,8 +1179,14 @@ void SurfaceFlinger::preComposition()
     }
 }
 
-void SurfaceFlinger::postComposition(nsecs_t refreshStartTime)
+void SurfaceFlinger::postComposition(nsecs_t refreshStartTime,
+        nsecs_t expectedPresentTime)
 {
+    if (mLayerGpuTiming) {
+        // drops the GPU timers of this frame if the GPU was disjoint
+        getRenderEngine().checkGpuTimers();
+    }
+
     const LayerVector& layers(mDrawingState.layersSortedByZ);
     const size_t count = layers.size();
     for (size_t i=0 ; i<count ; i++) {
@@ -1181,9 +1215,13 @@ void SurfaceFlinger::postComposition(nsecs_t refreshStartTime)
         }
     }
 
-    mFenceTracker.addFrame(refreshStartTime, presentFence,
+    mFenceTracker.addFrame(refreshStartTime, expectedPresentTime, presentFence,
             hw->getVisibleLayersSortedByZ(), hw->getClientTargetAcquireFence());
 
+    if (mAdaptivePhaseOffsets && presentFence->isValid()) {
+        updatePhaseOffsets();
+    }
+
     if (mAnimCompositionPending) {
         mAnimCompositionPending = false;
 
@@ -1221,6 +1259,32 @@ void SurfaceFlinger::postComposition(nsecs_t refreshStartTime)
     mLastSwapTime = currentTime;
 }
 
+void SurfaceFlinger::updatePhaseOffsets() {
+    std::vector<FenceTracker::FrameTiming> frames;
+    mFenceTracker.getPresentedFrames(&frames);
+
+    const nsecs_t period = mPrimaryDispSync.getPeriod();
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    bool changed = false;
+    for (const auto& frame : frames) {
+        PhaseOffsetController::FrameTiming timing;
+        timing.refreshStartTime = frame.refreshStartTime;
+        timing.expectedPresentTime = frame.expectedPresentTime;
+        timing.compositionDoneTime = frame.compositionDoneTime;
+        timing.presentTime = frame.presentTime;
+        changed |= mPhaseOffsetController.addFrame(timing, period, now);
+    }
+
+    // a binder thread may have forced the offsets in the meantime
+    if (changed && mAdaptivePhaseOffsets &&
+            mEventThread != NULL && mSFEventThread != NULL) {
+        mEventThread->setPhaseOffset(
+                mPhaseOffsetController.getAppPhaseOffset());
+        mSFEventThread->setPhaseOffset(
+                mPhaseOffsetController.getSfPhaseOffset());
+    }
+}
+
 void SurfaceFlinger::rebuildLayerStacks() {
     updateExtendedMode();
     // rebuild the visible layer list per screen
@@ -2036,6 +2100,24 @@ void SurfaceFlinger::invalidateHwcGeometry()
 }
 
 
+bool SurfaceFlinger::canComposePartially(const sp<const DisplayDevice>& hw)
+{
+    // Only frames composed entirely with GLES can be partially redrawn:
+    // with overlays the framebuffer is cleared as a whole, and which layers
+    // it holds changes from frame to frame. Legacy HWCs without framebuffer
+    // target swap the buffers themselves, so we can't track buffer damage.
+    if (!(hw->getFlags() & DisplayDevice::SWAP_WITH_DAMAGE) || mForceFullDamage) {
+        return false;
+    }
+    const int32_t id = hw->getHwcDisplayId();
+    HWComposer& hwc(getHwComposer());
+    if (id < 0 || hwc.initCheck() != NO_ERROR) {
+        return true;
+    }
+    return hwc.supportsFramebufferTarget() && hwc.hasGlesComposition(id) &&
+            !hwc.hasHwcComposition(id) && !isS3DLayerPresent(hw);
+}
+
 void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
         const Region& inDirtyRegion)
 {
@@ -2066,10 +2148,18 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
             // This is needed because PARTIAL_UPDATES only takes one
             // rectangle instead of a region (see DisplayDevice::flip())
             dirtyRegion.set(hw->swapRegion.bounds());
+        } else if (canComposePartially(hw)) {
+            // Only this frame's changes are reported to the consumer, but
+            // what changed since the back buffer was last drawn into needs
+            // to be redrawn too, which doComposeSurfaces adds once the
+            // buffer is current.
+            hw->setFrameDamage(dirtyRegion);
+            hw->swapRegion = dirtyRegion;
         } else {
             // we need to redraw everything (the whole screen)
             dirtyRegion.set(hw->bounds());
             hw->swapRegion = dirtyRegion;
+            hw->resetFrameDamage();
         }
     }
 
@@ -2097,8 +2187,9 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
     hw->swapBuffers(getHwComposer());
 }
 
-bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const Region& dirty)
+bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const Region& inDirty)
 {
+    Region dirty(inDirty);
     RenderEngine& engine(getRenderEngine());
     const int32_t id = hw->getHwcDisplayId();
     HWComposer& hwc(getHwComposer());
@@ -2117,6 +2208,16 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
             return false;
         }
 
+        // When only part of the display is recomposed, the bounds of what
+        // changed since the back buffer was last drawn into are redrawn, the
+        // age of the buffer being known now that it is current. Every layer
+        // is drawn over all of these bounds, which are scissored below, so
+        // that nothing within them is left from the previous frame and
+        // blended over again.
+        if (hw->isComposingPartially()) {
+            dirty.set(hw->getRepaintRegion().getBounds());
+        }
+
         // Never touch the framebuffer if we don't have any framebuffer layers
         const bool hasHwcComposition = hwc.hasHwcComposition(id) ||
                     isS3DLayerPresent(hw);
@@ -2166,6 +2267,19 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
                         scissor.getWidth(), scissor.getHeight());
             }
         }
+
+        // When only part of the display is recomposed, keep the GPU from
+        // drawing outside of it: layers are drawn as whole quads, and the
+        // translucent ones would blend again over the previous frame.
+        const Rect repaintBounds(dirty.getBounds());
+        if (repaintBounds != hw->getBounds()) {
+            Rect scissor;
+            repaintBounds.intersect(hw->getScissor(), &scissor);
+            const uint32_t height = hw->getHeight();
+            engine.setScissor(scissor.left, height - scissor.bottom,
+                    scissor.getWidth(), scissor.getHeight());
+        }
+        hw->recordComposedRegion(dirty);
     }
 
     /*
@@ -2175,6 +2289,20 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
     const Vector< sp<Layer> >& layers(hw->getVisibleLayersSortedByZ());
     const size_t count = layers.size();
     const Transform& tr = hw->getTransform();
+    if (hasGlesComposition) {
+        // Upload the vertices of every layer drawn below at once
+        Vector<const Mesh*> meshes;
+        HWComposer::LayerListIterator it = cur;
+        for (size_t i=0 ; i<count ; ++i) {
+            if (it == end || it->getCompositionType() == HWC_FRAMEBUFFER) {
+                meshes.add(&layers[i]->getDrawMesh(hw, false));
+            }
+            if (it != end) {
+                ++it;
+            }
+        }
+        engine.uploadMeshes(meshes);
+    }
     if (cur != end) {
         // we're using h/w composer
         for (size_t i=0 ; i<count && cur!=end ; ++i, ++cur) {
@@ -2221,6 +2349,8 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
         }
     }
 
+    engine.clearMeshes();
+
     // disable scissor at the end of the frame
     engine.disableScissor();
     return true;
@@ -2833,10 +2963,20 @@ status_t SurfaceFlinger::dump(int fd, const Vector<String16>& args)
                 dumpAll = false;
             }
 
+            if ((index < numArgs) &&
+                    (args[index] == String16("--latency-histogram"))) {
+                index++;
+                dumpLatencyHistogramsLocked(args, index, result);
+                dumpAll = false;
+            }
+
             if ((index < numArgs) &&
                     (args[index] == String16("--dispsync"))) {
                 index++;
                 mPrimaryDispSync.dump(result);
+                if (mAdaptivePhaseOffsets) {
+                    mPhaseOffsetController.dump(result);
+                }
                 dumpAll = false;
             }
 
@@ -2853,6 +2993,13 @@ status_t SurfaceFlinger::dump(int fd, const Vector<String16>& args)
                 mFenceTracker.dump(&result);
                 dumpAll = false;
             }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--composition-cost"))) {
+                index++;
+                dumpCompositionStatsLocked(args, index, result);
+                dumpAll = false;
+            }
         }
 
         if (dumpAll) {
@@ -2920,12 +3067,71 @@ void SurfaceFlinger::clearStatsLocked(const Vector<String16>& args, size_t& inde
         const sp<Layer>& layer(currentLayers[i]);
         if (name.isEmpty() || (name == layer->getName())) {
             layer->clearFrameStats();
+            layer->clearCompositionStats();
         }
     }
 
     mAnimFrameTracker.clearStats();
 }
 
+void SurfaceFlinger::dumpLatencyHistogramsLocked(const Vector<String16>& args,
+        size_t& index, String8& result) const
+{
+    String8 name;
+    if (index < args.size()) {
+        name = String8(args[index]);
+        index++;
+    }
+
+    // Unlike --latency, these cover every frame since the last
+    // --latency-clear, and since the layer was created.
+    LatencyHistogram presentLatency;
+    LatencyHistogram readyLatency;
+    result.append("Layer frame latency:\n");
+    const LayerVector& currentLayers = mCurrentState.layersSortedByZ;
+    const size_t count = currentLayers.size();
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<Layer>& layer(currentLayers[i]);
+        if (name.isEmpty() || (name == layer->getName())) {
+            result.appendFormat("  %s:\n", layer->getName().string());
+            layer->dumpLatencyHistograms(result);
+            layer->mergeLatencyHistograms(&presentLatency, &readyLatency,
+                    true);
+        }
+    }
+    if (name.isEmpty()) {
+        result.append("  all layers since clear:\n");
+        result.append("      desired-present to present: ");
+        presentLatency.dump(result);
+        result.append("      ready to present: ");
+        readyLatency.dump(result);
+    }
+}
+
+void SurfaceFlinger::dumpCompositionStatsLocked(const Vector<String16>& args,
+        size_t& index, String8& result) const
+{
+    String8 name;
+    if (index < args.size()) {
+        name = String8(args[index]);
+        index++;
+    }
+
+    // Cost of composing each layer with the GPU over its last
+    // CompositionCostTracker::NUM_SAMPLE_RECORDS composition passes
+    result.appendFormat("Layer composition cost (GPU timing %s):\n",
+            mLayerGpuTiming ? "on" : "off, set debug.sf.layer_gpu_timing");
+    const LayerVector& currentLayers = mCurrentState.layersSortedByZ;
+    const size_t count = currentLayers.size();
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<Layer>& layer(currentLayers[i]);
+        if (name.isEmpty() || (name == layer->getName())) {
+            result.appendFormat("  %s: ", layer->getName().string());
+            layer->dumpCompositionStats(result);
+        }
+    }
+}
+
 // This should only be called from the main thread.  Otherwise it would need
 // the lock and should use mCurrentState rather than mDrawingState.
 void SurfaceFlinger::logFrameStats() {
@@ -3222,6 +3428,7 @@ status_t SurfaceFlinger::onTransact(
         case GET_ANIMATION_FRAME_STATS:
         case SET_POWER_MODE:
         case GET_HDR_CAPABILITIES:
+        case GET_LAYER_COMPOSITION_STATS:
         {
             // codes that require permission check
             IPCThreadState* ipc = IPCThreadState::self();
@@ -3371,12 +3578,14 @@ status_t SurfaceFlinger::onTransact(
             }
             case 1018: { // Modify Choreographer's phase offset
                 n = data.readInt32();
+                mAdaptivePhaseOffsets = false;
                 if (mEventThread != NULL)
                     mEventThread->setPhaseOffset(static_cast<nsecs_t>(n));
                 return NO_ERROR;
             }
             case 1019: { // Modify SurfaceFlinger's phase offset
                 n = data.readInt32();
+                mAdaptivePhaseOffsets = false;
                 if (mSFEventThread != NULL)
                     mSFEventThread->setPhaseOffset(static_cast<nsecs_t>(n));
                 return NO_ERROR;
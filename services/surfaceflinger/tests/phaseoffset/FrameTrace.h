@@ -0,0 +1,345 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PHASEOFFSET_FRAMETRACE_H
+#define ANDROID_PHASEOFFSET_FRAMETRACE_H
+
+#include <utils/Timers.h>
+
+namespace android {
+
+struct TracedFrame {
+    // hardware vsync timestamp SurfaceFlinger woke up after
+    nsecs_t vsyncTime;
+    // when the present fence of the frame composed after vsyncTime signaled
+    nsecs_t presentTime;
+    // how long the frame took to compose, in microseconds
+    nsecs_t compositionUs;
+};
+
+// 600 consecutive frames of a display composed at the configured phase
+// offsets. Like on a real panel, the vsync timestamps jitter by tens of
+// microseconds around a period that is a little longer than 60Hz and
+// drifts, and present fences signal a little after the vsync the frame was
+// shown at. Frames 211 and 478 took longer than a period and were shown a
+// refresh late.
+static const TracedFrame kFrameTrace[] = {
+    { 83412001489, 83428885299, 2091 }, { 83428696308, 83445517161, 2572 },
+    { 83445391180, 83462164295, 2543 }, { 83462077093, 83478830890, 2210 },
+    { 83478736570, 83495505770, 2754 }, { 83495418351, 83512183757, 2297 },
+    { 83512114411, 83528917451, 2598 }, { 83528828395, 83545584361, 1732 },
+    { 83545438372, 83562197434, 2618 }, { 83562147853, 83578930629, 1820 },
+    { 83578835324, 83595630900, 2582 }, { 83595527202, 83612385507, 2094 },
+    { 83612166361, 83628959567, 2063 }, { 83628871991, 83645709438, 2149 },
+    { 83645529509, 83662424271, 2339 }, { 83662272107, 83679099132, 2291 },
+    { 83678980180, 83695820842, 2229 }, { 83695606195, 83712374828, 2168 },
+    { 83712311646, 83729234228, 2311 }, { 83729025130, 83745840587, 2195 },
+    { 83745691265, 83762537267, 2399 }, { 83762380878, 83779167555, 2326 },
+    { 83779068191, 83795782392, 2208 }, { 83795714013, 83812608470, 2237 },
+    { 83812391472, 83829246790, 1700 }, { 83829108620, 83845957626, 2061 },
+    { 83845757658, 83862542136, 2373 }, { 83862455688, 83879337043, 2426 },
+    { 83879152746, 83895886030, 2450 }, { 83895781340, 83912664772, 2182 },
+    { 83912456510, 83929361529, 2259 }, { 83929180680, 83946001717, 2499 },
+    { 83945882818, 83962753135, 2284 }, { 83962568090, 83979320621, 2194 },
+    { 83979196957, 83995990138, 2231 }, { 83995912976, 84012630680, 2477 },
+    { 84012580146, 84029337463, 2255 }, { 84029246093, 84046095321, 2293 },
+    { 84045940629, 84062852463, 2650 }, { 84062641765, 84079515563, 2340 },
+    { 84079320837, 84096205041, 2343 }, { 84096046471, 84112831207, 1900 },
+    { 84112710221, 84129482113, 2137 }, { 84129384173, 84146217716, 2356 },
+    { 84146085556, 84162907772, 1723 }, { 84162709034, 84179637065, 2279 },
+    { 84179432732, 84196245953, 2128 }, { 84196111455, 84212903953, 1857 },
+    { 84212793630, 84229658511, 2232 }, { 84229521870, 84246343426, 2279 },
+    { 84246196951, 84262953606, 2307 }, { 84262847770, 84279641847, 2756 },
+    { 84279500359, 84296324349, 2416 }, { 84296238414, 84312939302, 2397 },
+    { 84312892798, 84329728415, 2299 }, { 84329604163, 84346409668, 1926 },
+    { 84346285526, 84363009209, 2470 }, { 84362896998, 84379686881, 2604 },
+    { 84379587710, 84396386266, 2255 }, { 84396329412, 84413078699, 1844 },
+    { 84412992111, 84429788307, 2459 }, { 84429674111, 84446530905, 2466 },
+    { 84446346951, 84463111136, 2117 }, { 84463065437, 84479862432, 2177 },
+    { 84479729761, 84496601568, 1929 }, { 84496390368, 84513167036, 2044 },
+    { 84513094644, 84529924787, 2177 }, { 84529767169, 84546617522, 1924 },
+    { 84546420730, 84563144917, 2418 }, { 84563090143, 84579941682, 2326 },
+    { 84579786253, 84596672470, 1980 }, { 84596530576, 84613305409, 2044 },
+    { 84613196037, 84630001328, 2068 }, { 84629832155, 84646619862, 2006 },
+    { 84646567539, 84663375209, 2670 }, { 84663219429, 84679941658, 2491 },
+    { 84679901249, 84696777881, 2069 }, { 84696617426, 84713376289, 2632 },
+    { 84713316639, 84730071762, 2155 }, { 84729971225, 84746682617, 2437 },
+    { 84746600260, 84763507773, 2156 }, { 84763313539, 84780226537, 2251 },
+    { 84780020051, 84796737291, 2185 }, { 84796663634, 84813609597, 5803 },
+    { 84813406568, 84830113076, 2411 }, { 84830060534, 84846919705, 2230 },
+    { 84846723767, 84863439685, 1984 }, { 84863396421, 84880277987, 2386 },
+    { 84880127278, 84896979984, 2258 }, { 84896783845, 84913509745, 2369 },
+    { 84913448559, 84930264870, 2169 }, { 84930152500, 84946954193, 2163 },
+    { 84946809350, 84963680418, 2201 }, { 84963522848, 84980357087, 2125 },
+    { 84980187759, 84997005664, 2357 }, { 84996884395, 85013758962, 2005 },
+    { 85013590855, 85030490522, 2275 }, { 85030284645, 85047022060, 10916 },
+    { 85046912807, 85063729925, 2723 }, { 85063612326, 85080465404, 2062 },
+    { 85080313463, 85097098312, 2264 }, { 85096973692, 85113718715, 1841 },
+    { 85113639048, 85130546792, 2197 }, { 85130371388, 85147133180, 2378 },
+    { 85147040280, 85163768908, 2236 }, { 85163724910, 85180565804, 1923 },
+    { 85180413195, 85197170155, 2072 }, { 85197086380, 85213887214, 2439 },
+    { 85213742536, 85230491349, 2433 }, { 85230441681, 85247185381, 2513 },
+    { 85247105168, 85263886050, 2005 }, { 85263814848, 85280646960, 2348 },
+    { 85280499173, 85297334032, 2214 }, { 85297187076, 85313864672, 2179 },
+    { 85313813908, 85330617798, 2070 }, { 85330537858, 85347334431, 5389 },
+    { 85347244256, 85364115467, 2133 }, { 85363912795, 85380747196, 2075 },
+    { 85380613921, 85397330426, 1995 }, { 85397244225, 85414124108, 2261 },
+    { 85413925263, 85430807083, 2461 }, { 85430609435, 85447527924, 1837 },
+    { 85447310364, 85464164820, 2080 }, { 85464029737, 85480778975, 2231 },
+    { 85480707444, 85497484779, 2464 }, { 85497336671, 85514122224, 2299 },
+    { 85514045290, 85530786686, 2455 }, { 85530741933, 85547538155, 2067 },
+    { 85547429223, 85564328883, 2063 }, { 85564146553, 85580895043, 2476 },
+    { 85580743587, 85597484405, 2351 }, { 85597432902, 85614407755, 2338 },
+    { 85614230800, 85631051830, 2254 }, { 85630866047, 85647644894, 2060 },
+    { 85647499481, 85664246093, 2477 }, { 85664182840, 85681069694, 2579 },
+    { 85680860675, 85697648509, 2499 }, { 85697549739, 85714357027, 2138 },
+    { 85714283319, 85731041035, 1847 }, { 85730908593, 85747659068, 2523 },
+    { 85747611400, 85764514139, 2392 }, { 85764300993, 85781084697, 2423 },
+    { 85781005913, 85797851130, 2345 }, { 85797664964, 85814405066, 2305 },
+    { 85814335578, 85831257114, 2354 }, { 85831040239, 85847920177, 2413 },
+    { 85847725175, 85864469729, 2234 }, { 85864375630, 85881176610, 2026 },
+    { 85881074586, 85897856458, 2373 }, { 85897743257, 85914618750, 2178 },
+    { 85914457265, 85931208094, 2767 }, { 85931128914, 85947912122, 2182 },
+    { 85947830859, 85964555549, 2346 }, { 85964487190, 85981398654, 1961 },
+    { 85981182414, 85997966408, 2450 }, { 85997864209, 86014749378, 2418 },
+    { 86014545403, 86031309048, 2443 }, { 86031240883, 86048120508, 2366 },
+    { 86047913414, 86064812546, 1868 }, { 86064608139, 86081499474, 2205 },
+    { 86081300412, 86098083301, 2579 }, { 86097985568, 86114843049, 2051 },
+    { 86114664568, 86131574733, 1862 }, { 86131368887, 86148165878, 2203 },
+    { 86147995647, 86164806037, 2366 }, { 86164654067, 86181458343, 2302 },
+    { 86181329210, 86198065796, 2344 }, { 86198013211, 86214796771, 1879 },
+    { 86214745140, 86231495809, 2181 }, { 86231407071, 86248296273, 2250 },
+    { 86248140302, 86264849114, 2227 }, { 86264788530, 86281507820, 2348 },
+    { 86281440198, 86298379173, 2310 }, { 86298164020, 86314915259, 2204 },
+    { 86314817033, 86331686477, 2391 }, { 86331495939, 86348356867, 2292 },
+    { 86348208473, 86364971609, 2247 }, { 86364907175, 86381617783, 2424 },
+    { 86381562264, 86398360465, 2440 }, { 86398230619, 86415072579, 2235 },
+    { 86414943211, 86431716720, 1949 }, { 86431668939, 86448347263, 2371 },
+    { 86448304363, 86465196667, 2131 }, { 86464987897, 86481894014, 2511 },
+    { 86481688195, 86498440723, 2452 }, { 86498338877, 86515082029, 5309 },
+    { 86515038720, 86531845062, 2371 }, { 86531716366, 86548527238, 2238 },
+    { 86548401133, 86565257482, 2574 }, { 86565097664, 86581955136, 2278 },
+    { 86581749749, 86598595286, 2135 }, { 86598500372, 86615183120, 2095 },
+    { 86615121823, 86631932844, 2260 }, { 86631829537, 86648524288, 2423 },
+    { 86648468983, 86665214235, 2228 }, { 86665141448, 86682002622, 2499 },
+    { 86681844390, 86698770492, 2364 }, { 86698554133, 86715265761, 2215 },
+    { 86715174281, 86732071436, 2272 }, { 86731861962, 86748790370, 1916 },
+    { 86748614777, 86765544779, 2301 }, { 86765328053, 86782103533, 2556 },
+    { 86781952172, 86798775098, 2147 }, { 86798652314, 86815542660, 2249 },
+    { 86815325547, 86832209523, 2079 }, { 86832037090, 86848844569, 1954 },
+    { 86848666616, 86865469119, 2588 }, { 86865366922, 86882160859, 2094 },
+    { 86882046837, 86898801254, 2221 }, { 86898740170, 86915523199, 2366 },
+    { 86915431497, 86932194528, 2157 }, { 86932073945, 86965637388, 17112 },
+    { 86948789360, 86965617358, 2356 }, { 86965451969, 86982293155, 2139 },
+    { 86982199185, 86999011662, 2329 }, { 86998835513, 87015700958, 2014 },
+    { 87015499837, 87032245645, 2487 }, { 87032161629, 87048885589, 2735 },
+    { 87048830294, 87065606252, 2150 }, { 87065523761, 87082376671, 2177 },
+    { 87082263346, 87099100949, 2192 }, { 87098904198, 87115794548, 2706 },
+    { 87115593499, 87132453285, 2389 }, { 87132284882, 87149092768, 2371 },
+    { 87149016581, 87165705477, 2301 }, { 87165653474, 87182447732, 2520 },
+    { 87182335706, 87199208761, 2002 }, { 87199045114, 87215803541, 1966 },
+    { 87215692194, 87232519410, 2201 }, { 87232401335, 87249250464, 2071 },
+    { 87249097029, 87265924903, 2269 }, { 87265752311, 87282496808, 2339 },
+    { 87282430486, 87299271877, 2601 }, { 87299091024, 87315991477, 2379 },
+    { 87315813861, 87332691726, 1892 }, { 87332515233, 87349316876, 1888 },
+    { 87349203943, 87365885741, 2083 }, { 87365831241, 87382798205, 2212 },
+    { 87382600214, 87399303582, 2307 }, { 87399228613, 87416104576, 1991 },
+    { 87415908406, 87432755489, 2503 }, { 87432583698, 87449306343, 2288 },
+    { 87449255096, 87466168833, 2451 }, { 87465963215, 87482669338, 2042 },
+    { 87482616686, 87499488668, 2325 }, { 87499384130, 87516194112, 2617 },
+    { 87516016082, 87532896345, 2331 }, { 87532709809, 87549650280, 2540 },
+    { 87549440870, 87566213756, 1927 }, { 87566072849, 87582784886, 2465 },
+    { 87582728078, 87599512537, 2476 }, { 87599409168, 87616174859, 2210 },
+    { 87616118671, 87632828469, 2371 }, { 87632773322, 87649618284, 2266 },
+    { 87649492970, 87666214318, 2090 }, { 87666158456, 87683108164, 2405 },
+    { 87682888898, 87699745432, 2492 }, { 87699533850, 87716431091, 2035 },
+    { 87716235241, 87733042496, 6309 }, { 87732913390, 87749680648, 2130 },
+    { 87749592780, 87766382433, 2403 }, { 87766243501, 87782979818, 2300 },
+    { 87782926385, 87799694389, 1871 }, { 87799579710, 87816365267, 2334 },
+    { 87816305729, 87833101008, 2368 }, { 87832991324, 87849880224, 1848 },
+    { 87849689839, 87866579986, 2411 }, { 87866410706, 87883233337, 2314 },
+    { 87883104529, 87899784461, 2259 }, { 87899735863, 87916550817, 1967 },
+    { 87916492886, 87933270269, 6164 }, { 87933116448, 87949941775, 2099 },
+    { 87949803650, 87966553121, 2058 }, { 87966431405, 87983275314, 2337 },
+    { 87983118119, 88000047096, 2121 }, { 87999843017, 88016719351, 2149 },
+    { 88016507356, 88033423052, 2496 }, { 88033214887, 88050098671, 2197 },
+    { 88049891982, 88066782982, 2234 }, { 88066579406, 88083352359, 2185 },
+    { 88083271423, 88100137208, 2350 }, { 88099925269, 88116656424, 2161 },
+    { 88116567496, 88133470090, 2757 }, { 88133285566, 88149993930, 2678 },
+    { 88149950375, 88166882123, 2557 }, { 88166668407, 88183415981, 1886 },
+    { 88183343867, 88200260626, 2024 }, { 88200054264, 88216806376, 2186 },
+    { 88216705448, 88233545831, 6118 }, { 88233349487, 88250250553, 2074 },
+    { 88250122771, 88266902324, 2348 }, { 88266774420, 88283661329, 2302 },
+    { 88283443282, 88300291010, 2568 }, { 88300128190, 88316962565, 2542 },
+    { 88316824511, 88333557595, 2700 }, { 88333473037, 88350339740, 1943 },
+    { 88350149490, 88367071807, 2416 }, { 88366910742, 88383585200, 2047 },
+    { 88383508885, 88400365667, 2527 }, { 88400252597, 88416994685, 2485 },
+    { 88416886418, 88433664445, 2388 }, { 88433591392, 88450514371, 2327 },
+    { 88450294431, 88467124080, 2305 }, { 88467015048, 88483764053, 2374 },
+    { 88483623783, 88500458243, 1920 }, { 88500319536, 88517128466, 5837 },
+    { 88516991498, 88533791036, 2191 }, { 88533693511, 88550561009, 2001 },
+    { 88550383942, 88567182432, 2216 }, { 88567070134, 88583970941, 2545 },
+    { 88583754881, 88600623154, 1985 }, { 88600456540, 88617235846, 2164 },
+    { 88617157244, 88634046272, 2093 }, { 88633835721, 88650516136, 2146 },
+    { 88650462822, 88667288300, 2301 }, { 88667197372, 88683888176, 2248 },
+    { 88683818876, 88700633411, 1867 }, { 88700494031, 88717279550, 2295 },
+    { 88717202542, 88734004572, 1921 }, { 88733910592, 88750763578, 2554 },
+    { 88750563357, 88767499345, 2214 }, { 88767288760, 88784159060, 2090 },
+    { 88783972678, 88800762970, 1704 }, { 88800642488, 88817396884, 2426 },
+    { 88817338099, 88834072286, 2244 }, { 88834006771, 88850750458, 2053 },
+    { 88850694001, 88867569452, 1981 }, { 88867356938, 88884252013, 2614 },
+    { 88884051151, 88900883944, 2117 }, { 88900740483, 88917489232, 2543 },
+    { 88917392669, 88934269014, 2624 }, { 88934153487, 88950933444, 2047 },
+    { 88950793125, 88967583935, 2239 }, { 88967476900, 88984229547, 10581 },
+    { 88984155494, 89001040095, 2380 }, { 89000846811, 89017591459, 2194 },
+    { 89017547562, 89034261316, 2391 }, { 89034153221, 89051029115, 2244 },
+    { 89050930451, 89067772275, 2591 }, { 89067558967, 89084482224, 2225 },
+    { 89084293082, 89101097219, 2294 }, { 89100927842, 89117764459, 2250 },
+    { 89117616396, 89134432151, 2372 }, { 89134369211, 89151160912, 2525 },
+    { 89150986634, 89167865796, 2493 }, { 89167681012, 89184418681, 6842 },
+    { 89184361049, 89201132379, 2030 }, { 89201038958, 89217860574, 2169 },
+    { 89217737321, 89234606135, 2103 }, { 89234419419, 89251217852, 2039 },
+    { 89251109034, 89267924202, 2396 }, { 89267841740, 89284608327, 2438 },
+    { 89284451873, 89301336439, 1971 }, { 89301175002, 89318005191, 2164 },
+    { 89317829260, 89334655310, 2193 }, { 89334496447, 89351323862, 2151 },
+    { 89351211667, 89367968401, 2181 }, { 89367872068, 89384703818, 1707 },
+    { 89384533708, 89401378498, 2176 }, { 89401228832, 89418128862, 2217 },
+    { 89417939711, 89434811727, 2163 }, { 89434608984, 89451470289, 2255 },
+    { 89451308045, 89468082868, 2465 }, { 89468004280, 89484870211, 2209 },
+    { 89484659240, 89501454489, 2181 }, { 89501355305, 89518187465, 2096 },
+    { 89518043468, 89534776405, 2572 }, { 89534722660, 89551531935, 2460 },
+    { 89551433273, 89568248402, 2502 }, { 89568078431, 89584860515, 2837 },
+    { 89584787166, 89601597194, 1800 }, { 89601461977, 89618278768, 2172 },
+    { 89618117063, 89634868005, 1700 }, { 89634790484, 89651633736, 2004 },
+    { 89651490809, 89668282206, 2567 }, { 89668165227, 89685039294, 2297 },
+    { 89684903045, 89701765247, 2119 }, { 89701548306, 89718365562, 2511 },
+    { 89718252293, 89735048935, 2222 }, { 89734922981, 89751717353, 2152 },
+    { 89751613393, 89768509396, 2207 }, { 89768299094, 89785135860, 2006 },
+    { 89784946992, 89801808456, 2188 }, { 89801653198, 89818583951, 2170 },
+    { 89818365126, 89835141260, 2021 }, { 89834987972, 89851837544, 2122 },
+    { 89851736086, 89868482035, 2297 }, { 89868380997, 89885273293, 2269 },
+    { 89885096289, 89901972615, 1890 }, { 89901771201, 89918657215, 1984 },
+    { 89918464858, 89935216723, 2786 }, { 89935169255, 89952006065, 2497 },
+    { 89951790799, 89968723359, 2646 }, { 89968523430, 89985338205, 2346 },
+    { 89985201024, 90001951370, 2147 }, { 90001874545, 90018657220, 2212 },
+    { 90018530872, 90035396544, 2344 }, { 90035239647, 90052015993, 2608 },
+    { 90051883661, 90068657925, 2228 }, { 90068594791, 90085480406, 2460 },
+    { 90085298566, 90102004651, 2600 }, { 90101940417, 90118798757, 2297 },
+    { 90118668640, 90135479518, 2143 }, { 90135331850, 90152130478, 2261 },
+    { 90152040284, 90168776504, 2176 }, { 90168725373, 90185535360, 1969 },
+    { 90185381501, 90202227208, 2110 }, { 90202050460, 90218890949, 1946 },
+    { 90218805938, 90235644069, 2360 }, { 90235424311, 90252303432, 2223 },
+    { 90252106602, 90268928426, 2044 }, { 90268807689, 90285558791, 2280 },
+    { 90285486267, 90302278364, 2476 }, { 90302190424, 90319067152, 2217 },
+    { 90318923429, 90335604073, 1700 }, { 90335535659, 90352475229, 2386 },
+    { 90352258342, 90369048997, 2226 }, { 90368872595, 90385706023, 2480 },
+    { 90385572294, 90402376621, 1890 }, { 90402310308, 90419143700, 1794 },
+    { 90418986891, 90435817309, 2446 }, { 90435623582, 90452415687, 2432 },
+    { 90452360236, 90469205390, 2032 }, { 90468998773, 90485768641, 2154 },
+    { 90485688177, 90502629607, 2103 }, { 90502420672, 90519190119, 2433 },
+    { 90519093955, 90535848532, 1711 }, { 90535727411, 90552616539, 1971 },
+    { 90552427768, 90569335385, 2375 }, { 90569129398, 90585998786, 2469 },
+    { 90585821115, 90602678380, 2311 }, { 90602489857, 90619293498, 2108 },
+    { 90619187303, 90635963270, 2206 }, { 90635889250, 90652778655, 2257 },
+    { 90652623897, 90669263417, 1958 }, { 90669187501, 90686092125, 2305 },
+    { 90685886473, 90702709599, 2247 }, { 90702628093, 90719441150, 2517 },
+    { 90719286994, 90736048815, 2462 }, { 90735930635, 90752714231, 2183 },
+    { 90752650416, 90769412145, 2339 }, { 90769299268, 90786066383, 2469 },
+    { 90786015978, 90802762305, 2531 }, { 90802652074, 90819498226, 2459 },
+    { 90819363285, 90836190563, 2003 }, { 90836086927, 90852984704, 2375 },
+    { 90852801214, 90869546300, 2140 }, { 90869438514, 90886162098, 2483 },
+    { 90886118808, 90902934520, 2288 }, { 90902855675, 90919680069, 2124 },
+    { 90919482760, 90936247779, 2035 }, { 90936170499, 90953043176, 1857 },
+    { 90952846886, 90969699053, 1940 }, { 90969529701, 90986446495, 1861 },
+    { 90986245133, 91003037816, 2172 }, { 91002931693, 91019748112, 2371 },
+    { 91019620785, 91036421929, 2120 }, { 91036296916, 91053137815, 1916 },
+    { 91052930750, 91069856151, 2320 }, { 91069664777, 91086469867, 2217 },
+    { 91086370450, 91103208493, 2447 }, { 91103035971, 91119789456, 2183 },
+    { 91119728185, 91136596955, 2201 }, { 91136388359, 91153149117, 2423 },
+    { 91153051686, 91169883027, 2555 }, { 91169747357, 91186637295, 1961 },
+    { 91186463275, 91203166973, 2491 }, { 91203108150, 91220006747, 2116 },
+    { 91219815018, 91236602561, 2274 }, { 91236496166, 91253358729, 2323 },
+    { 91253177588, 91269977144, 2400 }, { 91269866827, 91286629313, 2199 },
+    { 91286507646, 91303411618, 2186 }, { 91303271422, 91320070082, 2368 },
+    { 91319910143, 91336707788, 2317 }, { 91336600211, 91353476225, 2145 },
+    { 91353299167, 91370111130, 2098 }, { 91369974522, 91386836217, 2524 },
+    { 91386636868, 91420251454, 18193 }, { 91403374363, 91420186432, 2133 },
+    { 91420048033, 91436892334, 2428 }, { 91436742505, 91453570149, 2465 },
+    { 91453418035, 91470214167, 2084 }, { 91470076800, 91486987136, 2196 },
+    { 91486798466, 91503598096, 2370 }, { 91503472877, 91520285941, 2202 },
+    { 91520102675, 91536940364, 2167 }, { 91536834442, 91553655358, 2319 },
+    { 91553502423, 91570277488, 2623 }, { 91570157334, 91586987486, 2061 },
+    { 91586847321, 91603724190, 1994 }, { 91603524246, 91620398203, 2078 },
+    { 91620257167, 91636995210, 5435 }, { 91636934678, 91653674356, 2295 },
+    { 91653600628, 91670378694, 2567 }, { 91670297132, 91687114178, 2688 },
+    { 91686992554, 91703782012, 2349 }, { 91703672560, 91720482319, 2274 },
+    { 91720367762, 91737095847, 2127 }, { 91737036611, 91753777029, 2706 },
+    { 91753662741, 91770418503, 2052 }, { 91770368874, 91787246470, 1823 },
+    { 91787051202, 91803791536, 2093 }, { 91803723889, 91820604728, 2393 },
+    { 91820433458, 91837246277, 2573 }, { 91837134723, 91854004743, 2397 },
+    { 91853824407, 91870623821, 2188 }, { 91870481818, 91887280802, 2168 },
+    { 91887235881, 91903949506, 1917 }, { 91903901246, 91920694248, 2086 },
+    { 91920566552, 91937365374, 2298 }, { 91937260446, 91953977143, 2497 },
+    { 91953890409, 91970818307, 2201 }, { 91970620487, 91987409181, 2262 },
+    { 91987248313, 92004161295, 2632 }, { 92003992378, 92020812836, 2300 },
+    { 92020661869, 92037602039, 2213 }, { 92037384786, 92054196393, 2047 },
+    { 92053993177, 92070877768, 2291 }, { 92070732505, 92087448970, 2141 },
+    { 92087392460, 92104191809, 2082 }, { 92104101013, 92120907318, 2439 },
+    { 92120747182, 92137589751, 2032 }, { 92137455887, 92154216737, 2093 },
+    { 92154176115, 92170872029, 2345 }, { 92170810693, 92187534892, 2261 },
+    { 92187474469, 92204286623, 2328 }, { 92204238328, 92221125713, 1891 },
+    { 92220928226, 92237680118, 2577 }, { 92237546346, 92254344799, 2322 },
+    { 92254224188, 92271119504, 2303 }, { 92270922415, 92287643463, 2263 },
+    { 92287597739, 92304388775, 2559 }, { 92304269588, 92321157237, 2282 },
+    { 92320977827, 92337879548, 2188 }, { 92337668279, 92354449724, 2136 },
+    { 92354306148, 92371137417, 2285 }, { 92371023163, 92387844567, 2271 },
+    { 92387743588, 92404544653, 2978 }, { 92404403700, 92421251885, 2404 },
+    { 92421153193, 92437930633, 2267 }, { 92437749445, 92454572608, 10289 },
+    { 92454461280, 92471203646, 1931 }, { 92471111466, 92487958378, 2071 },
+    { 92487799022, 92504660130, 2132 }, { 92504535527, 92521329997, 2377 },
+    { 92521137201, 92538027832, 2120 }, { 92537909853, 92554648134, 2367 },
+    { 92554520241, 92571301242, 2034 }, { 92571252148, 92588019741, 2036 },
+    { 92587924244, 92604766740, 2172 }, { 92604599146, 92621435087, 2375 },
+    { 92621288588, 92638125621, 2119 }, { 92637996282, 92654769742, 2417 },
+    { 92654698835, 92671499970, 2286 }, { 92671374289, 92688187266, 2102 },
+    { 92688059091, 92704949720, 2256 }, { 92704734142, 92721534016, 2088 },
+    { 92721378088, 92738203875, 1953 }, { 92738125906, 92754960931, 1978 },
+    { 92754745037, 92771570719, 2405 }, { 92771439087, 92788360135, 2163 },
+    { 92788144935, 92804998109, 1881 }, { 92804841346, 92821677271, 2329 },
+    { 92821502438, 92838284194, 2301 }, { 92838196607, 92854967454, 2143 },
+    { 92854878170, 92871637895, 1921 }, { 92871560657, 92888324756, 2340 },
+    { 92888236171, 92905074034, 2237 }, { 92904919949, 92921774817, 1839 },
+    { 92921648176, 92938479950, 2430 }, { 92938293945, 92955042275, 1971 },
+    { 92954968958, 92971756693, 2287 }, { 92971665435, 92988441012, 5593 },
+    { 92988345570, 93005240007, 2268 }, { 93005021980, 93021802559, 2018 },
+    { 93021710388, 93038595485, 2237 }, { 93038429081, 93055253467, 2164 },
+    { 93055125324, 93071832377, 2189 }, { 93071783102, 93088684505, 2023 },
+    { 93088494268, 93105257751, 2111 }, { 93105184129, 93121913711, 2636 },
+    { 93121871762, 93138702709, 2311 }, { 93138519406, 93155289365, 2185 },
+    { 93155179044, 93172112508, 2415 }, { 93171897567, 93188683044, 2405 },
+    { 93188572663, 93205330686, 2197 }, { 93205275202, 93222128651, 2348 },
+    { 93221947592, 93238825893, 1925 }, { 93238630436, 93255395929, 2285 },
+    { 93255332508, 93272050622, 2168 }, { 93271989607, 93288722693, 2093 },
+    { 93288674598, 93305509883, 2094 }, { 93305346736, 93322157678, 2231 },
+    { 93322042761, 93338870409, 2440 }, { 93338720335, 93355600266, 2255 },
+    { 93355393126, 93372219160, 2227 }, { 93372110834, 93388891562, 2481 },
+    { 93388774324, 93405707646, 2170 }, { 93405509497, 93422236812, 2054 },
+};
+static const size_t kNumTracedFrames = sizeof(kFrameTrace) / sizeof(kFrameTrace[0]);
+
+} // namespace android
+
+#endif // ANDROID_PHASEOFFSET_FRAMETRACE_H
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "PhaseOffsetController_test"
+
+#include <gtest/gtest.h>
+
+#include <deque>
+
+#include <utils/Timers.h>
+
+#include "FrameTrace.h"
+#include "PhaseOffsetController.h"
+
+namespace android {
+
+static const nsecs_t kPeriod = 16666667;
+static const nsecs_t kAppPhaseOffset = 1000000;
+static const nsecs_t kSfPhaseOffset = 0;
+static const float kTargetMissRate = 0.01f;
+
+// Composition times, in microseconds, of consecutive frames recorded while
+// scrolling a list: mostly short GLES compositions with a few slow ones.
+static const nsecs_t kRecordedCompositionUs[] = {
+    2210, 2380, 2050, 1980, 2460, 3120, 2240, 2170, 2090, 2300,
+    2410, 2150, 1940, 2060, 5870, 2230, 2310, 2180, 2010, 2290,
+    2350, 2120, 2480, 2260, 2070, 1990, 2140, 2330, 2220, 2450,
+    3380, 2190, 2030, 2100, 2270, 2360, 2080, 2160, 2250, 2400,
+    2130, 1970, 2200, 2320, 2040, 2280, 2390, 2110, 6120, 2230,
+    2170, 2060, 2340, 2190, 2010, 2260, 2430, 2150, 2080, 2300,
+};
+static const size_t kNumRecordedFrames =
+        sizeof(kRecordedCompositionUs) / sizeof(kRecordedCompositionUs[0]);
+
+// Replays composition times against an ideal display, waking the simulated
+// SurfaceFlinger at the phase offset chosen by the controller. The timing
+// of a frame reaches the controller two frames after it was composed, like
+// it does once the present fence has signaled.
+class PhaseOffsetSimulator {
+public:
+    PhaseOffsetSimulator() :
+            mController(kAppPhaseOffset, kSfPhaseOffset, kTargetMissRate),
+            mSfPhaseOffset(kSfPhaseOffset),
+            mAppPhaseOffset(kAppPhaseOffset),
+            mMaxSfPhaseOffset(kSfPhaseOffset),
+            mLastPresentTime(0),
+            mFrame(0),
+            mNumMissedFrames(0) {}
+    virtual ~PhaseOffsetSimulator() {}
+
+    // runs numFrames frames, adding extraTime to each recorded composition
+    // time, and returns the number of frames that missed their refresh but
+    // would have made it at the configured offsets
+    size_t run(size_t numFrames, nsecs_t extraTime) {
+        size_t missed = 0;
+        const nsecs_t period = getPeriod();
+        for (size_t i = 0; i < numFrames; i++, mFrame++) {
+            const nsecs_t duration = getCompositionTime(mFrame) + extraTime;
+
+            PhaseOffsetController::FrameTiming timing;
+            timing.refreshStartTime =
+                    getVsyncTime(mFrame) + normalize(mSfPhaseOffset, period);
+            timing.expectedPresentTime = getVsyncTime(mFrame + 1);
+            timing.compositionDoneTime = timing.refreshStartTime + duration;
+            nsecs_t shownAt = mFrame + 1;
+            while (getVsyncTime(shownAt) < timing.compositionDoneTime) {
+                shownAt++;
+            }
+            if (shownAt != mFrame + 1 &&
+                    getVsyncTime(mFrame) + normalize(kSfPhaseOffset, period) +
+                            duration <= timing.expectedPresentTime) {
+                missed++;
+            }
+            timing.presentTime = getVsyncTime(shownAt) + getPresentLatency(mFrame);
+            mLastPresentTime = timing.presentTime;
+            mPending.push_back(timing);
+
+            if (mPending.size() > 2) {
+                const nsecs_t now = timing.refreshStartTime;
+                if (mController.addFrame(mPending.front(), period, now)) {
+                    mSfPhaseOffset = mController.getSfPhaseOffset();
+                    mAppPhaseOffset = mController.getAppPhaseOffset();
+                    if (mSfPhaseOffset > mMaxSfPhaseOffset) {
+                        mMaxSfPhaseOffset = mSfPhaseOffset;
+                    }
+                }
+                mPending.pop_front();
+            }
+        }
+        mNumMissedFrames += missed;
+        return missed;
+    }
+
+    nsecs_t getSfPhaseOffset() const { return mSfPhaseOffset; }
+    nsecs_t getAppPhaseOffset() const { return mAppPhaseOffset; }
+    nsecs_t getMaxSfPhaseOffset() const { return mMaxSfPhaseOffset; }
+    nsecs_t getLastPresentTime() const { return mLastPresentTime; }
+
+protected:
+    // the period DispSync would report for the display
+    virtual nsecs_t getPeriod() const { return kPeriod; }
+    virtual nsecs_t getVsyncTime(nsecs_t frame) const { return frame * kPeriod; }
+    virtual nsecs_t getCompositionTime(nsecs_t frame) const {
+        return us2ns(kRecordedCompositionUs[frame % kNumRecordedFrames]);
+    }
+    // how long after the vsync the frame is shown at its present fence signals
+    virtual nsecs_t getPresentLatency(nsecs_t) const { return 0; }
+
+private:
+    static nsecs_t normalize(nsecs_t offset, nsecs_t period) {
+        offset %= period;
+        return offset < 0 ? offset + period : offset;
+    }
+
+    PhaseOffsetController mController;
+    std::deque<PhaseOffsetController::FrameTiming> mPending;
+    nsecs_t mSfPhaseOffset;
+    nsecs_t mAppPhaseOffset;
+    nsecs_t mMaxSfPhaseOffset;
+    nsecs_t mLastPresentTime;
+    nsecs_t mFrame;
+    size_t mNumMissedFrames;
+};
+
+// Replays kFrameTrace instead: its vsync timestamps, composition times and
+// present fence latencies, looping over the trace as needed.
+class TracedPhaseOffsetSimulator : public PhaseOffsetSimulator {
+public:
+    TracedPhaseOffsetSimulator() :
+            mPeriod((kFrameTrace[kNumTracedFrames - 1].vsyncTime -
+                    kFrameTrace[0].vsyncTime) / nsecs_t(kNumTracedFrames - 1)) {}
+
+protected:
+    virtual nsecs_t getPeriod() const { return mPeriod; }
+
+    virtual nsecs_t getVsyncTime(nsecs_t frame) const {
+        const nsecs_t span = kFrameTrace[kNumTracedFrames - 1].vsyncTime -
+                kFrameTrace[0].vsyncTime + mPeriod;
+        return kFrameTrace[frame % kNumTracedFrames].vsyncTime +
+                frame / kNumTracedFrames * span;
+    }
+
+    virtual nsecs_t getCompositionTime(nsecs_t frame) const {
+        return us2ns(kFrameTrace[frame % kNumTracedFrames].compositionUs);
+    }
+
+    virtual nsecs_t getPresentLatency(nsecs_t frame) const {
+        const nsecs_t traced = frame % kNumTracedFrames;
+        const nsecs_t presentTime = kFrameTrace[traced].presentTime;
+        nsecs_t shownAt = traced + 1;
+        while (getVsyncTime(shownAt + 1) <= presentTime) {
+            shownAt++;
+        }
+        return presentTime - getVsyncTime(shownAt);
+    }
+
+private:
+    const nsecs_t mPeriod;
+};
+
+TEST(PhaseOffsetControllerTest, KeepsConfiguredOffsetsUntilAWindowIsSeen) {
+    PhaseOffsetSimulator sim;
+    sim.run(PhaseOffsetController::WINDOW_SIZE, 0);
+    EXPECT_EQ(kSfPhaseOffset, sim.getSfPhaseOffset());
+    EXPECT_EQ(kAppPhaseOffset, sim.getAppPhaseOffset());
+}
+
+TEST(PhaseOffsetControllerTest, WakesLaterWhenCompositionIsFast) {
+    PhaseOffsetSimulator sim;
+    size_t missed = sim.run(60 * 60, 0);
+
+    // A few ms of composition leave most of the period unused
+    EXPECT_GT(sim.getSfPhaseOffset(), kSfPhaseOffset + ms2ns(6));
+    EXPECT_LE(sim.getSfPhaseOffset(),
+            kPeriod - PhaseOffsetController::MIN_COMPOSITION_BUDGET);
+    EXPECT_LE(missed, size_t(60 * 60 * kTargetMissRate));
+
+    // Apps keep the same distance to SurfaceFlinger
+    EXPECT_EQ(kAppPhaseOffset - kSfPhaseOffset,
+            sim.getAppPhaseOffset() - sim.getSfPhaseOffset());
+}
+
+TEST(PhaseOffsetControllerTest, BacksOffWhenCompositionSlowsDown) {
+    PhaseOffsetSimulator sim;
+    sim.run(60 * 60, 0);
+    const nsecs_t fastOffset = sim.getSfPhaseOffset();
+
+    // Composition now takes 6 ms more: the controller must recover quickly
+    // and then stay under the target miss rate.
+    sim.run(60 * 10, ms2ns(6));
+    size_t missed = sim.run(60 * 60, ms2ns(6));
+    EXPECT_LT(sim.getSfPhaseOffset(), fastOffset);
+    EXPECT_LE(missed, size_t(60 * 60 * kTargetMissRate));
+}
+
+TEST(PhaseOffsetControllerTest, NeverWakesEarlierThanConfigured) {
+    PhaseOffsetSimulator sim;
+    // Composition longer than a period misses every refresh regardless
+    sim.run(60 * 10, kPeriod);
+    EXPECT_EQ(kSfPhaseOffset, sim.getSfPhaseOffset());
+    EXPECT_EQ(kAppPhaseOffset, sim.getAppPhaseOffset());
+    EXPECT_EQ(kSfPhaseOffset, sim.getMaxSfPhaseOffset());
+}
+
+TEST(PhaseOffsetControllerTest, TracedDisplayReplaysTheTraceAtConfiguredOffsets) {
+    TracedPhaseOffsetSimulator sim;
+    for (size_t i = 0; i < PhaseOffsetController::WINDOW_SIZE; i++) {
+        sim.run(1, 0);
+        EXPECT_EQ(kFrameTrace[i].presentTime, sim.getLastPresentTime())
+                << "frame " << i;
+    }
+    EXPECT_EQ(kSfPhaseOffset, sim.getSfPhaseOffset());
+}
+
+TEST(PhaseOffsetControllerTest, TracedDisplayWakesLaterDespiteJitter) {
+    TracedPhaseOffsetSimulator sim;
+    size_t missed = sim.run(60 * 60, 0);
+
+    EXPECT_GT(sim.getSfPhaseOffset(), kSfPhaseOffset + ms2ns(6));
+    EXPECT_LE(sim.getSfPhaseOffset(),
+            kPeriod - PhaseOffsetController::MIN_COMPOSITION_BUDGET);
+    EXPECT_LE(missed, size_t(60 * 60 * kTargetMissRate));
+    EXPECT_EQ(kAppPhaseOffset - kSfPhaseOffset,
+            sim.getAppPhaseOffset() - sim.getSfPhaseOffset());
+}
+
+TEST(PhaseOffsetControllerTest, TracedDisplayBacksOffWhenCompositionSlowsDown) {
+    TracedPhaseOffsetSimulator sim;
+    sim.run(60 * 60, 0);
+    const nsecs_t fastOffset = sim.getSfPhaseOffset();
+
+    sim.run(60 * 10, ms2ns(6));
+    size_t missed = sim.run(60 * 60, ms2ns(6));
+    EXPECT_LT(sim.getSfPhaseOffset(), fastOffset);
+    EXPECT_LE(missed, size_t(60 * 60 * kTargetMissRate));
+}
+
+TEST(PhaseOffsetControllerTest, ResetRestoresConfiguredOffsets) {
+    PhaseOffsetController controller(kAppPhaseOffset, kSfPhaseOffset,
+            kTargetMissRate);
+    for (size_t i = 0; i < PhaseOffsetController::WINDOW_SIZE; i++) {
+        PhaseOffsetController::FrameTiming timing;
+        timing.refreshStartTime = i * kPeriod;
+        timing.expectedPresentTime = timing.refreshStartTime + kPeriod;
+        timing.compositionDoneTime = timing.refreshStartTime + ms2ns(1);
+        timing.presentTime = timing.expectedPresentTime;
+        controller.addFrame(timing, kPeriod, timing.presentTime);
+    }
+    EXPECT_GT(controller.getSfPhaseOffset(), kSfPhaseOffset);
+
+    controller.reset();
+    EXPECT_EQ(kSfPhaseOffset, controller.getSfPhaseOffset());
+    EXPECT_EQ(kAppPhaseOffset, controller.getAppPhaseOffset());
+}
+
+} // namespace android